@@ -14,10 +14,10 @@
  */
 #define _POSIX_SOURCE 1
 /**
- * This hash define is needed before including source files give us POSIX.4/IEEE1003.1b-1993 prototypes
- * for clock_gettime.
+ * This hash define is needed before including source files give us POSIX.1-2001 prototypes
+ * for clock_gettime and clock_nanosleep.
  */
-#define _POSIX_C_SOURCE 199309L
+#define _POSIX_C_SOURCE 200112L
 
 #include <errno.h>
 #include <fcntl.h>
@@ -55,19 +55,72 @@ static char rcsid[] = "$Id: ccd_dsp.c,v 0.56 2011-01-17 10:57:54 cjm Exp $";
  * @see #CCD_DSP_DON
  */
 #define	DSP_ACTUAL_VALUE 		-1 /* flag indicating return value of DSP command is to be returned as data */
+/**
+ * Priority of housekeeping commands (utility board memory reads for temperatures and voltages).
+ * These wait for any queued commands of a higher priority.
+ * @see #DSP_Mutex_Lock
+ */
+#define DSP_PRIORITY_HOUSEKEEPING	(0)
+/**
+ * Priority of most commands (setup, memory writes, power).
+ * @see #DSP_Mutex_Lock
+ */
+#define DSP_PRIORITY_NORMAL		(1)
+/**
+ * Priority of exposure control commands (start/pause/resume/abort exposure, shutter, status and readout
+ * progress reads). These are sent before any queued commands of a lower priority.
+ * @see #DSP_Mutex_Lock
+ */
+#define DSP_PRIORITY_EXPOSURE		(2)
+/**
+ * The number of command priorities.
+ */
+#define DSP_PRIORITY_COUNT		(3)
+/**
+ * The time, in nanoseconds, before the START_EXPOSURE command is due to be sent that DSP_Send_Sex stops
+ * sleeping and busy waits instead. This allows for the time the kernel takes to wake us from a sleep.
+ * @see #DSP_Send_Sex
+ */
+#define DSP_START_EXPOSURE_SPIN_TIME	(500*CCD_GLOBAL_ONE_MICROSECOND_NS)
+/**
+ * The time, in nanoseconds, before the START_EXPOSURE command is due to be sent that CCD_DSP_Command_SEX 
+ * stops waiting for the start time and takes the controller access lock. The rest of the wait is done with the
+ * lock held, so other commands cannot delay the START_EXPOSURE, but the lock is not held for the whole wait, 
+ * which would stop other controllers (e.g. the other arm) starting their exposures on time.
+ * @see #CCD_DSP_Command_SEX
+ * @see #DSP_Wait_Start_Time
+ */
+#define DSP_START_EXPOSURE_LOCK_TIME	(5*CCD_GLOBAL_ONE_MILLISECOND_NS)
+/**
+ * The time to sleep, in nanoseconds, between requests for the readout progress in 
+ * CCD_DSP_Command_Wait_Readout_Progress.
+ * @see #CCD_DSP_Command_Wait_Readout_Progress
+ */
+#define DSP_WAIT_PROGRESS_POLL_NS	(CCD_GLOBAL_ONE_MILLISECOND_NS)
 
 /* structure */
 /**
- * Structure used to hold local data to ccd_dsp.
+ * Structure used to hold local data to ccd_dsp. The optionally compiled controller access lock is
+ * a priority lock, built from a mutex and condition variable, see DSP_Mutex_Lock.
  * <dl>
- * <dt>Mutex</dt> <dd>Optionally compiled mutex locking for sending commands and getting replies from the 
- *    controller.</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting the lock state (Locked and Waiting_Count). It is only held whilst
+ *    the state is changed, not whilst commands are sent to the controller.</dd>
+ * <dt>Condition</dt> <dd>Condition variable signalled when the lock is released.</dd>
+ * <dt>Locked</dt> <dd>Whether a thread currently holds the controller access lock.</dd>
+ * <dt>Waiting_Count</dt> <dd>The number of threads waiting for the lock, at each priority.</dd>
+ * <dt>Mutex_Lock_Time</dt> <dd>The time the lock was last acquired, so the time it is held
+ *    for can be added to the handle's metrics when it is released. Only accessed whilst holding the lock.</dd>
  * </dl>
+ * @see #DSP_PRIORITY_COUNT
  */
 struct DSP_Struct
 {
 #ifdef CCD_DSP_MUTEXED
       pthread_mutex_t Mutex;
+      pthread_cond_t Condition;
+      int Locked;
+      int Waiting_Count[DSP_PRIORITY_COUNT];
+      struct timespec Mutex_Lock_Time;
 #endif
 };
 
@@ -75,24 +128,36 @@ struct DSP_Struct
 
 /* internal variables */
 /**
- * Variable holding error code of last operation performed by ccd_dsp.
+ * Variable holding error code of last operation performed by ccd_dsp,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int DSP_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int DSP_Error_Number = 0;
 /**
- * Internal  variable holding description of the last error that occured.
+ * Internal  variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char DSP_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char DSP_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 /**
  * Data holding the current status of ccd_dsp. This is statically initialised to the following:
  * <dl>
  * <dt>Mutex</dt> <dd>If compiled in, PTHREAD_MUTEX_INITIALIZER</dd>
+ * <dt>Condition</dt> <dd>If compiled in, PTHREAD_COND_INITIALIZER</dd>
+ * <dt>Locked</dt> <dd>If compiled in, FALSE</dd>
+ * <dt>Waiting_Count</dt> <dd>If compiled in, all 0</dd>
+ * <dt>Mutex_Lock_Time</dt> <dd>If compiled in, {0,0}</dd>
  * </dl>
  * @see #DSP_Struct
  */
 static struct DSP_Struct DSP_Data = 
 {
 #ifdef CCD_DSP_MUTEXED
-      PTHREAD_MUTEX_INITIALIZER
+      PTHREAD_MUTEX_INITIALIZER,
+      PTHREAD_COND_INITIALIZER,
+      FALSE,
+      {0,0,0},
+      {0,0}
 #endif
 };
 
@@ -129,6 +194,8 @@ static int DSP_Send_Pex(char *class,char *source,CCD_Interface_Handle_T* handle,
 static int DSP_Send_Pon(char *class,char *source,CCD_Interface_Handle_T* handle,int *reply_value);
 static int DSP_Send_Pof(char *class,char *source,CCD_Interface_Handle_T* handle,int *reply_value);
 static int DSP_Send_Rex(char *class,char *source,CCD_Interface_Handle_T* handle,int *reply_value);
+static int DSP_Wait_Start_Time(char *class,char *source,CCD_Interface_Handle_T* handle,
+			       struct timespec start_time);
 static int DSP_Send_Sex(char *class,char *source,CCD_Interface_Handle_T* handle,
 			struct timespec start_time,int exposure_length, int *reply_value);
 static int DSP_Send_Reset(char *class,char *source,CCD_Interface_Handle_T* handle,int *reply_value);
@@ -145,12 +212,17 @@ static int DSP_Send_Manual_Command(char *class,char *source,CCD_Interface_Handle
 static int DSP_Send_Command(char *class,char *source,CCD_Interface_Handle_T* handle,
 			    int hcvr_command,int *reply_value);
 static int DSP_Check_Reply(char *class,char *source,int reply,int expected_reply);
+static int DSP_Transaction_Add(struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_BOARD_ID board_id,
+			       int command,int *argument_list,int argument_count);
 
 #ifdef CCD_DSP_MUTEXED
-static int DSP_Mutex_Lock(CCD_Interface_Handle_T* handle);
+static int DSP_Mutex_Lock(CCD_Interface_Handle_T* handle,int priority);
 static int DSP_Mutex_Unlock(CCD_Interface_Handle_T* handle);
 #endif
 static char *DSP_Manual_Command_To_String(int manual_command);
+static void DSP_Sleep_Until(struct timespec wake_time);
+static long long DSP_TimeSpec_Diff_NS(struct timespec start_time,struct timespec end_time);
+static void DSP_TimeSpec_Add_NS(struct timespec *time,long long ns);
 
 /* external functions */
 
@@ -193,6 +265,7 @@ int CCD_DSP_Initialise(void)
  * Routine to initialise the dsp data in the interface handle. The data is initialsied as follows:
  * <dl>
  * <dt>Abort</dt> <dd>FALSE</dd>
+ * <dt>Download_Readback_Sample_Count</dt> <dd>0 (always download)</dd>
  * </dl>
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @see ccd_dsp_private.html#CCD_DSP_Struct
@@ -201,6 +274,7 @@ int CCD_DSP_Initialise(void)
 void CCD_DSP_Data_Initialise(CCD_Interface_Handle_T* handle)
 {
 	handle->DSP_Data.Abort = FALSE;
+	handle->DSP_Data.Download_Readback_Sample_Count = 0;
 }
 
 /* Boot commands */
@@ -248,7 +322,7 @@ int CCD_DSP_Command_LDA(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Lda(class,source,handle,board_id,application_number,&retval))
@@ -309,6 +383,9 @@ int CCD_DSP_Command_RDM(char *class,char *source,CCD_Interface_Handle_T* handle,
 			enum CCD_DSP_BOARD_ID board_id,enum CCD_DSP_MEM_SPACE mem_space,int address)
 {
 	int retval;
+#ifdef CCD_DSP_MUTEXED
+	int priority;
+#endif
 
 	DSP_Error_Number = 0;
 #if LOGGING > 4
@@ -337,7 +414,12 @@ int CCD_DSP_Command_RDM(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	/* utility board reads are temperature and voltage housekeeping, and should not delay exposure commands */
+	if(board_id == CCD_DSP_UTIL_BOARD_ID)
+		priority = DSP_PRIORITY_HOUSEKEEPING;
+	else
+		priority = DSP_PRIORITY_NORMAL;
+	if(!DSP_Mutex_Lock(handle,priority))
 		return FALSE;
 #endif
 /* Version 1.3: We can only read memory on the utility board when we are not exposing.
@@ -425,7 +507,7 @@ int CCD_DSP_Command_TDL(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 /* Version 1.3: We can only TDL on the utility board when we are not exposing.
@@ -534,7 +616,7 @@ int CCD_DSP_Command_WRM(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 /* Version 1.3: We can only write memory on the utility board when we are not exposing.
@@ -589,6 +671,459 @@ int CCD_DSP_Command_WRM(char *class,char *source,CCD_Interface_Handle_T* handle,
 	return retval;
 }
 
+/**
+ * This routine writes a contiguous block of words to a SDSU Controller board, using one WRite Memory (WRM)
+ * command per word. The arguments are validated once, and if mutex locking has been compiled in, the
+ * mutex is held for the whole block, so other threads' commands cannot be interleaved and the
+ * per-word lock/unlock and logging overhead of CCD_DSP_Command_WRM is avoided.
+ * The abort flag is checked between words.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param board_id The SDSU CCD Controller board to send the command to, one of 
+ * 	CCD_DSP_INTERFACE_BOARD_ID(interface),
+ *	CCD_DSP_TIM_BOARD_ID(timing board) or CCD_DSP_UTIL_BOARD_ID(utility board).
+ * @param mem_space The memory space on board board_id to write to, of type 
+ * <a href="#CCD_DSP_MEM_SPACE">CCD_DSP_MEM_SPACE</a>. One of:
+ * 	CCD_DSP_MEM_SPACE_P(program),
+ * 	CCD_DSP_MEM_SPACE_X(X data),
+ * 	CCD_DSP_MEM_SPACE_Y(Y data)
+ * 	or CCD_DSP_MEM_SPACE_R(ROM).
+ * @param address The memory address to write the first data word to.
+ * @param data_list A list of data values to write to consecutive memory addresses.
+ * @param data_count The number of data values in data_list.
+ * @return The routine returns DON if all the words were written and FALSE if the command failed.
+ * @see #CCD_DSP_Command_WRM
+ * @see #DSP_Send_Wrm
+ * @see #DSP_Check_Reply
+ * @see #CCD_DSP_Get_Abort
+ * @see ccd_exposure.html#CCD_Exposure_Get_Exposure_Status
+ * @see ccd_exposure.html#CCD_EXPOSURE_STATUS
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_DSP_Command_WRM_Block(char *class,char *source,CCD_Interface_Handle_T* handle,
+			      enum CCD_DSP_BOARD_ID board_id,enum CCD_DSP_MEM_SPACE mem_space,int address,
+			      int *data_list,int data_count)
+{
+	int retval,i;
+
+	DSP_Error_Number = 0;
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+			      "CCD_DSP_Command_WRM_Block(handle=%p,board_id=%d,mem_space=%d,address=%#x,"
+			      "data_count=%d) started.",handle,board_id,mem_space,address,data_count);
+#endif
+	/* check - is board_id a legal value */
+	if(!CCD_DSP_IS_BOARD_ID(board_id))
+	{
+		DSP_Error_Number = 115;
+		sprintf(DSP_Error_String,"CCD_DSP_Command_WRM_Block:Illegal board ID '%d'.",board_id);
+		return FALSE;
+	}
+	if(!CCD_DSP_IS_MEMORY_SPACE(mem_space))
+	{
+		DSP_Error_Number = 116;
+		sprintf(DSP_Error_String,"CCD_DSP_Command_WRM_Block:Illegal memory space '%c'.",mem_space);
+		return FALSE;
+	}
+	if((address < 0)||(data_list == NULL)||(data_count < 0))
+	{
+		DSP_Error_Number = 117;
+		sprintf(DSP_Error_String,"CCD_DSP_Command_WRM_Block:Illegal block (address=%#x,data_list=%p,"
+			"data_count=%d).",address,data_list,data_count);
+		return FALSE;
+	}
+#ifdef CCD_DSP_MUTEXED
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
+		return FALSE;
+#endif
+/* See CCD_DSP_Command_WRM for when we can write memory on the utility board. */
+#ifdef CCD_DSP_UTIL_EXPOSURE_CHECK
+#if CCD_DSP_UTIL_EXPOSURE_CHECK == 1
+	if((board_id == CCD_DSP_UTIL_BOARD_ID)&&
+	   (CCD_Exposure_Get_Exposure_Status(handle) != CCD_EXPOSURE_STATUS_NONE)&&
+	   (CCD_Exposure_Get_Exposure_Status(handle) != CCD_EXPOSURE_STATUS_WAIT_START)&&
+	   (CCD_Exposure_Get_Exposure_Status(handle) != CCD_EXPOSURE_STATUS_POST_READOUT))
+#elif CCD_DSP_UTIL_EXPOSURE_CHECK == 2
+	if ((CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_PRE_READOUT)||
+	   (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_READOUT))
+#elif CCD_DSP_UTIL_EXPOSURE_CHECK == 3
+	if ((CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_WAIT_START)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_CLEAR)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_EXPOSE)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_PRE_READOUT)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_READOUT))
+#endif
+	{
+#ifdef CCD_DSP_MUTEXED
+		DSP_Mutex_Unlock(handle);
+#endif
+		DSP_Error_Number = 91; /* this error code is checked for in the Java layer */
+		sprintf(DSP_Error_String,"CCD_DSP_Command_WRM_Block failed:Illegal Exposure Status (%d) when"
+			" writing to the utility board.",CCD_Exposure_Get_Exposure_Status(handle));
+		return FALSE;
+	}
+#endif
+	for(i = 0; i < data_count; i++)
+	{
+		if(CCD_DSP_Get_Abort(handle))
+		{
+#ifdef CCD_DSP_MUTEXED
+			DSP_Mutex_Unlock(handle);
+#endif
+			DSP_Error_Number = 118;
+			sprintf(DSP_Error_String,"CCD_DSP_Command_WRM_Block:Aborted at word %d of %d.",i,data_count);
+			return FALSE;
+		}
+		if(!DSP_Send_Wrm(class,source,handle,board_id,mem_space,address+i,data_list[i],&retval))
+		{
+#ifdef CCD_DSP_MUTEXED
+			DSP_Mutex_Unlock(handle);
+#endif
+			return FALSE;
+		}
+		/* check reply - DON should be returned */
+		if(DSP_Check_Reply(class,source,retval,CCD_DSP_DON) != CCD_DSP_DON)
+		{
+#ifdef CCD_DSP_MUTEXED
+			DSP_Mutex_Unlock(handle);
+#endif
+			return FALSE;
+		}
+	}
+#ifdef CCD_DSP_MUTEXED
+	if(!DSP_Mutex_Unlock(handle))
+		return FALSE;
+#endif
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+			      "CCD_DSP_Command_WRM_Block(%d,%d,%#x,%d) returned DON.",
+			      board_id,mem_space,address,data_count);
+#endif
+	return CCD_DSP_DON;
+}
+
+/* transactions */
+/**
+ * Routine to initialise a DSP transaction, so it contains no commands. This should be called before
+ * any commands are added to the transaction.
+ * @param transaction The address of the transaction to initialise.
+ * @see #CCD_DSP_Transaction_Struct
+ */
+void CCD_DSP_Transaction_Initialise(struct CCD_DSP_Transaction_Struct *transaction)
+{
+	if(transaction == NULL)
+		return;
+	transaction->Command_Count = 0;
+	transaction->Failed_Index = -1;
+}
+
+/**
+ * Routine to queue a WRite Memory (WRM) command in a DSP transaction. The arguments are checked as
+ * CCD_DSP_Command_WRM would check them.
+ * @param transaction The address of the transaction to add the command to.
+ * @param board_id The SDSU CCD Controller board to send the command to, one of 
+ * 	CCD_DSP_INTERFACE_BOARD_ID(interface),
+ *	CCD_DSP_TIM_BOARD_ID(timing board) or CCD_DSP_UTIL_BOARD_ID(utility board).
+ * @param mem_space The memory space on board board_id to write to, of type 
+ * <a href="#CCD_DSP_MEM_SPACE">CCD_DSP_MEM_SPACE</a>.
+ * @param address The memory address to write data to.
+ * @param data The data value to write to the memory address.
+ * @return The routine returns TRUE if the command was queued, and FALSE if an error occured.
+ * @see #CCD_DSP_Command_WRM
+ * @see #DSP_Transaction_Add
+ * @see #CCD_DSP_WRM
+ */
+int CCD_DSP_Transaction_Add_WRM(struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_BOARD_ID board_id,
+				enum CCD_DSP_MEM_SPACE mem_space,int address,int data)
+{
+	int argument_list[2];
+
+	DSP_Error_Number = 0;
+	if(!CCD_DSP_IS_BOARD_ID(board_id))
+	{
+		DSP_Error_Number = 121;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_WRM:Illegal board ID '%d'.",board_id);
+		return FALSE;
+	}
+	if(!CCD_DSP_IS_MEMORY_SPACE(mem_space))
+	{
+		DSP_Error_Number = 122;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_WRM:Illegal memory space '%c'.",mem_space);
+		return FALSE;
+	}
+	if(address < 0)
+	{
+		DSP_Error_Number = 123;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_WRM:Illegal address '%#x'.",address);
+		return FALSE;
+	}
+	argument_list[0] = (mem_space | address);
+	argument_list[1] = data;
+	return DSP_Transaction_Add(transaction,board_id,CCD_DSP_WRM,argument_list,2);
+}
+
+/**
+ * Routine to queue a Set GaiN (SGN) command in a DSP transaction. The arguments are checked as
+ * CCD_DSP_Command_SGN would check them.
+ * @param transaction The address of the transaction to add the command to.
+ * @param gain The gain to set the video processors to, one of the CCD_DSP_GAIN enum values.
+ * @param speed The integrator speed to set the video processors to. Either 0 or 1.
+ * @return The routine returns TRUE if the command was queued, and FALSE if an error occured.
+ * @see #CCD_DSP_Command_SGN
+ * @see #DSP_Transaction_Add
+ * @see #CCD_DSP_SGN
+ */
+int CCD_DSP_Transaction_Add_SGN(struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_GAIN gain,int speed)
+{
+	int argument_list[2];
+
+	DSP_Error_Number = 0;
+	if(!CCD_DSP_IS_GAIN(gain))
+	{
+		DSP_Error_Number = 124;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_SGN:Illegal gain '%d'.",gain);
+		return FALSE;
+	}
+	if(!CCD_GLOBAL_IS_BOOLEAN(speed))
+	{
+		DSP_Error_Number = 125;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_SGN:Illegal speed '%d'.",speed);
+		return FALSE;
+	}
+	argument_list[0] = gain;
+	argument_list[1] = speed;
+	return DSP_Transaction_Add(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_SGN,argument_list,2);
+}
+
+/**
+ * Routine to queue a Set Output Source (SOS) command in a DSP transaction. The argument is checked as
+ * CCD_DSP_Command_SOS would check it.
+ * @param transaction The address of the transaction to add the command to.
+ * @param amplifier The amplifier to use when reading out the CCD, one of the CCD_DSP_AMPLIFIER enum values.
+ * @return The routine returns TRUE if the command was queued, and FALSE if an error occured.
+ * @see #CCD_DSP_Command_SOS
+ * @see #DSP_Transaction_Add
+ * @see #CCD_DSP_SOS
+ */
+int CCD_DSP_Transaction_Add_SOS(struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_AMPLIFIER amplifier)
+{
+	int argument_list[1];
+
+	DSP_Error_Number = 0;
+	if(!CCD_DSP_IS_AMPLIFIER(amplifier))
+	{
+		DSP_Error_Number = 126;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_SOS:Illegal amplifier '%d'.",amplifier);
+		return FALSE;
+	}
+	argument_list[0] = amplifier;
+	return DSP_Transaction_Add(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_SOS,argument_list,1);
+}
+
+/**
+ * Routine to queue a Set Subarray Position (SSP) command in a DSP transaction. The arguments are checked as
+ * CCD_DSP_Command_SSP would check them.
+ * @param transaction The address of the transaction to add the command to.
+ * @param y_offset The number of rows (parallel) to clear AFTER THE LAST BOX (in pixels).
+ * @param x_offset The number of columns (serial) to clear from the left hand edge of the chip (in pixels).
+ * @param bias_x_offset The number of columns (serial) gap to leave between the right hand side of
+ *        the subarray box and the start of the bias strip (in pixels).
+ * @return The routine returns TRUE if the command was queued, and FALSE if an error occured.
+ * @see #CCD_DSP_Command_SSP
+ * @see #DSP_Transaction_Add
+ * @see #CCD_DSP_SSP
+ */
+int CCD_DSP_Transaction_Add_SSP(struct CCD_DSP_Transaction_Struct *transaction,int y_offset,int x_offset,
+				int bias_x_offset)
+{
+	int argument_list[3];
+
+	DSP_Error_Number = 0;
+	if((y_offset < 0)||(x_offset < 0)||(bias_x_offset < 0))
+	{
+		DSP_Error_Number = 127;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_SSP:Illegal offset (%d,%d,%d).",
+			y_offset,x_offset,bias_x_offset);
+		return FALSE;
+	}
+	argument_list[0] = y_offset;
+	argument_list[1] = x_offset;
+	argument_list[2] = bias_x_offset;
+	return DSP_Transaction_Add(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_SSP,argument_list,3);
+}
+
+/**
+ * Routine to queue a Set Subarray Size (SSS) command in a DSP transaction. The arguments are checked as
+ * CCD_DSP_Command_SSS would check them.
+ * @param transaction The address of the transaction to add the command to.
+ * @param bias_width The width of the bias strip (in pixels).
+ * @param box_width The width of the subarray box (in pixels).
+ * @param box_height The height of the subarray box (in pixels).
+ * @return The routine returns TRUE if the command was queued, and FALSE if an error occured.
+ * @see #CCD_DSP_Command_SSS
+ * @see #DSP_Transaction_Add
+ * @see #CCD_DSP_SSS
+ */
+int CCD_DSP_Transaction_Add_SSS(struct CCD_DSP_Transaction_Struct *transaction,int bias_width,int box_width,
+				int box_height)
+{
+	int argument_list[3];
+
+	DSP_Error_Number = 0;
+	if((bias_width < 0)||(box_width < 0)||(box_height < 0))
+	{
+		DSP_Error_Number = 128;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Add_SSS:Illegal size (%d,%d,%d).",
+			bias_width,box_width,box_height);
+		return FALSE;
+	}
+	argument_list[0] = bias_width;
+	argument_list[1] = box_width;
+	argument_list[2] = box_height;
+	return DSP_Transaction_Add(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_SSS,argument_list,3);
+}
+
+/**
+ * Routine to send all the commands queued in a DSP transaction to the controller. If mutex locking has
+ * been compiled in, the mutex is locked once for the whole transaction, and the commands are sent back to back.
+ * The abort flag is checked between commands. The replies are not checked until all the commands have been sent;
+ * each reply should be DON, and if one is not the transaction's Failed_Index is set to the index of that
+ * command, and the error string says which command it was.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param transaction The address of the transaction to send. The Reply of each command is filled in.
+ * @return The routine returns DON if all the commands succeeded and FALSE if one failed.
+ * @see #CCD_DSP_Transaction_Struct
+ * @see #DSP_Send_Manual_Command
+ * @see #DSP_Check_Reply
+ * @see #CCD_DSP_Get_Abort
+ * @see ccd_exposure.html#CCD_Exposure_Get_Exposure_Status
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_DSP_Transaction_Submit(char *class,char *source,CCD_Interface_Handle_T* handle,
+			       struct CCD_DSP_Transaction_Struct *transaction)
+{
+	struct CCD_DSP_Transaction_Command_Struct *command = NULL;
+	char reply_error_string[CCD_GLOBAL_ERROR_STRING_LENGTH];
+	int i;
+#ifdef CCD_DSP_UTIL_EXPOSURE_CHECK
+	int wrm_count,util_wrm_count;
+#endif
+
+	DSP_Error_Number = 0;
+	if(transaction == NULL)
+	{
+		DSP_Error_Number = 129;
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Submit:Transaction was NULL.");
+		return FALSE;
+	}
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+			      "CCD_DSP_Transaction_Submit(handle=%p,command_count=%d) started.",
+			      handle,transaction->Command_Count);
+#endif
+	transaction->Failed_Index = -1;
+#ifdef CCD_DSP_UTIL_EXPOSURE_CHECK
+	wrm_count = 0;
+	util_wrm_count = 0;
+	for(i = 0; i < transaction->Command_Count; i++)
+	{
+		if(transaction->Command_List[i].Command == CCD_DSP_WRM)
+		{
+			wrm_count++;
+			if(transaction->Command_List[i].Board_Id == CCD_DSP_UTIL_BOARD_ID)
+				util_wrm_count++;
+		}
+	}
+#endif
+#ifdef CCD_DSP_MUTEXED
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
+		return FALSE;
+#endif
+/* See CCD_DSP_Command_WRM for when we can write memory on the utility board. */
+#ifdef CCD_DSP_UTIL_EXPOSURE_CHECK
+#if CCD_DSP_UTIL_EXPOSURE_CHECK == 1
+	if((util_wrm_count > 0)&&
+	   (CCD_Exposure_Get_Exposure_Status(handle) != CCD_EXPOSURE_STATUS_NONE)&&
+	   (CCD_Exposure_Get_Exposure_Status(handle) != CCD_EXPOSURE_STATUS_WAIT_START)&&
+	   (CCD_Exposure_Get_Exposure_Status(handle) != CCD_EXPOSURE_STATUS_POST_READOUT))
+#elif CCD_DSP_UTIL_EXPOSURE_CHECK == 2
+	if((wrm_count > 0)&&
+	   ((CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_PRE_READOUT)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_READOUT)))
+#elif CCD_DSP_UTIL_EXPOSURE_CHECK == 3
+	if((wrm_count > 0)&&
+	   ((CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_WAIT_START)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_CLEAR)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_EXPOSE)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_PRE_READOUT)||
+	    (CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_READOUT)))
+#endif
+	{
+#ifdef CCD_DSP_MUTEXED
+		DSP_Mutex_Unlock(handle);
+#endif
+		DSP_Error_Number = 91; /* this error code is checked for in the Java layer */
+		sprintf(DSP_Error_String,"CCD_DSP_Transaction_Submit failed:Illegal Exposure Status (%d) when"
+			" writing to the utility board.",CCD_Exposure_Get_Exposure_Status(handle));
+		return FALSE;
+	}
+#endif
+	/* send all the commands, without checking the replies */
+	for(i = 0; i < transaction->Command_Count; i++)
+	{
+		command = &(transaction->Command_List[i]);
+		if(CCD_DSP_Get_Abort(handle))
+		{
+#ifdef CCD_DSP_MUTEXED
+			DSP_Mutex_Unlock(handle);
+#endif
+			transaction->Failed_Index = i;
+			DSP_Error_Number = 130;
+			sprintf(DSP_Error_String,"CCD_DSP_Transaction_Submit:Aborted at command %d of %d.",i,
+				transaction->Command_Count);
+			return FALSE;
+		}
+		if(!DSP_Send_Manual_Command(class,source,handle,command->Board_Id,command->Command,
+					    command->Argument_List,command->Argument_Count,&(command->Reply)))
+		{
+#ifdef CCD_DSP_MUTEXED
+			DSP_Mutex_Unlock(handle);
+#endif
+			transaction->Failed_Index = i;
+			return FALSE;
+		}
+	}
+#ifdef CCD_DSP_MUTEXED
+	if(!DSP_Mutex_Unlock(handle))
+		return FALSE;
+#endif
+	/* check replies - DON should be returned for every command */
+	for(i = 0; i < transaction->Command_Count; i++)
+	{
+		command = &(transaction->Command_List[i]);
+		if(DSP_Check_Reply(class,source,command->Reply,CCD_DSP_DON) != CCD_DSP_DON)
+		{
+			transaction->Failed_Index = i;
+			strcpy(reply_error_string,DSP_Error_String);
+			DSP_Error_Number = 131;
+			/* reply_error_string can fill the whole error string, so only keep the start of it */
+			sprintf(DSP_Error_String,"CCD_DSP_Transaction_Submit:Command %d of %d (%s) failed:%.160s",i,
+				transaction->Command_Count,DSP_Manual_Command_To_String(command->Command),
+				reply_error_string);
+			return FALSE;
+		}
+	}
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+			      "CCD_DSP_Transaction_Submit(handle=%p,command_count=%d) returned DON.",
+			      handle,transaction->Command_Count);
+#endif
+	return CCD_DSP_DON;
+}
+
 /* timing board commands */
 /**
  * This routine executes the ABort Readout (ABR) command on a SDSU Controller board.
@@ -647,7 +1182,7 @@ int CCD_DSP_Command_CLR(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_CLR(handle=%p) started.",handle);
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Clr(class,source,handle,&retval))
@@ -694,7 +1229,7 @@ int CCD_DSP_Command_RDC(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_RDC() started.");
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 /* set exposure status */
@@ -742,7 +1277,7 @@ int CCD_DSP_Command_IDL(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_IDL() started.");
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Idl(class,source,handle,&retval))
@@ -785,7 +1320,7 @@ int CCD_DSP_Command_SBV(char *class,char *source,CCD_Interface_Handle_T* handle)
 
 	DSP_Error_Number = 0;
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Sbv(class,source,handle,&retval))
@@ -848,7 +1383,7 @@ int CCD_DSP_Command_SGN(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Sgn(class,source,handle,gain,speed,&retval))
@@ -905,7 +1440,7 @@ int CCD_DSP_Command_SOS(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Sos(class,source,handle,amplifier,&retval))
@@ -978,7 +1513,7 @@ int CCD_DSP_Command_SSP(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Ssp(class,source,handle,y_offset,x_offset,bias_x_offset,&retval))
@@ -1048,7 +1583,7 @@ int CCD_DSP_Command_SSS(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Sss(class,source,handle,bias_width,box_width,box_height,&retval))
@@ -1095,7 +1630,7 @@ int CCD_DSP_Command_STP(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_STP() started.");
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Stp(class,source,handle,&retval))
@@ -1141,7 +1676,7 @@ int CCD_DSP_Command_AEX(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_AEX(handle=%p) started.",handle);
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Aex(class,source,handle,&retval))
@@ -1184,7 +1719,7 @@ int CCD_DSP_Command_CSH(char *class,char *source,CCD_Interface_Handle_T* handle)
 
 	DSP_Error_Number = 0;
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Csh(class,source,handle,&retval))
@@ -1223,7 +1758,7 @@ int CCD_DSP_Command_OSH(char *class,char *source,CCD_Interface_Handle_T* handle)
 
 	DSP_Error_Number = 0;
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Osh(class,source,handle,&retval))
@@ -1266,7 +1801,7 @@ int CCD_DSP_Command_PEX(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_PEX() started.");
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Pex(class,source,handle,&retval))
@@ -1311,7 +1846,7 @@ int CCD_DSP_Command_PON(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_PON(handle=%p) started.",handle);
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Pon(class,source,handle,&retval))
@@ -1357,7 +1892,7 @@ int CCD_DSP_Command_POF(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_POF(handle=%p) started.",handle);
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Pof(class,source,handle,&retval))
@@ -1404,7 +1939,7 @@ int CCD_DSP_Command_REX(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_REX() started.");
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Rex(class,source,handle,&retval))
@@ -1429,8 +1964,10 @@ int CCD_DSP_Command_REX(char *class,char *source,CCD_Interface_Handle_T* handle)
 
 /**
  * This routine executes the Start EXposure (SEX) command on a SDSU Controller board.
- * If mutex locking has been compiled in, the routine is mutexed over sending the command to the controller
- * and receiving a reply from it.
+ * If a start time is specified, DSP_Wait_Start_Time first waits until DSP_START_EXPOSURE_LOCK_TIME before
+ * the command is due to be sent, without the controller access lock held.
+ * If mutex locking has been compiled in, the routine is then mutexed over the rest of the wait, sending the 
+ * command to the controller and receiving a reply from it.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
@@ -1439,6 +1976,8 @@ int CCD_DSP_Command_REX(char *class,char *source,CCD_Interface_Handle_T* handle)
  * @param exposure_length The length of exposure we are about to start. Passed to DSP_Send_Sex.
  * @return The routine returns DON if the command succeeded and FALSE if the command failed.
  * @see #CCD_DSP_EXPOSURE_MAX_LENGTH
+ * @see #DSP_START_EXPOSURE_LOCK_TIME
+ * @see #DSP_Wait_Start_Time
  * @see #DSP_Send_Sex
  * @see #DSP_Check_Reply
  * @see ccd_interface.html#CCD_Interface_Handle_T
@@ -1453,8 +1992,10 @@ int CCD_DSP_Command_SEX(char *class,char *source,CCD_Interface_Handle_T* handle,
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
 			      "CCD_DSP_Command_SEX(handle=%p,exposure_length=%d) started.",handle,exposure_length);
 #endif
+	if(!DSP_Wait_Start_Time(class,source,handle,start_time))
+		return FALSE;
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Sex(class,source,handle,start_time,exposure_length,&retval))
@@ -1504,7 +2045,7 @@ int CCD_DSP_Command_Reset(char *class,char *source,CCD_Interface_Handle_T* handl
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_Reset(handle=%p) started.",handle);
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Reset(class,source,handle,&retval))
@@ -1554,7 +2095,7 @@ int CCD_DSP_Command_Get_HSTR(char *class,char *source,CCD_Interface_Handle_T* ha
 #endif
 	(*value) = 0;
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!CCD_Interface_Command(handle,CCD_PCI_IOCTL_GET_HSTR,value))
@@ -1599,7 +2140,7 @@ int CCD_DSP_Command_Get_Readout_Progress(char *class,char *source,CCD_Interface_
 #endif
 	(*value) = 0;
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!CCD_Interface_Command(handle,CCD_PCI_IOCTL_GET_PROGRESS,value))
@@ -1618,6 +2159,88 @@ int CCD_DSP_Command_Get_Readout_Progress(char *class,char *source,CCD_Interface_
 	return TRUE;
 }
 
+/**
+ * Routine to wait until the readout progress reaches target_value pixels, or timeout_ms milliseconds have 
+ * elapsed. This allows the exposure monitor loop to sleep until the readout completes, rather than for a
+ * fixed time. The astropci driver does not support a blocking progress request, so the progress is requested
+ * every DSP_WAIT_PROGRESS_POLL_NS nanoseconds, using CCD_Interface_Command so each request is counted in
+ * the handle's ioctl metrics. If mutex locking has been compiled in, the mutex is only held for each request,
+ * so other threads can send commands whilst we wait.
+ * The wait also stops if an abort is requested, the caller should check the abort flag.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param target_value The number of pixels read out to wait for.
+ * @param timeout_ms The maximum length of time to wait, in milliseconds.
+ * @param value The address of an integer to store the last readout progress.
+ * @return The routine returns TRUE if the operation succeeds (whether or not the target was reached), 
+ *         FALSE otherwise.
+ * @see #DSP_WAIT_PROGRESS_POLL_NS
+ * @see #DSP_Mutex_Lock
+ * @see #DSP_Mutex_Unlock
+ * @see #CCD_DSP_Get_Abort
+ * @see ccd_interface.html#CCD_Interface_Command
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see ccd_pci.html#CCD_PCI_IOCTL_GET_PROGRESS
+ */
+int CCD_DSP_Command_Wait_Readout_Progress(char *class,char *source,CCD_Interface_Handle_T* handle,
+					  int target_value,int timeout_ms,int *value)
+{
+	struct timespec sleep_time;
+	int timeout_count,poll_count;
+
+	DSP_Error_Number = 0;
+	if(value == NULL)
+	{
+		DSP_Error_Number = 113;
+		sprintf(DSP_Error_String,"CCD_DSP_Command_Wait_Readout_Progress:value was NULL.");
+		return FALSE;
+	}
+	if(timeout_ms < 0)
+	{
+		DSP_Error_Number = 135;
+		sprintf(DSP_Error_String,"CCD_DSP_Command_Wait_Readout_Progress:Illegal timeout %d.",timeout_ms);
+		return FALSE;
+	}
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+			      "CCD_DSP_Command_Wait_Readout_Progress(handle=%p,target=%d,timeout=%d) started.",
+			      handle,target_value,timeout_ms);
+#endif
+	(*value) = 0;
+	/* number of polls before we time out */
+	timeout_count = (timeout_ms*(CCD_GLOBAL_ONE_MILLISECOND_NS/DSP_WAIT_PROGRESS_POLL_NS));
+	poll_count = 0;
+	while(TRUE)
+	{
+#ifdef CCD_DSP_MUTEXED
+		if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
+			return FALSE;
+#endif
+		if(!CCD_Interface_Command(handle,CCD_PCI_IOCTL_GET_PROGRESS,value))
+		{
+#ifdef CCD_DSP_MUTEXED
+			DSP_Mutex_Unlock(handle);
+#endif
+			DSP_Error_Number = 114;
+			sprintf(DSP_Error_String,"CCD_DSP_Command_Wait_Readout_Progress:Sending Get Progress failed "
+				"after %d polls.",poll_count);
+			return FALSE;
+		}
+#ifdef CCD_DSP_MUTEXED
+		if(!DSP_Mutex_Unlock(handle))
+			return FALSE;
+#endif
+		if(((*value) >= target_value)||(poll_count >= timeout_count)||(handle->DSP_Data.Abort))
+			break;
+		sleep_time.tv_sec = 0;
+		sleep_time.tv_nsec = DSP_WAIT_PROGRESS_POLL_NS;
+		nanosleep(&sleep_time,NULL);
+		poll_count++;
+	}
+	return TRUE;
+}
+
 /**
  * Routine to read the controller configuration word.
  * @param class The class parameter to use for any log messages associated with this operation.
@@ -1643,7 +2266,7 @@ int CCD_DSP_Command_RCC(char *class,char *source,CCD_Interface_Handle_T* handle,
 	}
 	(*value) = 0;
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_NORMAL))
 		return FALSE;
 #endif
 	if(!DSP_Send_Rcc(class,source,handle,value))
@@ -1788,7 +2411,7 @@ int CCD_DSP_Command_SET(char *class,char *source,CCD_Interface_Handle_T* handle,
 		return FALSE;
 	}
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 	if(!DSP_Send_Set(class,source,handle,msecs,&retval))
@@ -1815,7 +2438,9 @@ int CCD_DSP_Command_SET(char *class,char *source,CCD_Interface_Handle_T* handle,
 
 /**
  * Routine to get the amount of time the utility board has had the shutter open for, i.e. the
- * amount of time an exposure has been underway. 
+ * amount of time an exposure has been underway. The returned time is also used to measure the latency
+ * between sending the START_EXPOSURE command and the exposure starting, see 
+ * CCD_Exposure_Measure_Exposure_Start_Time.
  * If mutex locking has been compiled in, the routine is mutexed over sending the command to the controller
  * and receiving a reply from it.
  * @param class The class parameter to use for any log messages associated with this operation.
@@ -1825,10 +2450,15 @@ int CCD_DSP_Command_SET(char *class,char *source,CCD_Interface_Handle_T* handle,
  * 	the amount of time an exposure has been underway is returned, in milliseconds.
  * @see #DSP_Send_Ret
  * @see #DSP_Check_Reply
+ * @see #DSP_TimeSpec_Diff_NS
+ * @see #DSP_TimeSpec_Add_NS
+ * @see ccd_exposure.html#CCD_Exposure_Measure_Exposure_Start_Time
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Time
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 int CCD_DSP_Command_RET(char *class,char *source,CCD_Interface_Handle_T* handle)
 {
+	struct timespec send_time,reply_time;
 	int retval;
 
 	DSP_Error_Number = 0;
@@ -1836,7 +2466,7 @@ int CCD_DSP_Command_RET(char *class,char *source,CCD_Interface_Handle_T* handle)
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_RET(handle=%p) started.",handle);
 #endif
 #ifdef CCD_DSP_MUTEXED
-	if(!DSP_Mutex_Lock(handle))
+	if(!DSP_Mutex_Lock(handle,DSP_PRIORITY_EXPOSURE))
 		return FALSE;
 #endif
 /* Version 1.7: We can only read elapsed exposure time when we are not reading out.
@@ -1860,6 +2490,7 @@ int CCD_DSP_Command_RET(char *class,char *source,CCD_Interface_Handle_T* handle)
 	/* no test in this mode - we can still call RET when exposing. */
 #endif
 #endif
+	CCD_Global_Metrics_Get_Time(&send_time);
 	if(!DSP_Send_Ret(class,source,handle,&retval))
 	{
 #ifdef CCD_DSP_MUTEXED
@@ -1867,6 +2498,7 @@ int CCD_DSP_Command_RET(char *class,char *source,CCD_Interface_Handle_T* handle)
 #endif
 		return FALSE;
 	}
+	CCD_Global_Metrics_Get_Time(&reply_time);
 #ifdef CCD_DSP_MUTEXED
 	if(!DSP_Mutex_Unlock(handle))
 		return FALSE;
@@ -1874,6 +2506,10 @@ int CCD_DSP_Command_RET(char *class,char *source,CCD_Interface_Handle_T* handle)
 /* check reply - the exposure time in milliseconds returned so this does nothing! */
 	if(DSP_Check_Reply(class,source,retval,DSP_ACTUAL_VALUE) != retval)
 		return FALSE;
+/* use the elapsed exposure time to measure when the exposure actually started. We assume the controller
+** read its timer half way between us sending the command and receiving the reply */
+	DSP_TimeSpec_Add_NS(&send_time,DSP_TimeSpec_Diff_NS(send_time,reply_time)/2);
+	CCD_Exposure_Measure_Exposure_Start_Time(handle,send_time,retval);
 #if LOGGING > 4
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_DSP_Command_Ret(handle=%p) returned %d (%#x).",
 			      handle,retval,retval);
@@ -2444,10 +3080,81 @@ static int DSP_Send_Rex(char *class,char *source,CCD_Interface_Handle_T* handle,
 	return DSP_Send_Manual_Command(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_REX,NULL,0,reply_value);
 }
 
+/**
+ * Internal routine to wait for the start time of an exposure, without the controller access lock held.
+ * If the tv_sec field of start_time is non-zero, the exposure status is set to WAIT_START, and we sleep until
+ * DSP_START_EXPOSURE_LOCK_TIME before the START_EXPOSURE command is due to be sent (see DSP_Send_Sex).
+ * Absolute time sleeps are used so the wakeup time does not drift, and we wake every second to check for 
+ * an abort.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param start_time The time to start the exposure. If the tv_sec field of the structure is zero,
+ * 	we return straight away.
+ * @return Returns TRUE if the wait succeeded, FALSE if it failed or was aborted.
+ * @see #DSP_START_EXPOSURE_LOCK_TIME
+ * @see #DSP_Send_Sex
+ * @see #DSP_Sleep_Until
+ * @see #DSP_TimeSpec_Diff_NS
+ * @see #DSP_TimeSpec_Add_NS
+ * @see ccd_exposure.html#CCD_Exposure_Set_Exposure_Status
+ * @see ccd_exposure.html#CCD_Exposure_Get_Start_Exposure_Latency
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Time
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int DSP_Wait_Start_Time(char *class,char *source,CCD_Interface_Handle_T* handle,
+			       struct timespec start_time)
+{
+	enum CCD_EXPOSURE_STATUS exposure_status;
+	struct timespec lock_time,current_time,wake_time;
+	long long remaining_ns;
+
+	if(start_time.tv_sec == 0)
+		return TRUE;
+	exposure_status = CCD_EXPOSURE_STATUS_WAIT_START;
+	if(!CCD_Exposure_Set_Exposure_Status(handle,exposure_status))
+	{
+		DSP_Error_Number = 35;
+		sprintf(DSP_Error_String,"DSP_Wait_Start_Time:Setting exposure status %d failed.",exposure_status);
+		return FALSE;
+	}
+	/* stop waiting DSP_START_EXPOSURE_LOCK_TIME before the START_EXPOSURE is sent */
+	lock_time = start_time;
+	DSP_TimeSpec_Add_NS(&lock_time,-(((long long)CCD_Exposure_Get_Start_Exposure_Latency(handle))+
+					 DSP_START_EXPOSURE_LOCK_TIME));
+	CCD_Global_Metrics_Get_Time(&current_time);
+	remaining_ns = DSP_TimeSpec_Diff_NS(current_time,lock_time);
+	while(remaining_ns > 0)
+	{
+		if(remaining_ns > CCD_GLOBBAL_ONE_SECOND_NS)
+		{
+			wake_time = current_time;
+			wake_time.tv_sec++;
+		}
+		else
+			wake_time = lock_time;
+		DSP_Sleep_Until(wake_time);
+	/* if an abort has occured, stop sleeping. */
+		if(handle->DSP_Data.Abort)
+		{
+			DSP_Error_Number = 136;
+			sprintf(DSP_Error_String,"DSP_Wait_Start_Time:Abort detected whilst waiting for start time.");
+			return FALSE;
+		}
+		CCD_Global_Metrics_Get_Time(&current_time);
+		remaining_ns = DSP_TimeSpec_Diff_NS(current_time,lock_time);
+	}
+	return TRUE;
+}
+
 /**
  * Internal DSP command to make the SDSU CCD Controller start an exposure.
- * If the tv_sec field of start_time is non-zero, we want to open the shutter as near as possible to the 
- * passed in time, allowing for some transmission delay (CCD_Exposure_Start_Exposure_Offset_Time).
+ * If the tv_sec field of start_time is non-zero, we want to start the exposure as near as possible to the 
+ * passed in time. The command is sent early by the start latency (CCD_Exposure_Get_Start_Exposure_Latency),
+ * which is measured from elapsed exposure time readbacks. DSP_Wait_Start_Time has already waited until 
+ * shortly before the send time, without the lock held. We sleep until DSP_START_EXPOSURE_SPIN_TIME before
+ * the send time, using absolute time sleeps so the wakeup time does not drift, and then busy wait until the 
+ * send time.
  * Sets the Exposure_Start_Time to start of the exposure.
  * Sets the exposure status to either EXPOSING or READOUT (if the exposure length is small).
  * @param class The class parameter to use for any log messages associated with this operation.
@@ -2459,74 +3166,56 @@ static int DSP_Send_Rex(char *class,char *source,CCD_Interface_Handle_T* handle,
  * 	CCD_Exposure_Get_Readout_Remaining_Time, to see whether to change status to EXPOSING or READOUT.
  * @param reply_value The address of an integer to store the value returned from the SDSU board.
  * @return Returns true if sending the command succeeded, false if it failed.
+ * @see #DSP_START_EXPOSURE_SPIN_TIME
+ * @see #DSP_Wait_Start_Time
  * @see #DSP_Send_Manual_Command
+ * @see #DSP_Sleep_Until
+ * @see #DSP_TimeSpec_Diff_NS
+ * @see #DSP_TimeSpec_Add_NS
  * @see ccd_pci.html#CCD_PCI_HCVR_START_EXPOSURE
  * @see ccd_exposure.html#CCD_Exposure_Set_Exposure_Start_Time
  * @see ccd_exposure.html#CCD_Exposure_Set_Exposure_Status
- * @see ccd_exposure.html#CCD_Exposure_Get_Start_Exposure_Offset_Time
+ * @see ccd_exposure.html#CCD_Exposure_Get_Start_Exposure_Latency
  * @see ccd_exposure.html#CCD_Exposure_Get_Readout_Remaining_Time
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Time
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 static int DSP_Send_Sex(char *class,char *source,CCD_Interface_Handle_T* handle,
 			struct timespec start_time,int exposure_length, int *reply_value)
 {
 	enum CCD_EXPOSURE_STATUS exposure_status;
-	struct timespec current_time,sleep_time;
-#ifndef _POSIX_TIMERS
-	struct timeval gtod_current_time;
-#endif
-	int remaining_sec,remaining_ns,done = FALSE;
+	struct timespec send_time,current_time,wake_time;
+	long long remaining_ns;
+	int done = FALSE;
 
 /* if a start time has been specified wait for it */
 	if(start_time.tv_sec > 0)
 	{
-		exposure_status = CCD_EXPOSURE_STATUS_WAIT_START;
-		if(!CCD_Exposure_Set_Exposure_Status(handle,exposure_status))
-		{
-			DSP_Error_Number = 35;
-			sprintf(DSP_Error_String,"DSP_Send_Sex:Setting exposure status %d failed.",exposure_status);
-			return FALSE;
-		}
+	/* we need to allow time for propogation of the SEX command */
+		send_time = start_time;
+		DSP_TimeSpec_Add_NS(&send_time,-((long long)CCD_Exposure_Get_Start_Exposure_Latency(handle)));
 		done = FALSE;
 		while(done == FALSE)
 		{
-#ifdef _POSIX_TIMERS
-			clock_gettime(CLOCK_REALTIME,&current_time);
-#else
-			gettimeofday(&gtod_current_time,NULL);
-			current_time.tv_sec = gtod_current_time.tv_sec;
-			current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
-#endif
-			remaining_sec = start_time.tv_sec - current_time.tv_sec;
-		/* if we have over a second before start_time, sleep for a second. */
-			if(remaining_sec > 1)
-			{
-				sleep_time.tv_sec = 1;
-				sleep_time.tv_nsec = 0;
-				nanosleep(&sleep_time,NULL);
-			}
-			else if(remaining_sec > -1)
+			CCD_Global_Metrics_Get_Time(&current_time);
+			remaining_ns = DSP_TimeSpec_Diff_NS(current_time,send_time);
+			if(remaining_ns <= DSP_START_EXPOSURE_SPIN_TIME)
+				done = TRUE;
+			else
 			{
-				remaining_ns = (start_time.tv_nsec - current_time.tv_nsec);
-			/* we need to allow time for propogation of the SEX command
-			** allow offset milliseconds to do this. */
-				remaining_ns -= CCD_Exposure_Get_Start_Exposure_Offset_Time(handle)*
-					CCD_GLOBAL_ONE_MILLISECOND_NS;
-				if(remaining_ns < 0)
+			/* sleep until just before the send time, waking every second to check for an abort */
+				if(remaining_ns > (CCD_GLOBBAL_ONE_SECOND_NS+DSP_START_EXPOSURE_SPIN_TIME))
 				{
-					remaining_sec--;
-					remaining_ns += CCD_GLOBBAL_ONE_SECOND_NS;
+					wake_time = current_time;
+					wake_time.tv_sec++;
 				}
-				done = TRUE;
-				if(remaining_sec > -1)
+				else
 				{
-					sleep_time.tv_sec = remaining_sec;
-					sleep_time.tv_nsec = remaining_ns;
-					nanosleep(&sleep_time,NULL);
+					wake_time = send_time;
+					DSP_TimeSpec_Add_NS(&wake_time,-DSP_START_EXPOSURE_SPIN_TIME);
 				}
+				DSP_Sleep_Until(wake_time);
 			}
-			else
-				done = TRUE;
 		/* if an abort has occured, stop sleeping. */
 			if(handle->DSP_Data.Abort)
 			{
@@ -2535,6 +3224,18 @@ static int DSP_Send_Sex(char *class,char *source,CCD_Interface_Handle_T* handle,
 				return FALSE;
 			}
 		}/* end while */
+	/* busy wait the last part, waking from a sleep is not this precise */
+		do
+		{
+			CCD_Global_Metrics_Get_Time(&current_time);
+		}
+		while(DSP_TimeSpec_Diff_NS(current_time,send_time) > 0);
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+				      "DSP_Send_Sex(handle=%p):Sending START_EXPOSURE %lld ns after the send time "
+				      "(start latency %d ns).",handle,DSP_TimeSpec_Diff_NS(send_time,current_time),
+				      CCD_Exposure_Get_Start_Exposure_Latency(handle));
+#endif
 	}/* end if */
 /* switch status to exposing and store the actual time the exposure is going to start */
 /* If the exposure length is small, we go directly into READOUT status. */
@@ -2817,6 +3518,51 @@ static int DSP_Send_Command(char *class,char *source,CCD_Interface_Handle_T* han
 	return TRUE;
 }
 
+/**
+ * Internal routine to queue a manual command in a DSP transaction. The command's reply is set to zero,
+ * it is filled in when the transaction is submitted.
+ * @param transaction The address of the transaction to add the command to.
+ * @param board_id Which SDSU board to send the manual command to. One of the ID's in the CCD_DSP_BOARD_ID
+ * 	enumeration.
+ * @param command The manual command to send.
+ * @param argument_list The list of arguments to send with the command.
+ * @param argument_count The number of arguments in the argument_list.
+ * @return The routine returns TRUE if the command was queued, and FALSE if an error occured.
+ * @see #CCD_DSP_Transaction_Struct
+ * @see #CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT
+ * @see #CCD_DSP_TRANSACTION_MAX_ARGUMENT_COUNT
+ */
+static int DSP_Transaction_Add(struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_BOARD_ID board_id,
+			       int command,int *argument_list,int argument_count)
+{
+	struct CCD_DSP_Transaction_Command_Struct *transaction_command = NULL;
+	int i;
+
+	if(transaction == NULL)
+	{
+		DSP_Error_Number = 119;
+		sprintf(DSP_Error_String,"DSP_Transaction_Add:Transaction was NULL.");
+		return FALSE;
+	}
+	if((transaction->Command_Count >= CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT)||
+	   (argument_count > CCD_DSP_TRANSACTION_MAX_ARGUMENT_COUNT))
+	{
+		DSP_Error_Number = 120;
+		sprintf(DSP_Error_String,"DSP_Transaction_Add:Too many commands (%d) or arguments (%d) "
+			"adding %s.",transaction->Command_Count,argument_count,DSP_Manual_Command_To_String(command));
+		return FALSE;
+	}
+	transaction_command = &(transaction->Command_List[transaction->Command_Count]);
+	transaction_command->Board_Id = board_id;
+	transaction_command->Command = command;
+	for(i = 0; i < argument_count; i++)
+		transaction_command->Argument_List[i] = argument_list[i];
+	transaction_command->Argument_Count = argument_count;
+	transaction_command->Reply = 0;
+	transaction->Command_Count++;
+	return TRUE;
+}
+
 /**
  * This routine checks a reply word from the SDSU CCD Controller. It checks that the reply is the expected_reply 
  * (unless expected_reply is DSP_ACTUAL_VALUE, in which case the reply is a value.
@@ -2875,23 +3621,40 @@ static int DSP_Check_Reply(char *class,char *source,int reply,int expected_reply
 
 #ifdef CCD_DSP_MUTEXED
 /**
- * Routine to lock the controller access mutex. This will block until the mutex has been acquired,
+ * Routine to acquire the controller access lock. This will block until the lock has been acquired,
  * unless an error occurs.
- * Mutex locking is currently acheived against one statically initialised mutex in ccd_dsp. 
+ * Locking is currently acheived against one statically initialised lock in ccd_dsp. 
  * I have tried this with one mutex per PCI card in the CCD_DSP_Struct (as part of the handle data), 
  * but this causes the control computer to lock.
  * Although it should theoretically work (as the data paths are parallel), I suspect the locking in the v1.7
  * linux PCI card device driver cannot cope - certainly the software (device driver) locking has changed compared to 
  * v2.0, and installing that may fix the problem and allow simultaneous DSP commands to both SDSU PCI cards.
- * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
- *       This isn't used anymore, but is left in in case I fix the device driver.
- * @return Returns TRUE if the mutex has been  locked for access by this thread,
+ * The lock is a priority lock: a thread waits whilst another thread holds the lock, or whilst a thread
+ * with a higher priority is waiting for it. So exposure control commands are sent before any queued
+ * housekeeping reads, although a command already being sent is never interrupted.
+ * The time spent waiting for the lock is added to the handle's DSP_MUTEX_WAIT metrics timer, and the
+ * metrics timer for the priority.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ *       The lock isn't per handle anymore, but the handle is left in in case I fix the device driver, 
+ *       and is used to keep the lock metrics for each handle.
+ * @param priority The priority of the command to be sent, one of DSP_PRIORITY_HOUSEKEEPING,
+ *       DSP_PRIORITY_NORMAL or DSP_PRIORITY_EXPOSURE.
+ * @return Returns TRUE if the lock has been acquired for access by this thread,
  * 	FALSE if an error occured.
+ * @see #DSP_Data
+ * @see #DSP_PRIORITY_HOUSEKEEPING
+ * @see #DSP_PRIORITY_NORMAL
+ * @see #DSP_PRIORITY_EXPOSURE
+ * @see ccd_global.html#CCD_Global_Metrics_Timer_Add
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_HOUSEKEEPING
  */
-static int DSP_Mutex_Lock(CCD_Interface_Handle_T* handle)
+static int DSP_Mutex_Lock(CCD_Interface_Handle_T* handle,int priority)
 {
-	int error_number;
+	struct timespec wait_start_time;
+	int error_number,blocked,i;
 
+	CCD_Global_Metrics_Get_Time(&wait_start_time);
 	error_number = pthread_mutex_lock(&(DSP_Data.Mutex));
 	if(error_number != 0)
 	{
@@ -2899,23 +3662,80 @@ static int DSP_Mutex_Lock(CCD_Interface_Handle_T* handle)
 		sprintf(DSP_Error_String,"DSP_Mutex_Lock:Mutex lock failed '%d'.",error_number);
 		return FALSE;
 	}
+	DSP_Data.Waiting_Count[priority]++;
+	do
+	{
+		/* wait whilst another thread holds the lock, or a higher priority thread is waiting for it */
+		blocked = DSP_Data.Locked;
+		for(i = priority+1; i < DSP_PRIORITY_COUNT; i++)
+		{
+			if(DSP_Data.Waiting_Count[i] > 0)
+				blocked = TRUE;
+		}
+		if(blocked)
+		{
+			error_number = pthread_cond_wait(&(DSP_Data.Condition),&(DSP_Data.Mutex));
+			if(error_number != 0)
+			{
+				/* lower priority threads may be waiting on us */
+				DSP_Data.Waiting_Count[priority]--;
+				pthread_cond_broadcast(&(DSP_Data.Condition));
+				pthread_mutex_unlock(&(DSP_Data.Mutex));
+				DSP_Error_Number = 132;
+				sprintf(DSP_Error_String,"DSP_Mutex_Lock:Condition wait failed '%d'.",error_number);
+				return FALSE;
+			}
+		}
+	}
+	while(blocked);
+	DSP_Data.Waiting_Count[priority]--;
+	DSP_Data.Locked = TRUE;
+	CCD_Global_Metrics_Get_Time(&(DSP_Data.Mutex_Lock_Time));
+	error_number = pthread_mutex_unlock(&(DSP_Data.Mutex));
+	if(error_number != 0)
+	{
+		DSP_Error_Number = 133;
+		sprintf(DSP_Error_String,"DSP_Mutex_Lock:Mutex unlock failed '%d'.",error_number);
+		return FALSE;
+	}
+	if(handle != NULL)
+	{
+		CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT,wait_start_time);
+		CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_HOUSEKEEPING+priority,
+					     wait_start_time);
+	}
 	return TRUE;
 }
 
 /**
- * Routine to unlock the controller access mutex. 
+ * Routine to release the controller access lock, and wake up any threads waiting for it.
+ * The time the lock was held for is added to the handle's DSP_MUTEX_HOLD metrics timer.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
- * @return Returns TRUE if the mutex has been unlocked, FALSE if an error occured.
+ * @return Returns TRUE if the lock has been released, FALSE if an error occured.
  * @see #DSP_Data
+ * @see ccd_global.html#CCD_Global_Metrics_Timer_Add
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_HOLD
  */
 static int DSP_Mutex_Unlock(CCD_Interface_Handle_T* handle)
 {
 	int error_number;
 
-	error_number = pthread_mutex_unlock(&(DSP_Data.Mutex));
+	/* Mutex_Lock_Time can only be read whilst we still hold the lock */
+	if(handle != NULL)
+		CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_HOLD,DSP_Data.Mutex_Lock_Time);
+	error_number = pthread_mutex_lock(&(DSP_Data.Mutex));
 	if(error_number != 0)
 	{
 		DSP_Error_Number = 20;
+		sprintf(DSP_Error_String,"DSP_Mutex_Unlock:Mutex lock failed '%d'.",error_number);
+		return FALSE;
+	}
+	DSP_Data.Locked = FALSE;
+	pthread_cond_broadcast(&(DSP_Data.Condition));
+	error_number = pthread_mutex_unlock(&(DSP_Data.Mutex));
+	if(error_number != 0)
+	{
+		DSP_Error_Number = 134;
 		sprintf(DSP_Error_String,"DSP_Mutex_Unlock:Mutex unlock failed '%d'.",error_number);
 		return FALSE;
 	}
@@ -2942,6 +3762,66 @@ static char *DSP_Manual_Command_To_String(int manual_command)
 	return command_string;
 }
 
+/**
+ * Internal routine to sleep until the specified time of the real time clock. When _POSIX_TIMERS is defined
+ * an absolute time clock_nanosleep is used, otherwise a relative nanosleep from the current time.
+ * The sleep can end early if a signal is received.
+ * @param wake_time The time to wake up.
+ * @see #DSP_TimeSpec_Diff_NS
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Time
+ */
+static void DSP_Sleep_Until(struct timespec wake_time)
+{
+#ifndef _POSIX_TIMERS
+	struct timespec current_time,sleep_time;
+	long long sleep_ns;
+#endif
+
+#ifdef _POSIX_TIMERS
+	clock_nanosleep(CLOCK_REALTIME,TIMER_ABSTIME,&wake_time,NULL);
+#else
+	CCD_Global_Metrics_Get_Time(&current_time);
+	sleep_ns = DSP_TimeSpec_Diff_NS(current_time,wake_time);
+	if(sleep_ns <= 0)
+		return;
+	sleep_time.tv_sec = (time_t)(sleep_ns/CCD_GLOBBAL_ONE_SECOND_NS);
+	sleep_time.tv_nsec = (long)(sleep_ns%CCD_GLOBBAL_ONE_SECOND_NS);
+	nanosleep(&sleep_time,NULL);
+#endif
+}
+
+/**
+ * Internal routine to return the difference between two times.
+ * @param start_time The earlier time.
+ * @param end_time The later time.
+ * @return The time difference (end_time - start_time), in nanoseconds.
+ */
+static long long DSP_TimeSpec_Diff_NS(struct timespec start_time,struct timespec end_time)
+{
+	return (((long long)(end_time.tv_sec-start_time.tv_sec))*((long long)CCD_GLOBBAL_ONE_SECOND_NS))+
+		((long long)(end_time.tv_nsec-start_time.tv_nsec));
+}
+
+/**
+ * Internal routine to add a number of nanoseconds to a time.
+ * @param time The address of the time to modify.
+ * @param ns The number of nanoseconds to add, this can be negative.
+ */
+static void DSP_TimeSpec_Add_NS(struct timespec *time,long long ns)
+{
+	long long total_ns;
+
+	total_ns = ((long long)time->tv_nsec)+ns;
+	time->tv_sec += (time_t)(total_ns/CCD_GLOBBAL_ONE_SECOND_NS);
+	total_ns %= CCD_GLOBBAL_ONE_SECOND_NS;
+	if(total_ns < 0)
+	{
+		time->tv_sec--;
+		total_ns += CCD_GLOBBAL_ONE_SECOND_NS;
+	}
+	time->tv_nsec = (long)total_ns;
+}
+
 /*
 ** $Log: not supported by cvs2svn $
 ** Revision 0.55  2009/05/05 10:42:04  cjm
@@ -20,14 +20,18 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 #include "log_udp.h"
 #include "ccd_interface.h"
+#include "ccd_interface_private.h"
 #include "ccd_pci.h"
 #include "ccd_dsp.h"
 #include "ccd_global.h"
@@ -82,16 +86,145 @@ static char rcsid[] = "$Id: ccd_dsp_download.c,v 1.8 2011-01-17 10:57:54 cjm Exp
  * @see #DSP_Download_PCI_Interface
  */
 #define DSP_DOWNLOAD_PCI_DATA_PROGRAM_STRING	("_DATA P")
+/**
+ * The magic string at the start of a compiled binary DSP image file. Files starting with this string are
+ * loaded as binary images, anything else is parsed as a .lod text file.
+ * @see #DSP_Download_Image_Load
+ * @see #CCD_DSP_Download_Image_Compile
+ */
+#define DSP_DOWNLOAD_IMAGE_MAGIC		("SDSUDSPI")
+/**
+ * The length of the magic string at the start of a compiled binary DSP image file.
+ * @see #DSP_DOWNLOAD_IMAGE_MAGIC
+ */
+#define DSP_DOWNLOAD_IMAGE_MAGIC_LENGTH		(8)
+/**
+ * The version number of the compiled binary DSP image file format.
+ */
+#define DSP_DOWNLOAD_IMAGE_VERSION		(1)
+/**
+ * The maximum number of blocks a compiled binary DSP image file can contain. Used to sanity check
+ * image headers.
+ */
+#define DSP_DOWNLOAD_IMAGE_BLOCK_MAX		(4096)
+/**
+ * The modulus used by the image checksum (the largest prime less than 2^16, as Adler-32).
+ * @see #DSP_Download_Image_Checksum
+ */
+#define DSP_DOWNLOAD_CHECKSUM_MODULUS		(65521)
+/**
+ * The number of parsed DSP images held in the image cache.
+ * @see #DSP_Download_Cache
+ */
+#define DSP_DOWNLOAD_CACHE_LENGTH		(4)
+/**
+ * The maximum length of a filename that can be used as an image cache key. Longer filenames are loaded
+ * but not cached.
+ * @see #DSP_Download_Cache
+ */
+#define DSP_DOWNLOAD_CACHE_FILENAME_LENGTH	(256)
+
+/* structures */
+/**
+ * Structure holding one contiguous block of DSP words, to be written to consecutive addresses in one
+ * memory space.
+ * <dl>
+ * <dt>Mem_Space</dt> <dd>The memory space the block is written to.</dd>
+ * <dt>Address</dt> <dd>The address of the first word in the block.</dd>
+ * <dt>Word_Index</dt> <dd>The index in the image's Word_List of the first word in the block.</dd>
+ * <dt>Word_Count</dt> <dd>The number of words in the block.</dd>
+ * </dl>
+ * @see #DSP_Download_Image_Struct
+ */
+struct DSP_Download_Block_Struct
+{
+	enum CCD_DSP_MEM_SPACE Mem_Space;
+	int Address;
+	int Word_Index;
+	int Word_Count;
+};
+
+/**
+ * Structure holding a parsed DSP program, ready to be downloaded to a timing or utility board.
+ * Images are shared between threads through the image cache, and are not modified once loaded.
+ * <dl>
+ * <dt>Board_Id</dt> <dd>The board the program is for, CCD_DSP_TIM_BOARD_ID or CCD_DSP_UTIL_BOARD_ID.</dd>
+ * <dt>Block_List</dt> <dd>An allocated list of contiguous blocks.</dd>
+ * <dt>Block_Count</dt> <dd>The number of blocks in Block_List.</dd>
+ * <dt>Word_List</dt> <dd>An allocated list of all the program words, in block order.</dd>
+ * <dt>Word_Count</dt> <dd>The number of words in Word_List.</dd>
+ * <dt>Checksum</dt> <dd>The checksum of the image, computed by DSP_Download_Image_Checksum.</dd>
+ * <dt>Reference_Count</dt> <dd>The number of references to the image (the cache and any downloads
+ *     in progress). Protected by DSP_Download_Cache_Mutex. The image is freed when this reaches zero.</dd>
+ * </dl>
+ * @see #DSP_Download_Block_Struct
+ * @see #DSP_Download_Image_Checksum
+ * @see #DSP_Download_Cache_Mutex
+ */
+struct DSP_Download_Image_Struct
+{
+	enum CCD_DSP_BOARD_ID Board_Id;
+	struct DSP_Download_Block_Struct *Block_List;
+	int Block_Count;
+	int *Word_List;
+	int Word_Count;
+	unsigned int Checksum;
+	int Reference_Count;
+};
+
+/**
+ * Structure holding one entry in the image cache. An entry is only used if the file it was loaded from
+ * still has the same modification time, size and inode.
+ * <dl>
+ * <dt>Filename</dt> <dd>The filename the image was loaded from.</dd>
+ * <dt>Modification_Time</dt> <dd>The modification time of the file when it was loaded.</dd>
+ * <dt>Size</dt> <dd>The size of the file when it was loaded.</dd>
+ * <dt>Inode</dt> <dd>The inode of the file when it was loaded.</dd>
+ * <dt>Image</dt> <dd>The loaded image, or NULL if the entry is unused.</dd>
+ * </dl>
+ * @see #DSP_Download_Cache
+ */
+struct DSP_Download_Cache_Entry_Struct
+{
+	char Filename[DSP_DOWNLOAD_CACHE_FILENAME_LENGTH];
+	time_t Modification_Time;
+	off_t Size;
+	ino_t Inode;
+	struct DSP_Download_Image_Struct *Image;
+};
 
 /* internal variables */
 /**
- * Variable holding error code of last operation performed by ccd_dsp_download.
+ * Variable holding error code of last operation performed by ccd_dsp_download,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
+ */
+static CCD_GLOBAL_THREAD_LOCAL int DSP_Download_Error_Number = 0;
+/**
+ * Internal  variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
+ */
+static CCD_GLOBAL_THREAD_LOCAL char DSP_Download_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+/**
+ * Cache of parsed DSP images, keyed by filename, modification time, size and inode.
+ * Shared between all handles, protected by DSP_Download_Cache_Mutex.
+ * @see #DSP_Download_Cache_Entry_Struct
+ * @see #DSP_DOWNLOAD_CACHE_LENGTH
+ * @see #DSP_Download_Cache_Mutex
  */
-static int DSP_Download_Error_Number = 0;
+static struct DSP_Download_Cache_Entry_Struct DSP_Download_Cache[DSP_DOWNLOAD_CACHE_LENGTH];
 /**
- * Internal  variable holding description of the last error that occured.
+ * The index of the next cache entry to replace, when the cache is full.
+ * Protected by DSP_Download_Cache_Mutex.
+ * @see #DSP_Download_Cache
  */
-static char DSP_Download_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static int DSP_Download_Cache_Next_Index = 0;
+/**
+ * Mutex protecting DSP_Download_Cache, DSP_Download_Cache_Next_Index and the image reference counts.
+ * @see #DSP_Download_Cache
+ */
+static pthread_mutex_t DSP_Download_Cache_Mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* internal functions */
 static int DSP_Download_Timing_Utility(char *class,char *source,CCD_Interface_Handle_T* handle,
@@ -101,8 +234,23 @@ static int DSP_Download_PCI_Finish(char *class,char *source,CCD_Interface_Handle
 static int DSP_Download_Read_Line(FILE *fp, char *buff);
 static int DSP_Download_Get_Type(FILE *fp);
 static int DSP_Download_Address_Char_To_Mem_Space(char ch,enum CCD_DSP_MEM_SPACE *mem_space);
-static int DSP_Download_Process_Data(char *class,char *source,CCD_Interface_Handle_T* handle,FILE *download_fp,
-				     enum CCD_DSP_BOARD_ID board_id,enum CCD_DSP_MEM_SPACE mem_space,int addr);
+static int DSP_Download_Process_Data(FILE *download_fp,struct DSP_Download_Image_Struct *image,
+				     enum CCD_DSP_MEM_SPACE mem_space,int addr);
+static int DSP_Download_Image_Get(char *class,char *source,char *filename,
+				  struct DSP_Download_Image_Struct **image);
+static void DSP_Download_Image_Release(struct DSP_Download_Image_Struct *image);
+static int DSP_Download_Image_Load(char *filename,struct DSP_Download_Image_Struct **image);
+static int DSP_Download_Image_Parse_Lod(FILE *download_fp,char *filename,struct DSP_Download_Image_Struct *image);
+static int DSP_Download_Image_Read(FILE *download_fp,char *filename,struct DSP_Download_Image_Struct *image);
+static int DSP_Download_Image_Write(char *filename,struct DSP_Download_Image_Struct *image);
+static int DSP_Download_Image_Add_Word(struct DSP_Download_Image_Struct *image,
+				      enum CCD_DSP_MEM_SPACE mem_space,int addr,int value);
+static unsigned int DSP_Download_Image_Checksum(struct DSP_Download_Image_Struct *image);
+static void DSP_Download_Image_Free(struct DSP_Download_Image_Struct *image);
+static int DSP_Download_Image_Verify(char *class,char *source,CCD_Interface_Handle_T* handle,
+				     struct DSP_Download_Image_Struct *image,int *matched);
+static int DSP_Download_Int_Read(FILE *fp,int *value);
+static int DSP_Download_Int_Write(FILE *fp,int value);
 
 /* external functions */
 /**
@@ -126,7 +274,8 @@ int CCD_DSP_Download_Initialise(void)
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @param board The board to send the command to.
  * @param filename The filename of compiled DSP commends to send to the board.
- * 	This is usually a .lod file.
+ * 	This is usually a .lod file. Timing and utility board programs can also be a binary image
+ * 	produced by CCD_DSP_Download_Image_Compile.
  * @return Returns TRUE if the operation succeeds, FALSE if it fails.
  * @see #DSP_Download_PCI_Interface
  * @see #DSP_Download_Timing_Utility
@@ -181,6 +330,135 @@ int CCD_DSP_Download(char *class,char *source,CCD_Interface_Handle_T* handle,
 	return retval;
 }
 
+/**
+ * Set how many words are read back from the timing and utility boards of the controller accessed through
+ * this handle before a download, to determine whether the board already holds the program. 
+ * If all the sampled words match the program, the download is skipped.
+ * The words not sampled are not checked, so a program that differs from the board's only in those words
+ * is not downloaded. This should therefore only be enabled when the programs on disc are known not
+ * to have changed since the boards were last loaded (e.g. repeated engineering setups).
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param sample_count The number of words to read back. Zero (the default) means always download.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Image_Verify
+ * @see ccd_dsp_private.html#CCD_DSP_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_DSP_Download_Set_Readback_Sample_Count(CCD_Interface_Handle_T* handle,int sample_count)
+{
+	DSP_Download_Error_Number = 0;
+	if(sample_count < 0)
+	{
+		DSP_Download_Error_Number = 44;
+		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Set_Readback_Sample_Count:"
+			"Illegal sample count %d.",sample_count);
+		return FALSE;
+	}
+	handle->DSP_Data.Download_Readback_Sample_Count = sample_count;
+	return TRUE;
+}
+
+/**
+ * Compile a timing or utility board .lod file into a checksummed binary image file. CCD_DSP_Download
+ * recognises binary image files, and loads them without parsing any text.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param lod_filename The filename of the .lod file to compile.
+ * @param image_filename The filename of the binary image file to write.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Image_Get
+ * @see #DSP_Download_Image_Write
+ * @see #DSP_Download_Image_Release
+ */
+int CCD_DSP_Download_Image_Compile(char *class,char *source,char *lod_filename,char *image_filename)
+{
+	struct DSP_Download_Image_Struct *image = NULL;
+
+	DSP_Download_Error_Number = 0;
+	if((lod_filename == NULL)||(image_filename == NULL))
+	{
+		DSP_Download_Error_Number = 45;
+		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Image_Compile:Filename was NULL(%p,%p).",
+			lod_filename,image_filename);
+		return FALSE;
+	}
+	if(!DSP_Download_Image_Get(class,source,lod_filename,&image))
+		return FALSE;
+	if(!DSP_Download_Image_Write(image_filename,image))
+	{
+		DSP_Download_Image_Release(image);
+		return FALSE;
+	}
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERY_VERBOSE,"CCD_DSP_Download_Image_Compile:"
+			      "Compiled '%s' to '%s' (%d blocks,%d words,checksum %#x).",lod_filename,
+			      image_filename,image->Block_Count,image->Word_Count,image->Checksum);
+#endif
+	DSP_Download_Image_Release(image);
+	return TRUE;
+}
+
+/**
+ * Get the checksum and word count of the program in a timing or utility board .lod file or binary image file.
+ * A .lod file and the binary image compiled from it have the same checksum.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param filename The filename of the .lod file or binary image file.
+ * @param checksum The address of an unsigned integer to store the checksum in.
+ * @param word_count The address of an integer to store the number of program words in.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Image_Get
+ * @see #DSP_Download_Image_Checksum
+ */
+int CCD_DSP_Download_Image_Get_Checksum(char *class,char *source,char *filename,unsigned int *checksum,
+					int *word_count)
+{
+	struct DSP_Download_Image_Struct *image = NULL;
+
+	DSP_Download_Error_Number = 0;
+	if((filename == NULL)||(checksum == NULL)||(word_count == NULL))
+	{
+		DSP_Download_Error_Number = 46;
+		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Image_Get_Checksum:Argument was NULL(%p,%p,%p).",
+			filename,checksum,word_count);
+		return FALSE;
+	}
+	if(!DSP_Download_Image_Get(class,source,filename,&image))
+		return FALSE;
+	(*checksum) = image->Checksum;
+	(*word_count) = image->Word_Count;
+	DSP_Download_Image_Release(image);
+	return TRUE;
+}
+
+/**
+ * Empty the image cache, so that the next download of every file parses it again.
+ * Images still being downloaded are freed when their download finishes.
+ * @see #DSP_Download_Cache
+ * @see #DSP_Download_Cache_Mutex
+ * @see #DSP_Download_Image_Free
+ */
+void CCD_DSP_Download_Cache_Clear(void)
+{
+	struct DSP_Download_Image_Struct *image = NULL;
+	int i;
+
+	pthread_mutex_lock(&DSP_Download_Cache_Mutex);
+	for(i = 0; i < DSP_DOWNLOAD_CACHE_LENGTH; i++)
+	{
+		image = DSP_Download_Cache[i].Image;
+		DSP_Download_Cache[i].Image = NULL;
+		if(image != NULL)
+		{
+			image->Reference_Count--;
+			if(image->Reference_Count == 0)
+				DSP_Download_Image_Free(image);
+		}
+	}
+	DSP_Download_Cache_Next_Index = 0;
+	pthread_mutex_unlock(&DSP_Download_Cache_Mutex);
+}
+
 /**
  * Get the current value of ccd_dsp_download's error number.
  * @return The current value of ccd_dsp_download's error number.
@@ -238,79 +516,81 @@ void CCD_DSP_Download_Error_String(char *error_string)
 ** ---------------------------------------------------------------- */
 /**
  * Downloads some DSP code to either the timing or utility board from filename.
+ * The file is parsed into an image (or fetched from the image cache if it has not changed since it was last
+ * parsed), and each contiguous block in the image is written using CCD_DSP_Command_WRM_Block.
+ * If a readback sample count has been set, sample words are first read back from the board, and
+ * the download is skipped if they all match the image.
+ * If the operation is aborted, the routine stops downloading and returns TRUE, the caller checks the abort flag.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @param board The board to send the command to.
  * @param filename The filename of compiled DSP commends to send to the board.
- * 	This is usually a .lod file.
+ * 	This is usually a .lod file, or a binary image produced by CCD_DSP_Download_Image_Compile.
  * @return Returns TRUE if the operation succeeds, FALSE if it fails.
- * @see #DSP_Download_Get_Type
- * @see #DSP_Download_Read_Line
- * @see #DSP_Download_Address_Char_To_Mem_Space
- * @see #DSP_Download_Process_Data
+ * @see #DSP_Download_Image_Get
+ * @see #DSP_Download_Image_Release
+ * @see #DSP_Download_Image_Verify
+ * @see #CCD_DSP_Download_Set_Readback_Sample_Count
+ * @see ccd_dsp.html#CCD_DSP_Command_WRM_Block
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 static int DSP_Download_Timing_Utility(char *class,char *source,CCD_Interface_Handle_T* handle,
 				       enum CCD_DSP_BOARD_ID board_id,char *filename)
 {
-	FILE *download_fp;
-	enum CCD_DSP_MEM_SPACE mem_space;
-	int finished,download_board_id,addr;
-	char buff[255],addr_type;
+	struct DSP_Download_Image_Struct *image = NULL;
+	struct DSP_Download_Block_Struct *block = NULL;
+	int i,matched;
 
-/* try to open the file */
-	if((download_fp = fopen(filename,"r")) == NULL)
-	{
-		DSP_Download_Error_Number = 5;
-		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Timing_Utility:Could not open filename(%s).",
-			filename);
+	if(!DSP_Download_Image_Get(class,source,filename,&image))
 		return FALSE;
-	}
 /* ensure the file is for the same board as the one we are trying to send a program to */
-	if((download_board_id = DSP_Download_Get_Type(download_fp)) == FALSE)
+	if(image->Board_Id != board_id)
 	{
-		fclose(download_fp);
-		DSP_Download_Error_Number = 6;
-		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Timing_Utility:Could not get filename type(%s).",
-			filename);
-		return FALSE;
-	}
-
-	if (download_board_id != board_id)
-	{
-		fclose(download_fp);
 		DSP_Download_Error_Number = 7;
 		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Timing_Utility:Boards do not match(%s,%d,%d).",
-			filename,download_board_id,board_id);
+			filename,image->Board_Id,board_id);
+		DSP_Download_Image_Release(image);
 		return FALSE;
 	}
-	finished = FALSE;
-/* send the data to the board until the end of the file is reached 
+/* if the board already holds this program, don't download it again */
+	if(handle->DSP_Data.Download_Readback_Sample_Count > 0)
+	{
+		if(!DSP_Download_Image_Verify(class,source,handle,image,&matched))
+		{
+			DSP_Download_Image_Release(image);
+			return FALSE;
+		}
+		if(matched)
+		{
+#if LOGGING > 1
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+					      "CCD_DSP_Download:Board %d already holds '%s' (checksum %#x):"
+					      "Skipping download.",board_id,filename,image->Checksum);
+#endif
+			DSP_Download_Image_Release(image);
+			return TRUE;
+		}
+	}
+/* send each block to the board until the end of the image is reached 
 ** or the operation is aborted */
-	while((!finished)&&(!CCD_DSP_Get_Abort(handle)))
+	for(i = 0; (i < image->Block_Count)&&(!CCD_DSP_Get_Abort(handle)); i++)
 	{
-		DSP_Download_Read_Line(download_fp,buff);
-		if(strncmp(buff,"_END",4) == 0)
-			finished = TRUE;
-		else if(sscanf(buff,"_DATA %c %x",&addr_type,(unsigned int *)&addr) == 2)
+		block = &(image->Block_List[i]);
+		if(CCD_DSP_Command_WRM_Block(class,source,handle,board_id,block->Mem_Space,block->Address,
+					     image->Word_List+block->Word_Index,block->Word_Count) != CCD_DSP_DON)
 		{
-			if(!DSP_Download_Address_Char_To_Mem_Space(addr_type,&mem_space))
-			{
-				fclose(download_fp);
-				return FALSE;
-			}
-			if (addr < DSP_DOWNLOAD_ADDR_MAX)
-			{
-				if(!DSP_Download_Process_Data(class,source,handle,download_fp,board_id,mem_space,addr))
-				{
-					fclose(download_fp);
-					return FALSE;
-				}
-			}
+			if(CCD_DSP_Get_Abort(handle))
+				break;
+			DSP_Download_Error_Number = 28;
+			sprintf(DSP_Download_Error_String,
+				"DSP_Download_Timing_Utility:Failed to WRM block(%#x,%#x,%#x,%d).",
+				board_id,block->Mem_Space,block->Address,block->Word_Count);
+			DSP_Download_Image_Release(image);
+			return FALSE;
 		}
 	}
-	fclose(download_fp);
+	DSP_Download_Image_Release(image);
 	return(TRUE);
 }
 
@@ -708,14 +988,11 @@ static int DSP_Download_Address_Char_To_Mem_Space(char ch,enum CCD_DSP_MEM_SPACE
 }
 
 /**
- * This routine reads DSP program code from file download_fp and writes it to DSP memory
- * using the <a href="#CCD_DSP_WRM">WRM</a> command to board board_id, memory space type address addr
- * @param class The class parameter to use for any log messages associated with this operation.
- * @param source The class parameter to use for any log messages associated with this operation.
- * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * This routine reads DSP program code from file download_fp and adds it to the image, to be written to
+ * memory space mem_space starting at address addr. Words are read until the next '_' (the start of an _END or
+ * _DATA statement) or the end of the file.
  * @param download_fp The file pointer of the .lod file we are loading the program from.
- * @param board_id The board to send the command to. One of
- * 	CCD_DSP_TIM_BOARD_ID(timing board) or CCD_DSP_UTIL_BOARD_ID(utility board).
+ * @param image The image to add the words to.
  * @param mem_space The memory space to put the data into, of type 
  * 	<a href="#CCD_DSP_MEM_SPACE">CCD_DSP_MEM_SPACE</a>. One of:
  * 	CCD_DSP_MEM_SPACE_P(program),
@@ -724,48 +1001,625 @@ static int DSP_Download_Address_Char_To_Mem_Space(char ch,enum CCD_DSP_MEM_SPACE
  * 	or CCD_DSP_MEM_SPACE_R(ROM).
  * @param addr The address within the memory space.
  * @return Returns TRUE if the operation succeeds, FALSE if it fails.
- * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see #DSP_Download_Image_Add_Word
  */
-static int DSP_Download_Process_Data(char *class,char *source,CCD_Interface_Handle_T* handle,
-	      FILE *download_fp,enum CCD_DSP_BOARD_ID board_id,enum CCD_DSP_MEM_SPACE mem_space,int addr)
+static int DSP_Download_Process_Data(FILE *download_fp,struct DSP_Download_Image_Struct *image,
+				     enum CCD_DSP_MEM_SPACE mem_space,int addr)
 { 
-	int finished, value;
-	char c;
+	int finished,value,c;
 
 	finished = FALSE;
-	/* while theres data to download and we've not aborted the operation */
-	while ((!finished) && (!CCD_DSP_Get_Abort(handle)))
+	/* while theres data to read */
+	while(!finished)
 	{
 		/* ignore spaces */
-		while ((c = getc(download_fp)) == 32);
+		while (((c = getc(download_fp)) == ' ')||(c == '\t'));
 		/* if we get an underscore it's probably the start of an _END or _DATA - hence stop */
 		if(c == '_')
 		{
 			ungetc(c, download_fp);
 			finished = TRUE;
 		}
+		else if(c == EOF)
+			finished = TRUE;
 		/* it it's not a newline it must be actual data */
-		else if((c != 10)&&(c != 13))
+		else if((c != '\n')&&(c != '\r'))
 		{
 			/* put the byte back */
 			ungetc(c, download_fp);
 			/* read the whole word of hexadecimal data */
-			fscanf(download_fp, "%x", (unsigned int *)&value);
-			/* try writing it to a board */
-			if(!CCD_DSP_Command_WRM(class,source,handle,board_id,mem_space,addr,value))
+			if(fscanf(download_fp, "%x", (unsigned int *)&value) != 1)
 			{
-				DSP_Download_Error_Number = 28;
+				DSP_Download_Error_Number = 29;
 				sprintf(DSP_Download_Error_String,
-					"DSP_Download_Process_Data:Failed to WRM(%#x,%#x,%#x,%#x).",
-					board_id,mem_space,addr,value);
+					"DSP_Download_Process_Data:Failed to parse word at (%#x,%#x).",mem_space,addr);
 				return FALSE;
 			}
+			if(!DSP_Download_Image_Add_Word(image,mem_space,addr,value))
+				return FALSE;
 			addr++;
 		}
 	}
 	return(TRUE);
 }
 
+/**
+ * Get a parsed image of filename. If the image cache holds an image of filename, and the file's modification time,
+ * size and inode have not changed since it was loaded, the cached image is returned. Otherwise the file is loaded
+ * and the new image put in the cache, replacing the oldest entry if the cache is full.
+ * The returned image must be released with DSP_Download_Image_Release.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param filename The filename of the .lod file or binary image.
+ * @param image The address of a pointer to store the image in.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Cache
+ * @see #DSP_Download_Cache_Mutex
+ * @see #DSP_Download_Image_Load
+ * @see #DSP_Download_Image_Release
+ */
+static int DSP_Download_Image_Get(char *class,char *source,char *filename,
+				  struct DSP_Download_Image_Struct **image)
+{
+	struct DSP_Download_Cache_Entry_Struct *entry = NULL;
+	struct DSP_Download_Image_Struct *old_image = NULL;
+	struct stat file_stat;
+	int i,cacheable;
+
+	if(stat(filename,&file_stat) != 0)
+	{
+		DSP_Download_Error_Number = 47;
+		sprintf(DSP_Download_Error_String,"DSP_Download_Image_Get:Could not stat filename(%s).",
+			filename);
+		return FALSE;
+	}
+	cacheable = (strlen(filename) < DSP_DOWNLOAD_CACHE_FILENAME_LENGTH);
+	if(cacheable)
+	{
+		pthread_mutex_lock(&DSP_Download_Cache_Mutex);
+		for(i = 0; i < DSP_DOWNLOAD_CACHE_LENGTH; i++)
+		{
+			entry = &(DSP_Download_Cache[i]);
+			if((entry->Image != NULL)&&(strcmp(entry->Filename,filename) == 0)&&
+			   (entry->Modification_Time == file_stat.st_mtime)&&(entry->Size == file_stat.st_size)&&
+			   (entry->Inode == file_stat.st_ino))
+			{
+				(*image) = entry->Image;
+				(*image)->Reference_Count++;
+				pthread_mutex_unlock(&DSP_Download_Cache_Mutex);
+#if LOGGING > 4
+				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERY_VERBOSE,
+						      "CCD_DSP_Download:Using cached image of '%s'.",filename);
+#endif
+				return TRUE;
+			}
+		}
+		pthread_mutex_unlock(&DSP_Download_Cache_Mutex);
+	}
+/* load the image outside the mutex, it may take some time */
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERY_VERBOSE,"CCD_DSP_Download:Loading '%s'.",filename);
+#endif
+	if(!DSP_Download_Image_Load(filename,image))
+		return FALSE;
+	(*image)->Reference_Count = 1;
+	if(!cacheable)
+		return TRUE;
+/* Put the image in the cache, replacing any entry with the same filename.
+** If another thread loaded the same file whilst we were, one of the images is replaced and freed when released. */
+	pthread_mutex_lock(&DSP_Download_Cache_Mutex);
+	entry = NULL;
+	for(i = 0; i < DSP_DOWNLOAD_CACHE_LENGTH; i++)
+	{
+		if((DSP_Download_Cache[i].Image != NULL)&&(strcmp(DSP_Download_Cache[i].Filename,filename) == 0))
+			entry = &(DSP_Download_Cache[i]);
+	}
+	for(i = 0; (entry == NULL)&&(i < DSP_DOWNLOAD_CACHE_LENGTH); i++)
+	{
+		if(DSP_Download_Cache[i].Image == NULL)
+			entry = &(DSP_Download_Cache[i]);
+	}
+	if(entry == NULL)
+	{
+		entry = &(DSP_Download_Cache[DSP_Download_Cache_Next_Index]);
+		DSP_Download_Cache_Next_Index = (DSP_Download_Cache_Next_Index+1)%DSP_DOWNLOAD_CACHE_LENGTH;
+	}
+	old_image = entry->Image;
+	strcpy(entry->Filename,filename);
+	entry->Modification_Time = file_stat.st_mtime;
+	entry->Size = file_stat.st_size;
+	entry->Inode = file_stat.st_ino;
+	entry->Image = (*image);
+	(*image)->Reference_Count++;
+	if(old_image != NULL)
+	{
+		old_image->Reference_Count--;
+		if(old_image->Reference_Count == 0)
+			DSP_Download_Image_Free(old_image);
+	}
+	pthread_mutex_unlock(&DSP_Download_Cache_Mutex);
+	return TRUE;
+}
+
+/**
+ * Release a reference to an image returned by DSP_Download_Image_Get. The image is freed when it is no
+ * longer referenced by the cache or any download.
+ * @param image The image to release.
+ * @see #DSP_Download_Image_Get
+ * @see #DSP_Download_Image_Free
+ * @see #DSP_Download_Cache_Mutex
+ */
+static void DSP_Download_Image_Release(struct DSP_Download_Image_Struct *image)
+{
+	pthread_mutex_lock(&DSP_Download_Cache_Mutex);
+	image->Reference_Count--;
+	if(image->Reference_Count == 0)
+		DSP_Download_Image_Free(image);
+	pthread_mutex_unlock(&DSP_Download_Cache_Mutex);
+}
+
+/**
+ * Load an image from filename. If the file starts with DSP_DOWNLOAD_IMAGE_MAGIC it is read as a binary image,
+ * otherwise it is parsed as a .lod text file.
+ * @param filename The filename of the .lod file or binary image.
+ * @param image The address of a pointer to store the allocated image in.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_DOWNLOAD_IMAGE_MAGIC
+ * @see #DSP_Download_Image_Read
+ * @see #DSP_Download_Image_Parse_Lod
+ * @see #DSP_Download_Image_Free
+ */
+static int DSP_Download_Image_Load(char *filename,struct DSP_Download_Image_Struct **image)
+{
+	FILE *download_fp = NULL;
+	char magic[DSP_DOWNLOAD_IMAGE_MAGIC_LENGTH];
+	int retval;
+
+/* try to open the file */
+	if((download_fp = fopen(filename,"rb")) == NULL)
+	{
+		DSP_Download_Error_Number = 5;
+		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Timing_Utility:Could not open filename(%s).",
+			filename);
+		return FALSE;
+	}
+	(*image) = (struct DSP_Download_Image_Struct *)malloc(sizeof(struct DSP_Download_Image_Struct));
+	if((*image) == NULL)
+	{
+		fclose(download_fp);
+		DSP_Download_Error_Number = 30;
+		sprintf(DSP_Download_Error_String,"DSP_Download_Image_Load:Failed to allocate image for '%s'.",
+			filename);
+		return FALSE;
+	}
+	(*image)->Board_Id = CCD_DSP_HOST_BOARD_ID;
+	(*image)->Block_List = NULL;
+	(*image)->Block_Count = 0;
+	(*image)->Word_List = NULL;
+	(*image)->Word_Count = 0;
+	(*image)->Checksum = 0;
+	(*image)->Reference_Count = 0;
+	if((fread(magic,sizeof(char),DSP_DOWNLOAD_IMAGE_MAGIC_LENGTH,download_fp) == DSP_DOWNLOAD_IMAGE_MAGIC_LENGTH)&&
+	   (memcmp(magic,DSP_DOWNLOAD_IMAGE_MAGIC,DSP_DOWNLOAD_IMAGE_MAGIC_LENGTH) == 0))
+	{
+		retval = DSP_Download_Image_Read(download_fp,filename,(*image));
+	}
+	else
+	{
+		rewind(download_fp);
+		retval = DSP_Download_Image_Parse_Lod(download_fp,filename,(*image));
+		if(retval)
+			(*image)->Checksum = DSP_Download_Image_Checksum((*image));
+	}
+	fclose(download_fp);
+	if(retval == FALSE)
+	{
+		DSP_Download_Image_Free((*image));
+		(*image) = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Parse a .lod text file into an image. Only _DATA sections with an address less than DSP_DOWNLOAD_ADDR_MAX
+ * are added to the image, so the boot code bundled with the application is not downloaded.
+ * @param download_fp The file pointer of the .lod file, positioned at the start of the file.
+ * @param filename The filename of the .lod file, used in error messages.
+ * @param image The image to fill in.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Get_Type
+ * @see #DSP_Download_Read_Line
+ * @see #DSP_Download_Address_Char_To_Mem_Space
+ * @see #DSP_Download_Process_Data
+ * @see #DSP_DOWNLOAD_ADDR_MAX
+ */
+static int DSP_Download_Image_Parse_Lod(FILE *download_fp,char *filename,struct DSP_Download_Image_Struct *image)
+{
+	enum CCD_DSP_MEM_SPACE mem_space;
+	int finished,download_board_id,addr;
+	char buff[255],addr_type;
+
+/* get which board the file is for */
+	if((download_board_id = DSP_Download_Get_Type(download_fp)) == FALSE)
+	{
+		DSP_Download_Error_Number = 6;
+		sprintf(DSP_Download_Error_String,"CCD_DSP_Download_Timing_Utility:Could not get filename type(%s).",
+			filename);
+		return FALSE;
+	}
+	image->Board_Id = download_board_id;
+	finished = FALSE;
+/* parse data until the end of the file is reached */
+	while(!finished)
+	{
+		if(!DSP_Download_Read_Line(download_fp,buff))
+		{
+			DSP_Download_Error_Number = 31;
+			sprintf(DSP_Download_Error_String,"DSP_Download_Image_Parse_Lod:'%s' has no _END.",filename);
+			return FALSE;
+		}
+		if(strncmp(buff,"_END",4) == 0)
+			finished = TRUE;
+		else if(sscanf(buff,"_DATA %c %x",&addr_type,(unsigned int *)&addr) == 2)
+		{
+			if(!DSP_Download_Address_Char_To_Mem_Space(addr_type,&mem_space))
+				return FALSE;
+			if (addr < DSP_DOWNLOAD_ADDR_MAX)
+			{
+				if(!DSP_Download_Process_Data(download_fp,image,mem_space,addr))
+					return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Read a binary image file, as written by DSP_Download_Image_Write. The magic string has already been read.
+ * The file is laid out as a list of 32 bit big-endian integers: version, board id, block count, word count and
+ * checksum, followed by each block's memory space, address and word count, and then the block's words.
+ * The checksum is recomputed and compared with the one in the file.
+ * @param download_fp The file pointer of the binary image, positioned after the magic string.
+ * @param filename The filename of the binary image, used in error messages.
+ * @param image The image to fill in.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Image_Write
+ * @see #DSP_Download_Int_Read
+ * @see #DSP_Download_Image_Checksum
+ * @see #DSP_DOWNLOAD_IMAGE_VERSION
+ */
+static int DSP_Download_Image_Read(FILE *download_fp,char *filename,struct DSP_Download_Image_Struct *image)
+{
+	int version,board_id,block_count,word_count,checksum,mem_space,address,block_word_count,value,i,j;
+
+	if((!DSP_Download_Int_Read(download_fp,&version))||(!DSP_Download_Int_Read(download_fp,&board_id))||
+	   (!DSP_Download_Int_Read(download_fp,&block_count))||(!DSP_Download_Int_Read(download_fp,&word_count))||
+	   (!DSP_Download_Int_Read(download_fp,&checksum)))
+	{
+		DSP_Download_Error_Number = 32;
+		sprintf(DSP_Download_Error_String,"DSP_Download_Image_Read:Failed to read header of '%s'.",filename);
+		return FALSE;
+	}
+	if((version != DSP_DOWNLOAD_IMAGE_VERSION)||
+	   ((board_id != CCD_DSP_TIM_BOARD_ID)&&(board_id != CCD_DSP_UTIL_BOARD_ID))||
+	   (block_count < 0)||(block_count > DSP_DOWNLOAD_IMAGE_BLOCK_MAX)||
+	   (word_count < 0)||(word_count > (block_count*DSP_DOWNLOAD_ADDR_MAX)))
+	{
+		DSP_Download_Error_Number = 33;
+		sprintf(DSP_Download_Error_String,"DSP_Download_Image_Read:'%s' has an illegal header "
+			"(version=%d,board_id=%d,block_count=%d,word_count=%d).",filename,version,board_id,
+			block_count,word_count);
+		return FALSE;
+	}
+	image->Board_Id = board_id;
+	for(i = 0; i < block_count; i++)
+	{
+		if((!DSP_Download_Int_Read(download_fp,&mem_space))||(!DSP_Download_Int_Read(download_fp,&address))||
+		   (!DSP_Download_Int_Read(download_fp,&block_word_count)))
+		{
+			DSP_Download_Error_Number = 34;
+			sprintf(DSP_Download_Error_String,"DSP_Download_Image_Read:Failed to read block %d of '%s'.",
+				i,filename);
+			return FALSE;
+		}
+		if((!CCD_DSP_IS_MEMORY_SPACE(mem_space))||(address < 0)||(block_word_count < 0)||
+		   ((address+block_word_count) > DSP_DOWNLOAD_ADDR_MAX)||
+		   ((image->Word_Count+block_word_count) > word_count))
+		{
+			DSP_Download_Error_Number = 35;
+			sprintf(DSP_Download_Error_String,"DSP_Download_Image_Read:Block %d of '%s' is illegal "
+				"(mem_space=%#x,address=%#x,word_count=%d).",i,filename,mem_space,address,
+				block_word_count);
+			return FALSE;
+		}
+		for(j = 0; j < block_word_count; j++)
+		{
+			if(!DSP_Download_Int_Read(download_fp,&value))
+			{
+				DSP_Download_Error_Number = 36;
+				sprintf(DSP_Download_Error_String,"DSP_Download_Image_Read:Failed to read word %d of "
+					"block %d of '%s'.",j,i,filename);
+				return FALSE;
+			}
+			if(!DSP_Download_Image_Add_Word(image,mem_space,address+j,value))
+				return FALSE;
+		}
+	}
+	image->Checksum = DSP_Download_Image_Checksum(image);
+	if((image->Word_Count != word_count)||(image->Checksum != (unsigned int)checksum))
+	{
+		DSP_Download_Error_Number = 37;
+		sprintf(DSP_Download_Error_String,"DSP_Download_Image_Read:'%s' is corrupt "
+			"(word count %d of %d,checksum %#x of %#x).",filename,image->Word_Count,word_count,
+			image->Checksum,(unsigned int)checksum);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Write an image to filename as a binary image file, in the format read by DSP_Download_Image_Read.
+ * @param filename The filename of the binary image to write.
+ * @param image The image to write.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Image_Read
+ * @see #DSP_Download_Int_Write
+ * @see #DSP_DOWNLOAD_IMAGE_MAGIC
+ * @see #DSP_DOWNLOAD_IMAGE_VERSION
+ */
+static int DSP_Download_Image_Write(char *filename,struct DSP_Download_Image_Struct *image)
+{
+	struct DSP_Download_Block_Struct *block = NULL;
+	FILE *image_fp = NULL;
+	int retval,i,j;
+
+	if((image_fp = fopen(filename,"wb")) == NULL)
+	{
+		DSP_Download_Error_Number = 38;
+		sprintf(DSP_Download_Error_String,"DSP_Download_Image_Write:Could not open filename(%s).",filename);
+		return FALSE;
+	}
+	retval = (fwrite(DSP_DOWNLOAD_IMAGE_MAGIC,sizeof(char),DSP_DOWNLOAD_IMAGE_MAGIC_LENGTH,image_fp) ==
+		  DSP_DOWNLOAD_IMAGE_MAGIC_LENGTH);
+	retval = retval && DSP_Download_Int_Write(image_fp,DSP_DOWNLOAD_IMAGE_VERSION);
+	retval = retval && DSP_Download_Int_Write(image_fp,image->Board_Id);
+	retval = retval && DSP_Download_Int_Write(image_fp,image->Block_Count);
+	retval = retval && DSP_Download_Int_Write(image_fp,image->Word_Count);
+	retval = retval && DSP_Download_Int_Write(image_fp,(int)(image->Checksum));
+	for(i = 0; retval && (i < image->Block_Count); i++)
+	{
+		block = &(image->Block_List[i]);
+		retval = retval && DSP_Download_Int_Write(image_fp,block->Mem_Space);
+		retval = retval && DSP_Download_Int_Write(image_fp,block->Address);
+		retval = retval && DSP_Download_Int_Write(image_fp,block->Word_Count);
+		for(j = 0; retval && (j < block->Word_Count); j++)
+			retval = DSP_Download_Int_Write(image_fp,image->Word_List[block->Word_Index+j]);
+	}
+	if(fclose(image_fp) != 0)
+		retval = FALSE;
+	if(retval == FALSE)
+	{
+		DSP_Download_Error_Number = 39;
+		sprintf(DSP_Download_Error_String,"DSP_Download_Image_Write:Failed to write '%s'.",filename);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Add a word to the end of an image. If the word is in the same memory space as, and the address immediately
+ * following, the last word in the image, it is added to the last block, otherwise a new block is started.
+ * @param image The image to add the word to.
+ * @param mem_space The memory space to write the word to.
+ * @param addr The address to write the word to.
+ * @param value The word.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #DSP_Download_Image_Struct
+ * @see #DSP_Download_Block_Struct
+ */
+static int DSP_Download_Image_Add_Word(struct DSP_Download_Image_Struct *image,
+				      enum CCD_DSP_MEM_SPACE mem_space,int addr,int value)
+{
+	struct DSP_Download_Block_Struct *block = NULL;
+	struct DSP_Download_Block_Struct *new_block_list = NULL;
+	int *new_word_list = NULL;
+
+	if(image->Block_Count > 0)
+		block = &(image->Block_List[image->Block_Count-1]);
+	if((block == NULL)||(block->Mem_Space != mem_space)||((block->Address+block->Word_Count) != addr))
+	{
+		if(image->Block_Count >= DSP_DOWNLOAD_IMAGE_BLOCK_MAX)
+		{
+			DSP_Download_Error_Number = 40;
+			sprintf(DSP_Download_Error_String,"DSP_Download_Image_Add_Word:Too many blocks(%d).",
+				image->Block_Count);
+			return FALSE;
+		}
+		new_block_list = (struct DSP_Download_Block_Struct *)realloc(image->Block_List,
+				(image->Block_Count+1)*sizeof(struct DSP_Download_Block_Struct));
+		if(new_block_list == NULL)
+		{
+			DSP_Download_Error_Number = 41;
+			sprintf(DSP_Download_Error_String,"DSP_Download_Image_Add_Word:Failed to reallocate block list(%d).",
+				image->Block_Count+1);
+			return FALSE;
+		}
+		image->Block_List = new_block_list;
+		block = &(image->Block_List[image->Block_Count]);
+		block->Mem_Space = mem_space;
+		block->Address = addr;
+		block->Word_Index = image->Word_Count;
+		block->Word_Count = 0;
+		image->Block_Count++;
+	}
+/* grow the word list in DSP_DOWNLOAD_ADDR_MAX chunks */
+	if((image->Word_Count % DSP_DOWNLOAD_ADDR_MAX) == 0)
+	{
+		new_word_list = (int *)realloc(image->Word_List,(image->Word_Count+DSP_DOWNLOAD_ADDR_MAX)*sizeof(int));
+		if(new_word_list == NULL)
+		{
+			DSP_Download_Error_Number = 42;
+			sprintf(DSP_Download_Error_String,"DSP_Download_Image_Add_Word:Failed to reallocate word list(%d).",
+				image->Word_Count+DSP_DOWNLOAD_ADDR_MAX);
+			return FALSE;
+		}
+		image->Word_List = new_word_list;
+	}
+	image->Word_List[image->Word_Count++] = value;
+	block->Word_Count++;
+	return TRUE;
+}
+
+/**
+ * Compute the checksum of an image. This is an Adler-32 style checksum over the board id, and each block's memory
+ * space, address, word count and (24 bit) words.
+ * @param image The image.
+ * @return The checksum.
+ * @see #DSP_DOWNLOAD_CHECKSUM_MODULUS
+ */
+static unsigned int DSP_Download_Image_Checksum(struct DSP_Download_Image_Struct *image)
+{
+	struct DSP_Download_Block_Struct *block = NULL;
+	unsigned int sum1,sum2;
+	int i,j;
+
+	sum1 = 1;
+	sum2 = 0;
+	sum1 = (sum1+((unsigned int)image->Board_Id))%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+	sum2 = (sum2+sum1)%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+	for(i = 0; i < image->Block_Count; i++)
+	{
+		block = &(image->Block_List[i]);
+		sum1 = (sum1+(((unsigned int)block->Mem_Space)>>20))%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+		sum2 = (sum2+sum1)%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+		sum1 = (sum1+((unsigned int)block->Address))%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+		sum2 = (sum2+sum1)%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+		sum1 = (sum1+((unsigned int)block->Word_Count))%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+		sum2 = (sum2+sum1)%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+		for(j = 0; j < block->Word_Count; j++)
+		{
+			sum1 = (sum1+(((unsigned int)image->Word_List[block->Word_Index+j])&0xffffff))%
+				DSP_DOWNLOAD_CHECKSUM_MODULUS;
+			sum2 = (sum2+sum1)%DSP_DOWNLOAD_CHECKSUM_MODULUS;
+		}
+	}
+	return (sum2<<16)|sum1;
+}
+
+/**
+ * Free an image allocated by DSP_Download_Image_Load.
+ * @param image The image to free.
+ * @see #DSP_Download_Image_Load
+ */
+static void DSP_Download_Image_Free(struct DSP_Download_Image_Struct *image)
+{
+	if(image->Block_List != NULL)
+		free(image->Block_List);
+	if(image->Word_List != NULL)
+		free(image->Word_List);
+	free(image);
+}
+
+/**
+ * Read back sample words from the board the image is for, and compare them with the image.
+ * The handle's readback sample count words are read (or every word, if the image is smaller), spread evenly
+ * across the image. Reading back a word costs a controller round trip, as writing it does, so only a sample
+ * is read: this detects a board that has been reset or holds a different program, but cannot detect
+ * a program that differs only in words that were not sampled.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param image The image to compare with.
+ * @param matched The address of an integer, set to TRUE if all the sampled words matched, and FALSE otherwise.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ * @see #CCD_DSP_Download_Set_Readback_Sample_Count
+ * @see ccd_dsp.html#CCD_DSP_Command_RDM
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int DSP_Download_Image_Verify(char *class,char *source,CCD_Interface_Handle_T* handle,
+				     struct DSP_Download_Image_Struct *image,int *matched)
+{
+	struct DSP_Download_Block_Struct *block = NULL;
+	int sample_count,sample_index,word_index,block_index,value,i;
+
+	(*matched) = FALSE;
+	if(image->Word_Count == 0)
+		return TRUE;
+	sample_count = handle->DSP_Data.Download_Readback_Sample_Count;
+	if(sample_count > image->Word_Count)
+		sample_count = image->Word_Count;
+	block_index = 0;
+	for(i = 0; i < sample_count; i++)
+	{
+		if(sample_count > 1)
+			sample_index = (int)((((long long)i)*(image->Word_Count-1))/(sample_count-1));
+		else
+			sample_index = 0;
+		/* sample indexes increase, so search forward from the last block */
+		while((image->Block_List[block_index].Word_Index+image->Block_List[block_index].Word_Count) <=
+		      sample_index)
+			block_index++;
+		block = &(image->Block_List[block_index]);
+		word_index = sample_index-block->Word_Index;
+		value = CCD_DSP_Command_RDM(class,source,handle,image->Board_Id,block->Mem_Space,
+					    block->Address+word_index);
+		if((value == 0)&&(CCD_DSP_Get_Error_Number() != 0))
+		{
+			DSP_Download_Error_Number = 43;
+			sprintf(DSP_Download_Error_String,"DSP_Download_Image_Verify:Failed to RDM(%#x,%#x,%#x).",
+				image->Board_Id,block->Mem_Space,block->Address+word_index);
+			return FALSE;
+		}
+		if((value&0xffffff) != (image->Word_List[sample_index]&0xffffff))
+		{
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERY_VERBOSE,
+					      "DSP_Download_Image_Verify:Sample %d (%#x,%#x) was %#x, not %#x.",i,
+					      block->Mem_Space,block->Address+word_index,value,
+					      image->Word_List[sample_index]);
+#endif
+			return TRUE;
+		}
+	}
+	(*matched) = TRUE;
+	return TRUE;
+}
+
+/**
+ * Read a 32 bit big-endian integer from a binary image file.
+ * @param fp The file pointer to read from.
+ * @param value The address of an integer to store the value in.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ */
+static int DSP_Download_Int_Read(FILE *fp,int *value)
+{
+	unsigned char buff[4];
+
+	if(fread(buff,sizeof(unsigned char),4,fp) != 4)
+		return FALSE;
+	(*value) = (int)((((unsigned int)buff[0])<<24)|(((unsigned int)buff[1])<<16)|
+			 (((unsigned int)buff[2])<<8)|((unsigned int)buff[3]));
+	return TRUE;
+}
+
+/**
+ * Write a 32 bit big-endian integer to a binary image file.
+ * @param fp The file pointer to write to.
+ * @param value The value to write.
+ * @return Returns TRUE if the operation succeeds, FALSE if it fails.
+ */
+static int DSP_Download_Int_Write(FILE *fp,int value)
+{
+	unsigned char buff[4];
+
+	buff[0] = (unsigned char)((((unsigned int)value)>>24)&0xff);
+	buff[1] = (unsigned char)((((unsigned int)value)>>16)&0xff);
+	buff[2] = (unsigned char)((((unsigned int)value)>>8)&0xff);
+	buff[3] = (unsigned char)(((unsigned int)value)&0xff);
+	return (fwrite(buff,sizeof(unsigned char),4,fp) == 4);
+}
+
 /*
 ** $Log: not supported by cvs2svn $
 ** Revision 1.7  2009/04/30 14:22:51  cjm
@@ -20,6 +20,7 @@
  */
 #define _POSIX_C_SOURCE 199309L
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +43,9 @@
 #ifdef CFITSIO
 #include "fitsio.h"
 #endif
+#ifdef CCD_EXPOSURE_DIRECT_SAVE
+#include <sys/uio.h>
+#endif
 #ifdef SLALIB
 #include "slalib.h"
 #endif /* SLALIB */
@@ -49,6 +53,15 @@
 #include "ngat_astro.h"
 #include "ngat_astro_mjd.h"
 #endif /* NGATASTRO */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/**
+ * Defined if the SSE2 and AVX2 de-interlace kernels are compiled in. They are selected at run time
+ * if the CPU supports them.
+ */
+#define EXPOSURE_DEINTERLACE_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
 /*#include "ngat_fits.h"  diddly we are not sure whether this mutex is needed yet, or wether
 **  CFITSIO compiled reentrant is sufficient. */
 /* FITS Mutex support */
@@ -66,21 +79,46 @@
  */
 #define EXPOSURE_HSTR_HTF_BITS				(0x38)
 /**
- * Number used to determine how long we keep getting the same number of readout pixels
- * returned before we timeout. This number depeends on the sleep in the loop.
- * This is by default 1 second, which makes this number the number of seconds
- * we don't read out more pixels before we time out.
+ * The number of seconds we keep getting the same number of readout pixels
+ * returned before we timeout.
  */
 #define EXPOSURE_READ_TIMEOUT                           (0x5)
+/**
+ * The longest time, in milliseconds, the exposure monitor loop sleeps between polls of the controller.
+ * Used whilst exposing, until the exposure nears completion.
+ * @see #Exposure_Poll_Interval
+ */
+#define EXPOSURE_POLL_COARSE_TIME			(1000)
+/**
+ * The shortest time, in milliseconds, the exposure monitor loop sleeps between polls of the controller.
+ * Used whilst waiting for the readout to start, and when the readout is predicted to finish.
+ * @see #Exposure_Poll_Interval
+ */
+#define EXPOSURE_POLL_FINE_TIME				(10)
+/**
+ * The time, in milliseconds, the exposure monitor loop sleeps between polls of the controller during readout,
+ * before the pixel readout rate has been measured. This is also the shortest time we sleep whilst exposing, 
+ * as each poll then sends a RET command to the utility board.
+ * @see #Exposure_Poll_Interval
+ */
+#define EXPOSURE_POLL_READOUT_TIME			(100)
 /**
  * The number of milliseconds before the controller stops exposing and starts reading out,
- * that we switch the exposure status from EXPOSING to READOUT. This is done early as we 
- * only check the HSTR status every second, and RDM/TDL/RET/WRM check the exposure status
- * to determine whether it is safe. It is not safe to call RDM/TDl/RET/WRM when
- * the HSTR is in readout mode, so we change exposure state early. Note the value
- * of this define should be greater than the sleep in the exposure loop.
+ * that we switch the exposure status from EXPOSING to PRE_READOUT. RDM/TDL/RET/WRM check the exposure status
+ * to determine whether it is safe, and it is not safe to call them when the HSTR is in readout mode, 
+ * so we change exposure state early. Whilst exposing, Exposure_Poll_Interval schedules the next poll for the
+ * moment this much exposure time is left, but never sleeps less than EXPOSURE_POLL_READOUT_TIME. So the 
+ * switch can be up to EXPOSURE_POLL_READOUT_TIME late, plus the time taken by one poll's HSTR/RET commands. 
+ * The value must be greater than this. 1500 ms leaves a wide margin; it is kept as it is also the 
+ * threshold below which DSP_Send_Sex puts short exposures straight into READOUT, and the value the 
+ * FrodoSpec property files configure.
+ * @see #EXPOSURE_POLL_READOUT_TIME
+ * @see #Exposure_Poll_Interval
  */
 #define EXPOSURE_DEFAULT_READOUT_REMAINING_TIME       	(1500)
+#if EXPOSURE_DEFAULT_READOUT_REMAINING_TIME <= EXPOSURE_POLL_READOUT_TIME
+#error "ccd_exposure.c:EXPOSURE_DEFAULT_READOUT_REMAINING_TIME must be greater than EXPOSURE_POLL_READOUT_TIME."
+#endif
 /**
  * The default amount of time before we are due to start an exposure, that a CLEAR_ARRAY command should be sent to
  * the controller. This time is in seconds, and must be greater than the time the CLEAR_ARRAY command takes to
@@ -92,6 +130,70 @@
  * START_EXPOSURE command, to allow for transmission delay.
  */
 #define EXPOSURE_DEFAULT_START_EXPOSURE_OFFSET_TIME	(2)
+/**
+ * The largest start latency measurement, in nanoseconds, accepted by CCD_Exposure_Measure_Exposure_Start_Time.
+ * Larger values mean the exposure was paused before the elapsed exposure time was read.
+ * @see #CCD_Exposure_Measure_Exposure_Start_Time
+ */
+#define EXPOSURE_START_LATENCY_MAX			(50*CCD_GLOBAL_ONE_MILLISECOND_NS)
+/**
+ * The smallest start latency measurement, in nanoseconds, accepted by CCD_Exposure_Measure_Exposure_Start_Time.
+ * The elapsed exposure time is only returned to the nearest millisecond, so small negative latencies are allowed.
+ * @see #CCD_Exposure_Measure_Exposure_Start_Time
+ */
+#define EXPOSURE_START_LATENCY_MIN			(-CCD_GLOBAL_ONE_MILLISECOND_NS)
+/**
+ * Each new start latency measurement is weighted 1/EXPOSURE_START_LATENCY_WEIGHT in the running average.
+ * @see #CCD_Exposure_Measure_Exposure_Start_Time
+ */
+#define EXPOSURE_START_LATENCY_WEIGHT			(8)
+/**
+ * Boolean passed to CCD_Exposure_DeInterlace as the byte_swap parameter, TRUE if the application
+ * rather than the device driver byte swaps the image data (CCD_EXPOSURE_BYTE_SWAP is defined).
+ * @see #CCD_Exposure_DeInterlace
+ */
+#ifdef CCD_EXPOSURE_BYTE_SWAP
+#define EXPOSURE_BYTE_SWAP				(TRUE)
+#else
+#define EXPOSURE_BYTE_SWAP				(FALSE)
+#endif
+/**
+ * The number of rows a streaming readout de-interlaces into it's row buffer, before writing them to the FITS file.
+ * @see #Exposure_Stream_Write_Rows
+ */
+#define EXPOSURE_STREAM_BLOCK_ROWS			(16)
+/**
+ * How long to wait, in milliseconds, for the FITS writer thread to save a frame, before checking whether the
+ * exposure has been aborted, when all the frames in the image buffer pool are in use.
+ * @see #Exposure_Frame_Acquire
+ */
+#define EXPOSURE_WRITER_WAIT_TIME			(100)
+#ifdef CCD_EXPOSURE_DIRECT_SAVE
+/**
+ * The length of a FITS block in bytes. FITS headers and data units are padded to a multiple of this length.
+ */
+#define EXPOSURE_FITS_BLOCK_LENGTH			(2880)
+/**
+ * The length of a FITS header card in bytes.
+ */
+#define EXPOSURE_FITS_CARD_LENGTH			(80)
+/**
+ * The maximum number of FITS blocks the direct FITS writer will read looking for the END card,
+ * before deciding the file does not contain a valid FITS header.
+ * @see #Exposure_Save_Header_Read
+ */
+#define EXPOSURE_FITS_HEADER_BLOCK_MAX			(100)
+/**
+ * The value of BZERO used to store unsigned short image data as FITS signed 16 bit integers.
+ */
+#define EXPOSURE_FITS_BZERO				(32768)
+/**
+ * The number of pixels the direct FITS writer converts to the FITS representation at a time, into a chunk buffer,
+ * before writing them.
+ * @see #Exposure_Save
+ */
+#define EXPOSURE_FITS_CHUNK_PIXELS			(32768)
+#endif
 
 /* structure */
 /**
@@ -99,15 +201,161 @@
  * <dl>
  * <dt>FITS_Mutex</dt> <dd>Optionally compiled mutex locking around CFITSIO calls, as the current version of
  *     CFITSIO we are using is not thread safe.</dd>
+ * <dt>DeInterlace_Kernel</dt> <dd>Which row kernel CCD_Exposure_DeInterlace uses.</dd>
  * </dl>
+ * @see #CCD_Exposure_DeInterlace
  */
 struct Exposure_Struct
 {
 #ifdef CCD_CFITSIO_MUTEXED
       pthread_mutex_t FITS_Mutex;
 #endif
+      enum CCD_EXPOSURE_DEINTERLACE_KERNEL DeInterlace_Kernel;
+};
+
+/**
+ * Structure used to hold the state of a streaming readout, where full frame rows are byte swapped,
+ * de-interlaced and written to the FITS file whilst the rest of the CCD is still being read out.
+ * <dl>
+ * <dt>Fp</dt> <dd>The file pointer of the open FITS file, or NULL if the stream is not open. This is a CFITSIO
+ *     fitsfile pointer if CFITSIO is compiled in, otherwise a stdio FILE pointer.</dd>
+ * <dt>Filename</dt> <dd>The FITS filename being written to.</dd>
+ * <dt>NCols</dt> <dd>The number of columns in the read out image.</dd>
+ * <dt>NRows</dt> <dd>The number of rows in the read out image.</dd>
+ * <dt>DeInterlace_Type</dt> <dd>The type of de-interlacing to apply to each block of rows.</dd>
+ * <dt>Row_Count</dt> <dd>The number of rows already processed and written to the FITS file.</dd>
+ * <dt>Row_Buffer</dt> <dd>An allocated buffer of EXPOSURE_STREAM_BLOCK_ROWS rows, the de-interlaced rows
+ *     are written into this before being saved.</dd>
+ * </dl>
+ * @see #EXPOSURE_STREAM_BLOCK_ROWS
+ * @see ccd_dsp.html#CCD_DSP_DEINTERLACE_TYPE
+ */
+struct Exposure_Stream_Struct
+{
+#ifdef CFITSIO
+	fitsfile *Fp;
+#else
+	FILE *Fp;
+#endif
+	char *Filename;
+	int NCols;
+	int NRows;
+	enum CCD_DSP_DEINTERLACE_TYPE DeInterlace_Type;
+	int Row_Count;
+	unsigned short *Row_Buffer;
 };
 
+/**
+ * Structure used to hold the state of one exposure, whilst it is being taken, read out and saved.
+ * This allows CCD_Exposure_Expose_Multi to monitor several exposures from one thread.
+ * <dl>
+ * <dt>Class</dt> <dd>The class parameter to use for any log messages associated with this exposure.</dd>
+ * <dt>Source</dt> <dd>The source parameter to use for any log messages associated with this exposure.</dd>
+ * <dt>Handle</dt> <dd>The handle of the controller taking the exposure.</dd>
+ * <dt>Filename_List</dt> <dd>The list of filenames to save the exposure into.</dd>
+ * <dt>Filename_Count</dt> <dd>The number of filenames in Filename_List.</dd>
+ * <dt>Exposure_Time</dt> <dd>The length of the exposure in milliseconds.</dd>
+ * <dt>Window_Flags</dt> <dd>The window flags of the controller's setup.</dd>
+ * <dt>Expected_Pixel_Count</dt> <dd>The number of pixels to be read out.</dd>
+ * <dt>Streaming</dt> <dd>A boolean, TRUE if the readout is being streamed to disk.</dd>
+ * <dt>Stream</dt> <dd>The streaming readout state, if Streaming is TRUE.</dd>
+ * <dt>Exposure_Data</dt> <dd>The read out reply data, or NULL if it has not been retrieved yet.</dd>
+ * <dt>Elapsed_Exposure_Time</dt> <dd>The last elapsed exposure time read from the controller,
+ *     in milliseconds.</dd>
+ * <dt>Readout_Detected</dt> <dd>A boolean, TRUE once the readout has been seen to start.</dd>
+ * <dt>Current_Pixel_Count</dt> <dd>The number of pixels read out at the last poll.</dd>
+ * <dt>Last_Pixel_Count</dt> <dd>The number of pixels read out at the poll before that.</dd>
+ * <dt>Pixel_Rate</dt> <dd>The measured readout rate, in pixels per millisecond.</dd>
+ * <dt>Progress_Time</dt> <dd>When the readout progress last changed.</dd>
+ * <dt>Stage_Start_Time</dt> <dd>When the current stage of the exposure started.</dd>
+ * <dt>Started</dt> <dd>A boolean, TRUE once the START_EXPOSURE command has been sent successfully.</dd>
+ * <dt>Done</dt> <dd>A boolean, TRUE when all the pixels have been read out.</dd>
+ * <dt>Active</dt> <dd>A boolean, TRUE until the exposure fails or is aborted.</dd>
+ * <dt>Error_Number</dt> <dd>The error number the exposure failed with.</dd>
+ * <dt>Error_String</dt> <dd>The error string the exposure failed with.</dd>
+ * </dl>
+ * @see #Exposure_Stream_Struct
+ * @see #CCD_Exposure_Expose
+ * @see #CCD_Exposure_Expose_Multi
+ */
+struct Exposure_Expose_Struct
+{
+	char *Class;
+	char *Source;
+	CCD_Interface_Handle_T *Handle;
+	char **Filename_List;
+	int Filename_Count;
+	int Exposure_Time;
+	int Window_Flags;
+	int Expected_Pixel_Count;
+	int Streaming;
+	struct Exposure_Stream_Struct Stream;
+	unsigned short *Exposure_Data;
+	int Elapsed_Exposure_Time;
+	int Readout_Detected;
+	int Current_Pixel_Count;
+	int Last_Pixel_Count;
+	double Pixel_Rate;
+	struct timespec Progress_Time;
+	struct timespec Stage_Start_Time;
+	int Started;
+	int Done;
+	int Active;
+	int Error_Number;
+	char Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH];
+};
+
+/**
+ * Structure used to hold the post-readout processing of one window of a windowed exposure. Each active
+ * window is de-interlaced and saved by Exposure_Window_Process, in parallel with the other windows.
+ * <dl>
+ * <dt>Class</dt> <dd>The class parameter to use for any log messages associated with this window.</dd>
+ * <dt>Source</dt> <dd>The source parameter to use for any log messages associated with this window.</dd>
+ * <dt>Handle</dt> <dd>The handle of the controller the window was read out from.</dd>
+ * <dt>Window_Number</dt> <dd>The number of the window (0..CCD_SETUP_WINDOW_COUNT-1).</dd>
+ * <dt>Filename</dt> <dd>The FITS filename to save the window into.</dd>
+ * <dt>NCols</dt> <dd>The number of columns in the window.</dd>
+ * <dt>NRows</dt> <dd>The number of rows in the window.</dd>
+ * <dt>Raw_Data</dt> <dd>The start of the window's data in the read out data.</dd>
+ * <dt>Image_Data</dt> <dd>Where to put the de-interlaced window. If this is the same as Raw_Data, the window
+ *     is already in the right order, and is saved directly from the read out data.</dd>
+ * <dt>DeInterlace_Type</dt> <dd>The type of de-interlacing to apply to the window.</dd>
+ * <dt>Save</dt> <dd>A boolean, TRUE if the window is to be saved, FALSE if it is only to be de-interlaced
+ *     (when the frame is queued for the FITS writer thread).</dd>
+ * <dt>Exposure_Start_Time</dt> <dd>The start time of the exposure, for the FITS headers.</dd>
+ * <dt>Stop</dt> <dd>The address of an integer shared by all the windows of the exposure. This is set
+ *     (atomically) when any window fails, so the other windows stop as soon as possible.</dd>
+ * <dt>Transform_Time</dt> <dd>How long the window took to de-interlace, in milliseconds.</dd>
+ * <dt>Save_Started</dt> <dd>A boolean, TRUE once we have started to save the window. The FITS file is not
+ *     deleted after this if the window fails, as it may contain the image data.</dd>
+ * <dt>Successful</dt> <dd>A boolean, TRUE if the window was processed (and saved) successfully.</dd>
+ * <dt>Error_Number</dt> <dd>The error number the window failed with.</dd>
+ * <dt>Error_String</dt> <dd>The error string the window failed with.</dd>
+ * </dl>
+ * @see #Exposure_Window_Process
+ * @see #Exposure_Expose_Post_Readout_Window
+ */
+struct Exposure_Window_Struct
+{
+	char *Class;
+	char *Source;
+	CCD_Interface_Handle_T *Handle;
+	int Window_Number;
+	char *Filename;
+	int NCols;
+	int NRows;
+	unsigned short *Raw_Data;
+	unsigned short *Image_Data;
+	enum CCD_DSP_DEINTERLACE_TYPE DeInterlace_Type;
+	int Save;
+	struct timespec Exposure_Start_Time;
+	int *Stop;
+	double Transform_Time;
+	int Save_Started;
+	int Successful;
+	int Error_Number;
+	char Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH];
+};
 
 /* external variables */
 
@@ -118,49 +366,121 @@ struct Exposure_Struct
 static char rcsid[] = "$Id: ccd_exposure.c,v 0.41 2014-08-28 17:03:19 cjm Exp $";
 
 /**
- * Variable holding error code of last operation performed by ccd_exposure.
+ * Variable holding error code of last operation performed by ccd_exposure,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int Exposure_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int Exposure_Error_Number = 0;
 /**
- * Local variable holding description of the last error that occured.
+ * Local variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char Exposure_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char Exposure_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 /**
  * Data holding the current status of ccd_exposure. This is statically initialised to the following:
  * <dl>
  * <dt>FITS_Mutex</dt> <dd>If compiled in, PTHREAD_MUTEX_INITIALIZER</dd>
+ * <dt>DeInterlace_Kernel</dt> <dd>CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR, CCD_Exposure_Initialise selects
+ *     the fastest kernel the CPU supports.</dd>
  * </dl>
  * @see #Exposure_Struct
  */
 static struct Exposure_Struct Exposure_Data = 
 {
 #ifdef CCD_CFITSIO_MUTEXED
-      PTHREAD_MUTEX_INITIALIZER
+      PTHREAD_MUTEX_INITIALIZER,
 #endif
+      CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR
 };
 
 
 /* internal functions */
 static int Exposure_Shutter_Control(char *class,char *source,CCD_Interface_Handle_T* handle,int value);
+static int Exposure_Expose_Prepare(char *class,char *source,struct Exposure_Expose_Struct *expose,int clear_array,
+				   int open_shutter,int exposure_time);
+static int Exposure_Expose_Wait_Start(char *class,char *source,struct Exposure_Expose_Struct *expose_list,
+				      int expose_count,int clear_array,struct timespec start_time);
+static int Exposure_Expose_Stream_Open(char *class,char *source,struct Exposure_Expose_Struct *expose);
+static int Exposure_Expose_Start(char *class,char *source,struct Exposure_Expose_Struct *expose,
+				 struct timespec start_time);
+static int Exposure_Expose_Monitor(char *class,char *source,struct Exposure_Expose_Struct *expose,int *poll_time);
+static int Exposure_Expose_Poll_Wait(char *class,char *source,struct Exposure_Expose_Struct *expose,int poll_time);
+static int Exposure_Expose_Post_Readout(char *class,char *source,struct Exposure_Expose_Struct *expose);
+static void *Exposure_Expose_Multi_Thread(void *user_arg);
+static void Exposure_Expose_Fail(char *class,char *source,struct Exposure_Expose_Struct *expose);
+static void Exposure_Expose_Error(struct Exposure_Expose_Struct *expose);
 static int Exposure_Expose_Post_Readout_Full_Frame(char *class,char *source,CCD_Interface_Handle_T* handle,
 						   unsigned short *exposure_data,char *filename);
 static int Exposure_Expose_Post_Readout_Window(char *class,char *source,CCD_Interface_Handle_T* handle,
 					       unsigned short *exposure_data,char **filename_list,int filename_count);
-/* we should provide an alternative for these two routines if the library is not using short ints. */
+/* we should provide an alternative for these routines if the library is not using short ints. */
 #if CCD_GLOBAL_BYTES_PER_PIXEL == 2
-static void Exposure_Byte_Swap(char *class,char *source,unsigned short *svalues,long nvals);
-static int Exposure_DeInterlace(char *class,char *source,int ncols,int nrows,unsigned short *old_iptr,
-				enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type);
+static void Exposure_DeInterlace_Row(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+				     int reverse,int byte_swap);
+static void Exposure_DeInterlace_Row_Scalar(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+					    int reverse,int byte_swap);
+#ifdef EXPOSURE_DEINTERLACE_X86
+static void Exposure_DeInterlace_Row_SSE2(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+					  int reverse,int byte_swap);
+static void Exposure_DeInterlace_Row_AVX2(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+					  int reverse,int byte_swap);
+#endif
 #else
 #error CCD_GLOBAL_BYTES_PER_PIXEL uses illegal value.
 #endif
 static int Exposure_Save(char *class,char *source,char *filename,unsigned short *exposure_data,int ncols,int nrows,
 			 struct timespec start_time);
+#ifdef CFITSIO
+static int Exposure_Save_Update_Keywords(char *class,char *source,fitsfile *fp,char *filename,
+					 struct timespec start_time);
+#endif
+#ifdef CCD_EXPOSURE_DIRECT_SAVE
+static int Exposure_Save_Header_Read(int fd,char *filename,char **header,int *header_length);
+static int Exposure_Save_Header_Check(char *filename,char *header,int header_length,int ncols,int nrows);
+static int Exposure_Save_Header_Update_Keywords(char *filename,char **header,int *header_length,
+						struct timespec start_time);
+static int Exposure_Save_Header_Update_Card(char *filename,char **header,int *header_length,char *keyword,
+					    char *value_string);
+static char *Exposure_Save_Header_Find_Card(char *header,int header_length,char *keyword);
+static int Exposure_Save_Header_Get_Card_Value(char *header,int header_length,char *keyword,double *value);
+static void Exposure_Save_To_FITS_Order(unsigned short *exposure_data,unsigned char *fits_data,int pixel_count);
+static int Exposure_Save_Write_Vector(int fd,struct iovec *iov,int iov_count);
+#endif
+static int Exposure_Stream_Open(char *class,char *source,CCD_Interface_Handle_T* handle,char *filename,
+				struct Exposure_Stream_Struct *stream);
+static int Exposure_Stream_Write_Rows(char *class,char *source,struct Exposure_Stream_Struct *stream,
+				      unsigned short *exposure_data,int pixel_count);
+static int Exposure_Stream_Close(char *class,char *source,struct Exposure_Stream_Struct *stream,
+				 struct timespec start_time);
+static void Exposure_Stream_Abort(struct Exposure_Stream_Struct *stream);
+static int Exposure_Poll_Interval(CCD_Interface_Handle_T* handle,int exposure_time,int elapsed_exposure_time,
+				  int expected_pixel_count,int current_pixel_count,double pixel_rate);
+static double Exposure_TimeSpec_Diff_Ms(struct timespec start_time,struct timespec end_time);
+static void Exposure_Start_Time_Add_Latency(CCD_Interface_Handle_T* handle);
+static void Exposure_Status_Set(CCD_Interface_Handle_T* handle,enum CCD_EXPOSURE_STATUS status);
+static void Exposure_Status_Publish(CCD_Interface_Handle_T* handle);
+static void Exposure_Status_Publish_Progress(CCD_Interface_Handle_T* handle,struct Exposure_Expose_Struct *expose);
+static void Exposure_Status_Write_Begin(CCD_Interface_Handle_T* handle);
+static void Exposure_Status_Write_End(CCD_Interface_Handle_T* handle);
+static void Exposure_Stage_Start(struct timespec *stage_start_time);
+static void Exposure_Stage_End(CCD_Interface_Handle_T* handle,enum CCD_EXPOSURE_STAGE stage,
+			       struct timespec *stage_start_time);
 static void Exposure_TimeSpec_To_Date_String(struct timespec time,char *time_string);
 static void Exposure_TimeSpec_To_Date_Obs_String(struct timespec time,char *time_string);
 static void Exposure_TimeSpec_To_UtStart_String(struct timespec time,char *time_string);
 static int Exposure_TimeSpec_To_Mjd(struct timespec time,int leap_second_correction,double *mjd);
 static int Exposure_Expose_Delete_Fits_Images(char *class,char *source,char **filename_list,int filename_count);
+static void *Exposure_Window_Thread(void *user_arg);
+static void Exposure_Window_Process(struct Exposure_Window_Struct *window);
+static void Exposure_Window_Error(struct Exposure_Window_Struct *window);
+static int Exposure_Frame_Allocate(char *class,char *source,CCD_Interface_Handle_T* handle,int frame_index);
+static int Exposure_Frame_Acquire(char *class,char *source,CCD_Interface_Handle_T* handle,int *frame_index);
+static void Exposure_Frame_Release(CCD_Interface_Handle_T* handle,int frame_index);
+static int Exposure_Frame_Save(char *class,char *source,CCD_Interface_Handle_T* handle,int frame_index);
+static int Exposure_Writer_Start(char *class,char *source,CCD_Interface_Handle_T* handle);
+static int Exposure_Writer_Stop(char *class,char *source,CCD_Interface_Handle_T* handle);
+static void *Exposure_Writer_Thread(void *user_arg);
 #ifdef CCD_CFITSIO_MUTEXED
 static int Exposure_FITS_Mutex_Lock(void);
 static int Exposure_FITS_Mutex_Unlock(void);
@@ -174,6 +494,9 @@ static int fexist(char *filename);
  * It now passes the FITS_Mutex address to the ngat.fits library,
  * so CFITSIO calls are mutex locked across libraries:- CFITSIO is currently crashing
  * due to multi-threading issues.
+ * It selects the fastest de-interlace kernel supported by the CPU.
+ * @see #Exposure_Data
+ * @see #CCD_Exposure_DeInterlace_Kernel_Supported
  * @see ../../../ngatfits/cdocs/ngat_fits.html#NGAT_Fits_Set_FITS_Mutex
  */
 void CCD_Exposure_Initialise(void)
@@ -191,6 +514,17 @@ void CCD_Exposure_Initialise(void)
 #else
 	fprintf(stdout,"CCD_Exposure_Initialise:NOT Using CFITSIO.\n");
 #endif
+#ifdef CCD_EXPOSURE_DIRECT_SAVE
+	fprintf(stdout,"CCD_Exposure_Initialise:Image data is saved by the direct FITS writer.\n");
+#endif
+	/* select the fastest de-interlace kernel this CPU supports */
+	if(CCD_Exposure_DeInterlace_Kernel_Supported(CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2))
+		Exposure_Data.DeInterlace_Kernel = CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2;
+	else if(CCD_Exposure_DeInterlace_Kernel_Supported(CCD_EXPOSURE_DEINTERLACE_KERNEL_SSE2))
+		Exposure_Data.DeInterlace_Kernel = CCD_EXPOSURE_DEINTERLACE_KERNEL_SSE2;
+	else
+		Exposure_Data.DeInterlace_Kernel = CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR;
+	fprintf(stdout,"CCD_Exposure_Initialise:Using de-interlace kernel %d.\n",Exposure_Data.DeInterlace_Kernel);
 #ifdef CCD_CFITSIO_MUTEXED
 	/* Send the address of FITS_Mutex to the ngat.fits library, so CFITSIO
 	** routines accessed from the Java layer to write FITS headers, are protected from 
@@ -212,13 +546,36 @@ diddly we are not sure whether this mutex is needed yet, or wether
  * <dt>Readout_Remaining_Time</dt> <dd>EXPOSURE_DEFAULT_READOUT_REMAINING_TIME</dd>
  * <dt>Exposure_Length</dt> <dd>0</dd>
  * <dt>Exposure_Start_Time</dt> <dd>{0L,0L}</dd>
+ * <dt>Start_Exposure_Send_Time</dt> <dd>{0L,0L}</dd>
+ * <dt>Start_Exposure_Latency</dt> <dd>0</dd>
+ * <dt>Start_Exposure_Latency_Count</dt> <dd>0</dd>
+ * <dt>Start_Exposure_Measured</dt> <dd>TRUE</dd>
+ * <dt>Streaming_Readout</dt> <dd>FALSE</dd>
+ * <dt>Readout_Progress_Wait</dt> <dd>FALSE</dd>
+ * <dt>Frame_List</dt> <dd>All buffers NULL with size 0, and not in use.</dd>
+ * <dt>Async_Save</dt> <dd>FALSE</dd>
+ * <dt>Save_Callback</dt> <dd>NULL</dd>
+ * <dt>Writer_Running</dt> <dd>FALSE</dd>
+ * <dt>Writer_Quit</dt> <dd>FALSE</dd>
+ * <dt>Writer_Mutex</dt> <dd>Initialised with pthread_mutex_init.</dd>
+ * <dt>Writer_Condition</dt> <dd>Initialised with pthread_cond_init.</dd>
+ * <dt>Writer_Queue_Head</dt> <dd>0</dd>
+ * <dt>Writer_Queue_Count</dt> <dd>0</dd>
+ * <dt>Writer_Pending_Count</dt> <dd>0</dd>
+ * <dt>Writer_Failed_Count</dt> <dd>0</dd>
+ * <dt>Readout_Pixel_Rate</dt> <dd>0.0</dd>
+ * <dt>Status_Sequence</dt> <dd>0</dd>
+ * <dt>Status_Snapshot</dt> <dd>A copy of the status fields above, with no progress.</dd>
  * </dl>
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see #Exposure_Status_Publish
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 void CCD_Exposure_Data_Initialise(CCD_Interface_Handle_T* handle)
 {
+	int frame_index,i;
+
 	handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
 	handle->Exposure_Data.Start_Exposure_Clear_Time = EXPOSURE_DEFAULT_START_EXPOSURE_CLEAR_TIME;
 	handle->Exposure_Data.Start_Exposure_Offset_Time = EXPOSURE_DEFAULT_START_EXPOSURE_OFFSET_TIME;
@@ -226,38 +583,72 @@ void CCD_Exposure_Data_Initialise(CCD_Interface_Handle_T* handle)
 	handle->Exposure_Data.Exposure_Length = 0;
 	handle->Exposure_Data.Exposure_Start_Time.tv_sec = 0;
 	handle->Exposure_Data.Exposure_Start_Time.tv_nsec = 0;
+	handle->Exposure_Data.Start_Exposure_Send_Time.tv_sec = 0;
+	handle->Exposure_Data.Start_Exposure_Send_Time.tv_nsec = 0;
+	handle->Exposure_Data.Start_Exposure_Latency = 0;
+	handle->Exposure_Data.Start_Exposure_Latency_Count = 0;
+	handle->Exposure_Data.Start_Exposure_Measured = TRUE;
+	handle->Exposure_Data.Streaming_Readout = FALSE;
+	handle->Exposure_Data.Readout_Progress_Wait = FALSE;
+	for(frame_index = 0; frame_index < CCD_EXPOSURE_FRAME_COUNT; frame_index++)
+	{
+		for(i=0;i<CCD_SETUP_WINDOW_COUNT;i++)
+		{
+			handle->Exposure_Data.Frame_List[frame_index].Image_Buffer_List[i] = NULL;
+			handle->Exposure_Data.Frame_List[frame_index].Image_Buffer_Size_List[i] = 0;
+		}
+		handle->Exposure_Data.Frame_List[frame_index].In_Use = FALSE;
+		handle->Exposure_Data.Frame_List[frame_index].Image_Count = 0;
+	}
+	handle->Exposure_Data.Async_Save = FALSE;
+	handle->Exposure_Data.Save_Callback = NULL;
+	handle->Exposure_Data.Writer_Running = FALSE;
+	handle->Exposure_Data.Writer_Quit = FALSE;
+	pthread_mutex_init(&(handle->Exposure_Data.Writer_Mutex),NULL);
+	pthread_cond_init(&(handle->Exposure_Data.Writer_Condition),NULL);
+	handle->Exposure_Data.Writer_Queue_Head = 0;
+	handle->Exposure_Data.Writer_Queue_Count = 0;
+	handle->Exposure_Data.Writer_Pending_Count = 0;
+	handle->Exposure_Data.Writer_Failed_Count = 0;
+	for(i=0;i<CCD_EXPOSURE_STAGE_COUNT;i++)
+		handle->Exposure_Data.Stage_Time_List[i] = -1.0;
+	handle->Exposure_Data.Readout_Pixel_Rate = 0.0;
+	handle->Exposure_Data.Status_Sequence = 0;
+	handle->Exposure_Data.Status_Snapshot.Elapsed_Exposure_Time = 0;
+	handle->Exposure_Data.Status_Snapshot.Readout_Pixel_Count = 0;
+	handle->Exposure_Data.Status_Snapshot.Expected_Pixel_Count = 0;
+	handle->Exposure_Data.Status_Snapshot.Readout_Progress = 0.0;
+	handle->Exposure_Data.Status_Snapshot.Predicted_End_Time.tv_sec = 0;
+	handle->Exposure_Data.Status_Snapshot.Predicted_End_Time.tv_nsec = 0;
+	handle->Exposure_Data.Status_Snapshot.Update_Time.tv_sec = 0;
+	handle->Exposure_Data.Status_Snapshot.Update_Time.tv_nsec = 0;
+	Exposure_Status_Publish(handle);
 }
 
 /**
  * Routine to perform an exposure.
  * <ul>
- * <li>It checks to ensure CCD Setup has been successfully completed using CCD_Setup_Get_Setup_Complete.
- * <li>The controller is told whether to open the shutter or not during the exposure, depending on the value
- * 	of the open_shutter parameter.
- * <li>The length of exposure is sent to the controller using CCD_DSP_Command_SET.
- * <li>A sleep is executed until it is nearly (Exposure_Data.Start_Exposure_Clear_Time) time to start the exposure.
- * <li>The array is cleared using CCD_DSP_Command_CLR.
- * <li>The exposure is started by calling CCD_DSP_Command_SEX.
+ * <li>The exposure is prepared using Exposure_Expose_Prepare. This checks CCD Setup has been successfully
+ * 	completed and the parameters are sensible, tells the controller whether to open the shutter or not
+ * 	during the exposure, and sends the length of exposure to the controller using CCD_DSP_Command_SET.
+ * <li>Exposure_Expose_Wait_Start sleeps until it is nearly (Exposure_Data.Start_Exposure_Clear_Time) time to
+ * 	start the exposure, and then clears the array.
+ * <li>If we are streaming the readout, the FITS file is opened using Exposure_Expose_Stream_Open.
+ * <li>The exposure is started by calling Exposure_Expose_Start, which calls CCD_DSP_Command_SEX.
  * <li>Enter a loop, until the readout is completed:
  * 	<ul>
- * 	<li>Get the Host Status Transfer Register value, using CCD_DSP_Command_Get_HSTR.
- * 	<li>If we are not reading out, and have more than Exposure_Data.Readout_Remaining_Time milliseconds 
- * 		left of exposure, use CCD_DSP_Command_RET to get the current elapsed exposure time.
- * 	<li>If the exposure length minus the current elapsed exposure time is less than 
- * 		Exposure_Data.Readout_Remaining_Time milliseconds, switch exposure status to READOUT.
- * 	<li>If we are in readout mode, use CCD_DSP_Command_Get_Readout_Progress to get how many pixels
- * 		we have read out.
- * 	<li>Check to see if we have finished reading out.
- * 	<li>Check to see whether we have been aborted.
+ * 	<li>Call Exposure_Expose_Monitor to check the progress of the exposure and readout.
+ * 	<li>Wait for the time returned by Exposure_Expose_Monitor, using Exposure_Expose_Poll_Wait.
  *	</ul>
- * <li>Get a pointer to the read out reply data, using CCD_Interface_Get_Reply_Data.
- * <li>If byte swapping is enabled, the data is byte swapped with Exposure_Byte_Swap.
- * <li>If we are reading out a full frame, call Exposure_Expose_Post_Readout_Full_Frame. Otherwise call
- *     Exposure_Expose_Post_Readout_Window.
+ * <li>Exposure_Expose_Post_Readout then processes and saves the read out data.
  * </ul>
+ * Streaming readout is used when Exposure_Data.Streaming_Readout is TRUE, the readout is not windowed, and
+ * the de-interlace type is single, flip or split serial (where each read out row maps onto one image row).
  * The Exposure_Data.Exposure_Status is changed to reflect the operation being performed on the CCD.
  * If the exposure is aborted at any stage the routine returns. Exposure_Expose_Delete_Fits_Images is
  * called to attempt to delete the blank FITS files, if the routine fails or is aborted.
+ * The time taken by each stage of the exposure is recorded in Exposure_Data.Stage_Time_List,
+ * see CCD_Exposure_Get_Stage_Time.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
@@ -270,47 +661,30 @@ void CCD_Exposure_Data_Initialise(CCD_Interface_Handle_T* handle)
  * 	the exposure can be started at any convenient time.
  * @param exposure_time The length of time to open the shutter for in milliseconds. This must be greater than zero,
  * 	and less than the maximum exposure length CCD_DSP_EXPOSURE_MAX_LENGTH.
- * @param filename_list A list of filenames to save the exposure into. This is normally of length 1,unless 
+ * @param filename_list A list of filenames to save the exposure into. This is normally of length 1,unless
  *        we are windowing, in which case there will be one filename for each window.
  * @param filename_count The number of filenames in the filename_list.
- * @return Returns TRUE if the exposure succeeds and the file is saved, returns FALSE if an error
- *	occurs or the exposure is aborted.
- * @see #EXPOSURE_HSTR_HTF_BITS
- * @see #CCD_EXPOSURE_HSTR_READOUT
- * @see #CCD_EXPOSURE_HSTR_BIT_SHIFT
- * @see #EXPOSURE_READ_TIMEOUT
+ * @return Returns TRUE if the exposure succeeds and the file is saved (or queued to be saved),
+ *	returns FALSE if an error occurs or the exposure is aborted.
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
- * @see #Exposure_Shutter_Control
- * @see #Exposure_Byte_Swap
- * @see #Exposure_Expose_Post_Readout_Full_Frame
- * @see #Exposure_Expose_Post_Readout_Window
- * @see #Exposure_Expose_Delete_Fits_Images
- * @see ccd_setup.html#CCD_Setup_Get_Setup_Complete
- * @see ccd_setup.html#CCD_Setup_Get_Window_Flags
- * @see ccd_setup.html#CCD_Setup_Get_Readout_Pixel_Count
- * @see ccd_setup.html#CCD_Setup_Get_DeInterlace_Type
- * @see ccd_dsp.html#CCD_DSP_Command_CLR
- * @see ccd_dsp.html#CCD_DSP_Command_SET
- * @see ccd_dsp.html#CCD_DSP_Command_SEX
- * @see ccd_dsp.html#CCD_DSP_Command_Get_HSTR
- * @see ccd_dsp.html#CCD_DSP_Command_RET
- * @see ccd_dsp.html#CCD_DSP_Command_Get_Readout_Progress
- * @see ccd_dsp.html#CCD_DSP_EXPOSURE_MAX_LENGTH
- * @see ccd_interface.html#CCD_Interface_Get_Reply_Data
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Prepare
+ * @see #Exposure_Expose_Wait_Start
+ * @see #Exposure_Expose_Stream_Open
+ * @see #Exposure_Expose_Start
+ * @see #Exposure_Expose_Monitor
+ * @see #Exposure_Expose_Poll_Wait
+ * @see #Exposure_Expose_Post_Readout
+ * @see #CCD_Exposure_Set_Async_Save
+ * @see #CCD_Exposure_Get_Stage_Time
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 int CCD_Exposure_Expose(char *class,char *source,CCD_Interface_Handle_T* handle,int clear_array,int open_shutter,
 			struct timespec start_time,int exposure_time,
 			char **filename_list,int filename_count)
 {
-	struct timespec sleep_time,current_time;
-#ifndef _POSIX_TIMERS
-	struct timeval gtod_current_time;
-#endif
-	unsigned short *exposure_data = NULL;
-	int elapsed_exposure_time,done;
-	int status,window_flags;
-	int expected_pixel_count,current_pixel_count,last_pixel_count,readout_timeout_count;
+	struct Exposure_Expose_Struct expose;
+	int poll_time;
 
 	Exposure_Error_Number = 0;
 #if LOGGING > 0
@@ -318,499 +692,291 @@ int CCD_Exposure_Expose(char *class,char *source,CCD_Interface_Handle_T* handle,
 			      "open_shutter=%d,start_time_sec=%ld,exposure_time=%d,filename_count=%d) started.",
 			      handle,clear_array,open_shutter,start_time.tv_sec,exposure_time,filename_count);
 #endif
-/* reset abort flag */
-	CCD_DSP_Set_Abort(class,source,handle,FALSE);
-/* we shouldn't be able to expose until setup has been successfully completed - check this */
-	if(!CCD_Setup_Get_Setup_Complete(handle))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 1;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Exposure failed:Setup was not complete");
+	expose.Class = class;
+	expose.Source = source;
+	expose.Handle = handle;
+	expose.Filename_List = filename_list;
+	expose.Filename_Count = filename_count;
+	if(!Exposure_Expose_Prepare(class,source,&expose,clear_array,open_shutter,exposure_time))
 		return FALSE;
-	}
-/* check parameter ranges */
-	if(!CCD_GLOBAL_IS_BOOLEAN(clear_array))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 6;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:clear_array = %d.",
-			clear_array);
+	if(!Exposure_Expose_Wait_Start(class,source,&expose,1,clear_array,start_time))
 		return FALSE;
-	}
-	if(!CCD_GLOBAL_IS_BOOLEAN(open_shutter))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 2;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:open_shutter = %d.",
-			open_shutter);
+	if(!Exposure_Expose_Stream_Open(class,source,&expose))
 		return FALSE;
-	}
-	if((exposure_time < 0)||(exposure_time > CCD_DSP_EXPOSURE_MAX_LENGTH))
+	if(!Exposure_Expose_Start(class,source,&expose,start_time))
+		return FALSE;
+/* wait while the exposure is taken and read out */
+	while(expose.Done == FALSE)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 3;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:exposure_time = %d",exposure_time);
+		if(!Exposure_Expose_Monitor(class,source,&expose,&poll_time))
+			return FALSE;
+		if(expose.Done == FALSE)
+		{
+			if(!Exposure_Expose_Poll_Wait(class,source,&expose,poll_time))
+				return FALSE;
+		}
+	}/* end while not done */
+	if(!Exposure_Expose_Post_Readout(class,source,&expose))
 		return FALSE;
-	}
-	if(filename_count < 0)
+#if LOGGING > 0
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"CCD_Exposure_Expose(handle=%p) returned TRUE.",
+			      handle);
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to perform a synchronised exposure on several controllers (e.g. the red and blue arms).
+ * All the exposures are started against the one start_time, and are monitored from the calling thread,
+ * rather than each needing its own thread calling CCD_Exposure_Expose. Each exposure goes through the same
+ * stages as CCD_Exposure_Expose:
+ * <ul>
+ * <li>Each exposure is prepared using Exposure_Expose_Prepare.
+ * <li>Exposure_Expose_Wait_Start waits until it is nearly time to start the exposures, using the longest
+ * 	Start_Exposure_Clear_Time of the controllers.
+ * <li>Streaming readouts are opened with Exposure_Expose_Stream_Open.
+ * <li>The exposures are started with Exposure_Expose_Start, in the order their START_EXPOSURE commands are due
+ * 	to be sent (start_time less each controller's start latency, see CCD_Exposure_Get_Start_Exposure_Latency).
+ * 	Each waits for it's own send time. The controller access lock is only held for the end of each wait,
+ * 	so each exposure starts on time unless the previous START_EXPOSURE is still being sent.
+ * <li>Each exposure is polled in turn using Exposure_Expose_Monitor, until all the readouts are complete.
+ * 	We wait for the shortest poll time returned, using Exposure_Expose_Poll_Wait. If any controllers
+ * 	are reading out with Readout_Progress_Wait set, the wait polls the readout progress of the one
+ * 	nearest completion.
+ * <li>The post-readout processing and saving of each exposure (Exposure_Expose_Post_Readout) is done in
+ * 	parallel, one thread per exposure (Exposure_Expose_Multi_Thread).
+ * </ul>
+ * If an exposure fails or is aborted, the others carry on. The Successful and Error_String fields of
+ * each element of multi_list are filled in with the result of that exposure. The Exposure_Start_Time and 
+ * Start_Skew fields are filled in with when each exposure started, and how long after the first one.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param multi_list A list of CCD_Exposure_Multi_Struct, one for each controller. The Handle, Filename_List
+ * 	and Filename_Count fields should be filled in.
+ * @param multi_count The number of elements in multi_list.
+ * @param clear_array An integer representing a boolean. This should be set to TRUE if we wish to
+ * 	manually clear the arrays before the exposures start, FALSE if we do not. This is usually TRUE.
+ * @param open_shutter TRUE if the shutters are to be opened over the duration of the exposure, FALSE if the
+ * 	shutters should remain closed.
+ * @param start_time The time to start the exposures. If both the fields in the <i>struct timespec</i> are zero,
+ * 	the exposures can be started at any convenient time.
+ * @param exposure_time The length of time to open the shutters for in milliseconds.
+ * @return Returns TRUE if all the exposures succeed and their files are saved (or queued to be saved),
+ *	returns FALSE if any exposure fails or is aborted.
+ * @see #CCD_Exposure_Multi_Struct
+ * @see #CCD_Exposure_Expose
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Prepare
+ * @see #Exposure_Expose_Wait_Start
+ * @see #Exposure_Expose_Stream_Open
+ * @see #Exposure_Expose_Start
+ * @see #Exposure_Expose_Monitor
+ * @see #Exposure_Expose_Poll_Wait
+ * @see #Exposure_Expose_Multi_Thread
+ * @see #Exposure_TimeSpec_Diff_Ms
+ * @see #CCD_Exposure_Get_Start_Exposure_Latency
+ * @see #CCD_Exposure_Get_Exposure_Start_Time
+ */
+int CCD_Exposure_Expose_Multi(char *class,char *source,struct CCD_Exposure_Multi_Struct *multi_list,int multi_count,
+			      int clear_array,int open_shutter,struct timespec start_time,int exposure_time)
+{
+	struct Exposure_Expose_Struct *expose_list = NULL;
+	struct Exposure_Expose_Struct *wait_expose = NULL;
+	struct timespec first_start_time;
+	pthread_t *thread_list = NULL;
+	int *thread_created_list = NULL;
+	int *start_order_list = NULL;
+	int i,j,done,poll_time,min_poll_time,fail_count,start_count;
+	double progress,wait_progress;
+
+	Exposure_Error_Number = 0;
+#if LOGGING > 0
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"CCD_Exposure_Expose_Multi(multi_count=%d,"
+			      "clear_array=%d,open_shutter=%d,start_time_sec=%ld,exposure_time=%d) started.",
+			      multi_count,clear_array,open_shutter,start_time.tv_sec,exposure_time);
+#endif
+	if(multi_list == NULL)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 7;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:filename_count = %d",filename_count);
+		Exposure_Error_Number = 110;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose_Multi:multi_list was NULL.");
 		return FALSE;
 	}
-	window_flags = CCD_Setup_Get_Window_Flags(handle);
-	if((window_flags == 0)&&(filename_count > 1))
+	if(multi_count < 1)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 8;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Too many filenames for window_flags %d:"
-			"filename_count = %d",window_flags,filename_count);
+		Exposure_Error_Number = 111;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose_Multi:Illegal multi_count %d.",multi_count);
 		return FALSE;
 	}
-/* get information from setup that we need to do an exposure */
-	expected_pixel_count = CCD_Setup_Get_Readout_Pixel_Count(handle);
-	if(expected_pixel_count <= 0)
+	expose_list = (struct Exposure_Expose_Struct *)malloc(multi_count*sizeof(struct Exposure_Expose_Struct));
+	thread_list = (pthread_t *)malloc(multi_count*sizeof(pthread_t));
+	thread_created_list = (int *)malloc(multi_count*sizeof(int));
+	start_order_list = (int *)malloc(multi_count*sizeof(int));
+	if((expose_list == NULL)||(thread_list == NULL)||(thread_created_list == NULL)||(start_order_list == NULL))
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 9;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal expected pixel count '%d'.",
-			expected_pixel_count);
+		if(expose_list != NULL)
+			free(expose_list);
+		if(thread_list != NULL)
+			free(thread_list);
+		if(thread_created_list != NULL)
+			free(thread_created_list);
+		if(start_order_list != NULL)
+			free(start_order_list);
+		Exposure_Error_Number = 112;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose_Multi:Failed to allocate memory for %d exposures.",
+			multi_count);
 		return FALSE;
 	}
-/* if we have aborted - stop here */
-	if(CCD_DSP_Get_Abort(handle))
+/* prepare each exposure. Failed exposures are marked as not Active, and are skipped from then on. */
+	for(i=0;i<multi_count;i++)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 4;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted");
-		return FALSE;
+		expose_list[i].Class = class;
+		expose_list[i].Source = source;
+		expose_list[i].Handle = multi_list[i].Handle;
+		expose_list[i].Filename_List = multi_list[i].Filename_List;
+		expose_list[i].Filename_Count = multi_list[i].Filename_Count;
+		Exposure_Expose_Prepare(class,source,&(expose_list[i]),clear_array,open_shutter,exposure_time);
 	}
-/* setup the shutter control bit - which determines whether the SEX command has
-** control to open and close the shutter at the appropriate times */
-#if LOGGING > 4
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			      "CCD_Exposure_Expose(handle=%p):Setting shutter control(%d).",
-			      handle,open_shutter);
-#endif
-	if(!Exposure_Shutter_Control(class,source,handle,open_shutter))
+	Exposure_Expose_Wait_Start(class,source,expose_list,multi_count,clear_array,start_time);
+	for(i=0;i<multi_count;i++)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		return FALSE;
+		if(expose_list[i].Active)
+			Exposure_Expose_Stream_Open(class,source,&(expose_list[i]));
 	}
-	if(CCD_DSP_Get_Abort(handle))
+/* start the exposures, in the order their START_EXPOSURE commands are due to be sent. Each is sent 
+** start latency before start_time, so the controller with the longest start latency goes first. */
+	start_count = 0;
+	for(i=0;i<multi_count;i++)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 5;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted");
-		return FALSE;
+		if(expose_list[i].Active == FALSE)
+			continue;
+		for(j=start_count;(j > 0)&&
+			    (CCD_Exposure_Get_Start_Exposure_Latency(expose_list[start_order_list[j-1]].Handle) <
+			     CCD_Exposure_Get_Start_Exposure_Latency(expose_list[i].Handle));j--)
+		{
+			start_order_list[j] = start_order_list[j-1];
+		}
+		start_order_list[j] = i;
+		start_count++;
 	}
-/* write the time to memory so that SEX can read it */
-#if LOGGING > 4
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			      "CCD_Exposure_Expose(handle=%p):Setting exposure length(%d).",
-			      handle,exposure_time);
+	for(i=0;i<start_count;i++)
+		Exposure_Expose_Start(class,source,&(expose_list[start_order_list[i]]),start_time);
+/* monitor all the exposures from this thread, until they have all been read out */
+	done = FALSE;
+	while(done == FALSE)
+	{
+		done = TRUE;
+		min_poll_time = EXPOSURE_POLL_COARSE_TIME;
+		wait_expose = NULL;
+		wait_progress = -1.0;
+		for(i=0;i<multi_count;i++)
+		{
+			if((expose_list[i].Active == FALSE)||expose_list[i].Done)
+				continue;
+			if(!Exposure_Expose_Monitor(class,source,&(expose_list[i]),&poll_time))
+				continue;
+			if(expose_list[i].Done == FALSE)
+			{
+				done = FALSE;
+				if(poll_time < min_poll_time)
+					min_poll_time = poll_time;
+				/* wait on the readout progress of the readout nearest completion */
+				if(expose_list[i].Handle->Exposure_Data.Readout_Progress_Wait &&
+				   (expose_list[i].Handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_READOUT))
+				{
+					progress = ((double)expose_list[i].Current_Pixel_Count)/
+						((double)expose_list[i].Expected_Pixel_Count);
+					if(progress > wait_progress)
+					{
+						wait_expose = &(expose_list[i]);
+						wait_progress = progress;
+					}
+				}
+			}
+		}
+		if(done == FALSE)
+		{
+#if LOGGING > 9
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+					      "CCD_Exposure_Expose_Multi:Next poll in %d ms.",min_poll_time);
 #endif
-	if(!CCD_DSP_Command_SET(class,source,handle,exposure_time))
+			/* if the wait fails, that exposure has failed, the others are polled straight away */
+			Exposure_Expose_Poll_Wait(class,source,wait_expose,min_poll_time);
+		}
+	}/* end while not done */
+/* process and save each exposure in its own thread. If a thread cannot be created,
+** process that exposure in this thread instead. */
+	for(i=0;i<multi_count;i++)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 23;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Setting exposure time failed.");
-		return FALSE;
+		thread_created_list[i] = FALSE;
+		if(expose_list[i].Active == FALSE)
+			continue;
+		if(pthread_create(&(thread_list[i]),NULL,Exposure_Expose_Multi_Thread,(void *)&(expose_list[i])) == 0)
+			thread_created_list[i] = TRUE;
+		else
+			Exposure_Expose_Multi_Thread((void *)&(expose_list[i]));
 	}
-	handle->Exposure_Data.Exposure_Length = exposure_time;
-	if(CCD_DSP_Get_Abort(handle))
+	for(i=0;i<multi_count;i++)
 	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 25;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted");
-		return FALSE;
+		if(thread_created_list[i])
+			pthread_join(thread_list[i],NULL);
 	}
-/* initialise variables */
-/* We will use the start_time parameter to determine when to start the exposure IF 
-** it's seconds are greater then zero */ 
-/* do the clear array a few seconds before the exposure is due to start */
-	if(start_time.tv_sec > 0)
+/* combine the results */
+	first_start_time.tv_sec = 0;
+	first_start_time.tv_nsec = 0;
+	for(i=0;i<multi_count;i++)
 	{
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_WAIT_START;
-		done = FALSE;
-		while(done == FALSE)
+		if(expose_list[i].Started)
 		{
-#ifdef _POSIX_TIMERS
-			clock_gettime(CLOCK_REALTIME,&current_time);
-#else
-			gettimeofday(&gtod_current_time,NULL);
-			current_time.tv_sec = gtod_current_time.tv_sec;
-			current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
-#endif
+			multi_list[i].Exposure_Start_Time = CCD_Exposure_Get_Exposure_Start_Time(expose_list[i].Handle);
+			if((first_start_time.tv_sec == 0)||
+			   (Exposure_TimeSpec_Diff_Ms(first_start_time,multi_list[i].Exposure_Start_Time) < 0.0))
+				first_start_time = multi_list[i].Exposure_Start_Time;
+		}
+		else
+		{
+			multi_list[i].Exposure_Start_Time.tv_sec = 0;
+			multi_list[i].Exposure_Start_Time.tv_nsec = 0;
+		}
+	}
+	fail_count = 0;
+	for(i=0;i<multi_count;i++)
+	{
+		if(expose_list[i].Started)
+		{
+			multi_list[i].Start_Skew = Exposure_TimeSpec_Diff_Ms(first_start_time,
+									      multi_list[i].Exposure_Start_Time);
 #if LOGGING > 4
-			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				       "CCD_Exposure_Expose(handle=%p):Waiting for exposure start time (%ld,%ld).",
-				       handle,current_time.tv_sec,start_time.tv_sec);
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"CCD_Exposure_Expose_Multi:"
+					      "Exposure %d started %.3f ms after the first.",i,multi_list[i].Start_Skew);
 #endif
-		/* if we've time, sleep for a second */
-			if((start_time.tv_sec - current_time.tv_sec) > handle->Exposure_Data.Start_Exposure_Clear_Time)
-			{
-				sleep_time.tv_sec = 1;
-				sleep_time.tv_nsec = 0;
-				nanosleep(&sleep_time,NULL);
-			}
-			else
-				done = TRUE;
-		/* check - have we been aborted? */
-			if(CCD_DSP_Get_Abort(handle))
+		}
+		else
+			multi_list[i].Start_Skew = 0.0;
+		multi_list[i].Successful = expose_list[i].Active;
+		if(expose_list[i].Active)
+			multi_list[i].Error_String[0] = '\0';
+		else
+		{
+			strncpy(multi_list[i].Error_String,expose_list[i].Error_String,CCD_GLOBAL_ERROR_STRING_LENGTH-1);
+			multi_list[i].Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH-1] = '\0';
+			if(fail_count == 0)
 			{
-				Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-				handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-				Exposure_Error_Number = 37;
-				sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
-				return FALSE;
+				Exposure_Error_Number = 113;
+				sprintf(Exposure_Error_String,"CCD_Exposure_Expose_Multi:Exposure %d failed:",i);
+				strncat(Exposure_Error_String,expose_list[i].Error_String,
+					CCD_GLOBAL_ERROR_STRING_LENGTH-strlen(Exposure_Error_String)-1);
 			}
-		}/* end while */
+			fail_count++;
+		}
 	}
-/* clear the array */
-	if(clear_array)
-	{
-#if LOGGING > 4
-		/*		CCD_Global_Log(LOG_VERBOSITY_INTERMEDIATE,"CCD_Exposure_Expose():Clearing CCD array.");*/
-		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				    "CCD_Exposure_Expose(handle=%p):Clearing is commented out at the moment.",handle);
-#endif
-		/* diddly
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_CLEAR;
-		if(!CCD_DSP_Command_CLR(class,source,handle))
-		{
-			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-			handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-			Exposure_Error_Number = 38;
-			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Clear Array failed.");
-			return FALSE;
-		}
-		*/
-
-	}
-/* check - have we been aborted? */
-	if(CCD_DSP_Get_Abort(handle))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-		Exposure_Error_Number = 20;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
-		return FALSE;
-	}
-/* Send the command to start the exposure, and monitor for completion. */
-#if LOGGING > 4
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			      "CCD_Exposure_Expose(handle=%p):Starting Exposure.",handle);
-#endif
-	/* Exposure status is set in CCD_DSP_Command_SEX, as this routine sleeps before starting
-	** the exposure. */
-	if(!CCD_DSP_Command_SEX(class,source,handle,start_time,exposure_time))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-		Exposure_Error_Number = 39;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:SEX command failed(%ld,%ld,%d).",
-			start_time.tv_sec,start_time.tv_nsec,exposure_time);
-		return FALSE;
-	}
-/* wait while the exposure is taken and read out */
-	done = FALSE;
-        elapsed_exposure_time = 0;
-	current_pixel_count = 0;
-	last_pixel_count = 0;
-	while(done == FALSE)
-	{
-#if LOGGING > 4
-		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			       "CCD_Exposure_Expose(handle=%p):Getting Host Status Transfer Register.",handle);
-#endif
-		if(!CCD_DSP_Command_Get_HSTR(class,source,handle,&status))
-		{
-			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-			handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-			Exposure_Error_Number = 40;
-			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Getting HSTR failed.");
-			return FALSE;
-		}
-#if LOGGING > 9
-		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				      "CCD_Exposure_Expose(handle=%p):HSTR is %#x.",handle,status);
-#endif
-		status = (status & EXPOSURE_HSTR_HTF_BITS) >> CCD_EXPOSURE_HSTR_BIT_SHIFT;
-#if LOGGING > 9
-		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				      "CCD_Exposure_Expose(handle=%p):HSTR reply bits %#x.",handle,status);
-#endif
-		if(status != CCD_EXPOSURE_HSTR_READOUT)
-		{
-			/* are we about to start reading out? */
-			if((exposure_time - elapsed_exposure_time) >= handle->Exposure_Data.Readout_Remaining_Time)
-			{
-#if LOGGING > 4
-				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				       "CCD_Exposure_Expose(handle=%p):Getting Elapsed exposure time.",handle);
-#endif
-				/* get elapsed time from controller */
-				elapsed_exposure_time = CCD_DSP_Command_RET(class,source,handle);
-#if LOGGING > 9
-				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				       "CCD_Exposure_Expose(handle=%p):Elapsed exposure time is %#x.",
-						      handle,elapsed_exposure_time);
-#endif
-				if (elapsed_exposure_time < 0)
-					elapsed_exposure_time = 0;
-				if(elapsed_exposure_time == 0)
-				{
-					if(CCD_DSP_Get_Error_Number() != 0)
-						CCD_DSP_Error();
-				}
-			}/* end if there is over handle->Exposure_Data.Readout_Remaining_Time milliseconds of exposure left */
-			if((handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_EXPOSE)&&
-			   ((exposure_time - elapsed_exposure_time) < handle->Exposure_Data.Readout_Remaining_Time))
-			{
-				/* Here we change the Exposure status to PRE_READOUT, when there
-				** is less than handle->Exposure_Data.Readout_Remaining_Time milliseconds of 
-				** exposure time left. 
-				** The exposure status is checked in WRM,RDM,TDL and RET commands, 
-				** so we can't send these commands when in readout mode. 
-				** We switch to exposure readout handle->Exposure_Data.Readout_Remaining_Time milliseconds 
-				** early as we sleep for a second at the bottom of the loop, and the HSTR status
-				** may change before we check it again. */
-				handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_PRE_READOUT;
-#if LOGGING > 4
-				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-						      "CCD_Exposure_Expose(handle=%p):Exposure Status "
-						      "changed to PRE_READOUT %d milliseconds before readout starts.",
-						      handle,(exposure_time - elapsed_exposure_time));
-#endif
-			}/* end if there  is less than handle->Exposure_Data.Readout_Remaining_Time milliseconds 
-			 ** of exposure time left */
-		}/* end if HSTR status is not readout */
-		/* Testing whether the status is CCD_EXPOSURE_HSTR_READOUT can fail to be detected, 
-		** if it is in this state for less than one second (i.e. dual amplifier readout with binning 4)
-		** We could try the following test to get round this:
-		**    if(handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_PRE_READOUT and
-		**       exposure_time - elapsed_exposure_time < 0)
-		**         handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_READOUT
-		** However this won't work as we go into PRE_READOUT (which stops updating elapsed_exposure_time)
-		** 1500 ms before the exposure fails.
-		** See below for solution.
-		*/
-		if(status == CCD_EXPOSURE_HSTR_READOUT)
-		{
-#if LOGGING > 4
-			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				       "CCD_Exposure_Expose(handle=%p):HSTR Status is READOUT.",handle);
-#endif
-			/* is this the first time through the loop we have detected readout mode? */
-			if(handle->Exposure_Data.Exposure_Status != CCD_EXPOSURE_STATUS_READOUT)
-			{
-				handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_READOUT;
-#if LOGGING > 4
-				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				 "CCD_Exposure_Expose(handle=%p):Exposure Status changed to READOUT(HSTR).",handle);
-#endif
-			}
-		}
-		/* We want to get the readout progress after we have moved into exposure status readout.
-		** We want to continue getting readout progress after the HSTR status has come out of readout mode,
-		** to get the progress of the last few bytes read out whilst we were sleeping. 
-		** We used to only get readout progress when:
-		** (handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_READOUT), (i.e. during and after
-		** we had detected HSTR register status to be CCD_EXPOSURE_HSTR_READOUT)
-		** However we can miss detecting readout mode, if the whole readout takes less than 1 second.
-		*/
-#if LOGGING > 4
-		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			       "CCD_Exposure_Expose(handle=%p):Getting Readout Progress.",handle);
-#endif
-		last_pixel_count = current_pixel_count;
-		if(!CCD_DSP_Command_Get_Readout_Progress(class,source,handle,&current_pixel_count))
-		{
-			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-			handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-			Exposure_Error_Number = 41;
-			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Get Readout Progress failed.");
-			return FALSE;
-		}
-#if LOGGING > 9
-		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				      "CCD_Exposure_Expose(handle=%p):Readout progress is %#x of %#x pixels.",
-				      handle,current_pixel_count,expected_pixel_count);
-#endif
-		/* If the current pixel count is greater than zero, we must be reading out, right? 
-	        ** Correct, see IIA in START_EXPOSURE (timCCDmisc.asm), INITIALIZE_NUMBER_OF_PIXELS in pciboot.asm,
-		** READ_NUMBER_OF_PIXELS_READ (0x8075) in pciboot.asm, and READ_PIXEL_COUNT/ASTROPCI_GET_PROGRESS in
-		** astropci.c. */
-		if(current_pixel_count > 0)
-		{
-			/* is this the first time through the loop we have detected readout mode? */
-			if(handle->Exposure_Data.Exposure_Status != CCD_EXPOSURE_STATUS_READOUT)
-			{
-				handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_READOUT;
-#if LOGGING > 4
-				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-						      "CCD_Exposure_Expose(handle=%p):"
-						   "Exposure Status changed to READOUT(current_pixel_count).",handle);
-#endif
-			}
-		}
-		/* We can only have a readout timeout, if we are in readout mode. */
-		if(handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_READOUT)
-		{
-			/* has the pixel count changed. If not, increment timeout */
-			if(current_pixel_count == last_pixel_count)
-				readout_timeout_count++;
-			else
-				readout_timeout_count = 0;
-			/* have we timed out? If so, exit loop. */
-			if(readout_timeout_count == EXPOSURE_READ_TIMEOUT)
-			{
-				Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-#if LOGGING > 9
-				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				       "CCD_Exposure_Expose(handle=%p):Readout timeout has occured.",handle);
-#endif
-				handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-				Exposure_Error_Number = 43;
-				sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Readout timed out.");
-				return FALSE;
-			}
-		} 
-		/* check - have we been aborted? */
-		if(CCD_DSP_Get_Abort(handle))
-		{
-#if LOGGING > 4
-			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-					      "CCD_Exposure_Expose(handle=%p):Abort detected.",handle);
-#endif
-			if(handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_EXPOSE)
-			{
-#if LOGGING > 4
-				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-						      "CCD_Exposure_Expose(handle=%p):Trying AEX.",handle);
-#endif
-				if(CCD_DSP_Command_AEX(class,source,handle) != CCD_DSP_DON)
-				{
-					Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-					handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-					Exposure_Error_Number = 15;
-					sprintf(Exposure_Error_String,"CCD_Exposure_Expose:AEX Abort command failed.");
-					return FALSE;
-				}
-				Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-				/* we now only abort when exposure status is STATUS_EXPOSE. */
-				handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-				Exposure_Error_Number = 42;
-				sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
-				return FALSE;
-			}
-			/* If the exposure status is PRE_READOUT, we should wait until it is READOUT,
-			** and the call ABR. */
-			/* If the exposure status is READOUT, we should call ABR.
-			** However ABR seems to be causing lockups even when called correctly.
-			** So for now we let the READOUT continue until it is finished,
-			** then an ABORT check after the exposure/readout loop will catch the abort. */
-		}
-		/* check - all pixels read out? */
-		if(current_pixel_count >= expected_pixel_count)
-		{
-#if LOGGING > 9
-			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-					      "CCD_Exposure_Expose(handle=%p):Readout completed.",handle);
-#endif
-			done = TRUE;
-		}
-		/* sleep for a bit */
-		sleep_time.tv_sec = 1;
-		sleep_time.tv_nsec = 0;
-		nanosleep(&sleep_time,NULL);
-	}/* end while not done */
-	/* did the readout time out?*/
-	if(readout_timeout_count == EXPOSURE_READ_TIMEOUT)
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-		Exposure_Error_Number = 30;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Readout timed out.");
-		return FALSE;
-	}
-/* check - have we been aborted? */
-	if(CCD_DSP_Get_Abort(handle))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-		Exposure_Error_Number = 24;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
-		return FALSE;
-	}
-#if LOGGING > 4
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			      "CCD_Exposure_Expose(handle=%p):Getting reply data.",handle);
-#endif
-	/* get data */
-	if(!CCD_Interface_Get_Reply_Data(handle,&exposure_data))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-		Exposure_Error_Number = 44;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Failed to get reply data.");
-		return FALSE;
-	}
-	handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_POST_READOUT;
-/* did we abort? */
-	if(CCD_DSP_Get_Abort(handle))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-		Exposure_Error_Number = 26;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
-		return FALSE;
-	}
-/* byte swap to get into right order */
-#ifdef CCD_EXPOSURE_BYTE_SWAP
-#if LOGGING > 4
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			      "CCD_Exposure_Expose(handle=%p):Byte swapping.",handle);
-#endif
-	Exposure_Byte_Swap(class,source,exposure_data,expected_pixel_count);
-#endif
-/* did we abort? */
-	if(CCD_DSP_Get_Abort(handle))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-		Exposure_Error_Number = 29;
-		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+	free(expose_list);
+	free(thread_list);
+	free(thread_created_list);
+	free(start_order_list);
+	if(fail_count > 0)
 		return FALSE;
-	}
-/* post-readout processing depends on whether we are windowing or not. */
-	if(window_flags == 0)
-	{
-		if(Exposure_Expose_Post_Readout_Full_Frame(class,source,handle,exposure_data,
-							   filename_list[0]) == FALSE)
-		{
-			/* Do not call Exposure_Expose_Delete_Fits_Images here - we may have saved to disk */
-			handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-			return FALSE;
-		}
-	}
-	else
-	{
-		if(Exposure_Expose_Post_Readout_Window(class,source,handle,exposure_data,filename_list,
-						       filename_count) == FALSE)
-		{
-			/* Do not call Exposure_Expose_Delete_Fits_Images here - we may have saved to disk */
-			handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-			return FALSE;
-		}
-	}
-/* reset exposure status */
-	handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
 #if LOGGING > 0
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"CCD_Exposure_Expose(handle=%p) returned TRUE.",
-			      handle);
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"CCD_Exposure_Expose_Multi returned TRUE.");
 #endif
 	return TRUE;
 }
@@ -1009,6 +1175,7 @@ int CCD_Exposure_Read_Out_CCD(char *class,char *source,CCD_Interface_Handle_T* h
  * Routine to set the current value of the exposure status.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @param status The exposure status.
+ * @see #Exposure_Status_Set
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see #CCD_EXPOSURE_STATUS
  * @see #CCD_EXPOSURE_IS_STATUS
@@ -1022,46 +1189,92 @@ int CCD_Exposure_Set_Exposure_Status(CCD_Interface_Handle_T* handle,enum CCD_EXP
 		sprintf(Exposure_Error_String,"CCD_Exposure_Set_Exposure_Status:Status illegal value (%d).",status);
 		return FALSE;
 	}
-	handle->Exposure_Data.Exposure_Status = status;
+	Exposure_Status_Set(handle,status);
 	return TRUE;
 }
 
 /**
- * This routine gets the current value of Exposure Status.
- * Exposure_Status is defined in Exposure_Data.
+ * This routine gets the current value of Exposure Status, from the published status snapshot.
+ * It can be called from any thread, and does not take the DSP mutex.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @return The current status of exposure.
  * @see #CCD_EXPOSURE_STATUS
+ * @see #CCD_Exposure_Get_Status_Snapshot
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 enum CCD_EXPOSURE_STATUS CCD_Exposure_Get_Exposure_Status(CCD_Interface_Handle_T* handle)
 {
-	return handle->Exposure_Data.Exposure_Status;
+	struct CCD_Exposure_Status_Struct status_snapshot;
+
+	CCD_Exposure_Get_Status_Snapshot(handle,&status_snapshot);
+	return status_snapshot.Exposure_Status;
 }
 
 /**
- * This routine gets the current value of Exposure Length.
+ * This routine gets the current value of Exposure Length, from the published status snapshot.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @return The last exposure length.
+ * @see #CCD_Exposure_Get_Status_Snapshot
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 int CCD_Exposure_Get_Exposure_Length(CCD_Interface_Handle_T* handle)
 {
-	return handle->Exposure_Data.Exposure_Length;
+	struct CCD_Exposure_Status_Struct status_snapshot;
+
+	CCD_Exposure_Get_Status_Snapshot(handle,&status_snapshot);
+	return status_snapshot.Exposure_Length;
 }
 
 /**
- * This routine gets the time stamp for the start of the exposure.
+ * This routine gets the time stamp for the start of the exposure, from the published status snapshot.
+ * The time stamp is never seen half updated.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @return The time stamp for the start of the exposure.
+ * @see #CCD_Exposure_Get_Status_Snapshot
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 struct timespec CCD_Exposure_Get_Exposure_Start_Time(CCD_Interface_Handle_T* handle)
 {
-	return handle->Exposure_Data.Exposure_Start_Time;
+	struct CCD_Exposure_Status_Struct status_snapshot;
+
+	CCD_Exposure_Get_Status_Snapshot(handle,&status_snapshot);
+	return status_snapshot.Exposure_Start_Time;
+}
+
+/**
+ * Routine to get a consistent copy of the exposure status of a controller, as published by the thread
+ * taking the exposure. This is meant for status pollers: it can be called from any thread at a high rate,
+ * takes no locks (in particular not the DSP mutex), and never returns fields from two different updates.
+ * The snapshot is protected by a sequence lock: we copy it whilst Status_Sequence is even and
+ * unchanged over the copy, and retry otherwise.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param status_snapshot The address of a CCD_Exposure_Status_Struct to fill in.
+ * @see #CCD_Exposure_Status_Struct
+ * @see #Exposure_Status_Write_Begin
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+void CCD_Exposure_Get_Status_Snapshot(CCD_Interface_Handle_T* handle,
+				      struct CCD_Exposure_Status_Struct *status_snapshot)
+{
+	unsigned int sequence;
+
+	do
+	{
+		sequence = handle->Exposure_Data.Status_Sequence;
+		while(sequence & 1)
+		{
+			sched_yield();
+			sequence = handle->Exposure_Data.Status_Sequence;
+		}
+		__sync_synchronize();
+		(*status_snapshot) = handle->Exposure_Data.Status_Snapshot;
+		__sync_synchronize();
+	}
+	while(sequence != handle->Exposure_Data.Status_Sequence);
 }
 
 /**
@@ -1093,7 +1306,8 @@ int CCD_Exposure_Get_Start_Exposure_Clear_Time(CCD_Interface_Handle_T* handle)
 
 /**
  * Routine to set the amount of time, in milliseconds, before the desired start of exposure that we should send the
- * START_EXPOSURE command, to allow for transmission delay.
+ * START_EXPOSURE command, to allow for transmission delay. This is only used until the start latency has been
+ * measured, see CCD_Exposure_Get_Start_Exposure_Latency.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
  * @param time The time, in milliseconds.
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
@@ -1121,8 +1335,9 @@ int CCD_Exposure_Get_Start_Exposure_Offset_Time(CCD_Interface_Handle_T* handle)
  * Routine to set the amount of time, in milleseconds, remaining for an exposure when we change status to READOUT, 
  * to stop RDM/TDL/WRMs affecting the readout.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
- * @param time The time, in milliseconds. Note, because the exposure time is read every second, it is best
- * 	not have have this constant an exact multiple of 1000.
+ * @param time The time, in milliseconds. This must be greater than the shortest time the exposure monitor
+ * 	loop sleeps between polls whilst exposing (EXPOSURE_POLL_READOUT_TIME, 100 ms), plus the time taken by
+ * 	one poll, or the status may not change before the readout starts.
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
@@ -1145,435 +1360,182 @@ int CCD_Exposure_Get_Readout_Remaining_Time(CCD_Interface_Handle_T* handle)
 }
 
 /**
- * Routine to set the Exposure_Start_Time of Exposure_Data, to the current time of the real time clock.
- * clock_gettime or gettimeofday is used, depending on whether _POSIX_TIMERS is defined.
+ * Routine to set the Exposure_Start_Time of Exposure_Data. This should be called just before the START_EXPOSURE
+ * command is sent to the controller. The current time of the real time clock is saved as Start_Exposure_Send_Time,
+ * and Exposure_Start_Time is set to this plus the measured start latency (if any latency measurements have been
+ * made). The latency of this exposure is then measured by the next call to CCD_Exposure_Measure_Exposure_Start_Time.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see #Exposure_Start_Time_Add_Latency
+ * @see #CCD_Exposure_Measure_Exposure_Start_Time
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Time
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 void CCD_Exposure_Set_Exposure_Start_Time(CCD_Interface_Handle_T* handle)
 {
-#ifndef _POSIX_TIMERS
-	struct timeval gtod_current_time;
-#endif
-
-#ifdef _POSIX_TIMERS
-	clock_gettime(CLOCK_REALTIME,&(handle->Exposure_Data.Exposure_Start_Time));
-#else
-	gettimeofday(&gtod_current_time,NULL);
-	handle->Exposure_Data.Exposure_Start_Time.tv_sec = gtod_current_time.tv_sec;
-	handle->Exposure_Data.Exposure_Start_Time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
-#endif
+	CCD_Global_Metrics_Get_Time(&(handle->Exposure_Data.Start_Exposure_Send_Time));
+	handle->Exposure_Data.Start_Exposure_Measured = FALSE;
+	Exposure_Start_Time_Add_Latency(handle);
 }
 
 /**
- * Get the current value of the ccd_exposure error number.
- * @return The current value of the ccd_exposure error number.
+ * Routine to measure the start latency of the current exposure, i.e. the time between sending the START_EXPOSURE
+ * command and the controller actually starting the exposure. This should be called with the elapsed exposure
+ * time returned by a RET command, and the time the RET command was sent. Only the first call after
+ * CCD_Exposure_Set_Exposure_Start_Time is used, and only when the exposure status is EXPOSE or PRE_READOUT.
+ * Measurements outside EXPOSURE_START_LATENCY_MIN to EXPOSURE_START_LATENCY_MAX are ignored (the exposure has 
+ * probably been paused). Otherwise the measurement is added to the running average in Start_Exposure_Latency, 
+ * and the Exposure_Start_Time recalculated using the new average. 
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param ret_time The time the RET command was sent to the controller, half way between the command being sent
+ * 	and the reply being received.
+ * @param elapsed_exposure_time The elapsed exposure time returned by the RET command, in milliseconds.
+ * @see #EXPOSURE_START_LATENCY_MIN
+ * @see #EXPOSURE_START_LATENCY_MAX
+ * @see #EXPOSURE_START_LATENCY_WEIGHT
+ * @see #Exposure_Start_Time_Add_Latency
+ * @see #CCD_Exposure_Set_Exposure_Start_Time
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-int CCD_Exposure_Get_Error_Number(void)
+void CCD_Exposure_Measure_Exposure_Start_Time(CCD_Interface_Handle_T* handle,struct timespec ret_time,
+					      int elapsed_exposure_time)
 {
-	return Exposure_Error_Number;
+	long long latency;
+
+	if(handle->Exposure_Data.Start_Exposure_Measured)
+		return;
+	if((handle->Exposure_Data.Exposure_Status != CCD_EXPOSURE_STATUS_EXPOSE)&&
+	   (handle->Exposure_Data.Exposure_Status != CCD_EXPOSURE_STATUS_PRE_READOUT))
+		return;
+	if(elapsed_exposure_time <= 0)
+		return;
+	handle->Exposure_Data.Start_Exposure_Measured = TRUE;
+	/* the actual start time is the RET time less the elapsed exposure time. The elapsed exposure
+	** time is truncated to a whole millisecond, so on average it is half a millisecond more */
+	latency = (((long long)(ret_time.tv_sec-handle->Exposure_Data.Start_Exposure_Send_Time.tv_sec))*
+		   ((long long)CCD_GLOBBAL_ONE_SECOND_NS))+
+		((long long)(ret_time.tv_nsec-handle->Exposure_Data.Start_Exposure_Send_Time.tv_nsec))-
+		(((long long)elapsed_exposure_time)*((long long)CCD_GLOBAL_ONE_MILLISECOND_NS))-
+		(CCD_GLOBAL_ONE_MILLISECOND_NS/2);
+	if((latency < EXPOSURE_START_LATENCY_MIN)||(latency > EXPOSURE_START_LATENCY_MAX))
+		return;
+	if(handle->Exposure_Data.Start_Exposure_Latency_Count == 0)
+		handle->Exposure_Data.Start_Exposure_Latency = (int)latency;
+	else
+	{
+		handle->Exposure_Data.Start_Exposure_Latency += (int)((latency-
+				       handle->Exposure_Data.Start_Exposure_Latency)/EXPOSURE_START_LATENCY_WEIGHT);
+	}
+	handle->Exposure_Data.Start_Exposure_Latency_Count++;
+	Exposure_Start_Time_Add_Latency(handle);
 }
 
 /**
- * The error routine that reports any errors occuring in ccd_exposure in a standard way.
- * @see ccd_global.html#CCD_Global_Get_Current_Time_String
+ * Routine to get the time between sending the START_EXPOSURE command and the controller starting the exposure.
+ * If start latency measurements have been made, the average measured latency is returned (or zero if this is
+ * negative). Otherwise Start_Exposure_Offset_Time is returned.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The start latency, in nanoseconds.
+ * @see #CCD_Exposure_Measure_Exposure_Start_Time
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-void CCD_Exposure_Error(void)
+int CCD_Exposure_Get_Start_Exposure_Latency(CCD_Interface_Handle_T* handle)
 {
-	char time_string[32];
-
-	CCD_Global_Get_Current_Time_String(time_string,32);
-	/* if the error number is zero an error message has not been set up
-	** This is in itself an error as we should not be calling this routine
-	** without there being an error to display */
-	if(Exposure_Error_Number == 0)
-		sprintf(Exposure_Error_String,"Logic Error:No Error defined");
-	fprintf(stderr,"%s CCD_Exposure:Error(%d) : %s\n",time_string,Exposure_Error_Number,Exposure_Error_String);
+	if(handle->Exposure_Data.Start_Exposure_Latency_Count == 0)
+		return handle->Exposure_Data.Start_Exposure_Offset_Time*CCD_GLOBAL_ONE_MILLISECOND_NS;
+	if(handle->Exposure_Data.Start_Exposure_Latency < 0)
+		return 0;
+	return handle->Exposure_Data.Start_Exposure_Latency;
 }
 
 /**
- * The error routine that reports any errors occuring in ccd_exposure in a standard way. This routine places the
- * generated error string at the end of a passed in string argument.
- * @param error_string A string to put the generated error in. This string should be initialised before
- * being passed to this routine. The routine will try to concatenate it's error string onto the end
- * of any string already in existance.
- * @see ccd_global.html#CCD_Global_Get_Current_Time_String
+ * Routine to get the number of start latency measurements averaged into the start latency.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The number of measurements.
+ * @see #CCD_Exposure_Measure_Exposure_Start_Time
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-void CCD_Exposure_Error_String(char *error_string)
+int CCD_Exposure_Get_Start_Exposure_Latency_Count(CCD_Interface_Handle_T* handle)
 {
-	char time_string[32];
+	return handle->Exposure_Data.Start_Exposure_Latency_Count;
+}
 
-	CCD_Global_Get_Current_Time_String(time_string,32);
-	/* if the error number is zero an error message has not been set up
-	** This is in itself an error as we should not be calling this routine
-	** without there being an error to display */
-	if(Exposure_Error_Number == 0)
-		sprintf(Exposure_Error_String,"Logic Error:No Error defined");
-	sprintf(error_string+strlen(error_string),"%s CCD_Exposure:Error(%d) : %s\n",time_string,
-		Exposure_Error_Number,Exposure_Error_String);
-}
-
-/**
- * The warning routine that reports any warnings occuring in ccd_exposure in a standard way.
- * @see ccd_global.html#CCD_Global_Get_Current_Time_String
- */
-void CCD_Exposure_Warning(void)
-{
-	char time_string[32];
-
-	CCD_Global_Get_Current_Time_String(time_string,32);
-	/* if the error number is zero an warning message has not been set up
-	** This is in itself an error as we should not be calling this routine
-	** without there being an warning to display */
-	if(Exposure_Error_Number == 0)
-		sprintf(Exposure_Error_String,"Logic Error:No Warning defined");
-	fprintf(stderr,"%s CCD_Exposure:Warning(%d) : %s\n",time_string,Exposure_Error_Number,Exposure_Error_String);
-}
-
-/* ----------------------------------------------------------------
-**	Internal routines
-** ---------------------------------------------------------------- */
 /**
- * Internal exposure routine that sets the shutter bit. The SDSU SEX command looks
- * at this bit to determine whether to open and close the shutter whilst performing an exposure.
- * @param class The class parameter to use for any log messages associated with this operation.
- * @param source The class parameter to use for any log messages associated with this operation.
+ * Routine to set whether full frame exposures are read out in streaming mode. In streaming mode, 
+ * rows already transferred into the reply data buffer are byte swapped, de-interlaced and written to the 
+ * FITS file whilst the rest of the CCD is still being read out. Windowed readouts, and de-interlace types 
+ * where the rows are not read out in order (split parallel and split quad), are always processed after 
+ * the readout has completed.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
- * @param open_shutter If it is TRUE, the SDSU SEX command will open/close the 
- * 	shutter at the relevant places during an exposure. If it is FALSE, the shutter will remain in it's 
- * 	current state throughout the exposure.
- * @return Returns TRUE if the operation succeeded, FALSE if it fails.
- * @see #EXPOSURE_ADDRESS_CONTROLLER_STATUS
- * @see #CCD_Exposure_Expose
- * @see ccd_dsp.html#CCD_DSP_Command_RDM
- * @see ccd_dsp.html#CCD_DSP_Command_WRM
- * @see ccd_dsp.html#CCD_DSP_CONTROLLER_STATUS_OPEN_SHUTTER_BIT
+ * @param value A boolean, TRUE to enable streaming readout and FALSE to disable it.
+ * @return The routine returns TRUE if the value was set, and FALSE if it was not a legal boolean.
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Exposure_Shutter_Control(char *class,char *source,CCD_Interface_Handle_T* handle,int open_shutter)
+int CCD_Exposure_Set_Streaming_Readout(CCD_Interface_Handle_T* handle,int value)
 {
-	int current_status;
-
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Shutter_Control:Started.");
-#endif
-/* check parameter */
-	if(!CCD_GLOBAL_IS_BOOLEAN(open_shutter))
-	{
-		Exposure_Error_Number = 21;
-		sprintf(Exposure_Error_String,"Exposure_Shutter_Control:Illegal open_shutter value:%d.",
-			open_shutter);
-		return FALSE;
-	}
-/* get current controller status */
-	current_status = CCD_DSP_Command_RDM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_X,
-					     EXPOSURE_ADDRESS_CONTROLLER_STATUS);
-	if((current_status == 0)&&(CCD_DSP_Get_Error_Number() != 0))
-	{
-		Exposure_Error_Number = 28;
-		sprintf(Exposure_Error_String,"Exposure_Shutter_Control: Reading timing status failed.");
-		return FALSE;
-	}
-/* set or clear open shutter bit */
-	if(open_shutter)
-		current_status |= CCD_DSP_CONTROLLER_STATUS_OPEN_SHUTTER_BIT;
-	else
-		current_status &= ~(CCD_DSP_CONTROLLER_STATUS_OPEN_SHUTTER_BIT);
-/* write new controller status value */
-	if(CCD_DSP_Command_WRM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_X,
-			       EXPOSURE_ADDRESS_CONTROLLER_STATUS,current_status) != CCD_DSP_DON)
+	if(!CCD_GLOBAL_IS_BOOLEAN(value))
 	{
-		Exposure_Error_Number = 22;
-		sprintf(Exposure_Error_String,"Exposure_Shutter_Control: Writing shutter bit failed.");
+		Exposure_Error_Number = 73;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Set_Streaming_Readout:Illegal value (%d).",value);
 		return FALSE;
 	}
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Shutter_Control:Completed.");
-#endif
+	handle->Exposure_Data.Streaming_Readout = value;
 	return TRUE;
 }
 
-#if CCD_GLOBAL_BYTES_PER_PIXEL == 2
 /**
- * Swap the bytes in the input unsigned short integers: ( 0 1 -> 1 0 ).
- * Based on CFITSIO's ffswap2 routine. This routine only works for CCD_GLOBAL_BYTES_PER_PIXEL == 2.
- * @param class The class parameter to use for any log messages associated with this operation.
- * @param source The class parameter to use for any log messages associated with this operation.
- * @param svalues A list of unsigned short values to byte swap.
- * @param nvals The number of values in svalues.
+ * Routine to get whether full frame exposures are read out in streaming mode.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return A boolean, TRUE if streaming readout is enabled and FALSE if it is not.
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static void Exposure_Byte_Swap(char *class,char *source,unsigned short *svalues,long nvals)
+int CCD_Exposure_Get_Streaming_Readout(CCD_Interface_Handle_T* handle)
 {
-	register char *cvalues;
-	register long i;
-
-/* equivalence an array of 2 bytes with a short */
-	union u_tag
-	{
-		char cvals[2];
-		unsigned short sval;
-	} u;
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Byte_Swap:Started.");
-#endif
-/* copy the initial pointer value */
-	cvalues = (char *) svalues;
-
-	for (i = 0; i < nvals;)
-	{
-	/* copy next short to temporary buffer */
-		u.sval = svalues[i++];
-	/* copy the 2 bytes to output in turn */
-		*cvalues++ = u.cvals[1];
-		*cvalues++ = u.cvals[0];
-	}
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Byte_Swap:Completed.");
-#endif
+	return handle->Exposure_Data.Streaming_Readout;
 }
-#else
-#error Exposure_Byte_Swap not defined for this value of CCD_GLOBAL_BYTES_PER_PIXEL.
-#endif
 
 /**
- * Post-Readout operations on a full frame exposure,
- * <ul>
- * <li>The number of columns and rows are retrieved from setup.
- * <li>The data is de-interlaced using Exposure_DeInterlace.
- * <li>The data is saved to disc using Exposure_Save.
- * </ul>
- * If an error occurs BEFORE saving the read out frame to disk, Exposure_Expose_Delete_Fits_Images is called
- * to delete any 'blank' FITS files.
- * @param class The class parameter to use for any log messages associated with this operation.
- * @param source The class parameter to use for any log messages associated with this operation.
+ * Routine to set whether the exposure monitor loop waits for the readout to complete during readout, using
+ * CCD_DSP_Command_Wait_Readout_Progress, rather than sleeping between polls. This wakes the loop up as soon
+ * as the last pixel has been read out, at the cost of a readout progress request every millisecond.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
- * @param exposure_data The data read out from the CCD.
- * @param filename The FITS filename (which should already contain relevant headers), in which to write 
- *        the image data.
- * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
- * @see #Exposure_DeInterlace
- * @see #Exposure_Save
- * @see #Exposure_Expose_Delete_Fits_Images
- * @see ccd_setup.html#CCD_Setup_Get_NCols
- * @see ccd_setup.html#CCD_Setup_Get_NRows
+ * @param value A boolean, TRUE to wait for the readout progress and FALSE to sleep between polls.
+ * @return The routine returns TRUE if the value was set, and FALSE if it was not a legal boolean.
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_dsp.html#CCD_DSP_Command_Wait_Readout_Progress
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Exposure_Expose_Post_Readout_Full_Frame(char *class,char *source,CCD_Interface_Handle_T* handle,
-						   unsigned short *exposure_data,char *filename)
+int CCD_Exposure_Set_Readout_Progress_Wait(CCD_Interface_Handle_T* handle,int value)
 {
-	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
-	char *filename_list[1];
-	int ncols,nrows;
-
-/* get setup details */
-	ncols = CCD_Setup_Get_NCols(handle);
-	nrows = CCD_Setup_Get_NRows(handle);
-	deinterlace_type = CCD_Setup_Get_DeInterlace_Type(handle);
-/* number of columns must be a positive number */
-	if(ncols <= 0)
-	{
-		filename_list[0] = filename;
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
-		Exposure_Error_Number = 27;
-		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:Illegal ncols '%d'.",ncols);
-		return FALSE;
-	}
-/* number of rows must be a positive number */
-	if(nrows <= 0)
-	{
-		filename_list[0] = filename;
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
-		Exposure_Error_Number = 31;
-		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:Illegal nrows '%d'.",nrows);
-		return FALSE;
-	}
-	if(!CCD_DSP_IS_DEINTERLACE_TYPE(deinterlace_type))
-	{
-		filename_list[0] = filename;
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
-		Exposure_Error_Number = 36;
-		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:"
-			"Illegal deinterlace type '%d'.",deinterlace_type);
-		return FALSE;
-	}
-/* Do deinterlacing. The image returned from the boards may not be in the correct order
-** if the CCD was readout from multiple places etc. The deinterlace routine reorders the image
-** so that it is back in the right order. */
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,
-		       "Exposure_Expose_Post_Readout_Full_Frame:De-Interlacing.");
-#endif
-	if(!Exposure_DeInterlace(class,source,ncols,nrows,exposure_data,deinterlace_type))
-	{
-		filename_list[0] = filename;
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
-		return FALSE;
-	}
-/* if we have aborted stop and return */
-	if(CCD_DSP_Get_Abort(handle))
-	{
-		filename_list[0] = filename;
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
-		Exposure_Error_Number = 45;
-		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:Aborted.");
-		return FALSE;
-	}
-/* save the resultant image to disk */
-#if LOGGING > 4
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Expose_Post_Readout_Full_Frame:"
-			      "Saving to filename %s.",filename);
-#endif
-	if(!Exposure_Save(class,source,filename,exposure_data,ncols,nrows,handle->Exposure_Data.Exposure_Start_Time))
+	if(!CCD_GLOBAL_IS_BOOLEAN(value))
 	{
-		/* Exposure_Save can fail but still have saved the exposure_data to disk OK */
+		Exposure_Error_Number = 83;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Set_Readout_Progress_Wait:Illegal value (%d).",value);
 		return FALSE;
 	}
-	return TRUE; 
+	handle->Exposure_Data.Readout_Progress_Wait = value;
+	return TRUE;
 }
 
 /**
- * Post-Readout operations on a windowed exposure.
- * <ul>
- * <li>We get necessary setup data (window flags and deinterlace type).
- * <li>We go though the list of windows, looking for active windows.
- * <li>We retrieve setup data for active windows (width,height and pixel_count).
- * <li>We allocate space for a subimage array of the required size, and copy the relevant exposure data
- *     (applying the necessary exposure data index offset) into it.
- * <li>We call Exposure_DeInterlace to de-interlace the sub-image.
- * <li>We check whether we should be aborting.
- * <li>We save the sub-image to the relevant filename.
- * <li>We increment the exposure data index offset by the number of pixels in the sub-image.
- * <li>We increment the filename index.
- * <li>We free the sub-image data.
- * </ul>
- * @param class The class parameter to use for any log messages associated with this operation.
- * @param source The class parameter to use for any log messages associated with this operation.
+ * Routine to get whether the exposure monitor loop waits for the readout to complete during readout.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
- * @param exposure_data The data read out from the CCD.
- * @param filename_list The list of FITS filenames (which should already contain relevant headers), in which to write 
- *        the image data. Each window of data is saved in a separate file.
- * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
- * @see #Exposure_DeInterlace
- * @see #Exposure_Save
- * @see ccd_setup.html#CCD_SETUP_WINDOW_COUNT
- * @see ccd_setup.html#CCD_Setup_Get_Window_Flags
- * @see ccd_setup.html#CCD_Setup_Get_DeInterlace_Type
- * @see ccd_setup.html#CCD_Setup_Get_Window_Width
- * @see ccd_setup.html#CCD_Setup_Get_Window_Height
- * @see ccd_setup.html#CCD_Setup_Get_Window_Pixel_Count
- * @see ccd_global.html#CCD_GLOBAL_BYTES_PER_PIXEL
- * @see ccd_dsp.html#CCD_DSP_IS_DEINTERLACE_TYPE
- * @see ccd_dsp.html#CCD_DSP_Get_Abort
+ * @return A boolean, TRUE if the loop waits for the readout progress, FALSE if it sleeps between polls.
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Exposure_Expose_Post_Readout_Window(char *class,char *source,CCD_Interface_Handle_T* handle,
-					       unsigned short *exposure_data,char **filename_list,int filename_count)
+int CCD_Exposure_Get_Readout_Progress_Wait(CCD_Interface_Handle_T* handle)
 {
-	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
-	unsigned short *subimage_data = NULL;
-	int exposure_data_index = 0;
-	int window_number,window_flags,filename_index;
-	int ncols,nrows,pixel_count;
-
-	/* get setup data */
-	window_flags = CCD_Setup_Get_Window_Flags(handle);
-	deinterlace_type = CCD_Setup_Get_DeInterlace_Type(handle);
-	if(!CCD_DSP_IS_DEINTERLACE_TYPE(deinterlace_type))
-	{
-		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
-		Exposure_Error_Number = 10;
-		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:"
-			"Illegal deinterlace type '%d'.",deinterlace_type);
-		return FALSE;
-	}
-	/* go through list of windows */
-	exposure_data_index = 0;
-	filename_index = 0;
-	for(window_number = 0;window_number < CCD_SETUP_WINDOW_COUNT; window_number++)
-	{
-		/* look for windows that have been read out (are in use). */
-		/* Note, relies on CCD_SETUP_WINDOW_ONE == (1<<0),
-		** CCD_SETUP_WINDOW_TWO	== (1<<1),
-		** CCD_SETUP_WINDOW_THREE == (1<<2) and
-		** CCD_SETUP_WINDOW_FOUR == (1<<3) */
-		if(window_flags&(1<<window_number))
-		{
-			ncols = CCD_Setup_Get_Window_Width(handle,window_number);
-			nrows = CCD_Setup_Get_Window_Height(handle,window_number);
-			pixel_count = CCD_Setup_Get_Window_Pixel_Count(handle,window_number);
-			if(filename_index >= filename_count)
-			{
-				Exposure_Error_Number = 16;
-				sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:"
-					"Filename index %d greater than count %d.",filename_index,filename_count);
-				return FALSE;
-			}
-#if LOGGING > 4
-			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-					      "Exposure_Expose_Post_Readout_Window:"
-			      "Window %d(%s) active:ncols = %d,nrows = %d,pixel_count = %d.",
-					      window_number,filename_list[filename_index],ncols,nrows,pixel_count);
-#endif
-			subimage_data = (unsigned short*)malloc(pixel_count*CCD_GLOBAL_BYTES_PER_PIXEL);
-			if(subimage_data == NULL)
-			{
-				Exposure_Expose_Delete_Fits_Images(class,source,filename_list+filename_index,
-								   filename_count-filename_index);
-				Exposure_Error_Number = 18;
-				sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:"
-					"SubImage Data was NULL (%d,%d).",window_number,pixel_count);
-				return FALSE;
-			}
-			memcpy(subimage_data,exposure_data+exposure_data_index,pixel_count*CCD_GLOBAL_BYTES_PER_PIXEL);
-#if LOGGING > 4
-			CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,
-				       "Exposure_Expose_Post_Readout_Window:De-Interlacing.");
-#endif
-			if(!Exposure_DeInterlace(class,source,ncols,nrows,subimage_data,deinterlace_type))
-			{
-				free(subimage_data);
-				Exposure_Expose_Delete_Fits_Images(class,source,filename_list+filename_index,
-								   filename_count-filename_index);
-				return FALSE;
-			}
-/* if we have aborted stop and return */
-			if(CCD_DSP_Get_Abort(handle))
-			{
-				free(subimage_data);
-				Exposure_Expose_Delete_Fits_Images(class,source,filename_list+filename_index,
-								   filename_count-filename_index);
-				Exposure_Error_Number = 19;
-				sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:Aborted.");
-				return FALSE;
-			}
-/* save the resultant image to disk */
-#if LOGGING > 4
-			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-					      "Exposure_Expose_Post_Readout_Window:"
-			      "Saving to filename %s.",filename_list[filename_index]);
-#endif
-			if(!Exposure_Save(class,source,filename_list[filename_index],subimage_data,ncols,nrows,
-					  handle->Exposure_Data.Exposure_Start_Time))
-			{
-				free(subimage_data);
-				/* Exposure_Save can fail but still have saved the exposure_data to disk OK */
-				return FALSE;
-			}
-			/* increment index into exposure data to start of next window. */
-			exposure_data_index += pixel_count;
-			/* increment index iff this window is active - only active window filenames in filename_list */
-			filename_index++;
-			/* free subimage */
-			free(subimage_data);
-		}
-	}
-	return TRUE;
+	return handle->Exposure_Data.Readout_Progress_Wait;
 }
 
-#if CCD_GLOBAL_BYTES_PER_PIXEL == 2
 /**
- * This routine deinterlaces a raw image read from the ccd. If the ccd has more than one
+ * Routine to de-interlace a raw image read from the CCD into a separate image buffer. If the CCD has more than one
  * readout port, the data will not be received in row-column order and will need deinterlacing.
  * The deinterlacing algorithms work on the principle that the ccd will read out the data in a 
  * predetermined order depending on the type of readout being implemented. Here's how they look:
@@ -1590,405 +1552,4173 @@ static int Exposure_Expose_Post_Readout_Window(char *class,char *source,CCD_Inte
  * |<--------  1    |          |<------ |       |      |<-----  |  ---->|    
  *  ----------------            ----------------        ----------------     
  * </pre>
+ * Each output row is made from one or two runs of raw pixels a fixed stride apart, which may be written in reverse.
+ * These runs are copied with the row kernel selected by CCD_Exposure_Set_DeInterlace_Kernel, which also
+ * byte swaps each pixel if requested, so the image is only read and written once. No temporary image
+ * is allocated.
  * <em>Note: This routine assumes CCD_GLOBAL_BYTES_PER_PIXEL == 2 e.g. 16 bits per pixel.</em>
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
- * @param ncols The number of columns on the CCD.
- * @param nrows The number of rows on the CCD.
- * @param old_iptr The interlaced image data received from the CCD. Once deinterlaced the image data is copied back
- * 	in this memory area.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param raw_data The interlaced image data received from the CCD, of ncols*nrows pixels.
+ * @param image_data A preallocated buffer of ncols*nrows pixels, the de-interlaced image is written here.
+ *        This must not overlap raw_data.
  * @param deinterlace_type The type of deinterlacing to perform. One of CCD_DSP_DEINTERLACE_TYPE:
  * 	CCD_DSP_DEINTERLACE_SINGLE,
  * 	CCD_DSP_DEINTERLACE_FLIP,
  * 	CCD_DSP_DEINTERLACE_SPLIT_PARALLEL,
  * 	CCD_DSP_DEINTERLACE_SPLIT_SERIAL or
  * 	CCD_DSP_DEINTERLACE_SPLIT_QUAD.
+ * @param byte_swap A boolean, if TRUE the bytes in each pixel are swapped as they are de-interlaced.
  * @return If everything was successful TRUE is returned, otherwise FALSE is returned.
+ * @see #Exposure_DeInterlace_Row
+ * @see #CCD_Exposure_Set_DeInterlace_Kernel
  * @see ccd_global.html#CCD_GLOBAL_BYTES_PER_PIXEL
- * @see ccd_setup.html#CCD_DSP_DEINTERLACE_TYPE
+ * @see ccd_dsp.html#CCD_DSP_DEINTERLACE_TYPE
  */
-static int Exposure_DeInterlace(char *class,char *source,int ncols,int nrows,unsigned short *old_iptr,
-				enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type)
+int CCD_Exposure_DeInterlace(char *class,char *source,int ncols,int nrows,unsigned short *raw_data,
+			     unsigned short *image_data,enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,int byte_swap)
 {
-	unsigned short *new_iptr = NULL;
+	int y,half_ncols;
 
 #if LOGGING > 4
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
-			      "Exposure_DeInterlace:Started with dimensions (%d,%d), type %d.",
-			      ncols,nrows,deinterlace_type);
+			      "CCD_Exposure_DeInterlace:Started with dimensions (%d,%d), type %d, byte swap %d, kernel %d.",
+			      ncols,nrows,deinterlace_type,byte_swap,Exposure_Data.DeInterlace_Kernel);
 #endif
-	switch(deinterlace_type)
+	if((raw_data == NULL)||(image_data == NULL)||(ncols <= 0)||(nrows <= 0))
 	{
-		/* SINGLE READOUT 
+		Exposure_Error_Number = 89;
+		sprintf(Exposure_Error_String,"CCD_Exposure_DeInterlace:Illegal arguments (%p,%p,%d,%d).",
+			(void*)raw_data,(void*)image_data,ncols,nrows);
+		return FALSE;
+	}
+	half_ncols = ncols/2;
+	switch(deinterlace_type)
+	{
+		/* SINGLE READOUT 
 		** The result is the same as the input. The CCD was readout from one port, so it
 		** was readout in order */
 		case CCD_DSP_DEINTERLACE_SINGLE:
-		{
+			for(y=0;y<nrows;y++)
+				Exposure_DeInterlace_Row(image_data+(y*ncols),raw_data+(y*ncols),ncols,1,0,FALSE,byte_swap);
 			return TRUE;
-		} /*end single readout*/
 		/* Flip the output image in X so east is to the left. */
 		case CCD_DSP_DEINTERLACE_FLIP:
-		{
-			int x,y;
-			unsigned short int tempval;
-
-			/* for each row */
 			for(y=0;y<nrows;y++)
-			{
-				/* for the first half of the columns.
-				** Note the middle column will be missed, this is OK as it
-				** does not need to be flipped if it is in the middle */
-				for(x=0;x<(ncols/2);x++)
-				{
-					/* Copy image[x,y] to tempval */
-					tempval = *(old_iptr+(y*ncols)+x);
-					/* Copy image[ncols-(x+1),y] to image[x,y] */
-					*(old_iptr+(y*ncols)+x) = *(old_iptr+(y*ncols)+(ncols-(x+1)));
-					/* Copy tempval = image[ncols-(x+1),y] */
-					*(old_iptr+(y*ncols)+(ncols-(x+1))) = tempval;
-				}
-			}
+				Exposure_DeInterlace_Row(image_data+(y*ncols),raw_data+(y*ncols),ncols,1,0,TRUE,byte_swap);
 			return TRUE;
-		} /*end single readout, flipped */
-		/* SPLIT PARALLEL READOUT */
+		/* SPLIT PARALLEL READOUT
+		** Even raw pixels fill the image from the start, odd raw pixels fill it backwards from the end. */
 		case CCD_DSP_DEINTERLACE_SPLIT_PARALLEL:
-		{
-			int i;
-
-			if(((float)nrows/2) != (int)nrows/2)
+			if((nrows%2) != 0)
 			{
  				Exposure_Error_Number = 46;
-				sprintf(Exposure_Error_String,"Exposure_DeInterlace:Split Parallel Readout,"
+				sprintf(Exposure_Error_String,"CCD_Exposure_DeInterlace:Split Parallel Readout,"
 					"nrows not even(%d), image not deinterlaced.",nrows);
 				return FALSE;
 			}
-		/* allocate enough memory to store the deinterlaced image */
-			if((new_iptr = (unsigned short *)malloc(ncols*nrows*CCD_GLOBAL_BYTES_PER_PIXEL)) == NULL)
+			for(y=0;y<(nrows/2);y++)
 			{
-		 		Exposure_Error_Number = 47;
-				sprintf(Exposure_Error_String,"Exposure_DeInterlace:Memory Allocation Error(%d,%d),"
-					"image not deinterlaced.",ncols,nrows);
-				return FALSE;
+				Exposure_DeInterlace_Row(image_data+(y*ncols),raw_data+(2*y*ncols),ncols,2,0,FALSE,
+							 byte_swap);
 			}
-			for(i=0;i<(ncols*nrows)/2;i++)
+			for(y=(nrows/2);y<nrows;y++)
 			{
-				*(new_iptr+i) = *(old_iptr+(2*i));
-				*(new_iptr+(ncols*nrows)-i-1) = *(old_iptr+(2*i)+1);
+				Exposure_DeInterlace_Row(image_data+(y*ncols),raw_data+(2*((nrows-(y+1))*ncols)),ncols,
+							 2,1,TRUE,byte_swap);
 			}
-			memcpy(old_iptr,new_iptr,ncols*nrows*CCD_GLOBAL_BYTES_PER_PIXEL);
-			free(new_iptr);
 			return TRUE;
-		} /*end split parallel*/
-		/* SPLIT SERIAL READOUT */
+		/* SPLIT SERIAL READOUT
+		** Each raw row holds the left half of the image row in the even pixels, 
+		** and the right half reversed in the odd pixels. */
 		case CCD_DSP_DEINTERLACE_SPLIT_SERIAL:
-		{
-			int i,j,p1,p2,begin,end;
-
-			if ((float)ncols/2 != (int)ncols/2)
+			if((ncols%2) != 0)
         		{
  				Exposure_Error_Number = 48;
-				sprintf(Exposure_Error_String,"Exposure_DeInterlace:Split Serial Readout,"
+				sprintf(Exposure_Error_String,"CCD_Exposure_DeInterlace:Split Serial Readout,"
 					"ncols not even(%d), image not deinterlaced.",ncols);
 				return FALSE;
 			}
-		/* allocate enough memory to store the deinterlaced image */
-			if((new_iptr = (unsigned short *)malloc(ncols*nrows*CCD_GLOBAL_BYTES_PER_PIXEL)) == NULL)
+			for(y=0;y<nrows;y++)
 			{
-		 		Exposure_Error_Number = 49;
-				sprintf(Exposure_Error_String,"Exposure_DeInterlace:Memory Allocation Error(%d,%d),"
-					"image not deinterlaced.",ncols,nrows);
-				return FALSE;
+				Exposure_DeInterlace_Row(image_data+(y*ncols),raw_data+(y*ncols),half_ncols,2,0,FALSE,
+							 byte_swap);
+				Exposure_DeInterlace_Row(image_data+(y*ncols)+half_ncols,raw_data+(y*ncols),half_ncols,2,1,
+							 TRUE,byte_swap);
 			}
-			for (i=0;i<nrows;i++)
-			{		 /* leave in +0 for clarity */
-				p1      = i*ncols+0; /*position in raw image */
-				p2      = i*ncols+1;
-				begin   = i*ncols+0; /*position in interlaced image */
-				end     = i*ncols+ncols-1;
-				for(j=0;j<ncols;j+=2)
-                		{
-                			*(new_iptr+begin) = *(old_iptr+p1);
-                			*(new_iptr+end) = *(old_iptr+p2);
-                			++begin;
-                			--end;
-                			p1+=2;
-                			p2+=2;
-                		}
-                	}
-			memcpy(old_iptr,new_iptr,ncols*nrows*sizeof(unsigned short));
-			free(new_iptr);
 			return TRUE;
-		} /*end split serial*/
-		/* SPLIT QUAD READOUT */
+		/* SPLIT QUAD READOUT
+		** Each pair of raw rows holds four half rows, one from each quadrant, 
+		** interlaced in groups of four pixels. */
 		case CCD_DSP_DEINTERLACE_SPLIT_QUAD:
-		{
-			int i=0,j=0,counter=0,end=0,begin=0;
-
-			if((float)ncols/2 != (int)ncols/2 || (float)nrows/2 != (int)nrows/2)
+			if(((ncols%2) != 0)||((nrows%2) != 0))
 			{
  				Exposure_Error_Number = 50;
-				sprintf(Exposure_Error_String,"Exposure_DeInterlace:Split Quad Readout,"
+				sprintf(Exposure_Error_String,"CCD_Exposure_DeInterlace:Split Quad Readout,"
 					"ncols or nrows not even(%d,%d), image not deinterlaced.",ncols,nrows);
 				return FALSE;
 			}
-		/* allocate enough memory to store the deinterlaced image */
-			if((new_iptr = (unsigned short *)malloc(ncols*nrows*CCD_GLOBAL_BYTES_PER_PIXEL)) == NULL)
-			{
-		 		Exposure_Error_Number = 51;
-				sprintf(Exposure_Error_String,"Exposure_DeInterlace:Memory Allocation Error(%d,%d),"
-					"image not deinterlaced.",ncols,nrows);
-				return FALSE;
-			}
-			while(i<ncols*nrows)
+			for(y=0;y<(nrows/2);y++)
 			{
-				if(counter%(ncols/2) == 0)
-				{
-					end     = (ncols*nrows)-(ncols*j)-1;
-					begin   = (ncols*j)+0; /* left in 0 for clarity*/
-					j++; /*number of completed rows*/
-					counter=0; /*reset for next convergece*/
-				}
-				*(new_iptr+begin+counter)       = *(old_iptr+i++); /*front_row--->  */
-				*(new_iptr+begin+ncols-1-counter)   = *(old_iptr+i++); /*front_row<--   */
-				*(new_iptr+end-counter)         = *(old_iptr+i++); /*end_row<----   */
-				*(new_iptr+end-ncols+1+counter)     = *(old_iptr+i++); /*end_row---->   */
-				counter++;
+				unsigned short *raw_ptr = raw_data+(y*2*ncols);
+				unsigned short *bottom_ptr = image_data+(y*ncols);
+				unsigned short *top_ptr = image_data+((nrows-1-y)*ncols);
+
+				Exposure_DeInterlace_Row(bottom_ptr,raw_ptr,half_ncols,4,0,FALSE,byte_swap);
+				Exposure_DeInterlace_Row(bottom_ptr+half_ncols,raw_ptr,half_ncols,4,1,TRUE,byte_swap);
+				Exposure_DeInterlace_Row(top_ptr+half_ncols,raw_ptr,half_ncols,4,2,TRUE,byte_swap);
+				Exposure_DeInterlace_Row(top_ptr,raw_ptr,half_ncols,4,3,FALSE,byte_swap);
 			}
-			memcpy(old_iptr,new_iptr,ncols*nrows*sizeof(unsigned short));
-			free(new_iptr);
 			return TRUE;
-		} /*end split quad readout*/
 	}/*end switch*/
 	Exposure_Error_Number = 52;
-	sprintf(Exposure_Error_String,"Exposure_DeInterlace:Wrong DeInterlace option(%d),Image not deinterlaced.",
+	sprintf(Exposure_Error_String,"CCD_Exposure_DeInterlace:Wrong DeInterlace option(%d),Image not deinterlaced.",
 		deinterlace_type);
 	return FALSE;
-} /* end deinterlacing */
-#else
-#error Exposure_DeInterlace not defined for this value of CCD_GLOBAL_BYTES_PER_PIXEL.
-#endif
-
-/* 
-** Exposure_Save uses a different implementation depending on whether CFITSIO define was defined at compile time.
-** If it was we use CFITSIO routines, otherwise we don't.
-*/
+}
 
-#ifdef CFITSIO
 /**
- * This routine takes some image data and saves it in a file on disc. It also updates the 
- * DATE-OBS FITS keyword to the value saved just before the SEX command was sent to the controller.
- * It currently uses Exposure_FITS_Mutex_Lock / Exposure_FITS_Mutex_UnLock to lock CFITSIO file writing,
- * as the CFITSIO library we are currently using (3.006) does not appear to be thread safe and causes crashes/
- * WRITE_ERROR errors when both arms try to write data at the same time.
+ * Routine to turn the raw data read out from the CCD into the final images, in one pass over the read out data.
+ * For a full frame readout, the whole of exposure_data is de-interlaced into image_data_list[0].
+ * For a windowed readout, each active window is de-interlaced from it's position in exposure_data (the windows
+ * are read out one after another) into the next buffer in image_data_list.
+ * If CCD_EXPOSURE_BYTE_SWAP is defined, the pixels are byte swapped as they are de-interlaced.
+ * If the transform succeeds, the time it took is added to the handle's DEINTERLACE metrics timer.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
- * @param filename The filename to save the data into.
- * @param exposure_data The data to save.
- * @param ncols The number of columns in the image data.
- * @param nrows The number of rows in the image data.
- * @param start_time The start time of the exposure.
- * @return Returns TRUE if the image is saved successfully, FALSE if it fails.
- * @see #Exposure_TimeSpec_To_Date_String
- * @see #Exposure_TimeSpec_To_Date_Obs_String
- * @see #Exposure_TimeSpec_To_UtStart_String
- * @see #Exposure_TimeSpec_To_Mjd
- * @see #Exposure_FITS_Mutex_Lock
- * @see #Exposure_FITS_Mutex_UnLock
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param exposure_data The data read out from the CCD.
+ * @param image_data_list A list of preallocated image buffers. For a full frame readout this contains one buffer of
+ *        ncols*nrows pixels, for a windowed readout one buffer per active window, of that window's pixel count.
+ * @param image_data_count The number of buffers in image_data_list.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #CCD_Exposure_DeInterlace
+ * @see #EXPOSURE_BYTE_SWAP
+ * @see ccd_setup.html#CCD_SETUP_WINDOW_COUNT
+ * @see ccd_setup.html#CCD_Setup_Get_NCols
+ * @see ccd_setup.html#CCD_Setup_Get_NRows
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Flags
+ * @see ccd_setup.html#CCD_Setup_Get_DeInterlace_Type
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Width
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Height
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Pixel_Count
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see ccd_global.html#CCD_Global_Metrics_Timer_Add
  */
-static int Exposure_Save(char *class,char *source,char *filename,unsigned short *exposure_data,int ncols,int nrows,
-			 struct timespec start_time)
+int CCD_Exposure_Post_Readout_Transform(char *class,char *source,CCD_Interface_Handle_T* handle,
+					unsigned short *exposure_data,unsigned short **image_data_list,
+					int image_data_count)
 {
-	fitsfile *fp = NULL;
-	int retval=0,status=0;
-	char buff[32]; /* fits_get_errstatus returns 30 chars max */
-	char exposure_start_time_string[64];
-	double mjd;
+	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
+	struct timespec start_time;
+	int exposure_data_index,window_number,window_flags,image_index,retval;
 
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Started.");
-#endif
-#ifdef CCD_CFITSIO_MUTEXED
-	if(!Exposure_FITS_Mutex_Lock())
-		return FALSE;
-#endif
-	/* try to open file */
-	retval = fits_open_file(&fp,filename,READWRITE,&status);
-	if(retval)
-	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		fits_get_errstatus(status,buff);
-		fits_report_error(stderr,status);
-		Exposure_Error_Number = 53;
-		sprintf(Exposure_Error_String,"Exposure_Save: File open failed(%s,%d,%s).",filename,status,buff);
-		return FALSE;
-	}
-	/* write the data */
-	retval = fits_write_img(fp,TUSHORT,1,ncols*nrows,exposure_data,&status);
-	if(retval)
-	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		fits_get_errstatus(status,buff);
-		fits_report_error(stderr,status);
-		fits_close_file(fp,&status);
-		Exposure_Error_Number = 54;
-		sprintf(Exposure_Error_String,"Exposure_Save: File write failed(%s,%d,%s).",filename,status,buff);
-		return FALSE;
-	}
-/* update DATE keyword */
-	Exposure_TimeSpec_To_Date_String(start_time,exposure_start_time_string);
-	retval = fits_update_key(fp,TSTRING,"DATE",exposure_start_time_string,NULL,&status);
-	if(retval)
-	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		fits_get_errstatus(status,buff);
-		fits_report_error(stderr,status);
-		fits_close_file(fp,&status);
-		Exposure_Error_Number = 55;
-		sprintf(Exposure_Error_String,"Exposure_Save: Updating DATE failed(%s,%d,%s).",filename,status,buff);
-		return FALSE;
-	}
-/* update DATE-OBS keyword */
-	Exposure_TimeSpec_To_Date_Obs_String(start_time,exposure_start_time_string);
-	retval = fits_update_key(fp,TSTRING,"DATE-OBS",exposure_start_time_string,NULL,&status);
-	if(retval)
-	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		fits_get_errstatus(status,buff);
-		fits_report_error(stderr,status);
-		fits_close_file(fp,&status);
-		Exposure_Error_Number = 56;
-		sprintf(Exposure_Error_String,"Exposure_Save: Updating DATE-OBS failed(%s,%d,%s).",filename,
-			status,buff);
-		return FALSE;
-	}
-/* update UTSTART keyword */
-	Exposure_TimeSpec_To_UtStart_String(start_time,exposure_start_time_string);
-	retval = fits_update_key(fp,TSTRING,"UTSTART",exposure_start_time_string,NULL,&status);
-	if(retval)
+	CCD_Global_Metrics_Get_Time(&start_time);
+	if((exposure_data == NULL)||(image_data_list == NULL))
 	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		fits_get_errstatus(status,buff);
-		fits_report_error(stderr,status);
-		fits_close_file(fp,&status);
-		Exposure_Error_Number = 57;
-		sprintf(Exposure_Error_String,"Exposure_Save: Updating UTSTART failed(%s,%d,%s).",filename,
-			status,buff);
+		Exposure_Error_Number = 90;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Post_Readout_Transform:Illegal arguments (%p,%p).",
+			(void*)exposure_data,(void*)image_data_list);
 		return FALSE;
 	}
-/* update MJD keyword */
-/* note leap second correction not implemented yet (always FALSE). */
-	if(!Exposure_TimeSpec_To_Mjd(start_time,FALSE,&mjd))
+	window_flags = CCD_Setup_Get_Window_Flags(handle);
+	deinterlace_type = CCD_Setup_Get_DeInterlace_Type(handle);
+	if(window_flags == 0)
 	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		return FALSE;
+		if(image_data_count < 1)
+		{
+			Exposure_Error_Number = 91;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Post_Readout_Transform:"
+				"Image data count %d too small for full frame.",image_data_count);
+			return FALSE;
+		}
+		retval = CCD_Exposure_DeInterlace(class,source,CCD_Setup_Get_NCols(handle),CCD_Setup_Get_NRows(handle),
+						  exposure_data,image_data_list[0],deinterlace_type,EXPOSURE_BYTE_SWAP);
+		if(retval)
+			CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_DEINTERLACE,start_time);
+		return retval;
 	}
-	retval = fits_update_key_fixdbl(fp,"MJD",mjd,6,NULL,&status);
-	if(retval)
+	exposure_data_index = 0;
+	image_index = 0;
+	for(window_number = 0;window_number < CCD_SETUP_WINDOW_COUNT; window_number++)
 	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		fits_get_errstatus(status,buff);
-		fits_report_error(stderr,status);
-		fits_close_file(fp,&status);
-		Exposure_Error_Number = 58;
-		sprintf(Exposure_Error_String,"Exposure_Save: Updating MJD failed(%.2f,%s,%d,%s).",mjd,filename,
-			status,buff);
-		return FALSE;
+		/* Note, relies on CCD_SETUP_WINDOW_ONE == (1<<0) etc. */
+		if(window_flags&(1<<window_number))
+		{
+			if(image_index >= image_data_count)
+			{
+				Exposure_Error_Number = 91;
+				sprintf(Exposure_Error_String,"CCD_Exposure_Post_Readout_Transform:"
+					"Image data index %d greater than count %d.",image_index,image_data_count);
+				return FALSE;
+			}
+			if(!CCD_Exposure_DeInterlace(class,source,CCD_Setup_Get_Window_Width(handle,window_number),
+						     CCD_Setup_Get_Window_Height(handle,window_number),
+						     exposure_data+exposure_data_index,image_data_list[image_index],
+						     deinterlace_type,EXPOSURE_BYTE_SWAP))
+			{
+				return FALSE;
+			}
+			/* increment index into exposure data to start of next window. */
+			exposure_data_index += CCD_Setup_Get_Window_Pixel_Count(handle,window_number);
+			image_index++;
+		}
 	}
-/* close file */
-	retval = fits_close_file(fp,&status);
-	if(retval)
+	CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_DEINTERLACE,start_time);
+	return TRUE;
+}
+
+/**
+ * Routine to allocate the image buffer pool for the current setup. This should be called after the dimensions
+ * and windows have been set up (it is called from CCD_Setup_Dimensions), so that post-readout processing
+ * does not have to allocate memory. The first frame of the pool is always allocated, the rest of the frames
+ * are only allocated if Async_Save is TRUE. Frames currently in use (by an exposure or the FITS writer thread)
+ * are left alone, they are resized if necessary when next acquired. See Exposure_Frame_Allocate for how 
+ * each frame is sized.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #CCD_Exposure_Buffer_Pool_Free
+ * @see #Exposure_Frame_Allocate
+ * @see ccd_exposure_private.html#CCD_EXPOSURE_FRAME_COUNT
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Exposure_Buffer_Pool_Allocate(char *class,char *source,CCD_Interface_Handle_T* handle)
+{
+	int frame_index,frame_count,in_use;
+
+	if(handle->Exposure_Data.Async_Save)
+		frame_count = CCD_EXPOSURE_FRAME_COUNT;
+	else
+		frame_count = 1;
+	for(frame_index = 0; frame_index < frame_count; frame_index++)
 	{
-#ifdef CCD_CFITSIO_MUTEXED
-		Exposure_FITS_Mutex_Unlock();
-#endif
-		fits_get_errstatus(status,buff);
-		fits_report_error(stderr,status);
-		Exposure_Error_Number = 59;
-		sprintf(Exposure_Error_String,"Exposure_Save: File close failed(%s,%d,%s).",filename,status,buff);
-		return FALSE;
+		pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+		in_use = handle->Exposure_Data.Frame_List[frame_index].In_Use;
+		pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+		if(in_use)
+			continue;
+		if(!Exposure_Frame_Allocate(class,source,handle,frame_index))
+			return FALSE;
 	}
-#ifdef CCD_CFITSIO_MUTEXED
-	if(!Exposure_FITS_Mutex_Unlock())
-		return FALSE;
-#endif
-
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Completed.");
-#endif
 	return TRUE;
 }
-#else
+
 /**
- * This routine takes some image data and saves it in a file on disc.
- * This routine does not update the DATE-OBS keyword, unlike the CFITSIO routine.
+ * Routine to unlock and free all the buffers in the image buffer pool. Any frames queued for the FITS writer
+ * thread are saved, and the thread stopped, first. This is called from CCD_Setup_Shutdown 
+ * and CCD_Interface_Close.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
- * @param filename The filename to save the data into.
- * @param exposure_data The data to save.
- * @param ncols The number of columns in the image data.
- * @param nrows The number of rows in the image data.
- * @param start_time The start time of the exposure.
- * @return Returns TRUE if the image is saved successfully, FALSE if it fails.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The routine returns TRUE if it suceeded, and FALSE if stopping the FITS writer thread or 
+ *         unlocking a buffer failed. All the buffers are freed in either case.
+ * @see #CCD_Exposure_Buffer_Pool_Allocate
+ * @see #Exposure_Writer_Stop
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_global.html#CCD_Global_Memory_UnLock
+ * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Exposure_Save(char *class,char *source,char *filename,unsigned short *exposure_data,int ncols,int nrows,
-			 struct timespec start_time)
+int CCD_Exposure_Buffer_Pool_Free(char *class,char *source,CCD_Interface_Handle_T* handle)
 {
-	FILE *fp = NULL;
-	int retval,error_number,nitems;
+	struct CCD_Exposure_Frame_Struct *frame = NULL;
+	int frame_index,i,retval;
 
-#if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Started.");
-#endif
-	/* try to open file */
-	fp = fopen(filename,"rb+");
-	if(fp == NULL)
+	retval = Exposure_Writer_Stop(class,source,handle);
+	for(frame_index = 0; frame_index < CCD_EXPOSURE_FRAME_COUNT; frame_index++)
 	{
-		error_number = errno;
-		Exposure_Error_Number = 60;
-		sprintf(Exposure_Error_String,"Exposure_Save: File open failed(%s,%d).",filename,error_number);
-		return FALSE;
+		frame = &(handle->Exposure_Data.Frame_List[frame_index]);
+		for(i=0;i<CCD_SETUP_WINDOW_COUNT;i++)
+		{
+			if(frame->Image_Buffer_List[i] != NULL)
+			{
+				if(!CCD_Global_Memory_UnLock(class,source,frame->Image_Buffer_List[i],
+						   frame->Image_Buffer_Size_List[i]*CCD_GLOBAL_BYTES_PER_PIXEL))
+					retval = FALSE;
+				free(frame->Image_Buffer_List[i]);
+			}
+			frame->Image_Buffer_List[i] = NULL;
+			frame->Image_Buffer_Size_List[i] = 0;
+		}
 	}
-	/* move to end of file */
-	retval = fseek(fp,0,SEEK_END);
-	if(retval == -1)
-	{
-		fclose(fp);
+	return retval;
+}
+
+/**
+ * Routine to set whether exposures are saved asynchronously. When TRUE, CCD_Exposure_Expose
+ * de-interlaces the read out data into a frame from the image buffer pool, queues the frame for the handle's 
+ * FITS writer thread and returns, so the next exposure can be started whilst the last one is written to disk. 
+ * If all the frames in the pool are waiting to be saved, CCD_Exposure_Expose waits for the writer thread 
+ * to save one before processing the next readout. Errors saving a frame are reported through the 
+ * save callback (CCD_Exposure_Set_Save_Callback) and CCD_Exposure_Save_Wait. Streaming readouts are always 
+ * saved synchronously. When set to FALSE, frames already queued are still saved by the writer thread.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param value A boolean, TRUE to save exposures asynchronously and FALSE to save them before 
+ *        CCD_Exposure_Expose returns.
+ * @return The routine returns TRUE if the value was set, and FALSE if it was not a legal boolean.
+ * @see #CCD_Exposure_Set_Save_Callback
+ * @see #CCD_Exposure_Save_Wait
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Exposure_Set_Async_Save(CCD_Interface_Handle_T* handle,int value)
+{
+	if(!CCD_GLOBAL_IS_BOOLEAN(value))
+	{
+		Exposure_Error_Number = 94;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Set_Async_Save:Illegal value (%d).",value);
+		return FALSE;
+	}
+	handle->Exposure_Data.Async_Save = value;
+	return TRUE;
+}
+
+/**
+ * Routine to get whether exposures are saved asynchronously.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return A boolean, TRUE if exposures are saved by the FITS writer thread, FALSE if they are saved
+ *         before CCD_Exposure_Expose returns.
+ * @see #CCD_Exposure_Set_Async_Save
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Exposure_Get_Async_Save(CCD_Interface_Handle_T* handle)
+{
+	return handle->Exposure_Data.Async_Save;
+}
+
+/**
+ * Routine to set the function the FITS writer thread calls after each asynchronously saved image has been
+ * written to disk (or failed to be). The callback is called from the FITS writer thread, and should return
+ * quickly as the next frame is not saved until it does.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param callback The function to call, or NULL to stop calling one. It is passed the handle, the filename
+ *        of the image, a boolean which is TRUE if the image was saved successfully, and an error string
+ *        describing why the save failed (an empty string if it succeeded).
+ * @see #CCD_Exposure_Set_Async_Save
+ * @see #Exposure_Writer_Thread
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+void CCD_Exposure_Set_Save_Callback(CCD_Interface_Handle_T* handle,
+				    void (*callback)(CCD_Interface_Handle_T* handle,char *filename,int successful,
+						     char *error_string))
+{
+	pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+	handle->Exposure_Data.Save_Callback = callback;
+	pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+}
+
+/**
+ * Routine to wait until the FITS writer thread has saved all the frames queued for it. This should be called
+ * at the end of a sequence of asynchronously saved exposures (e.g. a MULTRUN), before the saved images are used.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The routine returns TRUE if all the images queued since the last call have been saved, 
+ *         and FALSE if any of them failed to save.
+ * @see #CCD_Exposure_Set_Async_Save
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Exposure_Save_Wait(char *class,char *source,CCD_Interface_Handle_T* handle)
+{
+	int failed_count;
+
+	Exposure_Error_Number = 0;
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "CCD_Exposure_Save_Wait(handle=%p):Waiting for %d frames to be saved.",
+			      handle,handle->Exposure_Data.Writer_Pending_Count);
+#endif
+	pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+	while(handle->Exposure_Data.Writer_Pending_Count > 0)
+		pthread_cond_wait(&(handle->Exposure_Data.Writer_Condition),&(handle->Exposure_Data.Writer_Mutex));
+	failed_count = handle->Exposure_Data.Writer_Failed_Count;
+	handle->Exposure_Data.Writer_Failed_Count = 0;
+	pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+	if(failed_count > 0)
+	{
+		Exposure_Error_Number = 98;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Save_Wait:%d images failed to save.",failed_count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to set which row kernel CCD_Exposure_DeInterlace uses. CCD_Exposure_Initialise selects the fastest
+ * kernel supported by the CPU, this routine allows another to be used (for instance for testing).
+ * @param kernel The kernel to use, a member of CCD_EXPOSURE_DEINTERLACE_KERNEL.
+ * @return The routine returns TRUE if it suceeded, and FALSE if the kernel is illegal or not supported
+ *         on this CPU.
+ * @see #Exposure_Data
+ * @see #CCD_Exposure_DeInterlace_Kernel_Supported
+ * @see #CCD_EXPOSURE_IS_DEINTERLACE_KERNEL
+ */
+int CCD_Exposure_Set_DeInterlace_Kernel(enum CCD_EXPOSURE_DEINTERLACE_KERNEL kernel)
+{
+	if(!CCD_EXPOSURE_IS_DEINTERLACE_KERNEL(kernel))
+	{
+		Exposure_Error_Number = 86;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Set_DeInterlace_Kernel:Illegal kernel '%d'.",kernel);
+		return FALSE;
+	}
+	if(!CCD_Exposure_DeInterlace_Kernel_Supported(kernel))
+	{
+		Exposure_Error_Number = 87;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Set_DeInterlace_Kernel:Kernel '%d' not supported.",
+			kernel);
+		return FALSE;
+	}
+	Exposure_Data.DeInterlace_Kernel = kernel;
+	return TRUE;
+}
+
+/**
+ * Routine to get which row kernel CCD_Exposure_DeInterlace uses.
+ * @return The kernel in use, a member of CCD_EXPOSURE_DEINTERLACE_KERNEL.
+ * @see #Exposure_Data
+ */
+enum CCD_EXPOSURE_DEINTERLACE_KERNEL CCD_Exposure_Get_DeInterlace_Kernel(void)
+{
+	return Exposure_Data.DeInterlace_Kernel;
+}
+
+/**
+ * Routine to determine whether a de-interlace row kernel can be used on this CPU. The scalar kernel
+ * is always supported. The SSE2 and AVX2 kernels are only compiled in for GCC on x86 CPUs, and 
+ * are supported if __builtin_cpu_supports reports the relevant instruction set.
+ * @param kernel The kernel to check, a member of CCD_EXPOSURE_DEINTERLACE_KERNEL.
+ * @return The routine returns TRUE if the kernel is supported, and FALSE if it is not.
+ */
+int CCD_Exposure_DeInterlace_Kernel_Supported(enum CCD_EXPOSURE_DEINTERLACE_KERNEL kernel)
+{
+	switch(kernel)
+	{
+		case CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR:
+			return TRUE;
+#ifdef EXPOSURE_DEINTERLACE_X86
+		case CCD_EXPOSURE_DEINTERLACE_KERNEL_SSE2:
+			__builtin_cpu_init();
+			return (__builtin_cpu_supports("sse2") != 0);
+		case CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2:
+			__builtin_cpu_init();
+			return (__builtin_cpu_supports("avx2") != 0);
+#endif
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * Routine to get how long a stage of the last call to CCD_Exposure_Expose took. This allows the dead time
+ * of each exposure to be broken down, see test_exposure_benchmark.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param stage Which stage to return the time of, a member of CCD_EXPOSURE_STAGE.
+ * @return The time the stage took, in milliseconds. This is -1.0 if the stage was not reached 
+ *         (or is not used, e.g. POST_READOUT for a streamed readout), or the stage is illegal.
+ * @see #CCD_EXPOSURE_STAGE
+ * @see #CCD_EXPOSURE_IS_STAGE
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+double CCD_Exposure_Get_Stage_Time(CCD_Interface_Handle_T* handle,enum CCD_EXPOSURE_STAGE stage)
+{
+	if(!CCD_EXPOSURE_IS_STAGE(stage))
+		return -1.0;
+	return handle->Exposure_Data.Stage_Time_List[stage];
+}
+
+/**
+ * Get the current value of the ccd_exposure error number.
+ * @return The current value of the ccd_exposure error number.
+ */
+int CCD_Exposure_Get_Error_Number(void)
+{
+	return Exposure_Error_Number;
+}
+
+/**
+ * The error routine that reports any errors occuring in ccd_exposure in a standard way.
+ * @see ccd_global.html#CCD_Global_Get_Current_Time_String
+ */
+void CCD_Exposure_Error(void)
+{
+	char time_string[32];
+
+	CCD_Global_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Exposure_Error_Number == 0)
+		sprintf(Exposure_Error_String,"Logic Error:No Error defined");
+	fprintf(stderr,"%s CCD_Exposure:Error(%d) : %s\n",time_string,Exposure_Error_Number,Exposure_Error_String);
+}
+
+/**
+ * The error routine that reports any errors occuring in ccd_exposure in a standard way. This routine places the
+ * generated error string at the end of a passed in string argument.
+ * @param error_string A string to put the generated error in. This string should be initialised before
+ * being passed to this routine. The routine will try to concatenate it's error string onto the end
+ * of any string already in existance.
+ * @see ccd_global.html#CCD_Global_Get_Current_Time_String
+ */
+void CCD_Exposure_Error_String(char *error_string)
+{
+	char time_string[32];
+
+	CCD_Global_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Exposure_Error_Number == 0)
+		sprintf(Exposure_Error_String,"Logic Error:No Error defined");
+	sprintf(error_string+strlen(error_string),"%s CCD_Exposure:Error(%d) : %s\n",time_string,
+		Exposure_Error_Number,Exposure_Error_String);
+}
+
+/**
+ * The warning routine that reports any warnings occuring in ccd_exposure in a standard way.
+ * @see ccd_global.html#CCD_Global_Get_Current_Time_String
+ */
+void CCD_Exposure_Warning(void)
+{
+	char time_string[32];
+
+	CCD_Global_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an warning message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an warning to display */
+	if(Exposure_Error_Number == 0)
+		sprintf(Exposure_Error_String,"Logic Error:No Warning defined");
+	fprintf(stderr,"%s CCD_Exposure:Warning(%d) : %s\n",time_string,Exposure_Error_Number,Exposure_Error_String);
+}
+
+/* ----------------------------------------------------------------
+**	Internal routines
+** ---------------------------------------------------------------- */
+/**
+ * Internal exposure routine that sets the shutter bit. The SDSU SEX command looks
+ * at this bit to determine whether to open and close the shutter whilst performing an exposure.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param open_shutter If it is TRUE, the SDSU SEX command will open/close the 
+ * 	shutter at the relevant places during an exposure. If it is FALSE, the shutter will remain in it's 
+ * 	current state throughout the exposure.
+ * @return Returns TRUE if the operation succeeded, FALSE if it fails.
+ * @see #EXPOSURE_ADDRESS_CONTROLLER_STATUS
+ * @see #CCD_Exposure_Expose
+ * @see ccd_dsp.html#CCD_DSP_Command_RDM
+ * @see ccd_dsp.html#CCD_DSP_Command_WRM
+ * @see ccd_dsp.html#CCD_DSP_CONTROLLER_STATUS_OPEN_SHUTTER_BIT
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Shutter_Control(char *class,char *source,CCD_Interface_Handle_T* handle,int open_shutter)
+{
+	int current_status;
+
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Shutter_Control:Started.");
+#endif
+/* check parameter */
+	if(!CCD_GLOBAL_IS_BOOLEAN(open_shutter))
+	{
+		Exposure_Error_Number = 21;
+		sprintf(Exposure_Error_String,"Exposure_Shutter_Control:Illegal open_shutter value:%d.",
+			open_shutter);
+		return FALSE;
+	}
+/* get current controller status */
+	current_status = CCD_DSP_Command_RDM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_X,
+					     EXPOSURE_ADDRESS_CONTROLLER_STATUS);
+	if((current_status == 0)&&(CCD_DSP_Get_Error_Number() != 0))
+	{
+		Exposure_Error_Number = 28;
+		sprintf(Exposure_Error_String,"Exposure_Shutter_Control: Reading timing status failed.");
+		return FALSE;
+	}
+/* set or clear open shutter bit */
+	if(open_shutter)
+		current_status |= CCD_DSP_CONTROLLER_STATUS_OPEN_SHUTTER_BIT;
+	else
+		current_status &= ~(CCD_DSP_CONTROLLER_STATUS_OPEN_SHUTTER_BIT);
+/* write new controller status value */
+	if(CCD_DSP_Command_WRM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_X,
+			       EXPOSURE_ADDRESS_CONTROLLER_STATUS,current_status) != CCD_DSP_DON)
+	{
+		Exposure_Error_Number = 22;
+		sprintf(Exposure_Error_String,"Exposure_Shutter_Control: Writing shutter bit failed.");
+		return FALSE;
+	}
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Shutter_Control:Completed.");
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to prepare an exposure, called from CCD_Exposure_Expose and CCD_Exposure_Expose_Multi.
+ * <ul>
+ * <li>The abort flag and the stage timings of the last exposure are reset.
+ * <li>It checks to ensure CCD Setup has been successfully completed using CCD_Setup_Get_Setup_Complete.
+ * <li>The parameters are checked.
+ * <li>The controller is told whether to open the shutter or not during the exposure, depending on the value
+ * 	of the open_shutter parameter.
+ * <li>The length of exposure is sent to the controller using CCD_DSP_Command_SET.
+ * </ul>
+ * The rest of the expose structure is initialised, ready to monitor the exposure.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose The address of the exposure state. The Handle, Filename_List and Filename_Count fields
+ * 	should already be filled in.
+ * @param clear_array Whether to clear the array before the exposure starts.
+ * @param open_shutter Whether the shutter is to be opened over the duration of the exposure.
+ * @param exposure_time The length of time to open the shutter for in milliseconds.
+ * @return Returns TRUE on success. On failure Exposure_Expose_Fail is called and FALSE returned.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Fail
+ * @see #Exposure_Shutter_Control
+ * @see ccd_setup.html#CCD_Setup_Get_Setup_Complete
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Flags
+ * @see ccd_setup.html#CCD_Setup_Get_Readout_Pixel_Count
+ * @see ccd_dsp.html#CCD_DSP_Command_SET
+ * @see ccd_dsp.html#CCD_DSP_EXPOSURE_MAX_LENGTH
+ */
+static int Exposure_Expose_Prepare(char *class,char *source,struct Exposure_Expose_Struct *expose,int clear_array,
+				   int open_shutter,int exposure_time)
+{
+	CCD_Interface_Handle_T* handle = expose->Handle;
+	int i;
+
+	expose->Active = TRUE;
+	expose->Error_Number = 0;
+	expose->Error_String[0] = '\0';
+	expose->Exposure_Time = exposure_time;
+	expose->Window_Flags = 0;
+	expose->Expected_Pixel_Count = 0;
+	expose->Streaming = FALSE;
+	expose->Stream.Fp = NULL;
+	expose->Stream.Row_Buffer = NULL;
+	expose->Exposure_Data = NULL;
+	expose->Elapsed_Exposure_Time = 0;
+	expose->Readout_Detected = FALSE;
+	expose->Current_Pixel_Count = 0;
+	expose->Last_Pixel_Count = 0;
+	expose->Pixel_Rate = 0.0;
+	expose->Progress_Time.tv_sec = 0;
+	expose->Progress_Time.tv_nsec = 0;
+	expose->Started = FALSE;
+	expose->Done = FALSE;
+	if(handle == NULL)
+	{
+		Exposure_Error_Number = 114;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:handle was NULL.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* reset abort flag */
+	CCD_DSP_Set_Abort(class,source,handle,FALSE);
+/* reset the stage timings of the last exposure */
+	for(i=0;i<CCD_EXPOSURE_STAGE_COUNT;i++)
+		handle->Exposure_Data.Stage_Time_List[i] = -1.0;
+/* we shouldn't be able to expose until setup has been successfully completed - check this */
+	if(!CCD_Setup_Get_Setup_Complete(handle))
+	{
+		Exposure_Error_Number = 1;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Exposure failed:Setup was not complete");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* check parameter ranges */
+	if(!CCD_GLOBAL_IS_BOOLEAN(clear_array))
+	{
+		Exposure_Error_Number = 6;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:clear_array = %d.",clear_array);
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	if(!CCD_GLOBAL_IS_BOOLEAN(open_shutter))
+	{
+		Exposure_Error_Number = 2;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:open_shutter = %d.",open_shutter);
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	if((exposure_time < 0)||(exposure_time > CCD_DSP_EXPOSURE_MAX_LENGTH))
+	{
+		Exposure_Error_Number = 3;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:exposure_time = %d",exposure_time);
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	if(expose->Filename_Count < 0)
+	{
+		Exposure_Error_Number = 7;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal value:filename_count = %d",
+			expose->Filename_Count);
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	expose->Window_Flags = CCD_Setup_Get_Window_Flags(handle);
+	if((expose->Window_Flags == 0)&&(expose->Filename_Count > 1))
+	{
+		Exposure_Error_Number = 8;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Too many filenames for window_flags %d:"
+			"filename_count = %d",expose->Window_Flags,expose->Filename_Count);
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* get information from setup that we need to do an exposure */
+	expose->Expected_Pixel_Count = CCD_Setup_Get_Readout_Pixel_Count(handle);
+	if(expose->Expected_Pixel_Count <= 0)
+	{
+		Exposure_Error_Number = 9;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Illegal expected pixel count '%d'.",
+			expose->Expected_Pixel_Count);
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* if we have aborted - stop here */
+	if(CCD_DSP_Get_Abort(handle))
+	{
+		Exposure_Error_Number = 4;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* setup the shutter control bit - which determines whether the SEX command has
+** control to open and close the shutter at the appropriate times */
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Expose_Prepare(handle=%p):Setting shutter control(%d).",
+			      handle,open_shutter);
+#endif
+	if(!Exposure_Shutter_Control(class,source,handle,open_shutter))
+	{
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	if(CCD_DSP_Get_Abort(handle))
+	{
+		Exposure_Error_Number = 5;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* write the time to memory so that SEX can read it */
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Expose_Prepare(handle=%p):Setting exposure length(%d).",
+			      handle,exposure_time);
+#endif
+	if(!CCD_DSP_Command_SET(class,source,handle,exposure_time))
+	{
+		Exposure_Error_Number = 23;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Setting exposure time failed.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	handle->Exposure_Data.Exposure_Length = exposure_time;
+	Exposure_Status_Publish_Progress(handle,expose);
+	if(CCD_DSP_Get_Abort(handle))
+	{
+		Exposure_Error_Number = 25;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to wait until it is nearly time to start a list of exposures, and then clear the arrays.
+ * If start_time is set, we sleep until the longest Start_Exposure_Clear_Time of the active exposures
+ * before the start time. Any exposure aborted whilst waiting fails, the rest carry on waiting.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose_list The list of exposure states. Only Active exposures are waited for.
+ * @param expose_count The number of exposures in expose_list.
+ * @param clear_array Whether to clear the arrays before the exposures start.
+ * @param start_time The time to start the exposures. If the tv_sec field is zero, we do not wait.
+ * @return Returns TRUE if any of the exposures are still active, and FALSE if they have all failed.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Fail
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static int Exposure_Expose_Wait_Start(char *class,char *source,struct Exposure_Expose_Struct *expose_list,
+				      int expose_count,int clear_array,struct timespec start_time)
+{
+	struct timespec sleep_time,current_time;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+	int i,done,clear_time,active_count;
+
+/* We will use the start_time parameter to determine when to start the exposure IF
+** it's seconds are greater then zero */
+/* do the clear array a few seconds before the exposure is due to start */
+	if(start_time.tv_sec > 0)
+	{
+		clear_time = 0;
+		for(i=0;i<expose_count;i++)
+		{
+			if(expose_list[i].Active == FALSE)
+				continue;
+			Exposure_Status_Set(expose_list[i].Handle,CCD_EXPOSURE_STATUS_WAIT_START);
+			if(expose_list[i].Handle->Exposure_Data.Start_Exposure_Clear_Time > clear_time)
+				clear_time = expose_list[i].Handle->Exposure_Data.Start_Exposure_Clear_Time;
+		}
+		done = FALSE;
+		while(done == FALSE)
+		{
+#ifdef _POSIX_TIMERS
+			clock_gettime(CLOCK_REALTIME,&current_time);
+#else
+			gettimeofday(&gtod_current_time,NULL);
+			current_time.tv_sec = gtod_current_time.tv_sec;
+			current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
+#endif
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				       "Exposure_Expose_Wait_Start:Waiting for exposure start time (%ld,%ld).",
+				       current_time.tv_sec,start_time.tv_sec);
+#endif
+		/* If there is more than clear_time seconds to go, sleep for a second and check again.
+		** This is only the wait for the start time, the monitor loop polls at the adaptive interval
+		** from Exposure_Poll_Interval, and CCD_DSP_Command_SEX sleeps until the exact start time. */
+			if((start_time.tv_sec - current_time.tv_sec) > clear_time)
+			{
+				sleep_time.tv_sec = 1;
+				sleep_time.tv_nsec = 0;
+				nanosleep(&sleep_time,NULL);
+			}
+			else
+				done = TRUE;
+		/* check - have we been aborted? */
+			active_count = 0;
+			for(i=0;i<expose_count;i++)
+			{
+				if(expose_list[i].Active == FALSE)
+					continue;
+				if(CCD_DSP_Get_Abort(expose_list[i].Handle))
+				{
+					Exposure_Error_Number = 37;
+					sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+					Exposure_Expose_Fail(class,source,&(expose_list[i]));
+				}
+				else
+					active_count++;
+			}
+			if(active_count == 0)
+				return FALSE;
+		}/* end while */
+	}
+/* clear the array */
+	if(clear_array)
+	{
+#if LOGGING > 4
+		/*		CCD_Global_Log(LOG_VERBOSITY_INTERMEDIATE,"CCD_Exposure_Expose():Clearing CCD array.");*/
+		CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			       "Exposure_Expose_Wait_Start:Clearing is commented out at the moment.");
+#endif
+		/* diddly
+		handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_CLEAR;
+		if(!CCD_DSP_Command_CLR(class,source,handle))
+		{
+			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
+			handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 38;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Clear Array failed.");
+			return FALSE;
+		}
+		*/
+
+	}
+/* check - have we been aborted? */
+	active_count = 0;
+	for(i=0;i<expose_count;i++)
+	{
+		if(expose_list[i].Active == FALSE)
+			continue;
+		if(CCD_DSP_Get_Abort(expose_list[i].Handle))
+		{
+			Exposure_Error_Number = 20;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+			Exposure_Expose_Fail(class,source,&(expose_list[i]));
+		}
+		else
+			active_count++;
+	}
+	return (active_count > 0);
+}
+
+/**
+ * Routine to decide whether to stream the readout of an exposure to disk, and if so open the FITS file.
+ * We can only do this for full frame readouts where the de-interlaced rows are read out in order,
+ * i.e. each raw row maps onto one final row.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose The address of the exposure state. The Streaming and Stream fields are filled in.
+ * @return Returns TRUE on success. On failure Exposure_Expose_Fail is called and FALSE returned.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Fail
+ * @see #Exposure_Stream_Open
+ * @see ccd_setup.html#CCD_Setup_Get_DeInterlace_Type
+ */
+static int Exposure_Expose_Stream_Open(char *class,char *source,struct Exposure_Expose_Struct *expose)
+{
+	CCD_Interface_Handle_T* handle = expose->Handle;
+	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
+
+	expose->Streaming = FALSE;
+	if(handle->Exposure_Data.Streaming_Readout && (expose->Window_Flags == 0))
+	{
+		deinterlace_type = CCD_Setup_Get_DeInterlace_Type(handle);
+		if((deinterlace_type == CCD_DSP_DEINTERLACE_SINGLE)||(deinterlace_type == CCD_DSP_DEINTERLACE_FLIP)||
+		   (deinterlace_type == CCD_DSP_DEINTERLACE_SPLIT_SERIAL))
+		{
+			if(!Exposure_Stream_Open(class,source,handle,expose->Filename_List[0],&(expose->Stream)))
+			{
+				Exposure_Expose_Fail(class,source,expose);
+				return FALSE;
+			}
+			expose->Streaming = TRUE;
+		}
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Expose_Stream_Open(handle=%p):Streaming readout %s for deinterlace type %d.",
+				      handle,expose->Streaming ? "enabled" : "not supported",deinterlace_type);
+#endif
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to start an exposure, by calling CCD_DSP_Command_SEX. This sleeps until start_time if it is set.
+ * The SEX stage is timed, and the EXPOSE stage timing started.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose The address of the exposure state.
+ * @param start_time The time to start the exposure. If the tv_sec field is zero, the exposure is started now.
+ * @return Returns TRUE on success. On failure Exposure_Expose_Fail is called and FALSE returned.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Fail
+ * @see #Exposure_Stage_Start
+ * @see #Exposure_Stage_End
+ * @see ccd_dsp.html#CCD_DSP_Command_SEX
+ */
+static int Exposure_Expose_Start(char *class,char *source,struct Exposure_Expose_Struct *expose,
+				 struct timespec start_time)
+{
+/* Send the command to start the exposure, and monitor for completion. */
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Expose_Start(handle=%p):Starting Exposure.",expose->Handle);
+#endif
+	/* Exposure status is set in CCD_DSP_Command_SEX, as this routine sleeps before starting
+	** the exposure. */
+	Exposure_Stage_Start(&(expose->Stage_Start_Time));
+	if(!CCD_DSP_Command_SEX(class,source,expose->Handle,start_time,expose->Exposure_Time))
+	{
+		Exposure_Error_Number = 39;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:SEX command failed(%ld,%ld,%d).",
+			start_time.tv_sec,start_time.tv_nsec,expose->Exposure_Time);
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	expose->Started = TRUE;
+	Exposure_Stage_End(expose->Handle,CCD_EXPOSURE_STAGE_SEX,&(expose->Stage_Start_Time));
+	return TRUE;
+}
+
+/**
+ * Routine to poll an exposure once, whilst it is being taken and read out.
+ * <ul>
+ * <li>Get the Host Status Transfer Register value, using CCD_DSP_Command_Get_HSTR.
+ * <li>If we are not reading out, and have more than Exposure_Data.Readout_Remaining_Time milliseconds
+ * 	left of exposure, use CCD_DSP_Command_RET to get the current elapsed exposure time.
+ * <li>If the exposure length minus the current elapsed exposure time is less than
+ * 	Exposure_Data.Readout_Remaining_Time milliseconds, switch exposure status to PRE_READOUT.
+ * <li>Use CCD_DSP_Command_Get_Readout_Progress to get how many pixels we have read out.
+ * <li>If we are streaming the readout, process and save any complete rows read out so far,
+ * 	using Exposure_Stream_Write_Rows.
+ * <li>Check to see whether we have been aborted.
+ * <li>Check to see if we have finished reading out, if so set the Done field.
+ * <li>Otherwise work out how long to wait until the next poll, using Exposure_Poll_Interval.
+ * </ul>
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose The address of the exposure state.
+ * @param poll_time The address of an integer, set to how long to wait until the next poll in milliseconds,
+ * 	if the readout is not done.
+ * @return Returns TRUE on success. On failure (including an abort) Exposure_Expose_Fail is called
+ * 	and FALSE returned.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Fail
+ * @see #EXPOSURE_HSTR_HTF_BITS
+ * @see #CCD_EXPOSURE_HSTR_READOUT
+ * @see #CCD_EXPOSURE_HSTR_BIT_SHIFT
+ * @see #EXPOSURE_READ_TIMEOUT
+ * @see #Exposure_Stream_Write_Rows
+ * @see #Exposure_Poll_Interval
+ * @see #Exposure_Stage_End
+ * @see ccd_dsp.html#CCD_DSP_Command_Get_HSTR
+ * @see ccd_dsp.html#CCD_DSP_Command_RET
+ * @see ccd_dsp.html#CCD_DSP_Command_Get_Readout_Progress
+ * @see ccd_dsp.html#CCD_DSP_Command_AEX
+ * @see ccd_interface.html#CCD_Interface_Get_Reply_Data
+ */
+static int Exposure_Expose_Monitor(char *class,char *source,struct Exposure_Expose_Struct *expose,int *poll_time)
+{
+	CCD_Interface_Handle_T* handle = expose->Handle;
+	struct timespec current_time;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+	double progress_ms;
+	int status;
+
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+		       "Exposure_Expose_Monitor(handle=%p):Getting Host Status Transfer Register.",handle);
+#endif
+	if(!CCD_DSP_Command_Get_HSTR(class,source,handle,&status))
+	{
+		Exposure_Error_Number = 40;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Getting HSTR failed.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+#if LOGGING > 9
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Expose_Monitor(handle=%p):HSTR is %#x.",handle,status);
+#endif
+	status = (status & EXPOSURE_HSTR_HTF_BITS) >> CCD_EXPOSURE_HSTR_BIT_SHIFT;
+#if LOGGING > 9
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Expose_Monitor(handle=%p):HSTR reply bits %#x.",handle,status);
+#endif
+	if(status != CCD_EXPOSURE_HSTR_READOUT)
+	{
+		/* are we about to start reading out? */
+		if((expose->Exposure_Time - expose->Elapsed_Exposure_Time) >=
+		   handle->Exposure_Data.Readout_Remaining_Time)
+		{
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			       "Exposure_Expose_Monitor(handle=%p):Getting Elapsed exposure time.",handle);
+#endif
+			/* get elapsed time from controller */
+			expose->Elapsed_Exposure_Time = CCD_DSP_Command_RET(class,source,handle);
+#if LOGGING > 9
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			       "Exposure_Expose_Monitor(handle=%p):Elapsed exposure time is %#x.",
+					      handle,expose->Elapsed_Exposure_Time);
+#endif
+			if (expose->Elapsed_Exposure_Time < 0)
+				expose->Elapsed_Exposure_Time = 0;
+			if(expose->Elapsed_Exposure_Time == 0)
+			{
+				if(CCD_DSP_Get_Error_Number() != 0)
+					CCD_DSP_Error();
+			}
+		}/* end if there is over handle->Exposure_Data.Readout_Remaining_Time milliseconds of exposure left */
+		if((handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_EXPOSE)&&
+		   ((expose->Exposure_Time - expose->Elapsed_Exposure_Time) <
+		    handle->Exposure_Data.Readout_Remaining_Time))
+		{
+			/* Here we change the Exposure status to PRE_READOUT, when there
+			** is less than handle->Exposure_Data.Readout_Remaining_Time milliseconds of
+			** exposure time left.
+			** The exposure status is checked in WRM,RDM,TDL and RET commands,
+			** so we can't send these commands when in readout mode.
+			** We switch to exposure readout handle->Exposure_Data.Readout_Remaining_Time milliseconds
+			** early as Exposure_Poll_Interval can sleep up to EXPOSURE_POLL_READOUT_TIME past the
+			** switch point, and the HSTR status may change before we check it again. */
+			Exposure_Status_Set(handle,CCD_EXPOSURE_STATUS_PRE_READOUT);
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+					      "Exposure_Expose_Monitor(handle=%p):Exposure Status "
+					      "changed to PRE_READOUT %d milliseconds before readout starts.",
+					      handle,(expose->Exposure_Time - expose->Elapsed_Exposure_Time));
+#endif
+		}/* end if there  is less than handle->Exposure_Data.Readout_Remaining_Time milliseconds
+		 ** of exposure time left */
+	}/* end if HSTR status is not readout */
+	/* Testing whether the status is CCD_EXPOSURE_HSTR_READOUT can fail to be detected,
+	** if it is in this state for less than one poll interval (i.e. dual amplifier readout with binning 4)
+	** We could try the following test to get round this:
+	**    if(handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_PRE_READOUT and
+	**       exposure_time - elapsed_exposure_time < 0)
+	**         handle->Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_READOUT
+	** However this won't work as we go into PRE_READOUT (which stops updating elapsed_exposure_time)
+	** Readout_Remaining_Time (by default 1500 ms) before the exposure fails.
+	** See below for solution.
+	*/
+	if(status == CCD_EXPOSURE_HSTR_READOUT)
+	{
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			       "Exposure_Expose_Monitor(handle=%p):HSTR Status is READOUT.",handle);
+#endif
+		/* the exposure stage ends when we first see the readout, short exposures are already in
+		** READOUT exposure status (see DSP_Send_Sex) */
+		if(expose->Readout_Detected == FALSE)
+		{
+			expose->Readout_Detected = TRUE;
+			Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_EXPOSE,&(expose->Stage_Start_Time));
+		}
+		/* is this the first time through the loop we have detected readout mode? */
+		if(handle->Exposure_Data.Exposure_Status != CCD_EXPOSURE_STATUS_READOUT)
+		{
+			Exposure_Status_Set(handle,CCD_EXPOSURE_STATUS_READOUT);
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			 "Exposure_Expose_Monitor(handle=%p):Exposure Status changed to READOUT(HSTR).",handle);
+#endif
+		}
+	}
+	/* We want to get the readout progress after we have moved into exposure status readout.
+	** We want to continue getting readout progress after the HSTR status has come out of readout mode,
+	** to get the progress of the last few bytes read out whilst we were sleeping.
+	** We used to only get readout progress when:
+	** (handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_READOUT), (i.e. during and after
+	** we had detected HSTR register status to be CCD_EXPOSURE_HSTR_READOUT)
+	** However we can miss detecting readout mode, if the whole readout takes less than one poll interval.
+	*/
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+		       "Exposure_Expose_Monitor(handle=%p):Getting Readout Progress.",handle);
+#endif
+	expose->Last_Pixel_Count = expose->Current_Pixel_Count;
+	if(!CCD_DSP_Command_Get_Readout_Progress(class,source,handle,&(expose->Current_Pixel_Count)))
+	{
+		Exposure_Error_Number = 41;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Get Readout Progress failed.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+#if LOGGING > 9
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Expose_Monitor(handle=%p):Readout progress is %#x of %#x pixels.",
+			      handle,expose->Current_Pixel_Count,expose->Expected_Pixel_Count);
+#endif
+	/* If the current pixel count is greater than zero, we must be reading out, right?
+        ** Correct, see IIA in START_EXPOSURE (timCCDmisc.asm), INITIALIZE_NUMBER_OF_PIXELS in pciboot.asm,
+	** READ_NUMBER_OF_PIXELS_READ (0x8075) in pciboot.asm, and READ_PIXEL_COUNT/ASTROPCI_GET_PROGRESS in
+	** astropci.c. */
+	if(expose->Current_Pixel_Count > 0)
+	{
+		if(expose->Readout_Detected == FALSE)
+		{
+			expose->Readout_Detected = TRUE;
+			Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_EXPOSE,&(expose->Stage_Start_Time));
+		}
+		/* is this the first time through the loop we have detected readout mode? */
+		if(handle->Exposure_Data.Exposure_Status != CCD_EXPOSURE_STATUS_READOUT)
+		{
+			Exposure_Status_Set(handle,CCD_EXPOSURE_STATUS_READOUT);
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+					      "Exposure_Expose_Monitor(handle=%p):"
+					   "Exposure Status changed to READOUT(current_pixel_count).",handle);
+#endif
+		}
+	}
+	/* Measure the readout rate, for predicting the end of readout, and check for readout timeouts. */
+#ifdef _POSIX_TIMERS
+	clock_gettime(CLOCK_REALTIME,&current_time);
+#else
+	gettimeofday(&gtod_current_time,NULL);
+	current_time.tv_sec = gtod_current_time.tv_sec;
+	current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
+#endif
+	if(expose->Current_Pixel_Count != expose->Last_Pixel_Count)
+	{
+		/* we only know when the readout started, if we have seen some pixels before */
+		if((expose->Last_Pixel_Count > 0)&&(expose->Progress_Time.tv_sec > 0))
+		{
+			progress_ms = Exposure_TimeSpec_Diff_Ms(expose->Progress_Time,current_time);
+			if(progress_ms > 0.0)
+			{
+				expose->Pixel_Rate = ((double)(expose->Current_Pixel_Count-expose->Last_Pixel_Count))/
+					progress_ms;
+			}
+		}
+		expose->Progress_Time = current_time;
+	}
+	/* We can only have a readout timeout, if we are in readout mode. */
+	if(handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_READOUT)
+	{
+		/* start timing from when we detected readout mode, if we have not seen any pixels yet */
+		if(expose->Progress_Time.tv_sec == 0)
+			expose->Progress_Time = current_time;
+		/* have we timed out? If so, exit loop. */
+		if(Exposure_TimeSpec_Diff_Ms(expose->Progress_Time,current_time) >=
+		   (EXPOSURE_READ_TIMEOUT*CCD_GLOBAL_ONE_SECOND_MS))
+		{
+#if LOGGING > 9
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			       "Exposure_Expose_Monitor(handle=%p):Readout timeout has occured.",handle);
+#endif
+			CCD_Global_Metrics_Counter_Add(handle,CCD_GLOBAL_METRICS_COUNTER_READOUT_TIMEOUTS,1);
+			Exposure_Error_Number = 43;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Readout timed out.");
+			Exposure_Expose_Fail(class,source,expose);
+			return FALSE;
+		}
+	}
+	/* If streaming, process and save any complete rows that have been read out since the last time
+	** round the loop. The reply data buffer is filled by the PCI DMA transfer as the readout progresses,
+	** so the rows below current_pixel_count are already valid. */
+	if(expose->Streaming && (expose->Current_Pixel_Count > 0) && (CCD_DSP_Get_Abort(handle) == FALSE))
+	{
+		if(expose->Exposure_Data == NULL)
+		{
+			if(!CCD_Interface_Get_Reply_Data(handle,&(expose->Exposure_Data)))
+			{
+				Exposure_Error_Number = 74;
+				sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Failed to get reply data "
+					"whilst streaming.");
+				Exposure_Expose_Fail(class,source,expose);
+				return FALSE;
+			}
+		}
+		if(!Exposure_Stream_Write_Rows(class,source,&(expose->Stream),expose->Exposure_Data,
+					       expose->Current_Pixel_Count))
+		{
+			Exposure_Expose_Fail(class,source,expose);
+			return FALSE;
+		}
+	}
+	/* check - have we been aborted? */
+	if(CCD_DSP_Get_Abort(handle))
+	{
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Expose_Monitor(handle=%p):Abort detected.",handle);
+#endif
+		if(handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_EXPOSE)
+		{
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+					      "Exposure_Expose_Monitor(handle=%p):Trying AEX.",handle);
+#endif
+			if(CCD_DSP_Command_AEX(class,source,handle) != CCD_DSP_DON)
+			{
+				Exposure_Error_Number = 15;
+				sprintf(Exposure_Error_String,"CCD_Exposure_Expose:AEX Abort command failed.");
+				Exposure_Expose_Fail(class,source,expose);
+				return FALSE;
+			}
+			/* we now only abort when exposure status is STATUS_EXPOSE. */
+			Exposure_Error_Number = 42;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+			Exposure_Expose_Fail(class,source,expose);
+			return FALSE;
+		}
+		/* If the exposure status is PRE_READOUT, we should wait until it is READOUT,
+		** and the call ABR. */
+		/* If the exposure status is READOUT, we should call ABR.
+		** However ABR seems to be causing lockups even when called correctly.
+		** So for now we let the READOUT continue until it is finished,
+		** then an ABORT check after the exposure/readout loop will catch the abort. */
+	}
+	/* check - all pixels read out? */
+	if(expose->Current_Pixel_Count >= expose->Expected_Pixel_Count)
+	{
+#if LOGGING > 9
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Expose_Monitor(handle=%p):Readout completed.",handle);
+#endif
+		expose->Done = TRUE;
+		if(expose->Pixel_Rate > 0.0)
+			handle->Exposure_Data.Readout_Pixel_Rate = expose->Pixel_Rate;
+	}
+	else
+	{
+		(*poll_time) = Exposure_Poll_Interval(handle,expose->Exposure_Time,expose->Elapsed_Exposure_Time,
+						      expose->Expected_Pixel_Count,expose->Current_Pixel_Count,
+						      expose->Pixel_Rate);
+#if LOGGING > 9
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Expose_Monitor(handle=%p):Next poll in %d ms (pixel rate %.3f/ms).",
+				      handle,(*poll_time),expose->Pixel_Rate);
+#endif
+	}
+	Exposure_Status_Publish_Progress(handle,expose);
+	return TRUE;
+}
+
+/**
+ * Routine to wait until the next poll of an exposure. If Exposure_Data.Readout_Progress_Wait is TRUE and the 
+ * controller is reading out, CCD_DSP_Command_Wait_Readout_Progress is used to poll the readout progress finely
+ * until the readout completes, so we wake up as soon as the last pixel arrives. The wait is limited to
+ * EXPOSURE_POLL_READOUT_TIME, so the HSTR is still checked regularly. Otherwise we sleep for poll_time.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose The address of the exposure state, or NULL to just sleep for poll_time.
+ * @param poll_time How long to wait until the next poll, in milliseconds.
+ * @return Returns TRUE on success. On failure Exposure_Expose_Fail is called and FALSE returned.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Fail
+ * @see #EXPOSURE_POLL_READOUT_TIME
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_dsp.html#CCD_DSP_Command_Wait_Readout_Progress
+ */
+static int Exposure_Expose_Poll_Wait(char *class,char *source,struct Exposure_Expose_Struct *expose,int poll_time)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+	struct timespec sleep_time;
+	int wait_pixel_count;
+
+	if(expose != NULL)
+		handle = expose->Handle;
+	if((handle != NULL)&&handle->Exposure_Data.Readout_Progress_Wait &&
+	   (handle->Exposure_Data.Exposure_Status == CCD_EXPOSURE_STATUS_READOUT))
+	{
+		if(poll_time > EXPOSURE_POLL_READOUT_TIME)
+			poll_time = EXPOSURE_POLL_READOUT_TIME;
+		if(!CCD_DSP_Command_Wait_Readout_Progress(class,source,handle,expose->Expected_Pixel_Count,
+							  poll_time,&wait_pixel_count))
+		{
+			Exposure_Error_Number = 84;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Wait Readout Progress failed.");
+			Exposure_Expose_Fail(class,source,expose);
+			return FALSE;
+		}
+	}
+	else
+	{
+		sleep_time.tv_sec = poll_time/CCD_GLOBAL_ONE_SECOND_MS;
+		sleep_time.tv_nsec = (poll_time%CCD_GLOBAL_ONE_SECOND_MS)*CCD_GLOBAL_ONE_MILLISECOND_NS;
+		nanosleep(&sleep_time,NULL);
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to process and save an exposure, once it has been read out.
+ * <ul>
+ * <li>The readout is added to the handle's metrics, if it completed.
+ * <li>Get a pointer to the read out reply data, using CCD_Interface_Get_Reply_Data.
+ * <li>If we are streaming the readout, the remaining rows are saved and the FITS file closed with
+ *     Exposure_Stream_Write_Rows and Exposure_Stream_Close, and the routine returns.
+ * <li>If we are reading out a full frame, call Exposure_Expose_Post_Readout_Full_Frame. Otherwise call
+ *     Exposure_Expose_Post_Readout_Window. These byte swap the data (if CCD_EXPOSURE_BYTE_SWAP is defined)
+ *     whilst de-interlacing it, into a frame from the image buffer pool.
+ * <li>If Exposure_Data.Async_Save is TRUE, the frame is queued for the handle's FITS writer thread and the
+ *     routine returns without waiting for it to be saved. Otherwise the images are saved before returning.
+ * </ul>
+ * The exposure status is reset to NONE.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose The address of the exposure state.
+ * @return Returns TRUE on success. On failure (including an abort) Exposure_Expose_Fail or Exposure_Expose_Error
+ * 	is called and FALSE returned.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Fail
+ * @see #Exposure_Expose_Error
+ * @see #Exposure_Stream_Write_Rows
+ * @see #Exposure_Stream_Close
+ * @see #Exposure_Expose_Post_Readout_Full_Frame
+ * @see #Exposure_Expose_Post_Readout_Window
+ * @see #Exposure_Stage_End
+ * @see ccd_interface.html#CCD_Interface_Get_Reply_Data
+ */
+static int Exposure_Expose_Post_Readout(char *class,char *source,struct Exposure_Expose_Struct *expose)
+{
+	CCD_Interface_Handle_T* handle = expose->Handle;
+
+	/* add the readout to the handle's metrics, if it completed */
+	if(CCD_DSP_Get_Abort(handle) == FALSE)
+	{
+		CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_READOUT,expose->Stage_Start_Time);
+		CCD_Global_Metrics_Counter_Add(handle,CCD_GLOBAL_METRICS_COUNTER_READOUT_BYTES,
+				       ((long long)expose->Expected_Pixel_Count)*CCD_GLOBAL_BYTES_PER_PIXEL);
+	}
+	Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_READOUT,&(expose->Stage_Start_Time));
+/* check - have we been aborted? */
+	if(CCD_DSP_Get_Abort(handle))
+	{
+		Exposure_Error_Number = 24;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Expose_Post_Readout(handle=%p):Getting reply data.",handle);
+#endif
+	/* get data */
+	if(!CCD_Interface_Get_Reply_Data(handle,&(expose->Exposure_Data)))
+	{
+		Exposure_Error_Number = 44;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Failed to get reply data.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+	Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_REPLY_DATA,&(expose->Stage_Start_Time));
+	Exposure_Status_Set(handle,CCD_EXPOSURE_STATUS_POST_READOUT);
+/* did we abort? */
+	if(CCD_DSP_Get_Abort(handle))
+	{
+		Exposure_Error_Number = 26;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* If streaming, most of the image is already on disk. Write the remaining rows and update the FITS headers. */
+	if(expose->Streaming)
+	{
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Expose_Post_Readout(handle=%p):Streaming remaining rows from row %d.",
+				      handle,expose->Stream.Row_Count);
+#endif
+		if(!Exposure_Stream_Write_Rows(class,source,&(expose->Stream),expose->Exposure_Data,
+					       expose->Expected_Pixel_Count))
+		{
+			Exposure_Expose_Fail(class,source,expose);
+			return FALSE;
+		}
+		if(!Exposure_Stream_Close(class,source,&(expose->Stream),handle->Exposure_Data.Exposure_Start_Time))
+		{
+			/* Do not call Exposure_Expose_Delete_Fits_Images here - we have saved to disk */
+			Exposure_Expose_Error(expose);
+			return FALSE;
+		}
+		Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_SAVE,&(expose->Stage_Start_Time));
+		Exposure_Status_Set(handle,CCD_EXPOSURE_STATUS_NONE);
+		return TRUE;
+	}
+/* did we abort? */
+	if(CCD_DSP_Get_Abort(handle))
+	{
+		Exposure_Error_Number = 29;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+		Exposure_Expose_Fail(class,source,expose);
+		return FALSE;
+	}
+/* post-readout processing depends on whether we are windowing or not. */
+	if(expose->Window_Flags == 0)
+	{
+		if(Exposure_Expose_Post_Readout_Full_Frame(class,source,handle,expose->Exposure_Data,
+							   expose->Filename_List[0]) == FALSE)
+		{
+			/* Do not call Exposure_Expose_Delete_Fits_Images here - we may have saved to disk */
+			Exposure_Expose_Error(expose);
+			return FALSE;
+		}
+	}
+	else
+	{
+		if(Exposure_Expose_Post_Readout_Window(class,source,handle,expose->Exposure_Data,expose->Filename_List,
+						       expose->Filename_Count) == FALSE)
+		{
+			/* Do not call Exposure_Expose_Delete_Fits_Images here - we may have saved to disk */
+			Exposure_Expose_Error(expose);
+			return FALSE;
+		}
+	}
+/* reset exposure status */
+	Exposure_Status_Set(handle,CCD_EXPOSURE_STATUS_NONE);
+	return TRUE;
+}
+
+/**
+ * Thread routine used by CCD_Exposure_Expose_Multi, to process and save one exposure once it has been
+ * read out. This calls Exposure_Expose_Post_Readout, which records any error in the exposure state.
+ * @param user_arg The address of the exposure state (a Exposure_Expose_Struct), cast to a void pointer.
+ * @return The routine returns NULL.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Expose_Post_Readout
+ * @see #CCD_Exposure_Expose_Multi
+ */
+static void *Exposure_Expose_Multi_Thread(void *user_arg)
+{
+	struct Exposure_Expose_Struct *expose = (struct Exposure_Expose_Struct *)user_arg;
+
+	Exposure_Expose_Post_Readout(expose->Class,expose->Source,expose);
+	return NULL;
+}
+
+/**
+ * Routine called when an exposure fails before anything has been saved. The streaming readout (if any) is
+ * aborted, Exposure_Expose_Delete_Fits_Images is called to delete the blank FITS files, and then
+ * Exposure_Expose_Error records the error.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param expose The address of the exposure state.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Stream_Abort
+ * @see #Exposure_Expose_Delete_Fits_Images
+ * @see #Exposure_Expose_Error
+ */
+static void Exposure_Expose_Fail(char *class,char *source,struct Exposure_Expose_Struct *expose)
+{
+	Exposure_Stream_Abort(&(expose->Stream));
+	Exposure_Expose_Delete_Fits_Images(class,source,expose->Filename_List,expose->Filename_Count);
+	Exposure_Expose_Error(expose);
+}
+
+/**
+ * Routine called when an exposure fails. The exposure is marked as not Active, its exposure status reset
+ * to NONE, and the current error (from the calling thread's Exposure_Error_Number and Exposure_Error_String)
+ * is copied into the exposure state. This allows CCD_Exposure_Expose_Multi to report the errors of
+ * exposures that failed in other threads.
+ * @param expose The address of the exposure state.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Error_Number
+ * @see #Exposure_Error_String
+ */
+static void Exposure_Expose_Error(struct Exposure_Expose_Struct *expose)
+{
+	expose->Active = FALSE;
+	if(expose->Handle != NULL)
+		Exposure_Status_Set(expose->Handle,CCD_EXPOSURE_STATUS_NONE);
+	expose->Error_Number = Exposure_Error_Number;
+	strncpy(expose->Error_String,Exposure_Error_String,CCD_GLOBAL_ERROR_STRING_LENGTH-1);
+	expose->Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH-1] = '\0';
+}
+
+/**
+ * Post-Readout operations on a full frame exposure,
+ * <ul>
+ * <li>The number of columns and rows are retrieved from setup.
+ * <li>A frame is acquired from the handle's image buffer pool (Exposure_Frame_Acquire), 
+ *     and the data is de-interlaced (and byte swapped, if CCD_EXPOSURE_BYTE_SWAP
+ *     is defined) into it in one pass using CCD_Exposure_Post_Readout_Transform. If the de-interlace type is 
+ *     single, there is no byte swapping to do and we are not saving asynchronously, 
+ *     the read out data is saved directly.
+ * <li>The data is saved to disc using Exposure_Save, or the frame is passed to Exposure_Frame_Save which 
+ *     saves it or queues it for the FITS writer thread.
+ * </ul>
+ * If an error occurs BEFORE saving the read out frame to disk, Exposure_Expose_Delete_Fits_Images is called
+ * to delete any 'blank' FITS files.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param exposure_data The data read out from the CCD.
+ * @param filename The FITS filename (which should already contain relevant headers), in which to write 
+ *        the image data.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #Exposure_Frame_Acquire
+ * @see #Exposure_Frame_Release
+ * @see #Exposure_Frame_Save
+ * @see #CCD_Exposure_Post_Readout_Transform
+ * @see #EXPOSURE_BYTE_SWAP
+ * @see #Exposure_Save
+ * @see #Exposure_Expose_Delete_Fits_Images
+ * @see ccd_setup.html#CCD_Setup_Get_NCols
+ * @see ccd_setup.html#CCD_Setup_Get_NRows
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Expose_Post_Readout_Full_Frame(char *class,char *source,CCD_Interface_Handle_T* handle,
+						   unsigned short *exposure_data,char *filename)
+{
+	struct CCD_Exposure_Frame_Struct *frame = NULL;
+	struct timespec stage_start_time;
+	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
+	unsigned short *image_data = NULL;
+	char *filename_list[1];
+	int ncols,nrows,frame_index,retval;
+
+/* get setup details */
+	ncols = CCD_Setup_Get_NCols(handle);
+	nrows = CCD_Setup_Get_NRows(handle);
+	deinterlace_type = CCD_Setup_Get_DeInterlace_Type(handle);
+/* number of columns must be a positive number */
+	if(ncols <= 0)
+	{
+		filename_list[0] = filename;
+		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
+		Exposure_Error_Number = 27;
+		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:Illegal ncols '%d'.",ncols);
+		return FALSE;
+	}
+/* number of rows must be a positive number */
+	if(nrows <= 0)
+	{
+		filename_list[0] = filename;
+		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
+		Exposure_Error_Number = 31;
+		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:Illegal nrows '%d'.",nrows);
+		return FALSE;
+	}
+	if(!CCD_DSP_IS_DEINTERLACE_TYPE(deinterlace_type))
+	{
+		filename_list[0] = filename;
+		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
+		Exposure_Error_Number = 36;
+		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:"
+			"Illegal deinterlace type '%d'.",deinterlace_type);
+		return FALSE;
+	}
+/* Do deinterlacing. The image returned from the boards may not be in the correct order
+** if the CCD was readout from multiple places etc. The deinterlace routine reorders the image
+** so that it is back in the right order. When saving asynchronously we always copy the data into a frame,
+** as the read out data buffer is overwritten by the next exposure. */
+	frame_index = -1;
+	if((deinterlace_type == CCD_DSP_DEINTERLACE_SINGLE)&&(EXPOSURE_BYTE_SWAP == FALSE)&&
+	   (handle->Exposure_Data.Async_Save == FALSE))
+		image_data = exposure_data;
+	else
+	{
+		if(strlen(filename) >= CCD_EXPOSURE_STRING_LENGTH)
+		{
+			filename_list[0] = filename;
+			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
+			Exposure_Error_Number = 96;
+			sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:"
+				"Filename too long (%lu).",(unsigned long)strlen(filename));
+			return FALSE;
+		}
+		/* get a frame from the image buffer pool. This should already have been allocated by
+		** CCD_Setup_Dimensions, in which case no memory is allocated here. */
+		if(!Exposure_Frame_Acquire(class,source,handle,&frame_index))
+		{
+			filename_list[0] = filename;
+			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
+			return FALSE;
+		}
+		frame = &(handle->Exposure_Data.Frame_List[frame_index]);
+		image_data = frame->Image_Buffer_List[0];
+#if LOGGING > 4
+		CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			       "Exposure_Expose_Post_Readout_Full_Frame:De-Interlacing.");
+#endif
+		Exposure_Stage_Start(&stage_start_time);
+		if(!CCD_Exposure_Post_Readout_Transform(class,source,handle,exposure_data,&image_data,1))
+		{
+			Exposure_Frame_Release(handle,frame_index);
+			filename_list[0] = filename;
+			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
+			return FALSE;
+		}
+		Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_POST_READOUT,&stage_start_time);
+	}
+/* if we have aborted stop and return */
+	if(CCD_DSP_Get_Abort(handle))
+	{
+		if(frame_index >= 0)
+			Exposure_Frame_Release(handle,frame_index);
+		filename_list[0] = filename;
+		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,1);
+		Exposure_Error_Number = 45;
+		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Full_Frame:Aborted.");
+		return FALSE;
+	}
+/* save the resultant image to disk, or queue it for the FITS writer thread */
+	if(frame_index >= 0)
+	{
+		frame->Image_Count = 1;
+		strcpy(frame->Filename_List[0],filename);
+		frame->NCols_List[0] = ncols;
+		frame->NRows_List[0] = nrows;
+		frame->Exposure_Start_Time = handle->Exposure_Data.Exposure_Start_Time;
+		/* Exposure_Frame_Save can fail but still have saved the exposure_data to disk OK */
+		Exposure_Stage_Start(&stage_start_time);
+		retval = Exposure_Frame_Save(class,source,handle,frame_index);
+		Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_SAVE,&stage_start_time);
+		return retval;
+	}
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Expose_Post_Readout_Full_Frame:"
+			      "Saving to filename %s.",filename);
+#endif
+	Exposure_Stage_Start(&stage_start_time);
+	if(!Exposure_Save(class,source,filename,image_data,ncols,nrows,handle->Exposure_Data.Exposure_Start_Time))
+	{
+		/* Exposure_Save can fail but still have saved the exposure_data to disk OK */
+		return FALSE;
+	}
+	CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_SAVE,stage_start_time);
+	Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_SAVE,&stage_start_time);
+	return TRUE; 
+}
+
+/**
+ * Post-Readout operations on a windowed exposure.
+ * <ul>
+ * <li>We get necessary setup data (window flags and deinterlace type).
+ * <li>If the de-interlace type is single, there is no byte swapping to do and we are not saving asynchronously,
+ *     each window is already in the right order in the read out data, and is saved directly from there.
+ *     Otherwise we acquire a frame from the handle's image buffer pool (Exposure_Frame_Acquire). The pool is 
+ *     normally allocated by CCD_Setup_Dimensions, in which case no memory is allocated here.
+ * <li>We go though the list of windows, looking for active windows.
+ * <li>We retrieve setup data for active windows (width,height and pixel_count), and use the frame's buffer 
+ *     with the same index as the window's filename as it's subimage.
+ * <li>Each active window is processed in parallel by Exposure_Window_Process, the first in this thread
+ *     and the rest in their own thread (Exposure_Window_Thread). This byte swaps (if required) and
+ *     de-interlaces the window straight from the read out data into it's subimage, checks whether we
+ *     should be aborting, and (if we are not saving asynchronously) saves the subimage to the relevant filename.
+ *     If any window fails or the exposure is aborted, the other windows stop as soon as they can.
+ * <li>If we are saving asynchronously, the frame is queued for the FITS writer thread using Exposure_Frame_Save.
+ * </ul>
+ * The frame is returned to the pool once the sub-images are saved. If the processing fails, the FITS files
+ * of windows we had not started to save are deleted. The POST_READOUT stage time is the longest time any
+ * window took to de-interlace, the SAVE stage time the rest of the processing.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param exposure_data The data read out from the CCD.
+ * @param filename_list The list of FITS filenames (which should already contain relevant headers), in which to write 
+ *        the image data. Each window of data is saved in a separate file.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #Exposure_Window_Struct
+ * @see #Exposure_Window_Process
+ * @see #Exposure_Window_Thread
+ * @see #Exposure_Frame_Acquire
+ * @see #Exposure_Frame_Release
+ * @see #Exposure_Frame_Save
+ * @see #EXPOSURE_BYTE_SWAP
+ * @see ccd_setup.html#CCD_SETUP_WINDOW_COUNT
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Flags
+ * @see ccd_setup.html#CCD_Setup_Get_DeInterlace_Type
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Width
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Height
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Pixel_Count
+ * @see ccd_global.html#CCD_GLOBAL_BYTES_PER_PIXEL
+ * @see ccd_dsp.html#CCD_DSP_IS_DEINTERLACE_TYPE
+ * @see ccd_dsp.html#CCD_DSP_Get_Abort
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Expose_Post_Readout_Window(char *class,char *source,CCD_Interface_Handle_T* handle,
+					       unsigned short *exposure_data,char **filename_list,int filename_count)
+{
+	struct Exposure_Window_Struct window_list[CCD_SETUP_WINDOW_COUNT];
+	pthread_t thread_list[CCD_SETUP_WINDOW_COUNT];
+	int thread_created_list[CCD_SETUP_WINDOW_COUNT];
+	struct CCD_Exposure_Frame_Struct *frame = NULL;
+	struct timespec stage_start_time,stage_end_time;
+	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
+	double transform_time,total_time;
+	int window_number,window_flags,window_count,frame_index,exposure_data_index;
+	int pixel_count,view,stop,fail_index,i;
+
+	/* get setup data */
+	window_flags = CCD_Setup_Get_Window_Flags(handle);
+	deinterlace_type = CCD_Setup_Get_DeInterlace_Type(handle);
+	if(!CCD_DSP_IS_DEINTERLACE_TYPE(deinterlace_type))
+	{
+		Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
+		Exposure_Error_Number = 10;
+		sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:"
+			"Illegal deinterlace type '%d'.",deinterlace_type);
+		return FALSE;
+	}
+	/* If the windows are already in the right order, save them straight from the read out data.
+	** When saving asynchronously we always copy the data into a frame,
+	** as the read out data buffer is overwritten by the next exposure. */
+	view = ((deinterlace_type == CCD_DSP_DEINTERLACE_SINGLE)&&(EXPOSURE_BYTE_SWAP == FALSE)&&
+		(handle->Exposure_Data.Async_Save == FALSE));
+	frame_index = -1;
+	if(view == FALSE)
+	{
+		/* get a frame from the image buffer pool, sized for the current windows. */
+		if(!Exposure_Frame_Acquire(class,source,handle,&frame_index))
+		{
+			Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
+			return FALSE;
+		}
+		frame = &(handle->Exposure_Data.Frame_List[frame_index]);
+	}
+	/* go through list of windows, setting up the processing of each active window */
+	stop = FALSE;
+	window_count = 0;
+	exposure_data_index = 0;
+	for(window_number = 0;window_number < CCD_SETUP_WINDOW_COUNT; window_number++)
+	{
+		/* look for windows that have been read out (are in use). */
+		/* Note, relies on CCD_SETUP_WINDOW_ONE == (1<<0),
+		** CCD_SETUP_WINDOW_TWO	== (1<<1),
+		** CCD_SETUP_WINDOW_THREE == (1<<2) and
+		** CCD_SETUP_WINDOW_FOUR == (1<<3) */
+		if(window_flags&(1<<window_number))
+		{
+			if(window_count >= filename_count)
+			{
+				if(frame_index >= 0)
+					Exposure_Frame_Release(handle,frame_index);
+				Exposure_Error_Number = 16;
+				sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:"
+					"Filename index %d greater than count %d.",window_count,filename_count);
+				return FALSE;
+			}
+			window_list[window_count].Class = class;
+			window_list[window_count].Source = source;
+			window_list[window_count].Handle = handle;
+			window_list[window_count].Window_Number = window_number;
+			window_list[window_count].Filename = filename_list[window_count];
+			window_list[window_count].NCols = CCD_Setup_Get_Window_Width(handle,window_number);
+			window_list[window_count].NRows = CCD_Setup_Get_Window_Height(handle,window_number);
+			window_list[window_count].Raw_Data = exposure_data+exposure_data_index;
+			window_list[window_count].DeInterlace_Type = deinterlace_type;
+			window_list[window_count].Save = (handle->Exposure_Data.Async_Save == FALSE);
+			window_list[window_count].Exposure_Start_Time = handle->Exposure_Data.Exposure_Start_Time;
+			window_list[window_count].Stop = &stop;
+			window_list[window_count].Transform_Time = 0.0;
+			window_list[window_count].Save_Started = FALSE;
+			window_list[window_count].Successful = FALSE;
+			window_list[window_count].Error_Number = 0;
+			window_list[window_count].Error_String[0] = '\0';
+			pixel_count = CCD_Setup_Get_Window_Pixel_Count(handle,window_number);
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+					      "Exposure_Expose_Post_Readout_Window:"
+			      "Window %d(%s) active:ncols = %d,nrows = %d,pixel_count = %d.",
+					      window_number,filename_list[window_count],
+					      window_list[window_count].NCols,window_list[window_count].NRows,
+					      pixel_count);
+#endif
+			if(view)
+				window_list[window_count].Image_Data = window_list[window_count].Raw_Data;
+			else
+			{
+				if(strlen(filename_list[window_count]) >= CCD_EXPOSURE_STRING_LENGTH)
+				{
+					Exposure_Frame_Release(handle,frame_index);
+					Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
+					Exposure_Error_Number = 96;
+					sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:"
+						"Filename %d too long (%lu).",window_count,
+						(unsigned long)strlen(filename_list[window_count]));
+					return FALSE;
+				}
+				strcpy(frame->Filename_List[window_count],filename_list[window_count]);
+				frame->NCols_List[window_count] = window_list[window_count].NCols;
+				frame->NRows_List[window_count] = window_list[window_count].NRows;
+				window_list[window_count].Image_Data = frame->Image_Buffer_List[window_count];
+				if((window_list[window_count].Image_Data == NULL)||
+				   (frame->Image_Buffer_Size_List[window_count] < pixel_count))
+				{
+					Exposure_Frame_Release(handle,frame_index);
+					Exposure_Expose_Delete_Fits_Images(class,source,filename_list,filename_count);
+					Exposure_Error_Number = 18;
+					sprintf(Exposure_Error_String,"Exposure_Expose_Post_Readout_Window:"
+						"SubImage Data was NULL or too small (%d,%d).",window_number,pixel_count);
+					return FALSE;
+				}
+			}
+			/* increment index into exposure data to start of next window. */
+			exposure_data_index += pixel_count;
+			/* increment index iff this window is active - only active window filenames in filename_list */
+			window_count++;
+		}
+	}
+	/* process every window in parallel. The first window is processed in this thread. If a thread
+	** cannot be created for a window, it is processed in this thread afterwards. */
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Expose_Post_Readout_Window:"
+			      "Processing %d windows (view = %d).",window_count,view);
+#endif
+	Exposure_Stage_Start(&stage_start_time);
+	for(i=1;i<window_count;i++)
+	{
+		thread_created_list[i] = (pthread_create(&(thread_list[i]),NULL,Exposure_Window_Thread,
+							 (void *)&(window_list[i])) == 0);
+	}
+	if(window_count > 0)
+		Exposure_Window_Process(&(window_list[0]));
+	for(i=1;i<window_count;i++)
+	{
+		if(thread_created_list[i] == FALSE)
+			Exposure_Window_Process(&(window_list[i]));
+	}
+	for(i=1;i<window_count;i++)
+	{
+		if(thread_created_list[i])
+			pthread_join(thread_list[i],NULL);
+	}
+	Exposure_Stage_Start(&stage_end_time);
+	/* combine the results */
+	fail_index = -1;
+	transform_time = 0.0;
+	for(i=0;i<window_count;i++)
+	{
+		if(window_list[i].Transform_Time > transform_time)
+			transform_time = window_list[i].Transform_Time;
+		/* report the first window that failed, rather than one that stopped because of it */
+		if(window_list[i].Successful == FALSE)
+		{
+			if((fail_index < 0)||(window_list[fail_index].Error_Number == 115))
+				fail_index = i;
+		}
+	}
+	/* the windows are de-interlaced and saved at the same time, so the POST_READOUT stage is the longest
+	** de-interlace, and the SAVE stage the rest. */
+	total_time = Exposure_TimeSpec_Diff_Ms(stage_start_time,stage_end_time);
+	handle->Exposure_Data.Stage_Time_List[CCD_EXPOSURE_STAGE_POST_READOUT] = transform_time;
+	if(fail_index >= 0)
+	{
+		Exposure_Error_Number = window_list[fail_index].Error_Number;
+		strcpy(Exposure_Error_String,window_list[fail_index].Error_String);
+		if(frame_index >= 0)
+			Exposure_Frame_Release(handle,frame_index);
+		/* Do not delete FITS images we have started to save - Exposure_Save can fail but still
+		** have saved the exposure_data to disk OK */
+		for(i=0;i<window_count;i++)
+		{
+			if(window_list[i].Save_Started == FALSE)
+				Exposure_Expose_Delete_Fits_Images(class,source,&(window_list[i].Filename),1);
+		}
+		return FALSE;
+	}
+	if(handle->Exposure_Data.Async_Save == FALSE)
+	{
+		if(frame_index >= 0)
+			Exposure_Frame_Release(handle,frame_index);
+		handle->Exposure_Data.Stage_Time_List[CCD_EXPOSURE_STAGE_SAVE] = total_time-transform_time;
+		return TRUE;
+	}
+/* queue the resultant images for the FITS writer thread */
+	frame->Image_Count = window_count;
+	frame->Exposure_Start_Time = handle->Exposure_Data.Exposure_Start_Time;
+	stage_start_time = stage_end_time;
+	if(!Exposure_Frame_Save(class,source,handle,frame_index))
+		return FALSE;
+	Exposure_Stage_End(handle,CCD_EXPOSURE_STAGE_SAVE,&stage_start_time);
+	return TRUE;
+}
+
+/**
+ * Thread routine used by Exposure_Expose_Post_Readout_Window, to process one window of a windowed exposure
+ * in parallel with the others. This calls Exposure_Window_Process, which records any error in the window.
+ * @param user_arg The address of the window (a Exposure_Window_Struct), cast to a void pointer.
+ * @return The routine returns NULL.
+ * @see #Exposure_Window_Struct
+ * @see #Exposure_Window_Process
+ * @see #Exposure_Expose_Post_Readout_Window
+ */
+static void *Exposure_Window_Thread(void *user_arg)
+{
+	Exposure_Window_Process((struct Exposure_Window_Struct *)user_arg);
+	return NULL;
+}
+
+/**
+ * Routine to process one window of a windowed exposure.
+ * <ul>
+ * <li>We check whether the exposure has been aborted, or another window has failed.
+ * <li>Unless the window is saved directly from the read out data, we call CCD_Exposure_DeInterlace to byte swap
+ *     (if required) and de-interlace the window from the read out data into it's subimage. The time this takes
+ *     is added to the handle's DEINTERLACE metrics timer.
+ * <li>We check whether the exposure has been aborted, or another window has failed.
+ * <li>If the window's Save field is TRUE, we call Exposure_Save to save the subimage to the window's filename.
+ *     The time this takes is added to the handle's SAVE metrics timer.
+ * </ul>
+ * If the routine fails, the error is recorded in the window using Exposure_Window_Error, which also tells the
+ * other windows to stop.
+ * @param window The address of the window to process.
+ * @see #Exposure_Window_Struct
+ * @see #Exposure_Window_Error
+ * @see #CCD_Exposure_DeInterlace
+ * @see #Exposure_Save
+ * @see #EXPOSURE_BYTE_SWAP
+ * @see ccd_dsp.html#CCD_DSP_Get_Abort
+ * @see ccd_global.html#CCD_Global_Metrics_Timer_Add
+ */
+static void Exposure_Window_Process(struct Exposure_Window_Struct *window)
+{
+	struct timespec start_time,end_time;
+
+	if(__sync_fetch_and_add(window->Stop,0))
+	{
+		Exposure_Error_Number = 115;
+		sprintf(Exposure_Error_String,"Exposure_Window_Process:Window %d stopped as another window failed.",
+			window->Window_Number);
+		Exposure_Window_Error(window);
+		return;
+	}
+	if(window->Image_Data != window->Raw_Data)
+	{
+		CCD_Global_Metrics_Get_Time(&start_time);
+		if(!CCD_Exposure_DeInterlace(window->Class,window->Source,window->NCols,window->NRows,
+					     window->Raw_Data,window->Image_Data,window->DeInterlace_Type,
+					     EXPOSURE_BYTE_SWAP))
+		{
+			Exposure_Window_Error(window);
+			return;
+		}
+		CCD_Global_Metrics_Timer_Add(window->Handle,CCD_GLOBAL_METRICS_TIMER_DEINTERLACE,start_time);
+		CCD_Global_Metrics_Get_Time(&end_time);
+		window->Transform_Time = Exposure_TimeSpec_Diff_Ms(start_time,end_time);
+	}
+/* if we have aborted stop and return */
+	if(CCD_DSP_Get_Abort(window->Handle))
+	{
+		Exposure_Error_Number = 19;
+		sprintf(Exposure_Error_String,"Exposure_Window_Process:Aborted.");
+		Exposure_Window_Error(window);
+		return;
+	}
+	if(__sync_fetch_and_add(window->Stop,0))
+	{
+		Exposure_Error_Number = 115;
+		sprintf(Exposure_Error_String,"Exposure_Window_Process:Window %d stopped as another window failed.",
+			window->Window_Number);
+		Exposure_Window_Error(window);
+		return;
+	}
+	if(window->Save)
+	{
+#if LOGGING > 4
+		CCD_Global_Log_Format(window->Class,window->Source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Window_Process:Saving window %d to filename %s.",
+				      window->Window_Number,window->Filename);
+#endif
+		window->Save_Started = TRUE;
+		CCD_Global_Metrics_Get_Time(&start_time);
+		if(!Exposure_Save(window->Class,window->Source,window->Filename,window->Image_Data,window->NCols,
+				  window->NRows,window->Exposure_Start_Time))
+		{
+			Exposure_Window_Error(window);
+			return;
+		}
+		CCD_Global_Metrics_Timer_Add(window->Handle,CCD_GLOBAL_METRICS_TIMER_SAVE,start_time);
+	}
+	window->Successful = TRUE;
+}
+
+/**
+ * Routine called when the processing of a window fails. The current error (from the calling thread's
+ * Exposure_Error_Number and Exposure_Error_String) is copied into the window, and the window's Stop flag is
+ * set so the other windows of the exposure stop as soon as possible.
+ * @param window The address of the window that failed.
+ * @see #Exposure_Window_Struct
+ * @see #Exposure_Error_Number
+ * @see #Exposure_Error_String
+ */
+static void Exposure_Window_Error(struct Exposure_Window_Struct *window)
+{
+	window->Successful = FALSE;
+	window->Error_Number = Exposure_Error_Number;
+	strncpy(window->Error_String,Exposure_Error_String,CCD_GLOBAL_ERROR_STRING_LENGTH-1);
+	window->Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH-1] = '\0';
+	__sync_lock_test_and_set(window->Stop,TRUE);
+}
+
+/**
+ * Routine to make sure the buffers of a frame in the image buffer pool are big enough for the current setup.
+ * For a full frame readout one buffer of ncols*nrows pixels is needed (unless the de-interlace type is single, 
+ * there is no byte swapping and we are not saving asynchronously, when the read out data is saved directly).
+ * For a windowed readout one buffer of the window's pixel count is needed for each active window (with the
+ * same exception, as the windows are then saved directly from the read out data).
+ * Existing buffers that are big enough are kept, so a buffer is only reallocated when the setup grows.
+ * New buffers are locked into physical memory using CCD_Global_Memory_Lock.
+ * The frame must not be in use by the FITS writer thread.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param frame_index The index in the pool (Frame_List) of the frame to allocate.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #EXPOSURE_BYTE_SWAP
+ * @see ccd_exposure_private.html#CCD_Exposure_Frame_Struct
+ * @see ccd_global.html#CCD_Global_Memory_Lock
+ * @see ccd_global.html#CCD_Global_Memory_UnLock
+ * @see ccd_setup.html#CCD_Setup_Get_NCols
+ * @see ccd_setup.html#CCD_Setup_Get_NRows
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Flags
+ * @see ccd_setup.html#CCD_Setup_Get_DeInterlace_Type
+ * @see ccd_setup.html#CCD_Setup_Get_Window_Pixel_Count
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Frame_Allocate(char *class,char *source,CCD_Interface_Handle_T* handle,int frame_index)
+{
+	struct CCD_Exposure_Frame_Struct *frame = NULL;
+	int size_list[CCD_SETUP_WINDOW_COUNT];
+	int window_number,window_flags,buffer_count,i;
+
+	frame = &(handle->Exposure_Data.Frame_List[frame_index]);
+	/* work out how big each buffer needs to be */
+	buffer_count = 0;
+	window_flags = CCD_Setup_Get_Window_Flags(handle);
+	if(window_flags == 0)
+	{
+		if((CCD_Setup_Get_DeInterlace_Type(handle) != CCD_DSP_DEINTERLACE_SINGLE)||EXPOSURE_BYTE_SWAP||
+		   handle->Exposure_Data.Async_Save)
+		{
+			size_list[0] = CCD_Setup_Get_NCols(handle)*CCD_Setup_Get_NRows(handle);
+			buffer_count = 1;
+		}
+	}
+	else if((CCD_Setup_Get_DeInterlace_Type(handle) != CCD_DSP_DEINTERLACE_SINGLE)||EXPOSURE_BYTE_SWAP||
+		handle->Exposure_Data.Async_Save)
+	{
+		for(window_number = 0;window_number < CCD_SETUP_WINDOW_COUNT; window_number++)
+		{
+			/* Note, relies on CCD_SETUP_WINDOW_ONE == (1<<0) etc. */
+			if(window_flags&(1<<window_number))
+			{
+				size_list[buffer_count] = CCD_Setup_Get_Window_Pixel_Count(handle,window_number);
+				buffer_count++;
+			}
+		}
+	}
+	/* allocate any buffers that are not big enough */
+	for(i=0;i<buffer_count;i++)
+	{
+		if(size_list[i] <= 0)
+		{
+			Exposure_Error_Number = 92;
+			sprintf(Exposure_Error_String,"Exposure_Frame_Allocate:Illegal buffer size %d (%d,%d).",
+				size_list[i],frame_index,i);
+			return FALSE;
+		}
+		if(frame->Image_Buffer_Size_List[i] >= size_list[i])
+			continue;
+		if(frame->Image_Buffer_List[i] != NULL)
+		{
+			CCD_Global_Memory_UnLock(class,source,frame->Image_Buffer_List[i],
+						 frame->Image_Buffer_Size_List[i]*CCD_GLOBAL_BYTES_PER_PIXEL);
+			free(frame->Image_Buffer_List[i]);
+			frame->Image_Buffer_List[i] = NULL;
+			frame->Image_Buffer_Size_List[i] = 0;
+		}
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Frame_Allocate(handle=%p):Allocating frame %d buffer %d of %d pixels.",
+				      handle,frame_index,i,size_list[i]);
+#endif
+		frame->Image_Buffer_List[i] = (unsigned short*)malloc(size_list[i]*CCD_GLOBAL_BYTES_PER_PIXEL);
+		if(frame->Image_Buffer_List[i] == NULL)
+		{
+			Exposure_Error_Number = 93;
+			sprintf(Exposure_Error_String,"Exposure_Frame_Allocate:"
+				"Failed to allocate frame %d buffer %d of %d pixels.",frame_index,i,size_list[i]);
+			return FALSE;
+		}
+		if(!CCD_Global_Memory_Lock(class,source,frame->Image_Buffer_List[i],
+					   size_list[i]*CCD_GLOBAL_BYTES_PER_PIXEL))
+		{
+			free(frame->Image_Buffer_List[i]);
+			frame->Image_Buffer_List[i] = NULL;
+			return FALSE;
+		}
+		frame->Image_Buffer_Size_List[i] = size_list[i];
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to acquire a free frame from the image buffer pool, for post-readout processing to write into.
+ * Only the first frame is used when saving synchronously. If all the frames are in use (waiting for
+ * the FITS writer thread to save them), we wait (in chunks of EXPOSURE_WRITER_WAIT_TIME milliseconds,
+ * so we can check whether the exposure has been aborted) until one is saved.
+ * The acquired frame is resized for the current setup using Exposure_Frame_Allocate.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param frame_index The address of an integer, on a successful return this contains the index in the pool
+ *        (Frame_List) of the acquired frame. The frame should be passed to Exposure_Frame_Save or 
+ *        Exposure_Frame_Release when finished with.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails or is aborted.
+ * @see #EXPOSURE_WRITER_WAIT_TIME
+ * @see #Exposure_Frame_Allocate
+ * @see #Exposure_Frame_Release
+ * @see #Exposure_Frame_Save
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_dsp.html#CCD_DSP_Get_Abort
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Frame_Acquire(char *class,char *source,CCD_Interface_Handle_T* handle,int *frame_index)
+{
+	struct timespec wait_time;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+	int frame_count,i;
+
+	if(handle->Exposure_Data.Async_Save)
+		frame_count = CCD_EXPOSURE_FRAME_COUNT;
+	else
+		frame_count = 1;
+	pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+	(*frame_index) = -1;
+	while((*frame_index) < 0)
+	{
+		for(i=0;i<frame_count;i++)
+		{
+			if(handle->Exposure_Data.Frame_List[i].In_Use == FALSE)
+			{
+				(*frame_index) = i;
+				break;
+			}
+		}
+		if((*frame_index) < 0)
+		{
+			if(CCD_DSP_Get_Abort(handle))
+			{
+				pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+				Exposure_Error_Number = 95;
+				sprintf(Exposure_Error_String,"Exposure_Frame_Acquire:"
+					"Aborted whilst waiting for a free frame.");
+				return FALSE;
+			}
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+					      "Exposure_Frame_Acquire(handle=%p):Waiting for one of %d frames to be saved.",
+					      handle,handle->Exposure_Data.Writer_Pending_Count);
+#endif
+			/* back-pressure - wait for the FITS writer thread to save a frame */
+#ifdef _POSIX_TIMERS
+			clock_gettime(CLOCK_REALTIME,&wait_time);
+#else
+			gettimeofday(&gtod_current_time,NULL);
+			wait_time.tv_sec = gtod_current_time.tv_sec;
+			wait_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
+#endif
+			wait_time.tv_nsec += EXPOSURE_WRITER_WAIT_TIME*CCD_GLOBAL_ONE_MILLISECOND_NS;
+			if(wait_time.tv_nsec >= CCD_GLOBBAL_ONE_SECOND_NS)
+			{
+				wait_time.tv_sec++;
+				wait_time.tv_nsec -= CCD_GLOBBAL_ONE_SECOND_NS;
+			}
+			pthread_cond_timedwait(&(handle->Exposure_Data.Writer_Condition),
+					       &(handle->Exposure_Data.Writer_Mutex),&wait_time);
+		}
+	}
+	handle->Exposure_Data.Frame_List[(*frame_index)].In_Use = TRUE;
+	pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+	/* make sure the frame is big enough for the current setup */
+	if(!Exposure_Frame_Allocate(class,source,handle,(*frame_index)))
+	{
+		Exposure_Frame_Release(handle,(*frame_index));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to release a frame acquired with Exposure_Frame_Acquire back to the image buffer pool, without 
+ * saving it.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param frame_index The index in the pool (Frame_List) of the frame to release.
+ * @see #Exposure_Frame_Acquire
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void Exposure_Frame_Release(CCD_Interface_Handle_T* handle,int frame_index)
+{
+	pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+	handle->Exposure_Data.Frame_List[frame_index].In_Use = FALSE;
+	pthread_cond_broadcast(&(handle->Exposure_Data.Writer_Condition));
+	pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+}
+
+/**
+ * Routine to save the images in an acquired frame, whose Image_Count, Filename_List, NCols_List, NRows_List
+ * and Exposure_Start_Time have been filled in. If Async_Save is TRUE, the frame is added to the FITS writer
+ * thread's queue (starting the thread if necessary) and the routine returns straight away. Otherwise the images
+ * are saved using Exposure_Save and the frame released. The time each image takes to save is added to
+ * the handle's SAVE metrics timer.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param frame_index The index in the pool (Frame_List) of the frame to save.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #Exposure_Frame_Acquire
+ * @see #Exposure_Frame_Release
+ * @see #Exposure_Writer_Start
+ * @see #Exposure_Save
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Frame_Save(char *class,char *source,CCD_Interface_Handle_T* handle,int frame_index)
+{
+	struct CCD_Exposure_Frame_Struct *frame = NULL;
+	struct timespec save_start_time;
+	int i,queue_index;
+
+	frame = &(handle->Exposure_Data.Frame_List[frame_index]);
+	if(handle->Exposure_Data.Async_Save)
+	{
+		if(!Exposure_Writer_Start(class,source,handle))
+		{
+			Exposure_Frame_Release(handle,frame_index);
+			return FALSE;
+		}
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Frame_Save:"
+				      "Queueing frame %d (%s) for the FITS writer thread.",frame_index,
+				      frame->Filename_List[0]);
+#endif
+		pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+		queue_index = (handle->Exposure_Data.Writer_Queue_Head+handle->Exposure_Data.Writer_Queue_Count)%
+			CCD_EXPOSURE_FRAME_COUNT;
+		handle->Exposure_Data.Writer_Queue[queue_index] = frame_index;
+		handle->Exposure_Data.Writer_Queue_Count++;
+		handle->Exposure_Data.Writer_Pending_Count++;
+		pthread_cond_broadcast(&(handle->Exposure_Data.Writer_Condition));
+		pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+		return TRUE;
+	}
+	for(i=0;i<frame->Image_Count;i++)
+	{
+#if LOGGING > 4
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Frame_Save:"
+				      "Saving to filename %s.",frame->Filename_List[i]);
+#endif
+		CCD_Global_Metrics_Get_Time(&save_start_time);
+		if(!Exposure_Save(class,source,frame->Filename_List[i],frame->Image_Buffer_List[i],
+				  frame->NCols_List[i],frame->NRows_List[i],frame->Exposure_Start_Time))
+		{
+			/* Exposure_Save can fail but still have saved the exposure_data to disk OK */
+			Exposure_Frame_Release(handle,frame_index);
+			return FALSE;
+		}
+		CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_SAVE,save_start_time);
+	}
+	Exposure_Frame_Release(handle,frame_index);
+	return TRUE;
+}
+
+/**
+ * Routine to start the handle's FITS writer thread, if it is not already running. The class and source
+ * are copied, for the thread to log with.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #Exposure_Writer_Thread
+ * @see #Exposure_Writer_Stop
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Writer_Start(char *class,char *source,CCD_Interface_Handle_T* handle)
+{
+	int retval;
+
+	if(handle->Exposure_Data.Writer_Running)
+		return TRUE;
+	if(class != NULL)
+		strncpy(handle->Exposure_Data.Writer_Class,class,CCD_EXPOSURE_STRING_LENGTH-1);
+	else
+		strcpy(handle->Exposure_Data.Writer_Class,"-");
+	handle->Exposure_Data.Writer_Class[CCD_EXPOSURE_STRING_LENGTH-1] = '\0';
+	if(source != NULL)
+		strncpy(handle->Exposure_Data.Writer_Source,source,CCD_EXPOSURE_STRING_LENGTH-1);
+	else
+		strcpy(handle->Exposure_Data.Writer_Source,"-");
+	handle->Exposure_Data.Writer_Source[CCD_EXPOSURE_STRING_LENGTH-1] = '\0';
+	handle->Exposure_Data.Writer_Quit = FALSE;
+	retval = pthread_create(&(handle->Exposure_Data.Writer_Thread),NULL,Exposure_Writer_Thread,(void*)handle);
+	if(retval != 0)
+	{
+		Exposure_Error_Number = 97;
+		sprintf(Exposure_Error_String,"Exposure_Writer_Start:Failed to create FITS writer thread (%d).",
+			retval);
+		return FALSE;
+	}
+	handle->Exposure_Data.Writer_Running = TRUE;
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Writer_Start(handle=%p):FITS writer thread started.",handle);
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to stop the handle's FITS writer thread, if it is running. The thread saves any frames still
+ * queued before exiting, and this routine waits for it to do so.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #Exposure_Writer_Thread
+ * @see #Exposure_Writer_Start
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Writer_Stop(char *class,char *source,CCD_Interface_Handle_T* handle)
+{
+	int retval;
+
+	if(handle->Exposure_Data.Writer_Running == FALSE)
+		return TRUE;
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+			      "Exposure_Writer_Stop(handle=%p):Stopping FITS writer thread.",handle);
+#endif
+	pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+	handle->Exposure_Data.Writer_Quit = TRUE;
+	pthread_cond_broadcast(&(handle->Exposure_Data.Writer_Condition));
+	pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+	retval = pthread_join(handle->Exposure_Data.Writer_Thread,NULL);
+	handle->Exposure_Data.Writer_Running = FALSE;
+	handle->Exposure_Data.Writer_Quit = FALSE;
+	if(retval != 0)
+	{
+		Exposure_Error_Number = 99;
+		sprintf(Exposure_Error_String,"Exposure_Writer_Stop:Failed to join FITS writer thread (%d).",retval);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * The FITS writer thread. One is started per handle (i.e. per arm), the first time a frame is saved 
+ * asynchronously. It waits for frames to be queued by Exposure_Frame_Save, and saves each image in them
+ * using Exposure_Save, in the order they were queued. The save callback (if any) is called after each
+ * image, and the frame released back to the pool after all it's images have been saved. 
+ * The thread exits when Writer_Quit is set and the queue is empty.
+ * The time each image takes to save is added to the handle's SAVE metrics timer.
+ * As the error state is thread local, a failed save is reported through the save callback and
+ * CCD_Exposure_Save_Wait, and does not overwrite the error state of the thread driving the exposures.
+ * @param user_arg The address of the CCD_Interface_Handle_T the thread saves frames for.
+ * @return The routine returns NULL.
+ * @see #Exposure_Frame_Save
+ * @see #Exposure_Save
+ * @see #CCD_Exposure_Set_Save_Callback
+ * @see #CCD_Exposure_Error_String
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void *Exposure_Writer_Thread(void *user_arg)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+	struct CCD_Exposure_Frame_Struct *frame = NULL;
+	void (*callback)(CCD_Interface_Handle_T* handle,char *filename,int successful,char *error_string) = NULL;
+	char error_string[CCD_GLOBAL_ERROR_STRING_LENGTH+64];
+	char *class = NULL;
+	char *source = NULL;
+	struct timespec save_start_time;
+	int frame_index,failed_count,successful,i;
+
+	handle = (CCD_Interface_Handle_T*)user_arg;
+	class = handle->Exposure_Data.Writer_Class;
+	source = handle->Exposure_Data.Writer_Source;
+	pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+	while(TRUE)
+	{
+		while((handle->Exposure_Data.Writer_Queue_Count == 0)&&(handle->Exposure_Data.Writer_Quit == FALSE))
+		{
+			pthread_cond_wait(&(handle->Exposure_Data.Writer_Condition),
+					  &(handle->Exposure_Data.Writer_Mutex));
+		}
+		/* only quit once the queue is empty */
+		if(handle->Exposure_Data.Writer_Queue_Count == 0)
+			break;
+		frame_index = handle->Exposure_Data.Writer_Queue[handle->Exposure_Data.Writer_Queue_Head];
+		handle->Exposure_Data.Writer_Queue_Head = (handle->Exposure_Data.Writer_Queue_Head+1)%
+			CCD_EXPOSURE_FRAME_COUNT;
+		handle->Exposure_Data.Writer_Queue_Count--;
+		callback = handle->Exposure_Data.Save_Callback;
+		pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+		/* save the frame */
+		frame = &(handle->Exposure_Data.Frame_List[frame_index]);
+		failed_count = 0;
+		for(i=0;i<frame->Image_Count;i++)
+		{
+#if LOGGING > 4
+			CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Writer_Thread:"
+					      "Saving frame %d to filename %s.",frame_index,frame->Filename_List[i]);
+#endif
+			strcpy(error_string,"");
+			CCD_Global_Metrics_Get_Time(&save_start_time);
+			successful = Exposure_Save(class,source,frame->Filename_List[i],frame->Image_Buffer_List[i],
+						   frame->NCols_List[i],frame->NRows_List[i],
+						   frame->Exposure_Start_Time);
+			if(successful)
+				CCD_Global_Metrics_Timer_Add(handle,CCD_GLOBAL_METRICS_TIMER_SAVE,save_start_time);
+			else
+			{
+				CCD_Exposure_Error_String(error_string);
+				failed_count++;
+#if LOGGING > 0
+				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_TERSE,"Exposure_Writer_Thread:"
+						      "Failed to save %s:%s",frame->Filename_List[i],error_string);
+#endif
+			}
+			if(callback != NULL)
+				(*callback)(handle,frame->Filename_List[i],successful,error_string);
+		}
+		/* release the frame */
+		pthread_mutex_lock(&(handle->Exposure_Data.Writer_Mutex));
+		frame->In_Use = FALSE;
+		handle->Exposure_Data.Writer_Pending_Count--;
+		handle->Exposure_Data.Writer_Failed_Count += failed_count;
+		pthread_cond_broadcast(&(handle->Exposure_Data.Writer_Condition));
+	}
+	pthread_mutex_unlock(&(handle->Exposure_Data.Writer_Mutex));
+	return NULL;
+}
+
+#if CCD_GLOBAL_BYTES_PER_PIXEL == 2
+/**
+ * Scalar de-interlace row kernel. Copies count pixels from src to dst, where pixel k is 
+ * src[(k*stride)+phase]. If reverse is TRUE the pixels are written into dst in reverse order, 
+ * i.e. dst[count-1-k] = src[(k*stride)+phase]. If byte_swap is TRUE the bytes of each pixel are swapped.
+ * @param dst Where to write the pixels.
+ * @param src The start of the raw pixels to read.
+ * @param count The number of pixels to write.
+ * @param stride The distance between successive pixels in src, one of 1,2 or 4.
+ * @param phase The offset of the first pixel in src, less than stride.
+ * @param reverse A boolean, whether to write the pixels into dst in reverse order.
+ * @param byte_swap A boolean, whether to byte swap each pixel.
+ */
+static void Exposure_DeInterlace_Row_Scalar(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+					    int reverse,int byte_swap)
+{
+	unsigned short value;
+	int k;
+
+	src += phase;
+	for(k=0;k<count;k++)
+	{
+		value = src[k*stride];
+		if(byte_swap)
+			value = (unsigned short)((value<<8)|(value>>8));
+		if(reverse)
+			dst[count-1-k] = value;
+		else
+			dst[k] = value;
+	}
+}
+
+#ifdef EXPOSURE_DEINTERLACE_X86
+/**
+ * SSE2 helper routine, taking two vectors of 8 pixels and returning a vector of the 8 even (odd == FALSE)
+ * or odd (odd == TRUE) pixels. The pixels are sign extended into 32 bits and packed back with signed saturation,
+ * which leaves the 16 bit pattern unchanged.
+ * @param a The first 8 pixels.
+ * @param b The next 8 pixels.
+ * @param odd A boolean, whether to extract the odd or even pixels.
+ * @return A vector containing the extracted pixels.
+ */
+__attribute__((target("sse2")))
+static __m128i Exposure_SSE2_Extract(__m128i a,__m128i b,int odd)
+{
+	if(odd)
+	{
+		a = _mm_srai_epi32(a,16);
+		b = _mm_srai_epi32(b,16);
+	}
+	else
+	{
+		a = _mm_srai_epi32(_mm_slli_epi32(a,16),16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b,16),16);
+	}
+	return _mm_packs_epi32(a,b);
+}
+
+/**
+ * SSE2 de-interlace row kernel. Does the same as Exposure_DeInterlace_Row_Scalar, 8 pixels at a time, 
+ * using Exposure_DeInterlace_Row_Scalar for any remaining pixels.
+ * @param dst Where to write the pixels.
+ * @param src The start of the raw pixels to read.
+ * @param count The number of pixels to write.
+ * @param stride The distance between successive pixels in src, one of 1,2 or 4.
+ * @param phase The offset of the first pixel in src, less than stride.
+ * @param reverse A boolean, whether to write the pixels into dst in reverse order.
+ * @param byte_swap A boolean, whether to byte swap each pixel.
+ * @see #Exposure_SSE2_Extract
+ * @see #Exposure_DeInterlace_Row_Scalar
+ */
+__attribute__((target("sse2")))
+static void Exposure_DeInterlace_Row_SSE2(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+					  int reverse,int byte_swap)
+{
+	__m128i v,a,b,c,d;
+	int k;
+
+	for(k=0;(k+8)<=count;k+=8)
+	{
+		/* gather pixels k..k+7 into v */
+		switch(stride)
+		{
+			case 1:
+				v = _mm_loadu_si128((__m128i *)(src+k+phase));
+				break;
+			case 2:
+				a = _mm_loadu_si128((__m128i *)(src+(2*k)));
+				b = _mm_loadu_si128((__m128i *)(src+(2*k)+8));
+				v = Exposure_SSE2_Extract(a,b,phase&1);
+				break;
+			default: /* 4 */
+				a = _mm_loadu_si128((__m128i *)(src+(4*k)));
+				b = _mm_loadu_si128((__m128i *)(src+(4*k)+8));
+				c = _mm_loadu_si128((__m128i *)(src+(4*k)+16));
+				d = _mm_loadu_si128((__m128i *)(src+(4*k)+24));
+				a = Exposure_SSE2_Extract(a,b,phase&1);
+				c = Exposure_SSE2_Extract(c,d,phase&1);
+				v = Exposure_SSE2_Extract(a,c,(phase>>1)&1);
+				break;
+		}
+		if(byte_swap)
+			v = _mm_or_si128(_mm_slli_epi16(v,8),_mm_srli_epi16(v,8));
+		if(reverse)
+		{
+			v = _mm_shufflelo_epi16(v,_MM_SHUFFLE(0,1,2,3));
+			v = _mm_shufflehi_epi16(v,_MM_SHUFFLE(0,1,2,3));
+			v = _mm_shuffle_epi32(v,_MM_SHUFFLE(1,0,3,2));
+			_mm_storeu_si128((__m128i *)(dst+count-k-8),v);
+		}
+		else
+			_mm_storeu_si128((__m128i *)(dst+k),v);
+	}
+	/* do the remaining pixels */
+	if(k < count)
+	{
+		if(reverse)
+			Exposure_DeInterlace_Row_Scalar(dst,src+(k*stride),count-k,stride,phase,reverse,byte_swap);
+		else
+			Exposure_DeInterlace_Row_Scalar(dst+k,src+(k*stride),count-k,stride,phase,reverse,byte_swap);
+	}
+}
+
+/**
+ * AVX2 helper routine, taking two vectors of 16 pixels and returning a vector of the 16 even (odd == FALSE)
+ * or odd (odd == TRUE) pixels. The pack instruction works within 128 bit lanes, so the result is permuted
+ * back into order.
+ * @param a The first 16 pixels.
+ * @param b The next 16 pixels.
+ * @param odd A boolean, whether to extract the odd or even pixels.
+ * @return A vector containing the extracted pixels.
+ */
+__attribute__((target("avx2")))
+static __m256i Exposure_AVX2_Extract(__m256i a,__m256i b,int odd)
+{
+	if(odd)
+	{
+		a = _mm256_srai_epi32(a,16);
+		b = _mm256_srai_epi32(b,16);
+	}
+	else
+	{
+		a = _mm256_srai_epi32(_mm256_slli_epi32(a,16),16);
+		b = _mm256_srai_epi32(_mm256_slli_epi32(b,16),16);
+	}
+	return _mm256_permute4x64_epi64(_mm256_packs_epi32(a,b),_MM_SHUFFLE(3,1,2,0));
+}
+
+/**
+ * AVX2 de-interlace row kernel. Does the same as Exposure_DeInterlace_Row_Scalar, 16 pixels at a time, 
+ * using Exposure_DeInterlace_Row_Scalar for any remaining pixels. The byte swap and reversal are
+ * done with a single byte shuffle.
+ * @param dst Where to write the pixels.
+ * @param src The start of the raw pixels to read.
+ * @param count The number of pixels to write.
+ * @param stride The distance between successive pixels in src, one of 1,2 or 4.
+ * @param phase The offset of the first pixel in src, less than stride.
+ * @param reverse A boolean, whether to write the pixels into dst in reverse order.
+ * @param byte_swap A boolean, whether to byte swap each pixel.
+ * @see #Exposure_AVX2_Extract
+ * @see #Exposure_DeInterlace_Row_Scalar
+ */
+__attribute__((target("avx2")))
+static void Exposure_DeInterlace_Row_AVX2(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+					  int reverse,int byte_swap)
+{
+	__m256i v,a,b,c,d,shuffle_mask;
+	int k;
+
+	/* byte shuffle within each 128 bit lane, to byte swap and/or reverse the pixel order */
+	if(reverse && byte_swap)
+		shuffle_mask = _mm256_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0,
+						15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+	else if(reverse)
+		shuffle_mask = _mm256_setr_epi8(14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1,
+						14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1);
+	else
+		shuffle_mask = _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,
+						1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+	for(k=0;(k+16)<=count;k+=16)
+	{
+		/* gather pixels k..k+15 into v */
+		switch(stride)
+		{
+			case 1:
+				v = _mm256_loadu_si256((__m256i *)(src+k+phase));
+				break;
+			case 2:
+				a = _mm256_loadu_si256((__m256i *)(src+(2*k)));
+				b = _mm256_loadu_si256((__m256i *)(src+(2*k)+16));
+				v = Exposure_AVX2_Extract(a,b,phase&1);
+				break;
+			default: /* 4 */
+				a = _mm256_loadu_si256((__m256i *)(src+(4*k)));
+				b = _mm256_loadu_si256((__m256i *)(src+(4*k)+16));
+				c = _mm256_loadu_si256((__m256i *)(src+(4*k)+32));
+				d = _mm256_loadu_si256((__m256i *)(src+(4*k)+48));
+				a = Exposure_AVX2_Extract(a,b,phase&1);
+				c = Exposure_AVX2_Extract(c,d,phase&1);
+				v = Exposure_AVX2_Extract(a,c,(phase>>1)&1);
+				break;
+		}
+		if(reverse||byte_swap)
+			v = _mm256_shuffle_epi8(v,shuffle_mask);
+		if(reverse)
+		{
+			/* swap the 128 bit lanes to complete the reversal */
+			v = _mm256_permute4x64_epi64(v,_MM_SHUFFLE(1,0,3,2));
+			_mm256_storeu_si256((__m256i *)(dst+count-k-16),v);
+		}
+		else
+			_mm256_storeu_si256((__m256i *)(dst+k),v);
+	}
+	/* do the remaining pixels */
+	if(k < count)
+	{
+		if(reverse)
+			Exposure_DeInterlace_Row_Scalar(dst,src+(k*stride),count-k,stride,phase,reverse,byte_swap);
+		else
+			Exposure_DeInterlace_Row_Scalar(dst+k,src+(k*stride),count-k,stride,phase,reverse,byte_swap);
+	}
+}
+#endif /* EXPOSURE_DEINTERLACE_X86 */
+
+/**
+ * De-interlace row routine. Calls the row kernel selected by Exposure_Data.DeInterlace_Kernel.
+ * @param dst Where to write the pixels.
+ * @param src The start of the raw pixels to read.
+ * @param count The number of pixels to write.
+ * @param stride The distance between successive pixels in src, one of 1,2 or 4.
+ * @param phase The offset of the first pixel in src, less than stride.
+ * @param reverse A boolean, whether to write the pixels into dst in reverse order.
+ * @param byte_swap A boolean, whether to byte swap each pixel.
+ * @see #Exposure_Data
+ * @see #Exposure_DeInterlace_Row_Scalar
+ * @see #Exposure_DeInterlace_Row_SSE2
+ * @see #Exposure_DeInterlace_Row_AVX2
+ */
+static void Exposure_DeInterlace_Row(unsigned short *dst,unsigned short *src,int count,int stride,int phase,
+				     int reverse,int byte_swap)
+{
+	switch(Exposure_Data.DeInterlace_Kernel)
+	{
+#ifdef EXPOSURE_DEINTERLACE_X86
+		case CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2:
+			Exposure_DeInterlace_Row_AVX2(dst,src,count,stride,phase,reverse,byte_swap);
+			break;
+		case CCD_EXPOSURE_DEINTERLACE_KERNEL_SSE2:
+			Exposure_DeInterlace_Row_SSE2(dst,src,count,stride,phase,reverse,byte_swap);
+			break;
+#endif
+		default:
+			Exposure_DeInterlace_Row_Scalar(dst,src,count,stride,phase,reverse,byte_swap);
+			break;
+	}
+}
+#else
+#error Exposure_DeInterlace_Row not defined for this value of CCD_GLOBAL_BYTES_PER_PIXEL.
+#endif
+
+/* 
+** Exposure_Save uses a different implementation depending on whether CFITSIO define was defined at compile time.
+** If it was we use CFITSIO routines, otherwise we don't.
+** If CCD_EXPOSURE_DIRECT_SAVE is defined, the direct FITS writer is used instead, whether or not CFITSIO
+** was defined (CFITSIO is still used by streaming readouts).
+*/
+
+#ifdef CCD_EXPOSURE_DIRECT_SAVE
+/**
+ * This routine takes some image data and saves it in a file on disc, without using CFITSIO.
+ * The FITS file should already contain the headers (written by the Java layer). The header is read, 
+ * checked against the image dimensions, and the DATE, DATE-OBS, UTSTART and MJD keywords updated in memory to 
+ * the value saved just before the SEX command was sent to the controller. The image data is converted 
+ * EXPOSURE_FITS_CHUNK_PIXELS pixels at a time into a chunk buffer, in the FITS representation of unsigned short
+ * data (big-endian, offset by BZERO), and each chunk written with writev. The header is written with the
+ * first chunk, and the padding to the end of the last FITS block with the last chunk. The exposure_data buffer
+ * is not modified, so it can be the read out data buffer. No FITS mutex is needed, as CFITSIO is not used.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param filename The filename to save the data into.
+ * @param exposure_data The data to save.
+ * @param ncols The number of columns in the image data.
+ * @param nrows The number of rows in the image data.
+ * @param start_time The start time of the exposure.
+ * @return Returns TRUE if the image is saved successfully, FALSE if it fails.
+ * @see #EXPOSURE_FITS_BLOCK_LENGTH
+ * @see #EXPOSURE_FITS_CHUNK_PIXELS
+ * @see #Exposure_Save_Header_Read
+ * @see #Exposure_Save_Header_Check
+ * @see #Exposure_Save_Header_Update_Keywords
+ * @see #Exposure_Save_To_FITS_Order
+ * @see #Exposure_Save_Write_Vector
+ */
+static int Exposure_Save(char *class,char *source,char *filename,unsigned short *exposure_data,int ncols,int nrows,
+			 struct timespec start_time)
+{
+	static char padding[EXPOSURE_FITS_BLOCK_LENGTH]; /* zeros, only ever read */
+	struct iovec iov[3];
+	char *header = NULL;
+	unsigned char *chunk = NULL;
+	int fd,header_length,data_length,padding_length,error_number;
+	int pixel_count,pixel_index,chunk_pixel_count,iov_count;
+
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Started.");
+#endif
+	/* try to open file */
+	fd = open(filename,O_RDWR);
+	if(fd < 0)
+	{
+		error_number = errno;
+		Exposure_Error_Number = 100;
+		sprintf(Exposure_Error_String,"Exposure_Save: File open failed(%s,%d,%s).",filename,error_number,
+			strerror(error_number));
+		return FALSE;
+	}
+	/* read, check and update the header */
+	if(!Exposure_Save_Header_Read(fd,filename,&header,&header_length))
+	{
+		close(fd);
+		return FALSE;
+	}
+	if(!Exposure_Save_Header_Check(filename,header,header_length,ncols,nrows))
+	{
+		free(header);
+		close(fd);
+		return FALSE;
+	}
+	if(!Exposure_Save_Header_Update_Keywords(filename,&header,&header_length,start_time))
+	{
+		free(header);
+		close(fd);
+		return FALSE;
+	}
+	pixel_count = ncols*nrows;
+	data_length = pixel_count*CCD_GLOBAL_BYTES_PER_PIXEL;
+	padding_length = (EXPOSURE_FITS_BLOCK_LENGTH-(data_length%EXPOSURE_FITS_BLOCK_LENGTH))%
+		EXPOSURE_FITS_BLOCK_LENGTH;
+	chunk = (unsigned char*)malloc(EXPOSURE_FITS_CHUNK_PIXELS*CCD_GLOBAL_BYTES_PER_PIXEL);
+	if(chunk == NULL)
+	{
+		free(header);
+		close(fd);
+		Exposure_Error_Number = 116;
+		sprintf(Exposure_Error_String,"Exposure_Save: Failed to allocate chunk buffer(%s,%d).",filename,
+			EXPOSURE_FITS_CHUNK_PIXELS);
+		return FALSE;
+	}
+	if(lseek(fd,0,SEEK_SET) == (off_t)-1)
+	{
+		error_number = errno;
+		free(chunk);
+		free(header);
+		close(fd);
+		Exposure_Error_Number = 61;
+		sprintf(Exposure_Error_String,"Exposure_Save: File seek failed(%s,%d,%s).",filename,error_number,
+			strerror(error_number));
+		return FALSE;
+	}
+	/* convert the image data to FITS order a chunk at a time, and write each chunk.
+	** The header is written with the first chunk, and the padding with the last. */
+	iov[0].iov_base = header;
+	iov[0].iov_len = header_length;
+	iov_count = 1;
+	pixel_index = 0;
+	do
+	{
+		chunk_pixel_count = pixel_count-pixel_index;
+		if(chunk_pixel_count > EXPOSURE_FITS_CHUNK_PIXELS)
+			chunk_pixel_count = EXPOSURE_FITS_CHUNK_PIXELS;
+		Exposure_Save_To_FITS_Order(exposure_data+pixel_index,chunk,chunk_pixel_count);
+		pixel_index += chunk_pixel_count;
+		iov[iov_count].iov_base = chunk;
+		iov[iov_count].iov_len = chunk_pixel_count*CCD_GLOBAL_BYTES_PER_PIXEL;
+		iov_count++;
+		if(pixel_index >= pixel_count)
+		{
+			iov[iov_count].iov_base = padding;
+			iov[iov_count].iov_len = padding_length;
+			iov_count++;
+		}
+		if(!Exposure_Save_Write_Vector(fd,iov,iov_count))
+		{
+			free(chunk);
+			free(header);
+			close(fd);
+			/* Exposure_Save_Write_Vector sets the error but does not know the filename */
+			sprintf(Exposure_Error_String+strlen(Exposure_Error_String),"(%s).",filename);
+			return FALSE;
+		}
+		iov_count = 0;
+	}
+	while(pixel_index < pixel_count);
+	free(chunk);
+	free(header);
+	/* remove anything left over from a previous save of this file */
+	if(ftruncate(fd,(off_t)header_length+(off_t)data_length+(off_t)padding_length) != 0)
+	{
+		error_number = errno;
+		close(fd);
+		Exposure_Error_Number = 101;
+		sprintf(Exposure_Error_String,"Exposure_Save: File truncate failed(%s,%d,%s).",filename,
+			error_number,strerror(error_number));
+		return FALSE;
+	}
+	if(close(fd) != 0)
+	{
+		error_number = errno;
+		Exposure_Error_Number = 59;
+		sprintf(Exposure_Error_String,"Exposure_Save: File close failed(%s,%d,%s).",filename,error_number,
+			strerror(error_number));
+		return FALSE;
+	}
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Completed.");
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to read the FITS header from the start of an open FITS file, a FITS block at a time, until the
+ * block containing the END card has been read.
+ * @param fd The file descriptor of the open FITS file, positioned at the start of the file.
+ * @param filename The filename of the open FITS file, used for error messages.
+ * @param header The address of a character pointer, on success this is set to an allocated buffer containing the
+ *        header blocks (without a NULL terminator). The caller should free this.
+ * @param header_length The address of an integer, on success set to the length of the header in bytes,
+ *        a multiple of EXPOSURE_FITS_BLOCK_LENGTH.
+ * @return Returns TRUE if the header is read successfully, FALSE if it fails.
+ * @see #EXPOSURE_FITS_BLOCK_LENGTH
+ * @see #EXPOSURE_FITS_CARD_LENGTH
+ * @see #EXPOSURE_FITS_HEADER_BLOCK_MAX
+ */
+static int Exposure_Save_Header_Read(int fd,char *filename,char **header,int *header_length)
+{
+	char *new_header = NULL;
+	char *card = NULL;
+	int block_count,done,byte_count,retval,error_number,i;
+
+	(*header) = NULL;
+	(*header_length) = 0;
+	done = FALSE;
+	block_count = 0;
+	while(done == FALSE)
+	{
+		if(block_count >= EXPOSURE_FITS_HEADER_BLOCK_MAX)
+		{
+			free(*header);
+			(*header) = NULL;
+			Exposure_Error_Number = 102;
+			sprintf(Exposure_Error_String,"Exposure_Save_Header_Read:"
+				"No END card in first %d blocks of %s.",EXPOSURE_FITS_HEADER_BLOCK_MAX,filename);
+			return FALSE;
+		}
+		new_header = (char*)realloc(*header,(block_count+1)*EXPOSURE_FITS_BLOCK_LENGTH);
+		if(new_header == NULL)
+		{
+			free(*header);
+			(*header) = NULL;
+			Exposure_Error_Number = 103;
+			sprintf(Exposure_Error_String,"Exposure_Save_Header_Read:"
+				"Failed to reallocate header(%s,%d).",filename,block_count+1);
+			return FALSE;
+		}
+		(*header) = new_header;
+		/* read a whole block */
+		byte_count = 0;
+		while(byte_count < EXPOSURE_FITS_BLOCK_LENGTH)
+		{
+			retval = read(fd,(*header)+(block_count*EXPOSURE_FITS_BLOCK_LENGTH)+byte_count,
+				      EXPOSURE_FITS_BLOCK_LENGTH-byte_count);
+			if(retval < 0)
+			{
+				error_number = errno;
+				if(error_number == EINTR)
+					continue;
+				free(*header);
+				(*header) = NULL;
+				Exposure_Error_Number = 104;
+				sprintf(Exposure_Error_String,"Exposure_Save_Header_Read:Read failed(%s,%d,%s).",
+					filename,error_number,strerror(error_number));
+				return FALSE;
+			}
+			if(retval == 0)
+			{
+				free(*header);
+				(*header) = NULL;
+				Exposure_Error_Number = 105;
+				sprintf(Exposure_Error_String,"Exposure_Save_Header_Read:"
+					"End of file before END card(%s,%d).",filename,
+					(block_count*EXPOSURE_FITS_BLOCK_LENGTH)+byte_count);
+				return FALSE;
+			}
+			byte_count += retval;
+		}
+		/* look for the END card in this block */
+		for(i=0;i<EXPOSURE_FITS_BLOCK_LENGTH;i+=EXPOSURE_FITS_CARD_LENGTH)
+		{
+			card = (*header)+(block_count*EXPOSURE_FITS_BLOCK_LENGTH)+i;
+			if(strncmp(card,"END     ",8) == 0)
+			{
+				done = TRUE;
+				break;
+			}
+		}
+		block_count++;
+	}
+	(*header_length) = block_count*EXPOSURE_FITS_BLOCK_LENGTH;
+	return TRUE;
+}
+
+/**
+ * Routine to check the FITS header read from the file describes the image data we are about to write:
+ * BITPIX is 16, NAXIS is 2, NAXIS1/NAXIS2 match ncols/nrows, BZERO is 32768 and BSCALE (if present) is 1.
+ * @param filename The filename of the FITS file, used for error messages.
+ * @param header The header blocks.
+ * @param header_length The length of the header in bytes.
+ * @param ncols The number of columns in the image data.
+ * @param nrows The number of rows in the image data.
+ * @return Returns TRUE if the header matches the image data, FALSE if it does not.
+ * @see #EXPOSURE_FITS_BZERO
+ * @see #Exposure_Save_Header_Get_Card_Value
+ */
+static int Exposure_Save_Header_Check(char *filename,char *header,int header_length,int ncols,int nrows)
+{
+	double bitpix,naxis,naxis1,naxis2,bzero,bscale;
+
+	if((!Exposure_Save_Header_Get_Card_Value(header,header_length,"BITPIX",&bitpix))||
+	   (!Exposure_Save_Header_Get_Card_Value(header,header_length,"NAXIS",&naxis))||
+	   (!Exposure_Save_Header_Get_Card_Value(header,header_length,"NAXIS1",&naxis1))||
+	   (!Exposure_Save_Header_Get_Card_Value(header,header_length,"NAXIS2",&naxis2))||
+	   (!Exposure_Save_Header_Get_Card_Value(header,header_length,"BZERO",&bzero)))
+	{
+		Exposure_Error_Number = 106;
+		sprintf(Exposure_Error_String,"Exposure_Save_Header_Check:"
+			"Header of %s is missing one of BITPIX/NAXIS/NAXIS1/NAXIS2/BZERO.",filename);
+		return FALSE;
+	}
+	if(!Exposure_Save_Header_Get_Card_Value(header,header_length,"BSCALE",&bscale))
+		bscale = 1.0;
+	if(((int)bitpix != (CCD_GLOBAL_BYTES_PER_PIXEL*8))||((int)naxis != 2)||((int)naxis1 != ncols)||
+	   ((int)naxis2 != nrows)||(bzero != (double)EXPOSURE_FITS_BZERO)||(bscale != 1.0))
+	{
+		Exposure_Error_Number = 107;
+		sprintf(Exposure_Error_String,"Exposure_Save_Header_Check:Header of %s does not match image data:"
+			"BITPIX=%.0f,NAXIS=%.0f,NAXIS1=%.0f (%d),NAXIS2=%.0f (%d),BZERO=%.1f,BSCALE=%.1f.",filename,
+			bitpix,naxis,naxis1,ncols,naxis2,nrows,bzero,bscale);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * This routine updates the DATE, DATE-OBS, UTSTART and MJD FITS keywords in the header read from the FITS file,
+ * to the value saved just before the SEX command was sent to the controller. This is the direct FITS writer
+ * equivalent of the CFITSIO Exposure_Save_Update_Keywords.
+ * @param filename The filename of the FITS file, used for error messages.
+ * @param header The address of the header buffer, which may be reallocated if a keyword has to be added.
+ * @param header_length The address of the header length, which may be increased if a keyword has to be added.
+ * @param start_time The start time of the exposure.
+ * @return Returns TRUE if the keywords are updated successfully, FALSE if it fails.
+ * @see #Exposure_Save_Header_Update_Card
+ * @see #Exposure_TimeSpec_To_Date_String
+ * @see #Exposure_TimeSpec_To_Date_Obs_String
+ * @see #Exposure_TimeSpec_To_UtStart_String
+ * @see #Exposure_TimeSpec_To_Mjd
+ */
+static int Exposure_Save_Header_Update_Keywords(char *filename,char **header,int *header_length,
+						struct timespec start_time)
+{
+	char exposure_start_time_string[64];
+	char value_string[EXPOSURE_FITS_CARD_LENGTH+1];
+	double mjd;
+
+/* update DATE keyword */
+	Exposure_TimeSpec_To_Date_String(start_time,exposure_start_time_string);
+	sprintf(value_string,"'%-8s'",exposure_start_time_string);
+	if(!Exposure_Save_Header_Update_Card(filename,header,header_length,"DATE",value_string))
+		return FALSE;
+/* update DATE-OBS keyword */
+	Exposure_TimeSpec_To_Date_Obs_String(start_time,exposure_start_time_string);
+	sprintf(value_string,"'%-8s'",exposure_start_time_string);
+	if(!Exposure_Save_Header_Update_Card(filename,header,header_length,"DATE-OBS",value_string))
+		return FALSE;
+/* update UTSTART keyword */
+	Exposure_TimeSpec_To_UtStart_String(start_time,exposure_start_time_string);
+	sprintf(value_string,"'%-8s'",exposure_start_time_string);
+	if(!Exposure_Save_Header_Update_Card(filename,header,header_length,"UTSTART",value_string))
+		return FALSE;
+/* update MJD keyword */
+/* note leap second correction not implemented yet (always FALSE). */
+	if(!Exposure_TimeSpec_To_Mjd(start_time,FALSE,&mjd))
+		return FALSE;
+	sprintf(value_string,"%20.6f",mjd);
+	if(!Exposure_Save_Header_Update_Card(filename,header,header_length,"MJD",value_string))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Routine to set the value of a keyword in the header. The card is rewritten in fixed format
+ * (the value starting in column 11, padded to column 30), keeping any existing comment.
+ * If the keyword is not in the header, the card is added in place of the END card, and the END card moved
+ * to the next card, adding a new FITS block of blanks to the header if needed. The header can be grown
+ * safely, as the whole file is rewritten by Exposure_Save.
+ * @param filename The filename of the FITS file, used for error messages.
+ * @param header The address of the header buffer, which may be reallocated.
+ * @param header_length The address of the header length, which may be increased by EXPOSURE_FITS_BLOCK_LENGTH.
+ * @param keyword The keyword to update.
+ * @param value_string The formatted value, including quotes for a string value.
+ * @return Returns TRUE if the keyword is updated successfully, FALSE if it fails.
+ * @see #EXPOSURE_FITS_CARD_LENGTH
+ * @see #EXPOSURE_FITS_BLOCK_LENGTH
+ * @see #Exposure_Save_Header_Find_Card
+ */
+static int Exposure_Save_Header_Update_Card(char *filename,char **header,int *header_length,char *keyword,
+					    char *value_string)
+{
+	char old_card[EXPOSURE_FITS_CARD_LENGTH+1];
+	char new_card[(2*EXPOSURE_FITS_CARD_LENGTH)+1];
+	char *card = NULL;
+	char *comment = NULL;
+	char *new_header = NULL;
+	int i,end_index,length;
+
+	card = Exposure_Save_Header_Find_Card(*header,*header_length,keyword);
+	comment = NULL;
+	if(card != NULL)
+	{
+		/* find any existing comment, skipping over a quoted string value (where '' is a quote) */
+		strncpy(old_card,card,EXPOSURE_FITS_CARD_LENGTH);
+		old_card[EXPOSURE_FITS_CARD_LENGTH] = '\0';
+		i = 10;
+		while((i < EXPOSURE_FITS_CARD_LENGTH)&&(old_card[i] == ' '))
+			i++;
+		if((i < EXPOSURE_FITS_CARD_LENGTH)&&(old_card[i] == '\''))
+		{
+			i++;
+			while(i < EXPOSURE_FITS_CARD_LENGTH)
+			{
+				if((old_card[i] == '\'')&&(old_card[i+1] == '\''))
+					i += 2;
+				else if(old_card[i] == '\'')
+				{
+					i++;
+					break;
+				}
+				else
+					i++;
+			}
+		}
+		comment = strchr(old_card+i,'/');
+		if(comment != NULL)
+		{
+			comment++;
+			if((*comment) == ' ')
+				comment++;
+			length = strlen(comment);
+			while((length > 0)&&(comment[length-1] == ' '))
+				comment[--length] = '\0';
+		}
+	}
+	else
+	{
+		/* add the keyword in place of the END card */
+		card = Exposure_Save_Header_Find_Card(*header,*header_length,"END");
+		if(card == NULL)
+		{
+			Exposure_Error_Number = 108;
+			sprintf(Exposure_Error_String,"Exposure_Save_Header_Update_Card:"
+				"No END card adding %s to %s.",keyword,filename);
+			return FALSE;
+		}
+		end_index = card-(*header);
+		if(end_index+EXPOSURE_FITS_CARD_LENGTH >= (*header_length))
+		{
+			new_header = (char*)realloc(*header,(*header_length)+EXPOSURE_FITS_BLOCK_LENGTH);
+			if(new_header == NULL)
+			{
+				Exposure_Error_Number = 109;
+				sprintf(Exposure_Error_String,"Exposure_Save_Header_Update_Card:"
+					"Failed to reallocate header adding %s to %s.",keyword,filename);
+				return FALSE;
+			}
+			(*header) = new_header;
+			memset((*header)+(*header_length),' ',EXPOSURE_FITS_BLOCK_LENGTH);
+			(*header_length) += EXPOSURE_FITS_BLOCK_LENGTH;
+		}
+		card = (*header)+end_index;
+		memcpy(card+EXPOSURE_FITS_CARD_LENGTH,card,EXPOSURE_FITS_CARD_LENGTH);
+	}
+	/* format the new card, and pad/truncate it to the card length */
+	if((comment != NULL)&&(strlen(comment) > 0))
+		sprintf(new_card,"%-8.8s= %-20s / %.*s",keyword,value_string,EXPOSURE_FITS_CARD_LENGTH,comment);
+	else
+		sprintf(new_card,"%-8.8s= %-20s",keyword,value_string);
+	length = strlen(new_card);
+	if(length < EXPOSURE_FITS_CARD_LENGTH)
+		memset(new_card+length,' ',EXPOSURE_FITS_CARD_LENGTH-length);
+	memcpy(card,new_card,EXPOSURE_FITS_CARD_LENGTH);
+	return TRUE;
+}
+
+/**
+ * Routine to find the card for a keyword in the header. Only cards before the END card are searched
+ * (apart from the END card itself).
+ * @param header The header blocks.
+ * @param header_length The length of the header in bytes.
+ * @param keyword The keyword to find.
+ * @return A pointer to the start of the card in the header, or NULL if the keyword was not found.
+ * @see #EXPOSURE_FITS_CARD_LENGTH
+ */
+static char *Exposure_Save_Header_Find_Card(char *header,int header_length,char *keyword)
+{
+	char padded_keyword[9];
+	int i;
+
+	sprintf(padded_keyword,"%-8.8s",keyword);
+	for(i=0;i<header_length;i+=EXPOSURE_FITS_CARD_LENGTH)
+	{
+		if(strncmp(header+i,padded_keyword,8) == 0)
+			return header+i;
+		if(strncmp(header+i,"END     ",8) == 0)
+			return NULL;
+	}
+	return NULL;
+}
+
+/**
+ * Routine to get the numeric value of a keyword in the header.
+ * @param header The header blocks.
+ * @param header_length The length of the header in bytes.
+ * @param keyword The keyword to get the value of.
+ * @param value The address of a double to store the value in.
+ * @return Returns TRUE if the keyword was found and has a numeric value, FALSE otherwise.
+ * @see #Exposure_Save_Header_Find_Card
+ */
+static int Exposure_Save_Header_Get_Card_Value(char *header,int header_length,char *keyword,double *value)
+{
+	char card_string[EXPOSURE_FITS_CARD_LENGTH+1];
+	char *card = NULL;
+
+	card = Exposure_Save_Header_Find_Card(header,header_length,keyword);
+	if(card == NULL)
+		return FALSE;
+	strncpy(card_string,card,EXPOSURE_FITS_CARD_LENGTH);
+	card_string[EXPOSURE_FITS_CARD_LENGTH] = '\0';
+	if(card_string[8] != '=')
+		return FALSE;
+	if(sscanf(card_string+10,"%lf",value) != 1)
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Routine to convert unsigned short image data to the FITS representation used with BZERO = 32768:
+ * signed 16 bit integers (the value minus BZERO, i.e. the top bit flipped), stored big-endian.
+ * The bytes are written individually, so this works whatever the byte order of the host.
+ * @param exposure_data The image data to convert. This is not modified.
+ * @param fits_data A buffer of at least pixel_count*CCD_GLOBAL_BYTES_PER_PIXEL bytes, 
+ *        to store the FITS representation of the data in.
+ * @param pixel_count The number of pixels to convert.
+ * @see #EXPOSURE_FITS_BZERO
+ */
+static void Exposure_Save_To_FITS_Order(unsigned short *exposure_data,unsigned char *fits_data,int pixel_count)
+{
+	unsigned short value;
+	int i;
+
+	for(i=0;i<pixel_count;i++)
+	{
+		value = exposure_data[i]^EXPOSURE_FITS_BZERO;
+		fits_data[(2*i)] = (unsigned char)(value >> 8);
+		fits_data[(2*i)+1] = (unsigned char)(value & 0xff);
+	}
+}
+
+/**
+ * Routine to write an I/O vector to a file descriptor, restarting the writev if it is interrupted
+ * or only partially completes.
+ * @param fd The file descriptor to write to.
+ * @param iov The I/O vector. This is modified as the data is written.
+ * @param iov_count The number of elements in the I/O vector.
+ * @return Returns TRUE if all the data was written, FALSE if it fails.
+ */
+static int Exposure_Save_Write_Vector(int fd,struct iovec *iov,int iov_count)
+{
+	ssize_t retval;
+	size_t written;
+	int error_number;
+
+	/* skip empty elements */
+	while((iov_count > 0)&&(iov->iov_len == 0))
+	{
+		iov++;
+		iov_count--;
+	}
+	while(iov_count > 0)
+	{
+		retval = writev(fd,iov,iov_count);
+		if(retval < 0)
+		{
+			error_number = errno;
+			if(error_number == EINTR)
+				continue;
+			Exposure_Error_Number = 62;
+			sprintf(Exposure_Error_String,"Exposure_Save_Write_Vector: File write failed(%d,%s)",
+				error_number,strerror(error_number));
+			return FALSE;
+		}
+		written = (size_t)retval;
+		/* move past the elements (or part of an element) written */
+		while((iov_count > 0)&&(written >= iov->iov_len))
+		{
+			written -= iov->iov_len;
+			iov++;
+			iov_count--;
+		}
+		if(iov_count > 0)
+		{
+			iov->iov_base = ((char*)iov->iov_base)+written;
+			iov->iov_len -= written;
+		}
+	}
+	return TRUE;
+}
+#elif defined(CFITSIO)
+/**
+ * This routine takes some image data and saves it in a file on disc. It also updates the 
+ * DATE-OBS FITS keyword to the value saved just before the SEX command was sent to the controller.
+ * It currently uses Exposure_FITS_Mutex_Lock / Exposure_FITS_Mutex_UnLock to lock CFITSIO file writing,
+ * as the CFITSIO library we are currently using (3.006) does not appear to be thread safe and causes crashes/
+ * WRITE_ERROR errors when both arms try to write data at the same time.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param filename The filename to save the data into.
+ * @param exposure_data The data to save.
+ * @param ncols The number of columns in the image data.
+ * @param nrows The number of rows in the image data.
+ * @param start_time The start time of the exposure.
+ * @return Returns TRUE if the image is saved successfully, FALSE if it fails.
+ * @see #Exposure_Save_Update_Keywords
+ * @see #Exposure_FITS_Mutex_Lock
+ * @see #Exposure_FITS_Mutex_UnLock
+ */
+static int Exposure_Save(char *class,char *source,char *filename,unsigned short *exposure_data,int ncols,int nrows,
+			 struct timespec start_time)
+{
+	fitsfile *fp = NULL;
+	int retval=0,status=0;
+	char buff[32]; /* fits_get_errstatus returns 30 chars max */
+
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Started.");
+#endif
+#ifdef CCD_CFITSIO_MUTEXED
+	if(!Exposure_FITS_Mutex_Lock())
+		return FALSE;
+#endif
+	/* try to open file */
+	retval = fits_open_file(&fp,filename,READWRITE,&status);
+	if(retval)
+	{
+#ifdef CCD_CFITSIO_MUTEXED
+		Exposure_FITS_Mutex_Unlock();
+#endif
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		Exposure_Error_Number = 53;
+		sprintf(Exposure_Error_String,"Exposure_Save: File open failed(%s,%d,%s).",filename,status,buff);
+		return FALSE;
+	}
+	/* write the data */
+	retval = fits_write_img(fp,TUSHORT,1,ncols*nrows,exposure_data,&status);
+	if(retval)
+	{
+#ifdef CCD_CFITSIO_MUTEXED
+		Exposure_FITS_Mutex_Unlock();
+#endif
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		fits_close_file(fp,&status);
+		Exposure_Error_Number = 54;
+		sprintf(Exposure_Error_String,"Exposure_Save: File write failed(%s,%d,%s).",filename,status,buff);
+		return FALSE;
+	}
+/* update the exposure start time keywords */
+	if(!Exposure_Save_Update_Keywords(class,source,fp,filename,start_time))
+	{
+#ifdef CCD_CFITSIO_MUTEXED
+		Exposure_FITS_Mutex_Unlock();
+#endif
+		status = 0;
+		fits_close_file(fp,&status);
+		return FALSE;
+	}
+/* close file */
+	retval = fits_close_file(fp,&status);
+	if(retval)
+	{
+#ifdef CCD_CFITSIO_MUTEXED
+		Exposure_FITS_Mutex_Unlock();
+#endif
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		Exposure_Error_Number = 59;
+		sprintf(Exposure_Error_String,"Exposure_Save: File close failed(%s,%d,%s).",filename,status,buff);
+		return FALSE;
+	}
+#ifdef CCD_CFITSIO_MUTEXED
+	if(!Exposure_FITS_Mutex_Unlock())
+		return FALSE;
+#endif
+
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Completed.");
+#endif
+	return TRUE;
+}
+
+#else
+/**
+ * This routine takes some image data and saves it in a file on disc.
+ * This routine does not update the DATE-OBS keyword, unlike the CFITSIO routine.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param filename The filename to save the data into.
+ * @param exposure_data The data to save.
+ * @param ncols The number of columns in the image data.
+ * @param nrows The number of rows in the image data.
+ * @param start_time The start time of the exposure.
+ * @return Returns TRUE if the image is saved successfully, FALSE if it fails.
+ */
+static int Exposure_Save(char *class,char *source,char *filename,unsigned short *exposure_data,int ncols,int nrows,
+			 struct timespec start_time)
+{
+	FILE *fp = NULL;
+	int retval,error_number,nitems;
+
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Started.");
+#endif
+	/* try to open file */
+	fp = fopen(filename,"rb+");
+	if(fp == NULL)
+	{
+		error_number = errno;
+		Exposure_Error_Number = 60;
+		sprintf(Exposure_Error_String,"Exposure_Save: File open failed(%s,%d).",filename,error_number);
+		return FALSE;
+	}
+	/* move to end of file */
+	retval = fseek(fp,0,SEEK_END);
+	if(retval == -1)
+	{
+		fclose(fp);
 		Exposure_Error_Number = 61;
 		sprintf(Exposure_Error_String,"Exposure_Save: File seek failed(%s,%d,%s).",filename,errno,
 			strerror(errno));
 		return FALSE;
 	}
-	/* write the data */
-	nitems = nrows*ncols;
-	retval = fwrite(exposure_data,CCD_GLOBAL_BYTES_PER_PIXEL,nitems,fp);
-	if(retval != nitems)
+	/* write the data */
+	nitems = nrows*ncols;
+	retval = fwrite(exposure_data,CCD_GLOBAL_BYTES_PER_PIXEL,nitems,fp);
+	if(retval != nitems)
+	{
+		fclose(fp);
+		Exposure_Error_Number = 62;
+		sprintf(Exposure_Error_String,"Exposure_Save: File write failed(%s,%d,%d).",filename,retval,nitems);
+		return FALSE;
+	}
+	fclose(fp);
+#if LOGGING > 4
+	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Completed.");
+#endif
+	return TRUE;
+}
+#endif
+
+#ifdef CFITSIO
+/**
+ * This routine updates the DATE, DATE-OBS, UTSTART and MJD FITS keywords in an open FITS file 
+ * to the value saved just before the SEX command was sent to the controller.
+ * If CCD_CFITSIO_MUTEXED is defined, the caller should already have locked the FITS mutex
+ * using Exposure_FITS_Mutex_Lock. The file is not closed by this routine if it fails.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param fp The CFITSIO file pointer of the open FITS file.
+ * @param filename The filename of the open FITS file, used for error messages.
+ * @param start_time The start time of the exposure.
+ * @return Returns TRUE if the keywords are updated successfully, FALSE if it fails.
+ * @see #Exposure_TimeSpec_To_Date_String
+ * @see #Exposure_TimeSpec_To_Date_Obs_String
+ * @see #Exposure_TimeSpec_To_UtStart_String
+ * @see #Exposure_TimeSpec_To_Mjd
+ */
+static int Exposure_Save_Update_Keywords(char *class,char *source,fitsfile *fp,char *filename,
+					 struct timespec start_time)
+{
+	int retval=0,status=0;
+	char buff[32]; /* fits_get_errstatus returns 30 chars max */
+	char exposure_start_time_string[64];
+	double mjd;
+
+/* update DATE keyword */
+	Exposure_TimeSpec_To_Date_String(start_time,exposure_start_time_string);
+	retval = fits_update_key(fp,TSTRING,"DATE",exposure_start_time_string,NULL,&status);
+	if(retval)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		Exposure_Error_Number = 55;
+		sprintf(Exposure_Error_String,"Exposure_Save_Update_Keywords: Updating DATE failed(%s,%d,%s).",
+			filename,status,buff);
+		return FALSE;
+	}
+/* update DATE-OBS keyword */
+	Exposure_TimeSpec_To_Date_Obs_String(start_time,exposure_start_time_string);
+	retval = fits_update_key(fp,TSTRING,"DATE-OBS",exposure_start_time_string,NULL,&status);
+	if(retval)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		Exposure_Error_Number = 56;
+		sprintf(Exposure_Error_String,"Exposure_Save_Update_Keywords: Updating DATE-OBS failed(%s,%d,%s).",
+			filename,status,buff);
+		return FALSE;
+	}
+/* update UTSTART keyword */
+	Exposure_TimeSpec_To_UtStart_String(start_time,exposure_start_time_string);
+	retval = fits_update_key(fp,TSTRING,"UTSTART",exposure_start_time_string,NULL,&status);
+	if(retval)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		Exposure_Error_Number = 57;
+		sprintf(Exposure_Error_String,"Exposure_Save_Update_Keywords: Updating UTSTART failed(%s,%d,%s).",
+			filename,status,buff);
+		return FALSE;
+	}
+/* update MJD keyword */
+/* note leap second correction not implemented yet (always FALSE). */
+	if(!Exposure_TimeSpec_To_Mjd(start_time,FALSE,&mjd))
+		return FALSE;
+	retval = fits_update_key_fixdbl(fp,"MJD",mjd,6,NULL,&status);
+	if(retval)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		Exposure_Error_Number = 58;
+		sprintf(Exposure_Error_String,"Exposure_Save_Update_Keywords: Updating MJD failed(%.2f,%s,%d,%s).",
+			mjd,filename,status,buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+#endif
+
+/**
+ * Routine to open a FITS file for streaming readout. The FITS file should already contain the relevant
+ * headers, the image data is then written into it a block of rows at a time by Exposure_Stream_Write_Rows,
+ * as the CCD is read out. The stream is initialised from the current setup, retrieving the number of
+ * columns, rows and the de-interlace type, and a row buffer of EXPOSURE_STREAM_BLOCK_ROWS rows is allocated.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param filename The FITS filename (which should already contain relevant headers), in which to write 
+ *        the image data.
+ * @param stream The address of a stream structure to initialise.
+ * @return Returns TRUE if the FITS file was opened successfully, FALSE if it fails.
+ * @see #Exposure_Stream_Struct
+ * @see #Exposure_FITS_Mutex_Lock
+ * @see #Exposure_FITS_Mutex_UnLock
+ * @see ccd_setup.html#CCD_Setup_Get_NCols
+ * @see ccd_setup.html#CCD_Setup_Get_NRows
+ * @see ccd_setup.html#CCD_Setup_Get_DeInterlace_Type
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Stream_Open(char *class,char *source,CCD_Interface_Handle_T* handle,char *filename,
+				struct Exposure_Stream_Struct *stream)
+{
+#ifdef CFITSIO
+	int retval=0,status=0;
+	char buff[32]; /* fits_get_errstatus returns 30 chars max */
+#else
+	int retval,error_number;
+#endif
+
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Stream_Open(%s):Started.",filename);
+#endif
+	stream->Fp = NULL;
+	stream->Filename = filename;
+	stream->NCols = CCD_Setup_Get_NCols(handle);
+	stream->NRows = CCD_Setup_Get_NRows(handle);
+	stream->DeInterlace_Type = CCD_Setup_Get_DeInterlace_Type(handle);
+	stream->Row_Count = 0;
+	stream->Row_Buffer = NULL;
+	if(stream->NCols <= 0)
+	{
+		Exposure_Error_Number = 75;
+		sprintf(Exposure_Error_String,"Exposure_Stream_Open:Illegal ncols '%d'.",stream->NCols);
+		return FALSE;
+	}
+	if(stream->NRows <= 0)
 	{
-		fclose(fp);
-		Exposure_Error_Number = 62;
-		sprintf(Exposure_Error_String,"Exposure_Save: File write failed(%s,%d,%d).",filename,retval,nitems);
+		Exposure_Error_Number = 76;
+		sprintf(Exposure_Error_String,"Exposure_Stream_Open:Illegal nrows '%d'.",stream->NRows);
 		return FALSE;
 	}
-	fclose(fp);
+	stream->Row_Buffer = (unsigned short*)malloc(EXPOSURE_STREAM_BLOCK_ROWS*stream->NCols*
+						     CCD_GLOBAL_BYTES_PER_PIXEL);
+	if(stream->Row_Buffer == NULL)
+	{
+		Exposure_Error_Number = 88;
+		sprintf(Exposure_Error_String,"Exposure_Stream_Open:Failed to allocate row buffer (%d,%d).",
+			EXPOSURE_STREAM_BLOCK_ROWS,stream->NCols);
+		return FALSE;
+	}
+#ifdef CFITSIO
+#ifdef CCD_CFITSIO_MUTEXED
+	if(!Exposure_FITS_Mutex_Lock())
+		return FALSE;
+#endif
+	retval = fits_open_file(&(stream->Fp),filename,READWRITE,&status);
+#ifdef CCD_CFITSIO_MUTEXED
+	Exposure_FITS_Mutex_Unlock();
+#endif
+	if(retval)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		stream->Fp = NULL;
+		free(stream->Row_Buffer);
+		stream->Row_Buffer = NULL;
+		Exposure_Error_Number = 77;
+		sprintf(Exposure_Error_String,"Exposure_Stream_Open: File open failed(%s,%d,%s).",filename,status,buff);
+		return FALSE;
+	}
+#else
+	stream->Fp = fopen(filename,"rb+");
+	if(stream->Fp == NULL)
+	{
+		error_number = errno;
+		free(stream->Row_Buffer);
+		stream->Row_Buffer = NULL;
+		Exposure_Error_Number = 78;
+		sprintf(Exposure_Error_String,"Exposure_Stream_Open: File open failed(%s,%d).",filename,error_number);
+		return FALSE;
+	}
+	/* move to end of file */
+	retval = fseek(stream->Fp,0,SEEK_END);
+	if(retval == -1)
+	{
+		error_number = errno;
+		fclose(stream->Fp);
+		stream->Fp = NULL;
+		free(stream->Row_Buffer);
+		stream->Row_Buffer = NULL;
+		Exposure_Error_Number = 79;
+		sprintf(Exposure_Error_String,"Exposure_Stream_Open: File seek failed(%s,%d,%s).",filename,
+			error_number,strerror(error_number));
+		return FALSE;
+	}
+#endif
 #if LOGGING > 4
-	CCD_Global_Log(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Save:Completed.");
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Stream_Open(%s):Completed.",filename);
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to process and save any complete rows of a streaming readout, that have not already been
+ * saved. The rows between stream->Row_Count and the last complete row in pixel_count pixels are
+ * processed in blocks of up to EXPOSURE_STREAM_BLOCK_ROWS rows:
+ * <ul>
+ * <li>The block is de-interlaced (and byte swapped, if CCD_EXPOSURE_BYTE_SWAP is defined) into 
+ *     stream->Row_Buffer using CCD_Exposure_DeInterlace. This only works for de-interlace types where each
+ *     read out row maps onto one image row (single, flip and split serial).
+ * <li>The block is written into the image data of the FITS file.
+ * </ul>
+ * The read out data in exposure_data is not modified.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param stream The address of an open stream structure.
+ * @param exposure_data The data being read out from the CCD.
+ * @param pixel_count The number of pixels read out so far.
+ * @return Returns TRUE if the rows were processed and saved successfully, FALSE if it fails.
+ * @see #Exposure_Stream_Struct
+ * @see #EXPOSURE_STREAM_BLOCK_ROWS
+ * @see #EXPOSURE_BYTE_SWAP
+ * @see #CCD_Exposure_DeInterlace
+ * @see #Exposure_FITS_Mutex_Lock
+ * @see #Exposure_FITS_Mutex_UnLock
+ */
+static int Exposure_Stream_Write_Rows(char *class,char *source,struct Exposure_Stream_Struct *stream,
+				      unsigned short *exposure_data,int pixel_count)
+{
+	int row_count,nrows;
+#ifdef CFITSIO
+	int retval=0,status=0;
+	char buff[32]; /* fits_get_errstatus returns 30 chars max */
+#else
+	int retval,nitems;
+#endif
+
+	row_count = pixel_count/stream->NCols;
+	if(row_count > stream->NRows)
+		row_count = stream->NRows;
+#if LOGGING > 9
+	if(row_count > stream->Row_Count)
+	{
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,
+				      "Exposure_Stream_Write_Rows:Writing rows %d to %d of %d.",
+				      stream->Row_Count,row_count-1,stream->NRows);
+	}
+#endif
+	while(stream->Row_Count < row_count)
+	{
+		nrows = row_count-stream->Row_Count;
+		if(nrows > EXPOSURE_STREAM_BLOCK_ROWS)
+			nrows = EXPOSURE_STREAM_BLOCK_ROWS;
+		if(!CCD_Exposure_DeInterlace(class,source,stream->NCols,nrows,
+					     exposure_data+(stream->Row_Count*stream->NCols),stream->Row_Buffer,
+					     stream->DeInterlace_Type,EXPOSURE_BYTE_SWAP))
+		{
+			return FALSE;
+		}
+#ifdef CFITSIO
+#ifdef CCD_CFITSIO_MUTEXED
+		if(!Exposure_FITS_Mutex_Lock())
+			return FALSE;
+#endif
+		retval = fits_write_img(stream->Fp,TUSHORT,(stream->Row_Count*stream->NCols)+1,nrows*stream->NCols,
+					stream->Row_Buffer,&status);
+#ifdef CCD_CFITSIO_MUTEXED
+		Exposure_FITS_Mutex_Unlock();
+#endif
+		if(retval)
+		{
+			fits_get_errstatus(status,buff);
+			fits_report_error(stderr,status);
+			Exposure_Error_Number = 80;
+			sprintf(Exposure_Error_String,"Exposure_Stream_Write_Rows: File write failed(%s,%d,%d,%s).",
+				stream->Filename,stream->Row_Count,status,buff);
+			return FALSE;
+		}
+#else
+		nitems = nrows*stream->NCols;
+		retval = fwrite(stream->Row_Buffer,CCD_GLOBAL_BYTES_PER_PIXEL,nitems,stream->Fp);
+		if(retval != nitems)
+		{
+			Exposure_Error_Number = 81;
+			sprintf(Exposure_Error_String,"Exposure_Stream_Write_Rows: File write failed(%s,%d,%d,%d).",
+				stream->Filename,stream->Row_Count,retval,nitems);
+			return FALSE;
+		}
+#endif
+		stream->Row_Count += nrows;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to close a streaming readout FITS file, once all the rows have been written. The row buffer is freed.
+ * If CFITSIO is compiled in, the exposure start time keywords are updated using 
+ * Exposure_Save_Update_Keywords before the file is closed.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param stream The address of an open stream structure.
+ * @param start_time The start time of the exposure.
+ * @return Returns TRUE if the file was closed successfully, FALSE if it fails.
+ * @see #Exposure_Stream_Struct
+ * @see #Exposure_Save_Update_Keywords
+ * @see #Exposure_FITS_Mutex_Lock
+ * @see #Exposure_FITS_Mutex_UnLock
+ */
+static int Exposure_Stream_Close(char *class,char *source,struct Exposure_Stream_Struct *stream,
+				 struct timespec start_time)
+{
+#ifdef CFITSIO
+	int retval=0,status=0;
+	char buff[32]; /* fits_get_errstatus returns 30 chars max */
+#endif
+
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Stream_Close(%s):Started.",
+			      stream->Filename);
+#endif
+#ifdef CFITSIO
+#ifdef CCD_CFITSIO_MUTEXED
+	if(!Exposure_FITS_Mutex_Lock())
+	{
+		Exposure_Stream_Abort(stream);
+		return FALSE;
+	}
+#endif
+	if(!Exposure_Save_Update_Keywords(class,source,stream->Fp,stream->Filename,start_time))
+	{
+		fits_close_file(stream->Fp,&status);
+		stream->Fp = NULL;
+#ifdef CCD_CFITSIO_MUTEXED
+		Exposure_FITS_Mutex_Unlock();
+#endif
+		free(stream->Row_Buffer);
+		stream->Row_Buffer = NULL;
+		return FALSE;
+	}
+	retval = fits_close_file(stream->Fp,&status);
+	stream->Fp = NULL;
+#ifdef CCD_CFITSIO_MUTEXED
+	Exposure_FITS_Mutex_Unlock();
+#endif
+	free(stream->Row_Buffer);
+	stream->Row_Buffer = NULL;
+	if(retval)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		Exposure_Error_Number = 82;
+		sprintf(Exposure_Error_String,"Exposure_Stream_Close: File close failed(%s,%d,%s).",stream->Filename,
+			status,buff);
+		return FALSE;
+	}
+#else
+	fclose(stream->Fp);
+	stream->Fp = NULL;
+#endif
+	free(stream->Row_Buffer);
+	stream->Row_Buffer = NULL;
+#if LOGGING > 4
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_INTERMEDIATE,"Exposure_Stream_Close(%s):Completed.",
+			      stream->Filename);
 #endif
 	return TRUE;
 }
+
+/**
+ * Routine to close a streaming readout FITS file, after an error or abort, and free the row buffer. 
+ * Nothing is done if the stream is not open. No keywords are updated and no errors are reported, as the caller is usually about to 
+ * delete the FITS file using Exposure_Expose_Delete_Fits_Images.
+ * @param stream The address of a stream structure.
+ * @see #Exposure_Stream_Struct
+ * @see #Exposure_FITS_Mutex_Lock
+ * @see #Exposure_FITS_Mutex_UnLock
+ */
+static void Exposure_Stream_Abort(struct Exposure_Stream_Struct *stream)
+{
+#ifdef CFITSIO
+	int status=0;
+#endif
+
+	if(stream->Row_Buffer != NULL)
+	{
+		free(stream->Row_Buffer);
+		stream->Row_Buffer = NULL;
+	}
+	if(stream->Fp == NULL)
+		return;
+#ifdef CFITSIO
+#ifdef CCD_CFITSIO_MUTEXED
+	if(!Exposure_FITS_Mutex_Lock())
+		return;
+#endif
+	fits_close_file(stream->Fp,&status);
+#ifdef CCD_CFITSIO_MUTEXED
+	Exposure_FITS_Mutex_Unlock();
+#endif
+#else
+	fclose(stream->Fp);
+#endif
+	stream->Fp = NULL;
+}
+
+/**
+ * Routine to decide how long the exposure monitor loop in CCD_Exposure_Expose should sleep before 
+ * polling the controller again. This depends on the exposure status:
+ * <ul>
+ * <li>EXPOSE: Poll coarsely (EXPOSURE_POLL_COARSE_TIME), but wake up in time to switch the exposure status 
+ *     to PRE_READOUT Readout_Remaining_Time milliseconds before the end of the exposure. We do not poll faster 
+ *     than EXPOSURE_POLL_READOUT_TIME, as each poll sends a RET to the utility board.
+ * <li>PRE_READOUT: Poll finely (EXPOSURE_POLL_FINE_TIME), so we catch the readout starting even if it is
+ *     very short.
+ * <li>READOUT: If the pixel readout rate has been measured, sleep until the readout is predicted to end
+ *     (limited to between EXPOSURE_POLL_FINE_TIME and EXPOSURE_POLL_COARSE_TIME). Otherwise use 
+ *     EXPOSURE_POLL_READOUT_TIME.
+ * </ul>
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param exposure_time The length of the exposure in milliseconds.
+ * @param elapsed_exposure_time The last elapsed exposure time retrieved from the controller, in milliseconds.
+ * @param expected_pixel_count The number of pixels that will be read out.
+ * @param current_pixel_count The number of pixels read out so far.
+ * @param pixel_rate The measured readout rate, in pixels per millisecond, or 0.0 if not known yet.
+ * @return The time to sleep, in milliseconds.
+ * @see #EXPOSURE_POLL_COARSE_TIME
+ * @see #EXPOSURE_POLL_FINE_TIME
+ * @see #EXPOSURE_POLL_READOUT_TIME
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static int Exposure_Poll_Interval(CCD_Interface_Handle_T* handle,int exposure_time,int elapsed_exposure_time,
+				  int expected_pixel_count,int current_pixel_count,double pixel_rate)
+{
+	int poll_time;
+
+	switch(handle->Exposure_Data.Exposure_Status)
+	{
+		case CCD_EXPOSURE_STATUS_EXPOSE:
+			poll_time = (exposure_time-elapsed_exposure_time)-handle->Exposure_Data.Readout_Remaining_Time;
+			if(poll_time < EXPOSURE_POLL_READOUT_TIME)
+				poll_time = EXPOSURE_POLL_READOUT_TIME;
+			break;
+		case CCD_EXPOSURE_STATUS_PRE_READOUT:
+			poll_time = EXPOSURE_POLL_FINE_TIME;
+			break;
+		case CCD_EXPOSURE_STATUS_READOUT:
+			if(pixel_rate > 0.0)
+			{
+				poll_time = (int)(((double)(expected_pixel_count-current_pixel_count))/pixel_rate);
+				if(poll_time < EXPOSURE_POLL_FINE_TIME)
+					poll_time = EXPOSURE_POLL_FINE_TIME;
+			}
+			else
+				poll_time = EXPOSURE_POLL_READOUT_TIME;
+			break;
+		default:
+			poll_time = EXPOSURE_POLL_COARSE_TIME;
+			break;
+	}
+	if(poll_time > EXPOSURE_POLL_COARSE_TIME)
+		poll_time = EXPOSURE_POLL_COARSE_TIME;
+	return poll_time;
+}
+
+/**
+ * Routine to return the difference between two timespec structures, in milliseconds.
+ * @param start_time The earlier time.
+ * @param end_time The later time.
+ * @return The time difference (end_time - start_time), in milliseconds.
+ * @see ccd_global.html#CCD_GLOBAL_ONE_SECOND_MS
+ * @see ccd_global.html#CCD_GLOBAL_ONE_MILLISECOND_NS
+ */
+static double Exposure_TimeSpec_Diff_Ms(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*((double)CCD_GLOBAL_ONE_SECOND_MS))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/((double)CCD_GLOBAL_ONE_MILLISECOND_NS));
+}
+
+/**
+ * Routine to set the Exposure_Start_Time to the Start_Exposure_Send_Time plus the measured start latency.
+ * If no start latency has been measured yet, the Exposure_Start_Time is the Start_Exposure_Send_Time.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see #CCD_Exposure_Get_Start_Exposure_Latency
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static void Exposure_Start_Time_Add_Latency(CCD_Interface_Handle_T* handle)
+{
+	handle->Exposure_Data.Exposure_Start_Time = handle->Exposure_Data.Start_Exposure_Send_Time;
+	if(handle->Exposure_Data.Start_Exposure_Latency_Count > 0)
+	{
+		handle->Exposure_Data.Exposure_Start_Time.tv_nsec += CCD_Exposure_Get_Start_Exposure_Latency(handle);
+		while(handle->Exposure_Data.Exposure_Start_Time.tv_nsec >= CCD_GLOBBAL_ONE_SECOND_NS)
+		{
+			handle->Exposure_Data.Exposure_Start_Time.tv_sec++;
+			handle->Exposure_Data.Exposure_Start_Time.tv_nsec -= CCD_GLOBBAL_ONE_SECOND_NS;
+		}
+	}
+	Exposure_Status_Publish(handle);
+}
+
+/**
+ * Routine to change the exposure status, and publish the new status to the status snapshot.
+ * This should be used by the thread taking the exposure, instead of setting Exposure_Status directly.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param status The new exposure status.
+ * @see #Exposure_Status_Publish
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static void Exposure_Status_Set(CCD_Interface_Handle_T* handle,enum CCD_EXPOSURE_STATUS status)
+{
+	handle->Exposure_Data.Exposure_Status = status;
+	Exposure_Status_Publish(handle);
+}
+
+/**
+ * Routine to copy the current Exposure_Status, Exposure_Length and Exposure_Start_Time into the
+ * status snapshot. The progress fields of the snapshot are left as they are.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see #Exposure_Status_Write_Begin
+ * @see #Exposure_Status_Write_End
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static void Exposure_Status_Publish(CCD_Interface_Handle_T* handle)
+{
+	Exposure_Status_Write_Begin(handle);
+	handle->Exposure_Data.Status_Snapshot.Exposure_Status = handle->Exposure_Data.Exposure_Status;
+	handle->Exposure_Data.Status_Snapshot.Exposure_Length = handle->Exposure_Data.Exposure_Length;
+	handle->Exposure_Data.Status_Snapshot.Exposure_Start_Time = handle->Exposure_Data.Exposure_Start_Time;
+	Exposure_Status_Write_End(handle);
+}
+
+/**
+ * Routine to publish the status and progress of an exposure to the status snapshot.
+ * <ul>
+ * <li>The elapsed exposure time is the time since Exposure_Start_Time whilst exposing (limited to the 
+ * 	exposure length), and the exposure length once we are reading out.
+ * <li>The readout progress is the percentage of the expected pixels read out.
+ * <li>Whilst reading out, once the readout rate has been measured, the predicted end time is when the
+ * 	remaining pixels will have been read out at that rate. Whilst exposing, it is the end of the exposure 
+ * 	plus the time the readout took at the rate measured at the end of the last readout (Readout_Pixel_Rate).
+ * </ul>
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param expose The address of the exposure state.
+ * @see #Exposure_Expose_Struct
+ * @see #Exposure_Status_Write_Begin
+ * @see #Exposure_Status_Write_End
+ * @see #Exposure_TimeSpec_Diff_Ms
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Time
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static void Exposure_Status_Publish_Progress(CCD_Interface_Handle_T* handle,struct Exposure_Expose_Struct *expose)
+{
+	struct CCD_Exposure_Status_Struct *status_snapshot = &(handle->Exposure_Data.Status_Snapshot);
+	struct timespec current_time,end_time;
+	double elapsed_ms,remaining_ms;
+	long long end_ns;
+
+	CCD_Global_Metrics_Get_Time(&current_time);
+	elapsed_ms = 0.0;
+	remaining_ms = 0.0;
+	end_time.tv_sec = 0;
+	end_time.tv_nsec = 0;
+	switch(handle->Exposure_Data.Exposure_Status)
+	{
+		case CCD_EXPOSURE_STATUS_EXPOSE:
+		case CCD_EXPOSURE_STATUS_PRE_READOUT:
+			elapsed_ms = Exposure_TimeSpec_Diff_Ms(handle->Exposure_Data.Exposure_Start_Time,current_time);
+			if(elapsed_ms < 0.0)
+				elapsed_ms = 0.0;
+			if(elapsed_ms > ((double)expose->Exposure_Time))
+				elapsed_ms = (double)(expose->Exposure_Time);
+			remaining_ms = ((double)expose->Exposure_Time)-elapsed_ms;
+			if(handle->Exposure_Data.Readout_Pixel_Rate > 0.0)
+			{
+				remaining_ms += ((double)expose->Expected_Pixel_Count)/
+					handle->Exposure_Data.Readout_Pixel_Rate;
+			}
+			end_time = current_time;
+			break;
+		case CCD_EXPOSURE_STATUS_READOUT:
+		case CCD_EXPOSURE_STATUS_POST_READOUT:
+			elapsed_ms = (double)(expose->Exposure_Time);
+			if(expose->Current_Pixel_Count >= expose->Expected_Pixel_Count)
+			{
+				remaining_ms = 0.0;
+				end_time = current_time;
+			}
+			else if(expose->Pixel_Rate > 0.0)
+			{
+				remaining_ms = ((double)(expose->Expected_Pixel_Count-expose->Current_Pixel_Count))/
+					expose->Pixel_Rate;
+				end_time = current_time;
+			}
+			break;
+		default:
+			break;
+	}
+	if(end_time.tv_sec > 0)
+	{
+		end_ns = ((long long)end_time.tv_nsec)+((long long)(remaining_ms*CCD_GLOBAL_ONE_MILLISECOND_NS));
+		end_time.tv_sec += (time_t)(end_ns/CCD_GLOBBAL_ONE_SECOND_NS);
+		end_time.tv_nsec = (long)(end_ns%CCD_GLOBBAL_ONE_SECOND_NS);
+	}
+	Exposure_Status_Write_Begin(handle);
+	status_snapshot->Exposure_Status = handle->Exposure_Data.Exposure_Status;
+	status_snapshot->Exposure_Length = handle->Exposure_Data.Exposure_Length;
+	status_snapshot->Exposure_Start_Time = handle->Exposure_Data.Exposure_Start_Time;
+	status_snapshot->Elapsed_Exposure_Time = (int)elapsed_ms;
+	status_snapshot->Readout_Pixel_Count = expose->Current_Pixel_Count;
+	status_snapshot->Expected_Pixel_Count = expose->Expected_Pixel_Count;
+	if(expose->Expected_Pixel_Count > 0)
+	{
+		status_snapshot->Readout_Progress = (100.0*((double)expose->Current_Pixel_Count))/
+			((double)expose->Expected_Pixel_Count);
+		if(status_snapshot->Readout_Progress > 100.0)
+			status_snapshot->Readout_Progress = 100.0;
+	}
+	else
+		status_snapshot->Readout_Progress = 0.0;
+	status_snapshot->Predicted_End_Time = end_time;
+	status_snapshot->Update_Time = current_time;
+	Exposure_Status_Write_End(handle);
+}
+
+/**
+ * Routine to start updating the status snapshot. Status_Sequence is moved from even to odd, 
+ * telling readers the snapshot is being changed. If another thread is already updating the snapshot
+ * (Status_Sequence is odd), we wait for it to finish first, so updates never overlap.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see #Exposure_Status_Write_End
+ * @see #CCD_Exposure_Get_Status_Snapshot
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static void Exposure_Status_Write_Begin(CCD_Interface_Handle_T* handle)
+{
+	unsigned int sequence;
+
+	do
+	{
+		sequence = handle->Exposure_Data.Status_Sequence;
+		if(sequence & 1)
+			sched_yield();
+	}
+	while((sequence & 1)||
+	      (!__sync_bool_compare_and_swap(&(handle->Exposure_Data.Status_Sequence),sequence,sequence+1)));
+}
+
+/**
+ * Routine to finish updating the status snapshot. Status_Sequence is moved from odd to even,
+ * after the updated fields (the atomic increment is a full memory barrier).
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see #Exposure_Status_Write_Begin
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static void Exposure_Status_Write_End(CCD_Interface_Handle_T* handle)
+{
+	__sync_fetch_and_add(&(handle->Exposure_Data.Status_Sequence),1);
+}
+
+/**
+ * Routine to start timing a stage of CCD_Exposure_Expose.
+ * @param stage_start_time The address of a timespec, filled in with the current time.
+ * @see #Exposure_Stage_End
+ */
+static void Exposure_Stage_Start(struct timespec *stage_start_time)
+{
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+
+#ifdef _POSIX_TIMERS
+	clock_gettime(CLOCK_REALTIME,stage_start_time);
+#else
+	gettimeofday(&gtod_current_time,NULL);
+	stage_start_time->tv_sec = gtod_current_time.tv_sec;
+	stage_start_time->tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
 #endif
+}
+
+/**
+ * Routine to finish timing a stage of CCD_Exposure_Expose. The time since stage_start_time is stored in
+ * the handle's Stage_Time_List, and stage_start_time is reset to the current time, so the next stage
+ * is timed from the end of this one.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param stage The stage that has finished.
+ * @param stage_start_time The address of a timespec, holding the time the stage started.
+ * @see #Exposure_Stage_Start
+ * @see #Exposure_TimeSpec_Diff_Ms
+ * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ */
+static void Exposure_Stage_End(CCD_Interface_Handle_T* handle,enum CCD_EXPOSURE_STAGE stage,
+			       struct timespec *stage_start_time)
+{
+	struct timespec current_time;
+
+	Exposure_Stage_Start(&current_time);
+	handle->Exposure_Data.Stage_Time_List[stage] = Exposure_TimeSpec_Diff_Ms(*stage_start_time,current_time);
+	(*stage_start_time) = current_time;
+}
 
 /**
  * Routine to convert a timespec structure to a DATE sytle string to put into a FITS header.
@@ -33,6 +33,11 @@
  * causes struct timeval not to be defined in time.h, and then resource.h complains about this (under Solaris).
  */
 #define _XOPEN_SOURCE_EXTENDED 	(1)
+/**
+ * This hash define is needed to make header files declare snprintf/vsnprintf, which are used to format log
+ * messages into fixed length buffers, even when _POSIX_C_SOURCE is defined.
+ */
+#define _ISOC99_SOURCE		(1)
 
 #include <stdio.h>
 #include <errno.h>
@@ -42,6 +47,10 @@
 #include <time.h>
 #include <stdarg.h>
 #include <unistd.h>
+#ifndef _POSIX_TIMERS
+#include <sys/time.h>
+#endif
+#include <pthread.h>
 #if CCD_GLOBAL_READOUT_PRIORITY == 0
 /* include nothing for normal priority readout */
 #elif CCD_GLOBAL_READOUT_PRIORITY == 1
@@ -65,6 +74,7 @@
 #include "ccd_exposure.h"
 #include "ccd_temperature.h"
 #include "ccd_setup.h"
+#include "ccd_interface_private.h"
 
 /* hash definitions */
 /**
@@ -97,6 +107,40 @@
  * @see #PAGESIZE
  */
 #define GLOBAL_ROUND_UP_TO_PAGE(v)		(((unsigned long)(v) + PAGESIZE -1)& ~(PAGESIZE-1))
+/**
+ * The number of log records in the log ring. This must be a power of two.
+ * @see #Global_Log_Ring
+ */
+#define GLOBAL_LOG_RING_LENGTH			(512)
+/**
+ * The maximum number of arguments (including '*' widths and precisions) a log message can have
+ * and still be formatted by the log ring consumer thread. Messages with more arguments are formatted when they
+ * are logged.
+ * @see #Global_Log_Record_Struct
+ */
+#define GLOBAL_LOG_ARGUMENT_COUNT		(16)
+/**
+ * The length of the string buffer in each log record. This holds copies of any string (%s) arguments,
+ * or the formatted message if it could not be captured as binary arguments. 
+ * It is also the maximum length of a formatted log message.
+ * @see #Global_Log_Record_Struct
+ */
+#define GLOBAL_LOG_STRING_LENGTH		(512)
+/**
+ * The length of the class and source strings copied into each log record.
+ * @see #Global_Log_Record_Struct
+ */
+#define GLOBAL_LOG_NAME_LENGTH			(32)
+/**
+ * The maximum length of a single conversion specification (e.g. "%-10.3f") in a log format string.
+ * @see #Global_Log_Parse_Conversion
+ */
+#define GLOBAL_LOG_CONVERSION_LENGTH		(32)
+/**
+ * The length of time the log ring consumer thread sleeps when the ring is empty, in milliseconds.
+ * @see #Global_Log_Ring_Thread
+ */
+#define GLOBAL_LOG_RING_SLEEP_MS		(10)
 
 /* data types */
 /**
@@ -137,19 +181,129 @@ struct Global_Struct
 	int Global_Log_Filter_Level;
 };
 
+/**
+ * Enumeration of the types of argument that can be stored in a log record.
+ * <ul>
+ * <li>GLOBAL_LOG_ARGUMENT_NONE - A literal '%%', which takes no argument.
+ * <li>GLOBAL_LOG_ARGUMENT_INT - An int (d,i,o,u,x,X,c conversions, and '*' widths/precisions).
+ * <li>GLOBAL_LOG_ARGUMENT_LONG - A long (l length modifier).
+ * <li>GLOBAL_LOG_ARGUMENT_LONG_LONG - A long long (ll or q length modifier).
+ * <li>GLOBAL_LOG_ARGUMENT_DOUBLE - A double (e,E,f,F,g,G,a,A conversions).
+ * <li>GLOBAL_LOG_ARGUMENT_STRING - A string (s conversion), copied into the record's string buffer.
+ * <li>GLOBAL_LOG_ARGUMENT_POINTER - A pointer (p conversion).
+ * </ul>
+ * @see #Global_Log_Argument_Struct
+ */
+enum GLOBAL_LOG_ARGUMENT_TYPE
+{
+	GLOBAL_LOG_ARGUMENT_NONE,GLOBAL_LOG_ARGUMENT_INT,GLOBAL_LOG_ARGUMENT_LONG,GLOBAL_LOG_ARGUMENT_LONG_LONG,
+	GLOBAL_LOG_ARGUMENT_DOUBLE,GLOBAL_LOG_ARGUMENT_STRING,GLOBAL_LOG_ARGUMENT_POINTER
+};
+
+/**
+ * Structure holding one captured log message argument.
+ * <dl>
+ * <dt>Type</dt> <dd>Which member of Value holds the argument.</dd>
+ * <dt>Value</dt> <dd>A union of the argument value. For strings, String_Offset is the offset of the copied 
+ * 	string in the record's String buffer.</dd>
+ * </dl>
+ * @see #GLOBAL_LOG_ARGUMENT_TYPE
+ */
+struct Global_Log_Argument_Struct
+{
+	enum GLOBAL_LOG_ARGUMENT_TYPE Type;
+	union
+	{
+		int Int;
+		long Long;
+		long long Long_Long;
+		double Double;
+		int String_Offset;
+		void *Pointer;
+	} Value;
+};
+
+/**
+ * Structure holding one log message in the log ring. The message is pre-filtered, and stored in binary form,
+ * so it can be formatted and passed to the log handler by the log ring consumer thread.
+ * <dl>
+ * <dt>Sequence</dt> <dd>The ring sequence number of this record, used to claim and publish the record
+ * 	without locking.</dd>
+ * <dt>Level</dt> <dd>The log level of the message.</dd>
+ * <dt>Class</dt> <dd>A copy of the class that produced this message.</dd>
+ * <dt>Source</dt> <dd>A copy of the source that produced this message.</dd>
+ * <dt>Format</dt> <dd>The format string (which is assumed to be a string constant), or NULL if String
+ * 	already holds the formatted message.</dd>
+ * <dt>Argument_Count</dt> <dd>The number of arguments in Argument_List.</dd>
+ * <dt>Argument_List</dt> <dd>The captured arguments, in format string order.</dd>
+ * <dt>String_Length</dt> <dd>The number of bytes of String used by copied string arguments.</dd>
+ * <dt>String</dt> <dd>The copied string arguments, or the formatted message if Format is NULL.</dd>
+ * </dl>
+ * @see #GLOBAL_LOG_NAME_LENGTH
+ * @see #GLOBAL_LOG_ARGUMENT_COUNT
+ * @see #GLOBAL_LOG_STRING_LENGTH
+ */
+struct Global_Log_Record_Struct
+{
+	volatile unsigned int Sequence;
+	int Level;
+	char Class[GLOBAL_LOG_NAME_LENGTH];
+	char Source[GLOBAL_LOG_NAME_LENGTH];
+	char *Format;
+	int Argument_Count;
+	struct Global_Log_Argument_Struct Argument_List[GLOBAL_LOG_ARGUMENT_COUNT];
+	int String_Length;
+	char String[GLOBAL_LOG_STRING_LENGTH];
+};
+
+/**
+ * Structure holding the log ring, a bounded multi-producer single-consumer queue of log records.
+ * Logging threads claim a record by atomically advancing Enqueue_Position, fill it in, and publish it by
+ * setting it's Sequence. The consumer thread formats each published record and passes it to the log handler.
+ * If the ring is full, the message is dropped and counted rather than blocking the logging thread.
+ * <dl>
+ * <dt>Initialised</dt> <dd>Whether the record sequence numbers have been initialised.</dd>
+ * <dt>Running</dt> <dd>Whether the consumer thread is running. Log messages are only put into the ring
+ * 	whilst this is TRUE, otherwise they are passed straight to the log handler.</dd>
+ * <dt>Quit</dt> <dd>Set to TRUE to tell the consumer thread to empty the ring and exit.</dd>
+ * <dt>Thread</dt> <dd>The consumer thread.</dd>
+ * <dt>Enqueue_Position</dt> <dd>The ring position of the next record to be claimed by a logging thread.</dd>
+ * <dt>Dequeue_Position</dt> <dd>The ring position of the next record to be consumed.</dd>
+ * <dt>Dropped_Count</dt> <dd>The number of messages dropped because the ring was full.</dd>
+ * <dt>Record_List</dt> <dd>The ring of log records.</dd>
+ * </dl>
+ * @see #GLOBAL_LOG_RING_LENGTH
+ * @see #Global_Log_Record_Struct
+ */
+struct Global_Log_Ring_Struct
+{
+	int Initialised;
+	volatile int Running;
+	volatile int Quit;
+	pthread_t Thread;
+	volatile unsigned int Enqueue_Position;
+	unsigned int Dequeue_Position;
+	volatile int Dropped_Count;
+	struct Global_Log_Record_Struct Record_List[GLOBAL_LOG_RING_LENGTH];
+};
+
 /* internal data */
 /**
  * Revision Control System identifier.
  */
 static char rcsid[] = "$Id: ccd_global.c,v 0.15 2011-01-17 10:57:54 cjm Exp $";
 /**
- * Variable holding error code of last operation performed by ccd_dsp.
+ * Variable holding error code of last operation performed by ccd_global,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int Global_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int Global_Error_Number = 0;
 /**
- * Internal variable holding description of the last error that occured.
+ * Internal variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char Global_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char Global_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 /**
  * The instance of Global_Struct that contains local data for this module.
  * This is statically initialised to the following:
@@ -174,12 +328,46 @@ static struct Global_Struct Global_Data =
 	NULL,NULL,0
 };
 
+/**
+ * The log ring. This is statically allocated so logging never allocates memory.
+ * @see #Global_Log_Ring_Struct
+ */
+static struct Global_Log_Ring_Struct Global_Log_Ring;
+
+/**
+ * The ioctl requests the per-handle metrics are kept for, in the order they are indexed in
+ * Metrics_Data.Ioctl_List. Any other request is counted in the last entry 
+ * (index CCD_GLOBAL_METRICS_IOCTL_COUNT-1), which has no request in this list.
+ * @see #CCD_Global_Metrics_Ioctl_Add
+ * @see #CCD_Global_Metrics_Get_Ioctl
+ * @see ccd_global_private.html#CCD_Global_Metrics_Struct
+ * @see ccd_pci.html#CCD_PCI_IOCTL_GET_HCTR
+ */
+static int Global_Metrics_Ioctl_Request_List[CCD_GLOBAL_METRICS_IOCTL_COUNT-1] = 
+{
+	CCD_PCI_IOCTL_GET_HCTR,CCD_PCI_IOCTL_GET_PROGRESS,CCD_PCI_IOCTL_GET_DMA_ADDR,CCD_PCI_IOCTL_GET_HSTR,
+	CCD_PCI_IOCTL_HCVR_DATA,CCD_PCI_IOCTL_SET_HCTR,CCD_PCI_IOCTL_SET_HCVR,CCD_PCI_IOCTL_PCI_DOWNLOAD,
+	CCD_PCI_IOCTL_PCI_DOWNLOAD_WAIT,CCD_PCI_IOCTL_COMMAND,CCD_PCI_IOCTL_SET_CMDR,CCD_PCI_IOCTL_SET_DESTINATION,
+	CCD_PCI_IOCTL_SET_IMAGE_BUFFERS,CCD_PCI_IOCTL_SET_UTIL_OPTIONS,CCD_PCI_IOCTL_ABORT_READ
+};
+
 /**
  * General buffer used for string formatting during logging.
  * @see #CCD_GLOBAL_ERROR_STRING_LENGTH
  */
 static char Global_Buff[CCD_GLOBAL_ERROR_STRING_LENGTH];
 
+/* internal functions */
+static struct Global_Log_Record_Struct *Global_Log_Ring_Claim(char *class,char *source,int level,
+							      unsigned int *position);
+static void Global_Log_Ring_Publish(struct Global_Log_Record_Struct *record,unsigned int position);
+static int Global_Log_Record_Capture(struct Global_Log_Record_Struct *record,char *format,va_list ap);
+static void Global_Log_Record_Format(struct Global_Log_Record_Struct *record,char *buff,int buff_length);
+static int Global_Log_Parse_Conversion(char *format,int *length,int *star_count,
+				       enum GLOBAL_LOG_ARGUMENT_TYPE *type);
+static void *Global_Log_Ring_Thread(void *user_arg);
+static void Global_Metrics_Timer_Update(struct CCD_Global_Metrics_Timer_Struct *timer,long long time_ns);
+
 /* ----------------------------------------------------------------------------
 ** 		external functions 
 ** ---------------------------------------------------------------------------- */
@@ -396,6 +584,45 @@ void CCD_Global_Error_String(char *error_string)
 	}
 }
 
+/**
+ * Routine to get the error number of the last error generated by the library in the calling thread.
+ * The modules are checked in the same order as CCD_Global_Error_String, and the first non-zero error number found
+ * is returned (the top level module that failed). As the error state is thread local, this is the error 
+ * generated by the last failed call made by the calling thread, whatever the other arm's thread is doing.
+ * @return The error number, or zero if no error has been generated.
+ * @see #CCD_Global_Error_String
+ * @see #CCD_GLOBAL_THREAD_LOCAL
+ * @see #Global_Error_Number
+ * @see ccd_setup.html#CCD_Setup_Get_Error_Number
+ * @see ccd_exposure.html#CCD_Exposure_Get_Error_Number
+ * @see ccd_temperature.html#CCD_Temperature_Get_Error_Number
+ * @see ccd_dsp_download.html#CCD_DSP_Download_Get_Error_Number
+ * @see ccd_dsp.html#CCD_DSP_Get_Error_Number
+ * @see ccd_interface.html#CCD_Interface_Get_Error_Number
+ * @see ccd_pci.html#CCD_PCI_Get_Error_Number
+ * @see ccd_text.html#CCD_Text_Get_Error_Number
+ */
+int CCD_Global_Get_Error_Number(void)
+{
+	if(CCD_Setup_Get_Error_Number() != 0)
+		return CCD_Setup_Get_Error_Number();
+	if(CCD_Exposure_Get_Error_Number() != 0)
+		return CCD_Exposure_Get_Error_Number();
+	if(CCD_Temperature_Get_Error_Number() != 0)
+		return CCD_Temperature_Get_Error_Number();
+	if(CCD_DSP_Download_Get_Error_Number() != 0)
+		return CCD_DSP_Download_Get_Error_Number();
+	if(CCD_DSP_Get_Error_Number() != 0)
+		return CCD_DSP_Get_Error_Number();
+	if(CCD_Interface_Get_Error_Number() != 0)
+		return CCD_Interface_Get_Error_Number();
+	if(CCD_PCI_Get_Error_Number() != 0)
+		return CCD_PCI_Get_Error_Number();
+	if(CCD_Text_Get_Error_Number() != 0)
+		return CCD_Text_Get_Error_Number();
+	return Global_Error_Number;
+}
+
 /**
  * Routine to get the current time in a string. The string is returned in the format
  * '01/01/2000 13:59:59', or the string "Unknown time" if the routine failed.
@@ -419,26 +646,69 @@ void CCD_Global_Get_Current_Time_String(char *time_string,int string_length)
 
 /**
  * Routine to log a message to a defined logging mechanism. This routine has an arbitary number of arguments,
- * and uses vsprintf to format them i.e. like fprintf. A buffer is used to hold the created string,
- * therefore the total length of the generated string should not be longer than CCD_GLOBAL_ERROR_STRING_LENGTH.
- * CCD_Global_Log is then called to handle the log message.
+ * and uses vsnprintf to format them i.e. like fprintf. 
+ * If the log ring is running (CCD_Global_Log_Ring_Start), the message is filtered using the format string,
+ * and if selected, the arguments are captured into a log ring record without formatting them. 
+ * The log ring consumer thread then formats the message and calls the log handler. 
+ * If the arguments cannot be captured (an unsupported conversion or too many arguments), 
+ * the message is formatted into the record instead.
+ * If the ring is not running, a buffer is used to hold the created string, and CCD_Global_Log is then called 
+ * to handle the log message. The total length of the generated string is truncated to 
+ * GLOBAL_LOG_STRING_LENGTH.
  * @param class The class that produced this log message.
  * @param source The source that produced this log message.
  * @param level An integer, used to decide whether this particular message has been selected for
  * 	logging or not.
  * @param format A string, with formatting statements the same as fprintf would use to determine the type
- * 	of the following arguments.
+ * 	of the following arguments. This should be a string constant, as it is formatted after this routine
+ * 	has returned when the log ring is running.
  * @see #CCD_Global_Log
- * @see #CCD_GLOBAL_ERROR_STRING_LENGTH
+ * @see #CCD_Global_Log_Ring_Start
+ * @see #Global_Data
+ * @see #Global_Log_Ring
+ * @see #Global_Log_Ring_Claim
+ * @see #Global_Log_Record_Capture
+ * @see #Global_Log_Ring_Publish
+ * @see #GLOBAL_LOG_STRING_LENGTH
  */
 void CCD_Global_Log_Format(char *class,char *source,int level,char *format,...)
 {
-	char buff[512];
+	struct Global_Log_Record_Struct *record = NULL;
+	char buff[GLOBAL_LOG_STRING_LENGTH];
+	unsigned int position;
 	va_list ap;
+	int retval;
 
+/* If the format is NULL, or there is no log handler, don't log. */
+	if((format == NULL)||(Global_Data.Global_Log_Handler == NULL))
+		return;
+	if(Global_Log_Ring.Running)
+	{
+	/* If there's a log filter, check it returns TRUE for this message (the unformatted format string) */
+		if(Global_Data.Global_Log_Filter != NULL)
+		{
+			if(Global_Data.Global_Log_Filter(class,source,level,format) == FALSE)
+				return;
+		}
+		record = Global_Log_Ring_Claim(class,source,level,&position);
+		if(record == NULL)
+			return; /* ring full, message dropped */
+		va_start(ap,format);
+		retval = Global_Log_Record_Capture(record,format,ap);
+		va_end(ap);
+		if(retval == FALSE)
+		{
+			va_start(ap,format);
+			vsnprintf(record->String,GLOBAL_LOG_STRING_LENGTH,format,ap);
+			va_end(ap);
+			record->Format = NULL;
+		}
+		Global_Log_Ring_Publish(record,position);
+		return;
+	}
 /* format the arguments */
 	va_start(ap,format);
-	vsprintf(buff,format,ap);
+	vsnprintf(buff,GLOBAL_LOG_STRING_LENGTH,format,ap);
 	va_end(ap);
 /* call the log routine to log the results */
 	CCD_Global_Log(class,source,level,buff);
@@ -448,15 +718,23 @@ void CCD_Global_Log_Format(char *class,char *source,int level,char *format,...)
  * Routine to log a message to a defined logging mechanism. If the string or Global_Data.Global_Log_Handler are NULL
  * the routine does not log the message. If the Global_Data.Global_Log_Filter function pointer is non-NULL, the
  * message is passed to it to determine whether to log the message.
+ * If the log ring is running, the message is copied into a log ring record, and the log ring consumer
+ * thread calls the log handler. Otherwise the log handler is called directly.
  * @param class The class that produced this log message.
  * @param source The source that produced this log message.
  * @param level An integer, used to decide whether this particular message has been selected for
  * 	logging or not.
  * @param string The message to log.
  * @see #Global_Data
+ * @see #Global_Log_Ring
+ * @see #Global_Log_Ring_Claim
+ * @see #Global_Log_Ring_Publish
  */
 void CCD_Global_Log(char *class,char *source,int level,char *string)
 {
+	struct Global_Log_Record_Struct *record = NULL;
+	unsigned int position;
+
 /* If the string is NULL, don't log. */
 	if(string == NULL)
 		return;
@@ -469,6 +747,18 @@ void CCD_Global_Log(char *class,char *source,int level,char *string)
 		if(Global_Data.Global_Log_Filter(class,source,level,string) == FALSE)
 			return;
 	}
+/* If the log ring is running, pass the message to the consumer thread */
+	if(Global_Log_Ring.Running)
+	{
+		record = Global_Log_Ring_Claim(class,source,level,&position);
+		if(record == NULL)
+			return; /* ring full, message dropped */
+		strncpy(record->String,string,GLOBAL_LOG_STRING_LENGTH-1);
+		record->String[GLOBAL_LOG_STRING_LENGTH-1] = '\0';
+		record->Format = NULL;
+		Global_Log_Ring_Publish(record,position);
+		return;
+	}
 /* We can log the message */
 	(*Global_Data.Global_Log_Handler)(class,source,level,string);
 }
@@ -549,6 +839,92 @@ int CCD_Global_Log_Filter_Level_Bitwise(char *class,char *source,int level,char
 	return ((level & Global_Data.Global_Log_Filter_Level) > 0);
 }
 
+/**
+ * Routine to start the log ring. After this routine returns, messages logged with CCD_Global_Log_Format and 
+ * CCD_Global_Log are filtered and put into the log ring by the logging thread, and a separate consumer thread
+ * formats them and calls the log handler (Global_Data.Global_Log_Handler). This means the logging thread
+ * (e.g. during an image readout) never formats filtered out messages, never calls the log handler
+ * (which may be slow, e.g. a JNI call to a Java logger), and never blocks on a lock. If the ring fills up,
+ * messages are dropped (and counted) rather than slowing down the logging thread.
+ * If the log ring is already running, this routine does nothing and returns TRUE.
+ * @return The routine returns TRUE if the log ring was started, and FALSE if an error occured.
+ * @see #Global_Log_Ring
+ * @see #Global_Log_Ring_Thread
+ * @see #CCD_Global_Log_Ring_Stop
+ * @see #CCD_Global_Log_Format
+ * @see #CCD_Global_Log
+ */
+int CCD_Global_Log_Ring_Start(void)
+{
+	int i,retval;
+
+	Global_Error_Number = 0;
+	if(Global_Log_Ring.Running)
+		return TRUE;
+	/* The ring positions are only initialised once, so records published by a logging thread 
+	** during a previous stop are not lost. */
+	if(Global_Log_Ring.Initialised == FALSE)
+	{
+		for(i=0;i<GLOBAL_LOG_RING_LENGTH;i++)
+			Global_Log_Ring.Record_List[i].Sequence = i;
+		Global_Log_Ring.Enqueue_Position = 0;
+		Global_Log_Ring.Dequeue_Position = 0;
+		Global_Log_Ring.Dropped_Count = 0;
+		Global_Log_Ring.Initialised = TRUE;
+	}
+	Global_Log_Ring.Quit = FALSE;
+	retval = pthread_create(&(Global_Log_Ring.Thread),NULL,Global_Log_Ring_Thread,NULL);
+	if(retval != 0)
+	{
+		Global_Error_Number = 12;
+		sprintf(Global_Error_String,"CCD_Global_Log_Ring_Start:Failed to create log ring thread(%d).",retval);
+		return FALSE;
+	}
+	__sync_synchronize();
+	Global_Log_Ring.Running = TRUE;
+	return TRUE;
+}
+
+/**
+ * Routine to stop the log ring. Messages logged after this routine is called are passed straight to the 
+ * log handler again. The consumer thread is told to quit, and joined after it has passed all the messages
+ * left in the ring to the log handler.
+ * If the log ring is not running, this routine does nothing and returns TRUE.
+ * @return The routine returns TRUE if the log ring was stopped, and FALSE if an error occured.
+ * @see #Global_Log_Ring
+ * @see #Global_Log_Ring_Thread
+ * @see #CCD_Global_Log_Ring_Start
+ */
+int CCD_Global_Log_Ring_Stop(void)
+{
+	int retval;
+
+	Global_Error_Number = 0;
+	if(Global_Log_Ring.Running == FALSE)
+		return TRUE;
+	Global_Log_Ring.Running = FALSE;
+	__sync_synchronize();
+	Global_Log_Ring.Quit = TRUE;
+	retval = pthread_join(Global_Log_Ring.Thread,NULL);
+	if(retval != 0)
+	{
+		Global_Error_Number = 13;
+		sprintf(Global_Error_String,"CCD_Global_Log_Ring_Stop:Failed to join log ring thread(%d).",retval);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to return the number of log messages that have been dropped because the log ring was full.
+ * @return The number of dropped messages since the log ring was first started.
+ * @see #Global_Log_Ring
+ */
+int CCD_Global_Log_Ring_Get_Dropped_Count(void)
+{
+	return Global_Log_Ring.Dropped_Count;
+}
+
 /**
  * This routine increases the scheduling/priority
  * of this process. It is called whilst reading out images from the camera, and this reduces the 
@@ -890,6 +1266,724 @@ int CCD_Global_Memory_UnLock_All(char *class,char *source)
 	return TRUE;
 }
 
+
+/**
+ * Routine to initialise (zero) the per-handle metrics. It is called when the handle is opened, and can be
+ * called again to reset the metrics. It should not be called whilst another thread is using the handle.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see ccd_global_private.html#CCD_Global_Metrics_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+void CCD_Global_Metrics_Initialise(CCD_Interface_Handle_T *handle)
+{
+	memset(&(handle->Metrics_Data),0,sizeof(struct CCD_Global_Metrics_Struct));
+	__sync_synchronize();
+}
+
+/**
+ * Routine to get the current time, for timing operations to add to the metrics.
+ * @param current_time The address of a timespec, filled in with the current time.
+ * @see #CCD_Global_Metrics_Ioctl_Add
+ * @see #CCD_Global_Metrics_Timer_Add
+ */
+void CCD_Global_Metrics_Get_Time(struct timespec *current_time)
+{
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+
+#ifdef _POSIX_TIMERS
+	clock_gettime(CLOCK_REALTIME,current_time);
+#else
+	gettimeofday(&gtod_current_time,NULL);
+	current_time->tv_sec = gtod_current_time.tv_sec;
+	current_time->tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
+#endif
+}
+
+/**
+ * Routine to add an ioctl request, and how long it took, to the handle's metrics. The time is from start_time
+ * until now. Requests not in Global_Metrics_Ioctl_Request_List are counted in the last ioctl metric.
+ * This routine does not lock, the metrics are updated atomically.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param request The ioctl request sent to the device.
+ * @param start_time The time the request was sent, from CCD_Global_Metrics_Get_Time.
+ * @see #Global_Metrics_Ioctl_Request_List
+ * @see #Global_Metrics_Timer_Update
+ * @see #CCD_Global_Metrics_Get_Time
+ * @see #CCD_GLOBAL_METRICS_IOCTL_COUNT
+ */
+void CCD_Global_Metrics_Ioctl_Add(CCD_Interface_Handle_T *handle,int request,struct timespec start_time)
+{
+	struct timespec current_time;
+	int index;
+
+	CCD_Global_Metrics_Get_Time(&current_time);
+	for(index = 0; index < (CCD_GLOBAL_METRICS_IOCTL_COUNT-1); index++)
+	{
+		if(Global_Metrics_Ioctl_Request_List[index] == request)
+			break;
+	}
+	Global_Metrics_Timer_Update(&(handle->Metrics_Data.Ioctl_List[index]),
+		(((long long)(current_time.tv_sec-start_time.tv_sec))*((long long)CCD_GLOBBAL_ONE_SECOND_NS))+
+				    ((long long)(current_time.tv_nsec-start_time.tv_nsec)));
+}
+
+/**
+ * Routine to add the time since start_time to one of the handle's metric timers.
+ * This routine does not lock, the metrics are updated atomically.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param timer Which timer to add to.
+ * @param start_time The time the timed operation started, from CCD_Global_Metrics_Get_Time.
+ * @see #Global_Metrics_Timer_Update
+ * @see #CCD_Global_Metrics_Get_Time
+ * @see #CCD_GLOBAL_METRICS_TIMER
+ */
+void CCD_Global_Metrics_Timer_Add(CCD_Interface_Handle_T *handle,enum CCD_GLOBAL_METRICS_TIMER timer,
+				  struct timespec start_time)
+{
+	struct timespec current_time;
+
+	if(!CCD_GLOBAL_METRICS_IS_TIMER(timer))
+		return;
+	CCD_Global_Metrics_Get_Time(&current_time);
+	Global_Metrics_Timer_Update(&(handle->Metrics_Data.Timer_List[timer]),
+		(((long long)(current_time.tv_sec-start_time.tv_sec))*((long long)CCD_GLOBBAL_ONE_SECOND_NS))+
+				    ((long long)(current_time.tv_nsec-start_time.tv_nsec)));
+}
+
+/**
+ * Routine to add value to one of the handle's metric counters.
+ * This routine does not lock, the metrics are updated atomically.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param counter Which counter to add to.
+ * @param value The value to add.
+ * @see #CCD_GLOBAL_METRICS_COUNTER
+ */
+void CCD_Global_Metrics_Counter_Add(CCD_Interface_Handle_T *handle,enum CCD_GLOBAL_METRICS_COUNTER counter,
+				    long long value)
+{
+	if(!CCD_GLOBAL_METRICS_IS_COUNTER(counter))
+		return;
+	__sync_fetch_and_add(&(handle->Metrics_Data.Counter_List[counter]),value);
+}
+
+/**
+ * Routine to get the metrics for one type of ioctl request.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param index The index of the ioctl metric, from 0 to CCD_GLOBAL_METRICS_IOCTL_COUNT-1.
+ * @param request The address of an integer, on return set to the ioctl request this metric is for, 
+ * 	or -1 for the last metric, which counts all other requests. Can be NULL.
+ * @param count The address of a long long, on return set to the number of requests sent.
+ * @param total_ns The address of a long long, on return set to the total time the requests took, in nanoseconds.
+ * @param max_ns The address of a long long, on return set to the longest time a request took, in nanoseconds.
+ * @return The routine returns TRUE if it succeeds, FALSE if it fails.
+ * @see #Global_Metrics_Ioctl_Request_List
+ * @see #CCD_GLOBAL_METRICS_IOCTL_COUNT
+ */
+int CCD_Global_Metrics_Get_Ioctl(CCD_Interface_Handle_T *handle,int index,int *request,long long *count,
+				 long long *total_ns,long long *max_ns)
+{
+	struct CCD_Global_Metrics_Timer_Struct *timer = NULL;
+
+	Global_Error_Number = 0;
+	if((index < 0)||(index >= CCD_GLOBAL_METRICS_IOCTL_COUNT))
+	{
+		Global_Error_Number = 14;
+		sprintf(Global_Error_String,"CCD_Global_Metrics_Get_Ioctl:Illegal index %d.",index);
+		return FALSE;
+	}
+	if((handle == NULL)||(count == NULL)||(total_ns == NULL)||(max_ns == NULL))
+	{
+		Global_Error_Number = 15;
+		sprintf(Global_Error_String,"CCD_Global_Metrics_Get_Ioctl:Illegal arguments (%p,%p,%p,%p).",
+			(void*)handle,(void*)count,(void*)total_ns,(void*)max_ns);
+		return FALSE;
+	}
+	if(request != NULL)
+	{
+		if(index < (CCD_GLOBAL_METRICS_IOCTL_COUNT-1))
+			(*request) = Global_Metrics_Ioctl_Request_List[index];
+		else
+			(*request) = -1;
+	}
+	timer = &(handle->Metrics_Data.Ioctl_List[index]);
+	(*count) = __sync_fetch_and_add(&(timer->Count),0);
+	(*total_ns) = __sync_fetch_and_add(&(timer->Total_NS),0);
+	(*max_ns) = __sync_fetch_and_add(&(timer->Max_NS),0);
+	return TRUE;
+}
+
+/**
+ * Routine to get one of the handle's metric timers.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param timer Which timer to get.
+ * @param count The address of a long long, on return set to the number of times the operation was timed.
+ * @param total_ns The address of a long long, on return set to the total time, in nanoseconds.
+ * @param max_ns The address of a long long, on return set to the longest time, in nanoseconds.
+ * @return The routine returns TRUE if it succeeds, FALSE if it fails.
+ * @see #CCD_GLOBAL_METRICS_TIMER
+ */
+int CCD_Global_Metrics_Get_Timer(CCD_Interface_Handle_T *handle,enum CCD_GLOBAL_METRICS_TIMER timer,
+				 long long *count,long long *total_ns,long long *max_ns)
+{
+	struct CCD_Global_Metrics_Timer_Struct *metrics_timer = NULL;
+
+	Global_Error_Number = 0;
+	if(!CCD_GLOBAL_METRICS_IS_TIMER(timer))
+	{
+		Global_Error_Number = 16;
+		sprintf(Global_Error_String,"CCD_Global_Metrics_Get_Timer:Illegal timer %d.",timer);
+		return FALSE;
+	}
+	if((handle == NULL)||(count == NULL)||(total_ns == NULL)||(max_ns == NULL))
+	{
+		Global_Error_Number = 17;
+		sprintf(Global_Error_String,"CCD_Global_Metrics_Get_Timer:Illegal arguments (%p,%p,%p,%p).",
+			(void*)handle,(void*)count,(void*)total_ns,(void*)max_ns);
+		return FALSE;
+	}
+	metrics_timer = &(handle->Metrics_Data.Timer_List[timer]);
+	(*count) = __sync_fetch_and_add(&(metrics_timer->Count),0);
+	(*total_ns) = __sync_fetch_and_add(&(metrics_timer->Total_NS),0);
+	(*max_ns) = __sync_fetch_and_add(&(metrics_timer->Max_NS),0);
+	return TRUE;
+}
+
+/**
+ * Routine to get the value of one of the handle's metric counters.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param counter Which counter to get.
+ * @return The value of the counter, or zero if handle is NULL or counter is not a legal value.
+ * @see #CCD_GLOBAL_METRICS_COUNTER
+ */
+long long CCD_Global_Metrics_Get_Counter(CCD_Interface_Handle_T *handle,enum CCD_GLOBAL_METRICS_COUNTER counter)
+{
+	if((handle == NULL)||(!CCD_GLOBAL_METRICS_IS_COUNTER(counter)))
+		return 0;
+	return __sync_fetch_and_add(&(handle->Metrics_Data.Counter_List[counter]),0);
+}
+
+/**
+ * Routine to get the average readout rate of the handle, the number of bytes read out divided by the
+ * total time spent reading them out.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return The readout rate in bytes per second, or zero if nothing has been read out yet.
+ * @see #CCD_GLOBAL_METRICS_COUNTER_READOUT_BYTES
+ * @see #CCD_GLOBAL_METRICS_TIMER_READOUT
+ */
+double CCD_Global_Metrics_Get_Readout_Rate(CCD_Interface_Handle_T *handle)
+{
+	long long readout_bytes,readout_ns;
+
+	if(handle == NULL)
+		return 0.0;
+	readout_bytes = __sync_fetch_and_add(&(handle->Metrics_Data.Counter_List[
+						       CCD_GLOBAL_METRICS_COUNTER_READOUT_BYTES]),0);
+	readout_ns = __sync_fetch_and_add(&(handle->Metrics_Data.Timer_List[
+						    CCD_GLOBAL_METRICS_TIMER_READOUT].Total_NS),0);
+	if(readout_ns <= 0)
+		return 0.0;
+	return ((double)readout_bytes)*((double)CCD_GLOBBAL_ONE_SECOND_NS)/((double)readout_ns);
+}
+
+/* ----------------------------------------------------------------------------
+** 		internal functions 
+** ---------------------------------------------------------------------------- */
+/**
+ * Routine to claim the next free record in the log ring, and fill in it's class, source and level.
+ * The record is claimed by atomically advancing Global_Log_Ring.Enqueue_Position, so many threads can
+ * log at once without locking. The record must be published with Global_Log_Ring_Publish once it has been
+ * filled in. If the ring is full, Global_Log_Ring.Dropped_Count is incremented and NULL is returned.
+ * @param class The class that produced this log message.
+ * @param source The source that produced this log message.
+ * @param level The log level of the message.
+ * @param position The address of an unsigned integer, on return set to the claimed ring position, 
+ * 	which should be passed to Global_Log_Ring_Publish.
+ * @return The address of the claimed record, or NULL if the ring was full.
+ * @see #Global_Log_Ring
+ * @see #Global_Log_Ring_Publish
+ * @see #GLOBAL_LOG_RING_LENGTH
+ * @see #GLOBAL_LOG_NAME_LENGTH
+ */
+static struct Global_Log_Record_Struct *Global_Log_Ring_Claim(char *class,char *source,int level,
+							      unsigned int *position)
+{
+	struct Global_Log_Record_Struct *record = NULL;
+	unsigned int enqueue_position;
+	int difference;
+
+	enqueue_position = Global_Log_Ring.Enqueue_Position;
+	while(TRUE)
+	{
+		record = &(Global_Log_Ring.Record_List[enqueue_position & (GLOBAL_LOG_RING_LENGTH-1)]);
+		/* atomic read of the sequence number, with a full memory barrier */
+		difference = (int)(__sync_fetch_and_add(&(record->Sequence),0) - enqueue_position);
+		if(difference == 0)
+		{
+			/* record is free, try to claim it */
+			if(__sync_bool_compare_and_swap(&(Global_Log_Ring.Enqueue_Position),enqueue_position,
+							enqueue_position+1))
+				break;
+		}
+		else if(difference < 0)
+		{
+			/* record still holds a message from the last time round the ring - the ring is full */
+			__sync_fetch_and_add(&(Global_Log_Ring.Dropped_Count),1);
+			return NULL;
+		}
+		/* another thread claimed this record first */
+		enqueue_position = Global_Log_Ring.Enqueue_Position;
+	}
+	(*position) = enqueue_position;
+	record->Level = level;
+	if(class != NULL)
+		strncpy(record->Class,class,GLOBAL_LOG_NAME_LENGTH-1);
+	else
+		strcpy(record->Class,"-");
+	record->Class[GLOBAL_LOG_NAME_LENGTH-1] = '\0';
+	if(source != NULL)
+		strncpy(record->Source,source,GLOBAL_LOG_NAME_LENGTH-1);
+	else
+		strcpy(record->Source,"-");
+	record->Source[GLOBAL_LOG_NAME_LENGTH-1] = '\0';
+	record->Format = NULL;
+	record->Argument_Count = 0;
+	record->String_Length = 0;
+	return record;
+}
+
+/**
+ * Routine to publish a record claimed by Global_Log_Ring_Claim, so the consumer thread can log it.
+ * @param record The address of the claimed record.
+ * @param position The ring position returned by Global_Log_Ring_Claim.
+ * @see #Global_Log_Ring_Claim
+ * @see #Global_Log_Ring_Thread
+ */
+static void Global_Log_Ring_Publish(struct Global_Log_Record_Struct *record,unsigned int position)
+{
+	/* The sequence number is still position, as we claimed the record. This is a full memory barrier,
+	** so the consumer sees the filled in record. */
+	__sync_val_compare_and_swap(&(record->Sequence),position,position+1);
+}
+
+/**
+ * Routine to capture the arguments of a log message into a log record, without formatting them.
+ * Each conversion in the format string is parsed using Global_Log_Parse_Conversion, and the arguments 
+ * (including '*' widths and precisions) copied into the record's Argument_List. String arguments are copied
+ * into the record's String buffer, as they may not exist by the time the message is formatted.
+ * @param record The log record to fill in.
+ * @param format The format string.
+ * @param ap The argument list.
+ * @return The routine returns TRUE if the arguments were captured, and FALSE if they could not be
+ * 	(an unsupported conversion, too many arguments, or the strings were too long). 
+ * 	If FALSE is returned, the caller should format the message itself.
+ * @see #Global_Log_Parse_Conversion
+ * @see #Global_Log_Record_Struct
+ * @see #GLOBAL_LOG_ARGUMENT_COUNT
+ * @see #GLOBAL_LOG_STRING_LENGTH
+ */
+static int Global_Log_Record_Capture(struct Global_Log_Record_Struct *record,char *format,va_list ap)
+{
+	struct Global_Log_Argument_Struct *argument = NULL;
+	enum GLOBAL_LOG_ARGUMENT_TYPE type;
+	char *ch = NULL;
+	char *string = NULL;
+	int length,star_count,string_length,i;
+
+	ch = format;
+	while((*ch) != '\0')
+	{
+		if((*ch) != '%')
+		{
+			ch++;
+			continue;
+		}
+		if(!Global_Log_Parse_Conversion(ch,&length,&star_count,&type))
+			return FALSE;
+		ch += length;
+		if(type == GLOBAL_LOG_ARGUMENT_NONE)
+			continue;
+		if((record->Argument_Count+star_count+1) > GLOBAL_LOG_ARGUMENT_COUNT)
+			return FALSE;
+		for(i=0;i<star_count;i++)
+		{
+			argument = &(record->Argument_List[record->Argument_Count++]);
+			argument->Type = GLOBAL_LOG_ARGUMENT_INT;
+			argument->Value.Int = va_arg(ap,int);
+		}
+		argument = &(record->Argument_List[record->Argument_Count++]);
+		argument->Type = type;
+		switch(type)
+		{
+			case GLOBAL_LOG_ARGUMENT_INT:
+				argument->Value.Int = va_arg(ap,int);
+				break;
+			case GLOBAL_LOG_ARGUMENT_LONG:
+				argument->Value.Long = va_arg(ap,long);
+				break;
+			case GLOBAL_LOG_ARGUMENT_LONG_LONG:
+				argument->Value.Long_Long = va_arg(ap,long long);
+				break;
+			case GLOBAL_LOG_ARGUMENT_DOUBLE:
+				argument->Value.Double = va_arg(ap,double);
+				break;
+			case GLOBAL_LOG_ARGUMENT_POINTER:
+				argument->Value.Pointer = va_arg(ap,void*);
+				break;
+			case GLOBAL_LOG_ARGUMENT_STRING:
+				string = va_arg(ap,char*);
+				if(string == NULL)
+					string = "(null)";
+				string_length = strlen(string);
+				if((record->String_Length+string_length+1) > GLOBAL_LOG_STRING_LENGTH)
+					return FALSE;
+				argument->Value.String_Offset = record->String_Length;
+				strcpy(record->String+record->String_Length,string);
+				record->String_Length += string_length+1;
+				break;
+			default:
+				return FALSE;
+		}
+	}
+	record->Format = format;
+	return TRUE;
+}
+
+/**
+ * Routine to format a log record into a message. If the record has no format string, the String buffer
+ * already holds the message and is copied. Otherwise the format string is copied, with each conversion
+ * formatted using snprintf and the captured argument(s).
+ * @param record The log record to format.
+ * @param buff The buffer to put the formatted message into.
+ * @param buff_length The length of buff. The message is truncated to fit.
+ * @see #Global_Log_Parse_Conversion
+ * @see #Global_Log_Record_Struct
+ * @see #GLOBAL_LOG_CONVERSION_LENGTH
+ */
+static void Global_Log_Record_Format(struct Global_Log_Record_Struct *record,char *buff,int buff_length)
+{
+	struct Global_Log_Argument_Struct *argument = NULL;
+	enum GLOBAL_LOG_ARGUMENT_TYPE type;
+	char conversion[GLOBAL_LOG_CONVERSION_LENGTH];
+	char *ch = NULL;
+	int star_list[2];
+	int buff_index,argument_index,length,star_count,retval,i;
+
+	if(record->Format == NULL)
+	{
+		strncpy(buff,record->String,buff_length-1);
+		buff[buff_length-1] = '\0';
+		return;
+	}
+	buff_index = 0;
+	argument_index = 0;
+	ch = record->Format;
+	while(((*ch) != '\0')&&(buff_index < (buff_length-1)))
+	{
+		if((*ch) != '%')
+		{
+			buff[buff_index++] = (*ch);
+			ch++;
+			continue;
+		}
+		/* Global_Log_Record_Capture has already parsed this format string successfully */
+		Global_Log_Parse_Conversion(ch,&length,&star_count,&type);
+		if(type == GLOBAL_LOG_ARGUMENT_NONE)
+		{
+			buff[buff_index++] = '%';
+			ch += length;
+			continue;
+		}
+		strncpy(conversion,ch,length);
+		conversion[length] = '\0';
+		ch += length;
+		for(i=0;i<star_count;i++)
+			star_list[i] = record->Argument_List[argument_index++].Value.Int;
+		argument = &(record->Argument_List[argument_index++]);
+		retval = 0;
+		switch(type)
+		{
+			case GLOBAL_LOG_ARGUMENT_INT:
+				if(star_count == 0)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  argument->Value.Int);
+				else if(star_count == 1)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],argument->Value.Int);
+				else
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],star_list[1],argument->Value.Int);
+				break;
+			case GLOBAL_LOG_ARGUMENT_LONG:
+				if(star_count == 0)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  argument->Value.Long);
+				else if(star_count == 1)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],argument->Value.Long);
+				else
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],star_list[1],argument->Value.Long);
+				break;
+			case GLOBAL_LOG_ARGUMENT_LONG_LONG:
+				if(star_count == 0)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  argument->Value.Long_Long);
+				else if(star_count == 1)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],argument->Value.Long_Long);
+				else
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],star_list[1],argument->Value.Long_Long);
+				break;
+			case GLOBAL_LOG_ARGUMENT_DOUBLE:
+				if(star_count == 0)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  argument->Value.Double);
+				else if(star_count == 1)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],argument->Value.Double);
+				else
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],star_list[1],argument->Value.Double);
+				break;
+			case GLOBAL_LOG_ARGUMENT_STRING:
+				if(star_count == 0)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  record->String+argument->Value.String_Offset);
+				else if(star_count == 1)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],record->String+argument->Value.String_Offset);
+				else
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],star_list[1],
+							  record->String+argument->Value.String_Offset);
+				break;
+			case GLOBAL_LOG_ARGUMENT_POINTER:
+				if(star_count == 0)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  argument->Value.Pointer);
+				else if(star_count == 1)
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],argument->Value.Pointer);
+				else
+					retval = snprintf(buff+buff_index,buff_length-buff_index,conversion,
+							  star_list[0],star_list[1],argument->Value.Pointer);
+				break;
+			default:
+				break;
+		}
+		if(retval > 0)
+			buff_index += retval;
+		if(buff_index > (buff_length-1))
+			buff_index = buff_length-1;
+	}
+	buff[buff_index] = '\0';
+}
+
+/**
+ * Routine to parse one conversion specification (e.g. "%-10.3f") in a log format string. 
+ * Only the flags, width, precision, length modifiers and conversions that can be captured are supported:
+ * positional arguments, wide characters/strings, long doubles, %n and the j, z and t length modifiers are not.
+ * @param format A pointer to the '%' starting the conversion specification.
+ * @param length The address of an integer, on return set to the length of the conversion specification.
+ * @param star_count The address of an integer, on return set to the number of '*' widths/precisions (0..2).
+ * @param type The address of an enum, on return set to the type of the argument the conversion takes, or
+ * 	GLOBAL_LOG_ARGUMENT_NONE for "%%".
+ * @return The routine returns TRUE if the conversion is supported, and FALSE if it is not.
+ * @see #GLOBAL_LOG_ARGUMENT_TYPE
+ * @see #GLOBAL_LOG_CONVERSION_LENGTH
+ */
+static int Global_Log_Parse_Conversion(char *format,int *length,int *star_count,
+				       enum GLOBAL_LOG_ARGUMENT_TYPE *type)
+{
+	char *ch = NULL;
+	int long_count = 0;
+
+	(*star_count) = 0;
+	ch = format+1;
+	if((*ch) == '%')
+	{
+		(*length) = 2;
+		(*type) = GLOBAL_LOG_ARGUMENT_NONE;
+		return TRUE;
+	}
+	/* flags */
+	while(((*ch) == '-')||((*ch) == '+')||((*ch) == ' ')||((*ch) == '#')||((*ch) == '0'))
+		ch++;
+	/* width */
+	if((*ch) == '*')
+	{
+		(*star_count)++;
+		ch++;
+	}
+	else
+	{
+		while(((*ch) >= '0')&&((*ch) <= '9'))
+			ch++;
+		if((*ch) == '$')
+			return FALSE;
+	}
+	/* precision */
+	if((*ch) == '.')
+	{
+		ch++;
+		if((*ch) == '*')
+		{
+			(*star_count)++;
+			ch++;
+		}
+		else
+		{
+			while(((*ch) >= '0')&&((*ch) <= '9'))
+				ch++;
+		}
+	}
+	/* length modifiers */
+	if((*ch) == 'h')
+	{
+		ch++;
+		if((*ch) == 'h')
+			ch++;
+	}
+	else if((*ch) == 'q')
+	{
+		long_count = 2;
+		ch++;
+	}
+	else
+	{
+		while(((*ch) == 'l')&&(long_count < 2))
+		{
+			long_count++;
+			ch++;
+		}
+	}
+	/* conversion */
+	switch(*ch)
+	{
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+			if(long_count == 0)
+				(*type) = GLOBAL_LOG_ARGUMENT_INT;
+			else if(long_count == 1)
+				(*type) = GLOBAL_LOG_ARGUMENT_LONG;
+			else
+				(*type) = GLOBAL_LOG_ARGUMENT_LONG_LONG;
+			break;
+		case 'c':
+			if(long_count != 0)
+				return FALSE;
+			(*type) = GLOBAL_LOG_ARGUMENT_INT;
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if(long_count > 1)
+				return FALSE;
+			(*type) = GLOBAL_LOG_ARGUMENT_DOUBLE;
+			break;
+		case 's':
+			if(long_count != 0)
+				return FALSE;
+			(*type) = GLOBAL_LOG_ARGUMENT_STRING;
+			break;
+		case 'p':
+			(*type) = GLOBAL_LOG_ARGUMENT_POINTER;
+			break;
+		default:
+			return FALSE;
+	}
+	ch++;
+	(*length) = ch-format;
+	if((*length) >= GLOBAL_LOG_CONVERSION_LENGTH)
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * The log ring consumer thread, started by CCD_Global_Log_Ring_Start. It takes each published record from
+ * the log ring in turn, formats it using Global_Log_Record_Format, and passes it to the log handler.
+ * The record is then released for re-use. If any messages have been dropped since the last record was
+ * logged, a message saying how many is logged first. When the ring is empty, the thread sleeps for 
+ * GLOBAL_LOG_RING_SLEEP_MS milliseconds. When Global_Log_Ring.Quit is set, the thread empties the ring and exits.
+ * @param user_arg Not used.
+ * @return The routine returns NULL.
+ * @see #Global_Log_Ring
+ * @see #Global_Log_Record_Format
+ * @see #Global_Data
+ * @see #GLOBAL_LOG_RING_SLEEP_MS
+ * @see #GLOBAL_LOG_STRING_LENGTH
+ */
+static void *Global_Log_Ring_Thread(void *user_arg)
+{
+	struct Global_Log_Record_Struct *record = NULL;
+	struct timespec sleep_time;
+	char buff[GLOBAL_LOG_STRING_LENGTH];
+	unsigned int position;
+	int dropped_count,reported_dropped_count,quit;
+
+	reported_dropped_count = Global_Log_Ring.Dropped_Count;
+	while(TRUE)
+	{
+		/* read the quit flag before looking at the ring, so records published before quit is set are
+		** logged before the thread exits */
+		quit = Global_Log_Ring.Quit;
+		position = Global_Log_Ring.Dequeue_Position;
+		record = &(Global_Log_Ring.Record_List[position & (GLOBAL_LOG_RING_LENGTH-1)]);
+		/* atomic read of the sequence number, with a full memory barrier */
+		if(__sync_fetch_and_add(&(record->Sequence),0) != (position+1))
+		{
+			/* ring empty (or the next record is not yet published) */
+			if(quit)
+				break;
+			sleep_time.tv_sec = 0;
+			sleep_time.tv_nsec = GLOBAL_LOG_RING_SLEEP_MS*CCD_GLOBAL_ONE_MILLISECOND_NS;
+			nanosleep(&sleep_time,NULL);
+			continue;
+		}
+		dropped_count = __sync_fetch_and_add(&(Global_Log_Ring.Dropped_Count),0);
+		if((dropped_count != reported_dropped_count)&&(Global_Data.Global_Log_Handler != NULL))
+		{
+			sprintf(buff,"Global_Log_Ring_Thread:%d log messages dropped (log ring full).",
+				dropped_count-reported_dropped_count);
+			(*Global_Data.Global_Log_Handler)(record->Class,record->Source,record->Level,buff);
+			reported_dropped_count = dropped_count;
+		}
+		Global_Log_Record_Format(record,buff,GLOBAL_LOG_STRING_LENGTH);
+		if(Global_Data.Global_Log_Handler != NULL)
+			(*Global_Data.Global_Log_Handler)(record->Class,record->Source,record->Level,buff);
+		/* release the record for re-use next time round the ring */
+		__sync_val_compare_and_swap(&(record->Sequence),position+1,position+GLOBAL_LOG_RING_LENGTH);
+		Global_Log_Ring.Dequeue_Position = position+1;
+	}
+	return NULL;
+}
+
+/**
+ * Routine to add one timed operation to a metrics timer. The count and total are atomically added to,
+ * and the maximum atomically replaced if time_ns is larger, so the timer can be updated from more than one
+ * thread without locking. Negative times (the clock was stepped backwards) are counted as zero.
+ * @param timer The address of the timer to update.
+ * @param time_ns The time the operation took, in nanoseconds.
+ * @see ccd_global_private.html#CCD_Global_Metrics_Timer_Struct
+ */
+static void Global_Metrics_Timer_Update(struct CCD_Global_Metrics_Timer_Struct *timer,long long time_ns)
+{
+	long long max_ns,previous_max_ns;
+
+	if(time_ns < 0)
+		time_ns = 0;
+	__sync_fetch_and_add(&(timer->Count),1);
+	__sync_fetch_and_add(&(timer->Total_NS),time_ns);
+	max_ns = __sync_fetch_and_add(&(timer->Max_NS),0);
+	while(time_ns > max_ns)
+	{
+		previous_max_ns = __sync_val_compare_and_swap(&(timer->Max_NS),max_ns,time_ns);
+		if(previous_max_ns == max_ns)
+			break;
+		max_ns = previous_max_ns;
+	}
+}
+
 /*
 ** $Log: not supported by cvs2svn $
 ** Revision 0.14  2009/02/05 11:40:27  cjm
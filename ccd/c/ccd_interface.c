@@ -25,6 +25,7 @@
 #include "ccd_text.h"
 #include "ccd_pci.h"
 #include "ccd_setup.h"
+#include "ccd_temperature.h"
 #include "ccd_interface_private.h"
 
 /* internal structures */
@@ -38,13 +39,17 @@ static char rcsid[] = "$Id: ccd_interface.c,v 0.11 2011-01-17 10:57:54 cjm Exp $
 
 /* local variables */
 /**
- * Variable holding error code of last operation performed by ccd_interface.
+ * Variable holding error code of last operation performed by ccd_interface,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int Interface_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int Interface_Error_Number = 0;
 /**
- * Local variable holding description of the last error that occured.
+ * Local variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char Interface_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char Interface_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 
 /* external functions */
 /**
@@ -82,6 +87,8 @@ void CCD_Interface_Initialise(void)
  * @see ccd_text.html#CCD_Text_Open
  * @see ccd_pci.html#CCD_PCI_Open
  * @see ccd_setup.html#CCD_Setup_Data_Initialise
+ * @see ccd_temperature.html#CCD_Temperature_Data_Initialise
+ * @see ccd_global.html#CCD_Global_Metrics_Initialise
  */
 int CCD_Interface_Open(char *class,char *source,enum CCD_INTERFACE_DEVICE_ID device_number,char *device_pathname,
 			      CCD_Interface_Handle_T **handle)
@@ -121,6 +128,8 @@ int CCD_Interface_Open(char *class,char *source,enum CCD_INTERFACE_DEVICE_ID dev
         CCD_DSP_Data_Initialise((*handle));
 	CCD_Exposure_Data_Initialise((*handle));
         CCD_Setup_Data_Initialise((*handle));
+	CCD_Temperature_Data_Initialise((*handle));
+	CCD_Global_Metrics_Initialise((*handle));
 #if LOGGING > 1
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERY_VERBOSE,
 			      "CCD_Interface_Open() %s of type %d using handle %p.",
@@ -218,13 +227,18 @@ int CCD_Interface_Memory_UnMap(CCD_Interface_Handle_T *handle)
  * 	the routine, the return value from the DSP code may be in the argument.
  * @return The routine returns the return value from the command routine it called. This will normally be TRUE
  * 	if the request was sent correctly, or FALSE if it failed in some way.
+ * 	The request and how long it took are added to the handle's ioctl metrics.
  * @see #CCD_Interface_Handle_T
  * @see ccd_text.html#CCD_Text_Command
  * @see ccd_pci.html#CCD_PCI_Command
+ * @see ccd_global.html#CCD_Global_Metrics_Ioctl_Add
  * @see ccd_dsp.html#DSP_Send_Command
  */
 int CCD_Interface_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 {
+	struct timespec start_time;
+	int retval;
+
 	Interface_Error_Number = 0;
 	/* check parameters */
 	if(handle == NULL)
@@ -234,18 +248,23 @@ int CCD_Interface_Command(CCD_Interface_Handle_T *handle,int request,int *argume
 		return FALSE;
 	}
 	/* call the device specific command routine */
+	CCD_Global_Metrics_Get_Time(&start_time);
 	switch(handle->Interface_Device)
 	{
 		case CCD_INTERFACE_DEVICE_TEXT:
-			return CCD_Text_Command(handle,request,argument);
+			retval = CCD_Text_Command(handle,request,argument);
+			break;
 		case CCD_INTERFACE_DEVICE_PCI:
-			return CCD_PCI_Command(handle,request,argument);
+			retval = CCD_PCI_Command(handle,request,argument);
+			break;
 		default:
 			Interface_Error_Number = 4;
 			sprintf(Interface_Error_String,"CCD_Interface_Command failed:No device selected(%p,%d).",
 				(void*)handle,handle->Interface_Device);
 			return FALSE;
 	}
+	CCD_Global_Metrics_Ioctl_Add(handle,request,start_time);
+	return retval;
 }
 
 /**
@@ -258,13 +277,18 @@ int CCD_Interface_Command(CCD_Interface_Handle_T *handle,int request,int *argume
  * @param argument_count The number of arguments in argument_list.
  * @return The routine returns the return value from the command routine it called. This will normally be TRUE
  * 	if the request was sent correctly, or FALSE if it failed in some way.
+ * 	The request and how long it took are added to the handle's ioctl metrics.
  * @see #CCD_Interface_Handle_T
  * @see ccd_text.html#CCD_Text_Command_List
  * @see ccd_pci.html#CCD_PCI_Command_List
+ * @see ccd_global.html#CCD_Global_Metrics_Ioctl_Add
  * @see ccd_dsp.html#DSP_Send_Command
  */
 int CCD_Interface_Command_List(CCD_Interface_Handle_T *handle,int request,int *argument_list,int argument_count)
 {
+	struct timespec start_time;
+	int retval;
+
 	Interface_Error_Number = 0;
 	/* check parameters */
 	if(handle == NULL)
@@ -274,18 +298,23 @@ int CCD_Interface_Command_List(CCD_Interface_Handle_T *handle,int request,int *a
 		return FALSE;
 	}
 	/* call the device specific command routine */
+	CCD_Global_Metrics_Get_Time(&start_time);
 	switch(handle->Interface_Device)
 	{
 		case CCD_INTERFACE_DEVICE_TEXT:
-			return CCD_Text_Command_List(handle,request,argument_list,argument_count);
+			retval = CCD_Text_Command_List(handle,request,argument_list,argument_count);
+			break;
 		case CCD_INTERFACE_DEVICE_PCI:
-			return CCD_PCI_Command_List(handle,request,argument_list,argument_count);
+			retval = CCD_PCI_Command_List(handle,request,argument_list,argument_count);
+			break;
 		default:
 			Interface_Error_Number = 5;
 			sprintf(Interface_Error_String,"CCD_Interface_Command_List failed:No device selected(%p,%d).",
 				(void*)handle,handle->Interface_Device);
 			return FALSE;
 	}
+	CCD_Global_Metrics_Ioctl_Add(handle,request,start_time);
+	return retval;
 }
 
 /**
@@ -335,6 +364,8 @@ int CCD_Interface_Get_Reply_Data(CCD_Interface_Handle_T *handle,unsigned short *
  * @see #CCD_Interface_Handle_T
  * @see ccd_text.html#CCD_Text_Close
  * @see ccd_pci.html#CCD_PCI_Close
+ * @see ccd_exposure.html#CCD_Exposure_Buffer_Pool_Free
+ * @see ccd_temperature.html#CCD_Temperature_Sampler_Stop
  */
 int CCD_Interface_Close(char *class,char *source,CCD_Interface_Handle_T **handle)
 {
@@ -352,6 +383,13 @@ int CCD_Interface_Close(char *class,char *source,CCD_Interface_Handle_T **handle
 		sprintf(Interface_Error_String,"CCD_Interface_Close:handle points to NULL.");
 		return FALSE;
 	}
+	/* stop the temperature sampler (if running), it uses the device we are about to close */
+	if(!CCD_Temperature_Sampler_Stop(class,source,(*handle)))
+	{
+		Interface_Error_Number = 21;
+		sprintf(Interface_Error_String,"CCD_Interface_Close:Failed to stop temperature sampler.");
+		return FALSE;
+	}
 	/* call the device specific close routine */
 	switch((*handle)->Interface_Device)
 	{
@@ -374,6 +412,8 @@ int CCD_Interface_Close(char *class,char *source,CCD_Interface_Handle_T **handle
 			      "CCD_Interface_Close(): Closing handle %p of type %d.",
 			      (*handle),(*handle)->Interface_Device);
 #endif
+	/* free the image buffer pool, before freeing the handle it is attached to */
+	CCD_Exposure_Buffer_Pool_Free(class,source,(*handle));
 	/* free alocated handle */
 	free((*handle));
 	(*handle) = NULL;
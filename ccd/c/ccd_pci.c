@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #ifdef __linux
 #include <sys/ioctl.h>
@@ -61,13 +62,17 @@ struct CCD_PCI_Handle_Struct
 
 /* local variables */
 /**
- * Variable holding error code of last operation performed by ccd_pci.
+ * Variable holding error code of last operation performed by ccd_pci,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int PCI_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int PCI_Error_Number = 0;
 /**
- * Local variable holding description of the last error that occured.
+ * Local variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char PCI_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char PCI_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 
 /* external functions */
 /**
@@ -31,6 +31,7 @@
 #include "ccd_global.h"
 #include "ccd_dsp.h"
 #include "ccd_dsp_download.h"
+#include "ccd_exposure.h"
 #include "ccd_interface.h"
 #include "ccd_interface_private.h"
 #include "ccd_temperature.h"
@@ -123,13 +124,17 @@ static char rcsid[] = "$Id: ccd_setup.c,v 0.34 2011-01-17 10:57:54 cjm Exp $";
 
 /* local variables */
 /**
- * Variable holding error code of last operation performed by ccd_dsp.
+ * Variable holding error code of last operation performed by ccd_setup,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int Setup_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int Setup_Error_Number = 0;
 /**
- * Local variable holding description of the last error that occured.
+ * Local variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char Setup_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char Setup_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 
 /* local function definitions */
 static int Setup_Reset_Controller(char *class,char *source,CCD_Interface_Handle_T* handle);
@@ -145,13 +150,18 @@ static int Setup_Power_On(char *class,char *source,CCD_Interface_Handle_T* handl
 static int Setup_Power_Off(char *class,char *source,CCD_Interface_Handle_T* handle);
 static int Setup_Gain(char *class,char *source,CCD_Interface_Handle_T* handle,enum CCD_DSP_GAIN gain,int speed);
 static int Setup_Idle(char *class,char *source,CCD_Interface_Handle_T* handle,int idle);
-static int Setup_Binning(char *class,char *source,CCD_Interface_Handle_T* handle,int nsbin,int npbin);
-static int Setup_DeInterlace(char *class,char *source,CCD_Interface_Handle_T* handle,enum CCD_DSP_AMPLIFIER amplifier,
+static int Setup_Binning(char *class,char *source,CCD_Interface_Handle_T* handle,
+			struct CCD_DSP_Transaction_Struct *transaction,int nsbin,int npbin);
+static int Setup_DeInterlace(char *class,char *source,CCD_Interface_Handle_T* handle,
+			     struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_AMPLIFIER amplifier,
 			     enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type);
-static int Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle,int ncols,int nrows);
-static int Setup_Window_List(char *class,char *source,CCD_Interface_Handle_T* handle,int window_flags,
+static int Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle,
+			struct CCD_DSP_Transaction_Struct *transaction,int ncols,int nrows);
+static int Setup_Window_List(char *class,char *source,CCD_Interface_Handle_T* handle,
+			     struct CCD_DSP_Transaction_Struct *transaction,int window_flags,
 			     struct CCD_Setup_Window_Struct window_list[]);
-static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handle_T* handle);
+static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handle_T* handle,
+				    struct CCD_DSP_Transaction_Struct *transaction);
 
 /* external functions */
 /**
@@ -482,6 +492,7 @@ int CCD_Setup_Startup(char *class,char *source,CCD_Interface_Handle_T* handle,
  * @see #CCD_Setup_Startup
  * @see ccd_setup_private.html#CCD_Setup_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see ccd_exposure.html#CCD_Exposure_Buffer_Pool_Free
  */
 int CCD_Setup_Shutdown(char *class,char *source,CCD_Interface_Handle_T* handle)
 {
@@ -512,6 +523,13 @@ int CCD_Setup_Shutdown(char *class,char *source,CCD_Interface_Handle_T* handle)
 		sprintf(Setup_Error_String,"CCD_Setup_Shutdown:Memory UnMap failed.");
 		return FALSE;
 	}
+/* free image buffer pool */
+	if(!CCD_Exposure_Buffer_Pool_Free(class,source,handle))
+	{
+		Setup_Error_Number = 85;
+		sprintf(Setup_Error_String,"CCD_Setup_Shutdown:Freeing image buffer pool failed.");
+		return FALSE;
+	}
 /* reset completion flags  */
 	handle->Setup_Data.Power_Complete = FALSE;
 	handle->Setup_Data.PCI_Complete = FALSE;
@@ -528,6 +546,8 @@ int CCD_Setup_Shutdown(char *class,char *source,CCD_Interface_Handle_T* handle)
 /**
  * Routine to setup dimension information in the controller. This needs to be setup before an exposure
  * can take place. This routine must be called <b>after</b> the CCD_Setup_Startup routine.
+ * The binning, amplifier, dimension and window commands are queued in one DSP transaction, which is sent
+ * to the controller once they have all been calculated, so the controller access mutex is only locked once.
  * This routine can be aborted with CCD_Setup_Abort.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
@@ -560,6 +580,9 @@ int CCD_Setup_Shutdown(char *class,char *source,CCD_Interface_Handle_T* handle)
  * @see #Setup_Window_List
  * @see #CCD_Setup_Abort
  * @see #CCD_Setup_Window_Struct
+ * @see ccd_dsp.html#CCD_DSP_Transaction_Struct
+ * @see ccd_dsp.html#CCD_DSP_Transaction_Submit
+ * @see ccd_exposure.html#CCD_Exposure_Buffer_Pool_Allocate
  * @see ccd_setup_private.html#CCD_Setup_Struct
  * @see ccd_dsp.html#CCD_DSP_AMPLIFIER
  * @see ccd_dsp.html#CCD_DSP_DEINTERLACE_TYPE
@@ -570,6 +593,8 @@ int CCD_Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle
 	enum CCD_DSP_AMPLIFIER amplifier,enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,
 	int window_flags,struct CCD_Setup_Window_Struct window_list[])
 {
+	struct CCD_DSP_Transaction_Struct transaction;
+
 	Setup_Error_Number = 0;
 #if LOGGING > 0
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Setup_Dimensions(handle=%p,ncols=%d,nrows=%d,"
@@ -582,6 +607,7 @@ int CCD_Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle
 	CCD_DSP_Set_Abort(class,source,handle,FALSE);
 /* reset dimension flag */
 	handle->Setup_Data.Dimension_Complete = FALSE;
+	CCD_DSP_Transaction_Initialise(&transaction);
 /* The binning needs to be done first to set the final
 ** image dimensions. Then Setup_DeInterlace is called
 ** to ensure that the dimensions agree with the deinterlace
@@ -607,7 +633,7 @@ int CCD_Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle
 		return FALSE;
 	}
 	handle->Setup_Data.NCols = ncols;
-	if(!Setup_Binning(class,source,handle,nsbin,npbin))
+	if(!Setup_Binning(class,source,handle,&transaction,nsbin,npbin))
 	{
 		handle->Setup_Data.Setup_In_Progress = FALSE;
 		return FALSE; 
@@ -621,7 +647,7 @@ int CCD_Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle
 		return FALSE;
 	}
 /* do de-interlacing/ amplifier setup */
-	if(!Setup_DeInterlace(class,source,handle,amplifier,deinterlace_type))
+	if(!Setup_DeInterlace(class,source,handle,&transaction,amplifier,deinterlace_type))
 	{
 		handle->Setup_Data.Setup_In_Progress = FALSE;
 		return FALSE;
@@ -635,13 +661,11 @@ int CCD_Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle
 		return FALSE;
 	}
 /* setup final calculated dimensions */
-	if(!Setup_Dimensions(class,source,handle,handle->Setup_Data.NCols,handle->Setup_Data.NRows))
+	if(!Setup_Dimensions(class,source,handle,&transaction,handle->Setup_Data.NCols,handle->Setup_Data.NRows))
 	{
 		handle->Setup_Data.Setup_In_Progress = FALSE;
 		return FALSE;
 	}
-	else /*acknowlege dimensions complete*/ 
-		handle->Setup_Data.Dimension_Complete = TRUE;
 /* if we have aborted - stop here */
 	if(CCD_DSP_Get_Abort(handle))
 	{
@@ -651,9 +675,29 @@ int CCD_Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle
 		return FALSE;
 	}
 /* setup windowing data */
-	if(!Setup_Window_List(class,source,handle,window_flags,window_list))
+	if(!Setup_Window_List(class,source,handle,&transaction,window_flags,window_list))
+	{
+		handle->Setup_Data.Setup_In_Progress = FALSE;
+		return FALSE;
+	}
+/* send all the queued binning, amplifier, dimension and window commands to the controller */
+	if(CCD_DSP_Transaction_Submit(class,source,handle,&transaction) != CCD_DSP_DON)
+	{
+		handle->Setup_Data.Setup_In_Progress = FALSE;
+		Setup_Error_Number = 86;
+		sprintf(Setup_Error_String,"CCD_Setup_Dimensions:Sending command %d of %d to the controller failed.",
+			transaction.Failed_Index,transaction.Command_Count);
+		return FALSE;
+	}
+	else /*acknowlege dimensions complete*/ 
+		handle->Setup_Data.Dimension_Complete = TRUE;
+/* allocate the image buffers post-readout processing needs for these dimensions,
+** so they are not allocated in the readout path */
+	if(!CCD_Exposure_Buffer_Pool_Allocate(class,source,handle))
 	{
 		handle->Setup_Data.Setup_In_Progress = FALSE;
+		Setup_Error_Number = 84;
+		sprintf(Setup_Error_String,"CCD_Setup_Dimensions:Failed to allocate image buffer pool.");
 		return FALSE;
 	}
 /* reset in progress information */
@@ -1750,12 +1794,13 @@ static int Setup_Idle(char *class,char *source,CCD_Interface_Handle_T* handle,in
 
 /**
  * Internal routine to set up the binning configuration for the SDSU CCD Controller. This routine checks
- * the binning values and saves them in Setup_Data, writes the
+ * the binning values and saves them in Setup_Data, queues writing the
  * binning values to the controller boards, and re-calculates the stored columns and rows values to allow for
  * binning e.g. NCols = NCols/NSBin. This routine is called from CCD_Setup_Dimensions.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param transaction The DSP transaction to queue the controller commands in. CCD_Setup_Dimensions sends it.
  * @param nsbin The amount of binning applied to pixels in columns. This parameter will change internally ncols.
  * @param npbin The amount of binning applied to pixels in rows.This parameter will change internally nrows.
  * @return Returns TRUE if the operation succeeds, FALSE if it fails.
@@ -1763,10 +1808,11 @@ static int Setup_Idle(char *class,char *source,CCD_Interface_Handle_T* handle,in
  * @see ccd_setup_private.html#CCD_Setup_Struct
  * @see #SETUP_ADDRESS_BIN_X
  * @see #SETUP_ADDRESS_BIN_Y
- * @see ccd_dsp.html#CCD_DSP_Command_WRM
+ * @see ccd_dsp.html#CCD_DSP_Transaction_Add_WRM
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Setup_Binning(char *class,char *source,CCD_Interface_Handle_T* handle,int nsbin,int npbin)
+static int Setup_Binning(char *class,char *source,CCD_Interface_Handle_T* handle,
+			struct CCD_DSP_Transaction_Struct *transaction,int nsbin,int npbin)
 {
 	if(nsbin <= 0)
 	{
@@ -1786,15 +1832,15 @@ static int Setup_Binning(char *class,char *source,CCD_Interface_Handle_T* handle
 /* will be sending the FINAL image size to the boards, so calculate them now */
 	handle->Setup_Data.NCols = handle->Setup_Data.NCols/handle->Setup_Data.NSBin;
 	handle->Setup_Data.NRows = handle->Setup_Data.NRows/handle->Setup_Data.NPBin;
-	if(CCD_DSP_Command_WRM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,SETUP_ADDRESS_BIN_X,
-		handle->Setup_Data.NSBin) != CCD_DSP_DON)
+	if(!CCD_DSP_Transaction_Add_WRM(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,SETUP_ADDRESS_BIN_X,
+					handle->Setup_Data.NSBin))
 	{
 		Setup_Error_Number = 16;
 		sprintf(Setup_Error_String,"Setting Column Binning failed(%d)",handle->Setup_Data.NSBin);
 		return FALSE;
 	}
-	if(CCD_DSP_Command_WRM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,SETUP_ADDRESS_BIN_Y,
-		handle->Setup_Data.NPBin)!= CCD_DSP_DON)
+	if(!CCD_DSP_Transaction_Add_WRM(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,SETUP_ADDRESS_BIN_Y,
+					handle->Setup_Data.NPBin))
 	{
 		Setup_Error_Number = 17;
 		sprintf(Setup_Error_String,"Setting Row Binning failed(%d)",handle->Setup_Data.NPBin);
@@ -1808,11 +1854,12 @@ static int Setup_Binning(char *class,char *source,CCD_Interface_Handle_T* handle
  * This routine re-calculates the stored columns and rows values to allow for the deinterlace type. Some deinterlace
  * types require an even number of rows and/or columns. The routine prints a warning if the rows or columns are
  * changed. This routine is called from CCD_Setup_Dimensions.
- * The routine also sets which amplifier is used for image readout, which dictates the de-interlace settings.
+ * The routine also queues setting which amplifier is used for image readout, which dictates the de-interlace settings.
  * Note you can currently choose a silly combination of amplifier and deinterlace_type at the moment.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param transaction The DSP transaction to queue the controller commands in. CCD_Setup_Dimensions sends it.
  * @param amplifier Which amplifier to use when reading out data from the CCD. Possible values come from
  * 	the CCD_DSP_AMPLIFIER enum.
  * @param deinterlace_type The algorithm to use for deinterlacing the resulting data. The data needs to be
@@ -1825,11 +1872,13 @@ static int Setup_Binning(char *class,char *source,CCD_Interface_Handle_T* handle
  * 	CCD_DSP_DEINTERLACE_SPLIT_QUAD.
  * @return Returns TRUE if the operation succeeds, FALSE if it fails.
  * @see #CCD_Setup_Dimensions
+ * @see ccd_dsp.html#CCD_DSP_Transaction_Add_SOS
  * @see ccd_dsp.html#CCD_DSP_AMPLIFIER
  * @see ccd_dsp.html#CCD_DSP_DEINTERLACE_TYPE
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Setup_DeInterlace(char *class,char *source,CCD_Interface_Handle_T* handle,enum CCD_DSP_AMPLIFIER amplifier,
+static int Setup_DeInterlace(char *class,char *source,CCD_Interface_Handle_T* handle,
+			     struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_AMPLIFIER amplifier,
 			     enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type)
 {
 	if(!CCD_DSP_IS_AMPLIFIER(amplifier))
@@ -1845,7 +1894,7 @@ static int Setup_DeInterlace(char *class,char *source,CCD_Interface_Handle_T* ha
 		return FALSE;
 	}
 /* setup output amplifier */
-	if(CCD_DSP_Command_SOS(class,source,handle,amplifier)!=CCD_DSP_DON)
+	if(!CCD_DSP_Transaction_Add_SOS(transaction,amplifier))
 	{
 		Setup_Error_Number = 43;
 		sprintf(Setup_Error_String,"Setup_DeInterlace:Setting Amplifier to %d failed",amplifier);
@@ -1905,11 +1954,12 @@ static int Setup_DeInterlace(char *class,char *source,CCD_Interface_Handle_T* ha
 }
 
 /**
- * Internal routine to set up the CCD dimensions for the SDSU CCD Controller. This routines writes the
+ * Internal routine to set up the CCD dimensions for the SDSU CCD Controller. This routines queues writing the
  * dimension values to the controller boards using WRM.  This routine is called from CCD_Setup_Dimensions.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param transaction The DSP transaction to queue the controller commands in. CCD_Setup_Dimensions sends it.
  * @param ncols The number of columns. This is usually Setup_Data.NCols, but will be different when
  *        windowing.
  * @param nrows The number of rows. This is usually Setup_Data.NRows, but will be different when
@@ -1918,21 +1968,22 @@ static int Setup_DeInterlace(char *class,char *source,CCD_Interface_Handle_T* ha
  * @see #CCD_Setup_Dimensions
  * @see #SETUP_ADDRESS_DIMENSION_COLS
  * @see #SETUP_ADDRESS_DIMENSION_ROWS
- * @see ccd_dsp.html#CCD_DSP_Command_WRM
+ * @see ccd_dsp.html#CCD_DSP_Transaction_Add_WRM
  * @see ccd_dsp.html#CCD_DSP_WRM
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle,int ncols,int nrows)
+static int Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* handle,
+			struct CCD_DSP_Transaction_Struct *transaction,int ncols,int nrows)
 {
-	if(CCD_DSP_Command_WRM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,
-			       SETUP_ADDRESS_DIMENSION_COLS,ncols) != CCD_DSP_DON)
+	if(!CCD_DSP_Transaction_Add_WRM(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,
+					SETUP_ADDRESS_DIMENSION_COLS,ncols))
 	{
 		Setup_Error_Number = 22;
 		sprintf(Setup_Error_String,"Setting Dimensions:Column Setup failed(%d)",ncols);
 		return FALSE;
 	}
-	if(CCD_DSP_Command_WRM(class,source,handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,
-			       SETUP_ADDRESS_DIMENSION_ROWS,nrows) != CCD_DSP_DON)
+	if(!CCD_DSP_Transaction_Add_WRM(transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,
+					SETUP_ADDRESS_DIMENSION_ROWS,nrows))
 	{
 		Setup_Error_Number = 23;
 		sprintf(Setup_Error_String,"Setting Dimensions:Row Setup failed(%d)",nrows);
@@ -1945,10 +1996,11 @@ static int Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* han
  * This routine sets the Setup_Data.Window_List from the passed in list of windows.
  * The windows are checked to ensure they don't overlap in the y (row) direction, and that sub-images are
  * all the same size. Only windows which are included in the window_flags parameter are checked.
- * If the windows are OK, Setup_Controller_Windows is called to write the windows to the SDSU controller.
+ * If the windows are OK, Setup_Controller_Windows is called to queue writing the windows to the SDSU controller.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param transaction The DSP transaction to queue the controller commands in. CCD_Setup_Dimensions sends it.
  * @param window_flags Information on which of the sets of window positions supplied contain windows to be used.
  * @param window_list A list of CCD_Setup_Window_Structs defining the position of the windows. The list should
  * 	<b>always</b> contain <b>four</b> entries, one for each possible window. The window_flags parameter
@@ -1959,7 +2011,8 @@ static int Setup_Dimensions(char *class,char *source,CCD_Interface_Handle_T* han
  * @see #Setup_Controller_Windows
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Setup_Window_List(char *class,char *source,CCD_Interface_Handle_T* handle,int window_flags,
+static int Setup_Window_List(char *class,char *source,CCD_Interface_Handle_T* handle,
+			     struct CCD_DSP_Transaction_Struct *transaction,int window_flags,
 			     struct CCD_Setup_Window_Struct window_list[])
 {
 	int start_window_index,end_window_index,found;
@@ -2037,27 +2090,31 @@ static int Setup_Window_List(char *class,char *source,CCD_Interface_Handle_T* ha
 		handle->Setup_Data.Window_List[3] = window_list[3];
 	handle->Setup_Data.Window_Flags = window_flags;
 /* write parameters to window table on timing board */
-	if(!Setup_Controller_Windows(class,source,handle))
+	if(!Setup_Controller_Windows(class,source,handle,transaction))
 		return FALSE;
 	return TRUE;
 }
 
 /**
- * Actually write the calculated Setup_Data windows to the SDSU controller, using SSS and SSP.
+ * Queue writing the calculated Setup_Data windows to the SDSU controller, using SSS and SSP.
  * If no windowing is taking place, we use SSS to reset the window sizes to zero (turning them off in the DSP code).
  * We also call Setup_Dimensions to set NSR and NPR to an area equivalent to the total number of pixels
  * written back from the timing board to the PCI board.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param transaction The DSP transaction to queue the controller commands in. CCD_Setup_Dimensions sends it.
  * @return The routine returns TRUE on success, and FALSE if something fails.
  * @see #Setup_Dimensions
+ * @see ccd_dsp.html#CCD_DSP_Transaction_Add_SSS
+ * @see ccd_dsp.html#CCD_DSP_Transaction_Add_SSP
  * @see ccd_setup_private.html#CCD_Setup_Struct
  * @see #CCD_Setup_Window_Struct
  * @see #SETUP_WINDOW_BIAS_WIDTH
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handle_T* handle)
+static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handle_T* handle,
+				    struct CCD_DSP_Transaction_Struct *transaction)
 {
 	struct CCD_Setup_Window_Struct window_list[CCD_SETUP_WINDOW_COUNT];
 	int bias_width,box_width,box_height,window_count;
@@ -2066,7 +2123,7 @@ static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handl
 	/* if no windows - reset window sizes and return */
 	if(handle->Setup_Data.Window_Flags == 0)
 	{
-		if(CCD_DSP_Command_SSS(class,source,handle,0,0,0) != CCD_DSP_DON)
+		if(!CCD_DSP_Transaction_Add_SSS(transaction,0,0,0))
 		{
 			Setup_Error_Number = 64;
 			sprintf(Setup_Error_String,"Reseting Subarray Sizes to zero failed.");
@@ -2088,7 +2145,7 @@ static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handl
 	bias_width = SETUP_WINDOW_BIAS_WIDTH;/* diddly - get this from parameters? */
 	box_width = window_list[0].X_End-window_list[0].X_Start;
 	box_height = window_list[0].Y_End-window_list[0].Y_Start;
-	if(CCD_DSP_Command_SSS(class,source,handle,bias_width,box_width,box_height) != CCD_DSP_DON)
+	if(!CCD_DSP_Transaction_Add_SSS(transaction,bias_width,box_width,box_height))
 	{
 		Setup_Error_Number = 45;
 		sprintf(Setup_Error_String,"Setting Subarray Sizes failed:(%d,%d,%d).",bias_width,box_width,
@@ -2107,7 +2164,7 @@ static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handl
 		/* diddly 2048 + a bit
 	        ** Full Width(2154)-bias strip width (53) = 2101 : correct calculation for this value. */
 		bias_x_offset = 2101-window_list[i].X_End;
-		if(CCD_DSP_Command_SSP(class,source,handle,y_offset,x_offset,bias_x_offset) != CCD_DSP_DON)
+		if(!CCD_DSP_Transaction_Add_SSP(transaction,y_offset,x_offset,bias_x_offset))
 		{
 			Setup_Error_Number = 60;
 			sprintf(Setup_Error_String,"Setting Subarray Position failed:(%d,%d,%d).",y_offset,
@@ -2123,7 +2180,7 @@ static int Setup_Controller_Windows(char *class,char *source,CCD_Interface_Handl
 	** For windowing, the total area of all the windows must be set as the CCD dimensions,
 	** as NSR and NPR are written back from the timing board to the PCI board as part of the
 	** RDA command, which tells the PCI board how many pixels is should expect from the timing board. */
-	if(Setup_Dimensions(class,source,handle,total_ncols,box_height) == FALSE)
+	if(Setup_Dimensions(class,source,handle,transaction,total_ncols,box_height) == FALSE)
 		return FALSE;
 	return TRUE;
 }
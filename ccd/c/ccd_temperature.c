@@ -23,14 +23,22 @@
  * This hash define is needed before including source files give us POSIX.4/IEEE1003.1b-1993 prototypes.
  */
 #define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#ifndef _POSIX_TIMERS
+#include <sys/time.h>
+#endif
 #include "log_udp.h"
 #include "ccd_global.h"
 #include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_setup.h"
 #include "ccd_temperature.h"
+#include "ccd_interface_private.h"
 
 /**
  * Revision Control System identifier.
@@ -39,8 +47,9 @@ static char rcsid[] = "$Id: ccd_temperature.c,v 0.15 2011-01-17 10:57:54 cjm Exp
 
 /**
  * The number of coefficients used to calculate the temperature.
+ * @see ccd_temperature.html#CCD_TEMPERATURE_COEFF_COUNT
  */
-#define TEMPERATURE_COEFF_COUNT			11
+#define TEMPERATURE_COEFF_COUNT			CCD_TEMPERATURE_COEFF_COUNT
 
 /**
  * The number of coefficients used to calculate the temperature.
@@ -158,37 +167,35 @@ static char rcsid[] = "$Id: ccd_temperature.c,v 0.15 2011-01-17 10:57:54 cjm Exp
  * only calculated every 3ms.
  */
 #define TEMPERATURE_GET_SLEEP_MS	(2)
-
-/* data types */
 /**
- * Data type holding local data to ccd_temperature. This data is all the numerical constants neccessary to
- * calculate temperatures for a particular temperature sensor connected to the system.
+ * The number of sample periods after the last sample was taken, that CCD_Temperature_Get still uses the
+ * sampler's averaged ADU. Older than this (the sampler skips sampling during exposures and setups), 
+ * CCD_Temperature_Get reads the controller directly.
+ * @see #CCD_Temperature_Get
  */
-typedef struct Temperature_Struct
-{
-	int	Temp_Coeff_Count;
-	float	V_Upper;
-	float	V_Lower;
-	float	Adu_Per_Volt;
-	int	Adu_Offset;
-	float	Temp_Coeff[TEMPERATURE_COEFF_COUNT];
-} TEMPERATURE_ATTR;
+#define TEMPERATURE_SAMPLE_MAX_AGE_PERIODS	(5)
 
 /* external variables */
 
 /* internal variables */
 /**
- * Variable holding error code of last operation performed by ccd_temperature.
+ * Variable holding error code of last operation performed by ccd_temperature,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int Temperature_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int Temperature_Error_Number = 0;
 /**
- * Local variable holding description of the last error that occured.
+ * Local variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char Temperature_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char Temperature_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 /**
- * Data holding the current diode configuration values for a particular temperature sensor.
+ * Data holding the default diode configuration values, copied into each handle by CCD_Temperature_Data_Initialise.
+ * @see #CCD_Temperature_Data_Initialise
+ * @see ccd_temperature_private.html#CCD_Temperature_Calibration_Struct
  */
-static TEMPERATURE_ATTR Temperature_Data = 
+static struct CCD_Temperature_Calibration_Struct Temperature_Default_Calibration = 
 {
 	TEMPERATURE_DEFAULT_NTEMP,
 	TEMPERATURE_DEFAULT_VU,TEMPERATURE_DEFAULT_VL,
@@ -205,14 +212,49 @@ static float Temperature_Temperature(float temp_coeff[],int n,float vu,float vl,
 	float adu);
 static int Temperature_Calc_Temp_ADU(float temp_coeff[],int n,float vu,float vl,float adu_per_volt,int adu_offset,
 	float temperature);
+static int Temperature_ADU_To_Temperature(char *class,char *source,
+					  struct CCD_Temperature_Calibration_Struct *calibration,int adu,
+					  double *temperature);
+static int Temperature_Get_Sampled_ADU(CCD_Interface_Handle_T* handle,int *adu,
+				       struct CCD_Temperature_Calibration_Struct *calibration);
+static void *Temperature_Sampler_Thread(void *user_arg);
 
 /* external functions */
+/**
+ * Routine to initialise the temperature data in the interface handle. The calibration data is set to the
+ * defaults (Temperature_Default_Calibration), the sample mutex and condition variable initialised, and
+ * the sampler marked as not running with no samples.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @see #Temperature_Default_Calibration
+ * @see ccd_temperature_private.html#CCD_Temperature_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+void CCD_Temperature_Data_Initialise(CCD_Interface_Handle_T* handle)
+{
+	handle->Temperature_Data.Calibration = Temperature_Default_Calibration;
+	pthread_mutex_init(&(handle->Temperature_Data.Sample_Mutex),NULL);
+	pthread_cond_init(&(handle->Temperature_Data.Sample_Condition),NULL);
+	handle->Temperature_Data.Sampler_Running = FALSE;
+	handle->Temperature_Data.Sampler_Quit = FALSE;
+	handle->Temperature_Data.Sample_Period = 0;
+	handle->Temperature_Data.Sample_Index = 0;
+	handle->Temperature_Data.Sample_Count = 0;
+	handle->Temperature_Data.Sample_Sum = 0;
+	handle->Temperature_Data.Sample_Time.tv_sec = 0;
+	handle->Temperature_Data.Sample_Time.tv_nsec = 0;
+	strcpy(handle->Temperature_Data.Sampler_Class,"");
+	strcpy(handle->Temperature_Data.Sampler_Source,"");
+}
+
 /**
  * This routine gets the current temperature of the CCD in the dewar using the SDSU CCD Controller utility board.
- * It reads the utility board using CCD_DSP_Command_RDM to read memory which has the digital counts 
+ * If the temperature sampler is running, and has taken a sample in the last TEMPERATURE_SAMPLE_MAX_AGE_PERIODS
+ * sample periods, the sampler's rolling average ADU is used, and the routine returns without sending any 
+ * commands to the controller. Otherwise
+ * it reads the utility board using CCD_DSP_Command_RDM to read memory which has the digital counts 
  * of the voltage from the temperature sensor in it. This is done TEMPERATURE_MAX_CHECKS times.
- * The temperature is calculated from the adu by calling Temperature_Temperature. 
- * If the voltage is out of range an error is returned.
+ * The temperature is calculated from the adu, using the handle's calibration data, by calling 
+ * Temperature_ADU_To_Temperature. If the voltage is out of range an error is returned.
  * @param class The class parameter to use for any log messages associated with this operation.
  * @param source The class parameter to use for any log messages associated with this operation.
  * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
@@ -223,16 +265,18 @@ static int Temperature_Calc_Temp_ADU(float temp_coeff[],int n,float vu,float vl,
  * @see #TEMPERATURE_MAX_CHECKS
  * @see #TEMPERATURE_CURRENT_ADU_ADDRESS
  * @see #TEMPERATURE_GET_SLEEP_MS
- * @see #Temperature_Temperature
+ * @see #TEMPERATURE_SAMPLE_MAX_AGE_PERIODS
+ * @see #Temperature_Get_Sampled_ADU
+ * @see #Temperature_ADU_To_Temperature
  * @see ccd_dsp.html#CCD_DSP_Command_RDM
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 int CCD_Temperature_Get(char *class,char *source,CCD_Interface_Handle_T* handle,double *temperature)
 {
+	struct CCD_Temperature_Calibration_Struct calibration;
 	struct timespec sleep_time;
 	int adu,retval;
 	int i;
-	float voltage;
 
 	Temperature_Error_Number = 0;
 #if LOGGING > 0
@@ -244,6 +288,14 @@ int CCD_Temperature_Get(char *class,char *source,CCD_Interface_Handle_T* handle,
 		sprintf(Temperature_Error_String,"CCD_Temperature_Get:temperature pointer was NULL.");
 		return FALSE;
 	}
+	/* use the sampler's average, if it is recent enough */
+	if(Temperature_Get_Sampled_ADU(handle,&adu,&calibration))
+	{
+#if LOGGING > 9
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Get():Sampled adu:%d.",adu);
+#endif
+		return Temperature_ADU_To_Temperature(class,source,&calibration,adu,temperature);
+	}
 	adu = 0;
 	for (i = 0; i < TEMPERATURE_MAX_CHECKS; i++)
 	{
@@ -281,37 +333,10 @@ int CCD_Temperature_Get(char *class,char *source,CCD_Interface_Handle_T* handle,
 #endif
 
 	/* Calculate the temperature */
-	(*temperature) = (double)Temperature_Temperature(Temperature_Data.Temp_Coeff,Temperature_Data.Temp_Coeff_Count,
-		Temperature_Data.V_Upper,
-		Temperature_Data.V_Lower,Temperature_Data.Adu_Per_Volt,Temperature_Data.Adu_Offset,(float)adu);
-
-#if LOGGING > 9
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Get():Temperature:%.2f.",
-			      (*temperature));
-#endif
-
-	voltage = (adu - Temperature_Data.Adu_Offset) / Temperature_Data.Adu_Per_Volt; 
-
-#if LOGGING > 9
-	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Get():Voltage:%.2f.",voltage);
-#endif
-
-	/* is the voltage in range? */
-	if ((voltage > Temperature_Data.V_Lower) && (voltage < Temperature_Data.V_Upper))
-	{
-#if LOGGING > 0
-		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Get() returned %.2f.",
-			(*temperature));
-#endif
-		return TRUE;
-	}
-	else
-	{
-		Temperature_Error_Number = 1;
-		sprintf(Temperature_Error_String,"CCD Temperature Out of range: adu = %d T = %4.1f",
-			adu,(*temperature));
-		return FALSE;
-	}
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	calibration = handle->Temperature_Data.Calibration;
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+	return Temperature_ADU_To_Temperature(class,source,&calibration,adu,temperature);
 }
 
 /**
@@ -382,10 +407,14 @@ int CCD_Temperature_Set(char *class,char *source,CCD_Interface_Handle_T* handle,
 	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Set(temperature=%.2f) started.",
 		target_temperature);
 #endif
-	/* get the target adu count from target_temperature using the setup data */
-	adu = Temperature_Calc_Temp_ADU(Temperature_Data.Temp_Coeff,Temperature_Data.Temp_Coeff_Count,
-		Temperature_Data.V_Upper,Temperature_Data.V_Lower, 
-		Temperature_Data.Adu_Per_Volt,Temperature_Data.Adu_Offset,target_temperature);
+	/* get the target adu count from target_temperature using the handle's calibration data */
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	adu = Temperature_Calc_Temp_ADU(handle->Temperature_Data.Calibration.Temp_Coeff,
+		handle->Temperature_Data.Calibration.Temp_Coeff_Count,
+		handle->Temperature_Data.Calibration.V_Upper,handle->Temperature_Data.Calibration.V_Lower, 
+		handle->Temperature_Data.Calibration.Adu_Per_Volt,handle->Temperature_Data.Calibration.Adu_Offset,
+		target_temperature);
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
 	/* write the target to memory */
 	if(CCD_DSP_Command_WRM(class,source,handle,CCD_DSP_UTIL_BOARD_ID,CCD_DSP_MEM_SPACE_Y,
 			       TEMPERATURE_REQUIRED_ADU_ADDRESS,adu) != CCD_DSP_DON)
@@ -444,6 +473,199 @@ int CCD_Temperature_Get_Heater_ADU(char *class,char *source,CCD_Interface_Handle
 	return TRUE;
 }
 
+/**
+ * Routine to set the calibration data used to convert between dewar temperature sensor ADUs and temperatures,
+ * for the controller accessed through this handle. The red and blue arm controllers have different
+ * temperature sensors, so each handle has it's own calibration data, initialised to the defaults
+ * by CCD_Temperature_Data_Initialise.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param coeff_count The number of Chebychev coefficients in coeff_list, from 1 to CCD_TEMPERATURE_COEFF_COUNT.
+ * @param coeff_list A list of coeff_count Chebychev coefficients.
+ * @param v_upper The upper voltage limit of the sensor.
+ * @param v_lower The lower voltage limit of the sensor, which must be less than v_upper.
+ * @param adu_per_volt The number of ADU's per volt, which must be positive.
+ * @param adu_offset The offset to add to the ADU.
+ * @return TRUE if the calibration data was set, FALSE if an error occured.
+ * @see #CCD_Temperature_Data_Initialise
+ * @see ccd_temperature.html#CCD_TEMPERATURE_COEFF_COUNT
+ * @see ccd_temperature_private.html#CCD_Temperature_Calibration_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Temperature_Set_Calibration(char *class,char *source,CCD_Interface_Handle_T* handle,int coeff_count,
+				    double *coeff_list,double v_upper,double v_lower,double adu_per_volt,
+				    int adu_offset)
+{
+	int i;
+
+	Temperature_Error_Number = 0;
+#if LOGGING > 0
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Set_Calibration"
+			      "(coeff_count=%d,v_upper=%.6f,v_lower=%.6f,adu_per_volt=%.2f,adu_offset=%d) started.",
+			      coeff_count,v_upper,v_lower,adu_per_volt,adu_offset);
+#endif
+	if((coeff_count < 1)||(coeff_count > CCD_TEMPERATURE_COEFF_COUNT))
+	{
+		Temperature_Error_Number = 9;
+		sprintf(Temperature_Error_String,"CCD_Temperature_Set_Calibration:Illegal coeff_count %d.",
+			coeff_count);
+		return FALSE;
+	}
+	if(coeff_list == NULL)
+	{
+		Temperature_Error_Number = 10;
+		sprintf(Temperature_Error_String,"CCD_Temperature_Set_Calibration:coeff_list was NULL.");
+		return FALSE;
+	}
+	if((v_lower >= v_upper)||(adu_per_volt <= 0.0))
+	{
+		Temperature_Error_Number = 11;
+		sprintf(Temperature_Error_String,"CCD_Temperature_Set_Calibration:Illegal voltage range/conversion "
+			"(v_upper=%.6f,v_lower=%.6f,adu_per_volt=%.2f).",v_upper,v_lower,adu_per_volt);
+		return FALSE;
+	}
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	handle->Temperature_Data.Calibration.Temp_Coeff_Count = coeff_count;
+	for(i=0;i<coeff_count;i++)
+		handle->Temperature_Data.Calibration.Temp_Coeff[i] = (float)coeff_list[i];
+	for(i=coeff_count;i<CCD_TEMPERATURE_COEFF_COUNT;i++)
+		handle->Temperature_Data.Calibration.Temp_Coeff[i] = 0.0;
+	handle->Temperature_Data.Calibration.V_Upper = (float)v_upper;
+	handle->Temperature_Data.Calibration.V_Lower = (float)v_lower;
+	handle->Temperature_Data.Calibration.Adu_Per_Volt = (float)adu_per_volt;
+	handle->Temperature_Data.Calibration.Adu_Offset = adu_offset;
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+#if LOGGING > 0
+	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Set_Calibration() returned TRUE.");
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to start the temperature sampler for the controller accessed through this handle.
+ * The sampler is a thread that reads the dewar temperature ADU from the utility board once every 
+ * sample_period milliseconds (a single RDM command), and keeps a rolling average of the last 
+ * CCD_TEMPERATURE_SAMPLE_COUNT samples. CCD_Temperature_Get then returns immediately using this average,
+ * rather than sending a burst of TEMPERATURE_MAX_CHECKS commands to the controller.
+ * Samples are not taken whilst an exposure or setup is in progress on the handle.
+ * The sampler is stopped by CCD_Temperature_Sampler_Stop, which is also called by CCD_Interface_Close.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param sample_period The time between samples, in milliseconds. This must be greater than zero.
+ * @return TRUE if the sampler was started, FALSE if an error occured.
+ * @see #CCD_Temperature_Sampler_Stop
+ * @see #CCD_Temperature_Get
+ * @see #Temperature_Sampler_Thread
+ * @see ccd_temperature_private.html#CCD_TEMPERATURE_SAMPLE_COUNT
+ * @see ccd_interface.html#CCD_Interface_Close
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Temperature_Sampler_Start(char *class,char *source,CCD_Interface_Handle_T* handle,int sample_period)
+{
+	int retval;
+
+	Temperature_Error_Number = 0;
+#if LOGGING > 0
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+			      "CCD_Temperature_Sampler_Start(sample_period=%d) started.",sample_period);
+#endif
+	if(sample_period <= 0)
+	{
+		Temperature_Error_Number = 12;
+		sprintf(Temperature_Error_String,"CCD_Temperature_Sampler_Start:Illegal sample period %d.",
+			sample_period);
+		return FALSE;
+	}
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	if(handle->Temperature_Data.Sampler_Running)
+	{
+		pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+		Temperature_Error_Number = 13;
+		sprintf(Temperature_Error_String,"CCD_Temperature_Sampler_Start:Sampler already running.");
+		return FALSE;
+	}
+	if(class != NULL)
+		strncpy(handle->Temperature_Data.Sampler_Class,class,CCD_TEMPERATURE_STRING_LENGTH-1);
+	else
+		strcpy(handle->Temperature_Data.Sampler_Class,"-");
+	handle->Temperature_Data.Sampler_Class[CCD_TEMPERATURE_STRING_LENGTH-1] = '\0';
+	if(source != NULL)
+		strncpy(handle->Temperature_Data.Sampler_Source,source,CCD_TEMPERATURE_STRING_LENGTH-1);
+	else
+		strcpy(handle->Temperature_Data.Sampler_Source,"-");
+	handle->Temperature_Data.Sampler_Source[CCD_TEMPERATURE_STRING_LENGTH-1] = '\0';
+	handle->Temperature_Data.Sample_Period = sample_period;
+	handle->Temperature_Data.Sample_Index = 0;
+	handle->Temperature_Data.Sample_Count = 0;
+	handle->Temperature_Data.Sample_Sum = 0;
+	handle->Temperature_Data.Sampler_Quit = FALSE;
+	retval = pthread_create(&(handle->Temperature_Data.Sampler_Thread),NULL,Temperature_Sampler_Thread,
+				(void*)handle);
+	if(retval != 0)
+	{
+		pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+		Temperature_Error_Number = 14;
+		sprintf(Temperature_Error_String,"CCD_Temperature_Sampler_Start:Failed to create sampler thread (%d).",
+			retval);
+		return FALSE;
+	}
+	handle->Temperature_Data.Sampler_Running = TRUE;
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+#if LOGGING > 0
+	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Sampler_Start() returned TRUE.");
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to stop the temperature sampler for the controller accessed through this handle, if it is running.
+ * The sampler thread is told to quit, woken, and joined. The sampled ADUs are discarded, so
+ * CCD_Temperature_Get reads the controller directly again.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @return TRUE if the sampler was stopped (or was not running), FALSE if an error occured.
+ * @see #CCD_Temperature_Sampler_Start
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Temperature_Sampler_Stop(char *class,char *source,CCD_Interface_Handle_T* handle)
+{
+	int retval;
+
+	Temperature_Error_Number = 0;
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	if(handle->Temperature_Data.Sampler_Running == FALSE)
+	{
+		pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+		return TRUE;
+	}
+#if LOGGING > 0
+	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Sampler_Stop() started.");
+#endif
+	handle->Temperature_Data.Sampler_Quit = TRUE;
+	pthread_cond_broadcast(&(handle->Temperature_Data.Sample_Condition));
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+	retval = pthread_join(handle->Temperature_Data.Sampler_Thread,NULL);
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	handle->Temperature_Data.Sampler_Running = FALSE;
+	handle->Temperature_Data.Sample_Count = 0;
+	handle->Temperature_Data.Sample_Sum = 0;
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+	if(retval != 0)
+	{
+		Temperature_Error_Number = 15;
+		sprintf(Temperature_Error_String,"CCD_Temperature_Sampler_Stop:Failed to join sampler thread (%d).",
+			retval);
+		return FALSE;
+	}
+#if LOGGING > 0
+	CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Sampler_Stop() returned TRUE.");
+#endif
+	return TRUE;
+}
+
 /**
  * Get the current value of the error number.
  * @return The current value of the error number.
@@ -605,6 +827,207 @@ static int Temperature_Calc_Temp_ADU(float temp_coeff[], int n,float vu, float v
 	return iadu;
 }
 
+/**
+ * Routine to calculate the temperature from an (averaged) dewar temperature sensor ADU, using the
+ * specified calibration data. If the voltage is out of the sensor's range an error is returned.
+ * @param class The class parameter to use for any log messages associated with this operation.
+ * @param source The class parameter to use for any log messages associated with this operation.
+ * @param calibration The calibration data to use.
+ * @param adu The ADU to convert.
+ * @param temperature The address of a variable to hold the calculated temperature to be returned.
+ * 	The returned temperature is in degrees centigrade.
+ * @return TRUE if the temperature returned was sensible, FALSE if the voltage was out of range.
+ * @see #Temperature_Temperature
+ */
+static int Temperature_ADU_To_Temperature(char *class,char *source,
+					  struct CCD_Temperature_Calibration_Struct *calibration,int adu,
+					  double *temperature)
+{
+	float voltage;
+
+	(*temperature) = (double)Temperature_Temperature(calibration->Temp_Coeff,calibration->Temp_Coeff_Count,
+		calibration->V_Upper,calibration->V_Lower,calibration->Adu_Per_Volt,calibration->Adu_Offset,
+		(float)adu);
+
+#if LOGGING > 9
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Get():Temperature:%.2f.",
+			      (*temperature));
+#endif
+
+	voltage = (adu - calibration->Adu_Offset) / calibration->Adu_Per_Volt; 
+
+#if LOGGING > 9
+	CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Get():Voltage:%.2f.",voltage);
+#endif
+
+	/* is the voltage in range? */
+	if ((voltage > calibration->V_Lower) && (voltage < calibration->V_Upper))
+	{
+#if LOGGING > 0
+		CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,"CCD_Temperature_Get() returned %.2f.",
+			(*temperature));
+#endif
+		return TRUE;
+	}
+	else
+	{
+		Temperature_Error_Number = 1;
+		sprintf(Temperature_Error_String,"CCD Temperature Out of range: adu = %d T = %4.1f",
+			adu,(*temperature));
+		return FALSE;
+	}
+}
+
+/**
+ * Routine to get the temperature sampler's rolling average ADU, if the sampler is running and has taken a
+ * sample in the last TEMPERATURE_SAMPLE_MAX_AGE_PERIODS sample periods. The handle's calibration data is
+ * copied at the same time, under the sample mutex.
+ * @param handle The address of a CCD_Interface_Handle_T that holds the device connection specific information.
+ * @param adu The address of an integer, on success set to the average sampled ADU.
+ * @param calibration The address of a calibration structure, on success filled in with the handle's calibration.
+ * @return TRUE if a recent average was available, FALSE if it was not (and the controller should be read directly).
+ * @see #TEMPERATURE_SAMPLE_MAX_AGE_PERIODS
+ * @see ccd_temperature_private.html#CCD_Temperature_Struct
+ */
+static int Temperature_Get_Sampled_ADU(CCD_Interface_Handle_T* handle,int *adu,
+				       struct CCD_Temperature_Calibration_Struct *calibration)
+{
+	struct timespec current_time;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+	double age_ms;
+	int retval;
+
+#ifdef _POSIX_TIMERS
+	clock_gettime(CLOCK_REALTIME,&current_time);
+#else
+	gettimeofday(&gtod_current_time,NULL);
+	current_time.tv_sec = gtod_current_time.tv_sec;
+	current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
+#endif
+	retval = FALSE;
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	if(handle->Temperature_Data.Sampler_Running && (handle->Temperature_Data.Sample_Count > 0))
+	{
+		age_ms = (((double)(current_time.tv_sec-handle->Temperature_Data.Sample_Time.tv_sec))*
+			  ((double)CCD_GLOBAL_ONE_SECOND_MS))+
+			(((double)(current_time.tv_nsec-handle->Temperature_Data.Sample_Time.tv_nsec))/
+			 ((double)CCD_GLOBAL_ONE_MILLISECOND_NS));
+		if(age_ms <= (double)(TEMPERATURE_SAMPLE_MAX_AGE_PERIODS*handle->Temperature_Data.Sample_Period))
+		{
+			(*adu) = handle->Temperature_Data.Sample_Sum/handle->Temperature_Data.Sample_Count;
+			(*calibration) = handle->Temperature_Data.Calibration;
+			retval = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+	return retval;
+}
+
+/**
+ * The temperature sampler thread, started by CCD_Temperature_Sampler_Start. Once every Sample_Period
+ * milliseconds, if no exposure or setup is in progress on the handle, it reads the dewar temperature ADU
+ * from the utility board with a single CCD_DSP_Command_RDM, and adds it to the handle's sample ring
+ * (replacing the oldest sample once there are CCD_TEMPERATURE_SAMPLE_COUNT samples).
+ * A failed read is logged and skipped: the error state is thread local, so it is not seen by the
+ * threads driving the controller. Between samples the thread waits on Sample_Condition, so
+ * CCD_Temperature_Sampler_Stop can wake it immediately.
+ * @param user_arg The address of the CCD_Interface_Handle_T to sample the temperature of.
+ * @return The routine returns NULL.
+ * @see #CCD_Temperature_Sampler_Start
+ * @see #CCD_Temperature_Sampler_Stop
+ * @see #TEMPERATURE_CURRENT_ADU_ADDRESS
+ * @see ccd_dsp.html#CCD_DSP_Command_RDM
+ * @see ccd_exposure.html#CCD_Exposure_Get_Exposure_Status
+ * @see ccd_setup.html#CCD_Setup_Get_Setup_In_Progress
+ * @see ccd_temperature_private.html#CCD_Temperature_Struct
+ */
+static void *Temperature_Sampler_Thread(void *user_arg)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+	struct timespec wake_time;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+	char *class = NULL;
+	char *source = NULL;
+	int retval,adu,index;
+
+	handle = (CCD_Interface_Handle_T*)user_arg;
+	class = handle->Temperature_Data.Sampler_Class;
+	source = handle->Temperature_Data.Sampler_Source;
+	pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+	while(handle->Temperature_Data.Sampler_Quit == FALSE)
+	{
+		pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+		if((CCD_Exposure_Get_Exposure_Status(handle) == CCD_EXPOSURE_STATUS_NONE)&&
+		   (CCD_Setup_Get_Setup_In_Progress(handle) == FALSE))
+		{
+			retval = CCD_DSP_Command_RDM(class,source,handle,CCD_DSP_UTIL_BOARD_ID,CCD_DSP_MEM_SPACE_Y,
+						     TEMPERATURE_CURRENT_ADU_ADDRESS);
+			if((retval == 0)&&(CCD_DSP_Get_Error_Number() != 0))
+			{
+#if LOGGING > 9
+				CCD_Global_Log(class,source,LOG_VERBOSITY_VERBOSE,
+					       "Temperature_Sampler_Thread:Read temperature failed.");
+#endif
+			}
+			else
+			{
+				adu = retval & 0xFFF;
+				pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+				index = handle->Temperature_Data.Sample_Index;
+				if(handle->Temperature_Data.Sample_Count == CCD_TEMPERATURE_SAMPLE_COUNT)
+					handle->Temperature_Data.Sample_Sum -= handle->Temperature_Data.Sample_List[index];
+				else
+					handle->Temperature_Data.Sample_Count++;
+				handle->Temperature_Data.Sample_List[index] = adu;
+				handle->Temperature_Data.Sample_Sum += adu;
+				handle->Temperature_Data.Sample_Index = (index+1)%CCD_TEMPERATURE_SAMPLE_COUNT;
+#ifdef _POSIX_TIMERS
+				clock_gettime(CLOCK_REALTIME,&(handle->Temperature_Data.Sample_Time));
+#else
+				gettimeofday(&gtod_current_time,NULL);
+				handle->Temperature_Data.Sample_Time.tv_sec = gtod_current_time.tv_sec;
+				handle->Temperature_Data.Sample_Time.tv_nsec = gtod_current_time.tv_usec*
+					CCD_GLOBAL_ONE_MICROSECOND_NS;
+#endif
+				pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+#if LOGGING > 9
+				CCD_Global_Log_Format(class,source,LOG_VERBOSITY_VERBOSE,
+						      "Temperature_Sampler_Thread:Sampled adu %d.",adu);
+#endif
+			}
+		}
+		/* wait for the next sample period, or to be told to quit */
+#ifdef _POSIX_TIMERS
+		clock_gettime(CLOCK_REALTIME,&wake_time);
+#else
+		gettimeofday(&gtod_current_time,NULL);
+		wake_time.tv_sec = gtod_current_time.tv_sec;
+		wake_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
+#endif
+		pthread_mutex_lock(&(handle->Temperature_Data.Sample_Mutex));
+		wake_time.tv_sec += handle->Temperature_Data.Sample_Period/CCD_GLOBAL_ONE_SECOND_MS;
+		wake_time.tv_nsec += (handle->Temperature_Data.Sample_Period%CCD_GLOBAL_ONE_SECOND_MS)*
+			CCD_GLOBAL_ONE_MILLISECOND_NS;
+		if(wake_time.tv_nsec >= CCD_GLOBBAL_ONE_SECOND_NS)
+		{
+			wake_time.tv_sec++;
+			wake_time.tv_nsec -= CCD_GLOBBAL_ONE_SECOND_NS;
+		}
+		retval = 0;
+		while((handle->Temperature_Data.Sampler_Quit == FALSE)&&(retval != ETIMEDOUT))
+		{
+			retval = pthread_cond_timedwait(&(handle->Temperature_Data.Sample_Condition),
+							&(handle->Temperature_Data.Sample_Mutex),&wake_time);
+		}
+	}
+	pthread_mutex_unlock(&(handle->Temperature_Data.Sample_Mutex));
+	return NULL;
+}
+
 /*
 ** $Log: not supported by cvs2svn $
 ** Revision 0.14  2009/02/05 11:40:27  cjm
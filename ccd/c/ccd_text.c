@@ -4,7 +4,10 @@
 */
 /**
  * ccd_text.c implements a virtual interface that prints out all commands that are sent to the SDSU CCD Controller
- * and emulates appropriate replies to requests.
+ * and emulates appropriate replies to requests. It also simulates the timing of exposures and readouts,
+ * including the HSTR register, readout progress and the image buffer filling with pixels in amplifier order,
+ * so the exposure path can be tested and benchmarked without a controller. Each opened handle is simulated 
+ * independantly, so more than one can be used at once.
  * @author SDSU, Chris Mottram
  * @version $Revision: 0.27 $
  */
@@ -24,6 +27,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
 #ifndef _POSIX_TIMERS
 #include <sys/time.h>
 #endif
@@ -74,30 +78,92 @@ static char rcsid[] = "$Id: ccd_text.c,v 0.27 2009-04-30 14:22:51 cjm Exp $";
 	CCD_DSP_CONTROLLER_CONFIG_BIT_SUBARRAY|CCD_DSP_CONTROLLER_CONFIG_BIT_BINNING| \
 	CCD_DSP_CONTROLLER_CONFIG_BIT_SERIAL_SPLIT)
 
-/* structures */
 /**
- * Internal handle data structure.
- * <dl>
- * <dt>Text_Device_Filename</dt> <dd>Filename of file to write text data to.</dd>
- * <dt>Text_File_Ptr</dt> <dd>FILE pointer to open text file to write to.</dd>
- * </dl>
- * File pointer to where the prints should be sent to.
- * @see #TEXT_MAX_FILENAME_LENGTH
+ * The number of words of timing board Y memory the simulator keeps track of. Values written using WRM to
+ * addresses below this are remembered, so the readout dimensions and binning can be used to simulate the readout.
  */
-struct CCD_Text_Handle_Struct
-{
-	char Text_Device_Filename[TEXT_MAX_FILENAME_LENGTH+1];
-	FILE *Text_File_Ptr;
-};
+#define TEXT_TIMING_Y_MEMORY_LENGTH	(0x10)
+/**
+ * The timing board Y memory address where the number of (binned) columns to read out is stored.
+ * @see ccd_setup.html#SETUP_ADDRESS_DIMENSION_COLS
+ */
+#define TEXT_ADDRESS_DIMENSION_COLS	(0x1)
+/**
+ * The timing board Y memory address where the number of (binned) rows to read out is stored.
+ * @see ccd_setup.html#SETUP_ADDRESS_DIMENSION_ROWS
+ */
+#define TEXT_ADDRESS_DIMENSION_ROWS	(0x2)
+/**
+ * The timing board Y memory address where the X (serial) binning factor is stored.
+ * @see ccd_setup.html#SETUP_ADDRESS_BIN_X
+ */
+#define TEXT_ADDRESS_BIN_X		(0x5)
+/**
+ * The timing board Y memory address where the Y (parallel) binning factor is stored.
+ * @see ccd_setup.html#SETUP_ADDRESS_BIN_Y
+ */
+#define TEXT_ADDRESS_BIN_Y		(0x6)
+/**
+ * Index into the pixel rate table for the left amplifier.
+ */
+#define TEXT_AMPLIFIER_INDEX_LEFT	(0)
+/**
+ * Index into the pixel rate table for the right amplifier.
+ */
+#define TEXT_AMPLIFIER_INDEX_RIGHT	(1)
+/**
+ * Index into the pixel rate table for dual (left and right) amplifier readouts.
+ */
+#define TEXT_AMPLIFIER_INDEX_BOTH	(2)
+/**
+ * The number of amplifier configurations in the pixel rate table.
+ */
+#define TEXT_AMPLIFIER_COUNT		(3)
+/**
+ * The default rate single amplifier readouts are simulated at, in pixels per second. Dual amplifier
+ * readouts default to twice this. This is about 4 microseconds per pixel, which reads out
+ * a full frame in around 9 seconds through one amplifier.
+ */
+#define TEXT_DEFAULT_PIXEL_RATE		(250000)
+/**
+ * The simulated bias level of the left amplifier, in ADU.
+ */
+#define TEXT_BIAS_LEVEL_LEFT		(1000)
+/**
+ * The simulated bias level of the right amplifier, in ADU. This is deliberately different from the
+ * left amplifier bias, so a wrongly de-interlaced dual amplifier readout is easy to spot.
+ */
+#define TEXT_BIAS_LEVEL_RIGHT		(1080)
+/**
+ * The simulated sky/dark signal collected by each unbinned pixel, in ADU per second of exposure.
+ */
+#define TEXT_SIGNAL_RATE		(20)
+/**
+ * The size of the simulated illumination gradient, in ADU, across the readout in each direction.
+ * The gradient increases with the de-interlaced column and row number.
+ */
+#define TEXT_GRADIENT_HEIGHT		(256)
+/**
+ * The maximum value a simulated pixel can have.
+ */
+#define TEXT_SATURATION_LEVEL		(65535)
 
+/* structures */
 /**
- * Structure holding data that the PCI interface would normally know about. This includes
- * the driver request being processed, the HCVR value, values held in the argument registers.
+ * Internal handle data structure. This holds the data that the PCI interface (and SDSU controller) would 
+ * normally know about, so that each opened text device is simulated independantly. This includes
+ * the driver request being processed, the HCVR value, values held in the argument registers,
+ * and the state of the simulated exposure and readout.
  * <dl>
+ * <dt>Text_Device_Filename</dt> <dd>Filename of file to write text data to.</dd>
+ * <dt>Text_File_Ptr</dt> <dd>FILE pointer to open text file to write to.</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting the simulator state, as readout progress can be requested from 
+ *     a different thread to the one sending commands (e.g. the temperature sampler).</dd>
  * <dt>Ioctl_Request</dt> <dd>The ioctl request.</dd>
  * <dt>HCVR_Command</dt> <dd>The last value put in the HCVR.</dd>
  * <dt>HCTR_Register</dt> <dd>The last value put in the HCTR.</dd>
  * <dt>HSTR_Register</dt> <dd>The last value put in the Host Status Transfer Register.</dd>
+ * <dt>Manual_Command</dt> <dd>The last manual command sent.</dd>
  * <dt>Destination</dt> <dd>The last destination put into the board destination register. Note
  * 	this does not include the number of arguments, see below.</dd>
  * <dt>Argument_List</dt> <dd>The current values of the PCI argument registers. An array of length 
@@ -106,17 +172,44 @@ struct CCD_Text_Handle_Struct
  * 	set as part of setting a destination.</dd>
  * <dt>Reply</dt> <dd>What we think the reply value should be.</dd>
  * <dt>Controller_Config</dt> <dd>The current value of the PCI controller status register.</dd>
+ * <dt>Timing_Y_Memory</dt> <dd>The values last written to the start of the timing board's Y memory.</dd>
+ * <dt>Amplifier</dt> <dd>The output amplifier last selected using SOS.</dd>
+ * <dt>Window_Bias_Width</dt> <dd>The bias strip width last set using SSS.</dd>
+ * <dt>Window_Box_Width</dt> <dd>The subarray box width last set using SSS, zero for full frame readouts.</dd>
+ * <dt>Window_Box_Height</dt> <dd>The subarray box height last set using SSS.</dd>
+ * <dt>Pixel_Rate_List</dt> <dd>The simulated readout rate, in pixels per second, indexed by amplifier
+ *     configuration and X and Y binning (minus one).</dd>
+ * <dt>Command_Delay</dt> <dd>The time, in milliseconds, each request takes to complete.</dd>
  * <dt>Exposure_Length</dt> <dd>The length of the exposure, in milliseconds.</dd>
- * <dt>Exposure_Start_Time</dt> <dd>The time the exposure was started.</dd>
+ * <dt>Exposure_Active</dt> <dd>A boolean, TRUE from when an exposure is started until it's readout completes
+ *     or is aborted.</dd>
+ * <dt>Exposure_Start_Time</dt> <dd>The time the exposure was started (adjusted for any time spent paused).</dd>
  * <dt>Pause_Start_Time</dt> <dd>The time the last pause was started.</dd>
  * <dt>Buffer</dt> <dd>Pointer to a memory buffer used for image storage.</dd>
  * <dt>Buffer_Length</dt> <dd>The allocated size of Buffer, in bytes.</dd>
- * <dt>Readout_Progress</dt> <dd>The number of bytes currently read out by the CCD.</dd>
+ * <dt>Readout_Progress</dt> <dd>The number of pixels currently read out by the CCD.</dd>
+ * <dt>Readout_Pixel_Count</dt> <dd>The total number of pixels the current readout will produce.</dd>
+ * <dt>Readout_Fill_Count</dt> <dd>The number of pixels of Buffer that have been filled with readout data.</dd>
+ * <dt>Readout_Pixel_Rate</dt> <dd>The rate the current readout is proceeding at, in pixels per second.</dd>
+ * <dt>Readout_Amplifier_Index</dt> <dd>The amplifier configuration used for the current readout.</dd>
+ * <dt>Readout_Block_Width</dt> <dd>The width of each block of pixels read out, the full readout width
+ *     for a full frame, or the box plus bias strip width for a windowed readout.</dd>
+ * <dt>Readout_Block_Height</dt> <dd>The height of each block of pixels read out.</dd>
+ * <dt>Readout_Box_Width</dt> <dd>The number of illuminated columns at the start of each (de-interlaced)
+ *     block row, the rest of the row is bias strip.</dd>
+ * <dt>Readout_Signal</dt> <dd>The signal collected by each (binned) pixel during the exposure, in ADU.</dd>
  * </dl>
+ * @see #TEXT_MAX_FILENAME_LENGTH
  * @see #TEXT_ARGUMENT_COUNT
+ * @see #TEXT_TIMING_Y_MEMORY_LENGTH
+ * @see #TEXT_AMPLIFIER_COUNT
+ * @see #CCD_TEXT_MAX_BINNING
  */
-struct Text_Struct
+struct CCD_Text_Handle_Struct
 {
+	char Text_Device_Filename[TEXT_MAX_FILENAME_LENGTH+1];
+	FILE *Text_File_Ptr;
+	pthread_mutex_t Mutex;
 	int Ioctl_Request;
 	int HCVR_Command;
 	int HCTR_Register;
@@ -127,12 +220,28 @@ struct Text_Struct
 	int Argument_Count;
 	int Reply;
 	int Controller_Config;
+	int Timing_Y_Memory[TEXT_TIMING_Y_MEMORY_LENGTH];
+	enum CCD_DSP_AMPLIFIER Amplifier;
+	int Window_Bias_Width;
+	int Window_Box_Width;
+	int Window_Box_Height;
+	int Pixel_Rate_List[TEXT_AMPLIFIER_COUNT][CCD_TEXT_MAX_BINNING][CCD_TEXT_MAX_BINNING];
+	int Command_Delay;
 	int Exposure_Length;
+	int Exposure_Active;
 	struct timespec Exposure_Start_Time;
 	struct timespec Pause_Start_Time;
 	unsigned short *Buffer;
 	int Buffer_Length;
 	int Readout_Progress;
+	int Readout_Pixel_Count;
+	int Readout_Fill_Count;
+	int Readout_Pixel_Rate;
+	int Readout_Amplifier_Index;
+	int Readout_Block_Width;
+	int Readout_Block_Height;
+	int Readout_Box_Width;
+	int Readout_Signal;
 };
 
 /**
@@ -175,8 +284,15 @@ struct Memory_Struct
 /* internal routines */
 static void Text_Print_Reply(CCD_Interface_Handle_T *handle);
 static void Text_HCVR(CCD_Interface_Handle_T *handle,int hcvr_command);
-static void Text_HSTR(void);
-static void Text_Readout_Progress(void);
+static void Text_Readout_Update(CCD_Interface_Handle_T *handle);
+static void Text_Readout_Fill(CCD_Interface_Handle_T *handle,int pixel_count);
+static unsigned short Text_Pixel_Value(CCD_Interface_Handle_T *handle,int pixel_index);
+static int Text_Amplifier_Index(enum CCD_DSP_AMPLIFIER amplifier);
+static void Text_Command_Delay(int delay_ms);
+static void Text_Get_Current_Time(struct timespec *current_time);
+static double Text_TimeSpec_Diff_Ms(struct timespec start_time,struct timespec end_time);
+static int Text_Mutex_Lock(CCD_Interface_Handle_T *handle);
+static int Text_Mutex_Unlock(CCD_Interface_Handle_T *handle);
 static void Text_Manual(CCD_Interface_Handle_T *handle,int manual_command);
 static void Text_Destination(CCD_Interface_Handle_T *handle,int destination_number);
 static void Text_Manual_Read_Controller_Config(CCD_Interface_Handle_T *handle);
@@ -187,25 +303,29 @@ static void Text_Manual_Set_Exposure_Time(CCD_Interface_Handle_T *handle);
 static void Text_Manual_Start_Exposure(CCD_Interface_Handle_T *handle);
 static void Text_Manual_Pause_Exposure(CCD_Interface_Handle_T *handle);
 static void Text_Manual_Resume_Exposure(CCD_Interface_Handle_T *handle);
+static void Text_Manual_Abort_Exposure(CCD_Interface_Handle_T *handle);
+static void Text_Manual_Write_Memory(CCD_Interface_Handle_T *handle);
+static void Text_Manual_Set_Output_Source(CCD_Interface_Handle_T *handle);
+static void Text_Manual_Set_Subarray_Size(CCD_Interface_Handle_T *handle);
+static void Text_HCVR_Abort_Readout(CCD_Interface_Handle_T *handle);
 
 /* local variables */
 /**
- * Variable holding error code of last operation performed by ccd_text.
+ * Variable holding error code of last operation performed by ccd_text,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static int Text_Error_Number = 0;
+static CCD_GLOBAL_THREAD_LOCAL int Text_Error_Number = 0;
 /**
- * Local variable holding description of the last error that occured.
+ * Local variable holding description of the last error that occured,
+ * in the calling thread.
+ * @see ccd_global.html#CCD_GLOBAL_THREAD_LOCAL
  */
-static char Text_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
+static CCD_GLOBAL_THREAD_LOCAL char Text_Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH] = "";
 /**
  * Local variable for deciding how detailed the print information is.
  */
 static enum CCD_TEXT_PRINT_LEVEL Text_Print_Level = CCD_TEXT_PRINT_LEVEL_COMMANDS;
-/**
- * Local variable holding data normally held by the PCI registers.
- * @see #Text_Struct
- */
-static struct Text_Struct Text_Data;
 /**
  * A list of all the HCVR commands the text driver can process. A Text description is given, the
  * default reply value to set the reply buffer to, and a function pointer to call for cases where the
@@ -218,7 +338,7 @@ static struct Text_Command_Struct Text_HCVR_Command_List[] =
 	{CCD_PCI_HCVR_RESET_CONTROLLER,"Reset Controller",CCD_DSP_SYR,NULL},
 	{CCD_PCI_HCVR_PCI_PC_RESET,"Reset PCI board Program Counter",CCD_DSP_DON,NULL},
 	{CCD_PCI_HCVR_SET_BIAS_VOLTAGES,"Set Bias Voltages",CCD_DSP_DON,NULL},
-	{CCD_PCI_HCVR_ABORT_READOUT,"Abort Readout",CCD_DSP_DON,NULL},
+	{CCD_PCI_HCVR_ABORT_READOUT,"Abort Readout",CCD_DSP_DON,Text_HCVR_Abort_Readout},
 };
 
 /**
@@ -235,7 +355,7 @@ static struct Text_Command_Struct Text_HCVR_Command_List[] =
  */
 static struct Text_Command_Struct Text_Manual_Command_List[] = 
 {
-	{CCD_DSP_AEX,"Abort Exposure",CCD_DSP_DON,NULL},
+	{CCD_DSP_AEX,"Abort Exposure",CCD_DSP_DON,Text_Manual_Abort_Exposure},
 	{CCD_DSP_CLR,"Clear Array",CCD_DSP_DON,NULL},
 	{CCD_DSP_CSH,"Close Shutter",CCD_DSP_DON,NULL},
 	{CCD_DSP_IDL,"Resume Idling",CCD_DSP_DON,NULL},
@@ -251,12 +371,12 @@ static struct Text_Command_Struct Text_Manual_Command_List[] =
 	{CCD_DSP_SET,"Set Exposure Time",CCD_DSP_DON,Text_Manual_Set_Exposure_Time},
 	{CCD_DSP_SEX,"Start Exposure",CCD_DSP_DON,Text_Manual_Start_Exposure},
 	{CCD_DSP_SGN,"Set Gain",CCD_DSP_DON,NULL},
-	{CCD_DSP_SOS,"Set Output Source",CCD_DSP_DON,NULL},
+	{CCD_DSP_SOS,"Set Output Source",CCD_DSP_DON,Text_Manual_Set_Output_Source},
 	{CCD_DSP_SSP,"Set Subarray Position",CCD_DSP_DON,NULL},
-	{CCD_DSP_SSS,"Set Subarray Size",CCD_DSP_DON,NULL},
+	{CCD_DSP_SSS,"Set Subarray Size",CCD_DSP_DON,Text_Manual_Set_Subarray_Size},
 	{CCD_DSP_STP,"Stop Idling",CCD_DSP_DON,NULL},
 	{CCD_DSP_TDL,"Test Data Link",0,Text_Manual_Test_Data_Link},
-	{CCD_DSP_WRM,"Write Memory",CCD_DSP_DON,NULL}
+	{CCD_DSP_WRM,"Write Memory",CCD_DSP_DON,Text_Manual_Write_Memory}
 };
 
 /**
@@ -314,51 +434,141 @@ void CCD_Text_Set_Print_Level(enum CCD_TEXT_PRINT_LEVEL level)
 	Text_Print_Level = level;
 }
 
+/**
+ * This routine is called to set the rate at which the simulated CCD reads out, for a particular amplifier
+ * and binning configuration. This allows the readout times of the real controller to be modelled,
+ * so the exposure/readout/save path can be benchmarked without a controller.
+ * The device must have been opened before calling this routine.
+ * @param handle The address of a CCD_Interface_Handle_T, opened with the text device.
+ * @param amplifier Which amplifier configuration the rate is for, one of 
+ *        <a href="ccd_dsp.html#CCD_DSP_AMPLIFIER">CCD_DSP_AMPLIFIER</a>:
+ *        CCD_DSP_AMPLIFIER_LEFT, CCD_DSP_AMPLIFIER_RIGHT or CCD_DSP_AMPLIFIER_BOTH.
+ * @param nsbin The X (serial) binning the rate is for, from 1 to CCD_TEXT_MAX_BINNING. Readouts with
+ *        larger binning use the rate for CCD_TEXT_MAX_BINNING.
+ * @param npbin The Y (parallel) binning the rate is for, from 1 to CCD_TEXT_MAX_BINNING.
+ * @param pixel_rate The readout rate, in (binned) pixels per second.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #CCD_TEXT_MAX_BINNING
+ * @see #Text_Amplifier_Index
+ * @see #Text_Mutex_Lock
+ * @see #Text_Mutex_Unlock
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Text_Set_Pixel_Rate(CCD_Interface_Handle_T *handle,enum CCD_DSP_AMPLIFIER amplifier,int nsbin,int npbin,
+			    int pixel_rate)
+{
+	Text_Error_Number = 0;
+	if(handle == NULL)
+	{
+		Text_Error_Number = 25;
+		sprintf(Text_Error_String,"CCD_Text_Set_Pixel_Rate failed:handle was NULL.");
+		return FALSE;
+	}
+	if(handle->Handle.Text == NULL)
+	{
+		Text_Error_Number = 26;
+		sprintf(Text_Error_String,"CCD_Text_Set_Pixel_Rate failed:handle Text pointer was NULL.");
+		return FALSE;
+	}
+	if(!CCD_DSP_IS_AMPLIFIER(amplifier))
+	{
+		Text_Error_Number = 27;
+		sprintf(Text_Error_String,"CCD_Text_Set_Pixel_Rate failed:Illegal amplifier '%#x'.",amplifier);
+		return FALSE;
+	}
+	if((nsbin < 1)||(nsbin > CCD_TEXT_MAX_BINNING)||(npbin < 1)||(npbin > CCD_TEXT_MAX_BINNING))
+	{
+		Text_Error_Number = 28;
+		sprintf(Text_Error_String,"CCD_Text_Set_Pixel_Rate failed:Illegal binning (%d,%d).",nsbin,npbin);
+		return FALSE;
+	}
+	if(pixel_rate <= 0)
+	{
+		Text_Error_Number = 29;
+		sprintf(Text_Error_String,"CCD_Text_Set_Pixel_Rate failed:Illegal pixel rate %d.",pixel_rate);
+		return FALSE;
+	}
+	if(!Text_Mutex_Lock(handle))
+		return FALSE;
+	handle->Handle.Text->Pixel_Rate_List[Text_Amplifier_Index(amplifier)][nsbin-1][npbin-1] = pixel_rate;
+	if(!Text_Mutex_Unlock(handle))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * This routine is called to set how long each request to the simulated device takes to complete. This allows a
+ * slow controller to be modelled, for instance to test how other threads' commands are queued whilst
+ * a command is in progress. The device must have been opened before calling this routine.
+ * @param handle The address of a CCD_Interface_Handle_T, opened with the text device.
+ * @param delay_ms The time each request takes, in milliseconds. Zero (the default) means requests
+ *        complete immediately.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Text_Command_Delay
+ * @see #Text_Mutex_Lock
+ * @see #Text_Mutex_Unlock
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+int CCD_Text_Set_Command_Delay(CCD_Interface_Handle_T *handle,int delay_ms)
+{
+	Text_Error_Number = 0;
+	if(handle == NULL)
+	{
+		Text_Error_Number = 31;
+		sprintf(Text_Error_String,"CCD_Text_Set_Command_Delay failed:handle was NULL.");
+		return FALSE;
+	}
+	if(handle->Handle.Text == NULL)
+	{
+		Text_Error_Number = 32;
+		sprintf(Text_Error_String,"CCD_Text_Set_Command_Delay failed:handle Text pointer was NULL.");
+		return FALSE;
+	}
+	if(delay_ms < 0)
+	{
+		Text_Error_Number = 33;
+		sprintf(Text_Error_String,"CCD_Text_Set_Command_Delay failed:Illegal delay %d.",delay_ms);
+		return FALSE;
+	}
+	if(!Text_Mutex_Lock(handle))
+		return FALSE;
+	handle->Handle.Text->Command_Delay = delay_ms;
+	if(!Text_Mutex_Unlock(handle))
+		return FALSE;
+	return TRUE;
+}
+
 /* device driver implementation functions */
 /**
  * This routine should be called at startup. 
  * In a real driver it will initialise the connection information ready for the device to be opened.
- * This routine just prints a message and initialises the Text_Data structure. It initialises the Text_File_Ptr
- * if it has not already been initialised by a call to CCD_Text_Set_File_Pointer.
+ * This routine just prints a message, the simulator state is per handle and is initialised in CCD_Text_Open.
  * @see ccd_interface.html#CCD_Interface_Initialise
- * @see #Text_Data
- * @see #Text_File_Ptr
- * @see #CCD_Text_Set_File_Pointer
+ * @see #CCD_Text_Open
  */
 void CCD_Text_Initialise(void)
 {
-	int i;
-
 	Text_Error_Number = 0;
-	Text_Data.Ioctl_Request = 0;
-	Text_Data.HCVR_Command = 0;
-	Text_Data.HCTR_Register = 0;
-	Text_Data.HSTR_Register = 0;
-	Text_Data.Manual_Command = 0;
-	Text_Data.Destination = 0;
-	Text_Data.Argument_Count = 0;
-	for(i=0;i<TEXT_ARGUMENT_COUNT;i++)
-		Text_Data.Argument_List[i] = 0;
-	Text_Data.Reply = -1;
-	Text_Data.Controller_Config = TEXT_DEFAULT_CONTROLLER_CONFIG;
-	Text_Data.Readout_Progress = 0;
 /* print some compile time information to stdout */
 	fprintf(stdout,"CCD_Text_Initialise:%s.\n",rcsid);
 }
 
 /**
- * This routine is called to open the device for communication. In this driver it just
- * prints out a message. 
+ * This routine is called to open the device for communication. In this driver it 
+ * opens the text file to print commands into, and initialises the per handle simulator state.
  * @param device_pathname The pathname of the device we are trying to talk to.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
- * @return Returns TRUE if a device can be opened, otherwise it returns FALSE. Currently, the device can
- * 	always be opened.
+ * @return Returns TRUE if a device can be opened, otherwise it returns FALSE.
  * @see #TEXT_MAX_FILENAME_LENGTH
+ * @see #TEXT_DEFAULT_CONTROLLER_CONFIG
+ * @see #TEXT_DEFAULT_PIXEL_RATE
  * @see ccd_interface.html#CCD_Interface_Handle_T
  * @see ccd_interface.html#CCD_Interface_Open
  */
 int CCD_Text_Open(char *device_pathname,CCD_Interface_Handle_T *handle)
 {
+	int i,x,y,error_number;
+
 	Text_Error_Number = 0;
 	/* check parameters */
 	if(device_pathname == NULL)
@@ -376,7 +586,8 @@ int CCD_Text_Open(char *device_pathname,CCD_Interface_Handle_T *handle)
 	if(strlen(device_pathname) > TEXT_MAX_FILENAME_LENGTH)
 	{
 		Text_Error_Number = 9;
-		sprintf(Text_Error_String,"CCD_Text_Open failed:handle was NULL.");
+		sprintf(Text_Error_String,"CCD_Text_Open failed:device_pathname too long(%lu).",
+			(unsigned long)strlen(device_pathname));
 		return FALSE;
 	}
 	/* Allocate Text block */
@@ -387,16 +598,73 @@ int CCD_Text_Open(char *device_pathname,CCD_Interface_Handle_T *handle)
 		sprintf(Text_Error_String,"CCD_Text_Open failed:Failed to allocate handle memory.");
 		return FALSE;
 	}
+	/* initialise simulator state */
+	handle->Handle.Text->Ioctl_Request = 0;
+	handle->Handle.Text->HCVR_Command = 0;
+	handle->Handle.Text->HCTR_Register = 0;
+	handle->Handle.Text->HSTR_Register = 0;
+	handle->Handle.Text->Manual_Command = 0;
+	handle->Handle.Text->Destination = 0;
+	handle->Handle.Text->Argument_Count = 0;
+	for(i=0;i<TEXT_ARGUMENT_COUNT;i++)
+		handle->Handle.Text->Argument_List[i] = 0;
+	handle->Handle.Text->Reply = -1;
+	handle->Handle.Text->Controller_Config = TEXT_DEFAULT_CONTROLLER_CONFIG;
+	for(i=0;i<TEXT_TIMING_Y_MEMORY_LENGTH;i++)
+		handle->Handle.Text->Timing_Y_Memory[i] = 0;
+	handle->Handle.Text->Timing_Y_Memory[TEXT_ADDRESS_BIN_X] = 1;
+	handle->Handle.Text->Timing_Y_Memory[TEXT_ADDRESS_BIN_Y] = 1;
+	handle->Handle.Text->Amplifier = CCD_DSP_AMPLIFIER_LEFT;
+	handle->Handle.Text->Window_Bias_Width = 0;
+	handle->Handle.Text->Window_Box_Width = 0;
+	handle->Handle.Text->Window_Box_Height = 0;
+	for(x=0;x<CCD_TEXT_MAX_BINNING;x++)
+	{
+		for(y=0;y<CCD_TEXT_MAX_BINNING;y++)
+		{
+			handle->Handle.Text->Pixel_Rate_List[TEXT_AMPLIFIER_INDEX_LEFT][x][y] = TEXT_DEFAULT_PIXEL_RATE;
+			handle->Handle.Text->Pixel_Rate_List[TEXT_AMPLIFIER_INDEX_RIGHT][x][y] = TEXT_DEFAULT_PIXEL_RATE;
+			handle->Handle.Text->Pixel_Rate_List[TEXT_AMPLIFIER_INDEX_BOTH][x][y] = 2*TEXT_DEFAULT_PIXEL_RATE;
+		}
+	}
+	handle->Handle.Text->Command_Delay = 0;
+	handle->Handle.Text->Exposure_Length = 0;
+	handle->Handle.Text->Exposure_Active = FALSE;
+	handle->Handle.Text->Exposure_Start_Time.tv_sec = 0;
+	handle->Handle.Text->Exposure_Start_Time.tv_nsec = 0;
+	handle->Handle.Text->Pause_Start_Time.tv_sec = 0;
+	handle->Handle.Text->Pause_Start_Time.tv_nsec = 0;
+	handle->Handle.Text->Buffer = NULL;
+	handle->Handle.Text->Buffer_Length = 0;
+	handle->Handle.Text->Readout_Progress = 0;
+	handle->Handle.Text->Readout_Pixel_Count = 0;
+	handle->Handle.Text->Readout_Fill_Count = 0;
+	handle->Handle.Text->Readout_Pixel_Rate = TEXT_DEFAULT_PIXEL_RATE;
+	handle->Handle.Text->Readout_Amplifier_Index = TEXT_AMPLIFIER_INDEX_LEFT;
+	handle->Handle.Text->Readout_Block_Width = 0;
+	handle->Handle.Text->Readout_Block_Height = 0;
+	handle->Handle.Text->Readout_Box_Width = 0;
+	handle->Handle.Text->Readout_Signal = 0;
+	error_number = pthread_mutex_init(&(handle->Handle.Text->Mutex),NULL);
+	if(error_number != 0)
+	{
+		free(handle->Handle.Text);
+		handle->Handle.Text = NULL;
+		Text_Error_Number = 30;
+		sprintf(Text_Error_String,"CCD_Text_Open failed:Initialising mutex failed(%d).",error_number);
+		return FALSE;
+	}
 	/* try to open the device */
 	strcpy(handle->Handle.Text->Text_Device_Filename,device_pathname);
-	Text_Data.Buffer = NULL;
-	Text_Data.Buffer_Length = 0;
 	handle->Handle.Text->Text_File_Ptr = fopen(handle->Handle.Text->Text_Device_Filename,"a+");
 	if(handle->Handle.Text->Text_File_Ptr == NULL)
 	{
 		Text_Error_Number = 11;
 		sprintf(Text_Error_String,"CCD_Text_Open failed:Failed to open '%s' for appending.",
 			handle->Handle.Text->Text_Device_Filename);
+		pthread_mutex_destroy(&(handle->Handle.Text->Mutex));
+		free(handle->Handle.Text);
+		handle->Handle.Text = NULL;
 		return FALSE;
 	}
 	if(Text_Print_Level == CCD_TEXT_PRINT_LEVEL_ALL)
@@ -406,7 +674,7 @@ int CCD_Text_Open(char *device_pathname,CCD_Interface_Handle_T *handle)
 
 /**
  * Routine to create a memory map for image download. This is done using malloc, as we are only emulating
- * the interface.
+ * the interface. The buffer is filled with simulated pixels as the readout progresses.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @param buffer_size The size of the buffer, in bytes.
  * @return Return TRUE if buffer initialisation is successful, FALSE if it wasn't.
@@ -432,15 +700,23 @@ int CCD_Text_Memory_Map(CCD_Interface_Handle_T *handle,int buffer_size)
 		sprintf(Text_Error_String,"CCD_Text_Memory_Map failed:Illegal buffer size %d.",buffer_size);
 		return FALSE;
 	}
-	/* diddly think about putting Buffer/Buffer_Length inside the Text handle, to allow multiple connections */
-	Text_Data.Buffer_Length = buffer_size;
-	Text_Data.Buffer = (unsigned short *)malloc(Text_Data.Buffer_Length);
-	if(Text_Data.Buffer == NULL)
+	if(!Text_Mutex_Lock(handle))
+		return FALSE;
+	if(handle->Handle.Text->Buffer != NULL)
+		free(handle->Handle.Text->Buffer);
+	handle->Handle.Text->Buffer_Length = buffer_size;
+	handle->Handle.Text->Buffer = (unsigned short *)calloc(1,handle->Handle.Text->Buffer_Length);
+	handle->Handle.Text->Readout_Fill_Count = 0;
+	if(handle->Handle.Text->Buffer == NULL)
 	{
+		handle->Handle.Text->Buffer_Length = 0;
+		Text_Mutex_Unlock(handle);
 		Text_Error_Number = 4;
-		sprintf(Text_Error_String,"CCD_Text_Memory_Map:Memory allocation failed(%d).",Text_Data.Buffer_Length);
+		sprintf(Text_Error_String,"CCD_Text_Memory_Map:Memory allocation failed(%d).",buffer_size);
 		return FALSE;
 	}
+	if(!Text_Mutex_Unlock(handle))
+		return FALSE;
 	return TRUE;
 }
 
@@ -465,15 +741,22 @@ int CCD_Text_Memory_UnMap(CCD_Interface_Handle_T *handle)
 		sprintf(Text_Error_String,"CCD_Text_Memory_UnMap failed:handle Text pointer was NULL.");
 		return FALSE;
 	}
-	if(Text_Data.Buffer == NULL)
+	if(!Text_Mutex_Lock(handle))
+		return FALSE;
+	if(handle->Handle.Text->Buffer == NULL)
 	{
+		Text_Mutex_Unlock(handle);
 		Text_Error_Number = 6;
-		sprintf(Text_Error_String,"CCD_Text_Memory_UnMap:Buffer was NULL(%d).",Text_Data.Buffer_Length);
+		sprintf(Text_Error_String,"CCD_Text_Memory_UnMap:Buffer was NULL(%d).",
+			handle->Handle.Text->Buffer_Length);
 		return FALSE;
 	}
-	free(Text_Data.Buffer);
-	Text_Data.Buffer = NULL;
-	Text_Data.Buffer_Length = 0;
+	free(handle->Handle.Text->Buffer);
+	handle->Handle.Text->Buffer = NULL;
+	handle->Handle.Text->Buffer_Length = 0;
+	handle->Handle.Text->Readout_Fill_Count = 0;
+	if(!Text_Mutex_Unlock(handle))
+		return FALSE;
 	return TRUE;
 }
 
@@ -491,15 +774,18 @@ int CCD_Text_Memory_UnMap(CCD_Interface_Handle_T *handle)
  * @see ccd_interface.html#CCD_Interface_Handle_T
  * @see ccd_interface.html#CCD_Interface_Command
  * @see #Text_Print_Reply
- * @see #Text_HSTR
- * @see #Text_Readout_Progress
+ * @see #Text_Readout_Update
  * @see #Text_HCVR
- * @see #Text_Data
- * @see #Text_File_Ptr
+ * @see #Text_Mutex_Lock
+ * @see #Text_Mutex_Unlock
+ * @see #Text_Command_Delay
+ * @see #CCD_Text_Handle_Struct
  * @see #Text_Print_Level
  */
 int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 {
+	int delay_ms;
+
 	Text_Error_Number = 0;
 	if(handle == NULL)
 	{
@@ -513,6 +799,8 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 		sprintf(Text_Error_String,"CCD_Text_Command failed:handle Text pointer was NULL.");
 		return FALSE;
 	}
+	if(!Text_Mutex_Lock(handle))
+		return FALSE;
 	if(Text_Print_Level == CCD_TEXT_PRINT_LEVEL_ALL)
 	{
 		/* some command arguments have interdetminate arguments 
@@ -524,31 +812,31 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 		else
 			fprintf(handle->Handle.Text->Text_File_Ptr,"ioctl(%#x,NULL)\n",request);
 	}
-/* set Text_Data Ioctl_Request */
-	Text_Data.Ioctl_Request = request;
+/* set Ioctl_Request */
+	handle->Handle.Text->Ioctl_Request = request;
 	switch(request)
 	{
 		case CCD_PCI_IOCTL_GET_HCTR:
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Request:Get Host Control Register:");
 			if(argument != NULL)
-				Text_Data.Reply = Text_Data.HCTR_Register;
+				handle->Handle.Text->Reply = handle->Handle.Text->HCTR_Register;
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,"HCTR not filled in:argument was NULL:");
 			break;
 		case CCD_PCI_IOCTL_GET_PROGRESS:
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Request:Get Readout Progress:");
-			Text_Readout_Progress();
+			Text_Readout_Update(handle);
 			if(argument != NULL)
-				Text_Data.Reply = Text_Data.Readout_Progress;
+				handle->Handle.Text->Reply = handle->Handle.Text->Readout_Progress;
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,
 					"Readout Progress not filled in:argument was NULL:");
 			break;
 		case CCD_PCI_IOCTL_GET_HSTR:
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Request:Get Host Status Transfer Register:");
-			Text_HSTR();
+			Text_Readout_Update(handle);
 			if(argument != NULL)
-				Text_Data.Reply = Text_Data.HSTR_Register;
+				handle->Handle.Text->Reply = handle->Handle.Text->HSTR_Register;
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,"HSTR not filled in:argument was NULL:");
 			break;
@@ -562,16 +850,18 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 			{
 				if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_VALUES)
 					fprintf(handle->Handle.Text->Text_File_Ptr,"%#x:",(*argument));
-				Text_Data.HCTR_Register = *argument;
+				handle->Handle.Text->HCTR_Register = *argument;
 			}
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,"NULL Argument:");
 			break;
 		case CCD_PCI_IOCTL_SET_HCVR:
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Request:Set HCVR (Host Command Vector Register):");
-			Text_Data.HCVR_Command = *argument;
 			if(argument != NULL)
+			{
+				handle->Handle.Text->HCVR_Command = *argument;
 				Text_HCVR(handle,*argument);
+			}
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,"NULL Argument:");
 			break;
@@ -579,12 +869,12 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Request:Set HCVR data:");
 			if(argument != NULL)
 			{
-				Text_Data.Argument_List[0] = (*argument);
+				handle->Handle.Text->Argument_List[0] = (*argument);
 				if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_VALUES)
 					fprintf(handle->Handle.Text->Text_File_Ptr,"%#x:",(*argument));
-			/* HCVR_DATA does not return a reply. So we set the Text_Data.Reply to the input argument,
+			/* HCVR_DATA does not return a reply. So we set the handle->Handle.Text->Reply to the input argument,
 			** so that it is not changed. */
-				Text_Data.Reply = (*argument);
+				handle->Handle.Text->Reply = (*argument);
 			}
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,"NULL Argument:");
@@ -596,7 +886,7 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Request:PCI Download:");
 			if(argument != NULL)
 			{
-				Text_Data.Argument_List[0] = (*argument);
+				handle->Handle.Text->Argument_List[0] = (*argument);
 				if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_VALUES)
 					fprintf(handle->Handle.Text->Text_File_Ptr,"%#x:",(*argument));
 			}
@@ -607,10 +897,10 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Request:PCI Download Wait:");
 			if(argument != NULL)
 			{
-				Text_Data.Argument_List[0] = (*argument);
+				handle->Handle.Text->Argument_List[0] = (*argument);
 				if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_VALUES)
 					fprintf(handle->Handle.Text->Text_File_Ptr,"%#x:",(*argument));
-				Text_Data.Reply = CCD_DSP_DON;
+				handle->Handle.Text->Reply = CCD_DSP_DON;
 			}
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,"NULL Argument:");
@@ -624,7 +914,7 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 			{
 				if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_VALUES)
 					fprintf(handle->Handle.Text->Text_File_Ptr,"%d:",(*argument));
-				Text_Data.Reply = CCD_DSP_DON;
+				handle->Handle.Text->Reply = CCD_DSP_DON;
 			}
 			else
 				fprintf(handle->Handle.Text->Text_File_Ptr,"NULL Argument:");
@@ -633,14 +923,18 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Unknown Request");
 			break;
 	}
-/* reply is passed back in argument - copy any set from Text_Data.Reply */
+/* reply is passed back in argument - copy any set from handle->Handle.Text->Reply */
 	if(argument != NULL)
 	{
-		(*argument) = Text_Data.Reply;
+		(*argument) = handle->Handle.Text->Reply;
 		Text_Print_Reply(handle);
 	}
 	fprintf(handle->Handle.Text->Text_File_Ptr,"\n");
 	fflush(handle->Handle.Text->Text_File_Ptr);
+	delay_ms = handle->Handle.Text->Command_Delay;
+	if(!Text_Mutex_Unlock(handle))
+		return FALSE;
+	Text_Command_Delay(delay_ms);
 	return TRUE;
 }
 
@@ -657,10 +951,11 @@ int CCD_Text_Command(CCD_Interface_Handle_T *handle,int request,int *argument)
  * @see #Text_Destination
  * @see #Text_Manual
  * @see #Text_Print_Reply
+ * @see #Text_Command_Delay
  */
 int CCD_Text_Command_List(CCD_Interface_Handle_T *handle,int request,int *argument_list,int argument_count)
 {
-	int i;
+	int i,delay_ms;
 
 	Text_Error_Number = 0;
 	if(handle == NULL)
@@ -675,6 +970,8 @@ int CCD_Text_Command_List(CCD_Interface_Handle_T *handle,int request,int *argume
 		sprintf(Text_Error_String,"CCD_Text_Command_List failed:handle Text pointer was NULL.");
 		return FALSE;
 	}
+	if(!Text_Mutex_Lock(handle))
+		return FALSE;
 	if(Text_Print_Level == CCD_TEXT_PRINT_LEVEL_ALL)
 	{
 		/* some command arguments have interdetminate arguments 
@@ -693,8 +990,8 @@ int CCD_Text_Command_List(CCD_Interface_Handle_T *handle,int request,int *argume
 		else
 			fprintf(handle->Handle.Text->Text_File_Ptr,"ioctl(%#x,NULL)\n",request);
 	}
-/* set Text_Data Ioctl_Request */
-	Text_Data.Ioctl_Request = request;
+/* set Ioctl_Request */
+	handle->Handle.Text->Ioctl_Request = request;
 	switch(request)
 	{
 		case CCD_PCI_IOCTL_COMMAND:
@@ -704,16 +1001,16 @@ int CCD_Text_Command_List(CCD_Interface_Handle_T *handle,int request,int *argume
 		/* Copy arguments.
 		** Loop starts from 2, first 2 CCD_PCI_IOCTL_COMMAND arguments are header word and 
 		** Manual Command itself. */
-			Text_Data.Argument_Count = argument_count-2;
+			handle->Handle.Text->Argument_Count = argument_count-2;
 			for(i=2;i<argument_count;i++)
 			{
-				Text_Data.Argument_List[i-2] = argument_list[i];
+				handle->Handle.Text->Argument_List[i-2] = argument_list[i];
 			}
 		/* Call manual command routine */
 			if(argument_count > 1)
 				Text_Manual(handle,argument_list[1]);
 		/* put reply value in argument_list[0] */
-			argument_list[0] = Text_Data.Reply;
+			argument_list[0] = handle->Handle.Text->Reply;
 			Text_Print_Reply(handle);
 			break;
 		default:
@@ -722,26 +1019,27 @@ int CCD_Text_Command_List(CCD_Interface_Handle_T *handle,int request,int *argume
 	}
 	fprintf(handle->Handle.Text->Text_File_Ptr,"\n");
 	fflush(handle->Handle.Text->Text_File_Ptr);
+	delay_ms = handle->Handle.Text->Command_Delay;
+	if(!Text_Mutex_Unlock(handle))
+		return FALSE;
+	Text_Command_Delay(delay_ms);
 	return TRUE;
 }
 
 /**
- * This routine emulates getting reply data from the SDSU CCD Controller. The reply data is stored in
- * the data parameter, up to byte_count bytes of it. This allows the routine to read an arbitary amount of data 
- * (an image for instance).
+ * This routine emulates getting reply data from the SDSU CCD Controller. The simulated readout is brought up to
+ * date, so the buffer contains the pixels read out so far, and a pointer to the buffer is returned.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @param data The address of an unsigned short pointer, which on return from this routine will point to
  *        an area of memory containing the read out CCD image. 
- *        In this routine the image is filled with bytes that are ASCII characters so the resultant image 
- *        can be printed out.
  * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Text_Readout_Update
+ * @see #Text_Pixel_Value
  * @see ccd_interface.html#CCD_Interface_Handle_T
  * @see ccd_interface.html#CCD_Interface_Get_Reply_Data
  */
 int CCD_Text_Get_Reply_Data(CCD_Interface_Handle_T *handle,unsigned short **data)
 {
-	int i;
-
 	Text_Error_Number = 0;
 	if(handle == NULL)
 	{
@@ -764,21 +1062,22 @@ int CCD_Text_Get_Reply_Data(CCD_Interface_Handle_T *handle,unsigned short **data
 		sprintf(Text_Error_String,"CCD_Text_Get_Reply_Data:data is NULL");
 		return FALSE;
 	}
-	if(Text_Data.Buffer == NULL)
+	if(!Text_Mutex_Lock(handle))
+		return FALSE;
+	if(handle->Handle.Text->Buffer == NULL)
 	{
+		Text_Mutex_Unlock(handle);
 		Text_Error_Number = 2;
 		sprintf(Text_Error_String,"CCD_Text_Get_Reply_Data:Reply Buffer is NULL");
 		return FALSE;
 	}
-	/* fill data with return values */
-	(*data) = (unsigned short *)(Text_Data.Buffer);
-	i=0;
-	while((i<(Text_Data.Buffer_Length/sizeof(unsigned short)))&&(!CCD_DSP_Get_Abort(handle)))
-	{
-		(*data)[i] = (i%((1<<16)-1));
-		i++;
-	}
-	fprintf(handle->Handle.Text->Text_File_Ptr,"CCD_Text_Get_Reply_Data:%d.\n",Text_Data.Buffer_Length);
+	Text_Readout_Update(handle);
+	(*data) = handle->Handle.Text->Buffer;
+	fprintf(handle->Handle.Text->Text_File_Ptr,"CCD_Text_Get_Reply_Data:%d:%d of %d pixels.\n",
+		handle->Handle.Text->Buffer_Length,handle->Handle.Text->Readout_Fill_Count,
+		handle->Handle.Text->Readout_Pixel_Count);
+	if(!Text_Mutex_Unlock(handle))
+		return FALSE;
 	return TRUE;
 }
 
@@ -819,6 +1118,9 @@ int CCD_Text_Close(CCD_Interface_Handle_T *handle)
 		sprintf(Text_Error_String,"CCD_Text_Close failed:fclose returned %d(%d).",retval,error_number);
 		return FALSE;
 	}
+	if(handle->Handle.Text->Buffer != NULL)
+		free(handle->Handle.Text->Buffer);
+	pthread_mutex_destroy(&(handle->Handle.Text->Mutex));
 	free(handle->Handle.Text);
 	handle->Handle.Text = NULL;
 	return TRUE;
@@ -893,13 +1195,13 @@ void CCD_Text_Warning(void)
 ** 	Internal routines 
 ** ------------------------------------------------------------------- */
 /**
- * Routine that prints out a textual representation of Text_Data.Reply,
+ * Routine that prints out a textual representation of the handle's Reply,
  * if Text_Print_Level is greater than or equal to CCD_TEXT_PRINT_LEVEL_REPLIES.
  * The spacial case return values CCD_DSP_DON, CCD_DSP_ERR and
  * CCD_DSP_SYR are checked for special printouts.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_Print_Level
- * @see #Text_Data
+ * @see #CCD_Text_Handle_Struct
  * @see #CCD_TEXT_PRINT_LEVEL_REPLIES
  * @see ccd_dsp.html#CCD_DSP_DON
  * @see ccd_dsp.html#CCD_DSP_ERR
@@ -911,7 +1213,7 @@ static void Text_Print_Reply(CCD_Interface_Handle_T *handle)
 /* if it's a standard reply print out a text representation. */
 	if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_REPLIES)
 	{
-		switch(Text_Data.Reply)
+		switch(handle->Handle.Text->Reply)
 		{
 			case CCD_DSP_DON:
 				fprintf(handle->Handle.Text->Text_File_Ptr,"DON:");
@@ -923,7 +1225,7 @@ static void Text_Print_Reply(CCD_Interface_Handle_T *handle)
 				fprintf(handle->Handle.Text->Text_File_Ptr,"SYR:");
 				break;
 			default:
-				fprintf(handle->Handle.Text->Text_File_Ptr,"%#x:",Text_Data.Reply);
+				fprintf(handle->Handle.Text->Text_File_Ptr,"%#x:",handle->Handle.Text->Reply);
 				break;
 		}/* end switch on reply value */
 	}/* end if printing replies */
@@ -954,7 +1256,7 @@ static void Text_HCVR(CCD_Interface_Handle_T *handle,int hcvr_command)
 	{
 		if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_COMMANDS)
 			fprintf(handle->Handle.Text->Text_File_Ptr,":%s:",Text_HCVR_Command_List[i].Name);
-		Text_Data.Reply = Text_HCVR_Command_List[i].Reply;
+		handle->Handle.Text->Reply = Text_HCVR_Command_List[i].Reply;
 		if(Text_HCVR_Command_List[i].Function != NULL)
 			Text_HCVR_Command_List[i].Function(handle);
 	}
@@ -963,41 +1265,175 @@ static void Text_HCVR(CCD_Interface_Handle_T *handle,int hcvr_command)
 }
 
 /**
- * This routine is called whenever the ioctl command GET_HSTR is called.
- * It allows us to calculate the value of Text_Data.HSTR_Register, i.e. when to switch to readout mode.
- * @see #Text_Manual_Read_Exposure_Time
+ * This routine is called whenever the ioctl commands GET_HSTR or GET_PROGRESS are called, or the reply data is
+ * retrieved. It brings the simulated exposure and readout up to date with the current time:
+ * <ul>
+ * <li>Whilst the exposure is underway, the HSTR readout bits are clear and the readout progress is zero.
+ * <li>Once the exposure length has elapsed, the HSTR readout bits are set, and the readout progress increases at
+ *     the pixel rate configured for the amplifier and binning used.
+ * <li>When all the pixels have been read out, the HSTR returns to idle and the readout progress stays at the 
+ *     readout pixel count, until the next exposure is started.
+ * </ul>
+ * The image buffer is filled with pixel values as they are read out, as the PCI DMA transfer would.
+ * The simulated readout does not progress whilst the exposure is paused.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @see #Text_Readout_Fill
+ * @see #Text_Get_Current_Time
+ * @see #Text_TimeSpec_Diff_Ms
  * @see ccd_exposure.html#CCD_EXPOSURE_HSTR_READOUT
  * @see ccd_exposure.html#CCD_EXPOSURE_HSTR_BIT_SHIFT
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void Text_Readout_Update(CCD_Interface_Handle_T *handle)
+{
+	struct timespec current_time;
+	double readout_ms,progress;
+
+	if(handle->Handle.Text->Exposure_Active == FALSE)
+		return;
+	if(handle->Handle.Text->Pause_Start_Time.tv_sec > 0)
+		return;
+	Text_Get_Current_Time(&current_time);
+	readout_ms = Text_TimeSpec_Diff_Ms(handle->Handle.Text->Exposure_Start_Time,current_time)-
+		((double)(handle->Handle.Text->Exposure_Length));
+	/* still exposing */
+	if(readout_ms < 0.0)
+	{
+		handle->Handle.Text->HSTR_Register = 0;
+		handle->Handle.Text->Readout_Progress = 0;
+		return;
+	}
+	progress = (readout_ms*((double)(handle->Handle.Text->Readout_Pixel_Rate)))/((double)CCD_GLOBAL_ONE_SECOND_MS);
+	if(progress >= ((double)(handle->Handle.Text->Readout_Pixel_Count)))
+	{
+		/* readout complete, HSTR back to idle */
+		handle->Handle.Text->Readout_Progress = handle->Handle.Text->Readout_Pixel_Count;
+		handle->Handle.Text->HSTR_Register = 0;
+		handle->Handle.Text->Exposure_Active = FALSE;
+	}
+	else
+	{
+		handle->Handle.Text->Readout_Progress = (int)progress;
+		handle->Handle.Text->HSTR_Register = (CCD_EXPOSURE_HSTR_READOUT<<CCD_EXPOSURE_HSTR_BIT_SHIFT);
+	}
+	Text_Readout_Fill(handle,handle->Handle.Text->Readout_Progress);
+}
+
+/**
+ * Routine to fill the image buffer with simulated pixel values, from the last pixel filled up to pixel_count.
+ * This emulates the PCI board DMAing the pixels into the image buffer as they are read out.
+ * Pixels that would lie outside the buffer are not filled.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @param pixel_count The number of pixels of the readout that should now be in the buffer.
+ * @see #Text_Pixel_Value
+ * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static void Text_HSTR(void)
+static void Text_Readout_Fill(CCD_Interface_Handle_T *handle,int pixel_count)
 {
-	int elapsed_exposure_time;
-
-	/* call routine to get current elapsed exposure time - result put in Text_Data.Reply */
-	Text_Manual_Read_Exposure_Time(NULL);
-	elapsed_exposure_time = Text_Data.Reply;
-	/* if elapsed exposure time > exposure length, go into readout mode. */
-	if(elapsed_exposure_time> Text_Data.Exposure_Length)
-		Text_Data.HSTR_Register |= (CCD_EXPOSURE_HSTR_READOUT<<CCD_EXPOSURE_HSTR_BIT_SHIFT);
+	int i,buffer_pixel_count;
+
+	if(handle->Handle.Text->Buffer == NULL)
+		return;
+	buffer_pixel_count = handle->Handle.Text->Buffer_Length/sizeof(unsigned short);
+	if(pixel_count > buffer_pixel_count)
+		pixel_count = buffer_pixel_count;
+	for(i=handle->Handle.Text->Readout_Fill_Count;i<pixel_count;i++)
+		handle->Handle.Text->Buffer[i] = Text_Pixel_Value(handle,i);
+	if(pixel_count > handle->Handle.Text->Readout_Fill_Count)
+		handle->Handle.Text->Readout_Fill_Count = pixel_count;
 }
 
 /**
- * This routine is called whenever the ioctl command GET_PROGRESS is called.
- * This allows us to modify the Text_Data.Readout_Progress field to simulate readout.
+ * Routine to calculate the value of a simulated pixel, in the order it is read out of the controller.
+ * The readout consists of one or more blocks (one per window for windowed readouts) of 
+ * Readout_Block_Width by Readout_Block_Height pixels. Each row of a block is read out in the order
+ * the selected amplifier(s) clock the serial register:
+ * <ul>
+ * <li>The left amplifier reads the row from left to right.
+ * <li>The right amplifier reads the row from right to left (so CCD_DSP_DEINTERLACE_FLIP restores it).
+ * <li>Both amplifiers interleave the left half of the row read forwards (even pixels) with the right half read
+ *     backwards (odd pixels), as CCD_DSP_DEINTERLACE_SPLIT_SERIAL expects.
+ * </ul>
+ * Each pixel has the bias level of the amplifier that read it. Illuminated pixels (not in a window's bias strip)
+ * also have the exposure signal, plus a gradient that increases with the de-interlaced column and row.
+ * If CCD_EXPOSURE_BYTE_SWAP is defined, the library expects to byte swap the controller data,
+ * so the simulated pixels are byte swapped as well.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @param pixel_index The index of the pixel in the readout.
+ * @return The pixel value.
+ * @see #TEXT_BIAS_LEVEL_LEFT
+ * @see #TEXT_BIAS_LEVEL_RIGHT
+ * @see #TEXT_GRADIENT_HEIGHT
+ * @see #TEXT_SATURATION_LEVEL
+ * @see ccd_interface.html#CCD_Interface_Handle_T
  */
-static void Text_Readout_Progress(void)
+static unsigned short Text_Pixel_Value(CCD_Interface_Handle_T *handle,int pixel_index)
 {
-	/* check we are in readout, i.e. the exposure has finished... 
-       ** as GET_PROGRESS now called even when exposure underway, for readouts less than 1 second. */
-	if(((Text_Data.HSTR_Register>>CCD_EXPOSURE_HSTR_BIT_SHIFT)&CCD_EXPOSURE_HSTR_READOUT) == 
-	   CCD_EXPOSURE_HSTR_READOUT)
+	int block_width,block_height,block_index,x,y,k,value;
+
+	block_width = handle->Handle.Text->Readout_Block_Width;
+	block_height = handle->Handle.Text->Readout_Block_Height;
+	block_index = pixel_index%(block_width*block_height);
+	y = block_index/block_width;
+	k = block_index%block_width;
+	switch(handle->Handle.Text->Readout_Amplifier_Index)
 	{
-		/* read out 500000 bytes between calls, if we call GET_PROGRESS every second,
-		** about a 10 second readout. */
-		Text_Data.Readout_Progress = Text_Data.Readout_Progress + 500000;
+		case TEXT_AMPLIFIER_INDEX_RIGHT:
+			x = block_width-1-k;
+			value = TEXT_BIAS_LEVEL_RIGHT;
+			break;
+		case TEXT_AMPLIFIER_INDEX_BOTH:
+			if((k%2) == 0)
+			{
+				x = k/2;
+				value = TEXT_BIAS_LEVEL_LEFT;
+			}
+			else
+			{
+				x = block_width-1-(k/2);
+				value = TEXT_BIAS_LEVEL_RIGHT;
+			}
+			break;
+		case TEXT_AMPLIFIER_INDEX_LEFT:
+		default:
+			x = k;
+			value = TEXT_BIAS_LEVEL_LEFT;
+			break;
+	}
+	if(x < handle->Handle.Text->Readout_Box_Width)
+	{
+		value += handle->Handle.Text->Readout_Signal+((x*TEXT_GRADIENT_HEIGHT)/block_width)+
+			((y*TEXT_GRADIENT_HEIGHT)/block_height);
+	}
+	if(value > TEXT_SATURATION_LEVEL)
+		value = TEXT_SATURATION_LEVEL;
+#ifdef CCD_EXPOSURE_BYTE_SWAP
+	value = ((value&0xff)<<8)|((value>>8)&0xff);
+#endif
+	return (unsigned short)value;
+}
+
+/**
+ * Routine to convert an amplifier into an index into the pixel rate table.
+ * @param amplifier The amplifier, one of <a href="ccd_dsp.html#CCD_DSP_AMPLIFIER">CCD_DSP_AMPLIFIER</a>.
+ * @return The index, one of TEXT_AMPLIFIER_INDEX_LEFT, TEXT_AMPLIFIER_INDEX_RIGHT or TEXT_AMPLIFIER_INDEX_BOTH.
+ *         Unknown amplifiers are treated as the left amplifier.
+ * @see #TEXT_AMPLIFIER_INDEX_LEFT
+ * @see #TEXT_AMPLIFIER_INDEX_RIGHT
+ * @see #TEXT_AMPLIFIER_INDEX_BOTH
+ */
+static int Text_Amplifier_Index(enum CCD_DSP_AMPLIFIER amplifier)
+{
+	switch(amplifier)
+	{
+		case CCD_DSP_AMPLIFIER_RIGHT:
+			return TEXT_AMPLIFIER_INDEX_RIGHT;
+		case CCD_DSP_AMPLIFIER_BOTH:
+			return TEXT_AMPLIFIER_INDEX_BOTH;
+		case CCD_DSP_AMPLIFIER_LEFT:
+		default:
+			return TEXT_AMPLIFIER_INDEX_LEFT;
 	}
-	else
-		Text_Data.Readout_Progress = 0;
 }
 
 /**
@@ -1025,7 +1461,7 @@ static void Text_Manual(CCD_Interface_Handle_T *handle,int manual_command)
 	{
 		if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_COMMANDS)
 			fprintf(handle->Handle.Text->Text_File_Ptr,":%s:",Text_Manual_Command_List[i].Name);
-		Text_Data.Reply = Text_Manual_Command_List[i].Reply;
+		handle->Handle.Text->Reply = Text_Manual_Command_List[i].Reply;
 		if(Text_Manual_Command_List[i].Function != NULL)
 			Text_Manual_Command_List[i].Function(handle);
 	}
@@ -1045,20 +1481,20 @@ static void Text_Destination(CCD_Interface_Handle_T *handle,int destination_numb
 	char *Board_Name_List[] = {"Host","Interface","Timing board","Utility board"};
 	int Board_Name_Count = 4;
 
-	Text_Data.Destination = (destination_number >> 8)&0xFF;
-	Text_Data.Argument_Count = destination_number&0xFF;
-	Text_Data.Reply = CCD_DSP_DON;
+	handle->Handle.Text->Destination = (destination_number >> 8)&0xFF;
+	handle->Handle.Text->Argument_Count = destination_number&0xFF;
+	handle->Handle.Text->Reply = CCD_DSP_DON;
 	if(Text_Print_Level >= CCD_TEXT_PRINT_LEVEL_VALUES)
 	{
-		if((Text_Data.Destination > 0)&&(Text_Data.Destination<Board_Name_Count))
+		if((handle->Handle.Text->Destination > 0)&&(handle->Handle.Text->Destination<Board_Name_Count))
 		{
 			fprintf(handle->Handle.Text->Text_File_Ptr,":%s:Number of Arguments:%d:",
-				Board_Name_List[Text_Data.Destination],Text_Data.Argument_Count);
+				Board_Name_List[handle->Handle.Text->Destination],handle->Handle.Text->Argument_Count);
 		}
 		else
 		{
 			fprintf(handle->Handle.Text->Text_File_Ptr,":UNKNOWN BOARD %d:Number of Arguments:%d:",
-				Text_Data.Destination,Text_Data.Argument_Count);
+				handle->Handle.Text->Destination,handle->Handle.Text->Argument_Count);
 		}
 	}
 }
@@ -1066,7 +1502,7 @@ static void Text_Destination(CCD_Interface_Handle_T *handle,int destination_numb
 /**
  * Function invoked from Text_Manual when a RCC command is sent to the driver.
  * This retrieves the controller configuration word.
- * This function sets Text_Data.Reply to Text_Data.Controller_Config.
+ * This function sets the handle's Reply to the handle's Controller_Config.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_Manual
  * @see ccd_dsp.html#CCD_DSP_RCC
@@ -1074,13 +1510,13 @@ static void Text_Destination(CCD_Interface_Handle_T *handle,int destination_numb
  */
 static void Text_Manual_Read_Controller_Config(CCD_Interface_Handle_T *handle)
 {
-	Text_Data.Reply = Text_Data.Controller_Config;
+	handle->Handle.Text->Reply = handle->Handle.Text->Controller_Config;
 }
 
 /**
  * Function invoked from Text_Manual when a TDL command is sent to the driver.
  * This tests the driver by sending argument 1 to the required board, which should return the value.
- * Hence this function sets Text_Data.Reply to Text_Data.Argument_List[0].
+ * Hence this function sets the handle's Reply to the handle's Argument_List[0].
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_Manual
  * @see ccd_dsp.html#CCD_DSP_TDL
@@ -1088,16 +1524,18 @@ static void Text_Manual_Read_Controller_Config(CCD_Interface_Handle_T *handle)
  */
 static void Text_Manual_Test_Data_Link(CCD_Interface_Handle_T *handle)
 {
-	Text_Data.Reply = Text_Data.Argument_List[0];
+	handle->Handle.Text->Reply = handle->Handle.Text->Argument_List[0];
 }
 
 /**
  * Routine invoked from Text_Manual when a Read Memory command is sent to the driver.
  * This routine needs to get the relevant memory address we are reading (board/memory space/address)
- * and return a suitable value for some cases. This uses the Memory_List defined above.
+ * and return a suitable value for some cases. Timing board Y memory locations previously written with WRM
+ * return the value written, otherwise the Memory_List defined above is used.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_Manual
  * @see #Memory_List
+ * @see #TEXT_TIMING_Y_MEMORY_LENGTH
  * @see ccd_dsp.html#CCD_DSP_RDM
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
@@ -1105,170 +1543,378 @@ static void Text_Manual_Read_Memory(CCD_Interface_Handle_T *handle)
 {
 	int i,memory_space,address;
 
-	memory_space = Text_Data.Argument_List[0] & 0xf00000;
-	address = Text_Data.Argument_List[0] & 0xfffff;
+	memory_space = handle->Handle.Text->Argument_List[0] & 0xf00000;
+	address = handle->Handle.Text->Argument_List[0] & 0xfffff;
 	fprintf(handle->Handle.Text->Text_File_Ptr,
 		"Text_Manual_Read_Memory:Destination = %#x:Memory Space = %#x:Address = %#x\n",
-		Text_Data.Destination,memory_space,address);
+		handle->Handle.Text->Destination,memory_space,address);
+	if((handle->Handle.Text->Destination == CCD_DSP_TIM_BOARD_ID)&&(memory_space == CCD_DSP_MEM_SPACE_Y)&&
+	   (address < TEXT_TIMING_Y_MEMORY_LENGTH))
+	{
+		handle->Handle.Text->Reply = handle->Handle.Text->Timing_Y_Memory[address];
+		return;
+	}
 	for(i=0;i<MEMORY_COUNT;i++)
 	{
-		if((Text_Data.Destination == Memory_List[i].Board_Id)&&
+		if((handle->Handle.Text->Destination == Memory_List[i].Board_Id)&&
 			(memory_space == Memory_List[i].Mem_Space)&&
 			(address == Memory_List[i].Address))
 		{
 			fprintf(handle->Handle.Text->Text_File_Ptr,"Text_Manual_Read_Memory:Match Found:Value = %#x\n",
 				Memory_List[i].Value);
-			Text_Data.Reply = Memory_List[i].Value;
+			handle->Handle.Text->Reply = Memory_List[i].Value;
 		}
 	}
 }
 
+/**
+ * Routine invoked from Text_Manual when a Write Memory command is sent to the driver.
+ * Writes to the start of the timing board Y memory are remembered, as the readout dimensions and binning
+ * are written there, and are needed to simulate the readout.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @see #Text_Manual
+ * @see #TEXT_TIMING_Y_MEMORY_LENGTH
+ * @see ccd_dsp.html#CCD_DSP_WRM
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void Text_Manual_Write_Memory(CCD_Interface_Handle_T *handle)
+{
+	int memory_space,address;
+
+	memory_space = handle->Handle.Text->Argument_List[0] & 0xf00000;
+	address = handle->Handle.Text->Argument_List[0] & 0xfffff;
+	if((handle->Handle.Text->Destination == CCD_DSP_TIM_BOARD_ID)&&(memory_space == CCD_DSP_MEM_SPACE_Y)&&
+	   (address < TEXT_TIMING_Y_MEMORY_LENGTH))
+	{
+		handle->Handle.Text->Timing_Y_Memory[address] = handle->Handle.Text->Argument_List[1];
+	}
+}
+
+/**
+ * Routine invoked from Text_Manual when a SOS (Set Output Source) command is sent to the driver.
+ * The amplifier is saved, it determines the order of the simulated pixels and the readout rate.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @see #Text_Manual
+ * @see ccd_dsp.html#CCD_DSP_SOS
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void Text_Manual_Set_Output_Source(CCD_Interface_Handle_T *handle)
+{
+	handle->Handle.Text->Amplifier = handle->Handle.Text->Argument_List[0];
+}
+
+/**
+ * Routine invoked from Text_Manual when a SSS (Set Subarray Size) command is sent to the driver.
+ * The bias width, box width and box height are saved, a box width of zero means a full frame readout.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @see #Text_Manual
+ * @see ccd_dsp.html#CCD_DSP_SSS
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void Text_Manual_Set_Subarray_Size(CCD_Interface_Handle_T *handle)
+{
+	handle->Handle.Text->Window_Bias_Width = handle->Handle.Text->Argument_List[0];
+	handle->Handle.Text->Window_Box_Width = handle->Handle.Text->Argument_List[1];
+	handle->Handle.Text->Window_Box_Height = handle->Handle.Text->Argument_List[2];
+}
+
 /**
  * Function invoked from Text_Manual when a RET command is sent to the driver.
  * This should set the return argument to the elapsed time of exposure, in milliseconds.
- * Text_Data.Reply is set to the elapsed time, measured as the current time minus Text_Data.Exposure_Start_Time. 
- * However, if the exposure is currently paused Text_Data.Pause_Start_Time is non zero. In this case the 
- * current elapsed exposure time is the pause start time minus the exposure start time.
+ * The handle's Reply is set to the elapsed time, measured as the current time minus the handle's 
+ * Exposure_Start_Time. However, if the exposure is currently paused the handle's Pause_Start_Time is non zero. 
+ * In this case the current elapsed exposure time is the pause start time minus the exposure start time.
+ * The elapsed time is truncated to a whole millisecond, as the controller's exposure timer counts milliseconds.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_Manual
+ * @see #Text_Get_Current_Time
+ * @see #Text_TimeSpec_Diff_Ms
  * @see ccd_dsp.html#CCD_DSP_RET
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 static void Text_Manual_Read_Exposure_Time(CCD_Interface_Handle_T *handle)
 {
 	struct timespec current_time;
-#ifndef _POSIX_TIMERS
-	struct timeval gtod_current_time;
-#endif
 	long int elapsed_time;
 
-#ifdef _POSIX_TIMERS
-	clock_gettime(CLOCK_REALTIME,&current_time);
-#else
-	gettimeofday(&gtod_current_time,NULL);
-	current_time.tv_sec = gtod_current_time.tv_sec;
-	current_time.tv_nsec = gtod_current_time.tv_usec*TEXT_ONE_MICROSECOND_NS;
-#endif
+	Text_Get_Current_Time(&current_time);
 /* if we are currently paused */
-	if(Text_Data.Pause_Start_Time.tv_sec > 0)
+	if(handle->Handle.Text->Pause_Start_Time.tv_sec > 0)
 	{
-		elapsed_time = (Text_Data.Pause_Start_Time.tv_sec-Text_Data.Exposure_Start_Time.tv_sec)*1000;
-		elapsed_time += (Text_Data.Pause_Start_Time.tv_nsec-Text_Data.Exposure_Start_Time.tv_nsec)/1000000;
+		elapsed_time = Text_TimeSpec_Diff_Ms(handle->Handle.Text->Exposure_Start_Time,
+						     handle->Handle.Text->Pause_Start_Time);
 	}
 	else
 	{
-		elapsed_time = (current_time.tv_sec-Text_Data.Exposure_Start_Time.tv_sec)*1000;
+		elapsed_time = (current_time.tv_sec-handle->Handle.Text->Exposure_Start_Time.tv_sec)*
+			CCD_GLOBAL_ONE_SECOND_MS;
 		/* voodoo waits until elapsed time returns zero before assuming timing has started.
 		** This hack makes the first exposure time we return zero 
 		** (assuming we request exposure time within one second of starting an exposure). */
 		if(elapsed_time > 0)
-			elapsed_time += (current_time.tv_nsec-Text_Data.Exposure_Start_Time.tv_nsec)/1000000;
+			elapsed_time = Text_TimeSpec_Diff_Ms(handle->Handle.Text->Exposure_Start_Time,current_time);
 	}
-	Text_Data.Reply = elapsed_time;
+	handle->Handle.Text->Reply = elapsed_time;
 }
 
 /**
  * Invoked from Text_Manual when a SET (Set Exposure Time) command is sent to the driver.
- * Sets exposure time in Text_Data from argument list.
+ * Sets the handle's exposure time from argument list.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
- * @see #Text_Data
+ * @see #CCD_Text_Handle_Struct
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 static void Text_Manual_Set_Exposure_Time(CCD_Interface_Handle_T *handle)
 {
-	Text_Data.Exposure_Length = Text_Data.Argument_List[0];
+	handle->Handle.Text->Exposure_Length = handle->Handle.Text->Argument_List[0];
 }
 
 /**
  * Function invoked from Text_Manual when a SEX command is sent to the driver.
- * Text_Data sets the reply value to CCD_DSP_DON.
- * We set the Text_Data.Exposure_Start_Time to the current time when the exposure started.
- * We also reset Text_Data.Pause_Start_Time to zero - we are starting an exposure - we can't be paused.
+ * The reply value is set to CCD_DSP_DON.
+ * We set the handle's Exposure_Start_Time to the current time when the exposure started.
+ * We also reset the handle's Pause_Start_Time to zero - we are starting an exposure - we can't be paused.
+ * The readout that will follow the exposure is then set up from the dimensions and binning written to 
+ * the timing board, the last SOS amplifier and SSS subarray size, and the configured pixel rates.
+ * The signal in each pixel is proportional to the exposure length and the binned pixel area.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_Manual
+ * @see #Text_Get_Current_Time
+ * @see #Text_Amplifier_Index
+ * @see #TEXT_ADDRESS_DIMENSION_COLS
+ * @see #TEXT_ADDRESS_DIMENSION_ROWS
+ * @see #TEXT_ADDRESS_BIN_X
+ * @see #TEXT_ADDRESS_BIN_Y
+ * @see #TEXT_SIGNAL_RATE
  * @see ccd_dsp.html#CCD_DSP_SEX
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 static void Text_Manual_Start_Exposure(CCD_Interface_Handle_T *handle)
 {
-#ifndef _POSIX_TIMERS
-	struct timeval gtod_current_time;
-#endif
+	int ncols,nrows,nsbin,npbin;
 
-#ifdef _POSIX_TIMERS
-	clock_gettime(CLOCK_REALTIME,&(Text_Data.Exposure_Start_Time));
-#else
-	gettimeofday(&gtod_current_time,NULL);
-	Text_Data.Exposure_Start_Time.tv_sec = gtod_current_time.tv_sec;
-	Text_Data.Exposure_Start_Time.tv_nsec = gtod_current_time.tv_usec*TEXT_ONE_MICROSECOND_NS;
-#endif
+	Text_Get_Current_Time(&(handle->Handle.Text->Exposure_Start_Time));
 /* reset pause time */
-	Text_Data.Pause_Start_Time.tv_sec = 0;
-	Text_Data.Pause_Start_Time.tv_nsec = 0;
+	handle->Handle.Text->Pause_Start_Time.tv_sec = 0;
+	handle->Handle.Text->Pause_Start_Time.tv_nsec = 0;
 /* sort out HSTR - switch off readout flags */
-	Text_Data.HSTR_Register = 0;
+	handle->Handle.Text->HSTR_Register = 0;
 /* re-initialise Readout_Progress, not started reading out yet. */
-	Text_Data.Readout_Progress = 0;
+	handle->Handle.Text->Readout_Progress = 0;
+	handle->Handle.Text->Readout_Fill_Count = 0;
+/* set up the readout */
+	ncols = handle->Handle.Text->Timing_Y_Memory[TEXT_ADDRESS_DIMENSION_COLS];
+	nrows = handle->Handle.Text->Timing_Y_Memory[TEXT_ADDRESS_DIMENSION_ROWS];
+	nsbin = handle->Handle.Text->Timing_Y_Memory[TEXT_ADDRESS_BIN_X];
+	npbin = handle->Handle.Text->Timing_Y_Memory[TEXT_ADDRESS_BIN_Y];
+	if(ncols < 1)
+		ncols = 1;
+	if(nrows < 1)
+		nrows = 1;
+	if(nsbin < 1)
+		nsbin = 1;
+	if(npbin < 1)
+		npbin = 1;
+	handle->Handle.Text->Readout_Pixel_Count = ncols*nrows;
+	handle->Handle.Text->Readout_Amplifier_Index = Text_Amplifier_Index(handle->Handle.Text->Amplifier);
+	handle->Handle.Text->Readout_Pixel_Rate = handle->Handle.Text->Pixel_Rate_List
+		[handle->Handle.Text->Readout_Amplifier_Index]
+		[(nsbin > CCD_TEXT_MAX_BINNING) ? CCD_TEXT_MAX_BINNING-1 : nsbin-1]
+		[(npbin > CCD_TEXT_MAX_BINNING) ? CCD_TEXT_MAX_BINNING-1 : npbin-1];
+	if((handle->Handle.Text->Window_Box_Width > 0)&&(handle->Handle.Text->Window_Box_Height > 0))
+	{
+		handle->Handle.Text->Readout_Block_Width = handle->Handle.Text->Window_Box_Width+
+			handle->Handle.Text->Window_Bias_Width;
+		handle->Handle.Text->Readout_Block_Height = handle->Handle.Text->Window_Box_Height;
+		handle->Handle.Text->Readout_Box_Width = handle->Handle.Text->Window_Box_Width;
+	}
+	else
+	{
+		handle->Handle.Text->Readout_Block_Width = ncols;
+		handle->Handle.Text->Readout_Block_Height = nrows;
+		handle->Handle.Text->Readout_Box_Width = ncols;
+	}
+	handle->Handle.Text->Readout_Signal = (int)((((double)handle->Handle.Text->Exposure_Length)*
+						    TEXT_SIGNAL_RATE*nsbin*npbin)/CCD_GLOBAL_ONE_SECOND_MS);
+	handle->Handle.Text->Exposure_Active = TRUE;
 }
 
 /**
  * Function invoked from Text_HCVR when a PAUSE_EXPOSURE command is sent to the driver.
- * Text_Data sets the reply value to CCD_DSP_DON.
- * We set the Text_Data.Pause_Start_Time to the current time when the exposure started.
+ * The reply value is set to CCD_DSP_DON.
+ * We set the handle's Pause_Start_Time to the current time when the exposure was paused.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_HCVR
+ * @see #Text_Get_Current_Time
  * @see ccd_pci.html#CCD_PCI_HCVR_PAUSE_EXPOSURE
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 static void Text_Manual_Pause_Exposure(CCD_Interface_Handle_T *handle)
 {
-#ifndef _POSIX_TIMERS
-	struct timeval gtod_current_time;
-#endif
-
-#ifdef _POSIX_TIMERS
-	clock_gettime(CLOCK_REALTIME,&(Text_Data.Pause_Start_Time));
-#else
-	gettimeofday(&gtod_current_time,NULL);
-	Text_Data.Pause_Start_Time.tv_sec = gtod_current_time.tv_sec;
-	Text_Data.Pause_Start_Time.tv_nsec = gtod_current_time.tv_usec*TEXT_ONE_MICROSECOND_NS;
-#endif
+	Text_Get_Current_Time(&(handle->Handle.Text->Pause_Start_Time));
 }
 
 /**
  * Function invoked from Text_HCVR when a RESUME_EXPOSURE command is sent to the driver.
- * Text_Data sets the reply value to CCD_DSP_DON.
- * We get the current time and calculate the time elapsed from the Text_Data.Pause_Start_Time. We add the elapsed time
- * to the Text_Data.Exposure_Start_Time so that subsequent calls to get the elapsed exposure time do not
- * include the paused time. The Text_Data.Pause_Start_Time is reset.
- * Note the paused time is calculated only to the nearest second for simplicity.
+ * The reply value is set to CCD_DSP_DON.
+ * We get the current time and calculate the time elapsed from the handle's Pause_Start_Time. We add the elapsed time
+ * to the handle's Exposure_Start_Time so that subsequent calls to get the elapsed exposure time do not
+ * include the paused time, and the readout starts later. The handle's Pause_Start_Time is reset.
  * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
  * @see #Text_HCVR
+ * @see #Text_Get_Current_Time
  * @see ccd_pci.html#CCD_PCI_HCVR_RESUME_EXPOSURE
  * @see ccd_interface.html#CCD_Interface_Handle_T
  */
 static void Text_Manual_Resume_Exposure(CCD_Interface_Handle_T *handle)
 {
 	struct timespec resume_time;
+
+	if(handle->Handle.Text->Pause_Start_Time.tv_sec == 0)
+		return;
+	Text_Get_Current_Time(&resume_time);
+/* add amount of paused time to Exposure_Start_Time, so returned elapsed time is sensible */
+	handle->Handle.Text->Exposure_Start_Time.tv_sec += resume_time.tv_sec-
+		handle->Handle.Text->Pause_Start_Time.tv_sec;
+	handle->Handle.Text->Exposure_Start_Time.tv_nsec += resume_time.tv_nsec-
+		handle->Handle.Text->Pause_Start_Time.tv_nsec;
+	if(handle->Handle.Text->Exposure_Start_Time.tv_nsec >= CCD_GLOBBAL_ONE_SECOND_NS)
+	{
+		handle->Handle.Text->Exposure_Start_Time.tv_sec++;
+		handle->Handle.Text->Exposure_Start_Time.tv_nsec -= CCD_GLOBBAL_ONE_SECOND_NS;
+	}
+	else if(handle->Handle.Text->Exposure_Start_Time.tv_nsec < 0)
+	{
+		handle->Handle.Text->Exposure_Start_Time.tv_sec--;
+		handle->Handle.Text->Exposure_Start_Time.tv_nsec += CCD_GLOBBAL_ONE_SECOND_NS;
+	}
+/* reset pause time */
+	handle->Handle.Text->Pause_Start_Time.tv_sec = 0;
+	handle->Handle.Text->Pause_Start_Time.tv_nsec = 0;
+}
+
+/**
+ * Function invoked from Text_Manual when an AEX (Abort Exposure) command is sent to the driver.
+ * The simulated exposure is stopped, it will not be read out.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @see #Text_Manual
+ * @see ccd_dsp.html#CCD_DSP_AEX
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void Text_Manual_Abort_Exposure(CCD_Interface_Handle_T *handle)
+{
+	handle->Handle.Text->Exposure_Active = FALSE;
+	handle->Handle.Text->HSTR_Register = 0;
+	handle->Handle.Text->Pause_Start_Time.tv_sec = 0;
+	handle->Handle.Text->Pause_Start_Time.tv_nsec = 0;
+}
+
+/**
+ * Function invoked from Text_HCVR when an ABORT_READOUT command is sent to the driver.
+ * The simulated readout is brought up to date and then stopped, the readout progress stays where it got to.
+ * @param handle The address of a CCD_Interface_Handle_T to store the device connection specific information into.
+ * @see #Text_HCVR
+ * @see #Text_Readout_Update
+ * @see ccd_pci.html#CCD_PCI_HCVR_ABORT_READOUT
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void Text_HCVR_Abort_Readout(CCD_Interface_Handle_T *handle)
+{
+	Text_Readout_Update(handle);
+	handle->Handle.Text->Exposure_Active = FALSE;
+	handle->Handle.Text->HSTR_Register = 0;
+}
+
+/**
+ * Routine to simulate the time a request takes to complete, by sleeping. This is called without the 
+ * simulator mutex held, so other threads can still query the simulator.
+ * @param delay_ms The time to sleep, in milliseconds. If zero, the routine returns straight away.
+ * @see #CCD_Text_Set_Command_Delay
+ */
+static void Text_Command_Delay(int delay_ms)
+{
+	struct timespec sleep_time;
+
+	if(delay_ms <= 0)
+		return;
+	sleep_time.tv_sec = delay_ms/CCD_GLOBAL_ONE_SECOND_MS;
+	sleep_time.tv_nsec = (delay_ms%CCD_GLOBAL_ONE_SECOND_MS)*CCD_GLOBAL_ONE_MILLISECOND_NS;
+	nanosleep(&sleep_time,NULL);
+}
+
+/**
+ * Routine to get the current time, using clock_gettime if POSIX timers are available, 
+ * or gettimeofday if they are not.
+ * @param current_time The address of a timespec to store the current time in.
+ * @see #TEXT_ONE_MICROSECOND_NS
+ */
+static void Text_Get_Current_Time(struct timespec *current_time)
+{
 #ifndef _POSIX_TIMERS
 	struct timeval gtod_current_time;
 #endif
-	time_t paused_time;
 
 #ifdef _POSIX_TIMERS
-	clock_gettime(CLOCK_REALTIME,&resume_time);
+	clock_gettime(CLOCK_REALTIME,current_time);
 #else
 	gettimeofday(&gtod_current_time,NULL);
-	resume_time.tv_sec = gtod_current_time.tv_sec;
-	resume_time.tv_nsec = gtod_current_time.tv_usec*TEXT_ONE_MICROSECOND_NS;
+	current_time->tv_sec = gtod_current_time.tv_sec;
+	current_time->tv_nsec = gtod_current_time.tv_usec*TEXT_ONE_MICROSECOND_NS;
 #endif
-/* add amount of paused time to Exposure_Start_Time, so returned elapsed time is sensible */
-	paused_time = resume_time.tv_sec - Text_Data.Pause_Start_Time.tv_sec;
-	Text_Data.Exposure_Start_Time.tv_sec += paused_time;
-/* reset pause time */
-	Text_Data.Pause_Start_Time.tv_sec = 0;
-	Text_Data.Pause_Start_Time.tv_nsec = 0;
+}
 
+/**
+ * Routine to return the difference between two timespec structures, in milliseconds.
+ * @param start_time The earlier time.
+ * @param end_time The later time.
+ * @return The time difference (end_time - start_time), in milliseconds.
+ * @see ccd_global.html#CCD_GLOBAL_ONE_SECOND_MS
+ * @see ccd_global.html#CCD_GLOBAL_ONE_MILLISECOND_NS
+ */
+static double Text_TimeSpec_Diff_Ms(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*((double)CCD_GLOBAL_ONE_SECOND_MS))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/((double)CCD_GLOBAL_ONE_MILLISECOND_NS));
+}
+
+/**
+ * Routine to lock the simulator state mutex of a text handle.
+ * @param handle The address of a CCD_Interface_Handle_T, opened with the text device.
+ * @return Returns TRUE if the mutex has been locked for access by this thread, FALSE if an error occured.
+ * @see #CCD_Text_Handle_Struct
+ */
+static int Text_Mutex_Lock(CCD_Interface_Handle_T *handle)
+{
+	int error_number;
+
+	error_number = pthread_mutex_lock(&(handle->Handle.Text->Mutex));
+	if(error_number != 0)
+	{
+		Text_Error_Number = 34;
+		sprintf(Text_Error_String,"Text_Mutex_Lock:Mutex lock failed '%d'.",error_number);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to unlock the simulator state mutex of a text handle.
+ * @param handle The address of a CCD_Interface_Handle_T, opened with the text device.
+ * @return Returns TRUE if the mutex has been unlocked, FALSE if an error occured.
+ * @see #CCD_Text_Handle_Struct
+ */
+static int Text_Mutex_Unlock(CCD_Interface_Handle_T *handle)
+{
+	int error_number;
+
+	error_number = pthread_mutex_unlock(&(handle->Handle.Text->Mutex));
+	if(error_number != 0)
+	{
+		Text_Error_Number = 35;
+		sprintf(Text_Error_String,"Text_Mutex_Unlock:Mutex unlock failed '%d'.",error_number);
+		return FALSE;
+	}
+	return TRUE;
 }
 
 /*
@@ -27,6 +27,7 @@
 #include <time.h>
 #include "log_udp.h" /* CCD_Setup_Startup debug only */
 #include "ccd_dsp.h"
+#include "ccd_dsp_download.h"
 #include "ccd_exposure.h"
 #include "ccd_global.h"
 #include "ccd_interface.h"
@@ -172,6 +173,8 @@ static struct Handle_Map_Struct Handle_Map_List[HANDLE_MAP_SIZE] =
 static void CCDLibrary_Throw_Exception(JNIEnv *env,jobject obj,char *function_name);
 static void CCDLibrary_Throw_Exception_String(JNIEnv *env,jobject obj,char *function_name,char *error_string);
 static void CCDLibrary_Log_Handler(char *class,char *source,int level,char *string);
+static void CCDLibrary_Save_Callback(CCD_Interface_Handle_T* handle,char *filename,int successful,
+				     char *error_string);
 static int CCDLibrary_Java_String_List_To_C_List(JNIEnv *env,jobject obj,jobject java_list,
 						 jstring **jni_jstring_list,int *jni_jstring_count,
 						 char ***c_list,int *c_list_count);
@@ -301,6 +304,50 @@ JNIEXPORT jint JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1DSP_1Command_1RET
 	return retval;
 }
 
+/* ------------------------------------------------------------------------------
+** 		CCD_DSP_Download routines
+** ------------------------------------------------------------------------------ */
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_DSP_Download_Set_Readback_Sample_Count<br>
+ * Signature: (I)V<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_dsp_download.html#CCD_DSP_Download_Set_Readback_Sample_Count">
+ * CCD_DSP_Download_Set_Readback_Sample_Count</a>,
+ * which sets how many words are read back to decide whether a DSP program download can be skipped,
+ * for the controller this CCDLibrary instance is connected to.
+ * If an error occurs a CCDLibraryNativeException is thrown.
+ * @param sample_count The number of words to read back, zero to always download.
+ * @see ccd_dsp_download.html#CCD_DSP_Download_Set_Readback_Sample_Count
+ * @see #CCDLibrary_Handle_Map_Find
+ * @see #CCDLibrary_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1DSP_1Download_1Set_1Readback_1Sample_1Count(
+				JNIEnv *env,jobject obj,jint sample_count)
+{
+	CCD_Interface_Handle_T *handle = NULL;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	if(!CCD_DSP_Download_Set_Readback_Sample_Count(handle,(int)sample_count))
+		CCDLibrary_Throw_Exception(env,obj,"CCD_DSP_Download_Set_Readback_Sample_Count");
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_DSP_Download_Cache_Clear<br>
+ * Signature: ()V<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_dsp_download.html#CCD_DSP_Download_Cache_Clear">CCD_DSP_Download_Cache_Clear</a>,
+ * which empties the DSP program image cache.
+ * @see ccd_dsp_download.html#CCD_DSP_Download_Cache_Clear
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1DSP_1Download_1Cache_1Clear(JNIEnv *env,jobject obj)
+{
+	CCD_DSP_Download_Cache_Clear();
+}
+
 /* ------------------------------------------------------------------------------
 ** 		CCD_Exposure routines
 ** ------------------------------------------------------------------------------ */
@@ -527,6 +574,140 @@ JNIEXPORT jlong JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Exposure_1Get_1E
 	return retval;
 }
 
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Exposure_Get_Status_Snapshot<br>
+ * Signature: ()[J<br>
+ * Java Native method to get a consistent snapshot of the exposure status, using 
+ * CCD_Exposure_Get_Status_Snapshot. This does not take the controller access lock. Times are converted 
+ * to milliseconds since the EPOCH. The array contains, in order: the exposure status, exposure length,
+ * exposure start time, elapsed exposure time, readout pixel count, expected pixel count, 
+ * predicted end time and update time. The layout should match the EXPOSURE_SNAPSHOT_ indexes in CCDLibrary.java.
+ * @return A new array of longs, or NULL if an error occurs (in which case an exception is thrown).
+ * @see ccd_exposure.html#CCD_Exposure_Get_Status_Snapshot
+ * @see ccd_exposure.html#CCD_Exposure_Status_Struct
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see #CCDLibrary_Handle_Map_Find
+ */
+JNIEXPORT jlongArray JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Exposure_1Get_1Status_1Snapshot(JNIEnv *env,
+												    jobject obj)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+	struct CCD_Exposure_Status_Struct status_snapshot;
+	jlong snapshot_list[8];
+	jlongArray snapshot_jarray = NULL;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return NULL; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	CCD_Exposure_Get_Status_Snapshot(handle,&status_snapshot);
+	snapshot_list[0] = (jlong)status_snapshot.Exposure_Status;
+	snapshot_list[1] = (jlong)status_snapshot.Exposure_Length;
+	snapshot_list[2] = (((jlong)status_snapshot.Exposure_Start_Time.tv_sec)*((jlong)1000L))+
+		(((jlong)status_snapshot.Exposure_Start_Time.tv_nsec)/((jlong)1000000L));
+	snapshot_list[3] = (jlong)status_snapshot.Elapsed_Exposure_Time;
+	snapshot_list[4] = (jlong)status_snapshot.Readout_Pixel_Count;
+	snapshot_list[5] = (jlong)status_snapshot.Expected_Pixel_Count;
+	snapshot_list[6] = (((jlong)status_snapshot.Predicted_End_Time.tv_sec)*((jlong)1000L))+
+		(((jlong)status_snapshot.Predicted_End_Time.tv_nsec)/((jlong)1000000L));
+	snapshot_list[7] = (((jlong)status_snapshot.Update_Time.tv_sec)*((jlong)1000L))+
+		(((jlong)status_snapshot.Update_Time.tv_nsec)/((jlong)1000000L));
+	snapshot_jarray = (*env)->NewLongArray(env,8);
+	if(snapshot_jarray == NULL)
+		return NULL; /* NewLongArray throws an OutOfMemoryError on failure */
+	(*env)->SetLongArrayRegion(env,snapshot_jarray,0,8,snapshot_list);
+	return snapshot_jarray;
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Exposure_Set_Async_Save<br>
+ * Signature: (Z)V<br>
+ * Java Native Interface routine to set whether exposures are saved asynchronously, by the C layer's 
+ * FITS writer thread. The save callback is set to CCDLibrary_Save_Callback, so the CCDLibrary instance's 
+ * saveCallback method is called as each image is saved.
+ * @param value A boolean, true to save exposures asynchronously.
+ * @see ccd_exposure.html#CCD_Exposure_Set_Async_Save
+ * @see ccd_exposure.html#CCD_Exposure_Set_Save_Callback
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see #CCDLibrary_Save_Callback
+ * @see #CCDLibrary_Handle_Map_Find
+ * @see #CCDLibrary_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Exposure_1Set_1Async_1Save(JNIEnv *env,jobject obj,
+											 jboolean value)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	CCD_Exposure_Set_Save_Callback(handle,CCDLibrary_Save_Callback);
+	if(!CCD_Exposure_Set_Async_Save(handle,(int)value))
+		CCDLibrary_Throw_Exception(env,obj,"CCD_Exposure_Set_Async_Save");
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Exposure_Get_Async_Save<br>
+ * Signature: ()Z<br>
+ * Java Native Interface routine to get whether exposures are saved asynchronously.
+ * @return A boolean, true if exposures are saved by the C layer's FITS writer thread.
+ * @see ccd_exposure.html#CCD_Exposure_Get_Async_Save
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see #CCDLibrary_Handle_Map_Find
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Exposure_1Get_1Async_1Save(JNIEnv *env,
+											     jobject obj)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return FALSE; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	return (jboolean)CCD_Exposure_Get_Async_Save(handle);
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Exposure_Save_Wait<br>
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)V<br>
+ * Java Native Interface routine to wait until all asynchronously saved exposures have been written to disk.
+ * An exception is thrown if any of them failed to save.
+ * @see ccd_exposure.html#CCD_Exposure_Save_Wait
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see #CCDLibrary_Handle_Map_Find
+ * @see #CCDLibrary_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Exposure_1Save_1Wait(JNIEnv *env,jobject obj,
+								  jstring class_jstring, jstring source_jstring)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+	const char *class = NULL;
+	const char *source = NULL;
+	int retval;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	/* Change the java strings to a c null terminated string
+	** If the java String is null the C string should be null as well */
+	if(class_jstring != NULL)
+		class = (*env)->GetStringUTFChars(env,class_jstring,0);
+	if(source_jstring != NULL)
+		source = (*env)->GetStringUTFChars(env,source_jstring,0);
+	/* wait for the FITS writer thread */
+	retval = CCD_Exposure_Save_Wait((char*)class,(char*)source,handle);
+	/* If we created the C strings we need to free the memory it uses */
+	if(class_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,class_jstring,class);
+	if(source_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,source_jstring,source);
+	/* if an error occured throw an exception. */
+	if(retval == FALSE)
+		CCDLibrary_Throw_Exception(env,obj,"CCD_Exposure_Save_Wait");
+}
+
 /* ------------------------------------------------------------------------------
 ** 		ccd_global.c
 ** ------------------------------------------------------------------------------ */
@@ -563,6 +744,153 @@ JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Global_1Set_1Log_
 	CCD_Global_Set_Log_Filter_Level(level);
 }
 
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Global_Log_Ring_Start<br>
+ * Signature: ()V<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_global.html#CCD_Global_Log_Ring_Start">CCD_Global_Log_Ring_Start</a>,
+ * which starts delivering log messages to CCDLibrary_Log_Handler from a separate thread.
+ * If an error occurs a CCDLibraryNativeException is thrown.
+ * @see ccd_global.html#CCD_Global_Log_Ring_Start
+ * @see #CCDLibrary_Log_Handler
+ * @see #CCDLibrary_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Global_1Log_1Ring_1Start(JNIEnv *env,jobject obj)
+{
+	if(!CCD_Global_Log_Ring_Start())
+		CCDLibrary_Throw_Exception(env,obj,"CCD_Global_Log_Ring_Start");
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Global_Log_Ring_Stop<br>
+ * Signature: ()V<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_global.html#CCD_Global_Log_Ring_Stop">CCD_Global_Log_Ring_Stop</a>,
+ * which logs any messages left in the log ring, and stops the log ring thread.
+ * If an error occurs a CCDLibraryNativeException is thrown.
+ * @see ccd_global.html#CCD_Global_Log_Ring_Stop
+ * @see #CCDLibrary_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Global_1Log_1Ring_1Stop(JNIEnv *env,jobject obj)
+{
+	if(!CCD_Global_Log_Ring_Stop())
+		CCDLibrary_Throw_Exception(env,obj,"CCD_Global_Log_Ring_Stop");
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Global_Log_Ring_Get_Dropped_Count<br>
+ * Signature: ()I<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_global.html#CCD_Global_Log_Ring_Get_Dropped_Count">CCD_Global_Log_Ring_Get_Dropped_Count</a>.
+ * @return The number of log messages dropped because the log ring was full.
+ * @see ccd_global.html#CCD_Global_Log_Ring_Get_Dropped_Count
+ */
+JNIEXPORT jint JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Global_1Log_1Ring_1Get_1Dropped_1Count(JNIEnv *env,
+													   jobject obj)
+{
+	return (jint)CCD_Global_Log_Ring_Get_Dropped_Count();
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Global_Metrics_Get<br>
+ * Signature: ()[J<br>
+ * Java Native Interface routine to get a snapshot of this CCDLibrary's per-handle metrics, as an array of longs.
+ * All times are in nanoseconds. The array contains, in order:
+ * <ul>
+ * <li>For each of the CCD_GLOBAL_METRICS_IOCTL_COUNT ioctl metrics, the count, total time and maximum time.
+ * <li>For each of the CCD_GLOBAL_METRICS_TIMER_COUNT timers, the count, total time and maximum time.
+ * <li>The CCD_GLOBAL_METRICS_COUNTER_COUNT counters.
+ * </ul>
+ * The layout should match that described in CCDLibrary.java.
+ * @return A new array of longs, or NULL if an error occurs (in which case an exception is thrown).
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Ioctl
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Timer
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Counter
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_IOCTL_COUNT
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_TIMER_COUNT
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_COUNTER_COUNT
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see #CCDLibrary_Handle_Map_Find
+ * @see #CCDLibrary_Throw_Exception
+ */
+JNIEXPORT jlongArray JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Global_1Metrics_1Get(JNIEnv *env,jobject obj)
+{
+	CCD_Interface_Handle_T* handle = NULL;
+	jlong metrics_list[(3*(CCD_GLOBAL_METRICS_IOCTL_COUNT+CCD_GLOBAL_METRICS_TIMER_COUNT))+
+			   CCD_GLOBAL_METRICS_COUNTER_COUNT];
+	jlongArray metrics_jarray = NULL;
+	long long count,total_ns,max_ns;
+	int i,metrics_index;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return NULL; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	metrics_index = 0;
+	for(i=0;i<CCD_GLOBAL_METRICS_IOCTL_COUNT;i++)
+	{
+		if(!CCD_Global_Metrics_Get_Ioctl(handle,i,NULL,&count,&total_ns,&max_ns))
+		{
+			CCDLibrary_Throw_Exception(env,obj,"CCD_Global_Metrics_Get");
+			return NULL;
+		}
+		metrics_list[metrics_index++] = (jlong)count;
+		metrics_list[metrics_index++] = (jlong)total_ns;
+		metrics_list[metrics_index++] = (jlong)max_ns;
+	}
+	for(i=0;i<CCD_GLOBAL_METRICS_TIMER_COUNT;i++)
+	{
+		if(!CCD_Global_Metrics_Get_Timer(handle,i,&count,&total_ns,&max_ns))
+		{
+			CCDLibrary_Throw_Exception(env,obj,"CCD_Global_Metrics_Get");
+			return NULL;
+		}
+		metrics_list[metrics_index++] = (jlong)count;
+		metrics_list[metrics_index++] = (jlong)total_ns;
+		metrics_list[metrics_index++] = (jlong)max_ns;
+	}
+	for(i=0;i<CCD_GLOBAL_METRICS_COUNTER_COUNT;i++)
+		metrics_list[metrics_index++] = (jlong)CCD_Global_Metrics_Get_Counter(handle,i);
+	metrics_jarray = (*env)->NewLongArray(env,metrics_index);
+	if(metrics_jarray == NULL)
+		return NULL; /* NewLongArray throws an OutOfMemoryError on failure */
+	(*env)->SetLongArrayRegion(env,metrics_jarray,0,metrics_index,metrics_list);
+	return metrics_jarray;
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Global_Get_Error_Number<br>
+ * Signature: ()I<br>
+ * JNI interface to libfrodospec_ccd routine. The error state is thread local, so this returns the
+ * error number of the last failed libfrodospec_ccd call made by the calling Java thread.
+ * @see ccd_global.html#CCD_Global_Get_Error_Number
+ */
+JNIEXPORT jint JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Global_1Get_1Error_1Number(JNIEnv *env,jobject obj)
+{
+	return (jint)CCD_Global_Get_Error_Number();
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Global_Error_String<br>
+ * Signature: ()Ljava/lang/String;<br>
+ * JNI interface to libfrodospec_ccd routine. The error state is thread local, so this returns a description
+ * of the last failed libfrodospec_ccd call made by the calling Java thread.
+ * @see ccd_global.html#CCD_Global_Error_String
+ * @see #CCD_ERROR_LENGTH
+ */
+JNIEXPORT jstring JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Global_1Error_1String(JNIEnv *env,jobject obj)
+{
+	char error_string[CCD_ERROR_LENGTH];
+
+	CCD_Global_Error_String(error_string);
+	return (*env)->NewStringUTF(env,error_string);
+}
+
 /* ------------------------------------------------------------------------------
 ** 		CCD_Interface routines
 ** ------------------------------------------------------------------------------ */
@@ -1555,6 +1883,162 @@ JNIEXPORT jint JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Temperature_1Get_
 	return ((jint)adu);
 }
 
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Temperature_Set_Calibration<br>
+ * Signature: (Ljava/lang/String;Ljava/lang/String;[DDDDI)V<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_temperature.html#CCD_Temperature_Set_Calibration">CCD_Temperature_Set_Calibration</a>,
+ * which sets the dewar temperature sensor calibration data for this controller. 
+ * If an error occurs a CCDLibraryNativeException is thrown.
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see ccd_temperature.html#CCD_Temperature_Set_Calibration
+ * @see ccd_temperature.html#CCD_TEMPERATURE_COEFF_COUNT
+ * @see #CCDLibrary_Throw_Exception
+ * @see #CCDLibrary_Throw_Exception_String
+ * @see #CCDLibrary_Handle_Map_Find
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Temperature_1Set_1Calibration(JNIEnv *env,
+		jobject obj,jstring class_jstring,jstring source_jstring,jdoubleArray coeff_jarray,jdouble v_upper,
+		jdouble v_lower,jdouble adu_per_volt,jint adu_offset)
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	const char *class = NULL;
+	const char *source = NULL;
+	char error_string[CCD_ERROR_LENGTH];
+	double coeff_list[CCD_TEMPERATURE_COEFF_COUNT];
+	int retval,coeff_count;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	/* check size of array */
+	if(coeff_jarray == NULL)
+	{
+		/* N.B. This error occured in the JNI interface, not the libfrodospec_ccd - no error string set */
+		sprintf(error_string,"CCD_Temperature_Set_Calibration:coefficient list was NULL.");
+		CCDLibrary_Throw_Exception_String(env,obj,"CCD_Temperature_Set_Calibration",error_string);
+		return;
+	}
+	coeff_count = (*env)->GetArrayLength(env,(jarray)coeff_jarray);
+	if((coeff_count < 1)||(coeff_count > CCD_TEMPERATURE_COEFF_COUNT))
+	{
+		/* N.B. This error occured in the JNI interface, not the libfrodospec_ccd - no error string set */
+		sprintf(error_string,"CCD_Temperature_Set_Calibration:coefficient list has wrong number of "
+			"elements(%d,1..%d).",coeff_count,CCD_TEMPERATURE_COEFF_COUNT);
+		CCDLibrary_Throw_Exception_String(env,obj,"CCD_Temperature_Set_Calibration",error_string);
+		return;
+	}
+	(*env)->GetDoubleArrayRegion(env,coeff_jarray,0,coeff_count,(jdouble*)coeff_list);
+	if(((*env)->ExceptionCheck(env)))
+	{
+		fprintf(stderr,"Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Temperature_1Set_1Calibration:"
+			"GetDoubleArrayRegion caused exception.\n");
+		return;
+	}
+	/* Change the java strings to a c null terminated string
+	** If the java String is null the C string should be null as well */
+	if(class_jstring != NULL)
+		class = (*env)->GetStringUTFChars(env,class_jstring,0);
+	if(source_jstring != NULL)
+		source = (*env)->GetStringUTFChars(env,source_jstring,0);
+	/* set calibration */
+	retval = CCD_Temperature_Set_Calibration((char*)class,(char*)source,handle,coeff_count,coeff_list,
+						 v_upper,v_lower,adu_per_volt,adu_offset);
+	/* If we created the C strings we need to free the memory it uses */
+	if(class_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,class_jstring,class);
+	if(source_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,source_jstring,source);
+	/* if an error occured throw an exception. */
+	if(retval == FALSE)
+		CCDLibrary_Throw_Exception(env,obj,"CCD_Temperature_Set_Calibration");
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Temperature_Sampler_Start<br>
+ * Signature: (Ljava/lang/String;Ljava/lang/String;I)V<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_temperature.html#CCD_Temperature_Sampler_Start">CCD_Temperature_Sampler_Start</a>,
+ * which starts the background temperature sampler for this controller. 
+ * If an error occurs a CCDLibraryNativeException is thrown.
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see ccd_temperature.html#CCD_Temperature_Sampler_Start
+ * @see #CCDLibrary_Throw_Exception
+ * @see #CCDLibrary_Handle_Map_Find
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Temperature_1Sampler_1Start(JNIEnv *env,
+		jobject obj,jstring class_jstring,jstring source_jstring,jint sample_period)
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	const char *class = NULL;
+	const char *source = NULL;
+	int retval;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	/* Change the java strings to a c null terminated string
+	** If the java String is null the C string should be null as well */
+	if(class_jstring != NULL)
+		class = (*env)->GetStringUTFChars(env,class_jstring,0);
+	if(source_jstring != NULL)
+		source = (*env)->GetStringUTFChars(env,source_jstring,0);
+	/* start sampler. The class and source are copied by the library, so can be released afterwards. */
+	retval = CCD_Temperature_Sampler_Start((char*)class,(char*)source,handle,sample_period);
+	/* If we created the C strings we need to free the memory it uses */
+	if(class_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,class_jstring,class);
+	if(source_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,source_jstring,source);
+	/* if an error occured throw an exception. */
+	if(retval == FALSE)
+		CCDLibrary_Throw_Exception(env,obj,"CCD_Temperature_Sampler_Start");
+}
+
+/**
+ * Class:     ngat_frodospec_ccd_CCDLibrary<br>
+ * Method:    CCD_Temperature_Sampler_Stop<br>
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)V<br>
+ * Java Native Interface implementation of 
+ * <a href="ccd_temperature.html#CCD_Temperature_Sampler_Stop">CCD_Temperature_Sampler_Stop</a>,
+ * which stops the background temperature sampler for this controller. 
+ * If an error occurs a CCDLibraryNativeException is thrown.
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ * @see ccd_temperature.html#CCD_Temperature_Sampler_Stop
+ * @see #CCDLibrary_Throw_Exception
+ * @see #CCDLibrary_Handle_Map_Find
+ */
+JNIEXPORT void JNICALL Java_ngat_frodospec_ccd_CCDLibrary_CCD_1Temperature_1Sampler_1Stop(JNIEnv *env,
+		jobject obj,jstring class_jstring,jstring source_jstring)
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	const char *class = NULL;
+	const char *source = NULL;
+	int retval;
+
+	/* get interface handle from CCDLibrary instance map */
+	if(!CCDLibrary_Handle_Map_Find(env,obj,&handle))
+		return; /* CCDLibrary_Handle_Map_Find throws an exception on failure */
+	/* Change the java strings to a c null terminated string
+	** If the java String is null the C string should be null as well */
+	if(class_jstring != NULL)
+		class = (*env)->GetStringUTFChars(env,class_jstring,0);
+	if(source_jstring != NULL)
+		source = (*env)->GetStringUTFChars(env,source_jstring,0);
+	/* stop sampler */
+	retval = CCD_Temperature_Sampler_Stop((char*)class,(char*)source,handle);
+	/* If we created the C strings we need to free the memory it uses */
+	if(class_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,class_jstring,class);
+	if(source_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,source_jstring,source);
+	/* if an error occured throw an exception. */
+	if(retval == FALSE)
+		CCDLibrary_Throw_Exception(env,obj,"CCD_Temperature_Sampler_Stop");
+}
+
 
 /* ------------------------------------------------------------------------------
 ** 		ccd_text.c
@@ -1663,6 +2147,9 @@ static void CCDLibrary_Throw_Exception_String(JNIEnv *env,jobject obj,char *func
  * If the logger instance is NULL, or the log_method_id is NULL the call is not made.
  * Otherwise, A java.lang.String instance is constructed from the string parameter,
  * and the JNI CallVoidMEthod routine called to call log().
+ * When the libfrodospec_ccd log ring is running, this is called from the log ring thread, which is attached 
+ * to the JVM the first time it logs. The local references are deleted after the call, as that thread does not
+ * return to Java to free them.
  * @param class A string representing the class that caused this message to be logged - used to fill in the 
  *        class field in the log record.
  * @param source A string representing the source that caused this message to be logged - used to fill in the 
@@ -1719,6 +2206,92 @@ static void CCDLibrary_Log_Handler(char *class,char *source,int level,char *stri
 		java_source = (*env)->NewStringUTF(env,"-");
 /* call log method on logger instance */
 	(*env)->CallVoidMethod(env,logger,log_method_id,(jint)level,java_class,java_source,java_string);
+/* delete the local references, this may be the log ring thread which never returns to Java to free them */
+	(*env)->DeleteLocalRef(env,java_string);
+	(*env)->DeleteLocalRef(env,java_class);
+	(*env)->DeleteLocalRef(env,java_source);
+}
+
+/**
+ * libfrodospec_ccd save callback for the Java layer interface, called by the C layer's FITS writer thread
+ * after each asynchronously saved image. The CCDLibrary instance mapped to the handle is found in
+ * Handle_Map_List, and it's saveCallback(String filename,boolean successful,String errorString) method called.
+ * As the FITS writer thread is not a Java thread, it is attached to the JVM, and the local references created 
+ * are deleted before returning. Any exception thrown by saveCallback is printed and cleared.
+ * @param handle The interface handle the image was saved for.
+ * @param filename The filename of the saved image.
+ * @param successful A boolean, TRUE if the image was saved successfully.
+ * @param error_string A description of why the image failed to save (empty if it succeeded).
+ * @see #java_vm
+ * @see #Handle_Map_List
+ * @see #HANDLE_MAP_SIZE
+ * @see ccd_exposure.html#CCD_Exposure_Set_Save_Callback
+ * @see ccd_interface.html#CCD_Interface_Handle_T
+ */
+static void CCDLibrary_Save_Callback(CCD_Interface_Handle_T* handle,char *filename,int successful,
+				     char *error_string)
+{
+	JNIEnv *env = NULL;
+	jobject instance = NULL;
+	jclass cls = NULL;
+	jmethodID save_callback_method_id = NULL;
+	jstring java_filename = NULL;
+	jstring java_error_string = NULL;
+	int i;
+
+	if(java_vm == NULL)
+	{
+		fprintf(stderr,"CCDLibrary_Save_Callback:java_vm was NULL (%s,%d).\n",filename,successful);
+		return;
+	}
+	/* find the CCDLibrary instance for this handle */
+	for(i=0;i<HANDLE_MAP_SIZE;i++)
+	{
+		if(Handle_Map_List[i].Interface_Handle == handle)
+		{
+			instance = Handle_Map_List[i].CCDLibrary_Instance_Handle;
+			break;
+		}
+	}
+	if(instance == NULL)
+	{
+		fprintf(stderr,"CCDLibrary_Save_Callback:Failed to find instance for handle %p (%s,%d).\n",
+			(void*)handle,filename,successful);
+		return;
+	}
+/* get java env for this thread */
+	(*java_vm)->AttachCurrentThread(java_vm,(void**)&env,NULL);
+	if(env == NULL)
+	{
+		fprintf(stderr,"CCDLibrary_Save_Callback:env was NULL (%s,%d).\n",filename,successful);
+		return;
+	}
+/* get saveCallback(String filename,boolean successful,String errorString) method */
+	cls = (*env)->GetObjectClass(env,instance);
+	save_callback_method_id = (*env)->GetMethodID(env,cls,"saveCallback",
+						      "(Ljava/lang/String;ZLjava/lang/String;)V");
+	if(save_callback_method_id == NULL)
+	{
+		/* One of the following exceptions has been thrown:
+		** NoSuchMethodError, ExceptionInInitializerError, OutOfMemoryError */
+		(*env)->ExceptionDescribe(env);
+		(*env)->ExceptionClear(env);
+		(*env)->DeleteLocalRef(env,cls);
+		return;
+	}
+/* convert C to Java Strings and call saveCallback on the instance */
+	java_filename = (*env)->NewStringUTF(env,filename);
+	java_error_string = (*env)->NewStringUTF(env,error_string);
+	(*env)->CallVoidMethod(env,instance,save_callback_method_id,java_filename,(jboolean)successful,
+			       java_error_string);
+	if((*env)->ExceptionCheck(env))
+	{
+		(*env)->ExceptionDescribe(env);
+		(*env)->ExceptionClear(env);
+	}
+	(*env)->DeleteLocalRef(env,java_filename);
+	(*env)->DeleteLocalRef(env,java_error_string);
+	(*env)->DeleteLocalRef(env,cls);
 }
 
 /**
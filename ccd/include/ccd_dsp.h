@@ -314,6 +314,57 @@ enum CCD_DSP_AMPLIFIER
 #define CCD_DSP_CONTROLLER_CONFIG_BIT_BOTH_READOUTS		(0x3000)
 #define CCD_DSP_CONTROLLER_CONFIG_BIT_MPP_CAPABLE		(0x4000)
 
+/**
+ * The maximum number of manual commands that can be queued in one DSP transaction.
+ * @see #CCD_DSP_Transaction_Struct
+ */
+#define CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT	(32)
+/**
+ * The maximum number of arguments a manual command queued in a DSP transaction can have. This is the
+ * ioctl argument list length, less the header and command words.
+ * @see #CCD_DSP_Transaction_Command_Struct
+ */
+#define CCD_DSP_TRANSACTION_MAX_ARGUMENT_COUNT	(4)
+
+/**
+ * Structure holding one manual command queued in a DSP transaction. Fields are:
+ * <dl>
+ * <dt>Board_Id</dt> <dd>Which SDSU board to send the command to.</dd>
+ * <dt>Command</dt> <dd>The manual command to send, e.g. CCD_DSP_WRM.</dd>
+ * <dt>Argument_List</dt> <dd>The arguments to send with the command.</dd>
+ * <dt>Argument_Count</dt> <dd>The number of arguments in Argument_List.</dd>
+ * <dt>Reply</dt> <dd>The reply the controller returned, filled in by CCD_DSP_Transaction_Submit.</dd>
+ * </dl>
+ * @see #CCD_DSP_Transaction_Struct
+ */
+struct CCD_DSP_Transaction_Command_Struct
+{
+	enum CCD_DSP_BOARD_ID Board_Id;
+	int Command;
+	int Argument_List[CCD_DSP_TRANSACTION_MAX_ARGUMENT_COUNT];
+	int Argument_Count;
+	int Reply;
+};
+
+/**
+ * Structure holding a list of manual commands, that CCD_DSP_Transaction_Submit sends to the controller
+ * back to back. Fields are:
+ * <dl>
+ * <dt>Command_List</dt> <dd>The queued commands, in the order they are sent.</dd>
+ * <dt>Command_Count</dt> <dd>The number of commands in Command_List.</dd>
+ * <dt>Failed_Index</dt> <dd>The index in Command_List of the command that failed, or -1 if none did.</dd>
+ * </dl>
+ * @see #CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT
+ * @see #CCD_DSP_Transaction_Initialise
+ * @see #CCD_DSP_Transaction_Submit
+ */
+struct CCD_DSP_Transaction_Struct
+{
+	struct CCD_DSP_Transaction_Command_Struct Command_List[CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT];
+	int Command_Count;
+	int Failed_Index;
+};
+
 extern int CCD_DSP_Initialise(void);
 extern void CCD_DSP_Data_Initialise(CCD_Interface_Handle_T* handle);
 /* Boot commands */
@@ -325,6 +376,9 @@ extern int CCD_DSP_Command_TDL(char *class,char *source,CCD_Interface_Handle_T*
 			       enum CCD_DSP_BOARD_ID board_id,int data);
 extern int CCD_DSP_Command_WRM(char *class,char *source,CCD_Interface_Handle_T* handle,
 			       enum CCD_DSP_BOARD_ID board_id,enum CCD_DSP_MEM_SPACE mem_space,int address,int data);
+extern int CCD_DSP_Command_WRM_Block(char *class,char *source,CCD_Interface_Handle_T* handle,
+				     enum CCD_DSP_BOARD_ID board_id,enum CCD_DSP_MEM_SPACE mem_space,int address,
+				     int *data_list,int data_count);
 /* timing board commands */
 extern int CCD_DSP_Command_ABR(char *class,char *source,CCD_Interface_Handle_T* handle);
 extern int CCD_DSP_Command_CLR(char *class,char *source,CCD_Interface_Handle_T* handle);
@@ -353,12 +407,28 @@ extern int CCD_DSP_Command_SEX(char *class,char *source,CCD_Interface_Handle_T*
 extern int CCD_DSP_Command_Reset(char *class,char *source,CCD_Interface_Handle_T* handle);
 extern int CCD_DSP_Command_Get_HSTR(char *class,char *source,CCD_Interface_Handle_T* handle,int *value);
 extern int CCD_DSP_Command_Get_Readout_Progress(char *class,char *source,CCD_Interface_Handle_T* handle,int *value);
+extern int CCD_DSP_Command_Wait_Readout_Progress(char *class,char *source,CCD_Interface_Handle_T* handle,
+						 int target_value,int timeout_ms,int *value);
 extern int CCD_DSP_Command_RCC(char *class,char *source,CCD_Interface_Handle_T* handle,int *value);
 extern int CCD_DSP_Command_PCI_Download(char *class,char *source,CCD_Interface_Handle_T* handle);
 extern int CCD_DSP_Command_PCI_Download_Wait(char *class,char *source,CCD_Interface_Handle_T* handle);
 extern int CCD_DSP_Command_PCI_PC_Reset(char *class,char *source,CCD_Interface_Handle_T* handle);
 extern int CCD_DSP_Command_SET(char *class,char *source,CCD_Interface_Handle_T* handle,int msecs);
 extern int CCD_DSP_Command_RET(char *class,char *source,CCD_Interface_Handle_T* handle);
+/* transactions */
+extern void CCD_DSP_Transaction_Initialise(struct CCD_DSP_Transaction_Struct *transaction);
+extern int CCD_DSP_Transaction_Add_WRM(struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_BOARD_ID board_id,
+				       enum CCD_DSP_MEM_SPACE mem_space,int address,int data);
+extern int CCD_DSP_Transaction_Add_SGN(struct CCD_DSP_Transaction_Struct *transaction,enum CCD_DSP_GAIN gain,
+				       int speed);
+extern int CCD_DSP_Transaction_Add_SOS(struct CCD_DSP_Transaction_Struct *transaction,
+				       enum CCD_DSP_AMPLIFIER amplifier);
+extern int CCD_DSP_Transaction_Add_SSP(struct CCD_DSP_Transaction_Struct *transaction,int y_offset,int x_offset,
+				       int bias_x_offset);
+extern int CCD_DSP_Transaction_Add_SSS(struct CCD_DSP_Transaction_Struct *transaction,int bias_width,int box_width,
+				       int box_height);
+extern int CCD_DSP_Transaction_Submit(char *class,char *source,CCD_Interface_Handle_T* handle,
+				      struct CCD_DSP_Transaction_Struct *transaction);
 extern int CCD_DSP_Get_Abort(CCD_Interface_Handle_T* handle);
 extern int CCD_DSP_Set_Abort(char *class,char *source,CCD_Interface_Handle_T* handle,int value);
 extern int CCD_DSP_Get_Error_Number(void);
@@ -10,6 +10,11 @@
 extern int CCD_DSP_Download_Initialise(void);
 extern int CCD_DSP_Download(char *class,char *source,CCD_Interface_Handle_T* handle,
 			    enum CCD_DSP_BOARD_ID board_id,char *filename);
+extern int CCD_DSP_Download_Set_Readback_Sample_Count(CCD_Interface_Handle_T* handle,int sample_count);
+extern int CCD_DSP_Download_Image_Compile(char *class,char *source,char *lod_filename,char *image_filename);
+extern int CCD_DSP_Download_Image_Get_Checksum(char *class,char *source,char *filename,unsigned int *checksum,
+					       int *word_count);
+extern void CCD_DSP_Download_Cache_Clear(void);
 extern int CCD_DSP_Download_Get_Error_Number(void);
 extern void CCD_DSP_Download_Error(void);
 extern void CCD_DSP_Download_Error_String(char *error_string);
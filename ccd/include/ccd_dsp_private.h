@@ -11,11 +11,15 @@
  * Structure used to hold local per-handle data to ccd_dsp.
  * <dl>
  * <dt>Abort</dt> <dd>Whether it has been requested to abort the current operation.</dd>
+ * <dt>Download_Readback_Sample_Count</dt> <dd>The number of words ccd_dsp_download reads back from a timing or
+ * 	utility board before a download, to determine whether the board already holds the program.
+ * 	Zero means always download.</dd>
  * </dl>
  */
 struct CCD_DSP_Struct
 {
       volatile int Abort; /* This is volatile as a different thread may change this variable. */
+      int Download_Readback_Sample_Count;
 };
 
 #endif
@@ -18,6 +18,7 @@
 #include <time.h>
 #include "ccd_global.h"
 #include "ccd_interface.h"
+#include "ccd_dsp.h" /* enum CCD_DSP_DEINTERLACE_TYPE declaration */
 
 /* These #define/enum definitions should match with those in CCDLibrary.java */
 /**
@@ -59,13 +60,134 @@ enum CCD_EXPOSURE_STATUS
 #define CCD_EXPOSURE_IS_STATUS(status)	(((status) == CCD_EXPOSURE_STATUS_NONE)|| \
         ((status) == CCD_EXPOSURE_STATUS_WAIT_START)|| \
 	((status) == CCD_EXPOSURE_STATUS_CLEAR)||((status) == CCD_EXPOSURE_STATUS_EXPOSE)|| \
+	((status) == CCD_EXPOSURE_STATUS_PRE_READOUT)|| \
         ((status) == CCD_EXPOSURE_STATUS_READOUT)||((status) == CCD_EXPOSURE_STATUS_POST_READOUT))
 
+/**
+ * The stages of CCD_Exposure_Expose that are timed, see CCD_Exposure_Get_Stage_Time. One of:
+ * <ul>
+ * <li>CCD_EXPOSURE_STAGE_SEX - Sending the START_EXPOSURE command to the controller
+ * 	(including waiting for the exposure start time).
+ * <li>CCD_EXPOSURE_STAGE_EXPOSE - From the START_EXPOSURE command completing until the readout is detected.
+ * <li>CCD_EXPOSURE_STAGE_READOUT - From the readout being detected until all the pixels have been read out.
+ * <li>CCD_EXPOSURE_STAGE_REPLY_DATA - Getting a pointer to the read out data from the device.
+ * <li>CCD_EXPOSURE_STAGE_POST_READOUT - Byte swapping and de-interlacing the read out data.
+ * <li>CCD_EXPOSURE_STAGE_SAVE - Saving the images to disk (or queueing them for the FITS writer thread).
+ * </ul>
+ * @see #CCD_Exposure_Get_Stage_Time
+ * @see #CCD_EXPOSURE_STAGE_COUNT
+ */
+enum CCD_EXPOSURE_STAGE
+{
+	CCD_EXPOSURE_STAGE_SEX=0,CCD_EXPOSURE_STAGE_EXPOSE=1,CCD_EXPOSURE_STAGE_READOUT=2,
+	CCD_EXPOSURE_STAGE_REPLY_DATA=3,CCD_EXPOSURE_STAGE_POST_READOUT=4,CCD_EXPOSURE_STAGE_SAVE=5
+};
+
+/**
+ * The number of stages in CCD_EXPOSURE_STAGE.
+ * @see #CCD_EXPOSURE_STAGE
+ */
+#define CCD_EXPOSURE_STAGE_COUNT			(6)
+
+/**
+ * Macro to check whether the exposure stage is a legal value.
+ * @see #CCD_EXPOSURE_STAGE
+ */
+#define CCD_EXPOSURE_IS_STAGE(stage)	(((stage) >= CCD_EXPOSURE_STAGE_SEX)&& \
+	((stage) < CCD_EXPOSURE_STAGE_COUNT))
+
+/**
+ * Which set of row kernels CCD_Exposure_DeInterlace uses to reorder the read out image.
+ * <ul>
+ * <li>CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR uses plain C loops, and is always available.
+ * <li>CCD_EXPOSURE_DEINTERLACE_KERNEL_SSE2 uses SSE2 instructions, on x86 processors that support them.
+ * <li>CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2 uses AVX2 instructions, on x86 processors that support them.
+ * </ul>
+ * @see #CCD_Exposure_DeInterlace
+ * @see #CCD_Exposure_Set_DeInterlace_Kernel
+ */
+enum CCD_EXPOSURE_DEINTERLACE_KERNEL
+{
+	CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR=0,CCD_EXPOSURE_DEINTERLACE_KERNEL_SSE2=1,
+	CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2=2
+};
+
+/**
+ * Macro to check whether the deinterlace kernel is a legal value.
+ * @see #CCD_EXPOSURE_DEINTERLACE_KERNEL
+ */
+#define CCD_EXPOSURE_IS_DEINTERLACE_KERNEL(kernel)	(((kernel) == CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR)|| \
+	((kernel) == CCD_EXPOSURE_DEINTERLACE_KERNEL_SSE2)||((kernel) == CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2))
+
+/**
+ * Structure describing one of the exposures taken by CCD_Exposure_Expose_Multi.
+ * <dl>
+ * <dt>Handle</dt> <dd>The handle of the controller to take the exposure with.</dd>
+ * <dt>Filename_List</dt> <dd>A list of filenames to save the exposure into. This is normally of length 1,
+ *     unless we are windowing, in which case there will be one filename for each window.</dd>
+ * <dt>Filename_Count</dt> <dd>The number of filenames in Filename_List.</dd>
+ * <dt>Successful</dt> <dd>Set by CCD_Exposure_Expose_Multi to TRUE if this exposure was taken and saved
+ *     (or queued to be saved), and FALSE if it failed or was aborted.</dd>
+ * <dt>Error_String</dt> <dd>Set by CCD_Exposure_Expose_Multi to a description of why this exposure failed,
+ *     or an empty string if it was successful.</dd>
+ * <dt>Exposure_Start_Time</dt> <dd>Set by CCD_Exposure_Expose_Multi to the time this exposure started
+ *     (see CCD_Exposure_Get_Exposure_Start_Time), or zero if it was not started.</dd>
+ * <dt>Start_Skew</dt> <dd>Set by CCD_Exposure_Expose_Multi to how long after the first exposure to start
+ *     this exposure started, in milliseconds.</dd>
+ * </dl>
+ * @see #CCD_Exposure_Expose_Multi
+ */
+struct CCD_Exposure_Multi_Struct
+{
+	CCD_Interface_Handle_T *Handle;
+	char **Filename_List;
+	int Filename_Count;
+	int Successful;
+	char Error_String[CCD_GLOBAL_ERROR_STRING_LENGTH];
+	struct timespec Exposure_Start_Time;
+	double Start_Skew;
+};
+
+/**
+ * Structure holding a consistent snapshot of the status of the exposure being taken on a controller, as
+ * published by the exposure thread and returned by CCD_Exposure_Get_Status_Snapshot.
+ * <dl>
+ * <dt>Exposure_Status</dt> <dd>Whether an operation is being performed to CLEAR, EXPOSE or READOUT the CCD.</dd>
+ * <dt>Exposure_Length</dt> <dd>The last exposure length to be set, in milliseconds.</dd>
+ * <dt>Exposure_Start_Time</dt> <dd>The time stamp the exposure started.</dd>
+ * <dt>Elapsed_Exposure_Time</dt> <dd>The amount of the exposure that had elapsed at Update_Time, 
+ *     in milliseconds.</dd>
+ * <dt>Readout_Pixel_Count</dt> <dd>The number of pixels read out at Update_Time.</dd>
+ * <dt>Expected_Pixel_Count</dt> <dd>The number of pixels the readout will produce.</dd>
+ * <dt>Readout_Progress</dt> <dd>The percentage of the readout completed at Update_Time, 0.0 to 100.0.</dd>
+ * <dt>Predicted_End_Time</dt> <dd>The time the readout is predicted to finish. Until a readout rate has
+ *     been measured this is the end of the exposure. The tv_sec field is zero if no prediction can be made.</dd>
+ * <dt>Update_Time</dt> <dd>The time the progress fields were last updated.</dd>
+ * </dl>
+ * @see #CCD_Exposure_Get_Status_Snapshot
+ * @see #CCD_EXPOSURE_STATUS
+ */
+struct CCD_Exposure_Status_Struct
+{
+	enum CCD_EXPOSURE_STATUS Exposure_Status;
+	int Exposure_Length;
+	struct timespec Exposure_Start_Time;
+	int Elapsed_Exposure_Time;
+	int Readout_Pixel_Count;
+	int Expected_Pixel_Count;
+	double Readout_Progress;
+	struct timespec Predicted_End_Time;
+	struct timespec Update_Time;
+};
+
 extern void CCD_Exposure_Initialise(void);
 extern void CCD_Exposure_Data_Initialise(CCD_Interface_Handle_T* handle);
 extern int CCD_Exposure_Expose(char *class,char *source,CCD_Interface_Handle_T* handle,
 			       int clear_array,int open_shutter,struct timespec start_time,int exposure_time,
 			       char **filename_list,int filename_count);
+extern int CCD_Exposure_Expose_Multi(char *class,char *source,struct CCD_Exposure_Multi_Struct *multi_list,
+				     int multi_count,int clear_array,int open_shutter,struct timespec start_time,
+				     int exposure_time);
 extern int CCD_Exposure_Bias(char *class,char *source,CCD_Interface_Handle_T* handle,char *filename);
 extern int CCD_Exposure_Open_Shutter(char *class,char *source,CCD_Interface_Handle_T* handle);
 extern int CCD_Exposure_Close_Shutter(char *class,char *source,CCD_Interface_Handle_T* handle);
@@ -78,6 +200,8 @@ extern int CCD_Exposure_Set_Exposure_Status(CCD_Interface_Handle_T* handle,enum
 extern enum CCD_EXPOSURE_STATUS CCD_Exposure_Get_Exposure_Status(CCD_Interface_Handle_T* handle);
 extern struct timespec CCD_Exposure_Get_Exposure_Start_Time(CCD_Interface_Handle_T* handle);
 extern int CCD_Exposure_Get_Exposure_Length(CCD_Interface_Handle_T* handle);
+extern void CCD_Exposure_Get_Status_Snapshot(CCD_Interface_Handle_T* handle,
+					     struct CCD_Exposure_Status_Struct *status_snapshot);
 extern void CCD_Exposure_Set_Start_Exposure_Clear_Time(CCD_Interface_Handle_T* handle,int time);
 extern int CCD_Exposure_Get_Start_Exposure_Clear_Time(CCD_Interface_Handle_T* handle);
 extern void CCD_Exposure_Set_Start_Exposure_Offset_Time(CCD_Interface_Handle_T* handle,int time);
@@ -85,6 +209,31 @@ extern int CCD_Exposure_Get_Start_Exposure_Offset_Time(CCD_Interface_Handle_T* h
 extern void CCD_Exposure_Set_Readout_Remaining_Time(CCD_Interface_Handle_T* handle,int time);
 extern int CCD_Exposure_Get_Readout_Remaining_Time(CCD_Interface_Handle_T* handle);
 extern void CCD_Exposure_Set_Exposure_Start_Time(CCD_Interface_Handle_T* handle);
+extern void CCD_Exposure_Measure_Exposure_Start_Time(CCD_Interface_Handle_T* handle,struct timespec ret_time,
+						     int elapsed_exposure_time);
+extern int CCD_Exposure_Get_Start_Exposure_Latency(CCD_Interface_Handle_T* handle);
+extern int CCD_Exposure_Get_Start_Exposure_Latency_Count(CCD_Interface_Handle_T* handle);
+extern int CCD_Exposure_Set_Streaming_Readout(CCD_Interface_Handle_T* handle,int value);
+extern int CCD_Exposure_Get_Streaming_Readout(CCD_Interface_Handle_T* handle);
+extern int CCD_Exposure_Set_Readout_Progress_Wait(CCD_Interface_Handle_T* handle,int value);
+extern int CCD_Exposure_Get_Readout_Progress_Wait(CCD_Interface_Handle_T* handle);
+extern int CCD_Exposure_DeInterlace(char *class,char *source,int ncols,int nrows,unsigned short *raw_data,
+				    unsigned short *image_data,enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,int byte_swap);
+extern int CCD_Exposure_Post_Readout_Transform(char *class,char *source,CCD_Interface_Handle_T* handle,
+					       unsigned short *exposure_data,unsigned short **image_data_list,
+					       int image_data_count);
+extern int CCD_Exposure_Buffer_Pool_Allocate(char *class,char *source,CCD_Interface_Handle_T* handle);
+extern int CCD_Exposure_Buffer_Pool_Free(char *class,char *source,CCD_Interface_Handle_T* handle);
+extern int CCD_Exposure_Set_Async_Save(CCD_Interface_Handle_T* handle,int value);
+extern int CCD_Exposure_Get_Async_Save(CCD_Interface_Handle_T* handle);
+extern void CCD_Exposure_Set_Save_Callback(CCD_Interface_Handle_T* handle,
+					   void (*callback)(CCD_Interface_Handle_T* handle,char *filename,
+							    int successful,char *error_string));
+extern int CCD_Exposure_Save_Wait(char *class,char *source,CCD_Interface_Handle_T* handle);
+extern int CCD_Exposure_Set_DeInterlace_Kernel(enum CCD_EXPOSURE_DEINTERLACE_KERNEL kernel);
+extern enum CCD_EXPOSURE_DEINTERLACE_KERNEL CCD_Exposure_Get_DeInterlace_Kernel(void);
+extern int CCD_Exposure_DeInterlace_Kernel_Supported(enum CCD_EXPOSURE_DEINTERLACE_KERNEL kernel);
+extern double CCD_Exposure_Get_Stage_Time(CCD_Interface_Handle_T* handle,enum CCD_EXPOSURE_STAGE stage);
 
 extern int CCD_Exposure_Get_Error_Number(void);
 extern void CCD_Exposure_Error(void);
@@ -5,7 +5,52 @@
 #ifndef CCD_EXPOSURE_PRIVATE_H
 #define CCD_EXPOSURE_PRIVATE_H
 
+#include <pthread.h> /* pthread_t, pthread_mutex_t, pthread_cond_t */
 #include "ccd_exposure.h" /* enum CCD_EXPOSURE_STATUS declaration */
+#include "ccd_setup.h" /* CCD_SETUP_WINDOW_COUNT declaration */
+
+/* hash definitions */
+/**
+ * The number of frames in each handle's image buffer pool. When saving asynchronously, this is the number of
+ * read out frames that can be waiting to be written to disk before CCD_Exposure_Expose blocks.
+ */
+#define CCD_EXPOSURE_FRAME_COUNT		(3)
+/**
+ * The maximum length of a filename (and the class and source strings used by the FITS writer thread 
+ * for logging), including the terminating NULL.
+ */
+#define CCD_EXPOSURE_STRING_LENGTH		(256)
+
+/**
+ * Structure holding one frame of the image buffer pool. A frame holds the final images of one exposure,
+ * and the information needed to save them.
+ * <dl>
+ * <dt>Image_Buffer_List</dt> <dd>A list of preallocated, memory locked buffers, that post-readout processing 
+ * 	writes the final images into. The full frame image uses the first buffer, 
+ * 	each active window uses the buffer with the same index as it's filename. Entries are NULL if unallocated.</dd>
+ * <dt>Image_Buffer_Size_List</dt> <dd>The size of each buffer in Image_Buffer_List, in pixels.</dd>
+ * <dt>In_Use</dt> <dd>A boolean, TRUE from when an exposure acquires the frame until it's images have been saved.
+ * 	Protected by the Writer_Mutex of the CCD_Exposure_Struct holding the frame.</dd>
+ * <dt>Image_Count</dt> <dd>The number of images in the frame (1 for a full frame, or the number of active windows).</dd>
+ * <dt>Filename_List</dt> <dd>The FITS filename to save each image into.</dd>
+ * <dt>NCols_List</dt> <dd>The number of columns in each image.</dd>
+ * <dt>NRows_List</dt> <dd>The number of rows in each image.</dd>
+ * <dt>Exposure_Start_Time</dt> <dd>The start time of the exposure the images came from.</dd>
+ * </dl>
+ * @see #CCD_EXPOSURE_STRING_LENGTH
+ * @see ccd_exposure.html#CCD_Exposure_Buffer_Pool_Allocate
+ */
+struct CCD_Exposure_Frame_Struct
+{
+	unsigned short *Image_Buffer_List[CCD_SETUP_WINDOW_COUNT];
+	int Image_Buffer_Size_List[CCD_SETUP_WINDOW_COUNT];
+	int In_Use;
+	int Image_Count;
+	char Filename_List[CCD_SETUP_WINDOW_COUNT][CCD_EXPOSURE_STRING_LENGTH];
+	int NCols_List[CCD_SETUP_WINDOW_COUNT];
+	int NRows_List[CCD_SETUP_WINDOW_COUNT];
+	struct timespec Exposure_Start_Time;
+};
 
 /**
  * Structure used to hold local data to ccd_exposure.
@@ -16,13 +61,62 @@
  * 	and must be greater than the time the CLEAR_ARRAY command takes to clock all accumulated charge off the CCD 
  * 	(approx 5 seconds for a 2kx2k EEV42-40).</dd>
  * <dt>Start_Exposure_Offset_Time</dt> <dd>The amount of time, in milliseconds, before the desired start of 
- * 	exposure that we should send the START_EXPOSURE command, to allow for transmission delay.</dd>
+ * 	exposure that we should send the START_EXPOSURE command, to allow for transmission delay. This is only
+ * 	used until the start latency has been measured.</dd>
  * <dt>Readout_Remaining_Time</dt> <dd>Amount of time, in milleseconds,
  * 	remaining for an exposure when we change status to READOUT, to stop RDM/TDL/WRMs affecting the readout.</dd>
  * <dt>Exposure_Length</dt> <dd>The last exposure length to be set.</dd>
- * <dt>Exposure_Start_Time</dt> <dd>The time stamp when the START_EXPOSURE command was sent to the controller.</dd>
+ * <dt>Exposure_Start_Time</dt> <dd>The time stamp the exposure started. This is the time the START_EXPOSURE command
+ * 	was sent to the controller, plus the measured start latency.</dd>
+ * <dt>Start_Exposure_Send_Time</dt> <dd>The time stamp when the START_EXPOSURE command was sent to the controller.</dd>
+ * <dt>Start_Exposure_Latency</dt> <dd>The average time, in nanoseconds, between sending the START_EXPOSURE command
+ * 	and the controller starting the exposure, as measured from elapsed exposure time (RET) readbacks.</dd>
+ * <dt>Start_Exposure_Latency_Count</dt> <dd>The number of latency measurements averaged into 
+ * 	Start_Exposure_Latency.</dd>
+ * <dt>Start_Exposure_Measured</dt> <dd>A boolean, TRUE if the start latency of the current exposure has 
+ * 	been measured.</dd>
+ * <dt>Streaming_Readout</dt> <dd>A boolean, if TRUE full frame rows are byte swapped, de-interlaced and written to
+ * 	the FITS file whilst the rest of the CCD is still being read out.</dd>
+ * <dt>Readout_Progress_Wait</dt> <dd>A boolean, if TRUE the exposure monitor loop waits for the readout progress
+ * 	to complete (using CCD_DSP_Command_Wait_Readout_Progress) rather than sleeping during readout.</dd>
+ * <dt>Frame_List</dt> <dd>The image buffer pool, a list of frames that post-readout processing writes the 
+ * 	final images into. Only the first frame is used when saving synchronously.</dd>
+ * <dt>Async_Save</dt> <dd>A boolean, if TRUE CCD_Exposure_Expose queues the processed frame for the FITS writer
+ * 	thread and returns, rather than saving it itself.</dd>
+ * <dt>Save_Callback</dt> <dd>A function called by the FITS writer thread after each image is saved 
+ * 	(or fails to save), or NULL.</dd>
+ * <dt>Writer_Thread</dt> <dd>The FITS writer thread, which saves queued frames.</dd>
+ * <dt>Writer_Running</dt> <dd>A boolean, TRUE if the FITS writer thread has been started.</dd>
+ * <dt>Writer_Quit</dt> <dd>A boolean, set to TRUE to tell the FITS writer thread to exit once the queue is empty.</dd>
+ * <dt>Writer_Mutex</dt> <dd>Mutex protecting the frame In_Use flags and the writer queue.</dd>
+ * <dt>Writer_Condition</dt> <dd>Condition variable, signalled when a frame is queued, when a frame has been saved 
+ * 	and when the writer thread is told to quit.</dd>
+ * <dt>Writer_Queue</dt> <dd>A ring buffer of Frame_List indexes waiting to be saved, in exposure order.</dd>
+ * <dt>Writer_Queue_Head</dt> <dd>The index in Writer_Queue of the next frame to save.</dd>
+ * <dt>Writer_Queue_Count</dt> <dd>The number of frames in Writer_Queue.</dd>
+ * <dt>Writer_Pending_Count</dt> <dd>The number of frames queued or being saved by the FITS writer thread.</dd>
+ * <dt>Writer_Failed_Count</dt> <dd>The number of images the FITS writer thread has failed to save since the 
+ * 	last call to CCD_Exposure_Save_Wait.</dd>
+ * <dt>Writer_Class</dt> <dd>The class the FITS writer thread logs with.</dd>
+ * <dt>Writer_Source</dt> <dd>The source the FITS writer thread logs with.</dd>
+ * <dt>Stage_Time_List</dt> <dd>The time taken by each stage of the last call to CCD_Exposure_Expose, 
+ * 	in milliseconds, indexed by CCD_EXPOSURE_STAGE. Stages that were not reached are -1.0.</dd>
+ * <dt>Readout_Pixel_Rate</dt> <dd>The readout rate measured at the end of the last readout, in pixels per
+ * 	millisecond, or 0.0 if no readout has been measured. Used to predict when a readout will finish.</dd>
+ * <dt>Status_Sequence</dt> <dd>The sequence count of the Status_Snapshot seqlock. It is odd whilst 
+ * 	the snapshot is being updated, and is incremented again when the update is complete.</dd>
+ * <dt>Status_Snapshot</dt> <dd>The copy of the exposure status published for other threads to read, without
+ * 	taking any locks, see CCD_Exposure_Get_Status_Snapshot. The exposure thread updates it whenever 
+ * 	Exposure_Status, Exposure_Length or Exposure_Start_Time change, and each time the exposure is polled.</dd>
  * </dl>
+ * @see #CCD_Exposure_Frame_Struct
+ * @see #CCD_EXPOSURE_FRAME_COUNT
+ * @see ccd_exposure.html#CCD_Exposure_Buffer_Pool_Allocate
+ * @see ccd_exposure.html#CCD_Exposure_Set_Async_Save
  * @see ccd_exposure.html#CCD_EXPOSURE_STATUS
+ * @see ccd_exposure.html#CCD_EXPOSURE_STAGE
+ * @see ccd_exposure.html#CCD_Exposure_Status_Struct
+ * @see ccd_exposure.html#CCD_Exposure_Get_Status_Snapshot
  */
 struct CCD_Exposure_Struct
 {
@@ -32,6 +126,32 @@ struct CCD_Exposure_Struct
 	int Readout_Remaining_Time;
 	int Exposure_Length;
 	struct timespec Exposure_Start_Time;
+	struct timespec Start_Exposure_Send_Time;
+	int Start_Exposure_Latency;
+	int Start_Exposure_Latency_Count;
+	int Start_Exposure_Measured;
+	int Streaming_Readout;
+	int Readout_Progress_Wait;
+	struct CCD_Exposure_Frame_Struct Frame_List[CCD_EXPOSURE_FRAME_COUNT];
+	int Async_Save;
+	void (*Save_Callback)(struct CCD_Interface_Handle_Struct *handle,char *filename,int successful,
+			      char *error_string);
+	pthread_t Writer_Thread;
+	int Writer_Running;
+	int Writer_Quit;
+	pthread_mutex_t Writer_Mutex;
+	pthread_cond_t Writer_Condition;
+	int Writer_Queue[CCD_EXPOSURE_FRAME_COUNT];
+	int Writer_Queue_Head;
+	int Writer_Queue_Count;
+	int Writer_Pending_Count;
+	int Writer_Failed_Count;
+	char Writer_Class[CCD_EXPOSURE_STRING_LENGTH];
+	char Writer_Source[CCD_EXPOSURE_STRING_LENGTH];
+	double Stage_Time_List[CCD_EXPOSURE_STAGE_COUNT];
+	double Readout_Pixel_Rate;
+	volatile unsigned int Status_Sequence;
+	struct CCD_Exposure_Status_Struct Status_Snapshot;
 };
 
 
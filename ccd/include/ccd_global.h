@@ -4,6 +4,7 @@
 
 #ifndef CCD_GLOBAL_H
 #define CCD_GLOBAL_H
+#include <time.h> /* struct timespec */
 #include "ccd_interface.h"
 
 /* hash defines */
@@ -52,12 +53,106 @@
  * The number of nanoseconds in one microsecond.
  */
 #define CCD_GLOBAL_ONE_MICROSECOND_NS	(1000)
+/**
+ * Storage class specifier used for each module's error number and error string. These are thread local
+ * where the compiler supports it, so each thread (e.g. the threads driving the red and blue arms through
+ * their own interface handles) sees only the errors it generated, and one arm failing cannot overwrite
+ * the error the other arm is reporting. It can be overridden on the compile line 
+ * (-DCCD_GLOBAL_THREAD_LOCAL= restores process wide error state).
+ */
+#ifndef CCD_GLOBAL_THREAD_LOCAL
+#if defined(__GNUC__) || defined(__SUNPRO_C)
+#define CCD_GLOBAL_THREAD_LOCAL		__thread
+#else
+#define CCD_GLOBAL_THREAD_LOCAL
+#endif
+#endif
+
+/**
+ * The number of ioctl requests the metrics are kept for. One for each CCD_PCI_IOCTL_* request, plus one
+ * for any other request.
+ * @see #CCD_Global_Metrics_Get_Ioctl
+ * @see ccd_pci.html#CCD_PCI_IOCTL_GET_HCTR
+ */
+#define CCD_GLOBAL_METRICS_IOCTL_COUNT	(16)
+
+/**
+ * The timers kept in the per-handle metrics. Each timer records the number of times it has been added to,
+ * and the total and maximum time, in nanoseconds.
+ * <ul>
+ * <li>CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT - Time spent waiting to lock the controller access mutex.
+ * <li>CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_HOLD - Time the controller access mutex was held for.
+ * <li>CCD_GLOBAL_METRICS_TIMER_READOUT - Time from the readout being detected until all pixels were read out.
+ * <li>CCD_GLOBAL_METRICS_TIMER_DEINTERLACE - Time spent byte swapping and de-interlacing read out data.
+ * <li>CCD_GLOBAL_METRICS_TIMER_SAVE - Time spent saving images to disk (in the FITS writer thread
+ * 	if saving asynchronously).
+ * <li>CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_HOUSEKEEPING - Time housekeeping commands (temperature and voltage reads)
+ * 	spent waiting to lock the controller access mutex.
+ * <li>CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_NORMAL - Time other commands spent waiting to lock the
+ * 	controller access mutex.
+ * <li>CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_EXPOSURE - Time exposure control commands spent waiting to lock the
+ * 	controller access mutex.
+ * </ul>
+ * The three DSP_WAIT timers must stay in priority order, as ccd_dsp.c indexes them by priority.
+ * @see #CCD_Global_Metrics_Timer_Add
+ * @see #CCD_Global_Metrics_Get_Timer
+ * @see #CCD_GLOBAL_METRICS_TIMER_COUNT
+ */
+enum CCD_GLOBAL_METRICS_TIMER
+{
+	CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT=0,CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_HOLD=1,
+	CCD_GLOBAL_METRICS_TIMER_READOUT=2,CCD_GLOBAL_METRICS_TIMER_DEINTERLACE=3,
+	CCD_GLOBAL_METRICS_TIMER_SAVE=4,CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_HOUSEKEEPING=5,
+	CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_NORMAL=6,CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_EXPOSURE=7
+};
+
+/**
+ * The number of timers in CCD_GLOBAL_METRICS_TIMER.
+ * @see #CCD_GLOBAL_METRICS_TIMER
+ */
+#define CCD_GLOBAL_METRICS_TIMER_COUNT	(8)
+
+/**
+ * Macro to check whether the metrics timer is a legal value.
+ * @see #CCD_GLOBAL_METRICS_TIMER
+ */
+#define CCD_GLOBAL_METRICS_IS_TIMER(timer)	(((timer) >= CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT)&& \
+	((timer) < CCD_GLOBAL_METRICS_TIMER_COUNT))
+
+/**
+ * The counters kept in the per-handle metrics.
+ * <ul>
+ * <li>CCD_GLOBAL_METRICS_COUNTER_READOUT_BYTES - The number of bytes successfully read out from the controller.
+ * <li>CCD_GLOBAL_METRICS_COUNTER_READOUT_TIMEOUTS - The number of readouts that timed out.
+ * </ul>
+ * @see #CCD_Global_Metrics_Counter_Add
+ * @see #CCD_Global_Metrics_Get_Counter
+ * @see #CCD_GLOBAL_METRICS_COUNTER_COUNT
+ */
+enum CCD_GLOBAL_METRICS_COUNTER
+{
+	CCD_GLOBAL_METRICS_COUNTER_READOUT_BYTES=0,CCD_GLOBAL_METRICS_COUNTER_READOUT_TIMEOUTS=1
+};
+
+/**
+ * The number of counters in CCD_GLOBAL_METRICS_COUNTER.
+ * @see #CCD_GLOBAL_METRICS_COUNTER
+ */
+#define CCD_GLOBAL_METRICS_COUNTER_COUNT	(2)
+
+/**
+ * Macro to check whether the metrics counter is a legal value.
+ * @see #CCD_GLOBAL_METRICS_COUNTER
+ */
+#define CCD_GLOBAL_METRICS_IS_COUNTER(counter)	(((counter) >= CCD_GLOBAL_METRICS_COUNTER_READOUT_BYTES)&& \
+	((counter) < CCD_GLOBAL_METRICS_COUNTER_COUNT))
 
 /* external functions */
 
 extern void CCD_Global_Initialise(void);
 extern void CCD_Global_Error(void);
 extern void CCD_Global_Error_String(char *error_string);
+extern int CCD_Global_Get_Error_Number(void);
 
 /* routine used by other modules error code */
 extern void CCD_Global_Get_Current_Time_String(char *time_string,int string_length);
@@ -71,6 +166,9 @@ extern void CCD_Global_Log_Handler_Stdout(char *class,char *source,int level,cha
 extern void CCD_Global_Set_Log_Filter_Level(int level);
 extern int CCD_Global_Log_Filter_Level_Absolute(char *class,char *source,int level,char *string);
 extern int CCD_Global_Log_Filter_Level_Bitwise(char *class,char *source,int level,char *string);
+extern int CCD_Global_Log_Ring_Start(void);
+extern int CCD_Global_Log_Ring_Stop(void);
+extern int CCD_Global_Log_Ring_Get_Dropped_Count(void);
 
 /* readout process priority and memory locking */
 extern int CCD_Global_Increase_Priority(char *class,char *source);
@@ -80,4 +178,20 @@ extern int CCD_Global_Memory_UnLock(char *class,char *source,unsigned short *ima
 extern int CCD_Global_Memory_Lock_All(char *class,char *source);
 extern int CCD_Global_Memory_UnLock_All(char *class,char *source);
 
+/* per-handle metrics */
+extern void CCD_Global_Metrics_Initialise(CCD_Interface_Handle_T *handle);
+extern void CCD_Global_Metrics_Get_Time(struct timespec *current_time);
+extern void CCD_Global_Metrics_Ioctl_Add(CCD_Interface_Handle_T *handle,int request,struct timespec start_time);
+extern void CCD_Global_Metrics_Timer_Add(CCD_Interface_Handle_T *handle,enum CCD_GLOBAL_METRICS_TIMER timer,
+					 struct timespec start_time);
+extern void CCD_Global_Metrics_Counter_Add(CCD_Interface_Handle_T *handle,enum CCD_GLOBAL_METRICS_COUNTER counter,
+					   long long value);
+extern int CCD_Global_Metrics_Get_Ioctl(CCD_Interface_Handle_T *handle,int index,int *request,long long *count,
+					long long *total_ns,long long *max_ns);
+extern int CCD_Global_Metrics_Get_Timer(CCD_Interface_Handle_T *handle,enum CCD_GLOBAL_METRICS_TIMER timer,
+					long long *count,long long *total_ns,long long *max_ns);
+extern long long CCD_Global_Metrics_Get_Counter(CCD_Interface_Handle_T *handle,
+						enum CCD_GLOBAL_METRICS_COUNTER counter);
+extern double CCD_Global_Metrics_Get_Readout_Rate(CCD_Interface_Handle_T *handle);
+
 #endif
@@ -0,0 +1,51 @@
+/* ccd_global_private.h
+** $Header$
+*/
+
+#ifndef CCD_GLOBAL_PRIVATE_H
+#define CCD_GLOBAL_PRIVATE_H
+#include "ccd_global.h" /* CCD_GLOBAL_METRICS_*_COUNT declarations */
+
+/**
+ * Data type holding the count, total and maximum time of one timed operation. All times are in nanoseconds.
+ * The fields are only updated with atomic operations, so they can be added to from more than one thread
+ * (e.g. the thread driving the exposure and the FITS writer thread).
+ * <dl>
+ * <dt>Count</dt> <dd>The number of times the operation has been timed.</dd>
+ * <dt>Total_NS</dt> <dd>The total time of all the timed operations.</dd>
+ * <dt>Max_NS</dt> <dd>The longest time any one operation took.</dd>
+ * </dl>
+ */
+struct CCD_Global_Metrics_Timer_Struct
+{
+	long long Count;
+	long long Total_NS;
+	long long Max_NS;
+};
+
+/**
+ * Data type used to hold the per-handle metrics, see ccd_global.c. Fields are:
+ * <dl>
+ * <dt>Ioctl_List</dt> <dd>The count and latency of each type of ioctl request sent to the device, indexed as
+ *     described in CCD_Global_Metrics_Get_Ioctl.</dd>
+ * <dt>Timer_List</dt> <dd>The timers, indexed by CCD_GLOBAL_METRICS_TIMER.</dd>
+ * <dt>Counter_List</dt> <dd>The counters, indexed by CCD_GLOBAL_METRICS_COUNTER.</dd>
+ * </dl>
+ * @see #CCD_Global_Metrics_Timer_Struct
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_IOCTL_COUNT
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_TIMER
+ * @see ccd_global.html#CCD_GLOBAL_METRICS_COUNTER
+ * @see ccd_global.html#CCD_Global_Metrics_Get_Ioctl
+ */
+struct CCD_Global_Metrics_Struct
+{
+	struct CCD_Global_Metrics_Timer_Struct Ioctl_List[CCD_GLOBAL_METRICS_IOCTL_COUNT];
+	struct CCD_Global_Metrics_Timer_Struct Timer_List[CCD_GLOBAL_METRICS_TIMER_COUNT];
+	long long Counter_List[CCD_GLOBAL_METRICS_COUNTER_COUNT];
+};
+
+#endif
+
+/*
+** $Log$
+*/
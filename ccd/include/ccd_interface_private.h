@@ -6,9 +6,11 @@
 #define CCD_INTERFACE_PRIVATE_H
 #include "ccd_pci.h"
 #include "ccd_text.h"
+#include "ccd_global_private.h"
 #include "ccd_dsp_private.h"
 #include "ccd_exposure_private.h"
 #include "ccd_setup_private.h"
+#include "ccd_temperature_private.h"
 
 /**
  * Structure containing handle data.
@@ -22,6 +24,9 @@
  * <dt>DSP_Data</dt> <dd>Data type used to hold local data to ccd_dsp.</dd>
  * <dt>Setup_Data</dt> <dd>Data type used to hold local data to ccd_setup.</dd>
  * <dt>Exposure_Data</dt> <dd>Structure used to hold local data to ccd_exposure.</dd>
+ * <dt>Temperature_Data</dt> <dd>Structure used to hold local data to ccd_temperature (calibration and
+ *     temperature sampler).</dd>
+ * <dt>Metrics_Data</dt> <dd>Structure used to hold the per-handle metrics kept by ccd_global.</dd>
  * </dl>
  * @see #CCD_INTERFACE_DEVICE_ID
  * @see ccd_pci.html#CCD_PCI_Handle_T
@@ -29,6 +34,8 @@
  * @see ccd_dsp_private.html#CCD_DSP_Struct
  * @see ccd_setup_private.html#CCD_Setup_Struct
  * @see ccd_exposure_private.html#CCD_Exposure_Struct
+ * @see ccd_temperature_private.html#CCD_Temperature_Struct
+ * @see ccd_global_private.html#CCD_Global_Metrics_Struct
  */
 struct CCD_Interface_Handle_Struct
 {
@@ -41,6 +48,8 @@ struct CCD_Interface_Handle_Struct
 	struct CCD_DSP_Struct DSP_Data;
 	struct CCD_Setup_Struct Setup_Data;
 	struct CCD_Exposure_Struct Exposure_Data;
+	struct CCD_Temperature_Struct Temperature_Data;
+	struct CCD_Global_Metrics_Struct Metrics_Data;
 };
 
 /*
@@ -5,10 +5,22 @@
 #define CCD_TEMPERATURE_H
 #include "ccd_interface.h"
 
+/**
+ * The maximum number of Chebychev coefficients used to calculate the temperature from a sensor voltage.
+ * @see #CCD_Temperature_Set_Calibration
+ */
+#define CCD_TEMPERATURE_COEFF_COUNT			(11)
+
+extern void CCD_Temperature_Data_Initialise(CCD_Interface_Handle_T* handle);
 extern int CCD_Temperature_Get(char *class,char *source,CCD_Interface_Handle_T* handle,double *temperature);
 extern int CCD_Temperature_Get_Utility_Board_ADU(char *class,char *source,CCD_Interface_Handle_T* handle,int *adu);
 extern int CCD_Temperature_Set(char *class,char *source,CCD_Interface_Handle_T* handle,double target_temperature);
 extern int CCD_Temperature_Get_Heater_ADU(char *class,char *source,CCD_Interface_Handle_T* handle,int *heater_adu);
+extern int CCD_Temperature_Set_Calibration(char *class,char *source,CCD_Interface_Handle_T* handle,int coeff_count,
+					   double *coeff_list,double v_upper,double v_lower,double adu_per_volt,
+					   int adu_offset);
+extern int CCD_Temperature_Sampler_Start(char *class,char *source,CCD_Interface_Handle_T* handle,int sample_period);
+extern int CCD_Temperature_Sampler_Stop(char *class,char *source,CCD_Interface_Handle_T* handle);
 extern int CCD_Temperature_Get_Error_Number(void);
 extern void CCD_Temperature_Error(void);
 extern void CCD_Temperature_Error_String(char *error_string);
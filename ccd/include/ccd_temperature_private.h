@@ -0,0 +1,87 @@
+/* ccd_temperature_private.h
+** $Header$
+*/
+
+#ifndef CCD_TEMPERATURE_PRIVATE_H
+#define CCD_TEMPERATURE_PRIVATE_H
+#include <pthread.h>
+#include <time.h>
+#include "ccd_temperature.h" /* CCD_TEMPERATURE_COEFF_COUNT declaration */
+
+/**
+ * The number of utility board ADU samples the temperature sampler keeps, and averages over, 
+ * when calculating the temperature.
+ */
+#define CCD_TEMPERATURE_SAMPLE_COUNT		(30)
+/**
+ * The maximum length of the class and source strings the temperature sampler logs with.
+ */
+#define CCD_TEMPERATURE_STRING_LENGTH		(64)
+
+/**
+ * Data type holding the numerical constants neccessary to calculate temperatures for a particular 
+ * temperature sensor connected to the system. Fields are:
+ * <dl>
+ * <dt>Temp_Coeff_Count</dt> <dd>The number of Chebychev coefficients used.</dd>
+ * <dt>V_Upper</dt> <dd>The upper voltage limit of the sensor.</dd>
+ * <dt>V_Lower</dt> <dd>The lower voltage limit of the sensor.</dd>
+ * <dt>Adu_Per_Volt</dt> <dd>The number of ADU's per volt.</dd>
+ * <dt>Adu_Offset</dt> <dd>The offset to add to the ADU.</dd>
+ * <dt>Temp_Coeff</dt> <dd>The Chebychev coefficients.</dd>
+ * </dl>
+ * @see ccd_temperature.html#CCD_TEMPERATURE_COEFF_COUNT
+ */
+struct CCD_Temperature_Calibration_Struct
+{
+	int	Temp_Coeff_Count;
+	float	V_Upper;
+	float	V_Lower;
+	float	Adu_Per_Volt;
+	int	Adu_Offset;
+	float	Temp_Coeff[CCD_TEMPERATURE_COEFF_COUNT];
+};
+
+/**
+ * Data type used to hold local data to ccd_temperature, for each controller. Fields are:
+ * <dl>
+ * <dt>Calibration</dt> <dd>The calibration data of this controller's dewar temperature sensor.</dd>
+ * <dt>Sample_Mutex</dt> <dd>Mutex protecting the calibration data and the sample ring.</dd>
+ * <dt>Sample_Condition</dt> <dd>Condition variable the sampler waits on between samples, signalled to stop it.</dd>
+ * <dt>Sampler_Thread</dt> <dd>The temperature sampler thread, if Sampler_Running is TRUE.</dd>
+ * <dt>Sampler_Running</dt> <dd>A boolean, TRUE if the sampler thread has been started.</dd>
+ * <dt>Sampler_Quit</dt> <dd>A boolean, set to TRUE to tell the sampler thread to exit.</dd>
+ * <dt>Sample_Period</dt> <dd>The time between samples, in milliseconds.</dd>
+ * <dt>Sample_List</dt> <dd>A ring of the last CCD_TEMPERATURE_SAMPLE_COUNT dewar temperature ADUs.</dd>
+ * <dt>Sample_Index</dt> <dd>The index in Sample_List the next sample is put into.</dd>
+ * <dt>Sample_Count</dt> <dd>The number of valid samples in Sample_List.</dd>
+ * <dt>Sample_Sum</dt> <dd>The sum of the valid samples in Sample_List.</dd>
+ * <dt>Sample_Time</dt> <dd>The time the last sample was taken.</dd>
+ * <dt>Sampler_Class</dt> <dd>A copy of the class the sampler logs with.</dd>
+ * <dt>Sampler_Source</dt> <dd>A copy of the source the sampler logs with.</dd>
+ * </dl>
+ * @see #CCD_Temperature_Calibration_Struct
+ * @see #CCD_TEMPERATURE_SAMPLE_COUNT
+ * @see #CCD_TEMPERATURE_STRING_LENGTH
+ */
+struct CCD_Temperature_Struct
+{
+	struct CCD_Temperature_Calibration_Struct Calibration;
+	pthread_mutex_t Sample_Mutex;
+	pthread_cond_t Sample_Condition;
+	pthread_t Sampler_Thread;
+	int Sampler_Running;
+	int Sampler_Quit;
+	int Sample_Period;
+	int Sample_List[CCD_TEMPERATURE_SAMPLE_COUNT];
+	int Sample_Index;
+	int Sample_Count;
+	int Sample_Sum;
+	struct timespec Sample_Time;
+	char Sampler_Class[CCD_TEMPERATURE_STRING_LENGTH];
+	char Sampler_Source[CCD_TEMPERATURE_STRING_LENGTH];
+};
+
+/*
+** $Log$
+*/
+#endif
@@ -6,6 +6,7 @@
 #define CCD_TEXT_H
 
 #include <sys/types.h>
+#include "ccd_dsp.h" /* enum CCD_DSP_AMPLIFIER declaration */
 
 /* These enum definitions should match with those in CCDLibrary.java */
 /**
@@ -31,6 +32,13 @@ enum CCD_TEXT_PRINT_LEVEL
 	((level) == CCD_TEXT_PRINT_LEVEL_REPLIES)||((level) == CCD_TEXT_PRINT_LEVEL_VALUES)|| \
 	((level) == CCD_TEXT_PRINT_LEVEL_ALL))
 
+/**
+ * The maximum X and Y binning factor the text device has separately configurable pixel rates for.
+ * Readouts binned more than this use the rate configured for this binning factor.
+ * @see #CCD_Text_Set_Pixel_Rate
+ */
+#define CCD_TEXT_MAX_BINNING			(4)
+
 /**
  * Typedef for the text handle pointer, which is an instance of CCD_Text_Handle_Struct.
  * @see #CCD_Text_Handle_Struct
@@ -40,6 +48,9 @@ typedef struct CCD_Text_Handle_Struct CCD_Text_Handle_T;
 
 /* configuration of this device interface */
 extern void CCD_Text_Set_Print_Level(enum CCD_TEXT_PRINT_LEVEL level);
+extern int CCD_Text_Set_Pixel_Rate(CCD_Interface_Handle_T *handle,enum CCD_DSP_AMPLIFIER amplifier,int nsbin,int npbin,
+				   int pixel_rate);
+extern int CCD_Text_Set_Command_Delay(CCD_Interface_Handle_T *handle,int delay_ms);
 
 /* implementation of device interface */
 extern void CCD_Text_Initialise(void);
@@ -0,0 +1,366 @@
+/* test_deinterlace.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+
+/**
+ * This program tests CCD_Exposure_DeInterlace against a reference implementation of the original
+ * de-interlacing algorithms. Random raw images of various sizes are de-interlaced using every
+ * de-interlace type, with and without byte swapping, and every de-interlace kernel supported by this CPU.
+ * Each result is compared pixel by pixel to the reference image.
+ * <pre>
+ * test_deinterlace [-s[eed] &lt;n&gt;] [-h[elp]]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The number of image sizes in the Test_Size_List.
+ */
+#define TEST_SIZE_COUNT		(7)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The seed used to generate the random raw image data.
+ */
+static unsigned int Seed = 42;
+/**
+ * The list of {ncols,nrows} image sizes to test. These include sizes that are not a multiple of the
+ * SIMD vector lengths, and odd sizes (which the split readouts reject).
+ */
+static int Test_Size_List[TEST_SIZE_COUNT][2] =
+{
+	{2,2},{8,4},{16,2},{34,6},{70,10},{2154,24},{33,7}
+};
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Test_DeInterlace(enum CCD_EXPOSURE_DEINTERLACE_KERNEL kernel,int ncols,int nrows,
+			    enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,int byte_swap);
+static int Reference_DeInterlace(int ncols,int nrows,unsigned short *old_iptr,unsigned short *new_iptr,
+				 enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type);
+static void Reference_Byte_Swap(unsigned short *svalues,int nvals);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Seed
+ * @see #Test_Size_List
+ * @see #Test_DeInterlace
+ */
+int main(int argc, char *argv[])
+{
+	enum CCD_EXPOSURE_DEINTERLACE_KERNEL kernel;
+	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
+	int size_index,byte_swap,test_count,fail_count;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_deinterlace:%s.\n",rcsid);
+	fprintf(stdout,"Using seed %u.\n",Seed);
+	srand(Seed);
+	CCD_Exposure_Initialise();
+	test_count = 0;
+	fail_count = 0;
+	for(kernel = CCD_EXPOSURE_DEINTERLACE_KERNEL_SCALAR; kernel <= CCD_EXPOSURE_DEINTERLACE_KERNEL_AVX2; kernel++)
+	{
+		if(!CCD_Exposure_DeInterlace_Kernel_Supported(kernel))
+		{
+			fprintf(stdout,"Kernel %d not supported:skipping.\n",kernel);
+			continue;
+		}
+		for(size_index = 0; size_index < TEST_SIZE_COUNT; size_index++)
+		{
+			for(deinterlace_type = CCD_DSP_DEINTERLACE_SINGLE;
+			    deinterlace_type <= CCD_DSP_DEINTERLACE_SPLIT_QUAD; deinterlace_type++)
+			{
+				for(byte_swap = FALSE; byte_swap <= TRUE; byte_swap++)
+				{
+					test_count++;
+					if(!Test_DeInterlace(kernel,Test_Size_List[size_index][0],
+							     Test_Size_List[size_index][1],deinterlace_type,byte_swap))
+						fail_count++;
+				}
+			}
+		}
+	}
+	fprintf(stdout,"%d tests run, %d failed.\n",test_count,fail_count);
+	if(fail_count > 0)
+		return 2;
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Seed
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-seed")==0)||(strcmp(argv[i],"-s")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%u",&Seed);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing seed %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Seed requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test De-Interlace:Help.\n");
+	fprintf(stdout,"This program compares CCD_Exposure_DeInterlace to a reference de-interlace.\n");
+	fprintf(stdout,"test_deinterlace [-s[eed] <n>] [-h[elp]]\n");
+	fprintf(stdout,"\t-seed sets the random number seed used to generate the raw images.\n");
+}
+
+/**
+ * Test one de-interlace configuration. A raw image of random data is generated, and de-interlaced
+ * using CCD_Exposure_DeInterlace with the specified kernel. A copy is de-interlaced using
+ * Reference_DeInterlace (and Reference_Byte_Swap if byte_swap is TRUE). The two images are compared.
+ * If the split readout requires an even number of rows or columns, and this size does not have them,
+ * CCD_Exposure_DeInterlace is expected to fail.
+ * @param kernel Which kernel to test.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param deinterlace_type The type of de-interlacing to test.
+ * @param byte_swap Whether to byte swap the pixels whilst de-interlacing.
+ * @return The routine returns TRUE if the test passed, and FALSE if it failed.
+ * @see #Reference_DeInterlace
+ * @see #Reference_Byte_Swap
+ */
+static int Test_DeInterlace(enum CCD_EXPOSURE_DEINTERLACE_KERNEL kernel,int ncols,int nrows,
+			    enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,int byte_swap)
+{
+	unsigned short *raw_data = NULL;
+	unsigned short *reference_data = NULL;
+	unsigned short *image_data = NULL;
+	int i,expect_success,retval,pixel_count;
+
+	pixel_count = ncols*nrows;
+	raw_data = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+	reference_data = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+	image_data = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+	if((raw_data == NULL)||(reference_data == NULL)||(image_data == NULL))
+	{
+		fprintf(stderr,"Test_DeInterlace:Memory allocation failed (%d,%d).\n",ncols,nrows);
+		if(raw_data != NULL)
+			free(raw_data);
+		if(reference_data != NULL)
+			free(reference_data);
+		if(image_data != NULL)
+			free(image_data);
+		return FALSE;
+	}
+	for(i=0;i<pixel_count;i++)
+	{
+		raw_data[i] = (unsigned short)(rand()&0xffff);
+	}
+	expect_success = Reference_DeInterlace(ncols,nrows,raw_data,reference_data,deinterlace_type);
+	if(byte_swap)
+		Reference_Byte_Swap(reference_data,pixel_count);
+	if(!CCD_Exposure_Set_DeInterlace_Kernel(kernel))
+	{
+		CCD_Exposure_Error();
+		free(raw_data);
+		free(reference_data);
+		free(image_data);
+		return FALSE;
+	}
+	retval = CCD_Exposure_DeInterlace("test_deinterlace","-",ncols,nrows,raw_data,image_data,deinterlace_type,
+					  byte_swap);
+	if(retval != expect_success)
+	{
+		fprintf(stdout,"FAIL:kernel %d,size (%d,%d),type %d,byte swap %d:returned %d, expected %d.\n",
+			kernel,ncols,nrows,deinterlace_type,byte_swap,retval,expect_success);
+		if(retval == FALSE)
+			CCD_Exposure_Error();
+		free(raw_data);
+		free(reference_data);
+		free(image_data);
+		return FALSE;
+	}
+	if(retval == TRUE)
+	{
+		for(i=0;i<pixel_count;i++)
+		{
+			if(image_data[i] != reference_data[i])
+			{
+				fprintf(stdout,"FAIL:kernel %d,size (%d,%d),type %d,byte swap %d:"
+					"pixel (%d,%d) was %#x, expected %#x.\n",kernel,ncols,nrows,deinterlace_type,
+					byte_swap,i%ncols,i/ncols,image_data[i],reference_data[i]);
+				free(raw_data);
+				free(reference_data);
+				free(image_data);
+				return FALSE;
+			}
+		}
+	}
+	fprintf(stdout,"PASS:kernel %d,size (%d,%d),type %d,byte swap %d.\n",kernel,ncols,nrows,deinterlace_type,
+		byte_swap);
+	free(raw_data);
+	free(reference_data);
+	free(image_data);
+	return TRUE;
+}
+
+/**
+ * The reference de-interlace routine. This uses the pixel by pixel algorithms of the original ccd_exposure
+ * Exposure_DeInterlace routine, de-interlacing old_iptr into new_iptr.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param old_iptr The interlaced image data.
+ * @param new_iptr Where to put the de-interlaced image data.
+ * @param deinterlace_type The type of deinterlacing to perform.
+ * @return TRUE if the image was de-interlaced, FALSE if the image had an odd number of rows or columns
+ *         for a split readout that does not allow it.
+ */
+static int Reference_DeInterlace(int ncols,int nrows,unsigned short *old_iptr,unsigned short *new_iptr,
+				 enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type)
+{
+	switch(deinterlace_type)
+	{
+		case CCD_DSP_DEINTERLACE_SINGLE:
+		{
+			memcpy(new_iptr,old_iptr,ncols*nrows*sizeof(unsigned short));
+			return TRUE;
+		}
+		case CCD_DSP_DEINTERLACE_FLIP:
+		{
+			int x,y;
+
+			for(y=0;y<nrows;y++)
+			{
+				for(x=0;x<ncols;x++)
+				{
+					*(new_iptr+(y*ncols)+x) = *(old_iptr+(y*ncols)+(ncols-(x+1)));
+				}
+			}
+			return TRUE;
+		}
+		case CCD_DSP_DEINTERLACE_SPLIT_PARALLEL:
+		{
+			int i;
+
+			if(((float)nrows/2) != (int)nrows/2)
+				return FALSE;
+			for(i=0;i<(ncols*nrows)/2;i++)
+			{
+				*(new_iptr+i) = *(old_iptr+(2*i));
+				*(new_iptr+(ncols*nrows)-i-1) = *(old_iptr+(2*i)+1);
+			}
+			return TRUE;
+		}
+		case CCD_DSP_DEINTERLACE_SPLIT_SERIAL:
+		{
+			int i,j,p1,p2,begin,end;
+
+			if ((float)ncols/2 != (int)ncols/2)
+				return FALSE;
+			for (i=0;i<nrows;i++)
+			{
+				p1      = i*ncols+0;
+				p2      = i*ncols+1;
+				begin   = i*ncols+0;
+				end     = i*ncols+ncols-1;
+				for(j=0;j<ncols;j+=2)
+                		{
+                			*(new_iptr+begin) = *(old_iptr+p1);
+                			*(new_iptr+end) = *(old_iptr+p2);
+                			++begin;
+                			--end;
+                			p1+=2;
+                			p2+=2;
+                		}
+                	}
+			return TRUE;
+		}
+		case CCD_DSP_DEINTERLACE_SPLIT_QUAD:
+		{
+			int i=0,j=0,counter=0,end=0,begin=0;
+
+			if((float)ncols/2 != (int)ncols/2 || (float)nrows/2 != (int)nrows/2)
+				return FALSE;
+			while(i<ncols*nrows)
+			{
+				if(counter%(ncols/2) == 0)
+				{
+					end     = (ncols*nrows)-(ncols*j)-1;
+					begin   = (ncols*j)+0;
+					j++;
+					counter=0;
+				}
+				*(new_iptr+begin+counter)       = *(old_iptr+i++);
+				*(new_iptr+begin+ncols-1-counter)   = *(old_iptr+i++);
+				*(new_iptr+end-counter)         = *(old_iptr+i++);
+				*(new_iptr+end-ncols+1+counter)     = *(old_iptr+i++);
+				counter++;
+			}
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * The reference byte swap routine.
+ * @param svalues A list of unsigned short values to byte swap.
+ * @param nvals The number of values in svalues.
+ */
+static void Reference_Byte_Swap(unsigned short *svalues,int nvals)
+{
+	int i;
+
+	for(i=0;i<nvals;i++)
+		svalues[i] = (unsigned short)(((svalues[i]&0xff)<<8)|((svalues[i]>>8)&0xff));
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
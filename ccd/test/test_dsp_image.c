@@ -0,0 +1,379 @@
+/* test_dsp_image.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ccd_global.h"
+#include "ccd_dsp.h"
+#include "ccd_dsp_download.h"
+
+/**
+ * This program tests the libfrodospec_ccd DSP image cache and binary image format.
+ * A timing board .lod file is compiled into a binary image (CCD_DSP_Download_Image_Compile), and the checksum
+ * and word count of the .lod file and the binary image compared. A corrupted copy of the binary image is then
+ * checked to make sure it is rejected. Finally the time taken to load the .lod file is printed, both with
+ * the image cache emptied before each load and with the image cached.
+ * If no .lod file is specified, a test .lod file is generated.
+ * <pre>
+ * test_dsp_image [-l[od_filename] &lt;filename&gt;] [-o[utput_filename] &lt;filename&gt;] [-c[ount] &lt;n&gt;] [-h[elp]]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * Maximum length of some of the strings in this program.
+ */
+#define MAX_STRING_LENGTH	(256)
+/**
+ * The number of _DATA sections in the generated .lod file, below the boot code address.
+ */
+#define TEST_SECTION_COUNT	(8)
+/**
+ * The number of words in each _DATA section in the generated .lod file.
+ */
+#define TEST_SECTION_WORD_COUNT	(256)
+/**
+ * The number of words per line in the generated .lod file.
+ */
+#define TEST_WORDS_PER_LINE	(8)
+/**
+ * The number of words in the boot code section of the generated .lod file, which should not be in the image.
+ */
+#define TEST_BOOT_WORD_COUNT	(64)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The filename of the .lod file to compile.
+ */
+static char Lod_Filename[MAX_STRING_LENGTH] = "";
+/**
+ * The filename of the binary image file to write.
+ */
+static char Image_Filename[MAX_STRING_LENGTH] = "frodospec_ccd_test_dsp_image.img";
+/**
+ * The number of times to load the .lod file when timing.
+ */
+static int Load_Count = 100;
+
+/* internal routines */
+static int Write_Lod_File(char *filename,int *word_count);
+static int Corrupt_Image_File(char *filename,char *corrupt_filename);
+static double Time_Loads(int clear_cache);
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Lod_Filename
+ * @see #Image_Filename
+ * @see #Write_Lod_File
+ * @see #Corrupt_Image_File
+ * @see #Time_Loads
+ */
+int main(int argc, char *argv[])
+{
+	char corrupt_filename[MAX_STRING_LENGTH+16];
+	unsigned int lod_checksum,image_checksum;
+	int lod_word_count,image_word_count,expected_word_count = -1;
+
+	fprintf(stdout,"Parsing Arguments.\n");
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	CCD_Global_Initialise();
+	CCD_Global_Set_Log_Handler_Function(CCD_Global_Log_Handler_Stdout);
+	if(strlen(Lod_Filename) == 0)
+	{
+		strcpy(Lod_Filename,"frodospec_ccd_test_dsp_image.lod");
+		fprintf(stdout,"Generating test .lod file %s.\n",Lod_Filename);
+		if(!Write_Lod_File(Lod_Filename,&expected_word_count))
+			return 2;
+	}
+/* checksum .lod file */
+	if(!CCD_DSP_Download_Image_Get_Checksum("test_dsp_image","-",Lod_Filename,&lod_checksum,&lod_word_count))
+	{
+		CCD_Global_Error();
+		return 3;
+	}
+	fprintf(stdout,"%s:%d words:checksum %#x.\n",Lod_Filename,lod_word_count,lod_checksum);
+	if((expected_word_count >= 0)&&(lod_word_count != expected_word_count))
+	{
+		fprintf(stderr,"%s has %d words, expected %d.\n",Lod_Filename,lod_word_count,expected_word_count);
+		return 4;
+	}
+/* compile and checksum binary image */
+	if(!CCD_DSP_Download_Image_Compile("test_dsp_image","-",Lod_Filename,Image_Filename))
+	{
+		CCD_Global_Error();
+		return 5;
+	}
+	if(!CCD_DSP_Download_Image_Get_Checksum("test_dsp_image","-",Image_Filename,&image_checksum,
+						&image_word_count))
+	{
+		CCD_Global_Error();
+		return 6;
+	}
+	fprintf(stdout,"%s:%d words:checksum %#x.\n",Image_Filename,image_word_count,image_checksum);
+	if((image_checksum != lod_checksum)||(image_word_count != lod_word_count))
+	{
+		fprintf(stderr,"Binary image does not match .lod file.\n");
+		return 7;
+	}
+/* a corrupted binary image should be rejected */
+	sprintf(corrupt_filename,"%s.corrupt",Image_Filename);
+	if(!Corrupt_Image_File(Image_Filename,corrupt_filename))
+		return 8;
+	if(CCD_DSP_Download_Image_Get_Checksum("test_dsp_image","-",corrupt_filename,&image_checksum,
+					       &image_word_count))
+	{
+		fprintf(stderr,"Corrupted binary image %s was not rejected.\n",corrupt_filename);
+		return 9;
+	}
+	fprintf(stdout,"Corrupted binary image rejected with error %d.\n",CCD_DSP_Download_Get_Error_Number());
+	remove(corrupt_filename);
+/* time loading */
+	fprintf(stdout,"Load %s:%.3f ms per load.\n",Lod_Filename,Time_Loads(TRUE));
+	fprintf(stdout,"Load %s from image cache:%.3f ms per load.\n",Lod_Filename,Time_Loads(FALSE));
+	CCD_DSP_Download_Cache_Clear();
+	fprintf(stdout,"Test completed.\n");
+	return 0;
+}
+
+/**
+ * Write a timing board test .lod file. The file contains TEST_SECTION_COUNT _DATA sections alternating between
+ * the P, X and Y memory spaces, some of which are contiguous with the previous section, followed by a boot code
+ * section at address 0x4000.
+ * @param filename The filename to write.
+ * @param word_count The address of an integer to store the number of words that should be downloaded.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ * @see #TEST_SECTION_COUNT
+ * @see #TEST_SECTION_WORD_COUNT
+ * @see #TEST_WORDS_PER_LINE
+ * @see #TEST_BOOT_WORD_COUNT
+ */
+static int Write_Lod_File(char *filename,int *word_count)
+{
+	FILE *fp = NULL;
+	char mem_space_list[] = "PXY";
+	int i,j,address;
+
+	fp = fopen(filename,"w");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"Write_Lod_File:Failed to open %s.\n",filename);
+		return FALSE;
+	}
+	(*word_count) = 0;
+	fprintf(fp,"_START TIMBOOT 2.0 5.0 \n");
+	fprintf(fp,"\n");
+	for(i = 0; i < TEST_SECTION_COUNT; i++)
+	{
+		/* every other section in a memory space follows on from the previous one */
+		address = (i/6)*0x1000+((i/3)%2)*TEST_SECTION_WORD_COUNT;
+		fprintf(fp,"_DATA %c %04X\n",mem_space_list[i%3],address);
+		for(j = 0; j < TEST_SECTION_WORD_COUNT; j++)
+		{
+			fprintf(fp,"%06X",((i<<16)|j)&0xffffff);
+			if(((j+1)%TEST_WORDS_PER_LINE) == 0)
+				fprintf(fp," \n");
+			else
+				fprintf(fp," ");
+		}
+		(*word_count) += TEST_SECTION_WORD_COUNT;
+	}
+	fprintf(fp,"_DATA P 4000\n");
+	for(j = 0; j < TEST_BOOT_WORD_COUNT; j++)
+	{
+		fprintf(fp,"%06X",j);
+		if(((j+1)%TEST_WORDS_PER_LINE) == 0)
+			fprintf(fp," \n");
+		else
+			fprintf(fp," ");
+	}
+	fprintf(fp,"_SYMBOL P\n");
+	fprintf(fp,"_END 0000\n");
+	fclose(fp);
+	return TRUE;
+}
+
+/**
+ * Copy a binary image file, changing one of the program words.
+ * @param filename The filename of the binary image file to copy.
+ * @param corrupt_filename The filename of the corrupted copy to write.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ */
+static int Corrupt_Image_File(char *filename,char *corrupt_filename)
+{
+	FILE *fp = NULL;
+	unsigned char *buffer = NULL;
+	long byte_count;
+
+	fp = fopen(filename,"rb");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"Corrupt_Image_File:Failed to open %s.\n",filename);
+		return FALSE;
+	}
+	fseek(fp,0L,SEEK_END);
+	byte_count = ftell(fp);
+	rewind(fp);
+	buffer = (unsigned char *)malloc(byte_count);
+	if((buffer == NULL)||(byte_count < 1)||(fread(buffer,1,byte_count,fp) != byte_count))
+	{
+		fclose(fp);
+		if(buffer != NULL)
+			free(buffer);
+		fprintf(stderr,"Corrupt_Image_File:Failed to read %s.\n",filename);
+		return FALSE;
+	}
+	fclose(fp);
+	/* the last byte in the file is in the last program word */
+	buffer[byte_count-1] ^= 0x01;
+	fp = fopen(corrupt_filename,"wb");
+	if((fp == NULL)||(fwrite(buffer,1,byte_count,fp) != byte_count))
+	{
+		if(fp != NULL)
+			fclose(fp);
+		free(buffer);
+		fprintf(stderr,"Corrupt_Image_File:Failed to write %s.\n",corrupt_filename);
+		return FALSE;
+	}
+	fclose(fp);
+	free(buffer);
+	fprintf(stdout,"Copied %ld bytes from %s to %s, changing the last byte.\n",byte_count,filename,
+		corrupt_filename);
+	return TRUE;
+}
+
+/**
+ * Time how long getting the checksum of the .lod file takes.
+ * @param clear_cache If TRUE, the image cache is emptied before each load, so the file is parsed each time.
+ * @return The average time per load, in milliseconds.
+ * @see #Lod_Filename
+ * @see #Load_Count
+ */
+static double Time_Loads(int clear_cache)
+{
+	struct timespec start_time,end_time;
+	unsigned int checksum;
+	int i,word_count;
+
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	for(i = 0; i < Load_Count; i++)
+	{
+		if(clear_cache)
+			CCD_DSP_Download_Cache_Clear();
+		if(!CCD_DSP_Download_Image_Get_Checksum("test_dsp_image","-",Lod_Filename,&checksum,&word_count))
+		{
+			CCD_Global_Error();
+			return -1.0;
+		}
+	}
+	clock_gettime(CLOCK_REALTIME,&end_time);
+	return ((((double)(end_time.tv_sec-start_time.tv_sec))+
+		 (((double)(end_time.tv_nsec-start_time.tv_nsec))/((double)CCD_GLOBBAL_ONE_SECOND_NS)))*1000.0)/
+		((double)Load_Count);
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Lod_Filename
+ * @see #Image_Filename
+ * @see #Load_Count
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-count")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Load_Count);
+				if((retval != 1)||(Load_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal count %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-lod_filename")==0)||(strcmp(argv[i],"-l")==0))
+		{
+			if(((i+1)<argc)&&(strlen(argv[i+1]) < MAX_STRING_LENGTH))
+			{
+				strcpy(Lod_Filename,argv[i+1]);
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Lod filename requires a filename.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-output_filename")==0)||(strcmp(argv[i],"-o")==0))
+		{
+			if(((i+1)<argc)&&(strlen(argv[i+1]) < MAX_STRING_LENGTH-8))
+			{
+				strcpy(Image_Filename,argv[i+1]);
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Output filename requires a filename.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test DSP Image:Help.\n");
+	fprintf(stdout,"This program compiles a timing or utility board .lod file into a binary image, "
+		"and checks the image matches the .lod file.\n");
+	fprintf(stdout,"test_dsp_image [-l[od_filename] <filename>][-o[utput_filename] <filename>]\n");
+	fprintf(stdout,"\t[-c[ount] <n>][-h[elp]]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-lod_filename is the .lod file to compile. If not specified a test file is generated.\n");
+	fprintf(stdout,"\t-output_filename is the binary image file to write.\n");
+	fprintf(stdout,"\t-count is the number of times to load the .lod file when timing.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,391 @@
+/* test_dsp_priority.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "ccd_dsp.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_text.h"
+
+/**
+ * This program tests the priority scheduling of controller commands. A text device is opened, and one thread
+ * holds the controller access lock by sending a command that the text device has been told to take
+ * Hold_Time milliseconds to complete. Whilst it is held,
+ * a housekeeping command (a utility board memory read), a normal command (a timing board memory write) and
+ * an exposure command (a HSTR read) are queued, in that order, from three more threads. When the lock is
+ * released the commands should be sent in priority order: exposure, normal, then housekeeping.
+ * The order is read back from the text device output file.
+ * The ordering is only checked if the library was compiled with CCD_DSP_MUTEXED.
+ * <pre>
+ * test_dsp_priority [-h[old_time] &lt;ms&gt;] [-help]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The number of command threads queued whilst the lock is held.
+ */
+#define TEST_COMMAND_COUNT	(3)
+/**
+ * The time to wait between starting each command thread, in milliseconds.
+ */
+#define TEST_START_DELAY_MS	(50)
+
+/* enums */
+/**
+ * The commands each queued thread sends.
+ * <ul>
+ * <li>TEST_COMMAND_HOUSEKEEPING - A utility board memory read.
+ * <li>TEST_COMMAND_NORMAL - A timing board memory write.
+ * <li>TEST_COMMAND_EXPOSURE - A HSTR read.
+ * </ul>
+ */
+enum TEST_COMMAND
+{
+	TEST_COMMAND_HOUSEKEEPING=0,TEST_COMMAND_NORMAL=1,TEST_COMMAND_EXPOSURE=2
+};
+
+/* structures */
+/**
+ * Structure holding the data for each command thread.
+ * <dl>
+ * <dt>Command</dt> <dd>Which command to send.</dd>
+ * <dt>Success</dt> <dd>Whether the command succeeded.</dd>
+ * <dt>End_Time</dt> <dd>The time the command completed.</dd>
+ * </dl>
+ */
+struct Test_Command_Struct
+{
+	enum TEST_COMMAND Command;
+	int Success;
+	struct timespec End_Time;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The opened text device handle.
+ */
+static CCD_Interface_Handle_T *Handle = NULL;
+/**
+ * How long the holding thread holds the controller access lock, in milliseconds.
+ */
+static int Hold_Time = 500;
+/**
+ * Names of the commands, for printing.
+ */
+static char *Command_Name_List[] = {"Housekeeping","Normal","Exposure"};
+/**
+ * Strings identifying each command in the text device output file.
+ */
+static char *Command_Log_List[] = {"Read Memory","Write Memory","Host Status Transfer Register"};
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static void *Test_Hold_Thread(void *user_arg);
+static void *Test_Command_Thread(void *user_arg);
+static int Test_Get_Command_Order(char *filename,int *order_list);
+static void Test_Sleep(int ms);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Hold_Thread
+ * @see #Test_Command_Thread
+ * @see #Test_Get_Command_Order
+ */
+int main(int argc, char *argv[])
+{
+	struct Test_Command_Struct command_list[TEST_COMMAND_COUNT];
+	pthread_t hold_thread,command_thread_list[TEST_COMMAND_COUNT];
+	struct timespec start_time;
+	long long count,total_ns,max_ns;
+	int order_list[TEST_COMMAND_COUNT];
+	int i,mutexed,fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_dsp_priority:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	if(!CCD_Interface_Open("test_dsp_priority","-",CCD_INTERFACE_DEVICE_TEXT,"test_dsp_priority.txt",&Handle))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	/* the next command holds the lock for Hold_Time */
+	if(!CCD_Text_Set_Command_Delay(Handle,Hold_Time))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	if(pthread_create(&hold_thread,NULL,Test_Hold_Thread,NULL) != 0)
+	{
+		fprintf(stderr,"test_dsp_priority:Failed to create hold thread.\n");
+		return 3;
+	}
+	/* queue the commands in reverse priority order */
+	for(i=0;i<TEST_COMMAND_COUNT;i++)
+	{
+		Test_Sleep(TEST_START_DELAY_MS);
+		/* the hold command has started by now, the queued commands complete immediately */
+		if((i == 0)&&(!CCD_Text_Set_Command_Delay(Handle,0)))
+		{
+			CCD_Global_Error();
+			return 2;
+		}
+		command_list[i].Command = i;
+		command_list[i].Success = FALSE;
+		if(pthread_create(&(command_thread_list[i]),NULL,Test_Command_Thread,
+				  (void *)&(command_list[i])) != 0)
+		{
+			fprintf(stderr,"test_dsp_priority:Failed to create command thread %d.\n",i);
+			return 3;
+		}
+	}
+	pthread_join(hold_thread,NULL);
+	for(i=0;i<TEST_COMMAND_COUNT;i++)
+	{
+		pthread_join(command_thread_list[i],NULL);
+		fprintf(stdout,"%s command completed after %.1f ms.\n",Command_Name_List[i],
+			Time_Difference(start_time,command_list[i].End_Time));
+		if(command_list[i].Success == FALSE)
+		{
+			fprintf(stdout,"FAIL:%s command failed.\n",Command_Name_List[i]);
+			fail_count++;
+		}
+	}
+	for(i=0;i<TEST_COMMAND_COUNT;i++)
+	{
+		if(!CCD_Global_Metrics_Get_Timer(Handle,CCD_GLOBAL_METRICS_TIMER_DSP_WAIT_HOUSEKEEPING+i,
+						 &count,&total_ns,&max_ns))
+		{
+			CCD_Global_Error();
+			return 4;
+		}
+		fprintf(stdout,"%s priority waits:count %lld, max %.3f ms.\n",Command_Name_List[i],count,
+			((double)max_ns)/1000000.0);
+	}
+	if(!CCD_Interface_Close("test_dsp_priority","-",&Handle))
+	{
+		CCD_Global_Error();
+		fail_count++;
+	}
+	/* the lock, and the priority waits, are only compiled in with CCD_DSP_MUTEXED */
+	mutexed = (count > 0);
+	if(mutexed)
+	{
+		/* the text device log records the order the commands were actually sent in */
+		if(!Test_Get_Command_Order("test_dsp_priority.txt",order_list))
+			return 6;
+		if(order_list[TEST_COMMAND_EXPOSURE] > order_list[TEST_COMMAND_NORMAL])
+		{
+			fprintf(stdout,"FAIL:Normal command sent before the exposure command.\n");
+			fail_count++;
+		}
+		if(order_list[TEST_COMMAND_NORMAL] > order_list[TEST_COMMAND_HOUSEKEEPING])
+		{
+			fprintf(stdout,"FAIL:Housekeeping command sent before the normal command.\n");
+			fail_count++;
+		}
+	}
+	else
+		fprintf(stdout,"Controller commands are not mutexed:not checking the command order.\n");
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 5;
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Hold_Time
+ * @see #TEST_START_DELAY_MS
+ * @see #TEST_COMMAND_COUNT
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-help")==0)
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-hold_time")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Hold_Time);
+				if((retval != 1)||(Hold_Time <= (TEST_START_DELAY_MS*(TEST_COMMAND_COUNT+1))))
+				{
+					fprintf(stderr,"Parse_Arguments:Hold time %s must be more than %d ms.\n",
+						argv[i+1],TEST_START_DELAY_MS*(TEST_COMMAND_COUNT+1));
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Hold time requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test DSP Priority:Help.\n");
+	fprintf(stdout,"This program tests controller commands are scheduled in priority order.\n");
+	fprintf(stdout,"test_dsp_priority [-h[old_time] <ms>][-help]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-hold_time is how long the controller access lock is held whilst commands are queued.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Thread routine, that holds the controller access lock for Hold_Time milliseconds, by requesting the
+ * readout progress whilst the text device's command delay is Hold_Time.
+ * @param user_arg Not used.
+ * @return The routine returns NULL.
+ * @see #Hold_Time
+ */
+static void *Test_Hold_Thread(void *user_arg)
+{
+	int pixel_count;
+
+	if(!CCD_DSP_Command_Get_Readout_Progress("test_dsp_priority","-",Handle,&pixel_count))
+		CCD_Global_Error();
+	return NULL;
+}
+
+/**
+ * Thread routine, that sends one command, and records whether it succeeded and when it completed.
+ * @param user_arg A pointer to the Test_Command_Struct for this thread.
+ * @return The routine returns NULL.
+ */
+static void *Test_Command_Thread(void *user_arg)
+{
+	struct Test_Command_Struct *command = (struct Test_Command_Struct *)user_arg;
+	int value;
+
+	switch(command->Command)
+	{
+		case TEST_COMMAND_HOUSEKEEPING:
+			CCD_DSP_Command_RDM("test_dsp_priority","-",Handle,CCD_DSP_UTIL_BOARD_ID,CCD_DSP_MEM_SPACE_Y,0x1);
+			command->Success = (CCD_DSP_Get_Error_Number() == 0);
+			break;
+		case TEST_COMMAND_NORMAL:
+			command->Success = (CCD_DSP_Command_WRM("test_dsp_priority","-",Handle,CCD_DSP_TIM_BOARD_ID,
+								CCD_DSP_MEM_SPACE_Y,0x1,1) == CCD_DSP_DON);
+			break;
+		case TEST_COMMAND_EXPOSURE:
+			command->Success = CCD_DSP_Command_Get_HSTR("test_dsp_priority","-",Handle,&value);
+			break;
+	}
+	clock_gettime(CLOCK_REALTIME,&(command->End_Time));
+	if(command->Success == FALSE)
+		CCD_Global_Error();
+	return NULL;
+}
+
+/**
+ * Routine to find the order the queued commands were sent to the text device, by reading back its output file.
+ * @param filename The text device output filename.
+ * @param order_list An array of TEST_COMMAND_COUNT integers, filled with the line number each command
+ *        first appears on (or -1 if it does not appear).
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Command_Log_List
+ */
+static int Test_Get_Command_Order(char *filename,int *order_list)
+{
+	FILE *fp = NULL;
+	char buff[256];
+	int i,line_number = 0;
+
+	for(i=0;i<TEST_COMMAND_COUNT;i++)
+		order_list[i] = -1;
+	fp = fopen(filename,"r");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"Test_Get_Command_Order:Failed to open %s.\n",filename);
+		return FALSE;
+	}
+	while(fgets(buff,sizeof(buff),fp) != NULL)
+	{
+		for(i=0;i<TEST_COMMAND_COUNT;i++)
+		{
+			if((order_list[i] == -1)&&(strstr(buff,Command_Log_List[i]) != NULL))
+				order_list[i] = line_number;
+		}
+		line_number++;
+	}
+	fclose(fp);
+	for(i=0;i<TEST_COMMAND_COUNT;i++)
+	{
+		if(order_list[i] == -1)
+		{
+			fprintf(stderr,"Test_Get_Command_Order:%s command not found in %s.\n",
+				Command_Name_List[i],filename);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to sleep for the specified number of milliseconds.
+ * @param ms The number of milliseconds to sleep for.
+ */
+static void Test_Sleep(int ms)
+{
+	struct timespec sleep_time;
+
+	sleep_time.tv_sec = ms/1000;
+	sleep_time.tv_nsec = (ms%1000)*1000000;
+	nanosleep(&sleep_time,NULL);
+}
+
+/**
+ * Routine to return the difference between two times, in milliseconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The time difference in milliseconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/*
+** $Log$
+*/
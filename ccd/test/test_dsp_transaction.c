@@ -0,0 +1,360 @@
+/* test_dsp_transaction.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ccd_dsp.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_pci.h"
+#include "ccd_text.h"
+
+/**
+ * This program tests DSP transactions. A text device is opened, and the same set of WRM commands is sent
+ * to it one at a time with CCD_DSP_Command_WRM, and then queued in a transaction and sent with
+ * CCD_DSP_Transaction_Submit. The time each takes is printed, and the metrics are checked to see the
+ * transaction sent one COMMAND ioctl per command, but only locked the DSP mutex once (if the library was
+ * compiled with CCD_DSP_MUTEXED). Queueing too many commands, and submitting an aborted transaction, are
+ * checked to fail.
+ * <pre>
+ * test_dsp_transaction [-c[ommand_count] &lt;n&gt;] [-l[oop_count] &lt;n&gt;] [-h[elp]]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The number of WRM commands to queue in each transaction.
+ */
+static int Command_Count = 12;
+/**
+ * The number of times to send the commands, individually and as a transaction.
+ */
+static int Loop_Count = 100;
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Test_Submit(CCD_Interface_Handle_T *handle);
+static int Test_Errors(CCD_Interface_Handle_T *handle);
+static int Get_Command_Count(CCD_Interface_Handle_T *handle,long long *count);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Submit
+ * @see #Test_Errors
+ */
+int main(int argc, char *argv[])
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	int fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_dsp_transaction:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	if(!CCD_Interface_Open("test_dsp_transaction","-",CCD_INTERFACE_DEVICE_TEXT,"test_dsp_transaction.txt",
+			       &handle))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	if(!Test_Submit(handle))
+		fail_count++;
+	if(!Test_Errors(handle))
+		fail_count++;
+	if(!CCD_Interface_Close("test_dsp_transaction","-",&handle))
+	{
+		CCD_Global_Error();
+		fail_count++;
+	}
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 3;
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Command_Count
+ * @see #Loop_Count
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-command_count")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Command_Count);
+				if((retval != 1)||(Command_Count < 1)||
+				   (Command_Count > CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT))
+				{
+					fprintf(stderr,"Parse_Arguments:Command count %s must be between 1 and %d.\n",
+						argv[i+1],CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Command count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-loop_count")==0)||(strcmp(argv[i],"-l")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Loop_Count);
+				if((retval != 1)||(Loop_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing loop count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Loop count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test DSP Transaction:Help.\n");
+	fprintf(stdout,"This program tests sending a list of controller commands as one transaction.\n");
+	fprintf(stdout,"test_dsp_transaction [-c[ommand_count] <n>][-l[oop_count] <n>][-h[elp]]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-command_count is the number of WRM commands in each transaction.\n");
+	fprintf(stdout,"\t-loop_count is the number of times to send the commands.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Routine that sends Command_Count WRM commands Loop_Count times, first individually and then as a transaction.
+ * The time each took is printed. The COMMAND ioctl count is checked to increase by the same amount each time,
+ * and the transaction to lock the DSP mutex once per loop.
+ * @param handle The opened text device handle.
+ * @return The routine returns TRUE if all the checks passed, and FALSE if they did not.
+ * @see #Command_Count
+ * @see #Loop_Count
+ * @see #Get_Command_Count
+ */
+static int Test_Submit(CCD_Interface_Handle_T *handle)
+{
+	struct CCD_DSP_Transaction_Struct transaction;
+	struct timespec start_time,end_time;
+	long long start_count,single_count,transaction_count,lock_start_count,lock_count,total_ns,max_ns;
+	int i,j,success;
+
+	success = TRUE;
+	/* send the commands one at a time */
+	if(!Get_Command_Count(handle,&start_count))
+		return FALSE;
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	for(i=0;i<Loop_Count;i++)
+	{
+		for(j=0;j<Command_Count;j++)
+		{
+			if(CCD_DSP_Command_WRM("test_dsp_transaction","-",handle,CCD_DSP_TIM_BOARD_ID,
+					       CCD_DSP_MEM_SPACE_Y,0x10+j,i+j) != CCD_DSP_DON)
+			{
+				CCD_Global_Error();
+				return FALSE;
+			}
+		}
+	}
+	clock_gettime(CLOCK_REALTIME,&end_time);
+	if(!Get_Command_Count(handle,&single_count))
+		return FALSE;
+	single_count -= start_count;
+	fprintf(stdout,"Test_Submit:%d single WRM commands took %.3f ms.\n",Loop_Count*Command_Count,
+		Time_Difference(start_time,end_time));
+	/* send the same commands as transactions */
+	if(!CCD_Global_Metrics_Get_Timer(handle,CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT,&lock_start_count,
+					 &total_ns,&max_ns))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	for(i=0;i<Loop_Count;i++)
+	{
+		CCD_DSP_Transaction_Initialise(&transaction);
+		for(j=0;j<Command_Count;j++)
+		{
+			if(!CCD_DSP_Transaction_Add_WRM(&transaction,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,0x10+j,i+j))
+			{
+				CCD_Global_Error();
+				return FALSE;
+			}
+		}
+		if(CCD_DSP_Transaction_Submit("test_dsp_transaction","-",handle,&transaction) != CCD_DSP_DON)
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+	}
+	clock_gettime(CLOCK_REALTIME,&end_time);
+	if(!Get_Command_Count(handle,&transaction_count))
+		return FALSE;
+	transaction_count -= start_count+single_count;
+	if(!CCD_Global_Metrics_Get_Timer(handle,CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT,&lock_count,
+					 &total_ns,&max_ns))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	lock_count -= lock_start_count;
+	fprintf(stdout,"Test_Submit:%d transactions of %d WRM commands took %.3f ms, locking the mutex %lld times.\n",
+		Loop_Count,Command_Count,Time_Difference(start_time,end_time),lock_count);
+	if((single_count != Loop_Count*Command_Count)||(transaction_count != single_count))
+	{
+		fprintf(stdout,"Test_Submit:FAIL:Expected %d COMMAND ioctls, got %lld single and %lld in transactions.\n",
+			Loop_Count*Command_Count,single_count,transaction_count);
+		success = FALSE;
+	}
+	/* the mutex is only compiled in with CCD_DSP_MUTEXED */
+	if((lock_count != 0)&&(lock_count != Loop_Count))
+	{
+		fprintf(stdout,"Test_Submit:FAIL:Expected 0 or %d mutex locks.\n",Loop_Count);
+		success = FALSE;
+	}
+	if(transaction.Failed_Index != -1)
+	{
+		fprintf(stdout,"Test_Submit:FAIL:Failed index was %d after a successful submit.\n",
+			transaction.Failed_Index);
+		success = FALSE;
+	}
+	return success;
+}
+
+/**
+ * Routine that checks queueing more than CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT commands fails,
+ * and that submitting a transaction when the abort flag is set fails on the first command, without sending it.
+ * @param handle The opened text device handle.
+ * @return The routine returns TRUE if all the checks passed, and FALSE if they did not.
+ * @see #Get_Command_Count
+ */
+static int Test_Errors(CCD_Interface_Handle_T *handle)
+{
+	struct CCD_DSP_Transaction_Struct transaction;
+	long long start_count,end_count;
+	int i,success;
+
+	success = TRUE;
+	CCD_DSP_Transaction_Initialise(&transaction);
+	for(i=0;i<CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT;i++)
+	{
+		if(!CCD_DSP_Transaction_Add_SSP(&transaction,i,i,i))
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+	}
+	if(CCD_DSP_Transaction_Add_SSP(&transaction,0,0,0))
+	{
+		fprintf(stdout,"Test_Errors:FAIL:Queued more than %d commands.\n",CCD_DSP_TRANSACTION_MAX_COMMAND_COUNT);
+		success = FALSE;
+	}
+	if(CCD_DSP_Transaction_Add_SSS(&transaction,-1,0,0))
+	{
+		fprintf(stdout,"Test_Errors:FAIL:Queued an SSS with an illegal bias width.\n");
+		success = FALSE;
+	}
+	/* an aborted transaction should not send anything */
+	if(!Get_Command_Count(handle,&start_count))
+		return FALSE;
+	CCD_DSP_Set_Abort("test_dsp_transaction","-",handle,TRUE);
+	if(CCD_DSP_Transaction_Submit("test_dsp_transaction","-",handle,&transaction) == CCD_DSP_DON)
+	{
+		fprintf(stdout,"Test_Errors:FAIL:An aborted transaction succeeded.\n");
+		success = FALSE;
+	}
+	CCD_DSP_Set_Abort("test_dsp_transaction","-",handle,FALSE);
+	if(!Get_Command_Count(handle,&end_count))
+		return FALSE;
+	if((transaction.Failed_Index != 0)||(end_count != start_count))
+	{
+		fprintf(stdout,"Test_Errors:FAIL:Aborted transaction failed at %d, and sent %lld commands.\n",
+			transaction.Failed_Index,end_count-start_count);
+		success = FALSE;
+	}
+	return success;
+}
+
+/**
+ * Routine to return how many COMMAND ioctls have been sent to the device.
+ * @param handle The opened text device handle.
+ * @param count The address of a long long, on return set to the number of COMMAND ioctls sent.
+ * @return The routine returns TRUE if the count was found, and FALSE if it was not.
+ */
+static int Get_Command_Count(CCD_Interface_Handle_T *handle,long long *count)
+{
+	long long total_ns,max_ns;
+	int i,request;
+
+	for(i=0;i<CCD_GLOBAL_METRICS_IOCTL_COUNT;i++)
+	{
+		if(!CCD_Global_Metrics_Get_Ioctl(handle,i,&request,count,&total_ns,&max_ns))
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+		if(request == CCD_PCI_IOCTL_COMMAND)
+			return TRUE;
+	}
+	fprintf(stdout,"Get_Command_Count:FAIL:COMMAND ioctl has no metrics.\n");
+	return FALSE;
+}
+
+/**
+ * Routine to return the difference between two times, in milliseconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The time difference in milliseconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/*
+** $Log$
+*/
@@ -178,6 +178,14 @@ static char *Filename = NULL;
  * Log level to use.
  */
 static int Log_Filter_Level = LOG_VERBOSITY_VERY_VERBOSE;
+/**
+ * Whether to stream the readout to disk whilst the CCD is being read out.
+ */
+static int Streaming_Readout = FALSE;
+/**
+ * Whether to poll the readout progress finely during readout, rather than sleeping.
+ */
+static int Readout_Progress_Wait = FALSE;
 /* internal routines */
 static int Parse_Arguments(int argc, char *argv[]);
 static void Help(void);
@@ -292,6 +300,18 @@ int main(int argc, char *argv[])
 		return 3;
 	}
 	fprintf(stdout,"CCD_Setup_Dimensions completed\n");
+	if(!CCD_Exposure_Set_Streaming_Readout(handle,Streaming_Readout))
+	{
+		CCD_Global_Error();
+		return 3;
+	}
+	fprintf(stdout,"Streaming Readout:%d\n",Streaming_Readout);
+	if(!CCD_Exposure_Set_Readout_Progress_Wait(handle,Readout_Progress_Wait))
+	{
+		CCD_Global_Error();
+		return 3;
+	}
+	fprintf(stdout,"Readout Progress Wait:%d\n",Readout_Progress_Wait);
 /* save fits headers */
 	if(Window_Flags > 0 )
 	{
@@ -395,6 +415,8 @@ int main(int argc, char *argv[])
  * @see #Exposure_Length
  * @see #Filename
  * @see #Log_Filter_Level
+ * @see #Streaming_Readout
+ * @see #Readout_Progress_Wait
  */
 static int Parse_Arguments(int argc, char *argv[])
 {
@@ -590,6 +612,14 @@ static int Parse_Arguments(int argc, char *argv[])
 				return FALSE;
 			}
 		}
+		else if(strcmp(argv[i],"-progress_wait")==0)
+		{
+			Readout_Progress_Wait = TRUE;
+		}
+		else if(strcmp(argv[i],"-streaming")==0)
+		{
+			Streaming_Readout = TRUE;
+		}
 		else if((strcmp(argv[i],"-text_print_level")==0)||(strcmp(argv[i],"-t")==0))
 		{
 			if((i+1)<argc)
@@ -822,10 +852,12 @@ static void Help(void)
 	fprintf(stdout,"\t[-f[ilename] <filename>]\n");
 	fprintf(stdout,"\t[-b[ias]][-d[ark] <exposure length>][-e[xpose] <exposure length>]\n");
 	fprintf(stdout,"\t[-t[ext_print_level] <commands|replies|values|all>][-h[elp]]\n");
-	fprintf(stdout,"\t[-log_level <bit number>]\n");
+	fprintf(stdout,"\t[-log_level <bit number>][-streaming][-progress_wait]\n");
 	fprintf(stdout,"\n");
 	fprintf(stdout,"\t-interface_device selects the device to communicate with the SDSU controller.\n");
 	fprintf(stdout,"\t-device_pathname can select which controller (/dev/astropci[0|1]) or text output file.\n");
+	fprintf(stdout,"\t-streaming saves full frame rows to disk whilst the CCD is still being read out.\n");
+	fprintf(stdout,"\t-progress_wait polls the readout progress until the readout completes, rather than sleeping.\n");
 	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
 	fprintf(stdout,"\n");
 	fprintf(stdout,"\t<filename> should be a valid .lod file pathname.\n");
@@ -0,0 +1,1250 @@
+/* test_exposure_benchmark.c
+ * $Header$
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_pci.h"
+#include "ccd_setup.h"
+#include "ccd_text.h"
+#include "fitsio.h"
+
+/**
+ * This program benchmarks the exposure pipeline, to track the dead time per frame (and so the MULTRUN overhead)
+ * across releases. It initialises the SDSU controller (or the text device's simulated controller) using
+ * CCD_Setup_Startup and CCD_Setup_Dimensions, and then takes a number of full frame exposures in the same way as a
+ * MULTRUN does: for each frame the FITS headers are saved and a lock file created (as the Java layer's
+ * saveFitsHeaders does), CCD_Exposure_Expose is called, and the lock file removed (as unLockFile does).
+ * The wall time of each stage is recorded for every frame:
+ * <ul>
+ * <li>The FITS header save and lock.
+ * <li>The CCD_Exposure_Expose stages (SEX issue, exposure, readout, reply data fetch, post-readout processing
+ *     and FITS save), retrieved using CCD_Exposure_Get_Stage_Time.
+ * <li>The file unlock.
+ * <li>The whole frame, and the dead time (the frame time less the exposure length).
+ * </ul>
+ * As the library byte swaps and de-interlaces in one pass, after each frame the read out data is also
+ * byte swapped on it's own, and de-interlaced with each de-interlace type, to time these separately.
+ * Once all the frames are taken, the minimum, mean, percentiles, maximum and a histogram of each stage are
+ * written out, as CSV or JSON.
+ * <pre>
+ * test_exposure_benchmark [-i[nterface_device] &lt;pci|text&gt;] [-device_pathname &lt;path&gt;]
+ * 	[-pci_filename &lt;filename&gt;][-timing_filename &lt;filename&gt;][-utility_filename &lt;filename&gt;]
+ * 	[-temperature &lt;temperature&gt;]
+ * 	[-xs[ize] &lt;no. of pixels&gt;][-ys[ize] &lt;no. of pixels&gt;]
+ * 	[-xb[in] &lt;binning factor&gt;][-yb[in] &lt;binning factor&gt;][-a[mplifier] &lt;left|right|both&gt;]
+ * 	[-e[xposure_length] &lt;ms&gt;][-n[umber] &lt;frames&gt;][-d[irectory] &lt;directory&gt;][-k[eep]]
+ * 	[-stream][-progress_wait][-async]
+ * 	[-f[ormat] &lt;csv|json&gt;][-o[utput_filename] &lt;filename&gt;][-b[ins] &lt;n&gt;]
+ * 	[-t[ext_print_level] &lt;commands|replies|values|all&gt;][-h[elp]]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * Maximum length of some of the strings in this program.
+ */
+#define MAX_STRING_LENGTH	(256)
+/**
+ * Default temperature to set the CCD to.
+ */
+#define DEFAULT_TEMPERATURE	(-110.0)
+/**
+ * Default number of columns in the CCD.
+ */
+#define DEFAULT_SIZE_X		(2200)
+/**
+ * Default number of rows in the CCD.
+ */
+#define DEFAULT_SIZE_Y		(2048)
+/**
+ * Default number of histogram bins for each stage.
+ */
+#define DEFAULT_BIN_COUNT	(20)
+/**
+ * The stages timed by the benchmark. The first CCD_EXPOSURE_STAGE_COUNT stages are the stages of
+ * CCD_Exposure_Expose, in CCD_EXPOSURE_STAGE order.
+ * @see #Stage_Name_List
+ */
+#define BENCHMARK_STAGE_FITS_HEADER		(CCD_EXPOSURE_STAGE_COUNT)
+/**
+ * Index of the file unlock stage.
+ */
+#define BENCHMARK_STAGE_UNLOCK			(CCD_EXPOSURE_STAGE_COUNT+1)
+/**
+ * Index of the first (byte swap only) of the separately timed post-readout stages.
+ */
+#define BENCHMARK_STAGE_BYTE_SWAP		(CCD_EXPOSURE_STAGE_COUNT+2)
+/**
+ * Index of the first de-interlace stage. There is one stage for each CCD_DSP_DEINTERLACE_TYPE, in order.
+ */
+#define BENCHMARK_STAGE_DEINTERLACE		(CCD_EXPOSURE_STAGE_COUNT+3)
+/**
+ * The number of de-interlace types timed.
+ */
+#define BENCHMARK_DEINTERLACE_TYPE_COUNT	(5)
+/**
+ * Index of the whole frame stage.
+ */
+#define BENCHMARK_STAGE_FRAME			(BENCHMARK_STAGE_DEINTERLACE+BENCHMARK_DEINTERLACE_TYPE_COUNT)
+/**
+ * Index of the dead time stage.
+ */
+#define BENCHMARK_STAGE_DEAD_TIME		(BENCHMARK_STAGE_FRAME+1)
+/**
+ * The number of stages timed by the benchmark.
+ */
+#define BENCHMARK_STAGE_COUNT			(BENCHMARK_STAGE_DEAD_TIME+1)
+
+/* enums */
+/**
+ * The format to write the results in. One of:
+ * <ul>
+ * <li>OUTPUT_FORMAT_CSV
+ * <li>OUTPUT_FORMAT_JSON
+ * </ul>
+ */
+enum OUTPUT_FORMAT
+{
+	OUTPUT_FORMAT_CSV=0,OUTPUT_FORMAT_JSON
+};
+
+/* structures */
+/**
+ * Structure holding the statistics of one stage.
+ * <dl>
+ * <dt>Count</dt> <dd>The number of samples.</dd>
+ * <dt>Min</dt> <dd>The minimum time, in milliseconds.</dd>
+ * <dt>Mean</dt> <dd>The mean time, in milliseconds.</dd>
+ * <dt>P50</dt> <dd>The median time, in milliseconds.</dd>
+ * <dt>P90</dt> <dd>The 90th percentile time, in milliseconds.</dd>
+ * <dt>P99</dt> <dd>The 99th percentile time, in milliseconds.</dd>
+ * <dt>Max</dt> <dd>The maximum time, in milliseconds.</dd>
+ * <dt>Bin_Width</dt> <dd>The width of each histogram bin, in milliseconds. The first bin starts at Min.</dd>
+ * <dt>Histogram</dt> <dd>An allocated list of Bin_Count bin counts.</dd>
+ * </dl>
+ */
+struct Stage_Statistics_Struct
+{
+	int Count;
+	double Min;
+	double Mean;
+	double P50;
+	double P90;
+	double P99;
+	double Max;
+	double Bin_Width;
+	int *Histogram;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The name of each stage, as written to the output.
+ * @see #BENCHMARK_STAGE_COUNT
+ */
+static char *Stage_Name_List[BENCHMARK_STAGE_COUNT] =
+{
+	"sex","expose","readout","reply_data","post_readout","fits_save",
+	"fits_header","unlock","byte_swap","deinterlace_single","deinterlace_flip",
+	"deinterlace_split_parallel","deinterlace_split_serial","deinterlace_split_quad",
+	"frame","dead_time"
+};
+/**
+ * How much information to print out when using the text interface.
+ */
+static enum CCD_TEXT_PRINT_LEVEL Text_Print_Level = CCD_TEXT_PRINT_LEVEL_COMMANDS;
+/**
+ * Which interface to communicate with the SDSU controller with.
+ */
+static enum CCD_INTERFACE_DEVICE_ID Interface_Device = CCD_INTERFACE_DEVICE_TEXT;
+/**
+ * The pathname of the device to contact.
+ */
+static char Device_Pathname[MAX_STRING_LENGTH] = "";
+/**
+ * What type of board initialisation to do for the PCI board.
+ */
+static enum CCD_SETUP_LOAD_TYPE PCI_Load_Type = CCD_SETUP_LOAD_ROM;
+/**
+ * The filename of the PCI .lod file to download.
+ */
+static char *PCI_Filename = NULL;
+/**
+ * What type of board initialisation to do for the timing board.
+ */
+static enum CCD_SETUP_LOAD_TYPE Timing_Load_Type = CCD_SETUP_LOAD_ROM;
+/**
+ * The filename of the Timing .lod file to download.
+ */
+static char *Timing_Filename = NULL;
+/**
+ * What type of board initialisation to do for the utility board.
+ */
+static enum CCD_SETUP_LOAD_TYPE Utility_Load_Type = CCD_SETUP_LOAD_ROM;
+/**
+ * The filename of the utility .lod file to download.
+ */
+static char *Utility_Filename = NULL;
+/**
+ * Temperature to set the CCD to.
+ * @see #DEFAULT_TEMPERATURE
+ */
+static double Temperature = DEFAULT_TEMPERATURE;
+/**
+ * The number of columns in the CCD.
+ * @see #DEFAULT_SIZE_X
+ */
+static int Size_X = DEFAULT_SIZE_X;
+/**
+ * The number of rows in the CCD.
+ * @see #DEFAULT_SIZE_Y
+ */
+static int Size_Y = DEFAULT_SIZE_Y;
+/**
+ * The number binning factor in columns.
+ */
+static int Bin_X = 1;
+/**
+ * The number binning factor in rows.
+ */
+static int Bin_Y = 1;
+/**
+ * The amplifier to use when reading out the CCD.
+ */
+static enum CCD_DSP_AMPLIFIER Amplifier = CCD_DSP_AMPLIFIER_BOTH;
+/**
+ * The type of deinterlace to apply to the image, appropriate to the amplifier.
+ */
+static enum CCD_DSP_DEINTERLACE_TYPE DeInterlace_Type = CCD_DSP_DEINTERLACE_SPLIT_SERIAL;
+/**
+ * The exposure length of each frame, in milliseconds.
+ */
+static int Exposure_Length = 1000;
+/**
+ * The number of frames to take.
+ */
+static int Frame_Count = 10;
+/**
+ * The directory to save the FITS images in.
+ */
+static char *Directory = ".";
+/**
+ * Whether to keep the FITS images, or delete them after each frame has been timed.
+ */
+static int Keep_Images = FALSE;
+/**
+ * Whether to stream the readout to disk whilst the CCD is being read out.
+ */
+static int Streaming_Readout = FALSE;
+/**
+ * Whether to poll the readout progress finely during readout, rather than sleeping.
+ */
+static int Readout_Progress_Wait = FALSE;
+/**
+ * Whether to save the images asynchronously, using the FITS writer thread.
+ */
+static int Async_Save = FALSE;
+/**
+ * The format to write the results in.
+ */
+static enum OUTPUT_FORMAT Output_Format = OUTPUT_FORMAT_CSV;
+/**
+ * The filename to write the results to, or NULL to write them to stdout.
+ */
+static char *Output_Filename = NULL;
+/**
+ * The number of histogram bins for each stage.
+ * @see #DEFAULT_BIN_COUNT
+ */
+static int Bin_Count = DEFAULT_BIN_COUNT;
+/**
+ * The time taken by each stage of each frame, in milliseconds, indexed by stage, then by sample.
+ */
+static double *Sample_List[BENCHMARK_STAGE_COUNT];
+/**
+ * The number of samples of each stage in Sample_List.
+ */
+static int Sample_Count_List[BENCHMARK_STAGE_COUNT];
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Benchmark_Frame(CCD_Interface_Handle_T *handle,int frame_number,unsigned short *image_data);
+static int Benchmark_Post_Readout(CCD_Interface_Handle_T *handle,unsigned short *image_data);
+static void Benchmark_Add_Sample(int stage,double time_ms);
+static void Benchmark_Statistics(int stage,struct Stage_Statistics_Struct *statistics);
+static int Benchmark_Sort_Compare(const void *a,const void *b);
+static void Benchmark_Output_CSV(FILE *fp,struct Stage_Statistics_Struct *statistics_list);
+static void Benchmark_Output_JSON(FILE *fp,struct Stage_Statistics_Struct *statistics_list);
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename);
+static void Test_Fits_Header_Error(int status);
+static double Time_Diff_Ms(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Benchmark_Frame
+ * @see #Benchmark_Statistics
+ * @see #Benchmark_Output_CSV
+ * @see #Benchmark_Output_JSON
+ */
+int main(int argc, char *argv[])
+{
+	struct Stage_Statistics_Struct statistics_list[BENCHMARK_STAGE_COUNT];
+	struct CCD_Setup_Window_Struct window_list[CCD_SETUP_WINDOW_COUNT];
+	CCD_Interface_Handle_T *handle = NULL;
+	unsigned short *image_data = NULL;
+	FILE *fp = NULL;
+	int i,frame_number;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stderr,"test_exposure_benchmark:%s.\n",rcsid);
+	for(i=0;i<BENCHMARK_STAGE_COUNT;i++)
+	{
+		Sample_List[i] = (double *)malloc(Frame_Count*sizeof(double));
+		Sample_Count_List[i] = 0;
+		if(Sample_List[i] == NULL)
+		{
+			fprintf(stderr,"Failed to allocate sample list %d.\n",i);
+			return 2;
+		}
+	}
+	image_data = (unsigned short *)malloc((Size_X/Bin_X)*(Size_Y/Bin_Y)*sizeof(unsigned short));
+	if(image_data == NULL)
+	{
+		fprintf(stderr,"Failed to allocate image data.\n");
+		return 2;
+	}
+	CCD_Text_Set_Print_Level(Text_Print_Level);
+	CCD_Global_Initialise();
+	if(strlen(Device_Pathname) == 0)
+	{
+		switch(Interface_Device)
+		{
+			case CCD_INTERFACE_DEVICE_PCI:
+				strcpy(Device_Pathname,CCD_PCI_DEFAULT_DEVICE_ZERO);
+				break;
+			case CCD_INTERFACE_DEVICE_TEXT:
+				strcpy(Device_Pathname,"frodospec_ccd_text_benchmark.txt");
+				break;
+			default:
+				fprintf(stderr,"Illegal interface device %d.\n",Interface_Device);
+				return 3;
+		}
+	}
+	if(!CCD_Interface_Open("test_exposure_benchmark","-",Interface_Device,Device_Pathname,&handle))
+	{
+		CCD_Global_Error();
+		return 3;
+	}
+	if(!CCD_Setup_Startup("test_exposure_benchmark","-",handle,PCI_Load_Type,PCI_Filename,Timing_Load_Type,0,
+			      Timing_Filename,Utility_Load_Type,0,Utility_Filename,Temperature,CCD_DSP_GAIN_ONE,
+			      TRUE,TRUE))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_benchmark","-",&handle);
+		return 4;
+	}
+	memset(window_list,0,sizeof(window_list));
+	if(!CCD_Setup_Dimensions("test_exposure_benchmark","-",handle,Size_X,Size_Y,Bin_X,Bin_Y,Amplifier,
+				 DeInterlace_Type,0,window_list))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_benchmark","-",&handle);
+		return 4;
+	}
+	if((!CCD_Exposure_Set_Streaming_Readout(handle,Streaming_Readout))||
+	   (!CCD_Exposure_Set_Readout_Progress_Wait(handle,Readout_Progress_Wait))||
+	   (!CCD_Exposure_Set_Async_Save(handle,Async_Save)))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_benchmark","-",&handle);
+		return 4;
+	}
+	fprintf(stderr,"Taking %d frames of %d ms, (%d,%d) binned (%d,%d), amplifier %#x.\n",Frame_Count,
+		Exposure_Length,Size_X,Size_Y,Bin_X,Bin_Y,Amplifier);
+	for(frame_number = 0; frame_number < Frame_Count; frame_number++)
+	{
+		if(!Benchmark_Frame(handle,frame_number,image_data))
+		{
+			CCD_Interface_Close("test_exposure_benchmark","-",&handle);
+			return 5;
+		}
+	}
+	if(!CCD_Interface_Close("test_exposure_benchmark","-",&handle))
+	{
+		CCD_Global_Error();
+		return 6;
+	}
+	free(image_data);
+	/* compute and write out the statistics */
+	for(i=0;i<BENCHMARK_STAGE_COUNT;i++)
+		Benchmark_Statistics(i,&(statistics_list[i]));
+	if(Output_Filename != NULL)
+	{
+		fp = fopen(Output_Filename,"w");
+		if(fp == NULL)
+		{
+			fprintf(stderr,"Failed to open output filename %s.\n",Output_Filename);
+			return 7;
+		}
+	}
+	else
+		fp = stdout;
+	if(Output_Format == OUTPUT_FORMAT_JSON)
+		Benchmark_Output_JSON(fp,statistics_list);
+	else
+		Benchmark_Output_CSV(fp,statistics_list);
+	if(fp != stdout)
+		fclose(fp);
+	for(i=0;i<BENCHMARK_STAGE_COUNT;i++)
+	{
+		if(statistics_list[i].Histogram != NULL)
+			free(statistics_list[i].Histogram);
+		free(Sample_List[i]);
+	}
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @return The routine returns TRUE if the arguments were parsed successfully, and FALSE if they were not.
+ * @see #Help
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-amplifier")==0)||(strcmp(argv[i],"-a")==0))
+		{
+			if((i+1)<argc)
+			{
+				if(strcmp(argv[i+1],"left")==0)
+				{
+					Amplifier = CCD_DSP_AMPLIFIER_LEFT;
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_SINGLE;
+				}
+				else if(strcmp(argv[i+1],"right")==0)
+				{
+					Amplifier = CCD_DSP_AMPLIFIER_RIGHT;
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_FLIP;
+				}
+				else if(strcmp(argv[i+1],"both")==0)
+				{
+					Amplifier = CCD_DSP_AMPLIFIER_BOTH;
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_SPLIT_SERIAL;
+				}
+				else
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal Amplifier '%s', "
+						"<left|right|both> required.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Amplifier requires <left|right|both>.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-async")==0)
+		{
+			Async_Save = TRUE;
+		}
+		else if((strcmp(argv[i],"-bins")==0)||(strcmp(argv[i],"-b")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Bin_Count);
+				if((retval != 1)||(Bin_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing bin count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Bins requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-device_pathname")==0))
+		{
+			if((i+1)<argc)
+			{
+				strncpy(Device_Pathname,argv[i+1],MAX_STRING_LENGTH-1);
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Device Pathname requires a device.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-directory")==0)||(strcmp(argv[i],"-d")==0))
+		{
+			if((i+1)<argc)
+			{
+				Directory = argv[i+1];
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Directory requires a directory.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-exposure_length")==0)||(strcmp(argv[i],"-e")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Length);
+				if((retval != 1)||(Exposure_Length < 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing exposure length %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Exposure length requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-format")==0)||(strcmp(argv[i],"-f")==0))
+		{
+			if((i+1)<argc)
+			{
+				if(strcmp(argv[i+1],"csv")==0)
+					Output_Format = OUTPUT_FORMAT_CSV;
+				else if(strcmp(argv[i+1],"json")==0)
+					Output_Format = OUTPUT_FORMAT_JSON;
+				else
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal format '%s'.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Format requires <csv|json>.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-interface_device")==0)||(strcmp(argv[i],"-i")==0))
+		{
+			if((i+1)<argc)
+			{
+				if(strcmp(argv[i+1],"text")==0)
+					Interface_Device = CCD_INTERFACE_DEVICE_TEXT;
+				else if(strcmp(argv[i+1],"pci")==0)
+					Interface_Device = CCD_INTERFACE_DEVICE_PCI;
+				else
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal Interface Device '%s'.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Interface Device requires a device.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-keep")==0)||(strcmp(argv[i],"-k")==0))
+		{
+			Keep_Images = TRUE;
+		}
+		else if((strcmp(argv[i],"-number")==0)||(strcmp(argv[i],"-n")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Frame_Count);
+				if((retval != 1)||(Frame_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing frame count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Number requires a number of frames.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-output_filename")==0)||(strcmp(argv[i],"-o")==0))
+		{
+			if((i+1)<argc)
+			{
+				Output_Filename = argv[i+1];
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Output filename requires a filename.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-pci_filename")==0)
+		{
+			if((i+1)<argc)
+			{
+				PCI_Load_Type = CCD_SETUP_LOAD_FILENAME;
+				PCI_Filename = argv[i+1];
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:PCI filename requires a filename.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-progress_wait")==0)
+		{
+			Readout_Progress_Wait = TRUE;
+		}
+		else if(strcmp(argv[i],"-stream")==0)
+		{
+			Streaming_Readout = TRUE;
+		}
+		else if(strcmp(argv[i],"-temperature")==0)
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%lf",&Temperature);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing temperature %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Temperature requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-text_print_level")==0)||(strcmp(argv[i],"-t")==0))
+		{
+			if((i+1)<argc)
+			{
+				if(strcmp(argv[i+1],"commands")==0)
+					Text_Print_Level = CCD_TEXT_PRINT_LEVEL_COMMANDS;
+				else if(strcmp(argv[i+1],"replies")==0)
+					Text_Print_Level = CCD_TEXT_PRINT_LEVEL_REPLIES;
+				else if(strcmp(argv[i+1],"values")==0)
+					Text_Print_Level = CCD_TEXT_PRINT_LEVEL_VALUES;
+				else if(strcmp(argv[i+1],"all")==0)
+					Text_Print_Level = CCD_TEXT_PRINT_LEVEL_ALL;
+				else
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal Text Print Level '%s'.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Text Print Level requires a level.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-timing_filename")==0)
+		{
+			if((i+1)<argc)
+			{
+				Timing_Load_Type = CCD_SETUP_LOAD_FILENAME;
+				Timing_Filename = argv[i+1];
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Timing filename requires a filename.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-utility_filename")==0)
+		{
+			if((i+1)<argc)
+			{
+				Utility_Load_Type = CCD_SETUP_LOAD_FILENAME;
+				Utility_Filename = argv[i+1];
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Utility filename requires a filename.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-xbin")==0)||(strcmp(argv[i],"-xb")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Bin_X);
+				if((retval != 1)||(Bin_X < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing X Bin %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:X Bin requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-xsize")==0)||(strcmp(argv[i],"-xs")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Size_X);
+				if((retval != 1)||(Size_X < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing X Size %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:X Size requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-ybin")==0)||(strcmp(argv[i],"-yb")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Bin_Y);
+				if((retval != 1)||(Bin_Y < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing Y Bin %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Y Bin requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-ysize")==0)||(strcmp(argv[i],"-ys")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Size_Y);
+				if((retval != 1)||(Size_Y < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing Y Size %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Y Size requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Exposure Benchmark:Help.\n");
+	fprintf(stdout,"This program times each stage of a series of exposures, and writes out statistics and\n");
+	fprintf(stdout,"histograms of the time taken by each stage.\n");
+	fprintf(stdout,"test_exposure_benchmark [-i[nterface_device] <pci|text>][-device_pathname <path>]\n");
+	fprintf(stdout,"\t[-pci_filename <filename>][-timing_filename <filename>][-utility_filename <filename>]\n");
+	fprintf(stdout,"\t[-temperature <temperature>]\n");
+	fprintf(stdout,"\t[-xs[ize] <no. of pixels>][-ys[ize] <no. of pixels>]\n");
+	fprintf(stdout,"\t[-xb[in] <binning factor>][-yb[in] <binning factor>][-a[mplifier] <left|right|both>]\n");
+	fprintf(stdout,"\t[-e[xposure_length] <ms>][-n[umber] <frames>][-d[irectory] <directory>][-k[eep]]\n");
+	fprintf(stdout,"\t[-stream][-progress_wait][-async]\n");
+	fprintf(stdout,"\t[-f[ormat] <csv|json>][-o[utput_filename] <filename>][-b[ins] <n>]\n");
+	fprintf(stdout,"\t[-t[ext_print_level] <commands|replies|values|all>][-h[elp]]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-directory is where the FITS images are saved. They are deleted after each frame,\n");
+	fprintf(stdout,"\t\tunless -keep is specified.\n");
+	fprintf(stdout,"\t-stream, -progress_wait and -async set the exposure readout options.\n");
+	fprintf(stdout,"\t-format selects the output format, and -output_filename where it is written (stdout).\n");
+	fprintf(stdout,"\t-bins is the number of histogram bins for each stage.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Routine to take and time one frame. The FITS headers are saved and a lock file created,
+ * CCD_Exposure_Expose called, and the lock file removed. The time of each stage is added to the samples.
+ * Benchmark_Post_Readout is then called to time the byte swap and de-interlace types separately.
+ * Finally the FITS image is deleted, unless Keep_Images is TRUE.
+ * @param handle The handle of the opened and setup controller.
+ * @param frame_number The number of the frame, used to make the filename.
+ * @param image_data A buffer big enough to hold a binned image, used by Benchmark_Post_Readout.
+ * @return The routine returns TRUE if the frame was taken, and FALSE if an error occured.
+ * @see #Test_Save_Fits_Headers
+ * @see #Benchmark_Add_Sample
+ * @see #Benchmark_Post_Readout
+ * @see #Directory
+ * @see #Keep_Images
+ * @see #Async_Save
+ */
+static int Benchmark_Frame(CCD_Interface_Handle_T *handle,int frame_number,unsigned short *image_data)
+{
+	struct timespec frame_start_time,stage_start_time,stage_end_time,start_time;
+	char filename[MAX_STRING_LENGTH];
+	char lock_filename[MAX_STRING_LENGTH];
+	char *filename_list[1];
+	double frame_ms,stage_ms;
+	int fd,stage;
+
+	sprintf(filename,"%s/test_exposure_benchmark_%d.fits",Directory,frame_number);
+	sprintf(lock_filename,"%s.lock",filename);
+	filename_list[0] = filename;
+	start_time.tv_sec = 0;
+	start_time.tv_nsec = 0;
+	/* save FITS headers and lock the file */
+	clock_gettime(CLOCK_REALTIME,&frame_start_time);
+	if(!Test_Save_Fits_Headers(Exposure_Length,Size_X/Bin_X,Size_Y/Bin_Y,filename))
+	{
+		fprintf(stderr,"Benchmark_Frame:Saving FITS headers %s failed.\n",filename);
+		return FALSE;
+	}
+	fd = open(lock_filename,O_WRONLY|O_CREAT|O_EXCL,0644);
+	if(fd < 0)
+	{
+		fprintf(stderr,"Benchmark_Frame:Creating lock file %s failed (%d).\n",lock_filename,errno);
+		return FALSE;
+	}
+	close(fd);
+	clock_gettime(CLOCK_REALTIME,&stage_end_time);
+	Benchmark_Add_Sample(BENCHMARK_STAGE_FITS_HEADER,Time_Diff_Ms(frame_start_time,stage_end_time));
+	/* take the exposure */
+	if(!CCD_Exposure_Expose("test_exposure_benchmark","-",handle,TRUE,TRUE,start_time,Exposure_Length,
+				filename_list,1))
+	{
+		CCD_Global_Error();
+		unlink(lock_filename);
+		return FALSE;
+	}
+	for(stage = 0; stage < CCD_EXPOSURE_STAGE_COUNT; stage++)
+	{
+		stage_ms = CCD_Exposure_Get_Stage_Time(handle,stage);
+		if(stage_ms >= 0.0)
+			Benchmark_Add_Sample(stage,stage_ms);
+	}
+	/* When saving asynchronously, the file cannot be unlocked until it has been written */
+	if(Async_Save)
+	{
+		if(!CCD_Exposure_Save_Wait("test_exposure_benchmark","-",handle))
+		{
+			CCD_Global_Error();
+			unlink(lock_filename);
+			return FALSE;
+		}
+	}
+	/* unlock the file */
+	clock_gettime(CLOCK_REALTIME,&stage_start_time);
+	if(unlink(lock_filename) != 0)
+	{
+		fprintf(stderr,"Benchmark_Frame:Removing lock file %s failed (%d).\n",lock_filename,errno);
+		return FALSE;
+	}
+	clock_gettime(CLOCK_REALTIME,&stage_end_time);
+	Benchmark_Add_Sample(BENCHMARK_STAGE_UNLOCK,Time_Diff_Ms(stage_start_time,stage_end_time));
+	frame_ms = Time_Diff_Ms(frame_start_time,stage_end_time);
+	Benchmark_Add_Sample(BENCHMARK_STAGE_FRAME,frame_ms);
+	Benchmark_Add_Sample(BENCHMARK_STAGE_DEAD_TIME,frame_ms-Exposure_Length);
+	fprintf(stderr,"Frame %d took %.3f ms, dead time %.3f ms.\n",frame_number,frame_ms,frame_ms-Exposure_Length);
+	/* time the post-readout stages separately */
+	if(!Benchmark_Post_Readout(handle,image_data))
+		return FALSE;
+	if(Keep_Images == FALSE)
+		unlink(filename);
+	return TRUE;
+}
+
+/**
+ * Routine to time the post-readout stages separately, on the data just read out. The data is byte swapped
+ * on it's own (a single de-interlace with byte swapping), and then de-interlaced with each de-interlace type
+ * that is legal for the image dimensions (without byte swapping).
+ * @param handle The handle of the controller that has just read out.
+ * @param image_data A buffer big enough to hold a binned image.
+ * @return The routine returns TRUE if it succeeds, and FALSE if an error occurs.
+ * @see #Benchmark_Add_Sample
+ * @see #BENCHMARK_STAGE_BYTE_SWAP
+ * @see #BENCHMARK_STAGE_DEINTERLACE
+ */
+static int Benchmark_Post_Readout(CCD_Interface_Handle_T *handle,unsigned short *image_data)
+{
+	struct timespec stage_start_time,stage_end_time;
+	enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type;
+	unsigned short *exposure_data = NULL;
+	int ncols,nrows,type_index;
+
+	ncols = Size_X/Bin_X;
+	nrows = Size_Y/Bin_Y;
+	if(!CCD_Interface_Get_Reply_Data(handle,&exposure_data))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	clock_gettime(CLOCK_REALTIME,&stage_start_time);
+	if(!CCD_Exposure_DeInterlace("test_exposure_benchmark","-",ncols,nrows,exposure_data,image_data,
+				     CCD_DSP_DEINTERLACE_SINGLE,TRUE))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	clock_gettime(CLOCK_REALTIME,&stage_end_time);
+	Benchmark_Add_Sample(BENCHMARK_STAGE_BYTE_SWAP,Time_Diff_Ms(stage_start_time,stage_end_time));
+	for(type_index = 0; type_index < BENCHMARK_DEINTERLACE_TYPE_COUNT; type_index++)
+	{
+		deinterlace_type = (enum CCD_DSP_DEINTERLACE_TYPE)(CCD_DSP_DEINTERLACE_SINGLE+type_index);
+		/* split readouts need an even number of rows and/or columns */
+		if(((deinterlace_type == CCD_DSP_DEINTERLACE_SPLIT_PARALLEL)||
+		    (deinterlace_type == CCD_DSP_DEINTERLACE_SPLIT_QUAD))&&((nrows%2) != 0))
+			continue;
+		if(((deinterlace_type == CCD_DSP_DEINTERLACE_SPLIT_SERIAL)||
+		    (deinterlace_type == CCD_DSP_DEINTERLACE_SPLIT_QUAD))&&((ncols%2) != 0))
+			continue;
+		clock_gettime(CLOCK_REALTIME,&stage_start_time);
+		if(!CCD_Exposure_DeInterlace("test_exposure_benchmark","-",ncols,nrows,exposure_data,image_data,
+					     deinterlace_type,FALSE))
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+		clock_gettime(CLOCK_REALTIME,&stage_end_time);
+		Benchmark_Add_Sample(BENCHMARK_STAGE_DEINTERLACE+type_index,
+				     Time_Diff_Ms(stage_start_time,stage_end_time));
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to add a sample to a stage's list of samples.
+ * @param stage The stage.
+ * @param time_ms The time the stage took, in milliseconds.
+ * @see #Sample_List
+ * @see #Sample_Count_List
+ */
+static void Benchmark_Add_Sample(int stage,double time_ms)
+{
+	if(Sample_Count_List[stage] < Frame_Count)
+	{
+		Sample_List[stage][Sample_Count_List[stage]] = time_ms;
+		Sample_Count_List[stage]++;
+	}
+}
+
+/**
+ * Routine to calculate the statistics of a stage. The samples are sorted, the percentiles are taken
+ * using the nearest rank method, and a histogram of Bin_Count bins between the minimum and maximum computed.
+ * @param stage The stage.
+ * @param statistics The address of a structure to fill in. The Histogram is allocated, and should be freed,
+ *        unless Count is zero.
+ * @see #Benchmark_Sort_Compare
+ * @see #Bin_Count
+ */
+static void Benchmark_Statistics(int stage,struct Stage_Statistics_Struct *statistics)
+{
+	double *sample_list = Sample_List[stage];
+	double total;
+	int i,count,bin;
+
+	count = Sample_Count_List[stage];
+	statistics->Count = count;
+	statistics->Histogram = NULL;
+	if(count == 0)
+		return;
+	qsort(sample_list,count,sizeof(double),Benchmark_Sort_Compare);
+	total = 0.0;
+	for(i=0;i<count;i++)
+		total += sample_list[i];
+	statistics->Min = sample_list[0];
+	statistics->Max = sample_list[count-1];
+	statistics->Mean = total/((double)count);
+	statistics->P50 = sample_list[((count*50)+99)/100-1];
+	statistics->P90 = sample_list[((count*90)+99)/100-1];
+	statistics->P99 = sample_list[((count*99)+99)/100-1];
+	statistics->Bin_Width = (statistics->Max-statistics->Min)/((double)Bin_Count);
+	statistics->Histogram = (int *)calloc(Bin_Count,sizeof(int));
+	if(statistics->Histogram == NULL)
+		return;
+	for(i=0;i<count;i++)
+	{
+		if(statistics->Bin_Width > 0.0)
+			bin = (int)((sample_list[i]-statistics->Min)/statistics->Bin_Width);
+		else
+			bin = 0;
+		if(bin >= Bin_Count)
+			bin = Bin_Count-1;
+		statistics->Histogram[bin]++;
+	}
+}
+
+/**
+ * qsort comparison routine for doubles.
+ * @param a The address of the first double.
+ * @param b The address of the second double.
+ * @return -1, 0 or 1 if a is less than, equal to or greater than b.
+ */
+static int Benchmark_Sort_Compare(const void *a,const void *b)
+{
+	double da = *(const double *)a;
+	double db = *(const double *)b;
+
+	if(da < db)
+		return -1;
+	if(da > db)
+		return 1;
+	return 0;
+}
+
+/**
+ * Routine to write the statistics out as CSV. A table of the statistics of each stage is written, followed
+ * by a blank line and a table of the histogram bins of each stage. Stages with no samples are not written.
+ * @param fp The file pointer to write to.
+ * @param statistics_list The list of statistics for each stage.
+ * @see #Stage_Name_List
+ */
+static void Benchmark_Output_CSV(FILE *fp,struct Stage_Statistics_Struct *statistics_list)
+{
+	int i,bin;
+
+	fprintf(fp,"stage,count,min_ms,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+	for(i=0;i<BENCHMARK_STAGE_COUNT;i++)
+	{
+		if(statistics_list[i].Count == 0)
+			continue;
+		fprintf(fp,"%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",Stage_Name_List[i],statistics_list[i].Count,
+			statistics_list[i].Min,statistics_list[i].Mean,statistics_list[i].P50,
+			statistics_list[i].P90,statistics_list[i].P99,statistics_list[i].Max);
+	}
+	fprintf(fp,"\n");
+	fprintf(fp,"stage,bin,low_ms,high_ms,count\n");
+	for(i=0;i<BENCHMARK_STAGE_COUNT;i++)
+	{
+		if((statistics_list[i].Count == 0)||(statistics_list[i].Histogram == NULL))
+			continue;
+		for(bin = 0; bin < Bin_Count; bin++)
+		{
+			fprintf(fp,"%s,%d,%.3f,%.3f,%d\n",Stage_Name_List[i],bin,
+				statistics_list[i].Min+(bin*statistics_list[i].Bin_Width),
+				statistics_list[i].Min+((bin+1)*statistics_list[i].Bin_Width),
+				statistics_list[i].Histogram[bin]);
+		}
+	}
+}
+
+/**
+ * Routine to write the benchmark configuration and statistics out as JSON. Stages with no samples are not written.
+ * @param fp The file pointer to write to.
+ * @param statistics_list The list of statistics for each stage.
+ * @see #Stage_Name_List
+ */
+static void Benchmark_Output_JSON(FILE *fp,struct Stage_Statistics_Struct *statistics_list)
+{
+	int i,bin,first;
+
+	fprintf(fp,"{\n");
+	fprintf(fp,"\t\"device\": \"%s\",\n",(Interface_Device == CCD_INTERFACE_DEVICE_PCI) ? "pci" : "text");
+	fprintf(fp,"\t\"frames\": %d,\n",Frame_Count);
+	fprintf(fp,"\t\"exposure_length_ms\": %d,\n",Exposure_Length);
+	fprintf(fp,"\t\"ncols\": %d,\n\t\"nrows\": %d,\n",Size_X/Bin_X,Size_Y/Bin_Y);
+	fprintf(fp,"\t\"xbin\": %d,\n\t\"ybin\": %d,\n",Bin_X,Bin_Y);
+	fprintf(fp,"\t\"deinterlace_type\": %d,\n",DeInterlace_Type);
+	fprintf(fp,"\t\"deinterlace_kernel\": %d,\n",CCD_Exposure_Get_DeInterlace_Kernel());
+	fprintf(fp,"\t\"streaming_readout\": %s,\n",Streaming_Readout ? "true" : "false");
+	fprintf(fp,"\t\"readout_progress_wait\": %s,\n",Readout_Progress_Wait ? "true" : "false");
+	fprintf(fp,"\t\"async_save\": %s,\n",Async_Save ? "true" : "false");
+	fprintf(fp,"\t\"stages\": [");
+	first = TRUE;
+	for(i=0;i<BENCHMARK_STAGE_COUNT;i++)
+	{
+		if(statistics_list[i].Count == 0)
+			continue;
+		if(first == FALSE)
+			fprintf(fp,",");
+		first = FALSE;
+		fprintf(fp,"\n\t\t{\"name\": \"%s\", \"count\": %d, \"min_ms\": %.3f, \"mean_ms\": %.3f, "
+			"\"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f,\n",
+			Stage_Name_List[i],statistics_list[i].Count,statistics_list[i].Min,statistics_list[i].Mean,
+			statistics_list[i].P50,statistics_list[i].P90,statistics_list[i].P99,statistics_list[i].Max);
+		fprintf(fp,"\t\t \"bin_width_ms\": %.3f, \"histogram\": [",statistics_list[i].Bin_Width);
+		if(statistics_list[i].Histogram != NULL)
+		{
+			for(bin = 0; bin < Bin_Count; bin++)
+				fprintf(fp,"%s%d",(bin > 0) ? ", " : "",statistics_list[i].Histogram[bin]);
+		}
+		fprintf(fp,"]}");
+	}
+	fprintf(fp,"\n\t]\n}\n");
+}
+
+/**
+ * Internal routine that saves some basic FITS headers to the relevant filename.
+ * This is needed as CCD_Exposure_Expose needs saved FITS headers to not give an error.
+ * @param exposure_time The amount of time, in milliseconds, of the exposure.
+ * @param ncols The number of columns in the FITS file.
+ * @param nrows The number of rows in the FITS file.
+ * @param filename The filename to save the FITS headers in.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ * @see #Test_Fits_Header_Error
+ */
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename)
+{
+	static fitsfile *fits_fp = NULL;
+	int status = 0,retval,ivalue;
+	double dvalue;
+
+/* open file, overwriting any old one */
+	unlink(filename);
+	if(fits_create_file(&fits_fp,filename,&status))
+	{
+		Test_Fits_Header_Error(status);
+		return FALSE;
+	}
+/* SIMPLE keyword */
+	ivalue = TRUE;
+	retval = fits_update_key(fits_fp,TLOGICAL,(char*)"SIMPLE",&ivalue,NULL,&status);
+	if(retval != 0)
+	{
+		Test_Fits_Header_Error(status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+/* BITPIX keyword */
+	ivalue = 16;
+	retval = fits_update_key(fits_fp,TINT,(char*)"BITPIX",&ivalue,NULL,&status);
+	if(retval != 0)
+	{
+		Test_Fits_Header_Error(status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+/* NAXIS keyword */
+	ivalue = 2;
+	retval = fits_update_key(fits_fp,TINT,(char*)"NAXIS",&ivalue,NULL,&status);
+	if(retval != 0)
+	{
+		Test_Fits_Header_Error(status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+/* NAXIS1 keyword */
+	ivalue = ncols;
+	retval = fits_update_key(fits_fp,TINT,(char*)"NAXIS1",&ivalue,NULL,&status);
+	if(retval != 0)
+	{
+		Test_Fits_Header_Error(status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+/* NAXIS2 keyword */
+	ivalue = nrows;
+	retval = fits_update_key(fits_fp,TINT,(char*)"NAXIS2",&ivalue,NULL,&status);
+	if(retval != 0)
+	{
+		Test_Fits_Header_Error(status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+/* BZERO keyword */
+	dvalue = 32768.0;
+	retval = fits_update_key_fixdbl(fits_fp,(char*)"BZERO",dvalue,6,
+		(char*)"Number to offset data values by",&status);
+	if(retval != 0)
+	{
+		Test_Fits_Header_Error(status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+/* BSCALE keyword */
+	dvalue = 1.0;
+	retval = fits_update_key_fixdbl(fits_fp,(char*)"BSCALE",dvalue,6,
+		(char*)"Number to multiply data values by",&status);
+	if(retval != 0)
+	{
+		Test_Fits_Header_Error(status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+/* close file */
+	if(fits_close_file(fits_fp,&status))
+	{
+		Test_Fits_Header_Error(status);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Internal routine to write the complete CFITSIO error stack to stderr.
+ * @param status The status returned by CFITSIO.
+ */
+static void Test_Fits_Header_Error(int status)
+{
+	/* report the whole CFITSIO error message stack to stderr. */
+	fits_report_error(stderr, status);
+}
+
+/**
+ * Routine to return the difference between two times, in milliseconds.
+ * @param start_time The earlier time.
+ * @param end_time The later time.
+ * @return The difference (end_time - start_time), in milliseconds.
+ */
+static double Time_Diff_Ms(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/*
+** $Log$
+*/
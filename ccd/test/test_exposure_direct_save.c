@@ -0,0 +1,524 @@
+/* test_exposure_direct_save.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_setup.h"
+#include "ccd_text.h"
+
+/**
+ * This program tests the direct FITS writer (the library must be built with CCD_EXPOSURE_DIRECT_SAVE defined).
+ * A text device is opened and setup for an unwindowed single (left amplifier) readout, which is saved
+ * straight from the read out data. A minimal FITS header is written to the output file, followed by some stale
+ * bytes that the save should truncate away. An exposure is then taken and the saved file checked:
+ * <ul>
+ * <li>The file length should be the header plus the image data, padded to a whole number of FITS blocks.
+ * <li>The header should contain the DATE-OBS and UTSTART keywords added by the save, and the right NAXIS1/NAXIS2.
+ * <li>The data should be big-endian, offset by BZERO, and decode to the de-interlaced read out data.
+ *     As the read out data is checked after the save, this also checks the save did not convert it in place.
+ * </ul>
+ * <pre>
+ * test_exposure_direct_save [-e[xposure_length] &lt;ms&gt;] [-c[olumns] &lt;pixels&gt;] [-r[ows] &lt;pixels&gt;] [-help]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The length of a FITS block in bytes.
+ */
+#define TEST_FITS_BLOCK_LENGTH	(2880)
+/**
+ * The length of a FITS header card in bytes.
+ */
+#define TEST_FITS_CARD_LENGTH	(80)
+/**
+ * The value of BZERO used to store unsigned short data as FITS signed 16 bit integers.
+ */
+#define TEST_FITS_BZERO		(32768)
+/**
+ * The number of stale bytes written after the header, that the save should remove.
+ */
+#define TEST_STALE_LENGTH	(100000)
+/**
+ * The name of the FITS file to save.
+ */
+#define TEST_FILENAME		("test_exposure_direct_save.fits")
+/**
+ * Which value to pass as the byte swap parameter to CCD_Exposure_DeInterlace.
+ * This should agree with how the library was built, the simulator byte swaps it's pixels if
+ * CCD_EXPOSURE_BYTE_SWAP is defined.
+ */
+#ifdef CCD_EXPOSURE_BYTE_SWAP
+#define TEST_BYTE_SWAP		(TRUE)
+#else
+#define TEST_BYTE_SWAP		(FALSE)
+#endif
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The length of the exposure, in milliseconds.
+ */
+static int Exposure_Length = 100;
+/**
+ * The number of columns to read out. This is not a multiple of the FITS block length, so the data is padded.
+ */
+static int Columns = 1000;
+/**
+ * The number of rows to read out.
+ */
+static int Rows = 500;
+
+/* internal routines */
+static int Test_Direct_Save(CCD_Interface_Handle_T *handle);
+static int Test_Check_Header(char *header,int header_length);
+static int Test_Check_Data(CCD_Interface_Handle_T *handle,unsigned char *fits_data);
+static int Test_Save_Fits_Headers(char *filename);
+static char *Test_Find_Card(char *header,int header_length,char *keyword);
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Direct_Save
+ */
+int main(int argc, char *argv[])
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	int fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_exposure_direct_save:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	if(!CCD_Interface_Open("test_exposure_direct_save","-",CCD_INTERFACE_DEVICE_TEXT,
+			       "test_exposure_direct_save.txt",&handle))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	if(!CCD_Setup_Startup("test_exposure_direct_save","-",handle,CCD_SETUP_LOAD_ROM,NULL,CCD_SETUP_LOAD_ROM,0,
+			      NULL,CCD_SETUP_LOAD_ROM,0,NULL,-110.0,CCD_DSP_GAIN_ONE,TRUE,TRUE))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_direct_save","-",&handle);
+		return 3;
+	}
+	if(!Test_Direct_Save(handle))
+		fail_count++;
+	if(!CCD_Interface_Close("test_exposure_direct_save","-",&handle))
+	{
+		CCD_Global_Error();
+		fail_count++;
+	}
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 4;
+	return 0;
+}
+
+/**
+ * Routine to take an unwindowed single readout exposure, and check the saved FITS file.
+ * @param handle The handle of the opened controller.
+ * @return The routine returns TRUE if the test passes, and FALSE if it fails.
+ * @see #TEST_FILENAME
+ * @see #TEST_FITS_BLOCK_LENGTH
+ * @see #Test_Save_Fits_Headers
+ * @see #Test_Check_Header
+ * @see #Test_Check_Data
+ */
+static int Test_Direct_Save(CCD_Interface_Handle_T *handle)
+{
+	struct CCD_Setup_Window_Struct window_list[CCD_SETUP_WINDOW_COUNT];
+	struct timespec start_time;
+	struct stat file_stat;
+	FILE *fp = NULL;
+	char *filename_list[1];
+	char *file_data = NULL;
+	char *end_card = NULL;
+	int data_length,expected_length,header_length,retval = TRUE;
+
+	if(!CCD_Setup_Dimensions("test_exposure_direct_save","-",handle,Columns,Rows,1,1,CCD_DSP_AMPLIFIER_LEFT,
+				 CCD_DSP_DEINTERLACE_SINGLE,0,window_list))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	if(!Test_Save_Fits_Headers(TEST_FILENAME))
+		return FALSE;
+	start_time.tv_sec = 0;
+	start_time.tv_nsec = 0;
+	filename_list[0] = TEST_FILENAME;
+	if(!CCD_Exposure_Expose("test_exposure_direct_save","-",handle,TRUE,TRUE,start_time,Exposure_Length,
+				filename_list,1))
+	{
+		fprintf(stdout,"FAIL:Exposure failed.\n");
+		CCD_Global_Error();
+		unlink(TEST_FILENAME);
+		return FALSE;
+	}
+	/* check the file length */
+	data_length = Columns*Rows*sizeof(unsigned short);
+	expected_length = TEST_FITS_BLOCK_LENGTH+data_length;
+	expected_length += (TEST_FITS_BLOCK_LENGTH-(data_length%TEST_FITS_BLOCK_LENGTH))%TEST_FITS_BLOCK_LENGTH;
+	if(stat(TEST_FILENAME,&file_stat) != 0)
+	{
+		fprintf(stdout,"FAIL:File %s does not exist.\n",TEST_FILENAME);
+		return FALSE;
+	}
+	if(file_stat.st_size < TEST_FITS_BLOCK_LENGTH)
+	{
+		fprintf(stdout,"FAIL:File length %ld is shorter than a FITS block.\n",(long)file_stat.st_size);
+		unlink(TEST_FILENAME);
+		return FALSE;
+	}
+	/* read the file */
+	file_data = (char*)malloc(file_stat.st_size);
+	if(file_data == NULL)
+	{
+		fprintf(stdout,"FAIL:Failed to allocate %ld bytes.\n",(long)file_stat.st_size);
+		unlink(TEST_FILENAME);
+		return FALSE;
+	}
+	fp = fopen(TEST_FILENAME,"rb");
+	if((fp == NULL)||(fread(file_data,1,file_stat.st_size,fp) != (size_t)file_stat.st_size))
+	{
+		fprintf(stdout,"FAIL:Failed to read %s.\n",TEST_FILENAME);
+		if(fp != NULL)
+			fclose(fp);
+		free(file_data);
+		unlink(TEST_FILENAME);
+		return FALSE;
+	}
+	fclose(fp);
+	unlink(TEST_FILENAME);
+	/* find the end of the header, which may have grown by a block if the keywords did not fit */
+	header_length = 0;
+	end_card = NULL;
+	while((end_card == NULL)&&(header_length < file_stat.st_size))
+	{
+		header_length += TEST_FITS_BLOCK_LENGTH;
+		end_card = Test_Find_Card(file_data,header_length,"END");
+	}
+	if(end_card == NULL)
+	{
+		fprintf(stdout,"FAIL:No END card in the saved file.\n");
+		free(file_data);
+		return FALSE;
+	}
+	expected_length += header_length-TEST_FITS_BLOCK_LENGTH;
+	if(file_stat.st_size != expected_length)
+	{
+		fprintf(stdout,"FAIL:File length %ld, expected %d.\n",(long)file_stat.st_size,expected_length);
+		free(file_data);
+		return FALSE;
+	}
+	fprintf(stdout,"File length %ld (header %d bytes).\n",(long)file_stat.st_size,header_length);
+	if(!Test_Check_Header(file_data,header_length))
+		retval = FALSE;
+	if(!Test_Check_Data(handle,(unsigned char*)(file_data+header_length)))
+		retval = FALSE;
+	free(file_data);
+	if(retval)
+		fprintf(stdout,"PASS.\n");
+	return retval;
+}
+
+/**
+ * Routine to check the saved header contains the keywords the direct FITS writer should have added, and the
+ * image dimensions.
+ * @param header The saved header.
+ * @param header_length The length of the header, a multiple of the FITS block length.
+ * @return The routine returns TRUE if the header is correct, and FALSE if it is not.
+ * @see #Test_Find_Card
+ * @see #Columns
+ * @see #Rows
+ */
+static int Test_Check_Header(char *header,int header_length)
+{
+	char *keyword_list[] = {"DATE","DATE-OBS","UTSTART"};
+	char *card = NULL;
+	int i,value,retval = TRUE;
+
+	for(i=0;i<(sizeof(keyword_list)/sizeof(keyword_list[0]));i++)
+	{
+		if(Test_Find_Card(header,header_length,keyword_list[i]) == NULL)
+		{
+			fprintf(stdout,"FAIL:Keyword %s not found in the header.\n",keyword_list[i]);
+			retval = FALSE;
+		}
+	}
+	card = Test_Find_Card(header,header_length,"NAXIS1");
+	if((card == NULL)||(sscanf(card+10,"%d",&value) != 1)||(value != Columns))
+	{
+		fprintf(stdout,"FAIL:NAXIS1 is missing or not %d.\n",Columns);
+		retval = FALSE;
+	}
+	card = Test_Find_Card(header,header_length,"NAXIS2");
+	if((card == NULL)||(sscanf(card+10,"%d",&value) != 1)||(value != Rows))
+	{
+		fprintf(stdout,"FAIL:NAXIS2 is missing or not %d.\n",Rows);
+		retval = FALSE;
+	}
+	return retval;
+}
+
+/**
+ * Routine to check the saved data against the read out data. The read out data is de-interlaced, and each saved
+ * pixel decoded from big-endian, BZERO offset FITS data and compared with it. The saved padding must be zero.
+ * @param handle The handle of the opened controller, used to get the read out data.
+ * @param fits_data The saved data, following the header.
+ * @return The routine returns TRUE if the data is correct, and FALSE if it is not.
+ * @see #TEST_BYTE_SWAP
+ * @see #TEST_FITS_BZERO
+ * @see #TEST_FITS_BLOCK_LENGTH
+ */
+static int Test_Check_Data(CCD_Interface_Handle_T *handle,unsigned char *fits_data)
+{
+	unsigned short *exposure_data = NULL;
+	unsigned short *image_data = NULL;
+	unsigned short value;
+	int i,pixel_count,padding_length,error_count;
+
+	if(!CCD_Interface_Get_Reply_Data(handle,&exposure_data))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	pixel_count = Columns*Rows;
+	image_data = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+	if(image_data == NULL)
+	{
+		fprintf(stdout,"FAIL:Failed to allocate image.\n");
+		return FALSE;
+	}
+	if(!CCD_Exposure_DeInterlace("test_exposure_direct_save","-",Columns,Rows,exposure_data,image_data,
+				     CCD_DSP_DEINTERLACE_SINGLE,TEST_BYTE_SWAP))
+	{
+		CCD_Global_Error();
+		free(image_data);
+		return FALSE;
+	}
+	error_count = 0;
+	for(i=0;i<pixel_count;i++)
+	{
+		value = (unsigned short)(((fits_data[2*i] << 8)|fits_data[(2*i)+1]) ^ TEST_FITS_BZERO);
+		if(value != image_data[i])
+		{
+			if(error_count == 0)
+			{
+				fprintf(stdout,"FAIL:Pixel %d saved as %hu, read out as %hu.\n",i,value,
+					image_data[i]);
+			}
+			error_count++;
+		}
+	}
+	free(image_data);
+	padding_length = (TEST_FITS_BLOCK_LENGTH-((pixel_count*2)%TEST_FITS_BLOCK_LENGTH))%TEST_FITS_BLOCK_LENGTH;
+	for(i=0;i<padding_length;i++)
+	{
+		if(fits_data[(pixel_count*2)+i] != 0)
+		{
+			fprintf(stdout,"FAIL:Padding byte %d is %d, not zero.\n",i,fits_data[(pixel_count*2)+i]);
+			error_count++;
+			break;
+		}
+	}
+	if(error_count > 0)
+	{
+		fprintf(stdout,"FAIL:%d of %d pixels differ.\n",error_count,pixel_count);
+		return FALSE;
+	}
+	fprintf(stdout,"%d pixels match the read out data.\n",pixel_count);
+	return TRUE;
+}
+
+/**
+ * Internal routine that writes a minimal FITS header to the filename, followed by TEST_STALE_LENGTH bytes that
+ * the save should truncate away. CFITSIO is not used, as the direct FITS writer does not need it.
+ * @param filename The filename to save the FITS headers in.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ * @see #TEST_FITS_BLOCK_LENGTH
+ * @see #TEST_FITS_CARD_LENGTH
+ * @see #TEST_STALE_LENGTH
+ */
+static int Test_Save_Fits_Headers(char *filename)
+{
+	char header[TEST_FITS_BLOCK_LENGTH+1];
+	char stale[TEST_FITS_BLOCK_LENGTH];
+	char card[TEST_FITS_CARD_LENGTH+1];
+	FILE *fp = NULL;
+	int i,card_count = 0;
+
+	memset(header,' ',TEST_FITS_BLOCK_LENGTH);
+	sprintf(card,"%-8s= %20s","SIMPLE","T");
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	sprintf(card,"%-8s= %20d","BITPIX",16);
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	sprintf(card,"%-8s= %20d","NAXIS",2);
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	sprintf(card,"%-8s= %20d","NAXIS1",Columns);
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	sprintf(card,"%-8s= %20d","NAXIS2",Rows);
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	sprintf(card,"%-8s= %20.1f","BZERO",(double)TEST_FITS_BZERO);
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	sprintf(card,"%-8s= %20.1f","BSCALE",1.0);
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	sprintf(card,"%-8s= %20d","EXPTIME",Exposure_Length);
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),card,strlen(card));
+	memcpy(header+((card_count++)*TEST_FITS_CARD_LENGTH),"END",3);
+	memset(stale,0xff,TEST_FITS_BLOCK_LENGTH);
+	fp = fopen(filename,"wb");
+	if(fp == NULL)
+	{
+		fprintf(stdout,"FAIL:Failed to open %s.\n",filename);
+		return FALSE;
+	}
+	fwrite(header,1,TEST_FITS_BLOCK_LENGTH,fp);
+	for(i=0;i<TEST_STALE_LENGTH;i+=TEST_FITS_BLOCK_LENGTH)
+		fwrite(stale,1,TEST_FITS_BLOCK_LENGTH,fp);
+	if(fclose(fp) != 0)
+	{
+		fprintf(stdout,"FAIL:Failed to write %s.\n",filename);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to find the header card with the specified keyword.
+ * @param header The header.
+ * @param header_length The length of the header, a multiple of the FITS card length.
+ * @param keyword The keyword to look for.
+ * @return A pointer to the start of the card, or NULL if the keyword was not found.
+ * @see #TEST_FITS_CARD_LENGTH
+ */
+static char *Test_Find_Card(char *header,int header_length,char *keyword)
+{
+	int i,keyword_length;
+
+	keyword_length = strlen(keyword);
+	for(i=0;i<header_length;i+=TEST_FITS_CARD_LENGTH)
+	{
+		if((strncmp(header+i,keyword,keyword_length) == 0)&&
+		   ((keyword_length == 8)||(header[i+keyword_length] == ' ')||(header[i+keyword_length] == '=')))
+			return header+i;
+	}
+	return NULL;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Exposure_Length
+ * @see #Columns
+ * @see #Rows
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-columns")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Columns);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal columns %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:columns requires a number of pixels.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-exposure_length")==0)||(strcmp(argv[i],"-e")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Length);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal exposure length %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:exposure length requires a number of milliseconds.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-help")==0)
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-rows")==0)||(strcmp(argv[i],"-r")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Rows);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal rows %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:rows requires a number of pixels.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Exposure Direct Save:Help.\n");
+	fprintf(stdout,"This program tests the direct FITS writer saves an unwindowed exposure correctly.\n");
+	fprintf(stdout,"The library must be built with CCD_EXPOSURE_DIRECT_SAVE defined.\n");
+	fprintf(stdout,"test_exposure_direct_save [-e[xposure_length] <ms>] [-c[olumns] <pixels>] "
+		"[-r[ows] <pixels>] [-help]\n");
+}
+
+/*
+** $Log$
+*/
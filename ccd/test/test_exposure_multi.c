@@ -0,0 +1,414 @@
+/* test_exposure_multi.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_setup.h"
+#include "ccd_text.h"
+#include "fitsio.h"
+
+/**
+ * This program tests CCD_Exposure_Expose_Multi, which takes synchronised exposures on several controllers.
+ * Two text devices are opened and setup, as the red and blue arms. A synchronised exposure is then taken
+ * on both, starting a short way in the future. Both exposures should succeed, and both should start within
+ * the tolerance of the requested start time. The start time returned for each arm should be the arm's
+ * exposure start time, and the start skew between the arms should also be within the tolerance.
+ * A second synchronised exposure is then taken, with an illegal filename count for the second arm. 
+ * The first arm should still succeed, the second should fail (without being started), and
+ * CCD_Exposure_Expose_Multi should return FALSE.
+ * <pre>
+ * test_exposure_multi [-e[xposure_length] &lt;ms&gt;] [-d[elay] &lt;ms&gt;] [-t[olerance] &lt;us&gt;] [-help]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The number of arms (controllers) to expose with.
+ */
+#define TEST_ARM_COUNT		(2)
+/**
+ * The number of columns in each CCD.
+ */
+#define TEST_SIZE_X		(256)
+/**
+ * The number of rows in each CCD.
+ */
+#define TEST_SIZE_Y		(256)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The length of each exposure, in milliseconds.
+ */
+static int Exposure_Length = 1000;
+/**
+ * How far in the future to start each exposure, in milliseconds.
+ */
+static int Start_Delay = 1500;
+/**
+ * How close the exposure start times must be to the requested start time, in microseconds.
+ */
+static int Tolerance = 20000;
+
+/* internal routines */
+static int Test_Setup(int arm,CCD_Interface_Handle_T **handle);
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Setup
+ * @see #Test_Save_Fits_Headers
+ */
+int main(int argc, char *argv[])
+{
+	struct CCD_Exposure_Multi_Struct multi_list[TEST_ARM_COUNT];
+	CCD_Interface_Handle_T *handle_list[TEST_ARM_COUNT];
+	char filename[TEST_ARM_COUNT][256];
+	char *filename_list[TEST_ARM_COUNT][1];
+	struct timespec start_time;
+	double skew;
+	int i,retval,fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_exposure_multi:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	for(i=0;i<TEST_ARM_COUNT;i++)
+	{
+		if(!Test_Setup(i,&(handle_list[i])))
+			return 2;
+		sprintf(filename[i],"test_exposure_multi_%d.fits",i);
+		filename_list[i][0] = filename[i];
+		multi_list[i].Handle = handle_list[i];
+		multi_list[i].Filename_List = filename_list[i];
+		multi_list[i].Filename_Count = 1;
+	}
+	/* synchronised exposure on all arms */
+	for(i=0;i<TEST_ARM_COUNT;i++)
+	{
+		if(!Test_Save_Fits_Headers(Exposure_Length,TEST_SIZE_X,TEST_SIZE_Y,filename[i]))
+			return 3;
+	}
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	start_time.tv_sec += Start_Delay/1000;
+	start_time.tv_nsec += (Start_Delay%1000)*1000000;
+	if(start_time.tv_nsec >= 1000000000)
+	{
+		start_time.tv_sec++;
+		start_time.tv_nsec -= 1000000000;
+	}
+	retval = CCD_Exposure_Expose_Multi("test_exposure_multi","-",multi_list,TEST_ARM_COUNT,TRUE,TRUE,start_time,
+					   Exposure_Length);
+	if(retval == FALSE)
+	{
+		fprintf(stdout,"FAIL:Synchronised exposure failed.\n");
+		CCD_Global_Error();
+		fail_count++;
+	}
+	for(i=0;i<TEST_ARM_COUNT;i++)
+	{
+		if(multi_list[i].Successful == FALSE)
+		{
+			fprintf(stdout,"FAIL:Arm %d failed:%s\n",i,multi_list[i].Error_String);
+			fail_count++;
+		}
+		skew = Time_Difference(start_time,multi_list[i].Exposure_Start_Time);
+		fprintf(stdout,"Arm %d:Start time skew %.3f ms, %.3f ms after the first arm.\n",i,skew,
+			multi_list[i].Start_Skew);
+		if(Time_Difference(multi_list[i].Exposure_Start_Time,
+				   CCD_Exposure_Get_Exposure_Start_Time(handle_list[i])) != 0.0)
+		{
+			fprintf(stdout,"FAIL:Arm %d:Returned start time is not the exposure start time.\n",i);
+			fail_count++;
+		}
+		if(skew < 0.0)
+			skew = -skew;
+		if(skew > (((double)Tolerance)/1000.0))
+		{
+			fprintf(stdout,"FAIL:Arm %d:Start time skew %.3f ms is more than %d us.\n",i,skew,Tolerance);
+			fail_count++;
+		}
+		if((multi_list[i].Start_Skew < 0.0)||(multi_list[i].Start_Skew > (((double)Tolerance)/1000.0)))
+		{
+			fprintf(stdout,"FAIL:Arm %d:Skew after the first arm %.3f ms is not between 0 and %d us.\n",i,
+				multi_list[i].Start_Skew,Tolerance);
+			fail_count++;
+		}
+		if(CCD_Exposure_Get_Exposure_Status(handle_list[i]) != CCD_EXPOSURE_STATUS_NONE)
+		{
+			fprintf(stdout,"FAIL:Arm %d:Exposure status %d after exposure.\n",i,
+				CCD_Exposure_Get_Exposure_Status(handle_list[i]));
+			fail_count++;
+		}
+	}
+	/* the second arm fails, the first should still succeed */
+	for(i=0;i<TEST_ARM_COUNT;i++)
+	{
+		if(!Test_Save_Fits_Headers(Exposure_Length,TEST_SIZE_X,TEST_SIZE_Y,filename[i]))
+			return 3;
+	}
+	multi_list[1].Filename_Count = 2;
+	start_time.tv_sec = 0;
+	start_time.tv_nsec = 0;
+	retval = CCD_Exposure_Expose_Multi("test_exposure_multi","-",multi_list,TEST_ARM_COUNT,TRUE,TRUE,start_time,
+					   Exposure_Length);
+	if(retval == TRUE)
+	{
+		fprintf(stdout,"FAIL:Synchronised exposure with a failed arm returned TRUE.\n");
+		fail_count++;
+	}
+	else
+	{
+		fprintf(stdout,"Synchronised exposure with a failed arm returned FALSE:");
+		CCD_Global_Error();
+	}
+	if(multi_list[0].Successful == FALSE)
+	{
+		fprintf(stdout,"FAIL:Arm 0 failed:%s\n",multi_list[0].Error_String);
+		fail_count++;
+	}
+	if((multi_list[1].Successful == TRUE)||(strlen(multi_list[1].Error_String) == 0))
+	{
+		fprintf(stdout,"FAIL:Arm 1 did not fail, or has no error string.\n");
+		fail_count++;
+	}
+	if((multi_list[1].Exposure_Start_Time.tv_sec != 0)||(multi_list[1].Start_Skew != 0.0))
+	{
+		fprintf(stdout,"FAIL:Arm 1 failed before starting, but has a start time.\n");
+		fail_count++;
+	}
+	for(i=0;i<TEST_ARM_COUNT;i++)
+	{
+		if(!CCD_Interface_Close("test_exposure_multi","-",&(handle_list[i])))
+		{
+			CCD_Global_Error();
+			fail_count++;
+		}
+		unlink(filename[i]);
+	}
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 4;
+	return 0;
+}
+
+/**
+ * Routine to open and setup one of the arms, using a text device.
+ * @param arm The number of the arm, used to make the text device pathname.
+ * @param handle The address of a handle pointer, filled in with the opened handle.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ * @see #TEST_SIZE_X
+ * @see #TEST_SIZE_Y
+ */
+static int Test_Setup(int arm,CCD_Interface_Handle_T **handle)
+{
+	struct CCD_Setup_Window_Struct window_list[CCD_SETUP_WINDOW_COUNT];
+	char device_pathname[256];
+
+	sprintf(device_pathname,"test_exposure_multi_%d.txt",arm);
+	if(!CCD_Interface_Open("test_exposure_multi","-",CCD_INTERFACE_DEVICE_TEXT,device_pathname,handle))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	if(!CCD_Setup_Startup("test_exposure_multi","-",(*handle),CCD_SETUP_LOAD_ROM,NULL,CCD_SETUP_LOAD_ROM,0,
+			      NULL,CCD_SETUP_LOAD_ROM,0,NULL,-110.0,CCD_DSP_GAIN_ONE,TRUE,TRUE))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_multi","-",handle);
+		return FALSE;
+	}
+	memset(window_list,0,sizeof(window_list));
+	if(!CCD_Setup_Dimensions("test_exposure_multi","-",(*handle),TEST_SIZE_X,TEST_SIZE_Y,1,1,
+				 CCD_DSP_AMPLIFIER_BOTH,CCD_DSP_DEINTERLACE_SPLIT_SERIAL,0,window_list))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_multi","-",handle);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Exposure_Length
+ * @see #Start_Delay
+ * @see #Tolerance
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-help")==0)
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-exposure_length")==0)||(strcmp(argv[i],"-e")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Length);
+				if((retval != 1)||(Exposure_Length < 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal exposure length %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Exposure length requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-delay")==0)||(strcmp(argv[i],"-d")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Start_Delay);
+				if((retval != 1)||(Start_Delay < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal delay %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Delay requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-tolerance")==0)||(strcmp(argv[i],"-t")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Tolerance);
+				if((retval != 1)||(Tolerance < 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal tolerance %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Tolerance requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Exposure Multi:Help.\n");
+	fprintf(stdout,"This program tests synchronised exposures on two controllers.\n");
+	fprintf(stdout,"test_exposure_multi [-e[xposure_length] <ms>][-d[elay] <ms>][-t[olerance] <us>][-help]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-exposure_length is the length of each exposure, in milliseconds.\n");
+	fprintf(stdout,"\t-delay is how far in the future to start the exposures, in milliseconds.\n");
+	fprintf(stdout,"\t-tolerance is how close to the requested start time exposures must start, in microseconds.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Internal routine that saves some basic FITS headers to the relevant filename.
+ * This is needed as CCD_Exposure_Expose_Multi needs saved FITS headers to not give an error.
+ * @param exposure_time The amount of time, in milliseconds, of the exposure.
+ * @param ncols The number of columns in the FITS file.
+ * @param nrows The number of rows in the FITS file.
+ * @param filename The filename to save the FITS headers in.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ */
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename)
+{
+	fitsfile *fits_fp = NULL;
+	int status = 0,ivalue;
+	double dvalue;
+
+/* open file, overwriting any old one */
+	unlink(filename);
+	if(fits_create_file(&fits_fp,filename,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	ivalue = TRUE;
+	fits_update_key(fits_fp,TLOGICAL,(char*)"SIMPLE",&ivalue,NULL,&status);
+	ivalue = 16;
+	fits_update_key(fits_fp,TINT,(char*)"BITPIX",&ivalue,NULL,&status);
+	ivalue = 2;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS",&ivalue,NULL,&status);
+	ivalue = ncols;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS1",&ivalue,NULL,&status);
+	ivalue = nrows;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS2",&ivalue,NULL,&status);
+	dvalue = 32768.0;
+	fits_update_key_fixdbl(fits_fp,(char*)"BZERO",dvalue,6,(char*)"Number to offset data values by",&status);
+	dvalue = 1.0;
+	fits_update_key_fixdbl(fits_fp,(char*)"BSCALE",dvalue,6,(char*)"Number to multiply data values by",&status);
+	ivalue = exposure_time;
+	fits_update_key(fits_fp,TINT,(char*)"EXPTIME",&ivalue,NULL,&status);
+	if(status != 0)
+	{
+		fits_report_error(stderr,status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	if(fits_close_file(fits_fp,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to return the difference between two times, in milliseconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The time difference in milliseconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/*
+** $Log$
+*/
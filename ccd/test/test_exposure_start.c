@@ -0,0 +1,282 @@
+/* test_exposure_start.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_text.h"
+
+/**
+ * This program tests the scheduling of exposure starts. A text device is opened, and a number of exposures
+ * are started at a time a short way in the future. After each exposure is started, the elapsed exposure time is
+ * read (RET), which measures the start latency. The exposure is then aborted. The start latency should have
+ * been measured once per exposure, and once it has been measured the exposure start time should be within
+ * the tolerance of the requested start time.
+ * <pre>
+ * test_exposure_start [-c[ount] &lt;n&gt;] [-d[elay] &lt;ms&gt;] [-t[olerance] &lt;us&gt;] [-help]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The length of each exposure, in milliseconds. This must be longer than the readout remaining time,
+ * so the exposure status is EXPOSE when the elapsed exposure time is read.
+ */
+#define TEST_EXPOSURE_LENGTH	(5000)
+/**
+ * How long after the exposure starts to read the elapsed exposure time, in milliseconds. The text device
+ * returns an elapsed exposure time of zero for the first second of an exposure, as the controller does.
+ */
+#define TEST_RET_DELAY		(1100)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The number of exposures to start.
+ */
+static int Exposure_Count = 5;
+/**
+ * How far in the future to start each exposure, in milliseconds.
+ */
+static int Start_Delay = 200;
+/**
+ * How close the exposure start time must be to the requested start time, in microseconds.
+ */
+static int Tolerance = 5000;
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static void Test_Sleep(int ms);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ */
+int main(int argc, char *argv[])
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	struct timespec start_time,current_time;
+	double skew,max_skew = 0.0;
+	int i,elapsed_exposure_time,fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_exposure_start:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	if(!CCD_Interface_Open("test_exposure_start","-",CCD_INTERFACE_DEVICE_TEXT,"test_exposure_start.txt",&handle))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	for(i=0;i<Exposure_Count;i++)
+	{
+		if(CCD_DSP_Command_SET("test_exposure_start","-",handle,TEST_EXPOSURE_LENGTH) != CCD_DSP_DON)
+		{
+			CCD_Global_Error();
+			return 3;
+		}
+		clock_gettime(CLOCK_REALTIME,&start_time);
+		start_time.tv_sec += Start_Delay/1000;
+		start_time.tv_nsec += (Start_Delay%1000)*1000000;
+		if(start_time.tv_nsec >= 1000000000)
+		{
+			start_time.tv_sec++;
+			start_time.tv_nsec -= 1000000000;
+		}
+		if(CCD_DSP_Command_SEX("test_exposure_start","-",handle,start_time,TEST_EXPOSURE_LENGTH) != CCD_DSP_DON)
+		{
+			CCD_Global_Error();
+			return 4;
+		}
+		clock_gettime(CLOCK_REALTIME,&current_time);
+		fprintf(stdout,"Exposure %d:SEX returned %.3f ms after the start time.\n",i,
+			Time_Difference(start_time,current_time));
+		Test_Sleep(TEST_RET_DELAY);
+		elapsed_exposure_time = CCD_DSP_Command_RET("test_exposure_start","-",handle);
+		if(elapsed_exposure_time <= 0)
+		{
+			fprintf(stdout,"FAIL:Exposure %d:RET returned %d.\n",i,elapsed_exposure_time);
+			fail_count++;
+		}
+		if(CCD_Exposure_Get_Start_Exposure_Latency_Count(handle) != (i+1))
+		{
+			fprintf(stdout,"FAIL:Exposure %d:Start latency measured %d times.\n",i,
+				CCD_Exposure_Get_Start_Exposure_Latency_Count(handle));
+			fail_count++;
+		}
+		skew = Time_Difference(start_time,CCD_Exposure_Get_Exposure_Start_Time(handle));
+		fprintf(stdout,"Exposure %d:Elapsed exposure time %d ms, start latency %d ns, start time skew %.3f ms.\n",
+			i,elapsed_exposure_time,CCD_Exposure_Get_Start_Exposure_Latency(handle),skew);
+		if(skew < 0.0)
+			skew = -skew;
+		/* the first exposure is sent using the start exposure offset time, before any latency is measured */
+		if(i > 0)
+		{
+			if(skew > max_skew)
+				max_skew = skew;
+			if(skew > (((double)Tolerance)/1000.0))
+			{
+				fprintf(stdout,"FAIL:Exposure %d:Start time skew %.3f ms is more than %d us.\n",i,skew,
+					Tolerance);
+				fail_count++;
+			}
+		}
+		if(CCD_DSP_Command_AEX("test_exposure_start","-",handle) != CCD_DSP_DON)
+		{
+			CCD_Global_Error();
+			return 5;
+		}
+		CCD_Exposure_Set_Exposure_Status(handle,CCD_EXPOSURE_STATUS_NONE);
+	}
+	fprintf(stdout,"Maximum start time skew %.3f ms.\n",max_skew);
+	if(!CCD_Interface_Close("test_exposure_start","-",&handle))
+	{
+		CCD_Global_Error();
+		fail_count++;
+	}
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 6;
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Exposure_Count
+ * @see #Start_Delay
+ * @see #Tolerance
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-help")==0)
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-count")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Count);
+				if((retval != 1)||(Exposure_Count < 2))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal count %s (at least 2).\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-delay")==0)||(strcmp(argv[i],"-d")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Start_Delay);
+				if((retval != 1)||(Start_Delay < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal delay %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Delay requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-tolerance")==0)||(strcmp(argv[i],"-t")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Tolerance);
+				if((retval != 1)||(Tolerance < 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal tolerance %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Tolerance requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Exposure Start:Help.\n");
+	fprintf(stdout,"This program tests exposures start at the requested start time.\n");
+	fprintf(stdout,"test_exposure_start [-c[ount] <n>][-d[elay] <ms>][-t[olerance] <us>][-help]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-count is the number of exposures to start (at least 2).\n");
+	fprintf(stdout,"\t-delay is how far in the future to start each exposure, in milliseconds.\n");
+	fprintf(stdout,"\t-tolerance is how close to the requested start time exposures must start, in microseconds.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Routine to sleep for the specified number of milliseconds.
+ * @param ms The number of milliseconds to sleep for.
+ */
+static void Test_Sleep(int ms)
+{
+	struct timespec sleep_time;
+
+	sleep_time.tv_sec = ms/1000;
+	sleep_time.tv_nsec = (ms%1000)*1000000;
+	nanosleep(&sleep_time,NULL);
+}
+
+/**
+ * Routine to return the difference between two times, in milliseconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The time difference in milliseconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,412 @@
+/* test_exposure_status.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_setup.h"
+#include "ccd_text.h"
+#include "fitsio.h"
+
+/**
+ * This program tests the exposure status snapshot, CCD_Exposure_Get_Status_Snapshot. A text device is
+ * opened and setup, and a poller thread reads the status snapshot as fast as it can whilst a series of
+ * exposures are taken, each shorter than the last. Each snapshot is checked to be self consistent:
+ * <ul>
+ * <li>The exposure status is legal, and the start time stamp normalised.
+ * <li>The elapsed exposure time is not more than the exposure length in the same snapshot.
+ * Because each exposure is shorter than the last, a snapshot mixing an elapsed time from one exposure
+ * with the length of the next would fail this test.
+ * <li>The readout progress percentage matches the pixel counts in the same snapshot.
+ * </ul>
+ * After each exposure the snapshot should show no exposure in progress, and the readout completed.
+ * <pre>
+ * test_exposure_status [-e[xposure_length] &lt;ms&gt;] [-c[ount] &lt;n&gt;] [-help]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The number of columns in the CCD.
+ */
+#define TEST_SIZE_X		(256)
+/**
+ * The number of rows in the CCD.
+ */
+#define TEST_SIZE_Y		(256)
+/**
+ * The amount each exposure is shorter than the last, in milliseconds.
+ */
+#define TEST_EXPOSURE_STEP	(200)
+/**
+ * The FITS filename to save exposures into.
+ */
+#define TEST_FILENAME		("test_exposure_status.fits")
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The opened text device handle.
+ */
+static CCD_Interface_Handle_T *Handle = NULL;
+/**
+ * The length of the first exposure, in milliseconds. The exposures should be longer than the
+ * library's readout remaining time (1500 ms by default), or they go straight into READOUT status.
+ */
+static int Exposure_Length = 2400;
+/**
+ * The number of exposures to take.
+ */
+static int Exposure_Count = 3;
+/**
+ * Set to TRUE to stop the poller thread.
+ */
+static volatile int Poll_Quit = FALSE;
+/**
+ * The number of snapshots read by the poller thread.
+ */
+static int Poll_Count = 0;
+/**
+ * The number of inconsistent snapshots read by the poller thread.
+ */
+static int Poll_Fail_Count = 0;
+/**
+ * The number of snapshots read whilst the exposure status was EXPOSE.
+ */
+static int Poll_Expose_Count = 0;
+
+/* internal routines */
+static void *Test_Poll_Thread(void *user_arg);
+static int Test_Check_Snapshot(struct CCD_Exposure_Status_Struct *status_snapshot);
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Poll_Thread
+ * @see #Test_Save_Fits_Headers
+ */
+int main(int argc, char *argv[])
+{
+	struct CCD_Setup_Window_Struct window_list[CCD_SETUP_WINDOW_COUNT];
+	struct CCD_Exposure_Status_Struct status_snapshot;
+	struct timespec start_time;
+	pthread_t poll_thread;
+	char *filename_list[1];
+	int i,length,fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_exposure_status:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	if(!CCD_Interface_Open("test_exposure_status","-",CCD_INTERFACE_DEVICE_TEXT,"test_exposure_status.txt",
+			       &Handle))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	if(!CCD_Setup_Startup("test_exposure_status","-",Handle,CCD_SETUP_LOAD_ROM,NULL,CCD_SETUP_LOAD_ROM,0,
+			      NULL,CCD_SETUP_LOAD_ROM,0,NULL,-110.0,CCD_DSP_GAIN_ONE,TRUE,TRUE))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_status","-",&Handle);
+		return 2;
+	}
+	memset(window_list,0,sizeof(window_list));
+	if(!CCD_Setup_Dimensions("test_exposure_status","-",Handle,TEST_SIZE_X,TEST_SIZE_Y,1,1,
+				 CCD_DSP_AMPLIFIER_BOTH,CCD_DSP_DEINTERLACE_SPLIT_SERIAL,0,window_list))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_status","-",&Handle);
+		return 2;
+	}
+	if(pthread_create(&poll_thread,NULL,Test_Poll_Thread,NULL) != 0)
+	{
+		fprintf(stderr,"test_exposure_status:Failed to create poller thread.\n");
+		CCD_Interface_Close("test_exposure_status","-",&Handle);
+		return 2;
+	}
+	filename_list[0] = TEST_FILENAME;
+	start_time.tv_sec = 0;
+	start_time.tv_nsec = 0;
+	for(i=0;i<Exposure_Count;i++)
+	{
+		length = Exposure_Length-(i*TEST_EXPOSURE_STEP);
+		if(!Test_Save_Fits_Headers(length,TEST_SIZE_X,TEST_SIZE_Y,TEST_FILENAME))
+		{
+			fail_count++;
+			break;
+		}
+		fprintf(stdout,"Exposure %d of length %d ms.\n",i,length);
+		if(!CCD_Exposure_Expose("test_exposure_status","-",Handle,TRUE,TRUE,start_time,length,filename_list,1))
+		{
+			fprintf(stdout,"FAIL:Exposure %d failed.\n",i);
+			CCD_Global_Error();
+			fail_count++;
+			continue;
+		}
+		CCD_Exposure_Get_Status_Snapshot(Handle,&status_snapshot);
+		fprintf(stdout,"Exposure %d:status %d,length %d,elapsed %d,progress %.2f%% (%d of %d).\n",i,
+			status_snapshot.Exposure_Status,status_snapshot.Exposure_Length,
+			status_snapshot.Elapsed_Exposure_Time,status_snapshot.Readout_Progress,
+			status_snapshot.Readout_Pixel_Count,status_snapshot.Expected_Pixel_Count);
+		if((status_snapshot.Exposure_Status != CCD_EXPOSURE_STATUS_NONE)||
+		   (status_snapshot.Exposure_Length != length)||
+		   (status_snapshot.Elapsed_Exposure_Time != length)||
+		   (status_snapshot.Readout_Progress != 100.0)||
+		   (status_snapshot.Expected_Pixel_Count != (TEST_SIZE_X*TEST_SIZE_Y)))
+		{
+			fprintf(stdout,"FAIL:Exposure %d:Snapshot not complete after the exposure.\n",i);
+			fail_count++;
+		}
+	}
+	Poll_Quit = TRUE;
+	pthread_join(poll_thread,NULL);
+	fprintf(stdout,"Poller read %d snapshots, %d whilst exposing, %d inconsistent.\n",Poll_Count,
+		Poll_Expose_Count,Poll_Fail_Count);
+	if(Poll_Fail_Count > 0)
+		fail_count++;
+	if(Poll_Expose_Count == 0)
+	{
+		fprintf(stdout,"FAIL:Poller never saw the exposure status EXPOSE.\n");
+		fail_count++;
+	}
+	if(!CCD_Interface_Close("test_exposure_status","-",&Handle))
+	{
+		CCD_Global_Error();
+		fail_count++;
+	}
+	unlink(TEST_FILENAME);
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 4;
+	return 0;
+}
+
+/**
+ * Poller thread. Reads the status snapshot as fast as it can until Poll_Quit is set, checking each one.
+ * @param user_arg Not used.
+ * @return The routine returns NULL.
+ * @see #Test_Check_Snapshot
+ * @see #Poll_Quit
+ */
+static void *Test_Poll_Thread(void *user_arg)
+{
+	struct CCD_Exposure_Status_Struct status_snapshot;
+
+	while(Poll_Quit == FALSE)
+	{
+		CCD_Exposure_Get_Status_Snapshot(Handle,&status_snapshot);
+		Poll_Count++;
+		if(status_snapshot.Exposure_Status == CCD_EXPOSURE_STATUS_EXPOSE)
+			Poll_Expose_Count++;
+		if(!Test_Check_Snapshot(&status_snapshot))
+			Poll_Fail_Count++;
+	}
+	return NULL;
+}
+
+/**
+ * Routine to check a status snapshot is self consistent.
+ * @param status_snapshot The snapshot to check.
+ * @return The routine returns TRUE if the snapshot is consistent, and FALSE if it is not.
+ */
+static int Test_Check_Snapshot(struct CCD_Exposure_Status_Struct *status_snapshot)
+{
+	double progress;
+
+	if(!CCD_EXPOSURE_IS_STATUS(status_snapshot->Exposure_Status))
+	{
+		fprintf(stdout,"FAIL:Snapshot has illegal status %d.\n",status_snapshot->Exposure_Status);
+		return FALSE;
+	}
+	if((status_snapshot->Exposure_Start_Time.tv_nsec < 0)||
+	   (status_snapshot->Exposure_Start_Time.tv_nsec >= 1000000000))
+	{
+		fprintf(stdout,"FAIL:Snapshot has illegal start time nanoseconds %ld.\n",
+			status_snapshot->Exposure_Start_Time.tv_nsec);
+		return FALSE;
+	}
+	if((status_snapshot->Elapsed_Exposure_Time < 0)||
+	   (status_snapshot->Elapsed_Exposure_Time > status_snapshot->Exposure_Length))
+	{
+		fprintf(stdout,"FAIL:Snapshot elapsed time %d is not within the exposure length %d.\n",
+			status_snapshot->Elapsed_Exposure_Time,status_snapshot->Exposure_Length);
+		return FALSE;
+	}
+	if(status_snapshot->Expected_Pixel_Count > 0)
+	{
+		progress = (100.0*((double)status_snapshot->Readout_Pixel_Count))/
+			((double)status_snapshot->Expected_Pixel_Count);
+		if(progress > 100.0)
+			progress = 100.0;
+	}
+	else
+		progress = 0.0;
+	if(progress != status_snapshot->Readout_Progress)
+	{
+		fprintf(stdout,"FAIL:Snapshot progress %.3f%% does not match pixel count %d of %d.\n",
+			status_snapshot->Readout_Progress,status_snapshot->Readout_Pixel_Count,
+			status_snapshot->Expected_Pixel_Count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Exposure_Length
+ * @see #Exposure_Count
+ * @see #TEST_EXPOSURE_STEP
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-help")==0)
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-exposure_length")==0)||(strcmp(argv[i],"-e")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Length);
+				if((retval != 1)||(Exposure_Length < 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal exposure length %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Exposure length requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-count")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Count);
+				if((retval != 1)||(Exposure_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal count %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	if((Exposure_Length-((Exposure_Count-1)*TEST_EXPOSURE_STEP)) < 0)
+	{
+		fprintf(stderr,"Parse_Arguments:Exposure length %d too short for %d exposures.\n",
+			Exposure_Length,Exposure_Count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Exposure Status:Help.\n");
+	fprintf(stdout,"This program tests the exposure status snapshot is consistent whilst exposing.\n");
+	fprintf(stdout,"test_exposure_status [-e[xposure_length] <ms>][-c[ount] <n>][-help]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-exposure_length is the length of the first exposure, in milliseconds.\n");
+	fprintf(stdout,"\t\tEach exposure is %d milliseconds shorter than the last.\n",TEST_EXPOSURE_STEP);
+	fprintf(stdout,"\t-count is the number of exposures to take.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Internal routine that saves some basic FITS headers to the relevant filename.
+ * This is needed as CCD_Exposure_Expose needs saved FITS headers to not give an error.
+ * @param exposure_time The amount of time, in milliseconds, of the exposure.
+ * @param ncols The number of columns in the FITS file.
+ * @param nrows The number of rows in the FITS file.
+ * @param filename The filename to save the FITS headers in.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ */
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename)
+{
+	fitsfile *fits_fp = NULL;
+	int status = 0,ivalue;
+	double dvalue;
+
+/* open file, overwriting any old one */
+	unlink(filename);
+	if(fits_create_file(&fits_fp,filename,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	ivalue = TRUE;
+	fits_update_key(fits_fp,TLOGICAL,(char*)"SIMPLE",&ivalue,NULL,&status);
+	ivalue = 16;
+	fits_update_key(fits_fp,TINT,(char*)"BITPIX",&ivalue,NULL,&status);
+	ivalue = 2;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS",&ivalue,NULL,&status);
+	ivalue = ncols;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS1",&ivalue,NULL,&status);
+	ivalue = nrows;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS2",&ivalue,NULL,&status);
+	dvalue = 32768.0;
+	fits_update_key_fixdbl(fits_fp,(char*)"BZERO",dvalue,6,(char*)"Number to offset data values by",&status);
+	dvalue = 1.0;
+	fits_update_key_fixdbl(fits_fp,(char*)"BSCALE",dvalue,6,(char*)"Number to multiply data values by",&status);
+	ivalue = exposure_time;
+	fits_update_key(fits_fp,TINT,(char*)"EXPTIME",&ivalue,NULL,&status);
+	if(status != 0)
+	{
+		fits_report_error(stderr,status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	if(fits_close_file(fits_fp,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,326 @@
+/* test_exposure_window.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_setup.h"
+#include "ccd_text.h"
+#include "fitsio.h"
+
+/**
+ * This program tests windowed exposures, where each window is de-interlaced and saved in parallel.
+ * A text device is opened and setup with CCD_SETUP_WINDOW_COUNT windows, and an exposure taken for each
+ * combination of:
+ * <ul>
+ * <li>Single (left amplifier) and split serial (both amplifiers) de-interlacing. With single de-interlacing the
+ *     windows are saved directly from the read out data.
+ * <li>Synchronous and asynchronous saving.
+ * </ul>
+ * Each exposure should succeed, and every window's FITS file should exist afterwards.
+ * The POST_READOUT and SAVE stage times are printed.
+ * <pre>
+ * test_exposure_window [-e[xposure_length] &lt;ms&gt;] [-s[ize] &lt;pixels&gt;] [-help]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The number of columns in the CCD.
+ */
+#define TEST_SIZE_X		(2048)
+/**
+ * The number of rows in the CCD.
+ */
+#define TEST_SIZE_Y		(2048)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The length of each exposure, in milliseconds.
+ */
+static int Exposure_Length = 100;
+/**
+ * The width and height of each window, in pixels.
+ */
+static int Window_Size = 256;
+
+/* internal routines */
+static int Test_Window_Exposure(CCD_Interface_Handle_T *handle,enum CCD_DSP_AMPLIFIER amplifier,
+				enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,int async_save);
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Window_Exposure
+ */
+int main(int argc, char *argv[])
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	int async_save,fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_exposure_window:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	if(!CCD_Interface_Open("test_exposure_window","-",CCD_INTERFACE_DEVICE_TEXT,"test_exposure_window.txt",
+			       &handle))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	if(!CCD_Setup_Startup("test_exposure_window","-",handle,CCD_SETUP_LOAD_ROM,NULL,CCD_SETUP_LOAD_ROM,0,
+			      NULL,CCD_SETUP_LOAD_ROM,0,NULL,-110.0,CCD_DSP_GAIN_ONE,TRUE,TRUE))
+	{
+		CCD_Global_Error();
+		CCD_Interface_Close("test_exposure_window","-",&handle);
+		return 3;
+	}
+	for(async_save = FALSE; async_save <= TRUE; async_save++)
+	{
+		if(!Test_Window_Exposure(handle,CCD_DSP_AMPLIFIER_LEFT,CCD_DSP_DEINTERLACE_SINGLE,async_save))
+			fail_count++;
+		if(!Test_Window_Exposure(handle,CCD_DSP_AMPLIFIER_BOTH,CCD_DSP_DEINTERLACE_SPLIT_SERIAL,async_save))
+			fail_count++;
+	}
+	if(!CCD_Interface_Close("test_exposure_window","-",&handle))
+	{
+		CCD_Global_Error();
+		fail_count++;
+	}
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 4;
+	return 0;
+}
+
+/**
+ * Routine to setup CCD_SETUP_WINDOW_COUNT windows, take a windowed exposure, and check every window was saved.
+ * The windows are spread down the diagonal of the CCD.
+ * @param handle The handle of the opened controller.
+ * @param amplifier The amplifier to read out from.
+ * @param deinterlace_type The de-interlace type to use.
+ * @param async_save Whether to save the windows asynchronously.
+ * @return The routine returns TRUE if the test passes, and FALSE if it fails.
+ * @see #Window_Size
+ * @see #Test_Save_Fits_Headers
+ */
+static int Test_Window_Exposure(CCD_Interface_Handle_T *handle,enum CCD_DSP_AMPLIFIER amplifier,
+				enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,int async_save)
+{
+	struct CCD_Setup_Window_Struct window_list[CCD_SETUP_WINDOW_COUNT];
+	char filename[CCD_SETUP_WINDOW_COUNT][256];
+	char *filename_list[CCD_SETUP_WINDOW_COUNT];
+	struct timespec start_time;
+	struct stat file_stat;
+	int i,retval = TRUE;
+
+	for(i=0;i<CCD_SETUP_WINDOW_COUNT;i++)
+	{
+		window_list[i].X_Start = 1+(i*(Window_Size+1));
+		window_list[i].Y_Start = 1+(i*(Window_Size+1));
+		window_list[i].X_End = window_list[i].X_Start+Window_Size-1;
+		window_list[i].Y_End = window_list[i].Y_Start+Window_Size-1;
+	}
+	if(!CCD_Setup_Dimensions("test_exposure_window","-",handle,TEST_SIZE_X,TEST_SIZE_Y,1,1,amplifier,
+				 deinterlace_type,CCD_SETUP_WINDOW_ALL,window_list))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	if(!CCD_Exposure_Set_Async_Save(handle,async_save))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	for(i=0;i<CCD_SETUP_WINDOW_COUNT;i++)
+	{
+		sprintf(filename[i],"test_exposure_window_%d.fits",i);
+		filename_list[i] = filename[i];
+		if(!Test_Save_Fits_Headers(Exposure_Length,Window_Size,Window_Size,filename[i]))
+			return FALSE;
+	}
+	start_time.tv_sec = 0;
+	start_time.tv_nsec = 0;
+	if(!CCD_Exposure_Expose("test_exposure_window","-",handle,TRUE,TRUE,start_time,Exposure_Length,
+				filename_list,CCD_SETUP_WINDOW_COUNT))
+	{
+		fprintf(stdout,"FAIL:Deinterlace type %d,async save %d:Exposure failed.\n",deinterlace_type,async_save);
+		CCD_Global_Error();
+		retval = FALSE;
+	}
+	if(async_save)
+	{
+		if(!CCD_Exposure_Save_Wait("test_exposure_window","-",handle))
+		{
+			CCD_Global_Error();
+			retval = FALSE;
+		}
+	}
+	fprintf(stdout,"Deinterlace type %d,async save %d:Post readout %.3f ms,save %.3f ms.\n",deinterlace_type,
+		async_save,CCD_Exposure_Get_Stage_Time(handle,CCD_EXPOSURE_STAGE_POST_READOUT),
+		CCD_Exposure_Get_Stage_Time(handle,CCD_EXPOSURE_STAGE_SAVE));
+	for(i=0;i<CCD_SETUP_WINDOW_COUNT;i++)
+	{
+		if(stat(filename[i],&file_stat) != 0)
+		{
+			fprintf(stdout,"FAIL:Deinterlace type %d,async save %d:Window %d file %s does not exist.\n",
+				deinterlace_type,async_save,i,filename[i]);
+			retval = FALSE;
+		}
+		unlink(filename[i]);
+	}
+	return retval;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Exposure_Length
+ * @see #Window_Size
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-help")==0)
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-exposure_length")==0)||(strcmp(argv[i],"-e")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Length);
+				if((retval != 1)||(Exposure_Length < 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal exposure length %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Exposure length requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-size")==0)||(strcmp(argv[i],"-s")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Window_Size);
+				if((retval != 1)||(Window_Size < 16)||
+				   ((Window_Size+1)*CCD_SETUP_WINDOW_COUNT > TEST_SIZE_Y))
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal window size %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Window size requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Exposure Window:Help.\n");
+	fprintf(stdout,"This program tests windowed exposures are processed and saved.\n");
+	fprintf(stdout,"test_exposure_window [-e[xposure_length] <ms>][-s[ize] <pixels>][-help]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-exposure_length is the length of each exposure, in milliseconds.\n");
+	fprintf(stdout,"\t-size is the width and height of each window, in pixels.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Internal routine that saves some basic FITS headers to the relevant filename.
+ * This is needed as CCD_Exposure_Expose needs saved FITS headers to not give an error.
+ * @param exposure_time The amount of time, in milliseconds, of the exposure.
+ * @param ncols The number of columns in the FITS file.
+ * @param nrows The number of rows in the FITS file.
+ * @param filename The filename to save the FITS headers in.
+ * @return The routine returns TRUE if it succeeds, and FALSE if it fails.
+ */
+static int Test_Save_Fits_Headers(int exposure_time,int ncols,int nrows,char *filename)
+{
+	fitsfile *fits_fp = NULL;
+	int status = 0,ivalue;
+	double dvalue;
+
+/* open file, overwriting any old one */
+	unlink(filename);
+	if(fits_create_file(&fits_fp,filename,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	ivalue = TRUE;
+	fits_update_key(fits_fp,TLOGICAL,(char*)"SIMPLE",&ivalue,NULL,&status);
+	ivalue = 16;
+	fits_update_key(fits_fp,TINT,(char*)"BITPIX",&ivalue,NULL,&status);
+	ivalue = 2;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS",&ivalue,NULL,&status);
+	ivalue = ncols;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS1",&ivalue,NULL,&status);
+	ivalue = nrows;
+	fits_update_key(fits_fp,TINT,(char*)"NAXIS2",&ivalue,NULL,&status);
+	dvalue = 32768.0;
+	fits_update_key_fixdbl(fits_fp,(char*)"BZERO",dvalue,6,(char*)"Number to offset data values by",&status);
+	dvalue = 1.0;
+	fits_update_key_fixdbl(fits_fp,(char*)"BSCALE",dvalue,6,(char*)"Number to multiply data values by",&status);
+	ivalue = exposure_time;
+	fits_update_key(fits_fp,TINT,(char*)"EXPTIME",&ivalue,NULL,&status);
+	if(status != 0)
+	{
+		fits_report_error(stderr,status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	if(fits_close_file(fits_fp,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
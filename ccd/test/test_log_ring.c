@@ -0,0 +1,540 @@
+/* test_log_ring.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "ccd_global.h"
+
+/**
+ * This program tests the libfrodospec_ccd log ring (CCD_Global_Log_Ring_Start).
+ * Firstly, a list of log messages using different format conversions is logged through the ring,
+ * and the messages received by the log handler compared with the same message formatted by sprintf.
+ * Secondly, a number of threads log messages as fast as they can, and the number of messages received
+ * by the log handler plus the number dropped is checked against the number logged that pass the log filter.
+ * The time taken per message by the logging threads is printed, both with and without the log ring.
+ * With the log ring, this is done for a burst that fits in the ring, where no messages should be dropped,
+ * and for Message_Count messages per thread, which overruns the ring.
+ * The log handler sleeps for a short time per message, to simulate a slow handler (e.g. a JNI call).
+ * <pre>
+ * test_log_ring [-t[hreads] &lt;n&gt;] [-m[essages] &lt;n&gt;] [-d[elay] &lt;us&gt;] [-h[elp]]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The log level of messages logged that should pass the log filter.
+ */
+#define TEST_LEVEL_LOGGED	(1)
+/**
+ * The log level of messages logged that should be filtered out.
+ */
+#define TEST_LEVEL_FILTERED	(5)
+/**
+ * The log filter level set for this test.
+ */
+#define TEST_FILTER_LEVEL	(2)
+/**
+ * The length of the received message buffer.
+ */
+#define TEST_STRING_LENGTH	(1024)
+/**
+ * The number of messages that pass the filter logged by all the threads in the burst test. This is half
+ * the log ring length (GLOBAL_LOG_RING_LENGTH in ccd_global.c), so the burst fits in the ring even if 
+ * the log handler has not taken any messages off it.
+ */
+#define TEST_BURST_LOGGED_COUNT	(256)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The number of threads logging messages at once.
+ */
+static int Thread_Count = 4;
+/**
+ * The number of messages logged by each thread.
+ */
+static int Message_Count = 100000;
+/**
+ * The number of messages logged by each thread in the current Test_Threads test.
+ */
+static int Thread_Message_Count = 0;
+/**
+ * The time the log handler sleeps for per message, in microseconds.
+ */
+static int Handler_Delay = 10;
+/**
+ * The number of messages received by the log handler.
+ */
+static volatile int Received_Count = 0;
+/**
+ * A copy of the last message received by the log handler.
+ */
+static char Received_String[TEST_STRING_LENGTH];
+/**
+ * The expected message, formatted by sprintf.
+ */
+static char Expected_String[TEST_STRING_LENGTH];
+/**
+ * Mutex protecting Received_Count and Received_String.
+ */
+static pthread_mutex_t Received_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * The number of format tests that failed.
+ */
+static int Format_Fail_Count = 0;
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static void Test_Log_Handler(char *class,char *source,int level,char *string);
+static void Test_Format_Check(int count,char *format);
+static int Test_Formats(void);
+static int Test_Threads(int use_ring,int message_count,int drops_expected);
+static void *Test_Thread(void *user_arg);
+static int Get_Received_Count(void);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Log_Handler
+ * @see #Test_Formats
+ * @see #Test_Threads
+ */
+int main(int argc, char *argv[])
+{
+	int fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_log_ring:%s.\n",rcsid);
+	CCD_Global_Set_Log_Handler_Function(Test_Log_Handler);
+	CCD_Global_Set_Log_Filter_Function(CCD_Global_Log_Filter_Level_Absolute);
+	CCD_Global_Set_Log_Filter_Level(TEST_FILTER_LEVEL);
+	if(!CCD_Global_Log_Ring_Start())
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	if(!Test_Formats())
+		fail_count++;
+	if(!CCD_Global_Log_Ring_Stop())
+	{
+		CCD_Global_Error();
+		return 3;
+	}
+	if(!Test_Threads(FALSE,Message_Count,FALSE))
+		fail_count++;
+	/* half the messages are filtered out, so each thread logs twice its share of the burst */
+	if(!Test_Threads(TRUE,(2*TEST_BURST_LOGGED_COUNT)/Thread_Count,FALSE))
+		fail_count++;
+	if(!Test_Threads(TRUE,Message_Count,TRUE))
+		fail_count++;
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 4;
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Thread_Count
+ * @see #Message_Count
+ * @see #Handler_Delay
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-delay")==0)||(strcmp(argv[i],"-d")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Handler_Delay);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing delay %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Delay requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-messages")==0)||(strcmp(argv[i],"-m")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Message_Count);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing message count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Messages requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-threads")==0)||(strcmp(argv[i],"-t")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Thread_Count);
+				if((retval != 1)||(Thread_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing thread count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Threads requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Log Ring:Help.\n");
+	fprintf(stdout,"This program tests the libfrodospec_ccd log ring.\n");
+	fprintf(stdout,"test_log_ring [-t[hreads] <n>] [-m[essages] <n>] [-d[elay] <us>] [-h[elp]]\n");
+	fprintf(stdout,"\t-threads sets the number of threads logging at once.\n");
+	fprintf(stdout,"\t-messages sets the number of messages each thread logs.\n");
+	fprintf(stdout,"\t-delay sets the time the log handler takes per message, in microseconds.\n");
+}
+
+/**
+ * The log handler used for this test. It counts the number of messages received, copies the last message,
+ * and sleeps for Handler_Delay microseconds.
+ * @param class The class that produced this log message.
+ * @param source The source that produced this log message.
+ * @param level The log level for this message.
+ * @param string The log message to be logged.
+ * @see #Received_Count
+ * @see #Received_String
+ * @see #Received_Mutex
+ * @see #Handler_Delay
+ */
+static void Test_Log_Handler(char *class,char *source,int level,char *string)
+{
+	struct timespec sleep_time;
+
+	pthread_mutex_lock(&Received_Mutex);
+	Received_Count++;
+	strncpy(Received_String,string,TEST_STRING_LENGTH-1);
+	Received_String[TEST_STRING_LENGTH-1] = '\0';
+	pthread_mutex_unlock(&Received_Mutex);
+	if(Handler_Delay > 0)
+	{
+		sleep_time.tv_sec = Handler_Delay/1000000;
+		sleep_time.tv_nsec = (Handler_Delay%1000000)*CCD_GLOBAL_ONE_MICROSECOND_NS;
+		nanosleep(&sleep_time,NULL);
+	}
+}
+
+/**
+ * Routine to wait for the log handler to receive a message logged through the log ring,
+ * and compare it with the message formatted by sprintf (in Expected_String).
+ * @param count The number of messages received by the log handler before the message was logged.
+ * @param format The format string of the message, for error reporting.
+ * @see #Get_Received_Count
+ * @see #Received_String
+ * @see #Expected_String
+ * @see #Format_Fail_Count
+ */
+static void Test_Format_Check(int count,char *format)
+{
+	char buff[TEST_STRING_LENGTH];
+	struct timespec sleep_time;
+	int retry;
+
+	retry = 0;
+	while((Get_Received_Count() == count)&&(retry < 1000))
+	{
+		sleep_time.tv_sec = 0;
+		sleep_time.tv_nsec = CCD_GLOBAL_ONE_MILLISECOND_NS;
+		nanosleep(&sleep_time,NULL);
+		retry++;
+	}
+	pthread_mutex_lock(&Received_Mutex);
+	strcpy(buff,Received_String);
+	pthread_mutex_unlock(&Received_Mutex);
+	if(strcmp(buff,Expected_String) != 0)
+	{
+		fprintf(stdout,"Format '%s' failed:expected '%s' received '%s'.\n",format,Expected_String,buff);
+		Format_Fail_Count++;
+	}
+	else
+		fprintf(stdout,"Format '%s' OK:'%s'.\n",format,buff);
+}
+
+/**
+ * Test the log ring formats messages with a variety of conversions the same as sprintf.
+ * Each message is logged with CCD_Global_Log_Format, and Test_Format_Check called to compare the result.
+ * The last message has an unsupported conversion (long double), so is formatted by CCD_Global_Log_Format itself.
+ * @return The routine returns TRUE if all the messages were formatted correctly, and FALSE otherwise.
+ * @see #Test_Format_Check
+ * @see #Expected_String
+ * @see #Format_Fail_Count
+ */
+static int Test_Formats(void)
+{
+	char string_argument[32];
+	int count;
+
+	Format_Fail_Count = 0;
+	strcpy(string_argument,"a copied string");
+	count = Get_Received_Count();
+	sprintf(Expected_String,"literal %% only");
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"literal %% only");
+	Test_Format_Check(count,"literal %% only");
+
+	count = Get_Received_Count();
+	sprintf(Expected_String,"%d %5i %-5u| %x %X %o %c",-3,42,7u,255,255,8,'z');
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"%d %5i %-5u| %x %X %o %c",-3,42,7u,255,255,8,'z');
+	Test_Format_Check(count,"%d %5i %-5u| %x %X %o %c");
+
+	count = Get_Received_Count();
+	sprintf(Expected_String,"%ld %lu %lld %llx",-5L,6UL,-123456789012LL,0xabcdefULL);
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"%ld %lu %lld %llx",-5L,6UL,-123456789012LL,
+			      0xabcdefULL);
+	Test_Format_Check(count,"%ld %lu %lld %llx");
+
+	count = Get_Received_Count();
+	sprintf(Expected_String,"%f %.3e %10.2g %G",3.14159,12345.678,0.000123,1e20);
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"%f %.3e %10.2g %G",3.14159,12345.678,0.000123,1e20);
+	Test_Format_Check(count,"%f %.3e %10.2g %G");
+
+	count = Get_Received_Count();
+	sprintf(Expected_String,"%*d|%-*.*f|%.*s",6,42,10,3,2.5,2,"hello");
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"%*d|%-*.*f|%.*s",6,42,10,3,2.5,2,"hello");
+	Test_Format_Check(count,"%*d|%-*.*f|%.*s");
+
+	count = Get_Received_Count();
+	sprintf(Expected_String,"%s:%p",string_argument,(void*)string_argument);
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"%s:%p",string_argument,(void*)string_argument);
+	/* overwrite the string argument before it is formatted, it should have been copied */
+	strcpy(string_argument,"overwritten");
+	Test_Format_Check(count,"%s:%p");
+
+	count = Get_Received_Count();
+	sprintf(Expected_String,"%hd %hhu %#x %+d % d %05d",(short)-2,(unsigned char)250,16,5,5,42);
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"%hd %hhu %#x %+d % d %05d",(short)-2,
+			      (unsigned char)250,16,5,5,42);
+	Test_Format_Check(count,"%hd %hhu %#x %+d % d %05d");
+
+	count = Get_Received_Count();
+	sprintf(Expected_String,"%Lf",(long double)2.5);
+	CCD_Global_Log_Format("test","format",TEST_LEVEL_LOGGED,"%Lf",(long double)2.5);
+	Test_Format_Check(count,"%Lf");
+
+	count = Get_Received_Count();
+	strcpy(Expected_String,"CCD_Global_Log string");
+	CCD_Global_Log("test","format",TEST_LEVEL_LOGGED,"CCD_Global_Log string");
+	Test_Format_Check(count,"CCD_Global_Log");
+
+	fprintf(stdout,"Test_Formats:%d formats failed.\n",Format_Fail_Count);
+	return (Format_Fail_Count == 0);
+}
+
+/**
+ * Test many threads logging at once. Thread_Count threads are started, each of which calls Test_Thread to
+ * log message_count messages, half of which should be filtered out. The time taken to log the messages is
+ * printed. If the log ring is being used, it is then stopped (logging all queued messages), and the number
+ * of messages received plus the number dropped checked against the number that passed the filter.
+ * @param use_ring If TRUE, the messages are logged using the log ring, otherwise they are passed straight
+ * 	to the log handler.
+ * @param message_count The number of messages each thread logs.
+ * @param drops_expected A boolean, TRUE if the messages overrun the log ring, so some may be dropped.
+ * 	If FALSE, every message that passes the filter must be received. If TRUE, at least 
+ * 	TEST_BURST_LOGGED_COUNT messages must be received.
+ * @return The routine returns TRUE if the test passed, and FALSE otherwise.
+ * @see #Test_Thread
+ * @see #Thread_Count
+ * @see #Thread_Message_Count
+ * @see #TEST_BURST_LOGGED_COUNT
+ */
+static int Test_Threads(int use_ring,int message_count,int drops_expected)
+{
+	pthread_t *thread_list = NULL;
+	int *thread_index_list = NULL;
+	struct timespec start_time,end_time;
+	double elapsed_time;
+	int i,start_count,received_count,start_dropped_count,dropped_count,expected_count;
+
+	thread_list = (pthread_t *)malloc(Thread_Count*sizeof(pthread_t));
+	thread_index_list = (int *)malloc(Thread_Count*sizeof(int));
+	if((thread_list == NULL)||(thread_index_list == NULL))
+	{
+		fprintf(stderr,"Test_Threads:Memory allocation failed (%d).\n",Thread_Count);
+		if(thread_list != NULL)
+			free(thread_list);
+		if(thread_index_list != NULL)
+			free(thread_index_list);
+		return FALSE;
+	}
+	if(use_ring)
+	{
+		if(!CCD_Global_Log_Ring_Start())
+		{
+			CCD_Global_Error();
+			free(thread_list);
+			free(thread_index_list);
+			return FALSE;
+		}
+	}
+	Thread_Message_Count = message_count;
+	start_count = Get_Received_Count();
+	start_dropped_count = CCD_Global_Log_Ring_Get_Dropped_Count();
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	for(i=0;i<Thread_Count;i++)
+	{
+		thread_index_list[i] = i;
+		pthread_create(&(thread_list[i]),NULL,Test_Thread,(void*)(thread_index_list+i));
+	}
+	for(i=0;i<Thread_Count;i++)
+		pthread_join(thread_list[i],NULL);
+	clock_gettime(CLOCK_REALTIME,&end_time);
+	elapsed_time = Time_Difference(start_time,end_time);
+	fprintf(stdout,"Test_Threads:%s:%d threads logged %d messages each in %.3f seconds (%.3f us/message).\n",
+		use_ring ? "ring" : "direct",Thread_Count,message_count,elapsed_time,
+		(elapsed_time*1000000.0)/((double)message_count));
+	if(use_ring)
+	{
+		if(!CCD_Global_Log_Ring_Stop())
+		{
+			CCD_Global_Error();
+			free(thread_list);
+			free(thread_index_list);
+			return FALSE;
+		}
+	}
+	free(thread_list);
+	free(thread_index_list);
+	received_count = Get_Received_Count()-start_count;
+	dropped_count = CCD_Global_Log_Ring_Get_Dropped_Count()-start_dropped_count;
+	expected_count = Thread_Count*(message_count/2);
+	/* each batch of dropped messages produces one extra message reporting the drop */
+	fprintf(stdout,"Test_Threads:%s:received %d messages, %d dropped, expected %d.\n",
+		use_ring ? "ring" : "direct",received_count,dropped_count,expected_count);
+	if((dropped_count > 0)&&(drops_expected == FALSE))
+	{
+		fprintf(stdout,"Test_Threads:%d messages dropped, none expected.\n",dropped_count);
+		return FALSE;
+	}
+	/* even when overrun, at least the messages queued in the ring are delivered */
+	if(drops_expected && (expected_count > TEST_BURST_LOGGED_COUNT)&&
+	   (dropped_count > (expected_count-TEST_BURST_LOGGED_COUNT)))
+	{
+		fprintf(stdout,"Test_Threads:%d messages dropped, more than %d expected.\n",dropped_count,
+			expected_count-TEST_BURST_LOGGED_COUNT);
+		return FALSE;
+	}
+	if(dropped_count > 0)
+	{
+		if((received_count+dropped_count < expected_count)||
+		   (received_count+dropped_count > expected_count+dropped_count))
+		{
+			fprintf(stdout,"Test_Threads:Message count mismatch.\n");
+			return FALSE;
+		}
+	}
+	else if(received_count != expected_count)
+	{
+		fprintf(stdout,"Test_Threads:Message count mismatch.\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Thread routine that logs Thread_Message_Count messages. Every other message is logged at TEST_LEVEL_FILTERED,
+ * and should be filtered out.
+ * @param user_arg The address of an integer holding the thread's index, logged with each message.
+ * @return The routine returns NULL.
+ * @see #Thread_Message_Count
+ * @see #TEST_LEVEL_LOGGED
+ * @see #TEST_LEVEL_FILTERED
+ */
+static void *Test_Thread(void *user_arg)
+{
+	int i,level,thread_index;
+
+	thread_index = *((int *)user_arg);
+	for(i=0;i<Thread_Message_Count;i++)
+	{
+		if((i%2) == 0)
+			level = TEST_LEVEL_LOGGED;
+		else
+			level = TEST_LEVEL_FILTERED;
+		CCD_Global_Log_Format("test","thread",level,"Test_Thread(%d):Message %d of %d:%s:%.2f.",thread_index,i,
+				      Thread_Message_Count,"readout",((double)i)/((double)Thread_Message_Count));
+	}
+	return NULL;
+}
+
+/**
+ * Routine to get the number of messages received by the log handler.
+ * @return The number of messages received.
+ * @see #Received_Count
+ * @see #Received_Mutex
+ */
+static int Get_Received_Count(void)
+{
+	int count;
+
+	pthread_mutex_lock(&Received_Mutex);
+	count = Received_Count;
+	pthread_mutex_unlock(&Received_Mutex);
+	return count;
+}
+
+/**
+ * Routine to return the difference between two times, in seconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The difference between the times, in seconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return ((double)(end_time.tv_sec-start_time.tv_sec))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/((double)CCD_GLOBBAL_ONE_SECOND_NS));
+}
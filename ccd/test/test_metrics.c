@@ -0,0 +1,412 @@
+/* test_metrics.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "ccd_dsp.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_pci.h"
+#include "ccd_text.h"
+
+/**
+ * This program tests the per-handle metrics kept by ccd_global. A text device is opened, and some
+ * controller commands sent to it. The ioctl metrics are checked to have counted the requests the commands sent,
+ * and the DSP mutex wait and hold timers to have been updated once per command (if the library was compiled
+ * with CCD_DSP_MUTEXED). Several threads then add to the same timer and counter at once, and the totals
+ * and maximum are checked, to test the metrics are updated atomically. Finally the metrics are reset.
+ * <pre>
+ * test_metrics [-c[ommand_count] &lt;n&gt;] [-t[hread_count] &lt;n&gt;] [-a[dd_count] &lt;n&gt;] [-h[elp]]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The maximum number of threads that can add to the metrics at once.
+ */
+#define TEST_MAX_THREAD_COUNT	(16)
+
+/* structures */
+/**
+ * Structure holding the data passed to each adding thread.
+ * <dl>
+ * <dt>Handle</dt> <dd>The handle whose metrics are added to.</dd>
+ * <dt>Thread_Index</dt> <dd>The index of this thread, from 0.</dd>
+ * </dl>
+ */
+struct Test_Thread_Struct
+{
+	CCD_Interface_Handle_T *Handle;
+	int Thread_Index;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The number of controller commands to send.
+ */
+static int Command_Count = 10;
+/**
+ * The number of threads to add to the metrics at once.
+ */
+static int Thread_Count = 4;
+/**
+ * The number of times each thread adds to the metrics.
+ */
+static int Add_Count = 100000;
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Test_Commands(CCD_Interface_Handle_T *handle);
+static int Test_Threads(CCD_Interface_Handle_T *handle);
+static int Test_Reset(CCD_Interface_Handle_T *handle);
+static void *Test_Add_Thread(void *user_arg);
+static int Get_Ioctl_Count(CCD_Interface_Handle_T *handle,int request,long long *count);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Commands
+ * @see #Test_Threads
+ * @see #Test_Reset
+ */
+int main(int argc, char *argv[])
+{
+	CCD_Interface_Handle_T *handle = NULL;
+	int fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_metrics:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	if(!CCD_Interface_Open("test_metrics","-",CCD_INTERFACE_DEVICE_TEXT,"test_metrics.txt",&handle))
+	{
+		CCD_Global_Error();
+		return 2;
+	}
+	if(!Test_Commands(handle))
+		fail_count++;
+	if(!Test_Threads(handle))
+		fail_count++;
+	if(!Test_Reset(handle))
+		fail_count++;
+	if(!CCD_Interface_Close("test_metrics","-",&handle))
+	{
+		CCD_Global_Error();
+		fail_count++;
+	}
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 3;
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Command_Count
+ * @see #Thread_Count
+ * @see #Add_Count
+ * @see #TEST_MAX_THREAD_COUNT
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-add_count")==0)||(strcmp(argv[i],"-a")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Add_Count);
+				if((retval != 1)||(Add_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing add count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Add count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-command_count")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Command_Count);
+				if((retval != 1)||(Command_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing command count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Command count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-thread_count")==0)||(strcmp(argv[i],"-t")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Thread_Count);
+				if((retval != 1)||(Thread_Count < 1)||(Thread_Count > TEST_MAX_THREAD_COUNT))
+				{
+					fprintf(stderr,"Parse_Arguments:Thread count %s must be between 1 and %d.\n",
+						argv[i+1],TEST_MAX_THREAD_COUNT);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Thread count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Metrics:Help.\n");
+	fprintf(stdout,"This program tests the per-handle metrics kept by the CCD library.\n");
+	fprintf(stdout,"test_metrics [-c[ommand_count] <n>][-t[hread_count] <n>][-a[dd_count] <n>][-h[elp]]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-command_count is the number of controller commands to send.\n");
+	fprintf(stdout,"\t-thread_count is the number of threads to add to the metrics at once.\n");
+	fprintf(stdout,"\t-add_count is the number of times each thread adds to the metrics.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Routine that sends Command_Count WRM commands and Command_Count Get_HSTR requests to the text device,
+ * and checks the ioctl metrics counted them, and the DSP mutex timers were updated once per command.
+ * @param handle The opened text device handle.
+ * @return The routine returns TRUE if all the checks passed, and FALSE if they did not.
+ * @see #Command_Count
+ * @see #Get_Ioctl_Count
+ */
+static int Test_Commands(CCD_Interface_Handle_T *handle)
+{
+	long long command_count,hstr_count,wait_count,hold_count,total_ns,max_ns;
+	int i,status,success;
+
+	success = TRUE;
+	for(i=0;i<Command_Count;i++)
+	{
+		if(CCD_DSP_Command_WRM("test_metrics","-",handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,0x1,
+				       i+1) != CCD_DSP_DON)
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+		if(!CCD_DSP_Command_Get_HSTR("test_metrics","-",handle,&status))
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+	}
+	if((!Get_Ioctl_Count(handle,CCD_PCI_IOCTL_COMMAND,&command_count))||
+	   (!Get_Ioctl_Count(handle,CCD_PCI_IOCTL_GET_HSTR,&hstr_count)))
+		return FALSE;
+	fprintf(stdout,"Test_Commands:COMMAND ioctl count %lld, GET_HSTR ioctl count %lld.\n",command_count,hstr_count);
+	if((command_count != Command_Count)||(hstr_count != Command_Count))
+	{
+		fprintf(stdout,"Test_Commands:FAIL:Expected %d COMMAND and GET_HSTR ioctls.\n",Command_Count);
+		success = FALSE;
+	}
+	if((!CCD_Global_Metrics_Get_Timer(handle,CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_WAIT,&wait_count,
+					  &total_ns,&max_ns))||
+	   (!CCD_Global_Metrics_Get_Timer(handle,CCD_GLOBAL_METRICS_TIMER_DSP_MUTEX_HOLD,&hold_count,
+					  &total_ns,&max_ns)))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	fprintf(stdout,"Test_Commands:DSP mutex wait count %lld, hold count %lld, hold total %lld ns.\n",
+		wait_count,hold_count,total_ns);
+	/* the mutex is only compiled in with CCD_DSP_MUTEXED, in which case both commands lock it */
+	if((wait_count != hold_count)||((wait_count != 0)&&(wait_count != (2*Command_Count))))
+	{
+		fprintf(stdout,"Test_Commands:FAIL:Expected 0 or %d mutex locks.\n",2*Command_Count);
+		success = FALSE;
+	}
+	/* an illegal index should fail */
+	if(CCD_Global_Metrics_Get_Ioctl(handle,CCD_GLOBAL_METRICS_IOCTL_COUNT,NULL,&command_count,&total_ns,&max_ns))
+	{
+		fprintf(stdout,"Test_Commands:FAIL:Getting an illegal ioctl index succeeded.\n");
+		success = FALSE;
+	}
+	return success;
+}
+
+/**
+ * Routine that starts Thread_Count threads, that all add Add_Count times to the same timer and counter at once.
+ * The counter and timer count are then checked to have no lost updates, the timer total to be at least the
+ * sum of the times added, and the timer maximum to be the longest time any thread added.
+ * @param handle The opened text device handle.
+ * @return The routine returns TRUE if all the checks passed, and FALSE if they did not.
+ * @see #Test_Add_Thread
+ * @see #Thread_Count
+ * @see #Add_Count
+ */
+static int Test_Threads(CCD_Interface_Handle_T *handle)
+{
+	struct Test_Thread_Struct thread_data_list[TEST_MAX_THREAD_COUNT];
+	pthread_t thread_list[TEST_MAX_THREAD_COUNT];
+	long long counter,count,total_ns,max_ns,expected_count;
+	int i,success;
+
+	success = TRUE;
+	for(i=0;i<Thread_Count;i++)
+	{
+		thread_data_list[i].Handle = handle;
+		thread_data_list[i].Thread_Index = i;
+		if(pthread_create(&(thread_list[i]),NULL,Test_Add_Thread,(void *)&(thread_data_list[i])) != 0)
+		{
+			fprintf(stderr,"Test_Threads:Failed to create thread %d.\n",i);
+			return FALSE;
+		}
+	}
+	for(i=0;i<Thread_Count;i++)
+		pthread_join(thread_list[i],NULL);
+	expected_count = ((long long)Thread_Count)*((long long)Add_Count);
+	counter = CCD_Global_Metrics_Get_Counter(handle,CCD_GLOBAL_METRICS_COUNTER_READOUT_TIMEOUTS);
+	if(!CCD_Global_Metrics_Get_Timer(handle,CCD_GLOBAL_METRICS_TIMER_SAVE,&count,&total_ns,&max_ns))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	fprintf(stdout,"Test_Threads:Counter %lld, timer count %lld, total %lld ns, max %lld ns.\n",
+		counter,count,total_ns,max_ns);
+	if((counter != expected_count)||(count != expected_count))
+	{
+		fprintf(stdout,"Test_Threads:FAIL:Expected counter and timer count %lld.\n",expected_count);
+		success = FALSE;
+	}
+	/* each thread added times of just over Thread_Index seconds, see Test_Add_Thread */
+	if(total_ns < ((long long)Add_Count)*((long long)(Thread_Count*(Thread_Count-1))/2)*1000000000LL)
+	{
+		fprintf(stdout,"Test_Threads:FAIL:Timer total %lld ns is wrong.\n",total_ns);
+		success = FALSE;
+	}
+	if((max_ns < ((long long)(Thread_Count-1))*1000000000LL)||(max_ns >= ((long long)Thread_Count)*1000000000LL))
+	{
+		fprintf(stdout,"Test_Threads:FAIL:Timer maximum %lld ns is wrong.\n",max_ns);
+		success = FALSE;
+	}
+	return success;
+}
+
+/**
+ * Routine that resets the metrics, and checks the counter and timer used by Test_Threads were zeroed.
+ * @param handle The opened text device handle.
+ * @return The routine returns TRUE if all the checks passed, and FALSE if they did not.
+ */
+static int Test_Reset(CCD_Interface_Handle_T *handle)
+{
+	long long count,total_ns,max_ns;
+
+	CCD_Global_Metrics_Initialise(handle);
+	if(!CCD_Global_Metrics_Get_Timer(handle,CCD_GLOBAL_METRICS_TIMER_SAVE,&count,&total_ns,&max_ns))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	if((count != 0)||(total_ns != 0)||(max_ns != 0)||
+	   (CCD_Global_Metrics_Get_Counter(handle,CCD_GLOBAL_METRICS_COUNTER_READOUT_TIMEOUTS) != 0))
+	{
+		fprintf(stdout,"Test_Reset:FAIL:Metrics were not reset.\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Thread routine, that adds Add_Count times to the READOUT_TIMEOUTS counter and the SAVE timer.
+ * Each time added to the timer is just over Thread_Index seconds (the start time passed in is that far
+ * in the past), so the expected total and maximum can be bounded.
+ * @param user_arg A pointer to the Test_Thread_Struct for this thread.
+ * @return The routine returns NULL.
+ * @see #Add_Count
+ */
+static void *Test_Add_Thread(void *user_arg)
+{
+	struct Test_Thread_Struct *thread_data = (struct Test_Thread_Struct *)user_arg;
+	struct timespec start_time;
+	int i;
+
+	for(i=0;i<Add_Count;i++)
+	{
+		CCD_Global_Metrics_Counter_Add(thread_data->Handle,CCD_GLOBAL_METRICS_COUNTER_READOUT_TIMEOUTS,1);
+		/* start Thread_Index seconds ago, plus however long the two calls take */
+		CCD_Global_Metrics_Get_Time(&start_time);
+		start_time.tv_sec -= thread_data->Thread_Index;
+		CCD_Global_Metrics_Timer_Add(thread_data->Handle,CCD_GLOBAL_METRICS_TIMER_SAVE,start_time);
+	}
+	return NULL;
+}
+
+/**
+ * Routine to find the ioctl metrics for the specified request, and return how many have been sent.
+ * @param handle The opened text device handle.
+ * @param request The ioctl request to look for.
+ * @param count The address of a long long, on return set to the number of requests sent.
+ * @return The routine returns TRUE if the request was found, and FALSE if it was not.
+ */
+static int Get_Ioctl_Count(CCD_Interface_Handle_T *handle,int request,long long *count)
+{
+	long long total_ns,max_ns;
+	int i,metrics_request;
+
+	for(i=0;i<CCD_GLOBAL_METRICS_IOCTL_COUNT;i++)
+	{
+		if(!CCD_Global_Metrics_Get_Ioctl(handle,i,&metrics_request,count,&total_ns,&max_ns))
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+		if(metrics_request == request)
+			return TRUE;
+	}
+	fprintf(stdout,"Get_Ioctl_Count:FAIL:Request %#x has no metrics.\n",request);
+	return FALSE;
+}
+
+/*
+** $Log$
+*/
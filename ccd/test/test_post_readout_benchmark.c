@@ -0,0 +1,527 @@
+/* test_post_readout_benchmark.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+
+/**
+ * This program benchmarks the post-readout processing of a read out image, comparing the original
+ * multi-pass processing (a byte swap pass, a copy of each window into a sub-image, and an in-place de-interlace
+ * through a scratch buffer that is copied back) with the single pass CCD_Exposure_DeInterlace used by
+ * CCD_Exposure_Post_Readout_Transform. For each method it prints the time taken per frame, and the number of bytes
+ * read and written per pixel.
+ * <pre>
+ * test_post_readout_benchmark -c[olumns] &lt;n&gt; -r[ows] &lt;n&gt; -w[indows] &lt;n&gt;
+ * 	-d[einterlace_type] &lt;single|flip|split_parallel|split_serial|split_quad&gt; -b[yte_swap]
+ * 	-l[oop_count] &lt;n&gt; -h[elp]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The number of bytes in one pixel.
+ */
+#define BENCHMARK_BYTES_PER_PIXEL	(2)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The number of columns in each window (or the full frame).
+ */
+static int NCols = 2154;
+/**
+ * The number of rows in each window (or the full frame).
+ */
+static int NRows = 2048;
+/**
+ * The number of windows read out, one after another. Zero means a full frame readout.
+ */
+static int Window_Count = 0;
+/**
+ * The type of de-interlacing to benchmark.
+ */
+static enum CCD_DSP_DEINTERLACE_TYPE DeInterlace_Type = CCD_DSP_DEINTERLACE_SPLIT_SERIAL;
+/**
+ * Whether to byte swap the read out data.
+ */
+static int Byte_Swap = FALSE;
+/**
+ * The number of times to process the image with each method.
+ */
+static int Loop_Count = 10;
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static int Multi_Pass(unsigned short *exposure_data,unsigned short **image_data_list,double *bytes_touched);
+static int Single_Pass(unsigned short *exposure_data,unsigned short **image_data_list,double *bytes_touched);
+static void Multi_Pass_Byte_Swap(unsigned short *svalues,int nvals);
+static int Multi_Pass_DeInterlace(int ncols,int nrows,unsigned short *old_iptr,
+				  enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,double *bytes_touched);
+static double Time_Diff_Ms(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Multi_Pass
+ * @see #Single_Pass
+ */
+int main(int argc, char *argv[])
+{
+	struct timespec start_time,end_time;
+	unsigned short *exposure_data = NULL;
+	unsigned short **image_data_list = NULL;
+	double bytes_touched,pixel_count,multi_pass_ms,single_pass_ms;
+	int image_count,i,loop;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_post_readout_benchmark:%s.\n",rcsid);
+	CCD_Exposure_Initialise();
+	if(Window_Count > 0)
+		image_count = Window_Count;
+	else
+		image_count = 1;
+	pixel_count = ((double)NCols)*((double)NRows)*((double)image_count);
+	fprintf(stdout,"%d image(s) of (%d,%d), de-interlace type %d, byte swap %d, %d loops.\n",image_count,
+		NCols,NRows,DeInterlace_Type,Byte_Swap,Loop_Count);
+	/* allocate read out data and images */
+	exposure_data = (unsigned short *)malloc(NCols*NRows*image_count*BENCHMARK_BYTES_PER_PIXEL);
+	image_data_list = (unsigned short **)malloc(image_count*sizeof(unsigned short *));
+	if((exposure_data == NULL)||(image_data_list == NULL))
+	{
+		fprintf(stderr,"Failed to allocate exposure data.\n");
+		return 2;
+	}
+	for(i=0;i<image_count;i++)
+	{
+		image_data_list[i] = (unsigned short *)malloc(NCols*NRows*BENCHMARK_BYTES_PER_PIXEL);
+		if(image_data_list[i] == NULL)
+		{
+			fprintf(stderr,"Failed to allocate image %d.\n",i);
+			return 2;
+		}
+	}
+	for(i=0;i<(NCols*NRows*image_count);i++)
+		exposure_data[i] = (unsigned short)(i&0xffff);
+	/* multi-pass */
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	for(loop=0;loop<Loop_Count;loop++)
+	{
+		if(!Multi_Pass(exposure_data,image_data_list,&bytes_touched))
+			return 3;
+	}
+	clock_gettime(CLOCK_REALTIME,&end_time);
+	multi_pass_ms = Time_Diff_Ms(start_time,end_time)/((double)Loop_Count);
+	fprintf(stdout,"Multi-pass: %.3f ms per frame, %.1f bytes touched per pixel.\n",multi_pass_ms,
+		bytes_touched/pixel_count);
+	/* single pass */
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	for(loop=0;loop<Loop_Count;loop++)
+	{
+		if(!Single_Pass(exposure_data,image_data_list,&bytes_touched))
+		{
+			CCD_Exposure_Error();
+			return 4;
+		}
+	}
+	clock_gettime(CLOCK_REALTIME,&end_time);
+	single_pass_ms = Time_Diff_Ms(start_time,end_time)/((double)Loop_Count);
+	fprintf(stdout,"Single pass (kernel %d): %.3f ms per frame, %.1f bytes touched per pixel.\n",
+		CCD_Exposure_Get_DeInterlace_Kernel(),single_pass_ms,bytes_touched/pixel_count);
+	if(bytes_touched == 0.0)
+		fprintf(stdout,"No post-readout processing is needed.\n");
+	else if(single_pass_ms > 0.0)
+		fprintf(stdout,"Speedup: %.2f.\n",multi_pass_ms/single_pass_ms);
+	for(i=0;i<image_count;i++)
+		free(image_data_list[i]);
+	free(image_data_list);
+	free(exposure_data);
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #NCols
+ * @see #NRows
+ * @see #Window_Count
+ * @see #DeInterlace_Type
+ * @see #Byte_Swap
+ * @see #Loop_Count
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-byte_swap")==0)||(strcmp(argv[i],"-b")==0))
+		{
+			Byte_Swap = TRUE;
+		}
+		else if((strcmp(argv[i],"-columns")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&NCols);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing columns %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Columns requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-deinterlace_type")==0)||(strcmp(argv[i],"-d")==0))
+		{
+			if((i+1)<argc)
+			{
+				if(strcmp(argv[i+1],"single")==0)
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_SINGLE;
+				else if(strcmp(argv[i+1],"flip")==0)
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_FLIP;
+				else if(strcmp(argv[i+1],"split_parallel")==0)
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_SPLIT_PARALLEL;
+				else if(strcmp(argv[i+1],"split_serial")==0)
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_SPLIT_SERIAL;
+				else if(strcmp(argv[i+1],"split_quad")==0)
+					DeInterlace_Type = CCD_DSP_DEINTERLACE_SPLIT_QUAD;
+				else
+				{
+					fprintf(stderr,"Parse_Arguments:Illegal DeInterlace Type '%s'.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:DeInterlace Type requires a type.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-loop_count")==0)||(strcmp(argv[i],"-l")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Loop_Count);
+				if((retval != 1)||(Loop_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing loop count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Loop count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-rows")==0)||(strcmp(argv[i],"-r")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&NRows);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing rows %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Rows requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-windows")==0)||(strcmp(argv[i],"-w")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Window_Count);
+				if((retval != 1)||(Window_Count < 0)||(Window_Count > 4))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing window count %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Windows requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Post Readout Benchmark:Help.\n");
+	fprintf(stdout,"This program compares multi-pass and single pass post-readout processing.\n");
+	fprintf(stdout,"test_post_readout_benchmark -c[olumns] <n> -r[ows] <n> -w[indows] <0..4>\n");
+	fprintf(stdout,"\t-d[einterlace_type] <single|flip|split_parallel|split_serial|split_quad>\n");
+	fprintf(stdout,"\t-b[yte_swap] -l[oop_count] <n> -h[elp]\n");
+	fprintf(stdout,"\t-columns and -rows are the size of each window, or of the full frame if -windows is 0.\n");
+}
+
+/**
+ * The original multi-pass post-readout processing. The whole read out buffer is byte swapped
+ * (if Byte_Swap is TRUE). For a windowed readout each window is then copied into it's image. Each image
+ * is then de-interlaced in place using Multi_Pass_DeInterlace. For a full frame readout the read out
+ * buffer is de-interlaced in place, and then copied to the image (to match the single pass output).
+ * @param exposure_data The read out data. This is modified.
+ * @param image_data_list The list of images to write.
+ * @param bytes_touched The address of a double, to store the number of bytes read and written.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #Multi_Pass_Byte_Swap
+ * @see #Multi_Pass_DeInterlace
+ */
+static int Multi_Pass(unsigned short *exposure_data,unsigned short **image_data_list,double *bytes_touched)
+{
+	int i,pixel_count,image_count;
+
+	(*bytes_touched) = 0.0;
+	pixel_count = NCols*NRows;
+	if(Window_Count > 0)
+		image_count = Window_Count;
+	else
+		image_count = 1;
+	if(Byte_Swap)
+	{
+		Multi_Pass_Byte_Swap(exposure_data,pixel_count*image_count);
+		(*bytes_touched) += 2.0*((double)pixel_count)*((double)image_count)*BENCHMARK_BYTES_PER_PIXEL;
+	}
+	if(Window_Count > 0)
+	{
+		for(i=0;i<image_count;i++)
+		{
+			memcpy(image_data_list[i],exposure_data+(i*pixel_count),pixel_count*BENCHMARK_BYTES_PER_PIXEL);
+			(*bytes_touched) += 2.0*((double)pixel_count)*BENCHMARK_BYTES_PER_PIXEL;
+			if(!Multi_Pass_DeInterlace(NCols,NRows,image_data_list[i],DeInterlace_Type,bytes_touched))
+				return FALSE;
+		}
+	}
+	else
+	{
+		/* the full frame was de-interlaced in place and saved directly from the read out buffer */
+		if(!Multi_Pass_DeInterlace(NCols,NRows,exposure_data,DeInterlace_Type,bytes_touched))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * The single pass post-readout processing. Each window (or the full frame) is byte swapped and de-interlaced
+ * from the read out data into it's image using CCD_Exposure_DeInterlace, as
+ * CCD_Exposure_Post_Readout_Transform does. As in Exposure_Expose_Post_Readout_Full_Frame, a full frame
+ * with single de-interlacing and no byte swap is saved straight from the read out buffer.
+ * @param exposure_data The read out data.
+ * @param image_data_list The list of images to write.
+ * @param bytes_touched The address of a double, to store the number of bytes read and written.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ * @see #CCD_Exposure_DeInterlace
+ */
+static int Single_Pass(unsigned short *exposure_data,unsigned short **image_data_list,double *bytes_touched)
+{
+	int i,pixel_count,image_count;
+
+	(*bytes_touched) = 0.0;
+	pixel_count = NCols*NRows;
+	if(Window_Count > 0)
+		image_count = Window_Count;
+	else
+	{
+		if((DeInterlace_Type == CCD_DSP_DEINTERLACE_SINGLE)&&(Byte_Swap == FALSE))
+			return TRUE;
+		image_count = 1;
+	}
+	for(i=0;i<image_count;i++)
+	{
+		if(!CCD_Exposure_DeInterlace("test_post_readout_benchmark","-",NCols,NRows,
+					     exposure_data+(i*pixel_count),image_data_list[i],DeInterlace_Type,
+					     Byte_Swap))
+			return FALSE;
+		(*bytes_touched) += 2.0*((double)pixel_count)*BENCHMARK_BYTES_PER_PIXEL;
+	}
+	return TRUE;
+}
+
+/**
+ * The original byte swap routine.
+ * @param svalues A list of unsigned short values to byte swap.
+ * @param nvals The number of values in svalues.
+ */
+static void Multi_Pass_Byte_Swap(unsigned short *svalues,int nvals)
+{
+	register char *cvalues;
+	register int i;
+	union u_tag
+	{
+		char cvals[2];
+		unsigned short sval;
+	} u;
+
+	cvalues = (char *) svalues;
+	for (i = 0; i < nvals;)
+	{
+		u.sval = svalues[i++];
+		*cvalues++ = u.cvals[1];
+		*cvalues++ = u.cvals[0];
+	}
+}
+
+/**
+ * The original in-place de-interlace routine. Except for single and flip de-interlacing, a scratch image is
+ * allocated, the image is de-interlaced into it, and it is copied back.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param old_iptr The image to de-interlace in place.
+ * @param deinterlace_type The type of de-interlacing to perform.
+ * @param bytes_touched The address of a double, the number of bytes read and written is added to it.
+ * @return The routine returns TRUE if it suceeded, and FALSE if it fails.
+ */
+static int Multi_Pass_DeInterlace(int ncols,int nrows,unsigned short *old_iptr,
+				  enum CCD_DSP_DEINTERLACE_TYPE deinterlace_type,double *bytes_touched)
+{
+	unsigned short *new_iptr = NULL;
+	double image_bytes;
+	int i,j,p1,p2,begin,end,counter,x,y;
+	unsigned short tempval;
+
+	image_bytes = ((double)ncols)*((double)nrows)*BENCHMARK_BYTES_PER_PIXEL;
+	if(deinterlace_type == CCD_DSP_DEINTERLACE_SINGLE)
+		return TRUE;
+	if(deinterlace_type == CCD_DSP_DEINTERLACE_FLIP)
+	{
+		for(y=0;y<nrows;y++)
+		{
+			for(x=0;x<(ncols/2);x++)
+			{
+				tempval = *(old_iptr+(y*ncols)+x);
+				*(old_iptr+(y*ncols)+x) = *(old_iptr+(y*ncols)+(ncols-(x+1)));
+				*(old_iptr+(y*ncols)+(ncols-(x+1))) = tempval;
+			}
+		}
+		(*bytes_touched) += 2.0*image_bytes;
+		return TRUE;
+	}
+	if(((ncols%2) != 0)||((nrows%2) != 0))
+	{
+		fprintf(stderr,"Multi_Pass_DeInterlace:Split readouts need even dimensions (%d,%d).\n",ncols,nrows);
+		return FALSE;
+	}
+	if((new_iptr = (unsigned short *)malloc(ncols*nrows*BENCHMARK_BYTES_PER_PIXEL)) == NULL)
+	{
+		fprintf(stderr,"Multi_Pass_DeInterlace:Memory Allocation Error(%d,%d).\n",ncols,nrows);
+		return FALSE;
+	}
+	switch(deinterlace_type)
+	{
+		case CCD_DSP_DEINTERLACE_SPLIT_PARALLEL:
+			for(i=0;i<(ncols*nrows)/2;i++)
+			{
+				*(new_iptr+i) = *(old_iptr+(2*i));
+				*(new_iptr+(ncols*nrows)-i-1) = *(old_iptr+(2*i)+1);
+			}
+			break;
+		case CCD_DSP_DEINTERLACE_SPLIT_SERIAL:
+			for (i=0;i<nrows;i++)
+			{
+				p1      = i*ncols+0;
+				p2      = i*ncols+1;
+				begin   = i*ncols+0;
+				end     = i*ncols+ncols-1;
+				for(j=0;j<ncols;j+=2)
+				{
+					*(new_iptr+begin) = *(old_iptr+p1);
+					*(new_iptr+end) = *(old_iptr+p2);
+					++begin;
+					--end;
+					p1+=2;
+					p2+=2;
+				}
+			}
+			break;
+		case CCD_DSP_DEINTERLACE_SPLIT_QUAD:
+			i = 0;
+			j = 0;
+			counter = 0;
+			begin = 0;
+			end = 0;
+			while(i<ncols*nrows)
+			{
+				if(counter%(ncols/2) == 0)
+				{
+					end     = (ncols*nrows)-(ncols*j)-1;
+					begin   = (ncols*j)+0;
+					j++;
+					counter=0;
+				}
+				*(new_iptr+begin+counter)       = *(old_iptr+i++);
+				*(new_iptr+begin+ncols-1-counter)   = *(old_iptr+i++);
+				*(new_iptr+end-counter)         = *(old_iptr+i++);
+				*(new_iptr+end-ncols+1+counter)     = *(old_iptr+i++);
+				counter++;
+			}
+			break;
+		default:
+			free(new_iptr);
+			return FALSE;
+	}
+	memcpy(old_iptr,new_iptr,ncols*nrows*BENCHMARK_BYTES_PER_PIXEL);
+	free(new_iptr);
+	/* de-interlace into scratch, and copy back */
+	(*bytes_touched) += 4.0*image_bytes;
+	return TRUE;
+}
+
+/**
+ * Return the difference between two times in milliseconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The time difference in milliseconds.
+ */
+static double Time_Diff_Ms(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
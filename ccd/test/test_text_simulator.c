@@ -0,0 +1,549 @@
+/* test_text_simulator.c
+ * $Header$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "ccd_dsp.h"
+#include "ccd_exposure.h"
+#include "ccd_global.h"
+#include "ccd_interface.h"
+#include "ccd_text.h"
+
+/**
+ * This program tests the text device's SDSU controller simulator, and that two simulated arms
+ * can be used at once. Each arm is run in it's own thread. The readout dimensions and amplifier
+ * are sent to the simulated controller, and an exposure started. The HSTR and readout progress are then polled,
+ * checking the HSTR goes into readout mode after the exposure length, the readout progress only increases,
+ * the readout takes about as long as the configured pixel rate implies, and the HSTR comes back out of
+ * readout mode when the readout completes. The read out data is then de-interlaced, and the rows of the
+ * de-interlaced image checked for the simulated illumination gradient, which is only seen if the simulator
+ * read the pixels out in the order the de-interlace expects.
+ * <pre>
+ * test_text_simulator [-c[olumns] &lt;n&gt;] [-r[ows] &lt;n&gt;] [-e[xposure_length] &lt;ms&gt;]
+ * 	[-p[ixel_rate] &lt;pixels/s&gt;] [-h[elp]]
+ * </pre>
+ * @author $Author$
+ * @version $Revision$
+ */
+/* hash definitions */
+/**
+ * The number of simulated arms.
+ */
+#define TEST_ARM_COUNT		(2)
+/**
+ * The maximum time to wait for the readout to progress, each time round the polling loop, in milliseconds.
+ */
+#define TEST_POLL_TIME		(100)
+/**
+ * The time, in milliseconds, the measured readout time can differ from the time the pixel rate implies.
+ * The readout progress is polled every millisecond by CCD_DSP_Command_Wait_Readout_Progress, so the end of the
+ * readout is seen within a millisecond or so.
+ */
+#define TEST_READOUT_TIME_SLACK		(5.0)
+/**
+ * The allowance made for polling delays when checking when the readout started, in milliseconds.
+ * The HSTR is only read once per TEST_POLL_TIME.
+ */
+#define TEST_TIMING_SLACK		(TEST_POLL_TIME+50.0)
+/**
+ * The lowest value a simulated pixel can have (the left amplifier bias level in ccd_text.c).
+ */
+#define TEST_MIN_PIXEL_VALUE	(1000)
+/**
+ * Which value to pass as the byte swap parameter to CCD_Exposure_DeInterlace.
+ * This should agree with how the library was built, the simulator byte swaps it's pixels if
+ * CCD_EXPOSURE_BYTE_SWAP is defined.
+ */
+#ifdef CCD_EXPOSURE_BYTE_SWAP
+#define TEST_BYTE_SWAP		(TRUE)
+#else
+#define TEST_BYTE_SWAP		(FALSE)
+#endif
+
+/* structures */
+/**
+ * Structure holding the configuration and results of one simulated arm.
+ * <dl>
+ * <dt>Arm</dt> <dd>The arm number.</dd>
+ * <dt>Amplifier</dt> <dd>The amplifier to read out through.</dd>
+ * <dt>DeInterlace_Type</dt> <dd>The de-interlace type that matches the amplifier.</dd>
+ * <dt>Readout_Start_Ms</dt> <dd>When the HSTR was first seen in readout mode, in milliseconds
+ *     from the exposure start.</dd>
+ * <dt>Readout_Ms</dt> <dd>How long the readout took, in milliseconds.</dd>
+ * <dt>Success</dt> <dd>Whether all the checks on this arm passed.</dd>
+ * </dl>
+ */
+struct Test_Arm_Struct
+{
+	int Arm;
+	enum CCD_DSP_AMPLIFIER Amplifier;
+	enum CCD_DSP_DEINTERLACE_TYPE DeInterlace_Type;
+	double Readout_Start_Ms;
+	double Readout_Ms;
+	int Success;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The number of binned columns to read out.
+ */
+static int Columns = 512;
+/**
+ * The number of binned rows to read out.
+ */
+static int Rows = 512;
+/**
+ * The exposure length, in milliseconds.
+ */
+static int Exposure_Length = 500;
+/**
+ * The simulated single amplifier readout rate, in pixels per second. Dual amplifier readouts are
+ * simulated at twice this rate.
+ */
+static int Pixel_Rate = 250000;
+
+/* internal routines */
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+static void *Test_Arm_Thread(void *user_arg);
+static int Test_Arm(struct Test_Arm_Struct *arm_data,CCD_Interface_Handle_T *handle);
+static int Test_Image(struct Test_Arm_Struct *arm_data,unsigned short *image_data);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Arm_Thread
+ */
+int main(int argc, char *argv[])
+{
+	struct Test_Arm_Struct arm_data_list[TEST_ARM_COUNT];
+	pthread_t thread_list[TEST_ARM_COUNT];
+	struct timespec start_time,end_time;
+	double total_ms,longest_ms,arm_ms;
+	int i,fail_count = 0;
+
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	fprintf(stdout,"test_text_simulator:%s.\n",rcsid);
+	CCD_Text_Set_Print_Level(CCD_TEXT_PRINT_LEVEL_COMMANDS);
+	CCD_Global_Initialise();
+	/* arm 0 reads out through one amplifier, arm 1 through both */
+	arm_data_list[0].Amplifier = CCD_DSP_AMPLIFIER_RIGHT;
+	arm_data_list[0].DeInterlace_Type = CCD_DSP_DEINTERLACE_FLIP;
+	arm_data_list[1].Amplifier = CCD_DSP_AMPLIFIER_BOTH;
+	arm_data_list[1].DeInterlace_Type = CCD_DSP_DEINTERLACE_SPLIT_SERIAL;
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	for(i=0;i<TEST_ARM_COUNT;i++)
+	{
+		arm_data_list[i].Arm = i;
+		arm_data_list[i].Success = FALSE;
+		if(pthread_create(&(thread_list[i]),NULL,Test_Arm_Thread,(void *)&(arm_data_list[i])) != 0)
+		{
+			fprintf(stderr,"test_text_simulator:Failed to create thread %d.\n",i);
+			return 2;
+		}
+	}
+	longest_ms = 0.0;
+	for(i=0;i<TEST_ARM_COUNT;i++)
+	{
+		pthread_join(thread_list[i],NULL);
+		if(arm_data_list[i].Success == FALSE)
+			fail_count++;
+		arm_ms = arm_data_list[i].Readout_Start_Ms+arm_data_list[i].Readout_Ms;
+		if(arm_ms > longest_ms)
+			longest_ms = arm_ms;
+	}
+	clock_gettime(CLOCK_REALTIME,&end_time);
+	total_ms = Time_Difference(start_time,end_time);
+	fprintf(stdout,"test_text_simulator:Both arms took %.1f ms, the longest exposure and readout took %.1f ms.\n",
+		total_ms,longest_ms);
+	/* if the arms ran concurrently, the total time is about the time of the longest arm, not the sum */
+	if(total_ms > (longest_ms*1.5)+TEST_TIMING_SLACK)
+	{
+		fprintf(stdout,"test_text_simulator:FAIL:Arms do not appear to have run concurrently.\n");
+		fail_count++;
+	}
+	fprintf(stdout,"%d tests failed.\n",fail_count);
+	if(fail_count > 0)
+		return 3;
+	return 0;
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Columns
+ * @see #Rows
+ * @see #Exposure_Length
+ * @see #Pixel_Rate
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if((strcmp(argv[i],"-columns")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Columns);
+				if((retval != 1)||(Columns < 2)||((Columns%2) != 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Columns %s must be an even number.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Columns requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-exposure_length")==0)||(strcmp(argv[i],"-e")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Length);
+				if((retval != 1)||(Exposure_Length < 0))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing exposure length %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Exposure length requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-help")==0)||(strcmp(argv[i],"-h")==0))
+		{
+			Help();
+			exit(0);
+		}
+		else if((strcmp(argv[i],"-pixel_rate")==0)||(strcmp(argv[i],"-p")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Pixel_Rate);
+				if((retval != 1)||(Pixel_Rate < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing pixel rate %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Pixel rate requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if((strcmp(argv[i],"-rows")==0)||(strcmp(argv[i],"-r")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Rows);
+				if((retval != 1)||(Rows < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing rows %s failed.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:Rows requires a number.\n");
+				return FALSE;
+			}
+		}
+		else
+		{
+			fprintf(stderr,"Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test Text Simulator:Help.\n");
+	fprintf(stdout,"This program tests the text device's controller simulator, with two arms at once.\n");
+	fprintf(stdout,"test_text_simulator [-c[olumns] <n>][-r[ows] <n>][-e[xposure_length] <ms>]\n");
+	fprintf(stdout,"\t[-p[ixel_rate] <pixels/s>][-h[elp]]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-columns is the (even) number of columns to read out.\n");
+	fprintf(stdout,"\t-rows is the number of rows to read out.\n");
+	fprintf(stdout,"\t-exposure_length is the length of the exposure in milliseconds.\n");
+	fprintf(stdout,"\t-pixel_rate is the single amplifier readout rate, in pixels per second.\n");
+	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
+}
+
+/**
+ * Thread routine, that opens a text device for one arm, runs the arm test on it, and closes it again.
+ * @param user_arg A pointer to the Test_Arm_Struct for this arm.
+ * @return The routine returns NULL.
+ * @see #Test_Arm
+ */
+static void *Test_Arm_Thread(void *user_arg)
+{
+	struct Test_Arm_Struct *arm_data = (struct Test_Arm_Struct *)user_arg;
+	CCD_Interface_Handle_T *handle = NULL;
+	char device_pathname[256];
+
+	sprintf(device_pathname,"test_text_simulator_%d.txt",arm_data->Arm);
+	if(!CCD_Interface_Open("test_text_simulator","-",CCD_INTERFACE_DEVICE_TEXT,device_pathname,&handle))
+	{
+		CCD_Global_Error();
+		return NULL;
+	}
+	arm_data->Success = Test_Arm(arm_data,handle);
+	if(!CCD_Interface_Close("test_text_simulator","-",&handle))
+	{
+		CCD_Global_Error();
+		arm_data->Success = FALSE;
+	}
+	return NULL;
+}
+
+/**
+ * Routine that tests one simulated arm. The readout dimensions, binning and amplifier are sent to the
+ * simulator, and an exposure started. The HSTR and readout progress are then polled until the readout is complete,
+ * and the timings checked. The read out data is then checked using Test_Image.
+ * @param arm_data The configuration of the arm, the timings are filled in.
+ * @param handle The opened text device handle.
+ * @return The routine returns TRUE if all the checks passed, and FALSE if they did not.
+ * @see #Test_Image
+ * @see #TEST_POLL_TIME
+ * @see #TEST_READOUT_TIME_SLACK
+ * @see #TEST_TIMING_SLACK
+ */
+static int Test_Arm(struct Test_Arm_Struct *arm_data,CCD_Interface_Handle_T *handle)
+{
+	struct timespec start_time,current_time,status_time,readout_start_time,zero_time;
+	unsigned short *exposure_data = NULL;
+	double expected_ms,elapsed_ms;
+	int pixel_count,current_pixel_count,last_pixel_count,status,in_readout,pixel_rate,success;
+
+	success = TRUE;
+	pixel_count = Columns*Rows;
+	if(!CCD_Interface_Memory_Map(handle,pixel_count*sizeof(unsigned short)))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	/* configure the simulator */
+	pixel_rate = Pixel_Rate;
+	if(arm_data->Amplifier == CCD_DSP_AMPLIFIER_BOTH)
+		pixel_rate *= 2;
+	if(!CCD_Text_Set_Pixel_Rate(handle,arm_data->Amplifier,1,1,pixel_rate))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	/* send the readout setup, as CCD_Setup_Dimensions would */
+	if((CCD_DSP_Command_WRM("test_text_simulator","-",handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,0x1,
+				Columns) != CCD_DSP_DON)||
+	   (CCD_DSP_Command_WRM("test_text_simulator","-",handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,0x2,
+				Rows) != CCD_DSP_DON)||
+	   (CCD_DSP_Command_WRM("test_text_simulator","-",handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,0x5,
+				1) != CCD_DSP_DON)||
+	   (CCD_DSP_Command_WRM("test_text_simulator","-",handle,CCD_DSP_TIM_BOARD_ID,CCD_DSP_MEM_SPACE_Y,0x6,
+				1) != CCD_DSP_DON)||
+	   (CCD_DSP_Command_SOS("test_text_simulator","-",handle,arm_data->Amplifier) != CCD_DSP_DON)||
+	   (CCD_DSP_Command_SET("test_text_simulator","-",handle,Exposure_Length) != CCD_DSP_DON))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	/* start the exposure */
+	zero_time.tv_sec = 0;
+	zero_time.tv_nsec = 0;
+	clock_gettime(CLOCK_REALTIME,&start_time);
+	if(!CCD_DSP_Command_SEX("test_text_simulator","-",handle,zero_time,Exposure_Length))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	/* monitor the exposure and readout */
+	in_readout = FALSE;
+	current_pixel_count = 0;
+	readout_start_time = start_time;
+	arm_data->Readout_Start_Ms = 0.0;
+	do
+	{
+		last_pixel_count = current_pixel_count;
+		if(!CCD_DSP_Command_Get_HSTR("test_text_simulator","-",handle,&status))
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+		/* time the status was read, the progress wait below can take up to TEST_POLL_TIME */
+		clock_gettime(CLOCK_REALTIME,&status_time);
+		status = (status >> CCD_EXPOSURE_HSTR_BIT_SHIFT) & 0x7;
+		if(!CCD_DSP_Command_Wait_Readout_Progress("test_text_simulator","-",handle,pixel_count,
+							  TEST_POLL_TIME,&current_pixel_count))
+		{
+			CCD_Global_Error();
+			return FALSE;
+		}
+		clock_gettime(CLOCK_REALTIME,&current_time);
+		if((status == CCD_EXPOSURE_HSTR_READOUT)&&(in_readout == FALSE))
+		{
+			in_readout = TRUE;
+			readout_start_time = status_time;
+			arm_data->Readout_Start_Ms = Time_Difference(start_time,status_time);
+		}
+		if(current_pixel_count < last_pixel_count)
+		{
+			fprintf(stdout,"Arm %d:FAIL:Readout progress went backwards (%d,%d).\n",arm_data->Arm,
+				last_pixel_count,current_pixel_count);
+			success = FALSE;
+		}
+		if(Time_Difference(start_time,current_time) >
+		   (Exposure_Length+(2.0*pixel_count*1000.0)/pixel_rate+(10*TEST_TIMING_SLACK)))
+		{
+			fprintf(stdout,"Arm %d:FAIL:Readout timed out at %d of %d pixels.\n",arm_data->Arm,
+				current_pixel_count,pixel_count);
+			return FALSE;
+		}
+	}
+	while(current_pixel_count < pixel_count);
+	arm_data->Readout_Ms = Time_Difference(readout_start_time,current_time);
+	/* check the timings */
+	if(in_readout == FALSE)
+	{
+		fprintf(stdout,"Arm %d:FAIL:The HSTR was never in readout mode.\n",arm_data->Arm);
+		success = FALSE;
+	}
+	else if((arm_data->Readout_Start_Ms < Exposure_Length)||
+		(arm_data->Readout_Start_Ms > (Exposure_Length+TEST_TIMING_SLACK)))
+	{
+		fprintf(stdout,"Arm %d:FAIL:Readout started at %.1f ms for a %d ms exposure.\n",arm_data->Arm,
+			arm_data->Readout_Start_Ms,Exposure_Length);
+		success = FALSE;
+	}
+	expected_ms = (((double)pixel_count)*1000.0)/((double)pixel_rate);
+	elapsed_ms = Time_Difference(start_time,current_time)-Exposure_Length;
+	fprintf(stdout,"Arm %d:Readout started after %.1f ms and took %.1f ms (expected %.1f ms).\n",arm_data->Arm,
+		arm_data->Readout_Start_Ms,elapsed_ms,expected_ms);
+	if((elapsed_ms < (expected_ms-TEST_READOUT_TIME_SLACK))||
+	   (elapsed_ms > (expected_ms+TEST_READOUT_TIME_SLACK)))
+	{
+		fprintf(stdout,"Arm %d:FAIL:Readout time %.1f ms not near %.1f ms.\n",arm_data->Arm,elapsed_ms,
+			expected_ms);
+		success = FALSE;
+	}
+	/* the HSTR should now be out of readout mode */
+	if(!CCD_DSP_Command_Get_HSTR("test_text_simulator","-",handle,&status))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	status = (status >> CCD_EXPOSURE_HSTR_BIT_SHIFT) & 0x7;
+	if(status == CCD_EXPOSURE_HSTR_READOUT)
+	{
+		fprintf(stdout,"Arm %d:FAIL:The HSTR is still in readout mode after the readout.\n",arm_data->Arm);
+		success = FALSE;
+	}
+	/* check the data */
+	if(!CCD_Interface_Get_Reply_Data(handle,&exposure_data))
+	{
+		CCD_Global_Error();
+		return FALSE;
+	}
+	if(!Test_Image(arm_data,exposure_data))
+		success = FALSE;
+	if(success)
+		fprintf(stdout,"Arm %d:PASS.\n",arm_data->Arm);
+	return success;
+}
+
+/**
+ * Routine to de-interlace the read out data, and check the result. The simulated illumination gradient
+ * increases with column number, so within the part of each row read by one amplifier the pixel values
+ * should never decrease. Pixels de-interlaced from the wrong place break this.
+ * @param arm_data The configuration of the arm.
+ * @param exposure_data The read out data.
+ * @return The routine returns TRUE if the image passed the checks, and FALSE if it did not.
+ * @see #TEST_MIN_PIXEL_VALUE
+ * @see #TEST_BYTE_SWAP
+ */
+static int Test_Image(struct Test_Arm_Struct *arm_data,unsigned short *exposure_data)
+{
+	unsigned short *image_data = NULL;
+	int x,y,amplifier_width,error_count;
+
+	image_data = (unsigned short *)malloc(Columns*Rows*sizeof(unsigned short));
+	if(image_data == NULL)
+	{
+		fprintf(stdout,"Arm %d:FAIL:Failed to allocate image.\n",arm_data->Arm);
+		return FALSE;
+	}
+	if(!CCD_Exposure_DeInterlace("test_text_simulator","-",Columns,Rows,exposure_data,image_data,
+				     arm_data->DeInterlace_Type,TEST_BYTE_SWAP))
+	{
+		CCD_Global_Error();
+		free(image_data);
+		return FALSE;
+	}
+	if(arm_data->Amplifier == CCD_DSP_AMPLIFIER_BOTH)
+		amplifier_width = Columns/2;
+	else
+		amplifier_width = Columns;
+	error_count = 0;
+	for(y=0;y<Rows;y++)
+	{
+		for(x=0;x<Columns;x++)
+		{
+			if(image_data[(y*Columns)+x] < TEST_MIN_PIXEL_VALUE)
+				error_count++;
+			else if(((x%amplifier_width) > 0)&&
+				(image_data[(y*Columns)+x] < image_data[(y*Columns)+x-1]))
+				error_count++;
+		}
+	}
+	free(image_data);
+	if(error_count > 0)
+	{
+		fprintf(stdout,"Arm %d:FAIL:%d pixels were not in the de-interlaced order.\n",arm_data->Arm,
+			error_count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to return the difference between two times, in milliseconds.
+ * @param start_time The earlier time.
+ * @param end_time The later time.
+ * @return The difference (end_time - start_time), in milliseconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/*
+** $Log$
+*/
@@ -28,6 +28,9 @@
 #include <time.h>
 #include <stdarg.h>
 #include <unistd.h>
+#ifdef DF1_MUTEXED
+#include <pthread.h>
+#endif
 #include "df1_general.h"
 #include "df1.h"
 #include "df1_interface.h"
@@ -37,17 +40,105 @@
  * One millosecond in nanoseconds (1000000).
  */
 #define ONE_MILLISECOND_NS   (1000000)
+/**
+ * Df1_Link_Read_Event event type: nothing arrived before the timeout.
+ */
+#define DF1_LINK_EVENT_NONE     (0)
+/**
+ * Df1_Link_Read_Event event type: an ACK or NAK response arrived.
+ */
+#define DF1_LINK_EVENT_RESPONSE (1)
+/**
+ * Df1_Link_Read_Event event type: a complete (CRC checked) message frame arrived.
+ */
+#define DF1_LINK_EVENT_FRAME    (2)
 
 /* data types */
 /**
- * Local data.
+ * Local data. The ACK timeout Df1_Send uses is learnt from each link's observed response times
+ * (held in the handle's transaction table), in the same way TCP estimates its retransmission timeout: 
+ * a smoothed average plus four times the smoothed mean deviation, clamped to lie between 
+ * Ack_Timeout_Min_Ms and Ack_Timeout_Max_Ms.
  * <dl>
- * <dt>Reply_Pause_Ms</dt> <dd>Number of milliseconds to pause whilst awaiting ACKs.</dd>
+ * <dt>Ack_Timeout_Min_Ms</dt> <dd>The smallest ACK timeout we will use, in milliseconds.</dd>
+ * <dt>Ack_Timeout_Max_Ms</dt> <dd>The largest ACK timeout we will use, in milliseconds. This is also used
+ *     until the first response time has been measured.</dd>
  * </dl>
+ * @see #Df1_Transaction_Table_Struct
  */
 struct Df1_Struct
 {
-	int Reply_Pause_Ms;
+	int Ack_Timeout_Min_Ms;
+	int Ack_Timeout_Max_Ms;
+};
+
+/**
+ * Data for one transaction (a command sent to the PLC, awaiting its reply).
+ * <dl>
+ * <dt>In_Use</dt> <dd>Whether this entry holds an outstanding transaction.</dd>
+ * <dt>Tns</dt> <dd>The transaction number the command was sent with.</dd>
+ * <dt>Complete</dt> <dd>Set to TRUE when a reply with a matching transaction number has been received.</dd>
+ * <dt>Reply</dt> <dd>The reply message.</dd>
+ * </dl>
+ */
+struct Df1_Transaction_Struct
+{
+	int In_Use;
+	word Tns;
+	int Complete;
+	TMsg Reply;
+};
+
+/**
+ * Per interface handle transaction table, holding the link state and outstanding transactions.
+ * Several threads can have commands outstanding on one link at once. Only one can be waiting for an ACK
+ * to a frame it has sent (the sender), and only one reads the link at a time (the reader), 
+ * dispatching ACK/NAKs and replies (matched by tns) into the table for everyone else.
+ * <dl>
+ * <dt>Mutex</dt> <dd>Optionally compiled mutex protecting the table.</dd>
+ * <dt>Write_Mutex</dt> <dd>Optionally compiled mutex held around writes to the link, so frames and responses
+ *     from different threads are not interleaved.</dd>
+ * <dt>Condition</dt> <dd>Optionally compiled condition variable, broadcast when the reader has dispatched
+ *     something, or a role is given up.</dd>
+ * <dt>Tns</dt> <dd>The next transaction number to use on this handle, or -1 if not yet initialised.</dd>
+ * <dt>Reader_Active</dt> <dd>TRUE whilst a thread is reading the link on behalf of all waiters.</dd>
+ * <dt>Sender_Active</dt> <dd>TRUE whilst a thread has sent a frame and is waiting for its ACK/NAK.</dd>
+ * <dt>Response_Received</dt> <dd>Set to TRUE when an ACK or NAK arrives.</dd>
+ * <dt>Response</dt> <dd>The last ACK or NAK received.</dd>
+ * <dt>Last_Response_Sent</dt> <dd>The last ACK or NAK we sent, which is repeated if the PLC sends an ENQ.</dd>
+ * <dt>Unmatched_Received</dt> <dd>Set to TRUE when a frame arrives that does not match an outstanding 
+ *     transaction.</dd>
+ * <dt>Unmatched_Reply</dt> <dd>The last unmatched frame received, returned by Df1_Receive.</dd>
+ * <dt>Ack_Time_Average_Ms</dt> <dd>The smoothed average time between sending a message on this link and
+ *     receiving an ACK/NAK, in milliseconds.</dd>
+ * <dt>Ack_Time_Deviation_Ms</dt> <dd>The smoothed mean deviation of the ACK/NAK response time on this link,
+ *     in milliseconds.</dd>
+ * <dt>Ack_Time_Count</dt> <dd>The number of response times measured so far on this link.</dd>
+ * <dt>Transaction_List</dt> <dd>The outstanding transactions.</dd>
+ * </dl>
+ * @see #Df1_Struct
+ * @see #Df1_Transaction_Struct
+ * @see #DF1_TRANSACTION_COUNT
+ */
+struct Df1_Transaction_Table_Struct
+{
+#ifdef DF1_MUTEXED
+	pthread_mutex_t Mutex;
+	pthread_mutex_t Write_Mutex;
+	pthread_cond_t Condition;
+#endif
+	int Tns;
+	int Reader_Active;
+	int Sender_Active;
+	int Response_Received;
+	byte Response;
+	byte Last_Response_Sent;
+	int Unmatched_Received;
+	TMsg Unmatched_Reply;
+	double Ack_Time_Average_Ms;
+	double Ack_Time_Deviation_Ms;
+	int Ack_Time_Count;
+	struct Df1_Transaction_Struct Transaction_List[DF1_TRANSACTION_COUNT];
 };
 
 /* internal variables */
@@ -58,291 +149,468 @@ static char rcsid[] = "$Id: df1.c,v 1.1 2023-03-21 14:34:10 cjm Exp $";
 /**
  * Instance of local data. Initialised as follows:
  * <dl>
- * <dt>Reply_Pause_Ms</dt> <dd>100.</dd>
+ * <dt>Ack_Timeout_Min_Ms</dt> <dd>10.</dd>
+ * <dt>Ack_Timeout_Max_Ms</dt> <dd>1000.</dd>
  * </dl>
  * @see #Df1_Struct
  */
-static struct Df1_Struct Df1_Data = {100};
+static struct Df1_Struct Df1_Data = {10,1000};
+/**
+ * CRC-16 lookup table (reflected polynomial 0xA001), indexed by the low byte of the current CRC exclusive-or'd
+ * with the next data byte. Entry n is the result of running Df1_Calc_Crc's 8 shift/xor steps on n.
+ * @see #Df1_Crc_Add_Byte
+ * @see #Df1_Calc_Crc
+ */
+static const word Df1_Crc_Table[256] =
+{
+	0x0000,0xc0c1,0xc181,0x0140,0xc301,0x03c0,0x0280,0xc241,
+	0xc601,0x06c0,0x0780,0xc741,0x0500,0xc5c1,0xc481,0x0440,
+	0xcc01,0x0cc0,0x0d80,0xcd41,0x0f00,0xcfc1,0xce81,0x0e40,
+	0x0a00,0xcac1,0xcb81,0x0b40,0xc901,0x09c0,0x0880,0xc841,
+	0xd801,0x18c0,0x1980,0xd941,0x1b00,0xdbc1,0xda81,0x1a40,
+	0x1e00,0xdec1,0xdf81,0x1f40,0xdd01,0x1dc0,0x1c80,0xdc41,
+	0x1400,0xd4c1,0xd581,0x1540,0xd701,0x17c0,0x1680,0xd641,
+	0xd201,0x12c0,0x1380,0xd341,0x1100,0xd1c1,0xd081,0x1040,
+	0xf001,0x30c0,0x3180,0xf141,0x3300,0xf3c1,0xf281,0x3240,
+	0x3600,0xf6c1,0xf781,0x3740,0xf501,0x35c0,0x3480,0xf441,
+	0x3c00,0xfcc1,0xfd81,0x3d40,0xff01,0x3fc0,0x3e80,0xfe41,
+	0xfa01,0x3ac0,0x3b80,0xfb41,0x3900,0xf9c1,0xf881,0x3840,
+	0x2800,0xe8c1,0xe981,0x2940,0xeb01,0x2bc0,0x2a80,0xea41,
+	0xee01,0x2ec0,0x2f80,0xef41,0x2d00,0xedc1,0xec81,0x2c40,
+	0xe401,0x24c0,0x2580,0xe541,0x2700,0xe7c1,0xe681,0x2640,
+	0x2200,0xe2c1,0xe381,0x2340,0xe101,0x21c0,0x2080,0xe041,
+	0xa001,0x60c0,0x6180,0xa141,0x6300,0xa3c1,0xa281,0x6240,
+	0x6600,0xa6c1,0xa781,0x6740,0xa501,0x65c0,0x6480,0xa441,
+	0x6c00,0xacc1,0xad81,0x6d40,0xaf01,0x6fc0,0x6e80,0xae41,
+	0xaa01,0x6ac0,0x6b80,0xab41,0x6900,0xa9c1,0xa881,0x6840,
+	0x7800,0xb8c1,0xb981,0x7940,0xbb01,0x7bc0,0x7a80,0xba41,
+	0xbe01,0x7ec0,0x7f80,0xbf41,0x7d00,0xbdc1,0xbc81,0x7c40,
+	0xb401,0x74c0,0x7580,0xb541,0x7700,0xb7c1,0xb681,0x7640,
+	0x7200,0xb2c1,0xb381,0x7340,0xb101,0x71c0,0x7080,0xb041,
+	0x5000,0x90c1,0x9181,0x5140,0x9301,0x53c0,0x5280,0x9241,
+	0x9601,0x56c0,0x5780,0x9741,0x5500,0x95c1,0x9481,0x5440,
+	0x9c01,0x5cc0,0x5d80,0x9d41,0x5f00,0x9fc1,0x9e81,0x5e40,
+	0x5a00,0x9ac1,0x9b81,0x5b40,0x9901,0x59c0,0x5880,0x9841,
+	0x8801,0x48c0,0x4980,0x8941,0x4b00,0x8bc1,0x8a81,0x4a40,
+	0x4e00,0x8ec1,0x8f81,0x4f40,0x8d01,0x4dc0,0x4c80,0x8c41,
+	0x4400,0x84c1,0x8581,0x4540,0x8701,0x47c0,0x4680,0x8641,
+	0x8201,0x42c0,0x4380,0x8341,0x4100,0x81c1,0x8081,0x4040
+};
 
 /* internal function prototypes */
-static int Df1_Send_Response(Df1_Interface_Handle_T *handle,byte response);
+static int Df1_Send_Frame(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,TBuffer *data_send);
+static int Df1_Send_Response(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,byte response);
+static int Df1_Link_Write(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,void *buffer,
+			  size_t length);
+static int Df1_Link_Wait(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,int timeout_ms,
+			 int *flag,int *done);
+static int Df1_Link_Read_Event(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,int timeout_ms,
+			       int *event,byte *response,TMsg *msg);
+static void Df1_Link_Dispatch(Df1_Transaction_Table_T *table,int event,byte response,TMsg *msg);
+static void Df1_Transaction_Table_Lock(Df1_Transaction_Table_T *table);
+static void Df1_Transaction_Table_Unlock(Df1_Transaction_Table_T *table);
+static void Df1_Transaction_Table_Wait(Df1_Transaction_Table_T *table,struct timespec *end_time);
+static void Df1_Transaction_Table_Broadcast(Df1_Transaction_Table_T *table);
 static int Df1_Get_Symbol(Df1_Interface_Handle_T *handle,byte * b,int *flag);
+static int Df1_Ack_Timeout_Get(Df1_Transaction_Table_T *table);
+static int Df1_Ack_Timeout_Compute(Df1_Transaction_Table_T *table);
+static void Df1_Ack_Time_Add(Df1_Transaction_Table_T *table,double ack_time_ms);
+static double Df1_Time_Diff_Ms(struct timespec start_time,struct timespec end_time);
+static void Df1_Time_Add_Ms(struct timespec *time,int ms);
 static word Df1_Bytes2Word(byte lowb, byte highb);
 static int Df1_Add_Word2Buffer(TBuffer * buffer, word value);
 static int Df1_Add_Byte2Buffer(TBuffer * buffer, byte value);
-static int Df1_Add_Data2Buffer(TBuffer * buffer, void * data, byte size);
-static int Df1_Add_Data2BufferWithDLE(TBuffer * buffer, TMsg msg);
+static int Df1_Add_Data2BufferWithDLE(TBuffer * buffer, TMsg *msg, word *crc);
 static char * Df1_Print_Symbol(byte c);
-static word Df1_Compute_Crc(TBuffer * buffer);
+static word Df1_Crc_Add_Byte(word crc,byte b);
 static word Df1_Calc_Crc(word crc,word buffer);
 
 /* ----------------------------------------------------------------
 ** external functions 
 ** ---------------------------------------------------------------- */
 /**
- * Routine to send a DF1 protocol command.
+ * Routine to send a DF1 protocol command. After the message is written, we wait for the PLC's ACK/NAK
+ * for the current ACK timeout, returning as soon as it arrives. A NAK causes the message to be resent (at most
+ * 3 times), and a timeout causes an ENQ to be sent to ask the PLC to repeat its response (at most 3 times).
+ * The time taken for the PLC to respond to a message (not retried or ENQ'd, to avoid ambiguity) is used
+ * to update the ACK timeout. DF1 only allows one un-acknowledged frame at a time, so concurrent callers
+ * queue here for the sender role, but only until the ACK arrives, not for the whole transaction.
  * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
  * @param df1_data An instance of TMsg containing the data to send to the PLC.
  * @return The routine returns TRUE on success and FALSE on failure.
- * @see #Df1_Send_Response
- * @see #Df1_Get_Symbol
+ * @see #Df1_Send_Frame
+ * @see #Df1_Transaction_Table_Lock
+ * @see #Df1_Transaction_Table_Unlock
+ * @see #Df1_Transaction_Table_Wait
+ * @see #Df1_Transaction_Table_Broadcast
  * @see #TBuffer
  * @see #TMsg
  * @see #Df1_Add_Byte2Buffer
- * @see #Df1_Add_Data2Buffer
  * @see #Df1_Add_Word2Buffer
  * @see #Df1_Add_Data2BufferWithDLE
- * @see #Df1_Compute_Crc
- * @see #Df1_Print_Symbol
+ * @see #Df1_Crc_Add_Byte
  * @see df1_interface.html#Df1_Interface_Handle_T
- * @see df1_interface.html#Df1_Interface_Write
+ * @see df1_interface.html#Df1_Interface_Transaction_Table_Get
  */
 int Df1_Send(Df1_Interface_Handle_T *handle,TMsg df1_data)
 {
-	TBuffer crc_buffer,data_send,data_rcv;
-	struct timespec sleep_time;
-	int nbr_NAK=0;
-	int nbr_ENQ=0;
-	int retval,sleep_errno,flag;
-	byte c;
+	Df1_Transaction_Table_T *table = NULL;
+	TBuffer data_send;
+	word crc;
+	int retval;
 
 #if LOGGING > 5
 	Df1_Log(DF1_LOG_BIT_DF1,"Df1_Send Started.");
 #endif /* LOGGING */
+	table = Df1_Interface_Transaction_Table_Get(handle);
+	if(table == NULL)
+	{
+		Df1_Error_Number = 311;
+		sprintf(Df1_Error_String,"Df1_Send:Handle has no transaction table.");
+		return FALSE;
+	}
 	/* initialise buffers */
-	bzero(&crc_buffer,sizeof(crc_buffer));
-	bzero(&data_send,sizeof(data_send));
-	bzero(&data_rcv,sizeof(data_rcv));
-	/* create message to send */
+	data_send.size = 0;
+	crc = 0;
+	/* create message to send, the CRC is computed as the data is DLE stuffed, and includes the ETX */
 	Df1_Add_Byte2Buffer(&data_send,DLE);	
 	Df1_Add_Byte2Buffer(&data_send,STX);
-	Df1_Add_Data2BufferWithDLE(&data_send,df1_data);
+	Df1_Add_Data2BufferWithDLE(&data_send,&df1_data,&crc);
 	Df1_Add_Byte2Buffer(&data_send,DLE);	
 	Df1_Add_Byte2Buffer(&data_send,ETX);	
-	Df1_Add_Data2Buffer(&crc_buffer,&df1_data,df1_data.size+6);
-	Df1_Add_Word2Buffer(&data_send, Df1_Compute_Crc(&crc_buffer));
-	/* enter loop to send buffer */
-	do
-	{
+	crc = Df1_Crc_Add_Byte(crc,ETX);
+	Df1_Add_Word2Buffer(&data_send,crc);
+	/* acquire the sender role */
+	Df1_Transaction_Table_Lock(table);
+	while(table->Sender_Active)
+		Df1_Transaction_Table_Wait(table,NULL);
+	table->Sender_Active = TRUE;
+	Df1_Transaction_Table_Unlock(table);
+	retval = Df1_Send_Frame(handle,table,&data_send);
+	/* release the sender role */
+	Df1_Transaction_Table_Lock(table);
+	table->Sender_Active = FALSE;
+	Df1_Transaction_Table_Broadcast(table);
+	Df1_Transaction_Table_Unlock(table);
 #if LOGGING > 5
-		Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send writing %d bytes.",data_send.size);
+	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send Finished with retval %d.",retval);
 #endif /* LOGGING */
-		if(!Df1_Interface_Write(handle,&data_send, data_send.size))
-			return FALSE;
-		/* read ACK or NAK */
-		do
-		{
-			/* sleep for Reply_Pause_Ms */
-			sleep_time.tv_sec = (Df1_Data.Reply_Pause_Ms/1000);
-			sleep_time.tv_nsec = (Df1_Data.Reply_Pause_Ms%1000)*ONE_MILLISECOND_NS;
-			retval = nanosleep(&sleep_time,NULL);
-			if(retval != 0)
-			{
-				sleep_errno = errno;
-				Df1_Error_Number = 300;
-				sprintf(Df1_Error_String,"Df1_Send:nanosleep failed(%d).",retval);
-				Df1_Error();
-				/* not a fatal error, don't return */
-			}
-			/* increment counter */
-			nbr_ENQ++;
-			if(nbr_ENQ > 3)
-			{
-				Df1_Error_Number = 301;
-				sprintf(Df1_Error_String,"Df1_Send:ENQ Timeout.");
-				return FALSE;
-			}
-			/* enquire response */
-#if LOGGING > 5
-			Df1_Log(DF1_LOG_BIT_DF1,"Df1_Send : Df1_Send_Response(ENQ).");
-#endif /* LOGGING */
-			if(!Df1_Send_Response(handle,ENQ))
-				Df1_Error();
-#if LOGGING > 5
-			Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send : Calling Df1_Get_Symbol.",ENQ);
-#endif /* LOGGING */
-			if(!Df1_Get_Symbol(handle,&c,&flag))
-				Df1_Error();
-#if LOGGING > 5
-			Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send : Df1_Get_Symbol returned byte=%s,flag=%d.",
-				       Df1_Print_Symbol(c),flag);
-#endif /* LOGGING */
-		} 
-		while ((flag!=CONTROL_FLAG) & ((c!=ACK) | (c!=NAK)));
-		if (c==ACK)
-		{
-#if LOGGING > 5
-			Df1_Log(DF1_LOG_BIT_DF1,"Df1_Send Finished.");
-#endif /* LOGGING */
-			 return TRUE;
-		}
-		if (c==NAK) 
-		{
-			nbr_NAK++;
-		}
-	} while (nbr_NAK<=3);
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1,"Df1_Send Finished with error.");
-#endif /* LOGGING */
-	Df1_Error_Number = 302;
-	sprintf(Df1_Error_String,"Df1_Send:Too many NAKs (%d).",nbr_NAK);
-	return FALSE;
+	return retval;
 }
 
 /**
- * Receive a DF1 message.
+ * Receive a DF1 message, that does not match an outstanding transaction started with Df1_Transaction_Send.
+ * We wait up to the interface handle's read timeout for the message to arrive.
  * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
- * @param df1_data The address of a TMsg structure to fill with the received data.
+ * @param df1_data The address of a TMsg structure to fill with the received data. The size field is
+ *        set to the number of data bytes received (excluding the message header).
  * @return The routine returns TRUE on success and FALSE on failure.
  * @see #TMsg
- * @see #TBuffer
- * @see #Df1_Get_Symbol
- * @see #Df1_Send_Response
- * @see #Df1_Add_Byte2Buffer
- * @see #Df1_Bytes2Word
- * @see #Df1_Compute_Crc
- * @see #Df1_Print_Symbol
+ * @see #Df1_Link_Wait
+ * @see #Df1_Transaction_Table_Lock
+ * @see #Df1_Transaction_Table_Unlock
  * @see df1_interface.html#Df1_Interface_Handle_T
- * @see df1_interface.html#Df1_Interface_Read
+ * @see df1_interface.html#Df1_Interface_Transaction_Table_Get
+ * @see df1_interface.html#Df1_Interface_Read_Timeout_Get
  */
 int Df1_Receive(Df1_Interface_Handle_T *handle,TMsg *df1_data) 
 {
-	byte c,crcb1,crcb2;
-	word crc;
-	TBuffer data_rcv;
-	int flag,done,crc_ok,bytes_read;
-	
+	Df1_Transaction_Table_T *table = NULL;
+	int received;
+
 #if LOGGING > 5
 	Df1_Log(DF1_LOG_BIT_DF1,"Df1_Receive Started.");
 #endif /* LOGGING */
-	crc_ok=FALSE;
-	do
+	if(df1_data == NULL)
 	{
-		bzero(&data_rcv,sizeof(data_rcv));
-		do
-		{
-#if LOGGING > 5
-			Df1_Log(DF1_LOG_BIT_DF1,"Df1_Receive: Looking for control flag symbol.");
-#endif /* LOGGING */
-			if(!Df1_Get_Symbol(handle,&c,&flag))
-				return FALSE;
-		}
-		while (flag!=CONTROL_FLAG);
-#if LOGGING > 5
-		Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Receive: Found control flag %d, symbol %s.",flag,
-			       Df1_Print_Symbol(c));
-#endif /* LOGGING */
-		switch (c)
-		{	
-			case ENQ: 
-#if LOGGING > 5
-				Df1_Log_Format(DF1_LOG_BIT_DF1,
-					       "Df1_Receive: Found control flag ENQ: Sending response NAK.");
-#endif /* LOGGING */
-				/* send NAK - was last_response, but that was always set to NAK */
-				if(!Df1_Send_Response(handle,NAK))
-					return FALSE;
-				break;
-			case STX:
-#if LOGGING > 5
-				Df1_Log(DF1_LOG_BIT_DF1,"Df1_Receive: Found control flag STX: Reading data.");
-#endif /* LOGGING */
-				done = FALSE;
-				while(done == FALSE)
-				{
-					if(!Df1_Get_Symbol(handle,&c,&flag))
-						return FALSE;
-					if(flag !=CONTROL_FLAG)
-					{
-						if(!Df1_Add_Byte2Buffer(&data_rcv,c))
-							return FALSE;
-					}
-					else
-					{
-						done = TRUE;
-					}
-				}
-				if (c==ETX)
-				{
-#if LOGGING > 5
-					Df1_Log(DF1_LOG_BIT_DF1,"Df1_Receive: Data terminated with ETX: Getting CRC.");
-#endif /* LOGGING */
-					/* read crcb1 */
-					if(!Df1_Interface_Read(handle,&crcb1,1,&bytes_read))
-						return FALSE;
-					if(bytes_read < 1)
-					{
-						Df1_Error_Number = 307;
-						sprintf(Df1_Error_String,
-							"Df1_Receive:crcb1 bytes_read was too small(%d).",bytes_read);
-						return FALSE;
-					}
-					/* read crcb2 */
-					if(!Df1_Interface_Read(handle,&crcb2,1,&bytes_read))
-						return FALSE;
-					if(bytes_read < 1)
-					{
-						Df1_Error_Number = 308;
-						sprintf(Df1_Error_String,
-							"Df1_Receive:crcb2 bytes_read was too small(%d).",bytes_read);
-						return FALSE;
-					}
-					/* create crc and check it */
-					crc = Df1_Bytes2Word(crcb1,crcb2);
-					if (crc==Df1_Compute_Crc(&data_rcv)) 
-					{
-#if LOGGING > 5
-						Df1_Log(DF1_LOG_BIT_DF1,
-							"Df1_Receive: CRC was good - sending ACK response.");
-#endif /* LOGGING */
-						if(!Df1_Send_Response(handle,ACK))
-							return FALSE;
-						crc_ok=TRUE;
-					}	
-					else
-					{
-#if LOGGING > 5
-						Df1_Log(DF1_LOG_BIT_DF1,
-							"Df1_Receive: CRC was bad - sending NAK response.");
-#endif /* LOGGING */
-						if(!Df1_Send_Response(handle,NAK))
-							return FALSE;
-						crc_ok=FALSE;	
-					}
-				}
-				else
-				{
-#if LOGGING > 5
-					Df1_Log_Format(DF1_LOG_BIT_DF1,
-					    "Df1_Receive: Data was not terminated with ETX(%s): Sending NAK response.",
-						       Df1_Print_Symbol(c));
-#endif /* LOGGING */
-					if(!Df1_Send_Response(handle,NAK))
-						return FALSE;
-				} 
-				break;
-			default:
+		Df1_Error_Number = 312;
+		sprintf(Df1_Error_String,"Df1_Receive:df1_data was NULL.");
+		return FALSE;
+	}
+	table = Df1_Interface_Transaction_Table_Get(handle);
+	if(table == NULL)
+	{
+		Df1_Error_Number = 313;
+		sprintf(Df1_Error_String,"Df1_Receive:Handle has no transaction table.");
+		return FALSE;
+	}
+	if(!Df1_Link_Wait(handle,table,Df1_Interface_Read_Timeout_Get(handle),&(table->Unmatched_Received),
+			  &received))
+		return FALSE;
+	if(received == FALSE)
+	{
+		Df1_Error_Number = 314;
+		sprintf(Df1_Error_String,"Df1_Receive:Timed out waiting for a message.");
+		return FALSE;
+	}
+	Df1_Transaction_Table_Lock(table);
+	(*df1_data) = table->Unmatched_Reply;
+	table->Unmatched_Received = FALSE;
+	Df1_Transaction_Table_Unlock(table);
 #if LOGGING > 5
-				Df1_Log_Format(DF1_LOG_BIT_DF1,
-					"Df1_Receive: Control flag was not STX or ENQ(%s): Sending NAK response.",
-					       Df1_Print_Symbol(c));
+	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Receive: Finished with %d bytes of data.",df1_data->size);
 #endif /* LOGGING */
-				if(!Df1_Send_Response(handle,NAK))
-					return FALSE;
+	return TRUE;
+}
+
+/**
+ * Routine to allocate and initialise a transaction table, which holds the link state and outstanding
+ * transactions for one interface handle. This is called from Df1_Interface_Handle_Create.
+ * @param table The address of a pointer to allocate the table.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Transaction_Table_Struct
+ * @see df1_interface.html#Df1_Interface_Handle_Create
+ */
+int Df1_Transaction_Table_Create(Df1_Transaction_Table_T **table)
+{
+#ifdef DF1_MUTEXED
+	pthread_condattr_t condition_attr;
+#endif
+	int i;
+
+	if(table == NULL)
+	{
+		Df1_Error_Number = 315;
+		sprintf(Df1_Error_String,"Df1_Transaction_Table_Create:table was NULL.");
+		return FALSE;
+	}
+	(*table) = (Df1_Transaction_Table_T *)malloc(sizeof(Df1_Transaction_Table_T));
+	if((*table) == NULL)
+	{
+		Df1_Error_Number = 316;
+		sprintf(Df1_Error_String,"Df1_Transaction_Table_Create:Failed to allocate table.");
+		return FALSE;
+	}
+	bzero((*table),sizeof(Df1_Transaction_Table_T));
+#ifdef DF1_MUTEXED
+	pthread_mutex_init(&((*table)->Mutex),NULL);
+	pthread_mutex_init(&((*table)->Write_Mutex),NULL);
+	/* use the monotonic clock for timed waits, as our deadlines are computed with it */
+	pthread_condattr_init(&condition_attr);
+	pthread_condattr_setclock(&condition_attr,CLOCK_MONOTONIC);
+	pthread_cond_init(&((*table)->Condition),&condition_attr);
+	pthread_condattr_destroy(&condition_attr);
+#endif
+	(*table)->Tns = -1;
+	(*table)->Reader_Active = FALSE;
+	(*table)->Sender_Active = FALSE;
+	(*table)->Response_Received = FALSE;
+	(*table)->Last_Response_Sent = NAK;
+	(*table)->Unmatched_Received = FALSE;
+	(*table)->Ack_Time_Average_Ms = 0.0;
+	(*table)->Ack_Time_Deviation_Ms = 0.0;
+	(*table)->Ack_Time_Count = 0;
+	for(i = 0; i < DF1_TRANSACTION_COUNT; i++)
+	{
+		(*table)->Transaction_List[i].In_Use = FALSE;
+		(*table)->Transaction_List[i].Complete = FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to free a transaction table allocated by Df1_Transaction_Table_Create.
+ * This is called from Df1_Interface_Handle_Destroy.
+ * @param table The address of a pointer to the table, which is set to NULL.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Transaction_Table_Struct
+ * @see df1_interface.html#Df1_Interface_Handle_Destroy
+ */
+int Df1_Transaction_Table_Destroy(Df1_Transaction_Table_T **table)
+{
+	if((table == NULL)||((*table) == NULL))
+	{
+		Df1_Error_Number = 317;
+		sprintf(Df1_Error_String,"Df1_Transaction_Table_Destroy:table was NULL.");
+		return FALSE;
+	}
+#ifdef DF1_MUTEXED
+	pthread_cond_destroy(&((*table)->Condition));
+	pthread_mutex_destroy(&((*table)->Write_Mutex));
+	pthread_mutex_destroy(&((*table)->Mutex));
+#endif
+	free((*table));
+	(*table) = NULL;
+	return TRUE;
+}
+
+/**
+ * Start a DF1 transaction. The message is given the handle's next transaction number (tns), entered into the
+ * handle's transaction table, and sent (Df1_Send returns when the PLC has ACKed it). We do not wait for the
+ * reply: call Df1_Transaction_Wait with the returned transaction_index to collect it. Up to DF1_TRANSACTION_COUNT
+ * transactions can be outstanding at once, and the replies can arrive in any order.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param df1_data The address of a TMsg containing the command to send. Its tns field is filled in.
+ * @param transaction_index The address of an integer, filled in with the index of the transaction in
+ *        the table.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Send
+ * @see #Df1_Transaction_Wait
+ * @see #Df1_Transaction_Table_Struct
+ * @see #DF1_TRANSACTION_COUNT
+ * @see df1_interface.html#Df1_Interface_Transaction_Table_Get
+ */
+int Df1_Transaction_Send(Df1_Interface_Handle_T *handle,TMsg *df1_data,int *transaction_index)
+{
+	Df1_Transaction_Table_T *table = NULL;
+	int i,index;
+
+	if(df1_data == NULL)
+	{
+		Df1_Error_Number = 318;
+		sprintf(Df1_Error_String,"Df1_Transaction_Send:df1_data was NULL.");
+		return FALSE;
+	}
+	if(transaction_index == NULL)
+	{
+		Df1_Error_Number = 319;
+		sprintf(Df1_Error_String,"Df1_Transaction_Send:transaction_index was NULL.");
+		return FALSE;
+	}
+	table = Df1_Interface_Transaction_Table_Get(handle);
+	if(table == NULL)
+	{
+		Df1_Error_Number = 320;
+		sprintf(Df1_Error_String,"Df1_Transaction_Send:Handle has no transaction table.");
+		return FALSE;
+	}
+	/* allocate a transaction slot and number */
+	Df1_Transaction_Table_Lock(table);
+	index = -1;
+	for(i = 0; i < DF1_TRANSACTION_COUNT; i++)
+	{
+		if(table->Transaction_List[i].In_Use == FALSE)
+		{
+			index = i;
+			break;
 		}
-	} 
-	while (crc_ok != TRUE);
+	}
+	if(index < 0)
+	{
+		Df1_Transaction_Table_Unlock(table);
+		Df1_Error_Number = 321;
+		sprintf(Df1_Error_String,"Df1_Transaction_Send:Too many outstanding transactions (%d).",
+			DF1_TRANSACTION_COUNT);
+		return FALSE;
+	}
+	/* initialise Tns if it has not been used before */
+	if(table->Tns < 0)
+		table->Tns = (word)time(NULL);
+	df1_data->tns = (word)(table->Tns++);
+	table->Tns &= 0xffff;
+	table->Transaction_List[index].In_Use = TRUE;
+	table->Transaction_List[index].Complete = FALSE;
+	table->Transaction_List[index].Tns = df1_data->tns;
+	Df1_Transaction_Table_Unlock(table);
 #if LOGGING > 5
-	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Receive: Received %d bytes of data : Copying to df1_data.",data_rcv.size);
+	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Transaction_Send: Sending tns %d using transaction %d.",
+		       df1_data->tns,index);
 #endif /* LOGGING */
-	/* diddly dodgy, check size vs TMsg data size (255 + a bit) */
-	memcpy(df1_data,data_rcv.data,data_rcv.size);
+	if(!Df1_Send(handle,(*df1_data)))
+	{
+		Df1_Transaction_Table_Lock(table);
+		table->Transaction_List[index].In_Use = FALSE;
+		Df1_Transaction_Table_Unlock(table);
+		return FALSE;
+	}
+	(*transaction_index) = index;
+	return TRUE;
+}
+
+/**
+ * Wait for the reply to a transaction started with Df1_Transaction_Send. Whilst waiting, this thread may
+ * read the link on behalf of all waiters, dispatching replies to their transactions by tns. The
+ * transaction is finished (its table entry freed) when this routine returns, successfully or not.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param transaction_index The index returned by Df1_Transaction_Send.
+ * @param timeout_ms How long to wait for the reply, in milliseconds.
+ * @param reply The address of a TMsg to fill in with the reply.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Transaction_Send
+ * @see #Df1_Link_Wait
+ * @see #Df1_Transaction_Table_Struct
+ * @see df1_interface.html#Df1_Interface_Transaction_Table_Get
+ */
+int Df1_Transaction_Wait(Df1_Interface_Handle_T *handle,int transaction_index,int timeout_ms,TMsg *reply)
+{
+	Df1_Transaction_Table_T *table = NULL;
+	int complete,in_use;
+
+	if(reply == NULL)
+	{
+		Df1_Error_Number = 322;
+		sprintf(Df1_Error_String,"Df1_Transaction_Wait:reply was NULL.");
+		return FALSE;
+	}
+	table = Df1_Interface_Transaction_Table_Get(handle);
+	if(table == NULL)
+	{
+		Df1_Error_Number = 323;
+		sprintf(Df1_Error_String,"Df1_Transaction_Wait:Handle has no transaction table.");
+		return FALSE;
+	}
+	if((transaction_index >= 0)&&(transaction_index < DF1_TRANSACTION_COUNT))
+	{
+		Df1_Transaction_Table_Lock(table);
+		in_use = table->Transaction_List[transaction_index].In_Use;
+		Df1_Transaction_Table_Unlock(table);
+	}
+	else
+		in_use = FALSE;
+	if(in_use == FALSE)
+	{
+		Df1_Error_Number = 324;
+		sprintf(Df1_Error_String,"Df1_Transaction_Wait:Illegal transaction index %d.",transaction_index);
+		return FALSE;
+	}
+	if(!Df1_Link_Wait(handle,table,timeout_ms,&(table->Transaction_List[transaction_index].Complete),&complete))
+	{
+		Df1_Transaction_Table_Lock(table);
+		table->Transaction_List[transaction_index].In_Use = FALSE;
+		Df1_Transaction_Table_Unlock(table);
+		return FALSE;
+	}
+	Df1_Transaction_Table_Lock(table);
+	if(complete)
+		(*reply) = table->Transaction_List[transaction_index].Reply;
+	table->Transaction_List[transaction_index].In_Use = FALSE;
+	table->Transaction_List[transaction_index].Complete = FALSE;
+	Df1_Transaction_Table_Unlock(table);
+	if(complete == FALSE)
+	{
+		Df1_Error_Number = 325;
+		sprintf(Df1_Error_String,"Df1_Transaction_Wait:Timed out after %d ms waiting for transaction %d.",
+			timeout_ms,transaction_index);
+		return FALSE;
+	}
 #if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1,"Df1_Receive: Finished.");
+	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Transaction_Wait: Transaction %d received reply tns %d.",
+		       transaction_index,reply->tns);
 #endif /* LOGGING */
 	return TRUE;
 }
 
+/**
+ * Send a DF1 command and wait for its reply. This is Df1_Transaction_Send followed by Df1_Transaction_Wait,
+ * waiting for up to the interface handle's read timeout. Other threads can send their own commands on
+ * the same handle whilst we wait.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param df1_data The address of a TMsg containing the command to send. Its tns field is filled in.
+ * @param reply The address of a TMsg to fill in with the reply.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Transaction_Send
+ * @see #Df1_Transaction_Wait
+ * @see df1_interface.html#Df1_Interface_Read_Timeout_Get
+ */
+int Df1_Transaction(Df1_Interface_Handle_T *handle,TMsg *df1_data,TMsg *reply)
+{
+	int transaction_index;
+
+	if(!Df1_Transaction_Send(handle,df1_data,&transaction_index))
+		return FALSE;
+	return Df1_Transaction_Wait(handle,transaction_index,Df1_Interface_Read_Timeout_Get(handle),reply);
+}
+
 /**
  * Routine to take a string representation of a PLC address and turn it into an instance of TThree_Address_Fields.
  * @param straddress The string version of the address.
@@ -471,31 +739,164 @@ int Df1_Calc_Address(char *straddress,TThree_Address_Fields *address)
 	return TRUE;
 }
 
+/**
+ * Compute the DF1 CRC-16 of some data, using the lookup table. This is the routine used when framing and
+ * deframing messages. Pass 0 as the initial CRC, or the result of a previous call to continue a CRC over
+ * several pieces of data. The DF1 frame CRC also includes the ETX, which the caller must add.
+ * @param crc The initial CRC.
+ * @param data The address of the data.
+ * @param length The number of bytes of data.
+ * @return The updated CRC.
+ * @see #Df1_Crc_Add_Byte
+ * @see #Df1_Crc_Compute_Bitwise
+ */
+word Df1_Crc_Compute(word crc,byte *data,int length)
+{
+	int i;
+
+	for(i = 0; i < length; i++)
+		crc = Df1_Crc_Add_Byte(crc,data[i]);
+	return crc;
+}
+
+/**
+ * Compute the DF1 CRC-16 of some data, one bit at a time. This gives the same result as Df1_Crc_Compute,
+ * and is kept as a reference to test the table driven version against.
+ * @param crc The initial CRC.
+ * @param data The address of the data.
+ * @param length The number of bytes of data.
+ * @return The updated CRC.
+ * @see #Df1_Calc_Crc
+ * @see #Df1_Crc_Compute
+ */
+word Df1_Crc_Compute_Bitwise(word crc,byte *data,int length)
+{
+	int i;
+
+	for(i = 0; i < length; i++)
+		crc = Df1_Calc_Crc(crc,data[i]);
+	return crc;
+}
+
 /* ----------------------------------------------------------------
 ** internal functions 
 ** ---------------------------------------------------------------- */
 /**
- * Send a reponse request (NAK or ACK).
+ * Write a frame to the PLC, and wait for its ACK/NAK. The caller must hold the sender role
+ * (table->Sender_Active). See Df1_Send for the retry strategy.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param table The handle's transaction table.
+ * @param data_send The complete (DLE stuffed, with CRC) frame to send.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Send
+ * @see #Df1_Link_Write
+ * @see #Df1_Link_Wait
+ * @see #Df1_Send_Response
+ * @see #Df1_Ack_Timeout_Get
+ * @see #Df1_Ack_Time_Add
+ * @see #Df1_Time_Diff_Ms
+ * @see #Df1_Print_Symbol
+ */
+static int Df1_Send_Frame(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,TBuffer *data_send)
+{
+	struct timespec send_time,response_time;
+	int nbr_NAK=0;
+	int nbr_ENQ=0;
+	int enq_sent,got_response,timeout_ms;
+	byte c;
+
+	do
+	{
+#if LOGGING > 5
+		Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send_Frame writing %d bytes.",data_send->size);
+#endif /* LOGGING */
+		Df1_Transaction_Table_Lock(table);
+		table->Response_Received = FALSE;
+		Df1_Transaction_Table_Unlock(table);
+		if(!Df1_Link_Write(handle,table,data_send->data,data_send->size))
+			return FALSE;
+		clock_gettime(CLOCK_MONOTONIC,&send_time);
+		enq_sent = FALSE;
+		/* wait for ACK or NAK */
+		do
+		{
+			timeout_ms = Df1_Ack_Timeout_Get(table);
+#if LOGGING > 5
+			Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send_Frame : Waiting up to %d ms for a response.",timeout_ms);
+#endif /* LOGGING */
+			if(!Df1_Link_Wait(handle,table,timeout_ms,&(table->Response_Received),&got_response))
+				return FALSE;
+			if(got_response == FALSE)
+			{
+				nbr_ENQ++;
+				if(nbr_ENQ > 3)
+				{
+					Df1_Error_Number = 301;
+					sprintf(Df1_Error_String,"Df1_Send:ENQ Timeout.");
+					return FALSE;
+				}
+				/* enquire response */
+#if LOGGING > 5
+				Df1_Log(DF1_LOG_BIT_DF1,"Df1_Send_Frame : Df1_Send_Response(ENQ).");
+#endif /* LOGGING */
+				if(!Df1_Send_Response(handle,table,ENQ))
+					Df1_Error();
+				enq_sent = TRUE;
+			}
+		}
+		while(got_response == FALSE);
+		Df1_Transaction_Table_Lock(table);
+		c = table->Response;
+		Df1_Transaction_Table_Unlock(table);
+#if LOGGING > 5
+		Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send_Frame : Received response %s.",Df1_Print_Symbol(c));
+#endif /* LOGGING */
+		/* only learn from responses we can unambiguously match to this transmission */
+		if((enq_sent == FALSE)&&(nbr_NAK == 0))
+		{
+			clock_gettime(CLOCK_MONOTONIC,&response_time);
+			Df1_Ack_Time_Add(table,Df1_Time_Diff_Ms(send_time,response_time));
+		}
+		if (c==ACK)
+			 return TRUE;
+		nbr_NAK++;
+	} while (nbr_NAK<=3);
+	Df1_Error_Number = 302;
+	sprintf(Df1_Error_String,"Df1_Send:Too many NAKs (%d).",nbr_NAK);
+	return FALSE;
+}
+
+/**
+ * Send a reponse request (NAK, ACK or ENQ). ACKs and NAKs are remembered, so they can be repeated
+ * if the PLC sends an ENQ. The caller must not hold the table lock.
  * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param table The handle's transaction table.
  * @param response What to send.
  * @return The routine returns TRUE on success and FALSE on failure.
  * @see #DLE
- * @see #Df1_Bytes2Word
+ * @see #Df1_Link_Write
+ * @see #Df1_Transaction_Table_Lock
+ * @see #Df1_Transaction_Table_Unlock
  * @see #Df1_Print_Symbol
  * @see df1_interface.html#Df1_Interface_Handle_T
- * @see df1_interface.html#Df1_Interface_Write
  */
-static int Df1_Send_Response(Df1_Interface_Handle_T *handle,byte response)
+static int Df1_Send_Response(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,byte response)
 {
-	word w;
-	byte dle=DLE;
+	byte buff[2];
 
 #if LOGGING > 5
 	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send_Response(%s).",Df1_Print_Symbol(response));
 #endif /* LOGGING */
-	w = Df1_Bytes2Word(dle,response);
-	if(!Df1_Interface_Write(handle,&w,2))
+	buff[0] = DLE;
+	buff[1] = response;
+	if(!Df1_Link_Write(handle,table,buff,2))
 		return FALSE;
+	if((response == ACK)||(response == NAK))
+	{
+		Df1_Transaction_Table_Lock(table);
+		table->Last_Response_Sent = response;
+		Df1_Transaction_Table_Unlock(table);
+	}
 #if LOGGING > 5
 	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Send_Response finished.");
 #endif /* LOGGING */
@@ -503,19 +904,336 @@ static int Df1_Send_Response(Df1_Interface_Handle_T *handle,byte response)
 }	
 
 /**
- * Get a symbol from a read byte.
+ * Write some bytes to the link. The table's Write_Mutex is held around the write, so frames and
+ * responses written by different threads are not interleaved.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param table The handle's transaction table.
+ * @param buffer The bytes to write.
+ * @param length The number of bytes to write.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see df1_interface.html#Df1_Interface_Write
+ */
+static int Df1_Link_Write(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,void *buffer,
+			  size_t length)
+{
+	int retval;
+
+#ifdef DF1_MUTEXED
+	pthread_mutex_lock(&(table->Write_Mutex));
+#endif
+	retval = Df1_Interface_Write(handle,buffer,length);
+#ifdef DF1_MUTEXED
+	pthread_mutex_unlock(&(table->Write_Mutex));
+#endif
+	return retval;
+}
+
+/**
+ * Wait until (*flag) (a field in the transaction table) becomes TRUE, or timeout_ms elapses.
+ * Only one thread reads the link at a time: if no-one else is reading, we become the reader and
+ * dispatch whatever arrives (ACK/NAKs and reply frames) into the table for all the waiting threads.
+ * Otherwise we sleep on the table's condition variable until the reader dispatches something, or 
+ * gives up the reader role.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param table The handle's transaction table.
+ * @param timeout_ms The maximum time to wait, in milliseconds.
+ * @param flag The address of a flag in the table to wait for. It is only read with the table locked.
+ * @param done The address of an integer, set to the value of (*flag) when we return.
+ * @return The routine returns TRUE on success (including a timeout) and FALSE on failure. If we
+ *         were the reader, an error reading the link is returned to us.
+ * @see #Df1_Link_Read_Event
+ * @see #Df1_Link_Dispatch
+ * @see #Df1_Transaction_Table_Lock
+ * @see #Df1_Transaction_Table_Unlock
+ * @see #Df1_Transaction_Table_Wait
+ * @see #Df1_Transaction_Table_Broadcast
+ * @see #Df1_Time_Add_Ms
+ * @see #Df1_Time_Diff_Ms
+ */
+static int Df1_Link_Wait(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,int timeout_ms,
+			 int *flag,int *done)
+{
+	struct timespec current_time,end_time;
+	TMsg msg;
+	int remaining_ms,retval,event;
+	byte response;
+
+	clock_gettime(CLOCK_MONOTONIC,&end_time);
+	Df1_Time_Add_Ms(&end_time,timeout_ms);
+	Df1_Transaction_Table_Lock(table);
+	while((*flag) == FALSE)
+	{
+		clock_gettime(CLOCK_MONOTONIC,&current_time);
+		remaining_ms = (int)Df1_Time_Diff_Ms(current_time,end_time);
+		if(remaining_ms <= 0)
+			break;
+		if(table->Reader_Active == FALSE)
+		{
+			table->Reader_Active = TRUE;
+			Df1_Transaction_Table_Unlock(table);
+			retval = Df1_Link_Read_Event(handle,table,remaining_ms,&event,&response,&msg);
+			Df1_Transaction_Table_Lock(table);
+			table->Reader_Active = FALSE;
+			if(retval)
+				Df1_Link_Dispatch(table,event,response,&msg);
+			Df1_Transaction_Table_Broadcast(table);
+			if(retval == FALSE)
+			{
+				Df1_Transaction_Table_Unlock(table);
+				return FALSE;
+			}
+		}
+		else
+			Df1_Transaction_Table_Wait(table,&end_time);
+	}
+	(*done) = (*flag);
+	Df1_Transaction_Table_Unlock(table);
+	return TRUE;
+}
+
+/**
+ * Read the next event from the link: an ACK/NAK response, or a complete reply frame. A frame is
+ * checked against its CRC and ACKed (or NAKed, in which case the PLC will resend it and we carry on reading).
+ * An ENQ from the PLC is answered by repeating our last response. Other bytes are discarded. 
+ * The table must not be locked by the caller, who must hold the reader role.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param table The handle's transaction table.
+ * @param timeout_ms The maximum time to wait for the start of an event, in milliseconds. Once an event has
+ *        started, the rest of it must arrive within the interface handle's read timeout.
+ * @param event The address of an integer, set to DF1_LINK_EVENT_NONE on a timeout, DF1_LINK_EVENT_RESPONSE
+ *        or DF1_LINK_EVENT_FRAME.
+ * @param response The address of a byte, set to ACK or NAK for a DF1_LINK_EVENT_RESPONSE.
+ * @param msg The address of a TMsg, filled in for a DF1_LINK_EVENT_FRAME.
+ * @return The routine returns TRUE on success (including a timeout) and FALSE on failure.
+ * @see #DF1_LINK_EVENT_NONE
+ * @see #DF1_LINK_EVENT_RESPONSE
+ * @see #DF1_LINK_EVENT_FRAME
+ * @see #Df1_Get_Symbol
+ * @see #Df1_Send_Response
+ * @see #Df1_Add_Byte2Buffer
+ * @see #Df1_Bytes2Word
+ * @see #Df1_Crc_Add_Byte
+ * @see #Df1_Print_Symbol
+ * @see #DF1_MESSAGE_HEADER_LENGTH
+ * @see df1_interface.html#Df1_Interface_Read_Byte
+ * @see df1_interface.html#Df1_Interface_Read_Byte_Timeout
+ */
+static int Df1_Link_Read_Event(Df1_Interface_Handle_T *handle,Df1_Transaction_Table_T *table,int timeout_ms,
+			       int *event,byte *response,TMsg *msg)
+{
+	struct timespec start_time,current_time;
+	TBuffer data_rcv;
+	byte c,crcb1,crcb2,last_response;
+	word crc,computed_crc;
+	int remaining_ms,byte_read,flag,done;
+
+	(*event) = DF1_LINK_EVENT_NONE;
+	clock_gettime(CLOCK_MONOTONIC,&start_time);
+	remaining_ms = timeout_ms;
+	while(remaining_ms > 0)
+	{
+		if(!Df1_Interface_Read_Byte_Timeout(handle,&c,remaining_ms,&byte_read))
+			return FALSE;
+		if(byte_read && (c == DLE))
+		{
+			/* the rest of a control symbol follows straight on */
+			if(!Df1_Interface_Read_Byte(handle,&c))
+				return FALSE;
+#if LOGGING > 5
+			Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Link_Read_Event: Found DLE %s.",Df1_Print_Symbol(c));
+#endif /* LOGGING */
+			switch(c)
+			{
+				case ACK:
+				case NAK:
+					(*response) = c;
+					(*event) = DF1_LINK_EVENT_RESPONSE;
+					return TRUE;
+				case ENQ:
+					Df1_Transaction_Table_Lock(table);
+					last_response = table->Last_Response_Sent;
+					Df1_Transaction_Table_Unlock(table);
+					if(!Df1_Send_Response(handle,table,last_response))
+						return FALSE;
+					break;
+				case STX:
+					data_rcv.size = 0;
+					computed_crc = 0;
+					done = FALSE;
+					while(done == FALSE)
+					{
+						if(!Df1_Get_Symbol(handle,&c,&flag))
+							return FALSE;
+						if(flag != CONTROL_FLAG)
+						{
+							/* data_rcv.size is a byte, don't let it wrap */
+							if(data_rcv.size < 255)
+							{
+								Df1_Add_Byte2Buffer(&data_rcv,c);
+								computed_crc = Df1_Crc_Add_Byte(computed_crc,c);
+							}
+						}
+						else
+							done = TRUE;
+					}
+					if(c != ETX)
+					{
+#if LOGGING > 5
+						Df1_Log_Format(DF1_LOG_BIT_DF1,
+					  "Df1_Link_Read_Event: Data was not terminated with ETX(%s): Sending NAK response.",
+							       Df1_Print_Symbol(c));
+#endif /* LOGGING */
+						if(!Df1_Send_Response(handle,table,NAK))
+							return FALSE;
+						break;
+					}
+					if(!Df1_Interface_Read_Byte(handle,&crcb1))
+						return FALSE;
+					if(!Df1_Interface_Read_Byte(handle,&crcb2))
+						return FALSE;
+					crc = Df1_Bytes2Word(crcb1,crcb2);
+					computed_crc = Df1_Crc_Add_Byte(computed_crc,ETX);
+					if((crc != computed_crc)||(data_rcv.size < DF1_MESSAGE_HEADER_LENGTH)||
+					   (data_rcv.size == 255))
+					{
+#if LOGGING > 5
+						Df1_Log(DF1_LOG_BIT_DF1,
+						     "Df1_Link_Read_Event: CRC/length was bad - sending NAK response.");
+#endif /* LOGGING */
+						if(!Df1_Send_Response(handle,table,NAK))
+							return FALSE;
+						break;
+					}
+#if LOGGING > 5
+					Df1_Log(DF1_LOG_BIT_DF1,"Df1_Link_Read_Event: CRC was good - sending ACK response.");
+#endif /* LOGGING */
+					if(!Df1_Send_Response(handle,table,ACK))
+						return FALSE;
+					/* data_rcv holds the dst,src,cmd,sts,tns header followed by the data, and its
+					** size is less than 255, so the copy always fits inside a TMsg. */
+					bzero(msg,sizeof(TMsg));
+					memcpy(msg,data_rcv.data,data_rcv.size);
+					msg->size = data_rcv.size-DF1_MESSAGE_HEADER_LENGTH;
+					(*event) = DF1_LINK_EVENT_FRAME;
+					return TRUE;
+				default:
+					break;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC,&current_time);
+		remaining_ms = timeout_ms-(int)Df1_Time_Diff_Ms(start_time,current_time);
+	}
+	return TRUE;
+}
+
+/**
+ * Dispatch a link event into the transaction table. A response is stored for the current sender.
+ * A frame is given to the outstanding transaction with the same tns, or if there is none
+ * kept as the unmatched reply for Df1_Receive. The table must be locked by the caller.
+ * @param table The handle's transaction table.
+ * @param event The event type, as returned by Df1_Link_Read_Event.
+ * @param response The ACK/NAK, for a DF1_LINK_EVENT_RESPONSE.
+ * @param msg The received message, for a DF1_LINK_EVENT_FRAME.
+ * @see #Df1_Link_Read_Event
+ * @see #Df1_Transaction_Table_Struct
+ */
+static void Df1_Link_Dispatch(Df1_Transaction_Table_T *table,int event,byte response,TMsg *msg)
+{
+	int i;
+
+	if(event == DF1_LINK_EVENT_RESPONSE)
+	{
+		table->Response = response;
+		table->Response_Received = TRUE;
+	}
+	else if(event == DF1_LINK_EVENT_FRAME)
+	{
+		for(i = 0; i < DF1_TRANSACTION_COUNT; i++)
+		{
+			if(table->Transaction_List[i].In_Use && (table->Transaction_List[i].Complete == FALSE) &&
+			   (table->Transaction_List[i].Tns == msg->tns))
+			{
+				table->Transaction_List[i].Reply = (*msg);
+				table->Transaction_List[i].Complete = TRUE;
+#if LOGGING > 5
+				Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Link_Dispatch: Reply tns %d matched transaction %d.",
+					       msg->tns,i);
+#endif /* LOGGING */
+				return;
+			}
+		}
+#if LOGGING > 5
+		Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Link_Dispatch: Reply tns %d did not match a transaction.",
+			       msg->tns);
+#endif /* LOGGING */
+		table->Unmatched_Reply = (*msg);
+		table->Unmatched_Received = TRUE;
+	}
+}
+
+/**
+ * Lock the transaction table's mutex (if mutex support is compiled in).
+ * @param table The transaction table.
+ */
+static void Df1_Transaction_Table_Lock(Df1_Transaction_Table_T *table)
+{
+#ifdef DF1_MUTEXED
+	pthread_mutex_lock(&(table->Mutex));
+#endif
+}
+
+/**
+ * Unlock the transaction table's mutex (if mutex support is compiled in).
+ * @param table The transaction table.
+ */
+static void Df1_Transaction_Table_Unlock(Df1_Transaction_Table_T *table)
+{
+#ifdef DF1_MUTEXED
+	pthread_mutex_unlock(&(table->Mutex));
+#endif
+}
+
+/**
+ * Wait on the transaction table's condition variable (if mutex support is compiled in). 
+ * The table must be locked by the caller.
+ * @param table The transaction table.
+ * @param end_time The CLOCK_MONOTONIC time to wait until, or NULL to wait until woken.
+ */
+static void Df1_Transaction_Table_Wait(Df1_Transaction_Table_T *table,struct timespec *end_time)
+{
+#ifdef DF1_MUTEXED
+	if(end_time != NULL)
+		pthread_cond_timedwait(&(table->Condition),&(table->Mutex),end_time);
+	else
+		pthread_cond_wait(&(table->Condition),&(table->Mutex));
+#endif
+}
+
+/**
+ * Wake all threads waiting on the transaction table's condition variable (if mutex support is compiled in).
+ * @param table The transaction table.
+ */
+static void Df1_Transaction_Table_Broadcast(Df1_Transaction_Table_T *table)
+{
+#ifdef DF1_MUTEXED
+	pthread_cond_broadcast(&(table->Condition));
+#endif
+}
+
+/**
+ * Get a symbol from a read byte. Bytes are taken from the interface's receive buffer, which is
+ * refilled with one poll/read when empty, so decoding a frame does not cost a system call per byte.
  * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
  * @param b The address of a byte to return.
  * @param flag What sort of byte was read: DATA_FLAG, CONTROL_FLAG
  * @see #DATA_FLAG
  * @see #CONTROL_FLAG
  * @see df1_interface.html#Df1_Interface_Handle_T
- * @see df1_interface.html#Df1_Interface_Read
+ * @see df1_interface.html#Df1_Interface_Read_Byte
  */
 static int Df1_Get_Symbol(Df1_Interface_Handle_T *handle,byte * b,int *flag)
 {
 	byte c1,c2;
-	int bytes_read;
 
 #if LOGGING > 5
 	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Get_Symbol started.");
@@ -532,14 +1250,8 @@ static int Df1_Get_Symbol(Df1_Interface_Handle_T *handle,byte * b,int *flag)
 		sprintf(Df1_Error_String,"Df1_Get_Symbol:flag was NULL.");
 		return FALSE;
 	}
-	if(!Df1_Interface_Read(handle,&c1,1,&bytes_read))
+	if(!Df1_Interface_Read_Byte(handle,&c1))
 		return FALSE;
-	if(bytes_read < 1)
-	{
-		Df1_Error_Number = 305;
-		sprintf(Df1_Error_String,"Df1_Get_Symbol:bytes_read was too small(%d).",bytes_read);
-		return FALSE;
-	}
 #if LOGGING > 5
 	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Get_Symbol: First byte %s.",Df1_Print_Symbol(c1));
 #endif /* LOGGING */
@@ -548,14 +1260,8 @@ static int Df1_Get_Symbol(Df1_Interface_Handle_T *handle,byte * b,int *flag)
 #if LOGGING > 5
 		Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Get_Symbol: c1 was DLE: Attempting retry.");
 #endif /* LOGGING */
-		if(!Df1_Interface_Read(handle,&c2,1,&bytes_read))
-			return FALSE;
-		if(bytes_read < 1)
-		{
-			Df1_Error_Number = 306;
-			sprintf(Df1_Error_String,"Df1_Get_Symbol:bytes_read was too small(%d).",bytes_read);
+		if(!Df1_Interface_Read_Byte(handle,&c2))
 			return FALSE;
-		}
 #if LOGGING > 5
 		Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Get_Symbol: Second byte %s.",Df1_Print_Symbol(c2));
 #endif /* LOGGING */
@@ -592,6 +1298,123 @@ static int Df1_Get_Symbol(Df1_Interface_Handle_T *handle,byte * b,int *flag)
 	return TRUE;
 }	
 
+/**
+ * Return the ACK timeout to use on a link. The table is locked whilst it is computed.
+ * @param table The handle's transaction table.
+ * @return The ACK timeout, in milliseconds.
+ * @see #Df1_Ack_Timeout_Compute
+ * @see #Df1_Transaction_Table_Lock
+ * @see #Df1_Transaction_Table_Unlock
+ */
+static int Df1_Ack_Timeout_Get(Df1_Transaction_Table_T *table)
+{
+	int timeout_ms;
+
+	Df1_Transaction_Table_Lock(table);
+	timeout_ms = Df1_Ack_Timeout_Compute(table);
+	Df1_Transaction_Table_Unlock(table);
+	return timeout_ms;
+}
+
+/**
+ * Compute the ACK timeout for a link. Until a response time has been measured this is Ack_Timeout_Max_Ms, 
+ * otherwise it is the average response time plus four times the mean deviation, clamped to lie
+ * between Ack_Timeout_Min_Ms and Ack_Timeout_Max_Ms. The caller must hold the table lock.
+ * @param table The handle's transaction table.
+ * @return The ACK timeout, in milliseconds.
+ * @see #Df1_Data
+ * @see #Df1_Transaction_Table_Struct
+ */
+static int Df1_Ack_Timeout_Compute(Df1_Transaction_Table_T *table)
+{
+	int timeout_ms;
+
+	if(table->Ack_Time_Count == 0)
+		return Df1_Data.Ack_Timeout_Max_Ms;
+	timeout_ms = (int)(table->Ack_Time_Average_Ms+(4.0*table->Ack_Time_Deviation_Ms))+1;
+	if(timeout_ms < Df1_Data.Ack_Timeout_Min_Ms)
+		timeout_ms = Df1_Data.Ack_Timeout_Min_Ms;
+	if(timeout_ms > Df1_Data.Ack_Timeout_Max_Ms)
+		timeout_ms = Df1_Data.Ack_Timeout_Max_Ms;
+	return timeout_ms;
+}
+
+/**
+ * Add a measured ACK/NAK response time to a link's smoothed average and mean deviation, used to compute
+ * its ACK timeout. The first measurement initialises the average, and sets the deviation to half of it.
+ * The table is locked whilst it is updated.
+ * @param table The handle's transaction table.
+ * @param ack_time_ms The time between sending a message and receiving the response, in milliseconds.
+ * @see #Df1_Transaction_Table_Struct
+ * @see #Df1_Ack_Timeout_Compute
+ * @see #Df1_Transaction_Table_Lock
+ * @see #Df1_Transaction_Table_Unlock
+ */
+static void Df1_Ack_Time_Add(Df1_Transaction_Table_T *table,double ack_time_ms)
+{
+	double error_ms;
+#if LOGGING > 5
+	double average_ms,deviation_ms;
+	int timeout_ms;
+#endif /* LOGGING */
+
+	Df1_Transaction_Table_Lock(table);
+	if(table->Ack_Time_Count == 0)
+	{
+		table->Ack_Time_Average_Ms = ack_time_ms;
+		table->Ack_Time_Deviation_Ms = ack_time_ms/2.0;
+	}
+	else
+	{
+		error_ms = ack_time_ms-table->Ack_Time_Average_Ms;
+		if(error_ms < 0.0)
+			error_ms = -error_ms;
+		table->Ack_Time_Deviation_Ms = (0.75*table->Ack_Time_Deviation_Ms)+(0.25*error_ms);
+		table->Ack_Time_Average_Ms = (0.875*table->Ack_Time_Average_Ms)+(0.125*ack_time_ms);
+	}
+	table->Ack_Time_Count++;
+#if LOGGING > 5
+	average_ms = table->Ack_Time_Average_Ms;
+	deviation_ms = table->Ack_Time_Deviation_Ms;
+	timeout_ms = Df1_Ack_Timeout_Compute(table);
+#endif /* LOGGING */
+	Df1_Transaction_Table_Unlock(table);
+#if LOGGING > 5
+	Df1_Log_Format(DF1_LOG_BIT_DF1,"Df1_Ack_Time_Add(%.2f ms): average %.2f ms, deviation %.2f ms, timeout %d ms.",
+		       ack_time_ms,average_ms,deviation_ms,timeout_ms);
+#endif /* LOGGING */
+}
+
+/**
+ * Return the difference between two times, in milliseconds.
+ * @param start_time The earlier time.
+ * @param end_time The later time.
+ * @return end_time - start_time in milliseconds.
+ * @see #ONE_MILLISECOND_NS
+ */
+static double Df1_Time_Diff_Ms(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/((double)ONE_MILLISECOND_NS));
+}
+
+/**
+ * Add a number of milliseconds to a time.
+ * @param time The address of the time to modify.
+ * @param ms The number of milliseconds to add.
+ * @see #ONE_MILLISECOND_NS
+ */
+static void Df1_Time_Add_Ms(struct timespec *time,int ms)
+{
+	time->tv_sec += ms/1000;
+	time->tv_nsec += (ms%1000)*ONE_MILLISECOND_NS;
+	if(time->tv_nsec >= (1000*ONE_MILLISECOND_NS))
+	{
+		time->tv_sec++;
+		time->tv_nsec -= (1000*ONE_MILLISECOND_NS);
+	}
+}
+
 /**
  * Put two bytes into a word.
  * @param lowb The low byte.
@@ -637,40 +1460,32 @@ static int Df1_Add_Byte2Buffer(TBuffer * buffer, byte value)
 }	
 
 /**
- * Add data to the buffer.
- * @param buffer The buffer to add the data to.
- * @param data The data to add.
- * @param size The length of the data.
- * @return The new buffer size.
- * @see #TBuffer
- */
-static int Df1_Add_Data2Buffer(TBuffer * buffer, void * data, byte size) 
-{
-	memcpy(buffer->data+buffer->size, data,size);
-	buffer->size += size;
-	return buffer->size;
-}	
-
-/**
- *  Add DLE if DLE exist in buffer.
+ * Add the message header and data to the buffer, doubling any DLE bytes, in one pass over the message.
+ * The CRC of the (unstuffed) bytes is updated as they are added.
  * @param buffer The buffer to add the data to, of type TBuffer.
- * @param msg The message to add.
+ * @param msg The address of the message to add.
+ * @param crc The address of the CRC to update.
  * @return The new buffer size.
  * @see #TBuffer
  * @see #TMsg
- * @see #Df1_Add_Byte2Buffer
+ * @see #DF1_MESSAGE_HEADER_LENGTH
+ * @see #Df1_Crc_Add_Byte
  */
-static int Df1_Add_Data2BufferWithDLE(TBuffer * buffer, TMsg msg)
+static int Df1_Add_Data2BufferWithDLE(TBuffer * buffer, TMsg *msg, word *crc)
 {
-	byte  i;
-	byte databyte[262];
-	memcpy(&databyte, &msg,sizeof(msg));
-	for (i=0;i<msg.size+6;i++)
+	byte *databyte = (byte *)msg;
+	byte *output = buffer->data+buffer->size;
+	int i,length;
+
+	length = msg->size+DF1_MESSAGE_HEADER_LENGTH;
+	for (i=0;i<length;i++)
 	{
 		if (databyte[i]==DLE)
-			Df1_Add_Byte2Buffer(buffer,DLE);
-		Df1_Add_Byte2Buffer(buffer,databyte[i]);
+			(*output++) = DLE;
+		(*output++) = databyte[i];
+		(*crc) = Df1_Crc_Add_Byte((*crc),databyte[i]);
 	}	
+	buffer->size = output-buffer->data;
 	return buffer->size;
 }
 
@@ -716,22 +1531,15 @@ static char * Df1_Print_Symbol(byte c)
 }
 
 /**
- * Compute CRC for a TBuffer
- * @param buffer The buffer to compute for.
- * @return A word containing the CRC.
- * @see #Df1_Calc_Crc
+ * Add a byte to a CRC-16, using the lookup table.
+ * @param crc The current CRC.
+ * @param b The next byte.
+ * @return The updated CRC.
+ * @see #Df1_Crc_Table
  */
-static word Df1_Compute_Crc (TBuffer * buffer) 
+static word Df1_Crc_Add_Byte(word crc,byte b)
 {
-	byte x;
-	word crc = 0;
-
-	for (x=0;x<buffer->size;x++)
-	{ 
-		crc = Df1_Calc_Crc (crc, buffer->data[x]);
-	}
-	crc = Df1_Calc_Crc (crc,ETX);
-	return (crc);
+	return (crc >> 8)^Df1_Crc_Table[(crc^b)&0xff];
 }
 
 /**
@@ -739,7 +1547,7 @@ static word Df1_Compute_Crc (TBuffer * buffer)
  * @param crc The current CRC.
  * @param buffer The next word.
  * @return The updated CRC.
- * @see #Df1_Compute_Crc
+ * @see #Df1_Crc_Compute_Bitwise
  */
 static word Df1_Calc_Crc (word crc, word buffer) 
 {
@@ -18,6 +18,7 @@
 #define _POSIX_C_SOURCE 199309L
 
 #include <errno.h>   /* Error number definitions */
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +29,7 @@
 #include <pthread.h>
 #endif
 #include "df1_general.h"
+#include "df1.h"
 #include "df1_serial.h"
 #include "df1_socket.h"
 
@@ -42,10 +44,18 @@
  *     <li><b>Serial</b> Of type Df1_Serial_Handle_T, holding serial specific data.
  *     <li><b>Socket</b> Of type Df1_Socket_Handle_T, holding socket specific data.
  *     </ul>
+ * <li><b>Receive_Buffer</b> A buffer of bytes read from the device but not yet consumed by
+ *     Df1_Interface_Read_Byte / Df1_Interface_Read.
+ * <li><b>Receive_Start</b> The index in Receive_Buffer of the next unconsumed byte.
+ * <li><b>Receive_End</b> The index in Receive_Buffer one past the last byte read from the device.
+ * <li><b>Read_Timeout_Ms</b> How long Df1_Interface_Read_Byte waits for more data to arrive, in milliseconds.
+ * <li><b>Transaction_Table</b> The DF1 transaction table for this connection, holding the next transaction
+ *     number and the commands awaiting replies.
  * <li><b>Mutex</b> Optionally compiled mutex locking over sending commands down the comms link 
  *                and receiving a reply.
  * </ul>
  * @see #DF1_INTERFACE_DEVICE_ID
+ * @see #DF1_INTERFACE_RECEIVE_BUFFER_LENGTH
  * @see df1_serial.html#Df1_Serial_Handle_T
  * @see df1_socket.html#Df1_Socket_Handle_T
  */
@@ -57,6 +67,11 @@ struct Df1_Interface_Handle_Struct
 		Df1_Serial_Handle_T Serial;
 		Df1_Socket_Handle_T Socket;
 	} Handle;
+	unsigned char Receive_Buffer[DF1_INTERFACE_RECEIVE_BUFFER_LENGTH];
+	int Receive_Start;
+	int Receive_End;
+	int Read_Timeout_Ms;
+	Df1_Transaction_Table_T *Transaction_Table;
 #ifdef DF1_MUTEXED
 	pthread_mutex_t Mutex;
 #endif
@@ -68,14 +83,22 @@ struct Df1_Interface_Handle_Struct
  */
 static char rcsid[] = "$Id: df1_interface.c,v 1.1 2023-03-21 14:34:10 cjm Exp $";
 
+/* internal function prototypes */
+static int Df1_Interface_Get_Fd(Df1_Interface_Handle_T *handle,int *fd);
+static int Df1_Interface_Receive_Buffer_Fill(Df1_Interface_Handle_T *handle,int timeout_ms);
+
 /* =======================================
 **  external functions 
 ** ======================================= */
 /**
  * Routine to allocate memeory for the interface handle, and initialise the mutex.
+ * The receive buffer is emptied and the read timeout set to DF1_INTERFACE_DEFAULT_READ_TIMEOUT_MS.
+ * The handle's DF1 transaction table is also created.
  * @param handle The address of a pointer to allocate the handle.
  * @return The routine returns TRUE on success and FALSE on failure.
  * @see #Df1_Interface_Handle_T
+ * @see #DF1_INTERFACE_DEFAULT_READ_TIMEOUT_MS
+ * @see df1.html#Df1_Transaction_Table_Create
  */
 int Df1_Interface_Handle_Create(Df1_Interface_Handle_T **handle)
 {
@@ -93,6 +116,16 @@ int Df1_Interface_Handle_Create(Df1_Interface_Handle_T **handle)
 		sprintf(Df1_Error_String,"Df1_Interface_Handle_Create: Failed to allocate handle.");
 		return FALSE;
 	}
+	(*handle)->Interface_Device = DF1_INTERFACE_DEVICE_NONE;
+	(*handle)->Receive_Start = 0;
+	(*handle)->Receive_End = 0;
+	(*handle)->Read_Timeout_Ms = DF1_INTERFACE_DEFAULT_READ_TIMEOUT_MS;
+	if(!Df1_Transaction_Table_Create(&((*handle)->Transaction_Table)))
+	{
+		free((*handle));
+		(*handle) = NULL;
+		return FALSE;
+	}
 	/* initialise mutex - according to man page, pthread_mutex_init always returns 0. */
 #ifdef DF1_MUTEXED
 	pthread_mutex_init(&((*handle)->Mutex),NULL);
@@ -138,6 +171,9 @@ int Df1_Interface_Open(enum DF1_INTERFACE_DEVICE_ID device_id,char *device_name,
 	}
 	/* set the device type */
 	handle->Interface_Device = device_id;
+	/* discard anything left over from a previous connection */
+	handle->Receive_Start = 0;
+	handle->Receive_End = 0;
 	/* call the device specific open routine */
 	switch(handle->Interface_Device)
 	{
@@ -208,9 +244,10 @@ int Df1_Interface_Close(Df1_Interface_Handle_T *handle)
 }
 
 /**
- * Routine to destroy the specified handle.
+ * Routine to destroy the specified handle, and it's DF1 transaction table.
  * @return The routine returns TRUE on success and FALSE on failure.
  * @see #Df1_Interface_Handle_T
+ * @see df1.html#Df1_Transaction_Table_Destroy
  */
 int Df1_Interface_Handle_Destroy(Df1_Interface_Handle_T **handle)
 {
@@ -227,6 +264,8 @@ int Df1_Interface_Handle_Destroy(Df1_Interface_Handle_T **handle)
 		sprintf(Df1_Error_String,"Df1_Interface_Handle_Destroy: handle pointer was NULL.");
 		return FALSE;
 	}
+	if((*handle)->Transaction_Table != NULL)
+		Df1_Transaction_Table_Destroy(&((*handle)->Transaction_Table));
 	/* free alocated handle */
 	free((*handle));
 	(*handle) = NULL;
@@ -280,6 +319,8 @@ int Df1_Interface_Write(Df1_Interface_Handle_T *handle,void* message,size_t mess
 
 /**
  * Routine to read data to an open connection to the specified interface.
+ * If the handle's receive buffer already holds bytes (read ahead by Df1_Interface_Read_Byte), these
+ * are returned first and the device is not read.
  * @param handle The handle specifying which connection to write to.
  * @param message A pointer to the buffer to write read data into.
  * @param message_length The length of the buffer.
@@ -292,6 +333,8 @@ int Df1_Interface_Write(Df1_Interface_Handle_T *handle,void* message,size_t mess
  */
 int Df1_Interface_Read(Df1_Interface_Handle_T *handle,void* message,int message_length,int* bytes_read)
 {
+	int buffered_count;
+
 	if(handle == NULL)
 	{
 		Df1_Error_Number = 113;
@@ -304,6 +347,20 @@ int Df1_Interface_Read(Df1_Interface_Handle_T *handle,void* message,int message_
 		sprintf(Df1_Error_String,"Df1_Interface_Read: message was NULL.");
 		return FALSE;
 	}
+	/* return any bytes already sitting in the receive buffer first */
+	buffered_count = handle->Receive_End-handle->Receive_Start;
+	if(buffered_count > 0)
+	{
+		if(buffered_count > message_length)
+			buffered_count = message_length;
+		if(buffered_count < 0)
+			buffered_count = 0;
+		memcpy(message,handle->Receive_Buffer+handle->Receive_Start,buffered_count);
+		handle->Receive_Start += buffered_count;
+		if(bytes_read != NULL)
+			(*bytes_read) = buffered_count;
+		return TRUE;
+	}
 	/* call the device specific close routine */
 	switch(handle->Interface_Device)
 	{
@@ -324,6 +381,163 @@ int Df1_Interface_Read(Df1_Interface_Handle_T *handle,void* message,int message_
 	return TRUE;
 }
 
+/**
+ * Routine to read one byte from an open connection to the specified interface.
+ * Bytes are taken from the handle's receive buffer. When the buffer is empty, poll is used to wait
+ * (for up to the handle's Read_Timeout_Ms) for the device to become readable, and then as many bytes as
+ * are available (up to DF1_INTERFACE_RECEIVE_BUFFER_LENGTH) are read in one go. A whole DF1 reply frame
+ * therefore normally costs one or two read system calls, rather than one per byte, and a non-blocking
+ * read returning EAGAIN just causes us to wait for more data rather than failing.
+ * @param handle The handle specifying which connection to read from.
+ * @param b The address of a byte to return the read byte in.
+ * @return The routine returns TRUE on success and FALSE on failure. Failure includes no data arriving
+ *         within Read_Timeout_Ms.
+ * @see #Df1_Interface_Handle_T
+ * @see #Df1_Interface_Read_Byte_Timeout
+ */
+int Df1_Interface_Read_Byte(Df1_Interface_Handle_T *handle,unsigned char *b)
+{
+	int byte_read;
+
+	if(handle == NULL)
+	{
+		Df1_Error_Number = 122;
+		sprintf(Df1_Error_String,"Df1_Interface_Read_Byte: handle was NULL.");
+		return FALSE;
+	}
+	if(!Df1_Interface_Read_Byte_Timeout(handle,b,handle->Read_Timeout_Ms,&byte_read))
+		return FALSE;
+	if(byte_read == FALSE)
+	{
+		Df1_Error_Number = 124;
+		sprintf(Df1_Error_String,"Df1_Interface_Read_Byte: Timed out after %d ms.",
+			handle->Read_Timeout_Ms);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to read one byte from an open connection to the specified interface, waiting at most
+ * timeout_ms for it to arrive. This works as Df1_Interface_Read_Byte, but a timeout is not treated as an error,
+ * so callers (i.e. Df1_Send waiting for an ACK) can take some other action instead.
+ * @param handle The handle specifying which connection to read from.
+ * @param b The address of a byte to return the read byte in.
+ * @param timeout_ms The maximum time to wait for a byte to arrive, in milliseconds.
+ * @param byte_read The address of an integer, set to TRUE if a byte was read into b, and FALSE if
+ *        the timeout expired first.
+ * @return The routine returns TRUE on success (including a timeout) and FALSE on failure.
+ * @see #Df1_Interface_Handle_T
+ * @see #Df1_Interface_Receive_Buffer_Fill
+ * @see #DF1_INTERFACE_RECEIVE_BUFFER_LENGTH
+ */
+int Df1_Interface_Read_Byte_Timeout(Df1_Interface_Handle_T *handle,unsigned char *b,int timeout_ms,
+				    int *byte_read)
+{
+	struct timespec current_time,end_time;
+	int remaining_ms;
+
+	if(handle == NULL)
+	{
+		Df1_Error_Number = 131;
+		sprintf(Df1_Error_String,"Df1_Interface_Read_Byte_Timeout: handle was NULL.");
+		return FALSE;
+	}
+	if(b == NULL)
+	{
+		Df1_Error_Number = 123;
+		sprintf(Df1_Error_String,"Df1_Interface_Read_Byte_Timeout: b was NULL.");
+		return FALSE;
+	}
+	if(byte_read == NULL)
+	{
+		Df1_Error_Number = 132;
+		sprintf(Df1_Error_String,"Df1_Interface_Read_Byte_Timeout: byte_read was NULL.");
+		return FALSE;
+	}
+	(*byte_read) = FALSE;
+	if(handle->Receive_Start >= handle->Receive_End)
+	{
+		/* compute when we give up waiting for data */
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		end_time.tv_sec += timeout_ms/1000;
+		end_time.tv_nsec += (timeout_ms%1000)*1000000;
+		if(end_time.tv_nsec >= 1000000000)
+		{
+			end_time.tv_sec++;
+			end_time.tv_nsec -= 1000000000;
+		}
+		remaining_ms = timeout_ms;
+		while(handle->Receive_Start >= handle->Receive_End)
+		{
+			if(remaining_ms <= 0)
+				return TRUE;
+			if(!Df1_Interface_Receive_Buffer_Fill(handle,remaining_ms))
+				return FALSE;
+			clock_gettime(CLOCK_MONOTONIC,&current_time);
+			remaining_ms = ((end_time.tv_sec-current_time.tv_sec)*1000)+
+				((end_time.tv_nsec-current_time.tv_nsec)/1000000);
+		}
+	}
+	(*b) = handle->Receive_Buffer[handle->Receive_Start++];
+	(*byte_read) = TRUE;
+	return TRUE;
+}
+
+/**
+ * Routine to set how long Df1_Interface_Read_Byte waits for data to arrive.
+ * @param handle The handle specifying which connection to set the timeout for.
+ * @param timeout_ms The timeout in milliseconds, which must be positive.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Interface_Handle_T
+ * @see #Df1_Interface_Read_Byte
+ */
+int Df1_Interface_Read_Timeout_Set(Df1_Interface_Handle_T *handle,int timeout_ms)
+{
+	if(handle == NULL)
+	{
+		Df1_Error_Number = 125;
+		sprintf(Df1_Error_String,"Df1_Interface_Read_Timeout_Set: handle was NULL.");
+		return FALSE;
+	}
+	if(timeout_ms <= 0)
+	{
+		Df1_Error_Number = 126;
+		sprintf(Df1_Error_String,"Df1_Interface_Read_Timeout_Set: Illegal timeout %d ms.",timeout_ms);
+		return FALSE;
+	}
+	handle->Read_Timeout_Ms = timeout_ms;
+	return TRUE;
+}
+
+/**
+ * Routine to get how long Df1_Interface_Read_Byte waits for data to arrive.
+ * @param handle The handle specifying which connection to get the timeout for.
+ * @return The timeout in milliseconds, or -1 if the handle was NULL.
+ * @see #Df1_Interface_Handle_T
+ * @see #Df1_Interface_Read_Byte
+ */
+int Df1_Interface_Read_Timeout_Get(Df1_Interface_Handle_T *handle)
+{
+	if(handle == NULL)
+		return -1;
+	return handle->Read_Timeout_Ms;
+}
+
+/**
+ * Routine to get the DF1 transaction table associated with the handle.
+ * @param handle The handle specifying which connection to get the transaction table for.
+ * @return The transaction table, or NULL if the handle was NULL.
+ * @see #Df1_Interface_Handle_T
+ * @see df1.html#Df1_Transaction_Table_T
+ */
+Df1_Transaction_Table_T *Df1_Interface_Transaction_Table_Get(Df1_Interface_Handle_T *handle)
+{
+	if(handle == NULL)
+		return NULL;
+	return handle->Transaction_Table;
+}
+
 #ifdef DF1_MUTEXED
 /**
  * Routine to lock the comms access mutex. This will block until the mutex has been acquired,
@@ -382,6 +596,103 @@ int Df1_Interface_Mutex_Unlock(Df1_Interface_Handle_T *handle)
 }
 #endif
 
+/* =======================================
+**  internal functions 
+** ======================================= */
+/**
+ * Routine to get the file descriptor underlying the handle's serial or socket connection.
+ * @param handle The handle specifying which connection to use.
+ * @param fd The address of an integer to fill in with the file descriptor.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Interface_Handle_T
+ */
+static int Df1_Interface_Get_Fd(Df1_Interface_Handle_T *handle,int *fd)
+{
+	switch(handle->Interface_Device)
+	{
+		case DF1_INTERFACE_DEVICE_SERIAL:
+			(*fd) = handle->Handle.Serial.Serial_Fd;
+			break;
+		case DF1_INTERFACE_DEVICE_SOCKET:
+			(*fd) = handle->Handle.Socket.Socket_Fd;
+			break;
+		default:
+			Df1_Error_Number = 127;
+			sprintf(Df1_Error_String,"Df1_Interface_Get_Fd failed:Illegal device selected(%d).",
+				handle->Interface_Device);
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to refill the (empty) receive buffer. We poll the device for up to timeout_ms,
+ * and if it becomes readable read as many bytes as will fit into the buffer.
+ * Returning TRUE with the buffer still empty is allowed (poll timed out or was interrupted, or the read
+ * found no data after all), Df1_Interface_Read_Byte keeps calling us until its own deadline expires.
+ * @param handle The handle specifying which connection to read from.
+ * @param timeout_ms The maximum time to wait for the device to become readable, in milliseconds.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Interface_Handle_T
+ * @see #Df1_Interface_Get_Fd
+ * @see #DF1_INTERFACE_RECEIVE_BUFFER_LENGTH
+ * @see df1_socket.html#Df1_Socket_Read
+ * @see df1_serial.html#Df1_Serial_Read
+ */
+static int Df1_Interface_Receive_Buffer_Fill(Df1_Interface_Handle_T *handle,int timeout_ms)
+{
+	struct pollfd poll_fd;
+	int fd,retval,poll_errno,bytes_read;
+
+	if(!Df1_Interface_Get_Fd(handle,&fd))
+		return FALSE;
+	handle->Receive_Start = 0;
+	handle->Receive_End = 0;
+	poll_fd.fd = fd;
+	poll_fd.events = POLLIN;
+	poll_fd.revents = 0;
+	retval = poll(&poll_fd,1,timeout_ms);
+	if(retval < 0)
+	{
+		poll_errno = errno;
+		if(poll_errno == EINTR)
+			return TRUE;
+		Df1_Error_Number = 128;
+		sprintf(Df1_Error_String,"Df1_Interface_Receive_Buffer_Fill: poll failed (%d,%d).",fd,poll_errno);
+		return FALSE;
+	}
+	if(retval == 0)
+		return TRUE;
+	if(poll_fd.revents & (POLLERR|POLLNVAL))
+	{
+		Df1_Error_Number = 129;
+		sprintf(Df1_Error_String,"Df1_Interface_Receive_Buffer_Fill: poll returned error events (%d,%#x).",
+			fd,poll_fd.revents);
+		return FALSE;
+	}
+	switch(handle->Interface_Device)
+	{
+		case DF1_INTERFACE_DEVICE_SERIAL:
+			if(!Df1_Serial_Read(handle->Handle.Serial,handle->Receive_Buffer,
+					    DF1_INTERFACE_RECEIVE_BUFFER_LENGTH,&bytes_read))
+				return FALSE;
+			break;
+		case DF1_INTERFACE_DEVICE_SOCKET:
+			if(!Df1_Socket_Read(handle->Handle.Socket,handle->Receive_Buffer,
+					    DF1_INTERFACE_RECEIVE_BUFFER_LENGTH,&bytes_read))
+				return FALSE;
+			/* Df1_Socket_Read fails if the other end closed the connection, bytes_read is only
+			** zero if there was no data after all (EAGAIN), so leave the buffer empty and let the
+			** caller poll again until its deadline */
+			break;
+		default:
+			bytes_read = 0;
+			break;
+	}
+	handle->Receive_End = bytes_read;
+	return TRUE;
+}
+
 /*
 ** $Log: not supported by cvs2svn $
 */
@@ -32,32 +32,11 @@
 #include "df1_interface.h"
 #include "df1_read_write.h"
 
-/* data types */
-/**
- * Local data.
- * <dl>
- * <dt>Tns</dt> <dd>Transaction Number?</dd>
- * </dl>
- */
-struct Df1_Read_Write_Struct
-{
-	int Tns;
-};
-
 /* internal variables */
 /**
  * Revision Control System identifier.
  */
 static char rcsid[] = "$Id: df1_read_write.c,v 1.1 2023-03-21 14:34:10 cjm Exp $";
-/**
- * Instance of local data. Initialised as follows:
- * <dl>
- * <dt>Tns</dt> <dd>-1</dd>
- * </dl>
- * @see #Df1_Read_Write_Struct
- */
-static struct Df1_Read_Write_Struct Df1_Read_Write_Data = {-1};
-
 /* internal functions */
 static int Df1_Write_AB(Df1_Interface_Handle_T *handle,TThree_Address_Fields address, word value, word mask);
 static int Df1_Read_A2(Df1_Interface_Handle_T *handle,TThree_Address_Fields address, void *value, byte size);
@@ -354,27 +333,163 @@ int Df1_Read_Float(Df1_Interface_Handle_T *handle,int plctype, char *straddress,
 	return TRUE;
 }
 
+/**
+ * Routine to read a contiguous block of integer values from the PLC in one transaction,
+ * i.e. N20:0 with count 2 reads N20:0 and N20:1.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param plctype The type of PLC, use SLC if you want it to do anything.
+ * @param straddress The PLC address of the first element as a string, e.g N7:1.
+ * @param count The number of consecutive elements to read. count*sizeof(word) must not be more than
+ *        DF1_READ_WRITE_BLOCK_MAX_BYTES.
+ * @param values An array of at least count words, filled in with the integer values read.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Read_A2
+ * @see #DF1_READ_WRITE_BLOCK_MAX_BYTES
+ * @see df1.html#Df1_Calc_Address
+ * @see df1.html#SLC
+ * @see df1_interface.html#Df1_Interface_Handle_T
+ * @see df1.html#TThree_Address_Fields
+ */
+int Df1_Read_Integer_Block(Df1_Interface_Handle_T *handle,int plctype, char *straddress,int count,word *values)
+{
+	TThree_Address_Fields address;
+	byte data[DF1_READ_WRITE_BLOCK_MAX_BYTES];
+	int i;
+
+	if(straddress == NULL)
+	{
+		Df1_Error_Number = 516;
+		sprintf(Df1_Error_String,"Df1_Read_Integer_Block: Address was NULL.");
+		return FALSE;
+	}
+	if(values == NULL)
+	{
+		Df1_Error_Number = 517;
+		sprintf(Df1_Error_String,"Df1_Read_Integer_Block: Values was NULL.");
+		return FALSE;
+	}
+#if LOGGING > 1
+	Df1_Log_Format(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_Integer_Block(%d,%s,%d) Started.",plctype,
+		       straddress,count);
+#endif /* LOGGING */
+	if((count < 1)||((count*sizeof(word)) > DF1_READ_WRITE_BLOCK_MAX_BYTES))
+	{
+		Df1_Error_Number = 518;
+		sprintf(Df1_Error_String,"Df1_Read_Integer_Block: Illegal count %d (max %d).",count,
+			(int)(DF1_READ_WRITE_BLOCK_MAX_BYTES/sizeof(word)));
+		return FALSE;
+	}
+	bzero(values,count*sizeof(word));
+	/* parse address */
+	if(!Df1_Calc_Address(straddress,&address))
+		return FALSE;
+	if (plctype==SLC)
+	{
+		/* the address size is the number of bytes to read, starting at eleNumber */
+		address.size = count*sizeof(word);
+		if(!Df1_Read_A2(handle,address,data,address.size))
+			return FALSE;
+		/* data is little endian */
+		for(i = 0; i < count; i++)
+			values[i] = (word)(data[(i*2)]|(data[(i*2)+1]<<8));
+	}
+#if LOGGING > 1
+	Df1_Log_Format(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_Integer_Block(%d,%s,%d) Finished.",
+		       plctype,straddress,count);
+#endif /* LOGGING */
+	return TRUE;
+}
+
+/**
+ * Routine to read a contiguous block of float values from the PLC in one transaction,
+ * i.e. F21:0 with count 11 reads F21:0 to F21:10.
+ * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
+ * @param plctype The type of PLC, use SLC if you want it to do anything.
+ * @param straddress The PLC address of the first element as a string, e.g F8:5.
+ * @param count The number of consecutive elements to read. count*sizeof(float) must not be more than
+ *        DF1_READ_WRITE_BLOCK_MAX_BYTES.
+ * @param values An array of at least count floats, filled in with the float values read.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Df1_Read_A2
+ * @see #DF1_READ_WRITE_BLOCK_MAX_BYTES
+ * @see df1.html#Df1_Calc_Address
+ * @see df1.html#SLC
+ * @see df1_interface.html#Df1_Interface_Handle_T
+ * @see df1.html#TThree_Address_Fields
+ */
+int Df1_Read_Float_Block(Df1_Interface_Handle_T *handle,int plctype, char *straddress,int count,float *values)
+{
+	TThree_Address_Fields address;
+	byte data[DF1_READ_WRITE_BLOCK_MAX_BYTES];
+	unsigned int float_bits;
+	int i;
+
+	if(straddress == NULL)
+	{
+		Df1_Error_Number = 519;
+		sprintf(Df1_Error_String,"Df1_Read_Float_Block: Address was NULL.");
+		return FALSE;
+	}
+	if(values == NULL)
+	{
+		Df1_Error_Number = 520;
+		sprintf(Df1_Error_String,"Df1_Read_Float_Block: Values was NULL.");
+		return FALSE;
+	}
+#if LOGGING > 1
+	Df1_Log_Format(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_Float_Block(%d,%s,%d) Started.",plctype,
+		       straddress,count);
+#endif /* LOGGING */
+	if((count < 1)||((count*sizeof(float)) > DF1_READ_WRITE_BLOCK_MAX_BYTES))
+	{
+		Df1_Error_Number = 521;
+		sprintf(Df1_Error_String,"Df1_Read_Float_Block: Illegal count %d (max %d).",count,
+			(int)(DF1_READ_WRITE_BLOCK_MAX_BYTES/sizeof(float)));
+		return FALSE;
+	}
+	bzero(values,count*sizeof(float));
+	/* parse address */
+	if(!Df1_Calc_Address(straddress,&address))
+		return FALSE;
+	if (plctype==SLC)
+	{
+		/* the address size is the number of bytes to read, starting at eleNumber */
+		address.size = count*sizeof(float);
+		if(!Df1_Read_A2(handle,address,data,address.size))
+			return FALSE;
+		/* data is little endian IEEE 754 */
+		for(i = 0; i < count; i++)
+		{
+			float_bits = ((unsigned int)data[(i*4)])|(((unsigned int)data[(i*4)+1])<<8)|
+				(((unsigned int)data[(i*4)+2])<<16)|(((unsigned int)data[(i*4)+3])<<24);
+			memcpy(&(values[i]),&float_bits,sizeof(float));
+		}
+	}
+#if LOGGING > 1
+	Df1_Log_Format(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_Float_Block(%d,%s,%d) Finished.",
+		       plctype,straddress,count);
+#endif /* LOGGING */
+	return TRUE;
+}
+
 /* ----------------------------------------------------------------
 ** internal functions 
 ** ---------------------------------------------------------------- */
 /**
  * Cmd:0F Fnc:AB > write W/4 fields & mask in SLC500. Write 1 bit in SLC.
- * If mutex locking is compiled in, the handl's mutex is locked around the Df1_Send/Df1_Receive calls.
+ * The handle's transaction table assigns the transaction number, and matches the reply to it, so several
+ * commands can be outstanding on one link at once.
  * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
  * @param address Which PLC address to write to.
  * @param value The value to write.
  * @param mask The mask.
  * @return The routine returns TRUE on success and FALSE on failure.
- * @see #Df1_Read_Write_Data
  * @see df1.html#DEST
  * @see df1.html#SOURCE
  * @see df1.html#TCmd4
  * @see df1.html#TThree_Address_Fields
- * @see df1.html#Df1_Send
- * @see df1.html#Df1_Receive
+ * @see df1.html#Df1_Transaction
  * @see df1_interface.html#Df1_Interface_Handle_T
- * @see df1_interface.html#Df1_Interface_Mutex_Lock
- * @see df1_interface.html#Df1_Interface_Mutex_Unlock
  */
 static int Df1_Write_AB(Df1_Interface_Handle_T *handle,TThree_Address_Fields address, word value, word mask)
 {
@@ -391,10 +506,6 @@ static int Df1_Write_AB(Df1_Interface_Handle_T *handle,TThree_Address_Fields add
 	send_msg.src = SOURCE;
 	send_msg.cmd = 0x0F;
 	send_msg.sts = 0x00;
-	/* initialise Tns if it has not been used before */
-	if(Df1_Read_Write_Data.Tns < 0)
-		Df1_Read_Write_Data.Tns = (word)time(NULL);
-	send_msg.tns = Df1_Read_Write_Data.Tns++;
 	cmd.fnc = 0xAB;
 	cmd.size = address.size;
 	cmd.fileNumber = address.fileNumber;
@@ -405,44 +516,12 @@ static int Df1_Write_AB(Df1_Interface_Handle_T *handle,TThree_Address_Fields add
 	cmd.value = value;
 	memcpy(&send_msg.data,&cmd,sizeof(cmd));
 	send_msg.size = sizeof(cmd);
-	/* lock mutex */
-#ifdef DF1_MUTEXED
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AB: Locking handle mutex.");
-#endif /* LOGGING */
-	if(!Df1_Interface_Mutex_Lock(handle))
-		return FALSE;
-#endif
-	/* send message */
+	/* send message and wait for the reply, other threads can use the link in the meantime */
 #if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AB: Sending message.");
+	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AB: Sending message and waiting for reply.");
 #endif /* LOGGING */
-	if(!Df1_Send(handle,send_msg))
-	{
-#ifdef DF1_MUTEXED
-		Df1_Interface_Mutex_Unlock(handle);
-#endif
+	if(!Df1_Transaction(handle,&send_msg,&rcv_msg))
 		return FALSE;
-	}
-	/* get reply message */
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AB: Receiving reply message.");
-#endif /* LOGGING */
-	if(!Df1_Receive(handle,&rcv_msg))
-	{
-#ifdef DF1_MUTEXED
-		Df1_Interface_Mutex_Unlock(handle);
-#endif
-		return FALSE;
-	}
-	/* unlock mutex */
-#ifdef DF1_MUTEXED
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AB: Unlocking handle mutex.");
-#endif /* LOGGING */
-	if(!Df1_Interface_Mutex_Unlock(handle))
-		return FALSE;
-#endif
 	/* check transaction number */
 	if(rcv_msg.tns != send_msg.tns)
 	{
@@ -466,22 +545,20 @@ static int Df1_Write_AB(Df1_Interface_Handle_T *handle,TThree_Address_Fields add
 
 /**
  * Cmd:0F Fnc:A2 > Read 3 address fields in SLC500. Read Protected Typed Logical.
- * If mutex locking is compiled in, the handl's mutex is locked around the Df1_Send/Df1_Receive calls.
+ * The handle's transaction table assigns the transaction number, and matches the reply to it, so several
+ * commands can be outstanding on one link at once.
  * @param handle A pointer to an instance of Df1_Interface_Handle_T containing connection data to the PLC.
- * @param address Which PLC address to read from.
+ * @param address Which PLC address to read from. address.size is the number of bytes to read, 
+ *        which can cover several consecutive elements for a block read.
  * @param value The address of a variable to fill in with the value.
- * @param size The size.
+ * @param size The size of value, which should be at least address.size.
  * @return The routine returns TRUE on success and FALSE on failure.
- * @see #Df1_Read_Write_Data
  * @see df1.html#DEST
  * @see df1.html#SOURCE
  * @see df1.html#TCmd
  * @see df1.html#TMsg
- * @see df1.html#Df1_Send
- * @see df1.html#Df1_Receive
+ * @see df1.html#Df1_Transaction
  * @see df1_interface.html#Df1_Interface_Handle_T
- * @see df1_interface.html#Df1_Interface_Mutex_Lock
- * @see df1_interface.html#Df1_Interface_Mutex_Unlock
  */
 static int Df1_Read_A2(Df1_Interface_Handle_T *handle,TThree_Address_Fields address, void *value, byte size) 
 {
@@ -499,10 +576,6 @@ static int Df1_Read_A2(Df1_Interface_Handle_T *handle,TThree_Address_Fields addr
 	send_msg.src = SOURCE;
 	send_msg.cmd = 0x0F;
 	send_msg.sts = 0x00;
-	/* initialise Tns if it has not been used before */
-	if(Df1_Read_Write_Data.Tns < 0)
-		Df1_Read_Write_Data.Tns = (word)time(NULL);
-	send_msg.tns = Df1_Read_Write_Data.Tns++;
 	cmd.fnc = 0xA2;
 	cmd.size = address.size;
 	cmd.fileNumber = address.fileNumber;
@@ -511,44 +584,12 @@ static int Df1_Read_A2(Df1_Interface_Handle_T *handle,TThree_Address_Fields addr
 	cmd.s_eleNumber = address.s_eleNumber;
 	memcpy(&send_msg.data,&cmd,sizeof(cmd));
 	send_msg.size = sizeof(cmd);
-	/* lock mutex */
-#ifdef DF1_MUTEXED
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_A2: Locking handle mutex.");
-#endif /* LOGGING */
-	if(!Df1_Interface_Mutex_Lock(handle))
-		return FALSE;
-#endif
-	/* send message */
+	/* send message and wait for the reply, other threads can use the link in the meantime */
 #if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_A2: Sending message.");
+	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_A2: Sending message and waiting for reply.");
 #endif /* LOGGING */
-	if(!Df1_Send(handle,send_msg))
-	{
-#ifdef DF1_MUTEXED
-		Df1_Interface_Mutex_Unlock(handle);
-#endif
+	if(!Df1_Transaction(handle,&send_msg,&rcv_msg))
 		return FALSE;
-	}
-	/* get reply message */
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_A2: Receiving reply message.");
-#endif /* LOGGING */
-	if(!Df1_Receive(handle,&rcv_msg))
-	{
-#ifdef DF1_MUTEXED
-		Df1_Interface_Mutex_Unlock(handle);
-#endif
-		return FALSE;
-	}
-	/* unlock mutex */
-#ifdef DF1_MUTEXED
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_A2: Unlocking handle mutex.");
-#endif /* LOGGING */
-	if(!Df1_Interface_Mutex_Unlock(handle))
-		return FALSE;
-#endif
 	/* check transaction number */
 	if (rcv_msg.tns!=send_msg.tns)
 	{
@@ -564,6 +605,14 @@ static int Df1_Read_A2(Df1_Interface_Handle_T *handle,TThree_Address_Fields addr
 		sprintf(Df1_Error_String,"Df1_Read_A2: Receive Mesage sts = %d.",rcv_msg.sts);
 		return FALSE;
 	}
+	/* check we received all the data we asked for */
+	if((rcv_msg.size < address.size)||(address.size > size))
+	{
+		Df1_Error_Number = 522;
+		sprintf(Df1_Error_String,"Df1_Read_A2: Received %d bytes, expected %d (value size %d).",
+			rcv_msg.size,address.size,size);
+		return FALSE;
+	}
 	memcpy(value,rcv_msg.data,address.size);
 #if LOGGING > 1
 	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Read_A2 Finished.");
@@ -579,16 +628,12 @@ static int Df1_Read_A2(Df1_Interface_Handle_T *handle,TThree_Address_Fields addr
  * @param value The address of a variable to fill in with the value.
  * @param size The size of value.
  * @return The routine returns TRUE on success and FALSE on failure.
- * @see #Df1_Read_Write_Data
  * @see df1.html#DEST
  * @see df1.html#SOURCE
  * @see df1.html#TCmd
  * @see df1.html#TMsg
- * @see df1.html#Df1_Send
- * @see df1.html#Df1_Receive
+ * @see df1.html#Df1_Transaction
  * @see df1_interface.html#Df1_Interface_Handle_T
- * @see df1_interface.html#Df1_Interface_Mutex_Lock
- * @see df1_interface.html#Df1_Interface_Mutex_Unlock
  */
 static int Df1_Write_AA(Df1_Interface_Handle_T *handle,TThree_Address_Fields address, void *value, byte size) 
 {
@@ -605,10 +650,6 @@ static int Df1_Write_AA(Df1_Interface_Handle_T *handle,TThree_Address_Fields add
 	send_msg.src = SOURCE;
 	send_msg.cmd = 0x0F;
 	send_msg.sts = 0x00;
-	/* initialise Tns if it has not been used before */
-	if(Df1_Read_Write_Data.Tns < 0)
-		Df1_Read_Write_Data.Tns = (word)time(NULL);
-	send_msg.tns = Df1_Read_Write_Data.Tns++;
 	cmd.fnc = 0xAA;
 	cmd.size = address.size;
 	cmd.fileNumber = address.fileNumber;
@@ -623,44 +664,12 @@ static int Df1_Write_AA(Df1_Interface_Handle_T *handle,TThree_Address_Fields add
 	*/
 	memcpy(&send_msg.data[send_msg.size],value,size);
 	send_msg.size += size; 
-	/* lock mutex */
-#ifdef DF1_MUTEXED
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AA: Locking handle mutex.");
-#endif /* LOGGING */
-	if(!Df1_Interface_Mutex_Lock(handle))
-		return FALSE;
-#endif
-	/* send message */
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AA: Sending message.");
-#endif /* LOGGING */
-	if(!Df1_Send(handle,send_msg))
-	{
-#ifdef DF1_MUTEXED
-		Df1_Interface_Mutex_Unlock(handle);
-#endif
-		return FALSE;
-	}
-	/* get reply message */
-#if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AA: Receiving reply message.");
-#endif /* LOGGING */
-	if(!Df1_Receive(handle,&rcv_msg))
-	{
-#ifdef DF1_MUTEXED
-		Df1_Interface_Mutex_Unlock(handle);
-#endif
-		return FALSE;
-	}
-	/* unlock mutex */
-#ifdef DF1_MUTEXED
+	/* send message and wait for the reply, other threads can use the link in the meantime */
 #if LOGGING > 5
-	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AA: Unlocking handle mutex.");
+	Df1_Log(DF1_LOG_BIT_DF1_READ_WRITE,"Df1_Write_AA: Sending message and waiting for reply.");
 #endif /* LOGGING */
-	if(!Df1_Interface_Mutex_Unlock(handle))
+	if(!Df1_Transaction(handle,&send_msg,&rcv_msg))
 		return FALSE;
-#endif
 	/* check transaction number */
 	if (rcv_msg.tns!=send_msg.tns)
 	{
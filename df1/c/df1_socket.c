@@ -17,6 +17,7 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,7 +47,7 @@ int Df1_Socket_Open(Df1_Socket_Handle_T *handle)
 	char host_ip[256];
 	struct hostent *host;
 	struct sockaddr_in address;
-	int open_errno;
+	int open_errno,flag;
 
 	if(handle == NULL)
 	{
@@ -101,6 +102,17 @@ int Df1_Socket_Open(Df1_Socket_Handle_T *handle)
 			host_ip,handle->Port_Number,strerror(open_errno),open_errno);
 		return FALSE;
 	}
+	/* Turn off Nagle's algorithm. Each write is a complete DF1 frame or response, and otherwise
+	** a frame written straight after an ACK is held back until the ACK itself is acknowledged. */
+	flag = 1;
+	if(setsockopt(handle->Socket_Fd,IPPROTO_TCP,TCP_NODELAY,(char *)&flag,sizeof(flag)) != 0)
+	{
+		open_errno = errno;
+		Df1_Error_Number = 411;
+		sprintf(Df1_Error_String,"Df1_Socket_Open: setsockopt TCP_NODELAY failed (%s,%d).",
+			strerror(open_errno),open_errno);
+		return FALSE;
+	}
 	/* make non-blocking */
 	/*
 #if LOGGING > 1
@@ -200,8 +212,10 @@ int Df1_Socket_Write(Df1_Socket_Handle_T handle,void *message,size_t message_len
  * @param message A buffer of message_length bytes, to fill with any socket data returned.
  * @param message_length The length of the message buffer.
  * @param bytes_read The address of an integer. On return this will be filled with the number of bytes read from
- *        the socket interface. The address can be NULL, if this data is not needed.
- * @return TRUE if succeeded, FALSE otherwise.
+ *        the socket interface. The address can be NULL, if this data is not needed. This is zero if a
+ *        non-blocking read found no data (EAGAIN), which is not an error.
+ * @return TRUE if succeeded, FALSE otherwise. The remote end closing the connection (read returning 0)
+ *         is an error (413), so it can be told apart from no data being available.
  * @see #Socket_Data
  */
 int Df1_Socket_Read(Df1_Socket_Handle_T handle,void *message,int message_length,int *bytes_read)
@@ -249,6 +263,12 @@ int Df1_Socket_Read(Df1_Socket_Handle_T handle,void *message,int message_length,
 				(*bytes_read) = 0;
 		}
 	}
+	else if((retval == 0)&&(message_length > 0))
+	{
+		Df1_Error_Number = 413;
+		sprintf(Df1_Error_String,"Df1_Socket_Read: Connection closed by remote end (%d).",handle.Socket_Fd);
+		return FALSE;
+	}
 	else
 	{
 		if(bytes_read != NULL)
@@ -524,6 +524,113 @@ JNIEXPORT jfloat JNICALL Java_ngat_frodospec_df1_Df1Library_Df1_1Read_1Float(JNI
 	return (jfloat)value;
 }
 
+/**
+ * Class:     ngat_frodospec_df1_Df1Library<br>
+ * Method:    Df1_Read_Integer_Block<br>
+ * Signature: (Ljava/lang/String;I)[S<br>
+ * Read count consecutive integers starting at the specified PLC address, in one transaction.
+ * @return A new Java short array containing the values read, or NULL if an exception was thrown.
+ * @see #Df1Library_Throw_Exception
+ * @see #Df1Library_Throw_Exception_String
+ * @see #Df1Library_Handle_Map_Find
+ * @see df1_interface.html#Df1_Interface_Handle_T
+ * @see df1_read_write.html#Df1_Read_Integer_Block
+ * @see df1_read_write.html#DF1_READ_WRITE_BLOCK_MAX_BYTES
+ * @see df1.html#SLC
+ */
+JNIEXPORT jshortArray JNICALL Java_ngat_frodospec_df1_Df1Library_Df1_1Read_1Integer_1Block(JNIEnv *env,
+							       jobject obj,jstring plc_address_jstring,jint count)
+{
+	Df1_Interface_Handle_T *handle = NULL;
+	const char *plc_address_c = NULL;
+	jshortArray value_array = NULL;
+	word values[DF1_READ_WRITE_BLOCK_MAX_BYTES/sizeof(word)];
+	jshort jvalues[DF1_READ_WRITE_BLOCK_MAX_BYTES/sizeof(word)];
+	int retval,i;
+
+	/* get interface handle from Df1Library instance map */
+	if(!Df1Library_Handle_Map_Find(env,obj,&handle))
+		return NULL; /* Df1Library_Handle_Map_Find throws an exception on failure */
+	/* Get the PLC address from a java string to a c null terminated string
+	** If the java String is null the plc_address_c should be null as well */
+	if(plc_address_jstring != NULL)
+		plc_address_c = (*env)->GetStringUTFChars(env,plc_address_jstring,0);
+	retval = Df1_Read_Integer_Block(handle,SLC,(char *)plc_address_c,count,values);
+	/* If we created the plc_address_c string we need to free the memory it uses */
+	if(plc_address_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,plc_address_jstring,plc_address_c);
+	/* if an error occured throw an exception. */
+	if(retval == FALSE)
+	{
+		Df1Library_Throw_Exception(env,obj,"Df1_Read_Integer_Block");
+		return NULL;
+	}
+	/* copy the values into a new Java array */
+	value_array = (*env)->NewShortArray(env,count);
+	if(value_array == NULL)
+	{
+		Df1Library_Throw_Exception_String(env,obj,"Df1_Read_Integer_Block",
+						  "Failed to allocate value array.");
+		return NULL;
+	}
+	for(i = 0; i < count; i++)
+		jvalues[i] = (jshort)values[i];
+	(*env)->SetShortArrayRegion(env,value_array,0,count,jvalues);
+	return value_array;
+}
+
+/**
+ * Class:     ngat_frodospec_df1_Df1Library<br>
+ * Method:    Df1_Read_Float_Block<br>
+ * Signature: (Ljava/lang/String;I)[F<br>
+ * Read count consecutive floats starting at the specified PLC address, in one transaction.
+ * @return A new Java float array containing the values read, or NULL if an exception was thrown.
+ * @see #Df1Library_Throw_Exception
+ * @see #Df1Library_Throw_Exception_String
+ * @see #Df1Library_Handle_Map_Find
+ * @see df1_interface.html#Df1_Interface_Handle_T
+ * @see df1_read_write.html#Df1_Read_Float_Block
+ * @see df1_read_write.html#DF1_READ_WRITE_BLOCK_MAX_BYTES
+ * @see df1.html#SLC
+ */
+JNIEXPORT jfloatArray JNICALL Java_ngat_frodospec_df1_Df1Library_Df1_1Read_1Float_1Block(JNIEnv *env,
+							       jobject obj,jstring plc_address_jstring,jint count)
+{
+	Df1_Interface_Handle_T *handle = NULL;
+	const char *plc_address_c = NULL;
+	jfloatArray value_array = NULL;
+	float values[DF1_READ_WRITE_BLOCK_MAX_BYTES/sizeof(float)];
+	int retval;
+
+	/* get interface handle from Df1Library instance map */
+	if(!Df1Library_Handle_Map_Find(env,obj,&handle))
+		return NULL; /* Df1Library_Handle_Map_Find throws an exception on failure */
+	/* Get the PLC address from a java string to a c null terminated string
+	** If the java String is null the plc_address_c should be null as well */
+	if(plc_address_jstring != NULL)
+		plc_address_c = (*env)->GetStringUTFChars(env,plc_address_jstring,0);
+	retval = Df1_Read_Float_Block(handle,SLC,(char *)plc_address_c,count,values);
+	/* If we created the plc_address_c string we need to free the memory it uses */
+	if(plc_address_jstring != NULL)
+		(*env)->ReleaseStringUTFChars(env,plc_address_jstring,plc_address_c);
+	/* if an error occured throw an exception. */
+	if(retval == FALSE)
+	{
+		Df1Library_Throw_Exception(env,obj,"Df1_Read_Float_Block");
+		return NULL;
+	}
+	/* copy the values into a new Java array */
+	value_array = (*env)->NewFloatArray(env,count);
+	if(value_array == NULL)
+	{
+		Df1Library_Throw_Exception_String(env,obj,"Df1_Read_Float_Block",
+						  "Failed to allocate value array.");
+		return NULL;
+	}
+	(*env)->SetFloatArrayRegion(env,value_array,0,count,(jfloat *)values);
+	return value_array;
+}
+
 /* ------------------------------------------------------------------------------
 ** 		Internal routines
 ** ------------------------------------------------------------------------------ */
@@ -60,6 +60,17 @@
  * @see #Df1_Get_Symbol
  */
 #define CONTROL_FLAG 2
+/**
+ * The number of bytes in a DF1 message before the data: dst, src, cmd, sts and the 2 byte tns.
+ * @see #TMsg
+ */
+#define DF1_MESSAGE_HEADER_LENGTH (6)
+/**
+ * The maximum number of transactions (commands awaiting their replies) that can be outstanding
+ * on one interface handle at once.
+ * @see #Df1_Transaction_Send
+ */
+#define DF1_TRANSACTION_COUNT     (8)
 
 /* type definitions */
 /**
@@ -137,6 +148,13 @@ typedef struct
 extern int Df1_Send(Df1_Interface_Handle_T *handle,TMsg df1_data);
 extern int Df1_Receive(Df1_Interface_Handle_T *handle,TMsg *df1_data);
 extern int Df1_Calc_Address(char *straddress,TThree_Address_Fields *address);
+extern int Df1_Transaction_Table_Create(Df1_Transaction_Table_T **table);
+extern int Df1_Transaction_Table_Destroy(Df1_Transaction_Table_T **table);
+extern int Df1_Transaction_Send(Df1_Interface_Handle_T *handle,TMsg *df1_data,int *transaction_index);
+extern int Df1_Transaction_Wait(Df1_Interface_Handle_T *handle,int transaction_index,int timeout_ms,TMsg *reply);
+extern int Df1_Transaction(Df1_Interface_Handle_T *handle,TMsg *df1_data,TMsg *reply);
+extern word Df1_Crc_Compute(word crc,byte *data,int length);
+extern word Df1_Crc_Compute_Bitwise(word crc,byte *data,int length);
 
 #endif
 /*
@@ -9,6 +9,15 @@
  * Maximum length of the device name.
  */
 #define DF1_INTERFACE_DEVICE_NAME_STRING_LENGTH   (256)
+/**
+ * The length of the per-handle receive buffer, in bytes. This is big enough to hold a complete
+ * DLE stuffed DF1 reply frame, so a reply normally arrives in one or two reads.
+ */
+#define DF1_INTERFACE_RECEIVE_BUFFER_LENGTH       (1024)
+/**
+ * The default number of milliseconds Df1_Interface_Read_Byte will wait for data to arrive.
+ */
+#define DF1_INTERFACE_DEFAULT_READ_TIMEOUT_MS     (1000)
 
 /* These enum definitions should match with those in Df1Library.java */
 /**
@@ -38,6 +47,11 @@ enum DF1_INTERFACE_DEVICE_ID
  * @see #Df1_Interface_Handle_Struct
  */
 typedef struct Df1_Interface_Handle_Struct Df1_Interface_Handle_T;
+/**
+ * Typedef for the per handle DF1 transaction table, which is an instance of Df1_Transaction_Table_Struct.
+ * This is defined in df1.c.
+ */
+typedef struct Df1_Transaction_Table_Struct Df1_Transaction_Table_T;
 
 extern int Df1_Interface_Handle_Create(Df1_Interface_Handle_T **handle);
 extern int Df1_Interface_Open(enum DF1_INTERFACE_DEVICE_ID device_id,char *device_name,int port_number,
@@ -46,6 +60,12 @@ extern int Df1_Interface_Close(Df1_Interface_Handle_T *handle);
 extern int Df1_Interface_Handle_Destroy(Df1_Interface_Handle_T **handle);
 extern int Df1_Interface_Write(Df1_Interface_Handle_T *handle,void* message,size_t message_length);
 extern int Df1_Interface_Read(Df1_Interface_Handle_T *handle,void* message,int message_length,int* bytes_read);
+extern int Df1_Interface_Read_Byte(Df1_Interface_Handle_T *handle,unsigned char *b);
+extern int Df1_Interface_Read_Byte_Timeout(Df1_Interface_Handle_T *handle,unsigned char *b,int timeout_ms,
+					   int *byte_read);
+extern int Df1_Interface_Read_Timeout_Set(Df1_Interface_Handle_T *handle,int timeout_ms);
+extern int Df1_Interface_Read_Timeout_Get(Df1_Interface_Handle_T *handle);
+extern Df1_Transaction_Table_T *Df1_Interface_Transaction_Table_Get(Df1_Interface_Handle_T *handle);
 extern int Df1_Interface_Mutex_Lock(Df1_Interface_Handle_T *handle);
 extern int Df1_Interface_Mutex_Unlock(Df1_Interface_Handle_T *handle);
 
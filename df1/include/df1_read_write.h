@@ -6,12 +6,23 @@
 #define DF1_READ_WRITE_H
 #include "df1.h"
 
+/**
+ * The maximum number of data bytes we ask for in one protected typed logical read (block read).
+ * This keeps the reply within the PLC's DF1 packet limit (and the 255 byte TMsg data buffer).
+ * This allows 118 integers or 59 floats to be read in one transaction.
+ */
+#define DF1_READ_WRITE_BLOCK_MAX_BYTES (236)
+
 extern int Df1_Write_Boolean(Df1_Interface_Handle_T *handle,int plctype, char *straddress, int value);
 extern int Df1_Read_Boolean(Df1_Interface_Handle_T *handle,int plctype, char *straddress, int *value);
 extern int Df1_Write_Integer(Df1_Interface_Handle_T *handle,int plctype, char *straddress,word value);
 extern int Df1_Read_Integer(Df1_Interface_Handle_T *handle,int plctype, char *straddress,word *value);
 extern int Df1_Write_Float(Df1_Interface_Handle_T *handle,int plctype, char *straddress,float value);
 extern int Df1_Read_Float(Df1_Interface_Handle_T *handle,int plctype, char *straddress,float *value);
+extern int Df1_Read_Integer_Block(Df1_Interface_Handle_T *handle,int plctype, char *straddress,int count,
+				  word *values);
+extern int Df1_Read_Float_Block(Df1_Interface_Handle_T *handle,int plctype, char *straddress,int count,
+				float *values);
 
 #endif
 /*
@@ -0,0 +1,352 @@
+/* df1_test_crc.c
+** $Header: /home/cjm/cvs/frodospec/df1/test/df1_test_crc.c,v 1.1 2023-03-21 14:36:52 cjm Exp $
+ */
+/**
+ * This is needed for clock_gettime/CLOCK_MONOTONIC.
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "df1_general.h"
+#include "df1.h"
+
+/**
+ * This program tests the table driven DF1 CRC-16 routine (Df1_Crc_Compute) against the original bit-wise
+ * routine (Df1_Crc_Compute_Bitwise). It first checks both against a known check value, then fuzzes them with
+ * random data of random lengths and random initial CRCs, then times both over a frame sized block of data.
+ * No PLC is needed.
+ * @author $Author: cjm $
+ * @version $Revision: 1.1 $
+ */
+
+/* hash definitions */
+/**
+ * The data used to compute the check value.
+ */
+#define CHECK_STRING            ("123456789")
+/**
+ * The CRC-16 (polynomial 0xA001, initial value 0) of CHECK_STRING.
+ * @see #CHECK_STRING
+ */
+#define CHECK_VALUE             (0xbb3d)
+/**
+ * The largest block of data to fuzz with. This is bigger than any DF1 frame.
+ */
+#define MAX_DATA_LENGTH         (1024)
+/**
+ * Default number of random blocks of data to fuzz the CRC routines with.
+ */
+#define DEFAULT_FUZZ_COUNT      (100000)
+/**
+ * Default number of times to compute the CRC of the benchmark data.
+ */
+#define DEFAULT_BENCHMARK_COUNT (100000)
+/**
+ * Default length of the benchmark data, the header plus data of the largest block read reply.
+ * @see ../cdocs/df1.html#DF1_MESSAGE_HEADER_LENGTH
+ */
+#define DEFAULT_BENCHMARK_LENGTH (242)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id: df1_test_crc.c,v 1.1 2023-03-21 14:36:52 cjm Exp $";
+/**
+ * The number of random blocks of data to fuzz the CRC routines with.
+ * @see #DEFAULT_FUZZ_COUNT
+ */
+static int Fuzz_Count = DEFAULT_FUZZ_COUNT;
+/**
+ * The number of times to compute the CRC of the benchmark data.
+ * @see #DEFAULT_BENCHMARK_COUNT
+ */
+static int Benchmark_Count = DEFAULT_BENCHMARK_COUNT;
+/**
+ * The length of the benchmark data, in bytes.
+ * @see #DEFAULT_BENCHMARK_LENGTH
+ */
+static int Benchmark_Length = DEFAULT_BENCHMARK_LENGTH;
+/**
+ * The seed for the random number generator.
+ */
+static unsigned int Seed = 1;
+
+/* internal routines */
+static int Test_Check_Value(void);
+static int Test_Fuzz(void);
+static void Test_Benchmark(void);
+static double Time_Diff_Ms(struct timespec start_time,struct timespec end_time);
+static int Parse_Arguments(int argc, char *argv[]);
+static void Help(void);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Test_Check_Value
+ * @see #Test_Fuzz
+ * @see #Test_Benchmark
+ */
+int main(int argc, char *argv[])
+{
+	fprintf(stdout,"Test CRC.\n");
+	fprintf(stdout,"Parsing Arguments.\n");
+	/* parse arguments */
+	if(!Parse_Arguments(argc,argv))
+		return 1;
+	srand(Seed);
+	if(!Test_Check_Value())
+		return 2;
+	if(!Test_Fuzz())
+		return 3;
+	Test_Benchmark();
+	fprintf(stdout,"Test CRC:Finished Test ...\n");
+	return 0;
+}
+
+/**
+ * Check both CRC routines return the standard check value for the check string.
+ * @return The routine returns TRUE if both routines are correct, and FALSE otherwise.
+ * @see #CHECK_STRING
+ * @see #CHECK_VALUE
+ */
+static int Test_Check_Value(void)
+{
+	word table_crc,bitwise_crc;
+
+	table_crc = Df1_Crc_Compute(0,(byte *)CHECK_STRING,strlen(CHECK_STRING));
+	bitwise_crc = Df1_Crc_Compute_Bitwise(0,(byte *)CHECK_STRING,strlen(CHECK_STRING));
+	fprintf(stdout,"Test CRC:Check value:table %#06x, bitwise %#06x, expected %#06x.\n",table_crc,bitwise_crc,
+		CHECK_VALUE);
+	if((table_crc != CHECK_VALUE)||(bitwise_crc != CHECK_VALUE))
+	{
+		fprintf(stderr,"Test CRC:Check value failed.\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Compare the table driven and bit-wise CRC routines on random data. Each test uses a random length
+ * (including zero), random data and a random initial CRC, and the block is also split at a random point
+ * and computed in two calls, to check the CRC can be continued.
+ * @return The routine returns TRUE if the routines always agreed, and FALSE otherwise.
+ * @see #Fuzz_Count
+ * @see #MAX_DATA_LENGTH
+ */
+static int Test_Fuzz(void)
+{
+	byte data[MAX_DATA_LENGTH];
+	word initial_crc,table_crc,split_crc,bitwise_crc;
+	int i,j,length,split;
+
+	for(i = 0; i < Fuzz_Count; i++)
+	{
+		length = rand()%(MAX_DATA_LENGTH+1);
+		for(j = 0; j < length; j++)
+			data[j] = (byte)(rand()&0xff);
+		initial_crc = (word)(rand()&0xffff);
+		split = rand()%(length+1);
+		table_crc = Df1_Crc_Compute(initial_crc,data,length);
+		split_crc = Df1_Crc_Compute(Df1_Crc_Compute(initial_crc,data,split),data+split,length-split);
+		bitwise_crc = Df1_Crc_Compute_Bitwise(initial_crc,data,length);
+		if((table_crc != bitwise_crc)||(split_crc != bitwise_crc))
+		{
+			fprintf(stderr,"Test CRC:Fuzz test %d failed:length %d,initial CRC %#06x,split %d:"
+				"table %#06x,split table %#06x,bitwise %#06x.\n",i,length,initial_crc,split,
+				table_crc,split_crc,bitwise_crc);
+			return FALSE;
+		}
+	}
+	fprintf(stdout,"Test CRC:Fuzz test:%d random blocks agreed.\n",Fuzz_Count);
+	return TRUE;
+}
+
+/**
+ * Time the table driven and bit-wise CRC routines computing the CRC of a block of random data.
+ * @see #Benchmark_Count
+ * @see #Benchmark_Length
+ * @see #Time_Diff_Ms
+ */
+static void Test_Benchmark(void)
+{
+	struct timespec start_time,end_time;
+	byte data[MAX_DATA_LENGTH];
+	volatile word table_crc,bitwise_crc;
+	double table_ms,bitwise_ms;
+	int i;
+
+	for(i = 0; i < Benchmark_Length; i++)
+		data[i] = (byte)(rand()&0xff);
+	clock_gettime(CLOCK_MONOTONIC,&start_time);
+	for(i = 0; i < Benchmark_Count; i++)
+		table_crc = Df1_Crc_Compute(0,data,Benchmark_Length);
+	clock_gettime(CLOCK_MONOTONIC,&end_time);
+	table_ms = Time_Diff_Ms(start_time,end_time);
+	clock_gettime(CLOCK_MONOTONIC,&start_time);
+	for(i = 0; i < Benchmark_Count; i++)
+		bitwise_crc = Df1_Crc_Compute_Bitwise(0,data,Benchmark_Length);
+	clock_gettime(CLOCK_MONOTONIC,&end_time);
+	bitwise_ms = Time_Diff_Ms(start_time,end_time);
+	fprintf(stdout,"Test CRC:Benchmark:%d blocks of %d bytes:CRC table %#06x,bitwise %#06x.\n",Benchmark_Count,
+		Benchmark_Length,table_crc,bitwise_crc);
+	fprintf(stdout,"Test CRC:Benchmark:table   %.3f ms (%.2f us per block).\n",table_ms,
+		(table_ms*1000.0)/Benchmark_Count);
+	fprintf(stdout,"Test CRC:Benchmark:bitwise %.3f ms (%.2f us per block).\n",bitwise_ms,
+		(bitwise_ms*1000.0)/Benchmark_Count);
+	if(table_ms > 0.0)
+		fprintf(stdout,"Test CRC:Benchmark:table is %.1f times faster.\n",bitwise_ms/table_ms);
+}
+
+/**
+ * Return the difference between two times, in milliseconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The number of milliseconds from start_time to end_time.
+ */
+static double Time_Diff_Ms(struct timespec start_time,struct timespec end_time)
+{
+	return (((double)(end_time.tv_sec-start_time.tv_sec))*1000.0)+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1000000.0);
+}
+
+/**
+ * Routine to parse command line arguments.
+ * @param argc The number of arguments sent to the program.
+ * @param argv An array of argument strings.
+ * @see #Help
+ * @see #Fuzz_Count
+ * @see #Benchmark_Count
+ * @see #Benchmark_Length
+ * @see #Seed
+ */
+static int Parse_Arguments(int argc, char *argv[])
+{
+	int i,retval;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-fuzz_count")==0)
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Fuzz_Count);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Test CRC:Parse_Arguments:"
+						"Illegal fuzz count %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Test CRC:Parse_Arguments:"
+					"Fuzz count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-benchmark_count")==0)
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Benchmark_Count);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Test CRC:Parse_Arguments:"
+						"Illegal benchmark count %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Test CRC:Parse_Arguments:"
+					"Benchmark count requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-benchmark_length")==0)
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Benchmark_Length);
+				if((retval != 1)||(Benchmark_Length < 0)||(Benchmark_Length > MAX_DATA_LENGTH))
+				{
+					fprintf(stderr,"Test CRC:Parse_Arguments:"
+						"Illegal benchmark length %s (0..%d).\n",argv[i+1],MAX_DATA_LENGTH);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Test CRC:Parse_Arguments:"
+					"Benchmark length requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-seed")==0)
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%u",&Seed);
+				if(retval != 1)
+				{
+					fprintf(stderr,"Test CRC:Parse_Arguments:"
+						"Illegal seed %s.\n",argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Test CRC:Parse_Arguments:"
+					"Seed requires a number.\n");
+				return FALSE;
+			}
+		}
+		else if(strcmp(argv[i],"-help")==0)
+		{
+			Help();
+			exit(0);
+		}
+		else
+		{
+			fprintf(stderr,"Test CRC:Parse_Arguments:argument '%s' not recognized.\n",argv[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Help routine.
+ * @see #DEFAULT_FUZZ_COUNT
+ * @see #DEFAULT_BENCHMARK_COUNT
+ * @see #DEFAULT_BENCHMARK_LENGTH
+ */
+static void Help(void)
+{
+	fprintf(stdout,"Test CRC:Help.\n");
+	fprintf(stdout,"Test CRC compares the table driven DF1 CRC routine with the bit-wise one, and times them.\n");
+	fprintf(stdout,"df1_test_crc [-fuzz_count <number>][-benchmark_count <number>]\n");
+	fprintf(stdout,"\t[-benchmark_length <number>][-seed <number>][-help]\n");
+	fprintf(stdout,"\n");
+	fprintf(stdout,"\t-fuzz_count specifies how many random blocks to compare the routines on (default %d).\n",
+		DEFAULT_FUZZ_COUNT);
+	fprintf(stdout,"\t-benchmark_count specifies how many times to compute each CRC when timing (default %d).\n",
+		DEFAULT_BENCHMARK_COUNT);
+	fprintf(stdout,"\t-benchmark_length specifies the length of the timed data in bytes (default %d).\n",
+		DEFAULT_BENCHMARK_LENGTH);
+	fprintf(stdout,"\t-seed specifies the random number seed.\n");
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
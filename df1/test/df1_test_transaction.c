@@ -0,0 +1,466 @@
+/* df1_test_transaction.c
+** $Header: /home/cjm/cvs/frodospec/df1/test/df1_test_transaction.c,v 1.1 2023-03-21 14:36:52 cjm Exp $
+ */
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "df1_general.h"
+#include "df1.h"
+#include "df1_interface.h"
+
+/**
+ * This program tests pipelined DF1 transactions, and that replies are matched to their commands by
+ * transaction number (tns) rather than by arrival order. No PLC is needed: a thread in this program plays
+ * the PLC on a loopback TCP socket. Two read commands are sent (and ACKed) before either reply is sent,
+ * then the PLC replies to the second command first. Each transaction must get the reply with its own tns
+ * and value. One of the commands uses an element number of DLE, to check DLE stuffing in both directions.
+ * @author $Author: cjm $
+ * @version $Revision: 1.1 $
+ */
+
+/* hash definitions */
+/**
+ * The number of transactions outstanding at once.
+ */
+#define TRANSACTION_COUNT       (2)
+/**
+ * The number of seconds the scripted PLC waits for data from the library before giving up.
+ */
+#define PEER_TIMEOUT_S          (5)
+/**
+ * The PLC file number the read commands use.
+ */
+#define FILE_NUMBER             (20)
+/**
+ * The PLC file type the read commands use (integer).
+ */
+#define FILE_TYPE               (0x89)
+/**
+ * The value the scripted PLC adds to the element number, to make the reply value.
+ */
+#define VALUE_OFFSET            (0x1000)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id: df1_test_transaction.c,v 1.1 2023-03-21 14:36:52 cjm Exp $";
+/**
+ * The element numbers read by each transaction.
+ * @see #TRANSACTION_COUNT
+ */
+static byte Element_List[TRANSACTION_COUNT] = {1,DLE};
+/**
+ * The listening socket the scripted PLC accepts the library's connection on.
+ */
+static int Listen_Fd = -1;
+/**
+ * Whether the scripted PLC thread completed its script successfully.
+ */
+static int Peer_Success = FALSE;
+
+/* internal routines */
+static void *Peer_Thread(void *arg);
+static int Peer_Read_Byte(int fd,byte *b);
+static int Peer_Read_Frame(int fd,byte *body,int *length);
+static int Peer_Write_Frame(int fd,byte *body,int length);
+static int Peer_Read_Response(int fd,byte expected_response);
+static int Peer_Write_Response(int fd,byte response);
+static int Peer_Reply(int fd,byte *command,int command_length);
+
+/**
+ * Main program.
+ * @param argc The number of arguments to the program.
+ * @param argv An array of argument strings.
+ * @return This function returns 0 if the program succeeds, and a positive integer if it fails.
+ * @see #Peer_Thread
+ * @see #Element_List
+ */
+int main(int argc, char *argv[])
+{
+	Df1_Interface_Handle_T *handle = NULL;
+	struct sockaddr_in address;
+	socklen_t address_length;
+	pthread_t peer_thread;
+	TMsg send_msg_list[TRANSACTION_COUNT];
+	TMsg reply;
+	int transaction_index_list[TRANSACTION_COUNT];
+	int i,port_number,retval;
+	word value;
+
+	fprintf(stdout,"Test Transaction.\n");
+	/* initialise logging */
+	Df1_Set_Log_Handler_Function(Df1_Log_Handler_Stdout);
+	Df1_Set_Log_Filter_Function(Df1_Log_Filter_Level_Bitwise);
+	Df1_Set_Log_Filter_Level(0);
+	if(argc > 1)
+		Df1_Set_Log_Filter_Level(atoi(argv[1]));
+	/* create the scripted PLC's listening socket on an ephemeral loopback port */
+	Listen_Fd = socket(AF_INET,SOCK_STREAM,0);
+	if(Listen_Fd < 0)
+	{
+		fprintf(stderr,"Test Transaction:socket failed (%d).\n",errno);
+		return 1;
+	}
+	memset(&address,0,sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	if((bind(Listen_Fd,(struct sockaddr *)&address,sizeof(address)) != 0)||(listen(Listen_Fd,1) != 0))
+	{
+		fprintf(stderr,"Test Transaction:bind/listen failed (%d).\n",errno);
+		return 1;
+	}
+	address_length = sizeof(address);
+	if(getsockname(Listen_Fd,(struct sockaddr *)&address,&address_length) != 0)
+	{
+		fprintf(stderr,"Test Transaction:getsockname failed (%d).\n",errno);
+		return 1;
+	}
+	port_number = ntohs(address.sin_port);
+	retval = pthread_create(&peer_thread,NULL,Peer_Thread,NULL);
+	if(retval != 0)
+	{
+		fprintf(stderr,"Test Transaction:pthread_create failed (%d).\n",retval);
+		return 1;
+	}
+	/* open interface */
+	if(!Df1_Interface_Handle_Create(&handle))
+	{
+		Df1_Error();
+		return 2;
+	}
+	if(!Df1_Interface_Open(DF1_INTERFACE_DEVICE_SOCKET,"127.0.0.1",port_number,handle))
+	{
+		Df1_Error();
+		return 2;
+	}
+	/* send all the commands before waiting for any replies */
+	for(i = 0; i < TRANSACTION_COUNT; i++)
+	{
+		memset(&(send_msg_list[i]),0,sizeof(TMsg));
+		send_msg_list[i].dst = DEST;
+		send_msg_list[i].src = SOURCE;
+		send_msg_list[i].cmd = 0x0F;
+		send_msg_list[i].sts = 0x00;
+		send_msg_list[i].data[0] = 0xA2;
+		send_msg_list[i].data[1] = sizeof(word);
+		send_msg_list[i].data[2] = FILE_NUMBER;
+		send_msg_list[i].data[3] = FILE_TYPE;
+		send_msg_list[i].data[4] = Element_List[i];
+		send_msg_list[i].data[5] = 0;
+		send_msg_list[i].size = 6;
+		if(!Df1_Transaction_Send(handle,&(send_msg_list[i]),&(transaction_index_list[i])))
+		{
+			Df1_Error();
+			return 3;
+		}
+		fprintf(stdout,"Test Transaction:Sent element %d with tns %d as transaction %d.\n",
+			Element_List[i],send_msg_list[i].tns,transaction_index_list[i]);
+	}
+	/* wait for the replies in send order, the PLC replies in reverse order */
+	for(i = 0; i < TRANSACTION_COUNT; i++)
+	{
+		if(!Df1_Transaction_Wait(handle,transaction_index_list[i],PEER_TIMEOUT_S*1000,&reply))
+		{
+			Df1_Error();
+			return 4;
+		}
+		memcpy(&value,reply.data,sizeof(word));
+		fprintf(stdout,"Test Transaction:Transaction %d got tns %d (sent %d) value %#x (expected %#x).\n",
+			transaction_index_list[i],reply.tns,send_msg_list[i].tns,value,VALUE_OFFSET+Element_List[i]);
+		if((reply.tns != send_msg_list[i].tns)||(reply.size != sizeof(word))||
+		   (value != VALUE_OFFSET+Element_List[i]))
+		{
+			fprintf(stderr,"Test Transaction:Transaction %d got the wrong reply.\n",
+				transaction_index_list[i]);
+			return 5;
+		}
+	}
+	/* close interface */
+	if(!Df1_Interface_Close(handle))
+	{
+		Df1_Error();
+		return 6;
+	}
+	if(!Df1_Interface_Handle_Destroy(&handle))
+	{
+		Df1_Error();
+		return 6;
+	}
+	pthread_join(peer_thread,NULL);
+	close(Listen_Fd);
+	if(Peer_Success == FALSE)
+	{
+		fprintf(stderr,"Test Transaction:The scripted PLC failed.\n");
+		return 7;
+	}
+	fprintf(stdout,"Test Transaction:Finished Test ...\n");
+	return 0;
+}
+
+/**
+ * The scripted PLC. Accept the library's connection, read and ACK all the commands, then send
+ * the replies in reverse order, checking each is ACKed. Peer_Success is set if the script completes.
+ * @param arg Not used.
+ * @return NULL.
+ * @see #Listen_Fd
+ * @see #Peer_Success
+ * @see #Peer_Read_Frame
+ * @see #Peer_Write_Response
+ * @see #Peer_Reply
+ */
+static void *Peer_Thread(void *arg)
+{
+	struct timeval timeout;
+	byte command_list[TRANSACTION_COUNT][256];
+	int command_length_list[TRANSACTION_COUNT];
+	int fd,i;
+
+	fd = accept(Listen_Fd,NULL,NULL);
+	if(fd < 0)
+	{
+		fprintf(stderr,"Test Transaction:Peer:accept failed (%d).\n",errno);
+		return NULL;
+	}
+	timeout.tv_sec = PEER_TIMEOUT_S;
+	timeout.tv_usec = 0;
+	setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+	for(i = 0; i < TRANSACTION_COUNT; i++)
+	{
+		if(!Peer_Read_Frame(fd,command_list[i],&(command_length_list[i])))
+		{
+			close(fd);
+			return NULL;
+		}
+		if(!Peer_Write_Response(fd,ACK))
+		{
+			close(fd);
+			return NULL;
+		}
+	}
+	for(i = TRANSACTION_COUNT-1; i >= 0; i--)
+	{
+		if(!Peer_Reply(fd,command_list[i],command_length_list[i]))
+		{
+			close(fd);
+			return NULL;
+		}
+		if(!Peer_Read_Response(fd,ACK))
+		{
+			close(fd);
+			return NULL;
+		}
+	}
+	close(fd);
+	Peer_Success = TRUE;
+	return NULL;
+}
+
+/**
+ * Read one byte from the library.
+ * @param fd The socket to read from.
+ * @param b The address of a byte to store the read byte in.
+ * @return TRUE on success, FALSE on failure (including a timeout).
+ */
+static int Peer_Read_Byte(int fd,byte *b)
+{
+	if(read(fd,b,1) != 1)
+	{
+		fprintf(stderr,"Test Transaction:Peer:read failed (%d).\n",errno);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Read a DLE stuffed frame from the library, and check its CRC.
+ * @param fd The socket to read from.
+ * @param body A buffer of at least 256 bytes, to store the unstuffed frame body (header and data) in.
+ * @param length The address of an integer to store the body length in.
+ * @return TRUE on success, FALSE on failure.
+ * @see #Peer_Read_Byte
+ * @see ../cdocs/df1.html#Df1_Crc_Compute
+ */
+static int Peer_Read_Frame(int fd,byte *body,int *length)
+{
+	byte c,crcb1,crcb2;
+	word crc;
+
+	if(!Peer_Read_Byte(fd,&c))
+		return FALSE;
+	if(c != DLE)
+	{
+		fprintf(stderr,"Test Transaction:Peer:Expected DLE, got %#x.\n",c);
+		return FALSE;
+	}
+	if(!Peer_Read_Byte(fd,&c))
+		return FALSE;
+	if(c != STX)
+	{
+		fprintf(stderr,"Test Transaction:Peer:Expected STX, got %#x.\n",c);
+		return FALSE;
+	}
+	(*length) = 0;
+	while(TRUE)
+	{
+		if(!Peer_Read_Byte(fd,&c))
+			return FALSE;
+		if(c == DLE)
+		{
+			if(!Peer_Read_Byte(fd,&c))
+				return FALSE;
+			if(c == ETX)
+				break;
+			if(c != DLE)
+			{
+				fprintf(stderr,"Test Transaction:Peer:Unexpected DLE %#x in frame.\n",c);
+				return FALSE;
+			}
+		}
+		if((*length) >= 255)
+		{
+			fprintf(stderr,"Test Transaction:Peer:Frame too long.\n");
+			return FALSE;
+		}
+		body[(*length)++] = c;
+	}
+	if(!Peer_Read_Byte(fd,&crcb1))
+		return FALSE;
+	if(!Peer_Read_Byte(fd,&crcb2))
+		return FALSE;
+	c = ETX;
+	crc = Df1_Crc_Compute(Df1_Crc_Compute(0,body,(*length)),&c,1);
+	if(crc != (word)(crcb1|(crcb2<<8)))
+	{
+		fprintf(stderr,"Test Transaction:Peer:CRC mismatch (%#x vs %#x).\n",crc,crcb1|(crcb2<<8));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Write a frame to the library, DLE stuffing the body and adding the CRC.
+ * @param fd The socket to write to.
+ * @param body The frame body (header and data).
+ * @param length The length of the body.
+ * @return TRUE on success, FALSE on failure.
+ * @see ../cdocs/df1.html#Df1_Crc_Compute
+ */
+static int Peer_Write_Frame(int fd,byte *body,int length)
+{
+	byte frame[2*256+6];
+	byte c;
+	word crc;
+	int i,frame_length;
+
+	frame_length = 0;
+	frame[frame_length++] = DLE;
+	frame[frame_length++] = STX;
+	for(i = 0; i < length; i++)
+	{
+		if(body[i] == DLE)
+			frame[frame_length++] = DLE;
+		frame[frame_length++] = body[i];
+	}
+	frame[frame_length++] = DLE;
+	frame[frame_length++] = ETX;
+	c = ETX;
+	crc = Df1_Crc_Compute(Df1_Crc_Compute(0,body,length),&c,1);
+	frame[frame_length++] = crc&0xff;
+	frame[frame_length++] = (crc>>8)&0xff;
+	if(write(fd,frame,frame_length) != frame_length)
+	{
+		fprintf(stderr,"Test Transaction:Peer:write failed (%d).\n",errno);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Read a response (DLE followed by ACK or NAK) from the library, and check it is the expected one.
+ * @param fd The socket to read from.
+ * @param expected_response The response we expect.
+ * @return TRUE on success, FALSE on failure.
+ * @see #Peer_Read_Byte
+ */
+static int Peer_Read_Response(int fd,byte expected_response)
+{
+	byte c1,c2;
+
+	if(!Peer_Read_Byte(fd,&c1))
+		return FALSE;
+	if(!Peer_Read_Byte(fd,&c2))
+		return FALSE;
+	if((c1 != DLE)||(c2 != expected_response))
+	{
+		fprintf(stderr,"Test Transaction:Peer:Expected response DLE %#x, got %#x %#x.\n",
+			expected_response,c1,c2);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Write a response (DLE followed by ACK or NAK) to the library.
+ * @param fd The socket to write to.
+ * @param response The response to send.
+ * @return TRUE on success, FALSE on failure.
+ */
+static int Peer_Write_Response(int fd,byte response)
+{
+	byte buff[2];
+
+	buff[0] = DLE;
+	buff[1] = response;
+	if(write(fd,buff,2) != 2)
+	{
+		fprintf(stderr,"Test Transaction:Peer:write failed (%d).\n",errno);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Reply to a read command. The reply has the command's tns, and the value is the element number read
+ * plus VALUE_OFFSET.
+ * @param fd The socket to write to.
+ * @param command The command body (dst,src,cmd,sts,tns then fnc,size,file number,file type,element number,
+ *        sub-element number).
+ * @param command_length The length of the command body.
+ * @return TRUE on success, FALSE on failure.
+ * @see #VALUE_OFFSET
+ * @see #Peer_Write_Frame
+ */
+static int Peer_Reply(int fd,byte *command,int command_length)
+{
+	byte reply[8];
+	word value;
+
+	if(command_length != 12)
+	{
+		fprintf(stderr,"Test Transaction:Peer:Command had illegal length %d.\n",command_length);
+		return FALSE;
+	}
+	value = VALUE_OFFSET+command[10];
+	reply[0] = command[1];
+	reply[1] = command[0];
+	reply[2] = command[2]|0x40;
+	reply[3] = 0;
+	reply[4] = command[4];
+	reply[5] = command[5];
+	reply[6] = value&0xff;
+	reply[7] = (value>>8)&0xff;
+	return Peer_Write_Frame(fd,reply,8);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
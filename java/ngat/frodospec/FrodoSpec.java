@@ -957,9 +957,12 @@ public class FrodoSpec
 	 * @see FrodoSpecStatus#getPropertyDouble
 	 * @see ngat.frodospec.ccd.CCDLibrary#loadTypeFromString
 	 * @see ngat.frodospec.ccd.CCDLibrary#initialise
+	 * @see ngat.frodospec.ccd.CCDLibrary#logRingStart
 	 * @see ngat.frodospec.ccd.CCDLibrary#setTextPrintLevel
 	 * @see ngat.frodospec.ccd.CCDLibrary#interfaceOpen
+	 * @see ngat.frodospec.ccd.CCDLibrary#dspDownloadSetReadbackSampleCount
 	 * @see ngat.frodospec.ccd.CCDLibrary#setup
+	 * @see ngat.frodospec.ccd.CCDLibrary#temperatureSamplerStart
 	 * @see ngat.phase2.FrodoSpecConfig#RED_ARM
 	 * @see ngat.phase2.FrodoSpecConfig#BLUE_ARM
 	 * @see FrodoSpecConstants#ARM_STRING_LIST
@@ -971,6 +974,7 @@ public class FrodoSpec
 		int deviceNumber,textPrintLevel;
 		int pciLoadType,timingLoadType,timingApplicationNumber,utilityLoadType,utilityApplicationNumber,gain;
 		int startExposureClearTime,startExposureOffsetTime,readoutRemainingTime;
+		int temperatureSamplePeriod,downloadReadbackSampleCount;
 		boolean gainSpeed,idle,enable;
 		double targetTemperature;
 		String deviceString,pciFilename,timingFilename,utilityFilename,devicePathname;
@@ -1039,6 +1043,26 @@ public class FrodoSpec
 				    FrodoSpecConstants.ARM_STRING_LIST[arm]+".config.start_exposure_offset_time");
 				readoutRemainingTime = status.getPropertyInteger("frodospec.ccd."+
 				    FrodoSpecConstants.ARM_STRING_LIST[arm]+".config.readout_remaining_time");
+				// optional background temperature sampler period (ms), 0 or missing means not used
+				if(status.getProperty("frodospec.ccd."+FrodoSpecConstants.ARM_STRING_LIST[arm]+
+						      ".config.temperature.sample_period") != null)
+				{
+					temperatureSamplePeriod = status.getPropertyInteger("frodospec.ccd."+
+					    FrodoSpecConstants.ARM_STRING_LIST[arm]+".config.temperature.sample_period");
+				}
+				else
+					temperatureSamplePeriod = 0;
+				// optional number of words read back to skip downloading an unchanged DSP program,
+				// 0 or missing means always download
+				if(status.getProperty("frodospec.ccd."+FrodoSpecConstants.ARM_STRING_LIST[arm]+
+						      ".config.dsp.download.readback_sample_count") != null)
+				{
+					downloadReadbackSampleCount = status.getPropertyInteger("frodospec.ccd."+
+					    FrodoSpecConstants.ARM_STRING_LIST[arm]+
+					    ".config.dsp.download.readback_sample_count");
+				}
+				else
+					downloadReadbackSampleCount = 0;
 			}
 			catch(CCDLibraryFormatException e)
 			{
@@ -1055,14 +1079,22 @@ public class FrodoSpec
 					else if(arm == FrodoSpecConfig.BLUE_ARM)
 						ccd = blueCCD;
 					ccd.initialise();
+					ccd.logRingStart();
 					ccd.setTextPrintLevel(textPrintLevel);
 					ccd.interfaceOpen("FrodoSpec",FrodoSpecConstants.ARM_STRING_LIST[arm],
 							  deviceNumber,devicePathname);
+					ccd.dspDownloadSetReadbackSampleCount(downloadReadbackSampleCount);
 					ccd.setup("FrodoSpec",FrodoSpecConstants.ARM_STRING_LIST[arm],
 						  pciLoadType,pciFilename,
 						  timingLoadType,timingApplicationNumber,timingFilename,
 						  utilityLoadType,utilityApplicationNumber,utilityFilename,
 						  targetTemperature,gain,gainSpeed,idle);
+					if(temperatureSamplePeriod > 0)
+					{
+						ccd.temperatureSamplerStart("FrodoSpec",
+									    FrodoSpecConstants.ARM_STRING_LIST[arm],
+									    temperatureSamplePeriod);
+					}
 					// diddly not supported yet
 					//libccd.CCDExposureSetStartExposureClearTime(startExposureClearTime);
 					//libccd.CCDExposureSetStartExposureOffsetTime(startExposureOffsetTime);
@@ -1211,6 +1243,7 @@ public class FrodoSpec
 	 * Method to shut down the connection to the hardware controllers.
 	 * <ul>
 	 * <li>The CCD setup is shutdown (memory map), and the interface closed.
+	 * <li>The C layer log ring is stopped, after logging any queued messages.
 	 * </ul>
 	 * @exception CCDLibraryNativeException Thrown if the device failed to shut down.
 	 * @see #status
@@ -1219,6 +1252,7 @@ public class FrodoSpec
 	 * @see FrodoSpecStatus#getPropertyBoolean
 	 * @see ngat.frodospec.ccd.CCDLibrary#setupShutdown
 	 * @see ngat.frodospec.ccd.CCDLibrary#interfaceClose
+	 * @see ngat.frodospec.ccd.CCDLibrary#logRingStop
 	 */
 	public void shutdownCCDController() throws CCDLibraryNativeException
 	{
@@ -1236,6 +1270,8 @@ public class FrodoSpec
 			blueCCD.setupShutdown("FrodoSpec","blue");
 			blueCCD.interfaceClose("FrodoSpec","blue");
 		}
+		// the log ring is shared by both arms, stop it once both are shut down
+		redCCD.logRingStop();
 	}
 
 	/**
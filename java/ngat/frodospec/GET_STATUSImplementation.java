@@ -161,23 +161,25 @@ public class GET_STATUSImplementation extends INTERRUPTImplementation implements
 	 *      <li><b>&lt;arm&gt;.Setup Status</b> Whether the camera has been setup sufficiently for 
 	 *          exposures to be taken (from libccd, not the camera hardware).
 	 *      <li><b>&lt;arm&gt;.Exposure Start Time, &lt;arm&gt;.Exposure Length</b> The exposure start time, 
-	 *          and the length of the current (or last) exposure.
+	 *          and the length of the current (or last) exposure, and its progress (see 
+	 *          getExposureProgressStatus).
 	 *      <li><b>&lt;arm&gt;.Exposure Count, &lt;arm&gt;.Exposure Number</b> How many exposures the 
 	 *          current command has taken and how many it will do in total (from the status object).
 	 * </ul>
-	 * If the command requests a <b>INTERMEDIATE</b> level status, getIntermediateStatus is called.
+	 * If the command requests a <b>INTERMEDIATE</b> level status, getIntermediateStatus and getMetricsStatus
+	 * are called.
 	 * If the command requests a <b>FULL</b> level status, getFullStatus is called.
 	 * An object of class GET_STATUS_DONE is returned, with the information retrieved.
 	 * @see #status
 	 * @see #hashTable
 	 * @see #getCurrentMode
 	 * @see #getIntermediateStatus
+	 * @see #getMetricsStatus
+	 * @see #getExposureProgressStatus
 	 * @see #getFullStatus
 	 * @see #ccdList
 	 * @see FrodoSpecStatus#getCurrentCommand
 	 * @see ngat.frodospec.ccd.CCDLibrary#getExposureStatus
-	 * @see ngat.frodospec.ccd.CCDLibrary#getExposureLength
-	 * @see ngat.frodospec.ccd.CCDLibrary#getExposureStartTime
 	 * @see ngat.frodospec.ccd.CCDLibrary#getNCols
 	 * @see ngat.frodospec.ccd.CCDLibrary#getNRows
 	 * @see ngat.frodospec.ccd.CCDLibrary#getXBin
@@ -269,10 +271,7 @@ public class GET_STATUSImplementation extends INTERRUPTImplementation implements
 				      new Integer(ccdList[arm].setupGetWindowFlags()));
 			hashTable.put(FrodoSpecConstants.ARM_STRING_LIST[arm]+".Setup Status",
 				      new Boolean(ccdList[arm].getSetupComplete()));
-			hashTable.put(FrodoSpecConstants.ARM_STRING_LIST[arm]+".Exposure Length",
-				      new Integer(ccdList[arm].getExposureLength()));
-			hashTable.put(FrodoSpecConstants.ARM_STRING_LIST[arm]+".Exposure Start Time",
-				      new Long(ccdList[arm].getExposureStartTime()));
+			getExposureProgressStatus(arm);
 			hashTable.put(FrodoSpecConstants.ARM_STRING_LIST[arm]+".Exposure Count",
 				      new Integer(status.getExposureCount(arm)));
 			hashTable.put(FrodoSpecConstants.ARM_STRING_LIST[arm]+".Exposure Number",
@@ -289,6 +288,7 @@ public class GET_STATUSImplementation extends INTERRUPTImplementation implements
 			frodospec.log(Logger.VERBOSITY_VERBOSE,"GET_STATUS",null,
 				      this.getClass().getName()+":processCommand:Getting intermediate status.");
 			getIntermediateStatus();
+			getMetricsStatus();
 		}// end if intermediate level status
 	// Get full status information.
 		if(getStatusCommand.getLevel() >= GET_STATUS.LEVEL_FULL)
@@ -404,6 +404,73 @@ public class GET_STATUSImplementation extends INTERRUPTImplementation implements
 		return currentMode;
 	}
 
+	/**
+	 * Method to get the exposure progress of an arm. This uses a single status snapshot from the C layer,
+	 * so the values are consistent with each other, and does not talk to the controller.
+	 * The following data is put into the hashTable:
+	 * <ul>
+	 * <li><b>&lt;arm&gt;.Exposure Length</b> The length of the current (or last) exposure, in milliseconds.
+	 * <li><b>&lt;arm&gt;.Exposure Start Time</b> The start time of the current (or last) exposure, 
+	 *     in milliseconds since 1970.
+	 * <li><b>&lt;arm&gt;.Exposure Progress.Elapsed Time</b> How much of the exposure has elapsed, 
+	 *     in milliseconds, as of the update time.
+	 * <li><b>&lt;arm&gt;.Exposure Progress.Readout Percentage</b> How much of the readout has completed, 
+	 *     as of the update time.
+	 * <li><b>&lt;arm&gt;.Exposure Progress.Predicted End Time</b> When the readout is predicted to finish,
+	 *     in milliseconds since 1970, or zero if this cannot be predicted yet.
+	 * <li><b>&lt;arm&gt;.Exposure Progress.Update Time</b> When the progress was last updated, 
+	 *     in milliseconds since 1970.
+	 * </ul>
+	 * @param arm Which arm in ccdList to query. One of RED_ARM or BLUE_ARM.
+	 * @see #hashTable
+	 * @see #ccdList
+	 * @see ngat.frodospec.ccd.CCDLibrary#getExposureStatusSnapshot
+	 * @see ngat.frodospec.ccd.CCDLibrary#EXPOSURE_SNAPSHOT_LENGTH
+	 * @see ngat.frodospec.ccd.CCDLibrary#EXPOSURE_SNAPSHOT_START_TIME
+	 * @see ngat.frodospec.ccd.CCDLibrary#EXPOSURE_SNAPSHOT_ELAPSED_TIME
+	 * @see ngat.frodospec.ccd.CCDLibrary#EXPOSURE_SNAPSHOT_READOUT_PIXEL_COUNT
+	 * @see ngat.frodospec.ccd.CCDLibrary#EXPOSURE_SNAPSHOT_EXPECTED_PIXEL_COUNT
+	 * @see ngat.frodospec.ccd.CCDLibrary#EXPOSURE_SNAPSHOT_PREDICTED_END_TIME
+	 * @see ngat.frodospec.ccd.CCDLibrary#EXPOSURE_SNAPSHOT_UPDATE_TIME
+	 * @see FrodoSpecConstants#ARM_STRING_LIST
+	 */
+	private void getExposureProgressStatus(int arm)
+	{
+		String keyPrefix = null;
+		long snapshotList[] = null;
+		double readoutPercentage;
+
+		try
+		{
+			snapshotList = ccdList[arm].getExposureStatusSnapshot();
+		}
+		catch(CCDLibraryNativeException e)
+		{
+			frodospec.error(this.getClass().getName()+":getExposureProgressStatus:Get snapshot failed for arm "+
+					FrodoSpecConstants.ARM_STRING_LIST[arm]+".",e);
+			return;
+		}
+		keyPrefix = FrodoSpecConstants.ARM_STRING_LIST[arm]+".";
+		hashTable.put(keyPrefix+"Exposure Length",
+			      new Integer((int)(snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_LENGTH])));
+		hashTable.put(keyPrefix+"Exposure Start Time",
+			      new Long(snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_START_TIME]));
+		if(snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_EXPECTED_PIXEL_COUNT] > 0)
+		{
+			readoutPercentage = (100.0*((double)snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_READOUT_PIXEL_COUNT]))/
+				((double)snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_EXPECTED_PIXEL_COUNT]);
+		}
+		else
+			readoutPercentage = 0.0;
+		hashTable.put(keyPrefix+"Exposure Progress.Elapsed Time",
+			      new Integer((int)(snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_ELAPSED_TIME])));
+		hashTable.put(keyPrefix+"Exposure Progress.Readout Percentage",new Double(readoutPercentage));
+		hashTable.put(keyPrefix+"Exposure Progress.Predicted End Time",
+			      new Long(snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_PREDICTED_END_TIME]));
+		hashTable.put(keyPrefix+"Exposure Progress.Update Time",
+			      new Long(snapshotList[CCDLibrary.EXPOSURE_SNAPSHOT_UPDATE_TIME]));
+	}
+
 	/**
 	 * Routine to get status, when level INTERMEDIATE has been selected.
 	 * Intermediate level status is usually useful data which can only be retrieved by querying the
@@ -1187,6 +1254,92 @@ public class GET_STATUSImplementation extends INTERRUPTImplementation implements
 			      GET_STATUS_DONE.KEYWORD_INSTRUMENT_STATUS+":"+instrumentStatus+".");
 	}
 
+	/**
+	 * Method to get the CCD library metrics for each arm, when level INTERMEDIATE has been selected.
+	 * The metrics are kept in the C layer with atomic counters, so getting them does not talk to the
+	 * controller, and they can be retrieved whilst an arm is reading out. All times are in nanoseconds.
+	 * The following data is put into the hashTable, for each arm:
+	 * <ul>
+	 * <li><b>&lt;arm&gt;.Metrics.Ioctl.&lt;request&gt;.Count, .Total Time, .Max Time</b> The number of each
+	 *     type of ioctl request sent to the controller, and how long they took. Requests that have not
+	 *     been sent are not added.
+	 * <li><b>&lt;arm&gt;.Metrics.&lt;timer&gt;.Count, .Total Time, .Max Time</b> The DSP mutex wait and
+	 *     hold times, readout, de-interlace and save times.
+	 * <li><b>&lt;arm&gt;.Metrics.Readout Bytes, &lt;arm&gt;.Metrics.Readout Timeouts</b> The number of bytes
+	 *     read out, and the number of readouts that have timed out.
+	 * <li><b>&lt;arm&gt;.Metrics.Readout Rate</b> The average readout rate, in bytes per second.
+	 * </ul>
+	 * @see #hashTable
+	 * @see #ccdList
+	 * @see ngat.frodospec.ccd.CCDLibrary#getMetrics
+	 * @see ngat.frodospec.ccd.CCDLibrary#METRICS_IOCTL_COUNT
+	 * @see ngat.frodospec.ccd.CCDLibrary#METRICS_TIMER_COUNT
+	 * @see ngat.frodospec.ccd.CCDLibrary#METRICS_COUNTER_COUNT
+	 * @see ngat.frodospec.ccd.CCDLibrary#METRICS_IOCTL_NAME_LIST
+	 * @see ngat.frodospec.ccd.CCDLibrary#METRICS_TIMER_NAME_LIST
+	 * @see ngat.frodospec.ccd.CCDLibrary#METRICS_COUNTER_NAME_LIST
+	 * @see FrodoSpecConstants#ARM_STRING_LIST
+	 */
+	private void getMetricsStatus()
+	{
+		String keyPrefix = null;
+		long metricsList[] = null;
+		long readoutBytes,readoutTime;
+		int index;
+
+		for(int arm = FrodoSpecConfig.RED_ARM; arm <= FrodoSpecConfig.BLUE_ARM; arm++)
+		{
+			try
+			{
+				metricsList = ccdList[arm].getMetrics();
+			}
+			catch(CCDLibraryNativeException e)
+			{
+				frodospec.error(this.getClass().getName()+":getMetricsStatus:Get Metrics failed for arm "+
+						FrodoSpecConstants.ARM_STRING_LIST[arm]+".",e);
+				continue;
+			}
+			keyPrefix = FrodoSpecConstants.ARM_STRING_LIST[arm]+".Metrics.";
+			index = 0;
+			for(int i = 0; i < CCDLibrary.METRICS_IOCTL_COUNT; i++)
+			{
+				if(metricsList[index] > 0)
+				{
+					hashTable.put(keyPrefix+"Ioctl."+CCDLibrary.METRICS_IOCTL_NAME_LIST[i]+".Count",
+						      new Long(metricsList[index]));
+					hashTable.put(keyPrefix+"Ioctl."+CCDLibrary.METRICS_IOCTL_NAME_LIST[i]+".Total Time",
+						      new Long(metricsList[index+1]));
+					hashTable.put(keyPrefix+"Ioctl."+CCDLibrary.METRICS_IOCTL_NAME_LIST[i]+".Max Time",
+						      new Long(metricsList[index+2]));
+				}
+				index += 3;
+			}
+			for(int i = 0; i < CCDLibrary.METRICS_TIMER_COUNT; i++)
+			{
+				hashTable.put(keyPrefix+CCDLibrary.METRICS_TIMER_NAME_LIST[i]+".Count",
+					      new Long(metricsList[index]));
+				hashTable.put(keyPrefix+CCDLibrary.METRICS_TIMER_NAME_LIST[i]+".Total Time",
+					      new Long(metricsList[index+1]));
+				hashTable.put(keyPrefix+CCDLibrary.METRICS_TIMER_NAME_LIST[i]+".Max Time",
+					      new Long(metricsList[index+2]));
+				index += 3;
+			}
+			for(int i = 0; i < CCDLibrary.METRICS_COUNTER_COUNT; i++)
+			{
+				hashTable.put(keyPrefix+CCDLibrary.METRICS_COUNTER_NAME_LIST[i],new Long(metricsList[index]));
+				index++;
+			}
+			// readout rate in bytes per second, from the Readout Bytes counter and total Readout time
+			readoutBytes = ((Long)hashTable.get(keyPrefix+"Readout Bytes")).longValue();
+			readoutTime = ((Long)hashTable.get(keyPrefix+"Readout.Total Time")).longValue();
+			if(readoutTime > 0)
+			{
+				hashTable.put(keyPrefix+"Readout Rate",
+					      new Double(((double)readoutBytes)*1.0e9/((double)readoutTime)));
+			}
+		}
+	}
+
 	/**
 	 * Method to get misc status, when level FULL has been selected.
 	 * The following data is put into the hashTable:
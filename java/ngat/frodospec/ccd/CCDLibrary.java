@@ -123,6 +123,97 @@ public class CCDLibrary
 	 * @see #getExposureStatus
 	 */
 	public final static int EXPOSURE_STATUS_POST_READOUT       = 6;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the exposure status.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_STATUS               = 0;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the exposure length, in milliseconds.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_LENGTH               = 1;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the exposure start time, 
+	 * in milliseconds since 1970.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_START_TIME           = 2;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the elapsed exposure time, in milliseconds.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_ELAPSED_TIME         = 3;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the number of pixels read out.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_READOUT_PIXEL_COUNT  = 4;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the number of pixels the readout will produce.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_EXPECTED_PIXEL_COUNT = 5;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the predicted readout end time, 
+	 * in milliseconds since 1970, or zero if it cannot be predicted.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_PREDICTED_END_TIME   = 6;
+	/**
+	 * Index in the array returned by getExposureStatusSnapshot of the time the progress was last updated, 
+	 * in milliseconds since 1970.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_UPDATE_TIME          = 7;
+	/**
+	 * The length of the array returned by getExposureStatusSnapshot.
+	 * @see #getExposureStatusSnapshot
+	 */
+	public final static int EXPOSURE_SNAPSHOT_COUNT                = 8;
+// ccd_global.h
+	/* These constants should be the same as those in ccd_global.h */
+	/**
+	 * The number of ioctl requests metrics are returned for by getMetrics.
+	 * @see #getMetrics
+	 * @see #METRICS_IOCTL_NAME_LIST
+	 */
+	public final static int METRICS_IOCTL_COUNT =		16;
+	/**
+	 * The number of timers returned by getMetrics.
+	 * @see #getMetrics
+	 * @see #METRICS_TIMER_NAME_LIST
+	 */
+	public final static int METRICS_TIMER_COUNT =		8;
+	/**
+	 * The number of counters returned by getMetrics.
+	 * @see #getMetrics
+	 * @see #METRICS_COUNTER_NAME_LIST
+	 */
+	public final static int METRICS_COUNTER_COUNT =		2;
+	/**
+	 * The names of the ioctl requests metrics are returned for by getMetrics, in the order they are returned.
+	 * The last entry counts any other request.
+	 * @see #getMetrics
+	 * @see #METRICS_IOCTL_COUNT
+	 */
+	public final static String METRICS_IOCTL_NAME_LIST[] = {"GET_HCTR","GET_PROGRESS","GET_DMA_ADDR","GET_HSTR",
+		"HCVR_DATA","SET_HCTR","SET_HCVR","PCI_DOWNLOAD","PCI_DOWNLOAD_WAIT","COMMAND","SET_CMDR",
+		"SET_DESTINATION","SET_IMAGE_BUFFERS","SET_UTIL_OPTIONS","ABORT_READ","OTHER"};
+	/**
+	 * The names of the timers returned by getMetrics, in the order they are returned.
+	 * @see #getMetrics
+	 * @see #METRICS_TIMER_COUNT
+	 */
+	public final static String METRICS_TIMER_NAME_LIST[] = {"DSP Mutex Wait","DSP Mutex Hold","Readout",
+								"DeInterlace","Save","DSP Wait Housekeeping","DSP Wait Normal",
+								"DSP Wait Exposure"};
+	/**
+	 * The names of the counters returned by getMetrics, in the order they are returned.
+	 * @see #getMetrics
+	 * @see #METRICS_COUNTER_COUNT
+	 */
+	public final static String METRICS_COUNTER_NAME_LIST[] = {"Readout Bytes","Readout Timeouts"};
 // ccd_interface.h
 	/* These constants should be the same as those in ccd_interface.h */
 	/**
@@ -229,6 +320,19 @@ public class CCDLibrary
 	 * @param source A string representing the source used for logging messages as a result of this operation. 
 	 */
 	private native int CCD_DSP_Command_RET(String clazz,String source);
+// ccd_dsp_download.h
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that sets how many words are read back from a
+	 * timing or utility board, to decide whether a DSP program download can be skipped.
+	 * @param sampleCount The number of words to read back, zero to always download.
+	 * @exception CCDLibraryNativeException This routine throws a CCDLibraryNativeException if it failed.
+	 */
+	private native void CCD_DSP_Download_Set_Readback_Sample_Count(int sampleCount) 
+		throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that empties the DSP program image cache.
+	 */
+	private native void CCD_DSP_Download_Cache_Clear();
 // ccd_exposure.h
 	/**
 	 * Native wrapper to libfrodospec_ccd routine that does an exposure.
@@ -267,6 +371,32 @@ public class CCDLibrary
 	 * in milliseconds since 1970.
 	 */
 	private native long CCD_Exposure_Get_Exposure_Start_Time();
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that returns a consistent snapshot of the exposure status.
+	 * @exception CCDLibraryNativeException This routine throws a CCDLibraryNativeException if it failed.
+	 * @see #getExposureStatusSnapshot
+	 */
+	private native long[] CCD_Exposure_Get_Status_Snapshot() throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that sets whether exposures are saved asynchronously,
+	 * by the C layer's FITS writer thread.
+	 * @param value True to save exposures asynchronously, false to save them before expose returns.
+	 * @exception CCDLibraryNativeException This routine throws a CCDLibraryNativeException if it failed.
+	 */
+	private native void CCD_Exposure_Set_Async_Save(boolean value) throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that returns whether exposures are saved asynchronously.
+	 */
+	private native boolean CCD_Exposure_Get_Async_Save();
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that waits until all asynchronously saved exposures
+	 * have been written to disk.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @exception CCDLibraryNativeException This routine throws a CCDLibraryNativeException if it failed,
+	 *            or any of the exposures failed to save.
+	 */
+	private native void CCD_Exposure_Save_Wait(String clazz,String source) throws CCDLibraryNativeException;
 // ccd_global.h
 	/**
 	 * Native wrapper to libfrodospec_ccd routine that sets up the CCD library for use.
@@ -276,6 +406,37 @@ public class CCDLibrary
 	 * Native wrapper to libfrodospec_ccd routine that changes the log Filter Level.
 	 */
 	private native void CCD_Global_Set_Log_Filter_Level(int level);
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that starts the log ring thread.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 */
+	private native void CCD_Global_Log_Ring_Start() throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that stops the log ring thread.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 */
+	private native void CCD_Global_Log_Ring_Stop() throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that returns the number of log messages dropped
+	 * because the log ring was full.
+	 */
+	private native int CCD_Global_Log_Ring_Get_Dropped_Count();
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that returns the error number of the last error generated
+	 * in the calling thread.
+	 */
+	private native int CCD_Global_Get_Error_Number();
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that returns a description of the last error generated
+	 * in the calling thread.
+	 */
+	private native String CCD_Global_Error_String();
+	/**
+	 * Native wrapper to libfrodospec_ccd routines that return a snapshot of this instance's metrics.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #getMetrics
+	 */
+	private native long[] CCD_Global_Metrics_Get() throws CCDLibraryNativeException;
 // ccd_interface.h
 	/**
 	 * Native wrapper to libfrodospec_ccd routine that opens the selected interface device.
@@ -443,6 +604,30 @@ public class CCDLibrary
 	 */
 	private native int CCD_Temperature_Get_Heater_ADU(String clazz,String source) 
 		throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that sets the dewar temperature sensor calibration data.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 */
+	private native void CCD_Temperature_Set_Calibration(String clazz,String source,double coeffList[],
+		double vUpper,double vLower,double aduPerVolt,int aduOffset) throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that starts the background temperature sampler.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 */
+	private native void CCD_Temperature_Sampler_Start(String clazz,String source,int samplePeriod) 
+		throws CCDLibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_ccd routine that stops the background temperature sampler.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 */
+	private native void CCD_Temperature_Sampler_Stop(String clazz,String source) 
+		throws CCDLibraryNativeException;
 // ccd_text.h
 	/**
 	 * Native wrapper to libfrodospec_ccd routine that sets the amount of output from the text interface.
@@ -465,6 +650,12 @@ public class CCDLibrary
 	 * The logger to log messages to.
 	 */
 	protected Logger logger = null;
+	/**
+	 * The listener to tell when an asynchronously saved exposure has been written to disk.
+	 * @see #setSaveListener
+	 * @see #saveCallback
+	 */
+	protected CCDLibrarySaveListener saveListener = null;
 
 // static code block
 	/**
@@ -512,6 +703,32 @@ public class CCDLibrary
 		return CCD_DSP_Command_RET(clazz,source);
 	}
 
+// ccd_dsp_download.h
+	/**
+	 * Routine to set how many words are read back from the timing and utility boards before a DSP program
+	 * is downloaded from a file during setup. If all the sampled words match the program, the board already
+	 * holds it and the download is skipped. The words that are not sampled are not checked, so this should 
+	 * only be enabled when the DSP program files are known not to have changed since the boards were loaded.
+	 * The setting applies to the controller this CCDLibrary instance is connected to.
+	 * @param sampleCount The number of words to read back, zero (the default) to always download.
+	 * @exception CCDLibraryNativeException This routine throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_DSP_Download_Set_Readback_Sample_Count
+	 */
+	public void dspDownloadSetReadbackSampleCount(int sampleCount) throws CCDLibraryNativeException
+	{
+		CCD_DSP_Download_Set_Readback_Sample_Count(sampleCount);
+	}
+
+	/**
+	 * Routine to empty the DSP program image cache. DSP program files are normally only parsed again
+	 * when they are modified, this forces them to be parsed on the next download.
+	 * @see #CCD_DSP_Download_Cache_Clear
+	 */
+	public void dspDownloadCacheClear()
+	{
+		CCD_DSP_Download_Cache_Clear();
+	}
+
 	/**
 	 * Routine to parse a gain string and return a gain number suitable for input into
 	 * <a href="#setupStartup">setupStartup</a>, or a DSP Set Gain (SGN) command. 
@@ -702,6 +919,93 @@ public class CCDLibrary
 		return CCD_Exposure_Get_Exposure_Start_Time();
 	}
 
+	/**
+	 * Method to get a consistent snapshot of the exposure status: all the values come from the same update
+	 * by the thread taking the exposure. This does not talk to the controller, or wait for the 
+	 * controller access lock, so can be called as often as required.
+	 * @return An array of longs, of length EXPOSURE_SNAPSHOT_COUNT, indexed by the EXPOSURE_SNAPSHOT_ constants.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_Exposure_Get_Status_Snapshot
+	 * @see #EXPOSURE_SNAPSHOT_STATUS
+	 * @see #EXPOSURE_SNAPSHOT_LENGTH
+	 * @see #EXPOSURE_SNAPSHOT_START_TIME
+	 * @see #EXPOSURE_SNAPSHOT_ELAPSED_TIME
+	 * @see #EXPOSURE_SNAPSHOT_READOUT_PIXEL_COUNT
+	 * @see #EXPOSURE_SNAPSHOT_EXPECTED_PIXEL_COUNT
+	 * @see #EXPOSURE_SNAPSHOT_PREDICTED_END_TIME
+	 * @see #EXPOSURE_SNAPSHOT_UPDATE_TIME
+	 * @see #EXPOSURE_SNAPSHOT_COUNT
+	 */
+	public long[] getExposureStatusSnapshot() throws CCDLibraryNativeException
+	{
+		return CCD_Exposure_Get_Status_Snapshot();
+	}
+
+	/**
+	 * Method to set whether exposures are saved asynchronously. When true, expose and bias return
+	 * once the image has been read out and processed, and the C layer's FITS writer thread saves it to disk.
+	 * The save listener is told when each image has been saved.
+	 * @param value True to save exposures asynchronously, false to save them before expose returns.
+	 * @exception CCDLibraryNativeException This routine throws a CCDLibraryNativeException if 
+	 *            CCD_Exposure_Set_Async_Save failed.
+	 * @see #CCD_Exposure_Set_Async_Save
+	 * @see #setSaveListener
+	 * @see #saveWait
+	 */
+	public void setAsyncSave(boolean value) throws CCDLibraryNativeException
+	{
+		CCD_Exposure_Set_Async_Save(value);
+	}
+
+	/**
+	 * Method to get whether exposures are saved asynchronously.
+	 * @return True if exposures are saved asynchronously.
+	 * @see #CCD_Exposure_Get_Async_Save
+	 */
+	public boolean getAsyncSave()
+	{
+		return CCD_Exposure_Get_Async_Save();
+	}
+
+	/**
+	 * Method to wait until all asynchronously saved exposures have been written to disk.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @exception CCDLibraryNativeException This routine throws a CCDLibraryNativeException if 
+	 *            CCD_Exposure_Save_Wait failed, or any of the exposures failed to save.
+	 * @see #CCD_Exposure_Save_Wait
+	 */
+	public void saveWait(String clazz,String source) throws CCDLibraryNativeException
+	{
+		CCD_Exposure_Save_Wait(clazz,source);
+	}
+
+	/**
+	 * Method to set the listener told when an asynchronously saved exposure has been written to disk.
+	 * @param l The listener, or null to stop listening.
+	 * @see #saveListener
+	 */
+	public void setSaveListener(CCDLibrarySaveListener l)
+	{
+		saveListener = l;
+	}
+
+	/**
+	 * Method called from the JNI layer by the C layer's FITS writer thread, after each asynchronously
+	 * saved image. It is passed on to the save listener, if one has been set.
+	 * @param filename The filename of the saved image.
+	 * @param successful True if the image was saved successfully.
+	 * @param errorString A description of why the image failed to save, empty if it succeeded.
+	 * @see #saveListener
+	 */
+	private void saveCallback(String filename,boolean successful,String errorString)
+	{
+		CCDLibrarySaveListener l = saveListener;
+
+		if(l != null)
+			l.saveCompleted(filename,successful,errorString);
+	}
+
 // ccd_global.h
 	/**
 	 * Routine that sets up all the parts of CCDLibrary at the start of it's use. This routine should be
@@ -723,6 +1027,90 @@ public class CCDLibrary
 		CCD_Global_Set_Log_Filter_Level(level);
 	}
 
+	/**
+	 * Routine to start the libfrodospec_ccd log ring. Log messages generated by the C layer are then filtered
+	 * and queued by the thread that generated them (without formatting or calling back into Java), and
+	 * formatted and passed to the logger by a separate thread. This stops verbose logging slowing down 
+	 * time critical operations such as image readout. The log ring is shared by all CCDLibrary instances,
+	 * calling this method when it is already running does nothing.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_Global_Log_Ring_Start
+	 */
+	public void logRingStart() throws CCDLibraryNativeException
+	{
+		CCD_Global_Log_Ring_Start();
+	}
+
+	/**
+	 * Routine to stop the libfrodospec_ccd log ring. Any queued log messages are logged first.
+	 * C layer log messages are then passed to the logger by the thread that generated them.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_Global_Log_Ring_Stop
+	 */
+	public void logRingStop() throws CCDLibraryNativeException
+	{
+		CCD_Global_Log_Ring_Stop();
+	}
+
+	/**
+	 * Routine to get the number of C layer log messages dropped because the log ring was full.
+	 * @return The number of dropped log messages.
+	 * @see #CCD_Global_Log_Ring_Get_Dropped_Count
+	 */
+	public int getLogRingDroppedCount()
+	{
+		return CCD_Global_Log_Ring_Get_Dropped_Count();
+	}
+
+	/**
+	 * Routine to get a snapshot of the libfrodospec_ccd metrics for this instance (i.e. this arm's handle).
+	 * The metrics are kept with atomic counters in the C layer, so this can be called whilst an exposure 
+	 * is in progress. All times are in nanoseconds. The returned array contains, in order:
+	 * <ul>
+	 * <li>For each of the METRICS_IOCTL_COUNT ioctl requests (named in METRICS_IOCTL_NAME_LIST), 
+	 *     the number of requests sent, the total time they took and the longest time one took.
+	 * <li>For each of the METRICS_TIMER_COUNT timers (named in METRICS_TIMER_NAME_LIST), 
+	 *     the number of times it was timed, the total time and the longest time.
+	 * <li>The METRICS_COUNTER_COUNT counters (named in METRICS_COUNTER_NAME_LIST).
+	 * </ul>
+	 * @return An array of 3*(METRICS_IOCTL_COUNT+METRICS_TIMER_COUNT)+METRICS_COUNTER_COUNT longs.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_Global_Metrics_Get
+	 * @see #METRICS_IOCTL_COUNT
+	 * @see #METRICS_TIMER_COUNT
+	 * @see #METRICS_COUNTER_COUNT
+	 * @see #METRICS_IOCTL_NAME_LIST
+	 * @see #METRICS_TIMER_NAME_LIST
+	 * @see #METRICS_COUNTER_NAME_LIST
+	 */
+	public long[] getMetrics() throws CCDLibraryNativeException
+	{
+		return CCD_Global_Metrics_Get();
+	}
+
+	/**
+	 * Routine to get the error number of the last error generated by libfrodospec_ccd.
+	 * The C layer's error state is per thread, so this is the last error generated by a call made from
+	 * the calling thread: a red arm thread will not see errors generated by the blue arm, and vice versa.
+	 * @return The error number, or zero if the calling thread has not generated an error.
+	 * @see #CCD_Global_Get_Error_Number
+	 */
+	public int getErrorNumber()
+	{
+		return CCD_Global_Get_Error_Number();
+	}
+
+	/**
+	 * Routine to get a description of the last error generated by libfrodospec_ccd, in the calling thread.
+	 * @return The error string.
+	 * @see #CCD_Global_Error_String
+	 * @see #getErrorNumber
+	 */
+	public String getErrorString()
+	{
+		return CCD_Global_Error_String();
+	}
+
 // ccd_interface.h
 	/**
 	 * Routine to open the interface. 
@@ -1198,6 +1586,54 @@ public class CCDLibrary
 		return CCD_Temperature_Get_Heater_ADU(clazz,source);
 	}
 
+	/**
+	 * Routine to set the calibration data used to convert the dewar temperature sensor ADU to a 
+	 * temperature. Each controller (arm) has it's own calibration data, which defaults to the
+	 * original sensor's calibration.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @param coeffList A list of Chebychev coefficients, with between 1 and 11 elements.
+	 * @param vUpper The upper voltage limit of the sensor.
+	 * @param vLower The lower voltage limit of the sensor.
+	 * @param aduPerVolt The number of ADUs per volt.
+	 * @param aduOffset The ADU offset.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_Temperature_Set_Calibration
+	 */
+	public void temperatureSetCalibration(String clazz,String source,double coeffList[],double vUpper,
+		double vLower,double aduPerVolt,int aduOffset) throws CCDLibraryNativeException
+	{
+		CCD_Temperature_Set_Calibration(clazz,source,coeffList,vUpper,vLower,aduPerVolt,aduOffset);
+	}
+
+	/**
+	 * Routine to start the background temperature sampler. Whilst the sampler is running, temperatureGet
+	 * returns a rolling average of the sampled temperature without talking to the controller.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @param samplePeriod The time between samples, in milliseconds.
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_Temperature_Sampler_Start
+	 * @see #temperatureGet
+	 */
+	public void temperatureSamplerStart(String clazz,String source,int samplePeriod) 
+		throws CCDLibraryNativeException
+	{
+		CCD_Temperature_Sampler_Start(clazz,source,samplePeriod);
+	}
+
+	/**
+	 * Routine to stop the background temperature sampler. The sampler is also stopped by interfaceClose.
+	 * @param clazz A string representing the class used for logging messages as a result of this operation. 
+	 * @param source A string representing the source used for logging messages as a result of this operation. 
+	 * @exception CCDLibraryNativeException This method throws a CCDLibraryNativeException if it failed.
+	 * @see #CCD_Temperature_Sampler_Stop
+	 */
+	public void temperatureSamplerStop(String clazz,String source) throws CCDLibraryNativeException
+	{
+		CCD_Temperature_Sampler_Stop(clazz,source);
+	}
+
 // ccd_text.h
 	/**
 	 * Routine thats set the amount of information displayed when the text interface device
@@ -14,6 +14,10 @@ public class CCDLibraryNativeException extends Exception
 	 * Revision Control System id string, showing the version of the Class
 	 */
 	public final static String RCSID = new String("$Id: CCDLibraryNativeException.java,v 1.1 2008-11-20 11:34:28 cjm Exp $");
+	/**
+	 * The libfrodospec_ccd error number of the error that caused this exception, or zero if it is not known.
+	 */
+	protected int errorNumber = 0;
 
 	/**
 	 * Constructor for the exception.
@@ -25,13 +29,28 @@ public class CCDLibraryNativeException extends Exception
 	}
 
 	/**
-	 * Constructor for the exception. Used from C JNI interface.
+	 * Constructor for the exception. Used from C JNI interface. This is constructed in the thread that
+	 * made the failing call, so the (thread local) libfrodospec_ccd error number is retrieved here.
 	 * @param errorString The error string.
 	 * @param libfrodospec_ccd The libccd instance that caused this excecption.
+	 * @see #errorNumber
+	 * @see CCDLibrary#getErrorNumber
 	 */
 	public CCDLibraryNativeException(String errorString,CCDLibrary libfrodospec_ccd)
 	{
 		super(errorString);
+		if(libfrodospec_ccd != null)
+			errorNumber = libfrodospec_ccd.getErrorNumber();
+	}
+
+	/**
+	 * Method to get the libfrodospec_ccd error number of the error that caused this exception.
+	 * @return The error number, or zero if it is not known.
+	 * @see #errorNumber
+	 */
+	public int getErrorNumber()
+	{
+		return errorNumber;
 	}
 }
 
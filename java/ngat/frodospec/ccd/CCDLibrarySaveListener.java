@@ -0,0 +1,27 @@
+// CCDLibrarySaveListener.java -*- mode: Fundamental;-*-
+// $Header$
+package ngat.frodospec.ccd;
+
+/**
+ * This interface is implemented by classes that want to be told when an exposure, saved asynchronously by
+ * the C layer's FITS writer thread, has been written to disk.
+ * @author Chris Mottram
+ * @version $Revision$
+ * @see CCDLibrary#setSaveListener
+ * @see CCDLibrary#setAsyncSave
+ */
+public interface CCDLibrarySaveListener
+{
+	/**
+	 * Method called after each asynchronously saved image has been written to disk (or failed to be).
+	 * This is called from the C layer's FITS writer thread, so implementations should return quickly.
+	 * @param filename The filename of the saved image.
+	 * @param successful True if the image was saved successfully.
+	 * @param errorString A description of why the image failed to save, empty if it succeeded.
+	 */
+	public void saveCompleted(String filename,boolean successful,String errorString);
+}
+ 
+//
+// $Log$
+//
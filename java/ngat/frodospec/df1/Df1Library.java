@@ -136,6 +136,18 @@ public class Df1Library
 	 * @exception Df1LibraryNativeException This method throws a Df1LibraryNativeException if it failed.
 	 */
 	private native float Df1_Read_Float(String plcAddress) throws Df1LibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_df1 routine that reads a block of consecutive integer values 
+	 * from the PLC in one transaction.
+	 * @exception Df1LibraryNativeException This method throws a Df1LibraryNativeException if it failed.
+	 */
+	private native short[] Df1_Read_Integer_Block(String plcAddress,int count) throws Df1LibraryNativeException;
+	/**
+	 * Native wrapper to libfrodospec_df1 routine that reads a block of consecutive float values 
+	 * from the PLC in one transaction.
+	 * @exception Df1LibraryNativeException This method throws a Df1LibraryNativeException if it failed.
+	 */
+	private native float[] Df1_Read_Float_Block(String plcAddress,int count) throws Df1LibraryNativeException;
 
 // per instance variables
 	/**
@@ -339,6 +351,34 @@ public class Df1Library
 	{
 		return Df1_Read_Float(plcAddress);
 	}
+
+	/**
+	 * Method to read a block of consecutive integer values from the PLC, in one transaction.
+	 * At most 118 integers can be read at once.
+	 * @param plcAddress The memory location of the first integer to read, in the form: N20:0.
+	 * @param count The number of consecutive integers to read, i.e. 2 to read N20:0 and N20:1.
+	 * @return An array of length count containing the integer values.
+	 * @exception Df1LibraryNativeException This method throws a Df1LibraryNativeException if the read failed.
+	 * @see #Df1_Read_Integer_Block
+	 */
+	public short[] getIntegerBlock(String plcAddress,int count)  throws Df1LibraryNativeException
+	{
+		return Df1_Read_Integer_Block(plcAddress,count);
+	}
+
+	/**
+	 * Method to read a block of consecutive float values from the PLC, in one transaction.
+	 * At most 59 floats can be read at once.
+	 * @param plcAddress The memory location of the first float to read, in the form: F21:0.
+	 * @param count The number of consecutive floats to read, i.e. 11 to read F21:0 to F21:10.
+	 * @return An array of length count containing the float values.
+	 * @exception Df1LibraryNativeException This method throws a Df1LibraryNativeException if the read failed.
+	 * @see #Df1_Read_Float_Block
+	 */
+	public float[] getFloatBlock(String plcAddress,int count)  throws Df1LibraryNativeException
+	{
+		return Df1_Read_Float_Block(plcAddress,count);
+	}
 }
  
 //